@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#endif
+#include "../src/mixed.h"
+
+// Drives every registered segment with freshly filled buffers and
+// prints one CSV row per segment, channel count, and block size.
+// A sample is one frame in one buffer, so the rates are comparable
+// between segments with different numbers of inputs and outputs.
+// The channel count only applies to segments whose constructor asks
+// for one, everything else runs once with its own layout.
+//
+//   mixed-bench [-i iterations] [segment ...]
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define MAX_BUFFERS 64
+#define MAX_ARGS 16
+
+static uint32_t block_sizes[] = {64, 256, 1024, 4096};
+static uint8_t channel_counts[] = {1, 2, 8};
+static uint32_t iterations = 1000;
+static uint32_t samplerate = 44100;
+
+// Segments that need external resources or only wrap others.
+static const char *skipped[] = {"ladspa", "chain", "distribute", "graph", "queue", "commands", 0};
+
+struct bench{
+  struct mixed_segment segment;
+  struct mixed_buffer in[MAX_BUFFERS];
+  struct mixed_buffer out[MAX_BUFFERS];
+  struct mixed_pack pack;
+  char fill_pack;
+  uint32_t inputs;
+  uint32_t outputs;
+};
+
+union arg{
+  uint8_t u8;
+  uint32_t u32;
+  float f;
+  double d;
+  struct mixed_pack *pack;
+  char *string;
+};
+
+static uint64_t now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(){
+#ifdef HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int is_skipped(const char *name){
+  for(int i=0; skipped[i]; ++i){
+    if(strcmp(name, skipped[i]) == 0) return 1;
+  }
+  return 0;
+}
+
+static int is_channel_arg(const char *description){
+  return strcmp(description, "channels") == 0
+    || strcmp(description, "in") == 0
+    || strcmp(description, "out") == 0;
+}
+
+// Pick a plausible value for a constructor argument by its name.
+static int fill_arg(const struct mixed_segment_field_info *info, uint8_t channels, struct mixed_pack *pack, union arg *arg){
+  const char *description = info->description;
+  switch(info->type){
+  case MIXED_UINT8:
+  case MIXED_CHANNEL_T:
+    arg->u8 = is_channel_arg(description)? channels : 1;
+    return 1;
+  case MIXED_UINT32:
+    if(strcmp(description, "samplerate") == 0) arg->u32 = samplerate;
+    else if(strcmp(description, "frequency") == 0) arg->u32 = 1000;
+    else if(strcmp(description, "steps") == 0) arg->u32 = 8;
+    else if(strcmp(description, "voices") == 0) arg->u32 = 64;
+    else if(strcmp(description, "bands") == 0) arg->u32 = 10;
+    else if(strcmp(description, "busses") == 0) arg->u32 = 4;
+    else arg->u32 = 4096;
+    return 1;
+  case MIXED_FLOAT:
+    if(strcmp(description, "time") == 0) arg->f = 0.01f;
+    else if(strcmp(description, "pitch") == 0) arg->f = 1.5f;
+    else if(strcmp(description, "pan") == 0) arg->f = 0.25f;
+    else if(strcmp(description, "from") == 0) arg->f = 0.0f;
+    else arg->f = 0.5f;
+    return 1;
+  case MIXED_DOUBLE:
+    arg->d = 1.0;
+    return 1;
+  case MIXED_PACK_POINTER:
+    arg->pack = pack;
+    return 1;
+  case MIXED_BIQUAD_FILTER_ENUM:
+  case MIXED_NOISE_TYPE_ENUM:
+  case MIXED_GENERATOR_TYPE_ENUM:
+  case MIXED_FADE_TYPE_ENUM:
+    arg->u32 = 1;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void fill_buffer(struct mixed_buffer *buffer){
+  float *data;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_clear(buffer);
+  mixed_buffer_request_write(&data, &samples, buffer);
+  for(uint32_t i=0; i<samples; ++i){
+    data[i] = sinf(i*0.05f)*0.5f;
+  }
+  mixed_buffer_finish_write(samples, buffer);
+}
+
+// Put the buffers back into their filled or empty state. The data
+// written by fill_buffer stays in place, so only the indices move.
+static void reset(struct bench *bench){
+  void *area;
+  uint32_t size = UINT32_MAX;
+  for(uint32_t i=0; i<bench->inputs; ++i){
+    float *data;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_clear(&bench->in[i]);
+    mixed_buffer_request_write(&data, &samples, &bench->in[i]);
+    mixed_buffer_finish_write(samples, &bench->in[i]);
+  }
+  for(uint32_t i=0; i<bench->outputs; ++i){
+    mixed_buffer_clear(&bench->out[i]);
+  }
+  mixed_pack_clear(&bench->pack);
+  if(bench->fill_pack){
+    mixed_pack_request_write(&area, &size, &bench->pack);
+    mixed_pack_finish_write(size, &bench->pack);
+  }
+}
+
+static void free_bench(struct bench *bench){
+  mixed_free_segment(&bench->segment);
+  for(uint32_t i=0; i<MAX_BUFFERS; ++i){
+    mixed_free_buffer(&bench->in[i]);
+    mixed_free_buffer(&bench->out[i]);
+  }
+  mixed_free_pack(&bench->pack);
+}
+
+static int make_bench(char *name, uint8_t channels, uint32_t block, struct bench *bench){
+  uint32_t argc = 0;
+  const struct mixed_segment_field_info *args = 0;
+  union arg values[MAX_ARGS];
+  void *argv[MAX_ARGS];
+  struct mixed_segment_info info = {0};
+
+  memset(bench, 0, sizeof(struct bench));
+  if(!mixed_make_segment_info(name, &argc, &args) || MAX_ARGS < argc) return 0;
+  bench->pack.encoding = MIXED_INT16;
+  bench->pack.channels = channels;
+  bench->pack.samplerate = samplerate;
+  if(!mixed_make_pack(block, &bench->pack)) return 0;
+  for(uint32_t i=0; i<argc; ++i){
+    if(!fill_arg(&args[i], channels, &bench->pack, &values[i])) return 0;
+    if(args[i].type == MIXED_PACK_POINTER) argv[i] = &values[i].pack;
+    else argv[i] = &values[i];
+  }
+  if(!mixed_make_segment(name, argv, &bench->segment)) return 0;
+  if(!mixed_segment_info(&info, &bench->segment)) return 0;
+
+  // Variadic mixers get one source per output channel.
+  bench->inputs = info.min_inputs;
+  if(info.max_inputs == UINT32_MAX) bench->inputs = MAX(info.min_inputs, info.outputs);
+  bench->outputs = info.outputs;
+  if(MAX_BUFFERS < bench->inputs || MAX_BUFFERS < bench->outputs) return 0;
+  for(uint32_t i=0; i<bench->inputs; ++i){
+    if(!mixed_make_buffer(block, &bench->in[i])) return 0;
+    fill_buffer(&bench->in[i]);
+    if(!mixed_segment_set_in(MIXED_BUFFER, i, &bench->in[i], &bench->segment)) return 0;
+  }
+  for(uint32_t i=0; i<bench->outputs; ++i){
+    if(!mixed_make_buffer(block, &bench->out[i])) return 0;
+    if(!mixed_segment_set_out(MIXED_BUFFER, i, &bench->out[i], &bench->segment)) return 0;
+  }
+  // A pack that nothing feeds is the source of an unpacker.
+  bench->fill_pack = (info.min_inputs == 0);
+  return mixed_segment_start(&bench->segment);
+}
+
+static int run_bench(char *name, uint8_t channels, uint32_t block){
+  struct bench bench;
+  uint64_t ns = 0, cycles = 0;
+  int result = 0;
+  if(!make_bench(name, channels, block, &bench)){
+    fprintf(stderr, "Skipping %s (%u channels, %u samples): %s\n",
+            name, channels, block, mixed_error_string(-1));
+    goto cleanup;
+  }
+  // Warm up caches and any lazily built state first.
+  for(uint32_t i=0; i<iterations/10+1; ++i){
+    reset(&bench);
+    mixed_segment_mix(&bench.segment);
+  }
+  for(uint32_t i=0; i<iterations; ++i){
+    reset(&bench);
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = now_cycles();
+    if(!mixed_segment_mix(&bench.segment)) goto cleanup;
+    cycles += now_cycles() - start_cycles;
+    ns += now_ns() - start_ns;
+  }
+  mixed_segment_end(&bench.segment);
+
+  double samples = (double)iterations * block * MAX(1, MAX(bench.inputs, bench.outputs));
+  printf("%s,%u,%u,%u,%u,%u,%.0f,%.4f,",
+         name, channels, bench.inputs, bench.outputs, block, iterations,
+         samples / (ns / 1000000000.0), ns / samples);
+#ifdef HAVE_CYCLES
+  printf("%.4f\n", cycles / samples);
+#else
+  printf("\n");
+#endif
+  result = 1;
+
+ cleanup:
+  free_bench(&bench);
+  return result;
+}
+
+static int takes_channels(char *name){
+  uint32_t argc = 0;
+  const struct mixed_segment_field_info *args = 0;
+  if(!mixed_make_segment_info(name, &argc, &args)) return 0;
+  for(uint32_t i=0; i<argc; ++i){
+    if(is_channel_arg(args[i].description) || args[i].type == MIXED_PACK_POINTER)
+      return 1;
+  }
+  return 0;
+}
+
+static void bench_segment(char *name){
+  if(is_skipped(name)) return;
+  // Segments with a fixed layout only need one pass.
+  uint32_t passes = takes_channels(name)? sizeof(channel_counts) : 1;
+  for(uint32_t c=0; c<passes; ++c){
+    for(uint32_t b=0; b<sizeof(block_sizes)/sizeof(uint32_t); ++b){
+      run_bench(name, channel_counts[c], block_sizes[b]);
+    }
+  }
+}
+
+int main(int argc, char **argv){
+  uint32_t count = 0;
+  int first = 1;
+  if(2 < argc && strcmp(argv[1], "-i") == 0){
+    iterations = atoi(argv[2]);
+    first = 3;
+  }
+  printf("segment,channels,inputs,outputs,block,iterations,samples_per_sec,ns_per_sample,cycles_per_sample\n");
+  if(first < argc){
+    for(int i=first; i<argc; ++i){
+      bench_segment(argv[i]);
+    }
+    return 0;
+  }
+
+  if(!mixed_list_segments(&count, 0)) return 1;
+  char **names = calloc(count, sizeof(char *));
+  if(!names || !mixed_list_segments(&count, names)) return 1;
+  for(uint32_t i=0; i<count; ++i){
+    bench_segment(names[i]);
+  }
+  free(names);
+  return 0;
+}
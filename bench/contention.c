@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "../src/mixed.h"
+
+// Hands samples from a producer to a consumer thread over buffers and
+// packs of every kind, and prints one CSV row per kind and chunk size.
+// The two threads are pinned to different cores where possible. The
+// latency of a chunk is the time from the producer finishing its write
+// to the consumer finishing the read that completes it. Retries count
+// how often either side lost a race on the shared index, and are only
+// counted if the library was built with BUILD_RETRY_COUNTERS.
+//
+//   mixed-contention-bench [-n samples] [-s size]
+
+static uint32_t chunk_sizes[] = {16, 64, 256, 1024};
+static uint64_t total = 1 << 24;
+static uint32_t size = 4096;
+// Spinning on a single core only burns the other side's time slice.
+static int yield = 0;
+
+struct queue{
+  const char *name;
+  struct mixed_buffer buffer;
+  struct mixed_pack pack;
+  int is_pack;
+  int (*make)(struct queue *queue);
+};
+
+struct run{
+  struct queue *queue;
+  uint32_t chunk;
+  uint64_t chunks;
+  uint64_t *written;
+  uint64_t *latencies;
+  uint64_t errors;
+};
+
+static uint64_t now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static int make_buffer(struct queue *queue){
+  return mixed_make_buffer(size, &queue->buffer);
+}
+
+static int make_buffer_shared(struct queue *queue){
+  return mixed_make_buffer_shared(size, &queue->buffer);
+}
+
+static int make_buffer_mirrored(struct queue *queue){
+  return mixed_make_buffer_mirrored(size, &queue->buffer);
+}
+
+static int make_pack(struct queue *queue){
+  queue->pack.encoding = MIXED_FLOAT;
+  queue->pack.channels = 1;
+  queue->pack.samplerate = 48000;
+  return mixed_make_pack(size, &queue->pack);
+}
+
+static int make_pack_shared(struct queue *queue){
+  queue->pack.encoding = MIXED_FLOAT;
+  queue->pack.channels = 1;
+  queue->pack.samplerate = 48000;
+  return mixed_make_pack_shared(size, &queue->pack);
+}
+
+static struct queue queues[] = {
+  {.name = "buffer", .make = make_buffer},
+  {.name = "buffer-shared", .make = make_buffer_shared},
+  {.name = "buffer-mirrored", .make = make_buffer_mirrored},
+  {.name = "pack", .is_pack = 1, .make = make_pack},
+  {.name = "pack-shared", .is_pack = 1, .make = make_pack_shared},
+};
+
+// Sizes are in samples for both, packs being a single float channel.
+static int request_write(float **area, uint32_t *samples, struct queue *queue){
+  if(!queue->is_pack) return mixed_buffer_request_write(area, samples, &queue->buffer);
+  uint32_t bytes = *samples*sizeof(float);
+  int result = mixed_pack_request_write((void **)area, &bytes, &queue->pack);
+  *samples = bytes/sizeof(float);
+  return result && *samples;
+}
+
+static int finish_write(uint32_t samples, struct queue *queue){
+  if(!queue->is_pack) return mixed_buffer_finish_write(samples, &queue->buffer);
+  return mixed_pack_finish_write(samples*sizeof(float), &queue->pack);
+}
+
+static int request_read(float **area, uint32_t *samples, struct queue *queue){
+  if(!queue->is_pack) return mixed_buffer_request_read(area, samples, &queue->buffer);
+  uint32_t bytes = *samples*sizeof(float);
+  int result = mixed_pack_request_read((void **)area, &bytes, &queue->pack);
+  *samples = bytes/sizeof(float);
+  return result && *samples;
+}
+
+static int finish_read(uint32_t samples, struct queue *queue){
+  if(!queue->is_pack) return mixed_buffer_finish_read(samples, &queue->buffer);
+  return mixed_pack_finish_read(samples*sizeof(float), &queue->pack);
+}
+
+static void pin(int cpu){
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpu;
+#endif
+}
+
+// Writes whole chunks, and stamps each one as it is finished.
+static void *producer(void *arg){
+  struct run *run = (struct run *)arg;
+  uint64_t sample = 0;
+  pin(0);
+  for(uint64_t c=0; c<run->chunks; ++c){
+    uint32_t left = run->chunk;
+    while(0 < left){
+      float *area;
+      uint32_t samples = left;
+      if(!request_write(&area, &samples, run->queue)){
+        if(yield) sched_yield();
+        continue;
+      }
+      for(uint32_t i=0; i<samples; ++i)
+        area[i] = (float)((sample+i) & 0xFFFF);
+      __atomic_store_n(&run->written[c], now_ns(), __ATOMIC_RELAXED);
+      finish_write(samples, run->queue);
+      sample += samples;
+      left -= samples;
+    }
+  }
+  return 0;
+}
+
+static void *consumer(void *arg){
+  struct run *run = (struct run *)arg;
+  uint64_t sample = 0, end = run->chunks*run->chunk;
+  pin(1);
+  while(sample < end){
+    float *area;
+    uint32_t samples = run->chunk;
+    if(!request_read(&area, &samples, run->queue)){
+      if(yield) sched_yield();
+      continue;
+    }
+    for(uint32_t i=0; i<samples; ++i){
+      if(area[i] != (float)((sample+i) & 0xFFFF)) run->errors++;
+    }
+    finish_read(samples, run->queue);
+    uint64_t time = now_ns();
+    for(uint64_t c=sample/run->chunk; c<(sample+samples)/run->chunk; ++c)
+      run->latencies[c] = time - __atomic_load_n(&run->written[c], __ATOMIC_RELAXED);
+    sample += samples;
+  }
+  return 0;
+}
+
+static int compare(const void *a, const void *b){
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x < y)? -1 : (y < x);
+}
+
+static int run_bench(struct queue *queue, uint32_t chunk){
+  struct run run = {0};
+  pthread_t threads[2];
+  uint64_t write_retries[2], read_retries[2];
+  int result = 0;
+
+  memset(&queue->buffer, 0, sizeof(queue->buffer));
+  memset(&queue->pack, 0, sizeof(queue->pack));
+  if(!queue->make(queue)){
+    fprintf(stderr, "Skipping %s: %s\n", queue->name, mixed_error_string(-1));
+    return 0;
+  }
+  run.queue = queue;
+  run.chunk = chunk;
+  run.chunks = total / chunk;
+  run.written = calloc(run.chunks, sizeof(uint64_t));
+  run.latencies = calloc(run.chunks, sizeof(uint64_t));
+  if(!run.written || !run.latencies) goto cleanup;
+
+  mixed_buffer_retries(&write_retries[0], &read_retries[0]);
+  uint64_t start = now_ns();
+  if(pthread_create(&threads[0], 0, consumer, &run) != 0) goto cleanup;
+  if(pthread_create(&threads[1], 0, producer, &run) != 0){
+    pthread_cancel(threads[0]);
+    goto cleanup;
+  }
+  pthread_join(threads[1], 0);
+  pthread_join(threads[0], 0);
+  uint64_t elapsed = now_ns() - start;
+  mixed_buffer_retries(&write_retries[1], &read_retries[1]);
+
+  qsort(run.latencies, run.chunks, sizeof(uint64_t), compare);
+  double samples = (double)run.chunks * chunk;
+  printf("%s,%u,%u,%.0f,%.0f,%llu,%llu,%llu,%.6f,%.6f,%llu\n",
+         queue->name, chunk, size, samples, samples / (elapsed / 1000000000.0),
+         (unsigned long long)run.latencies[run.chunks/2],
+         (unsigned long long)run.latencies[run.chunks - run.chunks/100 - 1],
+         (unsigned long long)run.latencies[run.chunks-1],
+         (write_retries[1] - write_retries[0]) / (double)run.chunks,
+         (read_retries[1] - read_retries[0]) / (double)run.chunks,
+         (unsigned long long)run.errors);
+  result = 1;
+
+ cleanup:
+  free(run.written);
+  free(run.latencies);
+  if(queue->is_pack) mixed_free_pack(&queue->pack);
+  else mixed_free_buffer(&queue->buffer);
+  return result;
+}
+
+int main(int argc, char **argv){
+  for(int i=1; i+1<argc; i+=2){
+    if(strcmp(argv[i], "-n") == 0) total = strtoull(argv[i+1], 0, 10);
+    else if(strcmp(argv[i], "-s") == 0) size = atoi(argv[i+1]);
+  }
+  if(sysconf(_SC_NPROCESSORS_ONLN) < 2){
+    fprintf(stderr, "Only one processor is online, the latencies will reflect scheduling.\n");
+    yield = 1;
+  }
+  printf("queue,chunk,size,samples,samples_per_sec,p50_latency_ns,p99_latency_ns,max_latency_ns,write_retries_per_chunk,read_retries_per_chunk,errors\n");
+  for(uint32_t q=0; q<sizeof(queues)/sizeof(queues[0]); ++q){
+    for(uint32_t c=0; c<sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); ++c){
+      if(size < chunk_sizes[c]) continue;
+      run_bench(&queues[q], chunk_sizes[c]);
+    }
+  }
+  return 0;
+}
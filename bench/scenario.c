@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../src/mixed.h"
+
+// Builds the pipelines of the example programs with synthetic sources
+// in place of the decoders and the output device, and runs them as
+// fast as possible. Every source is a stereo 16 bit pack unpacked into
+// the graph like a decoded file, and the graph ends in a packer into a
+// 16 bit pack at the output rate like a device. Only the parameter
+// updates and the chain mix are timed, as filling the sources and
+// draining the output stand in for the decoder and the device.
+// Prints one CSV row per scenario and source count. A realtime factor
+// of 10 means a callback takes a tenth of the time it has for a block.
+//
+//   mixed-scenario-bench [-n sources] [-t seconds] [-b block] [scenario ...]
+
+#define MAX_SCALES 4
+
+static uint32_t samplerate = 44100;
+static uint32_t output_samplerate = 48000;
+static uint32_t block = 100;
+static double seconds = 10.0;
+static uint32_t sources_override = 0;
+
+struct source{
+  struct mixed_pack pack;
+  struct mixed_segment segment;
+  struct mixed_buffer left;
+  struct mixed_buffer right;
+  uint32_t seed;
+};
+
+struct graph{
+  struct mixed_segment chain;
+  struct mixed_segment mixer;
+  struct mixed_pack pack;
+  struct mixed_segment packer;
+  struct mixed_buffer left;
+  struct mixed_buffer right;
+  struct source *sources;
+  uint32_t source_count;
+  // Per-source segments and buffers, allocated up front so that the
+  // addresses handed to the segments stay put.
+  struct mixed_segment *segments;
+  uint32_t segment_count;
+  struct mixed_buffer *buffers;
+  uint32_t buffer_count;
+  uint32_t count;
+  uint64_t callback;
+};
+
+struct scenario{
+  const char *name;
+  uint32_t scales[MAX_SCALES];
+  int (*build)(struct graph *graph);
+  void (*update)(struct graph *graph);
+};
+
+static uint64_t now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static struct mixed_segment *new_segment(struct graph *graph){
+  return &graph->segments[graph->segment_count++];
+}
+
+static struct mixed_buffer *new_buffer(struct graph *graph){
+  struct mixed_buffer *buffer = &graph->buffers[graph->buffer_count];
+  if(!mixed_make_buffer(block, buffer)) return 0;
+  graph->buffer_count++;
+  return buffer;
+}
+
+static struct source *new_source(struct graph *graph){
+  struct source *source = &graph->sources[graph->source_count];
+  source->pack.encoding = MIXED_INT16;
+  source->pack.channels = 2;
+  source->pack.samplerate = samplerate;
+  source->seed = 0x9E3779B9u * (graph->source_count+1);
+  if(!mixed_make_pack(block, &source->pack)) return 0;
+  graph->source_count++;
+  if(!mixed_make_segment_unpacker(&source->pack, samplerate, &source->segment)
+     || !mixed_make_buffer(block, &source->left)
+     || !mixed_make_buffer(block, &source->right)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &source->left, &source->segment)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &source->right, &source->segment)
+     || !mixed_chain_add(&source->segment, &graph->chain))
+    return 0;
+  return source;
+}
+
+// Stands in for the decoder, topping the pack up with noise.
+static void fill_source(struct source *source){
+  int16_t *area;
+  uint32_t bytes = UINT32_MAX;
+  mixed_pack_request_write((void **)&area, &bytes, &source->pack);
+  for(uint32_t i=0; i<bytes/sizeof(int16_t); ++i){
+    source->seed = source->seed*1664525u + 1013904223u;
+    area[i] = (int16_t)(source->seed >> 18);
+  }
+  mixed_pack_finish_write(bytes, &source->pack);
+}
+
+// Stands in for the device, taking everything that was packed.
+static void drain_output(struct graph *graph){
+  void *area;
+  uint32_t bytes = UINT32_MAX;
+  mixed_pack_request_read(&area, &bytes, &graph->pack);
+  mixed_pack_finish_read(bytes, &graph->pack);
+}
+
+static int attach_stereo(struct mixed_buffer *left, struct mixed_buffer *right, uint32_t i, struct graph *graph){
+  return mixed_segment_set_in(MIXED_BUFFER, i*2, left, &graph->mixer)
+    && mixed_segment_set_in(MIXED_BUFFER, i*2+1, right, &graph->mixer);
+}
+
+// examples/mix.c: every file into one basic mixer.
+static int build_mix(struct graph *graph){
+  if(!mixed_make_segment_basic_mixer(2, &graph->mixer)) return 0;
+  for(uint32_t i=0; i<graph->count; ++i){
+    struct source *source = new_source(graph);
+    if(!source || !attach_stereo(&source->left, &source->right, i, graph)) return 0;
+  }
+  return mixed_chain_add(&graph->mixer, &graph->chain);
+}
+
+// examples/space.c: every file downmixed and placed in the space mixer.
+static int build_space(struct graph *graph){
+  if(!mixed_make_segment_space_mixer(samplerate, &graph->mixer)) return 0;
+  for(uint32_t i=0; i<graph->count; ++i){
+    struct source *source = new_source(graph);
+    struct mixed_segment *downmix = new_segment(graph);
+    struct mixed_buffer *mono = new_buffer(graph);
+    if(!source || !mono
+       || !mixed_make_segment_channel_convert(2, 1, samplerate, downmix)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &source->left, downmix)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &source->right, downmix)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, mono, downmix)
+       || !mixed_segment_set_in(MIXED_BUFFER, i, mono, &graph->mixer)
+       || !mixed_chain_add(downmix, &graph->chain))
+      return 0;
+  }
+  return mixed_chain_add(&graph->mixer, &graph->chain);
+}
+
+// Moves every source around the listener on its own circle, as the
+// example does with its one source.
+static void update_space(struct graph *graph){
+  double t = graph->callback * (double)block / samplerate;
+  float doppler = 1.0;
+  for(uint32_t i=0; i<graph->count; ++i){
+    double phi = t * (1.0 + i % 7) + i;
+    float r = 100.0 + 10.0 * (i % 13);
+    float pos[3] = {r*cos(phi), 0.0, r*sin(phi)};
+    float vel[3] = {-r*sin(phi), 0.0, r*cos(phi)};
+    mixed_segment_set_in(MIXED_SPACE_LOCATION, i, pos, &graph->mixer);
+    mixed_segment_set_in(MIXED_SPACE_VELOCITY, i, vel, &graph->mixer);
+  }
+  mixed_segment_set(MIXED_SPACE_DOPPLER_FACTOR, &doppler, &graph->mixer);
+}
+
+// examples/effect.c: a speed change on both channels of every file,
+// mixed together instead of played one at a time.
+static int build_effect(struct graph *graph){
+  if(!mixed_make_segment_basic_mixer(2, &graph->mixer)) return 0;
+  for(uint32_t i=0; i<graph->count; ++i){
+    struct source *source = new_source(graph);
+    struct mixed_segment *sfx_l = new_segment(graph);
+    struct mixed_segment *sfx_r = new_segment(graph);
+    struct mixed_buffer *left = new_buffer(graph);
+    struct mixed_buffer *right = new_buffer(graph);
+    double speed = 0.8 + 0.4 * (i % 9) / 8.0;
+    if(!source || !left || !right
+       || !mixed_make_segment_speed_change(speed, sfx_l)
+       || !mixed_make_segment_speed_change(speed, sfx_r)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &source->left, sfx_l)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, left, sfx_l)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &source->right, sfx_r)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, right, sfx_r)
+       || !attach_stereo(left, right, i, graph)
+       || !mixed_chain_add(sfx_l, &graph->chain)
+       || !mixed_chain_add(sfx_r, &graph->chain))
+      return 0;
+  }
+  return mixed_chain_add(&graph->mixer, &graph->chain);
+}
+
+// examples/tone.c: a faded generator upmixed to stereo, once per voice.
+static int build_tone(struct graph *graph){
+  if(!mixed_make_segment_basic_mixer(2, &graph->mixer)) return 0;
+  for(uint32_t i=0; i<graph->count; ++i){
+    struct mixed_segment *generator = new_segment(graph);
+    struct mixed_segment *fade = new_segment(graph);
+    struct mixed_segment *upmix = new_segment(graph);
+    struct mixed_buffer *mono = new_buffer(graph);
+    struct mixed_buffer *left = new_buffer(graph);
+    struct mixed_buffer *right = new_buffer(graph);
+    if(!mono || !left || !right
+       || !mixed_make_segment_generator(MIXED_SINE + i % 4, 220 + 5*i, samplerate, generator)
+       || !mixed_make_segment_fade(0.0, 0.8, 5.0, MIXED_CUBIC_IN_OUT, samplerate, fade)
+       || !mixed_make_segment_channel_convert(1, 2, samplerate, upmix)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, mono, generator)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, mono, fade)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, mono, fade)
+       || !mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, mono, upmix)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, left, upmix)
+       || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, right, upmix)
+       || !attach_stereo(left, right, i, graph)
+       || !mixed_chain_add(generator, &graph->chain)
+       || !mixed_chain_add(fade, &graph->chain)
+       || !mixed_chain_add(upmix, &graph->chain))
+      return 0;
+  }
+  return mixed_chain_add(&graph->mixer, &graph->chain);
+}
+
+static struct scenario scenarios[] = {
+  {.name = "mix", .scales = {1, 16, 64}, .build = build_mix},
+  {.name = "space", .scales = {1, 16, 64, 256}, .build = build_space, .update = update_space},
+  {.name = "effect", .scales = {1, 16, 64}, .build = build_effect},
+  {.name = "tone", .scales = {1, 16, 64, 256}, .build = build_tone},
+};
+
+static void free_graph(struct graph *graph){
+  mixed_free_segment(&graph->chain);
+  mixed_free_segment(&graph->mixer);
+  mixed_free_segment(&graph->packer);
+  mixed_free_pack(&graph->pack);
+  mixed_free_buffer(&graph->left);
+  mixed_free_buffer(&graph->right);
+  if(graph->sources){
+    for(uint32_t i=0; i<graph->source_count; ++i){
+      mixed_free_segment(&graph->sources[i].segment);
+      mixed_free_pack(&graph->sources[i].pack);
+      mixed_free_buffer(&graph->sources[i].left);
+      mixed_free_buffer(&graph->sources[i].right);
+    }
+    free(graph->sources);
+  }
+  if(graph->segments){
+    for(uint32_t i=0; i<graph->segment_count; ++i)
+      mixed_free_segment(&graph->segments[i]);
+    free(graph->segments);
+  }
+  if(graph->buffers){
+    for(uint32_t i=0; i<graph->buffer_count; ++i)
+      mixed_free_buffer(&graph->buffers[i]);
+    free(graph->buffers);
+  }
+}
+
+static int make_graph(struct scenario *scenario, uint32_t count, struct graph *graph){
+  graph->count = count;
+  graph->sources = calloc(count, sizeof(struct source));
+  graph->segments = calloc(3*count, sizeof(struct mixed_segment));
+  graph->buffers = calloc(3*count, sizeof(struct mixed_buffer));
+  if(!graph->sources || !graph->segments || !graph->buffers) return 0;
+
+  graph->pack.encoding = MIXED_INT16;
+  graph->pack.channels = 2;
+  graph->pack.samplerate = output_samplerate;
+  if(!mixed_make_segment_chain(&graph->chain)
+     || !scenario->build(graph)
+     || !mixed_make_pack(block, &graph->pack)
+     || !mixed_make_buffer(block, &graph->left)
+     || !mixed_make_buffer(block, &graph->right)
+     || !mixed_make_segment_packer(&graph->pack, samplerate, &graph->packer)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &graph->left, &graph->mixer)
+     || !mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &graph->right, &graph->mixer)
+     || !mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &graph->left, &graph->packer)
+     || !mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &graph->right, &graph->packer)
+     || !mixed_chain_add(&graph->packer, &graph->chain))
+    return 0;
+  return 1;
+}
+
+static int compare(const void *a, const void *b){
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x < y)? -1 : (y < x);
+}
+
+static int run_scenario(struct scenario *scenario, uint32_t count){
+  struct graph graph = {0};
+  uint64_t callbacks = (uint64_t)(seconds * samplerate / block);
+  uint64_t *times = calloc((callbacks)? callbacks : 1, sizeof(uint64_t));
+  uint64_t total = 0;
+  int result = 0;
+
+  if(!times || !make_graph(scenario, count, &graph)){
+    fprintf(stderr, "Skipping %s with %u sources: %s\n", scenario->name, count, mixed_error_string(-1));
+    goto cleanup;
+  }
+
+  mixed_segment_start(&graph.chain);
+  for(graph.callback=0; graph.callback<callbacks; ++graph.callback){
+    for(uint32_t i=0; i<graph.source_count; ++i)
+      fill_source(&graph.sources[i]);
+    uint64_t start = now_ns();
+    if(scenario->update) scenario->update(&graph);
+    mixed_segment_mix(&graph.chain);
+    uint64_t time = now_ns() - start;
+    times[graph.callback] = time;
+    total += time;
+    if(mixed_error() != MIXED_NO_ERROR){
+      fprintf(stderr, "Failure during %s: %s\n", scenario->name, mixed_error_string(-1));
+      mixed_segment_end(&graph.chain);
+      goto cleanup;
+    }
+    drain_output(&graph);
+  }
+  mixed_segment_end(&graph.chain);
+
+  if(callbacks){
+    double budget = 1000000000.0 * block / samplerate;
+    qsort(times, callbacks, sizeof(uint64_t), compare);
+    printf("%s,%u,%u,%llu,%.2f,%llu,%llu,%llu,%.0f\n",
+           scenario->name, count, block, (unsigned long long)callbacks,
+           (total)? budget * callbacks / total : 0.0,
+           (unsigned long long)times[callbacks/2],
+           (unsigned long long)times[callbacks - callbacks/100 - 1],
+           (unsigned long long)times[callbacks-1],
+           budget);
+  }
+  result = 1;
+
+ cleanup:
+  free_graph(&graph);
+  free(times);
+  return result;
+}
+
+int main(int argc, char **argv){
+  const char *names[sizeof(scenarios)/sizeof(scenarios[0])];
+  uint32_t name_count = 0;
+
+  for(int i=1; i<argc; ++i){
+    if(strcmp(argv[i], "-n") == 0 && i+1<argc) sources_override = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-t") == 0 && i+1<argc) seconds = strtod(argv[++i], 0);
+    else if(strcmp(argv[i], "-b") == 0 && i+1<argc) block = atoi(argv[++i]);
+    else if(name_count < sizeof(names)/sizeof(names[0])) names[name_count++] = argv[i];
+  }
+  if(block == 0){
+    fprintf(stderr, "The block size must be positive.\n");
+    return 1;
+  }
+
+  printf("scenario,sources,block,callbacks,realtime_factor,p50_callback_ns,p99_callback_ns,max_callback_ns,budget_ns\n");
+  for(uint32_t s=0; s<sizeof(scenarios)/sizeof(scenarios[0]); ++s){
+    struct scenario *scenario = &scenarios[s];
+    int selected = (name_count == 0);
+    for(uint32_t i=0; i<name_count; ++i){
+      if(strcmp(names[i], scenario->name) == 0) selected = 1;
+    }
+    if(!selected) continue;
+    if(sources_override){
+      run_scenario(scenario, sources_override);
+    }else{
+      for(uint32_t i=0; i<MAX_SCALES && scenario->scales[i]; ++i)
+        run_scenario(scenario, scenario->scales[i]);
+    }
+  }
+  return 0;
+}
@@ -6,6 +6,18 @@
   char FULL_R2 = WRITE ## _ >> 31;                      \
   uint32_t WRITE = WRITE ## _ & 0x7FFFFFFF;
 
+// Compare and swap retries of writers and readers over all bip buffers
+// and packs, as a measure of contention. Only the retry paths count.
+// The shared counters would themselves add to the contention they
+// measure, so they are only kept in builds that ask for them.
+extern uint64_t bip_write_retries;
+extern uint64_t bip_read_retries;
+#ifdef MIXED_RETRY_COUNTERS
+#define bip_count_retry(COUNTER) __atomic_add_fetch(&COUNTER, 1, __ATOMIC_RELAXED)
+#else
+#define bip_count_retry(COUNTER)
+#endif
+
 static inline int bip_request_write(uint32_t *off, uint32_t *size, struct bip *buffer){
   mixed_err(MIXED_NO_ERROR);
   uint32_t to_write = *size;
@@ -50,8 +62,10 @@ static inline int bip_finish_write(uint32_t size, struct bip *buffer){
   }
  retry: {
     uint32_t write = atomic_read(buffer->write);
-    if(!atomic_cas(buffer->write, write, write+size))
+    if(!atomic_cas(buffer->write, write, write+size)){
+      bip_count_retry(bip_write_retries);
       goto retry;
+    }
   }
   buffer->reserved = 0;
   return 1;
@@ -67,6 +81,7 @@ static inline int bip_request_read(uint32_t *off, uint32_t *size, struct bip *bu
     }else if(0 < write){ // We are at the end and need to wrap now.
     retry:
       if(!atomic_cas(buffer->write, write_, write)){
+        bip_count_retry(bip_read_retries);
         write_ = atomic_read(buffer->write);
         write = write_ & 0x7FFFFFFF;
         goto retry;
@@ -132,3 +147,232 @@ static inline uint32_t bip_available_write(struct bip *buffer){
   else
     return buffer->size - write;
 }
+
+// Mirrored buffers map their storage twice back to back, so any span
+// of up to size elements starting inside the first half is contiguous.
+// That lets them behave as a plain ring instead of a bip buffer. The
+// indices run over [0, 2*size) so that a full ring can be told apart
+// from an empty one without a flag bit.
+static inline uint32_t ring_used(uint32_t read, uint32_t write, uint32_t size){
+  return (read <= write)? write - read : write + 2*size - read;
+}
+
+static inline int ring_request_write(uint32_t *off, uint32_t *size, struct bip *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  uint32_t read = atomic_read(buffer->read);
+  uint32_t write = buffer->write;
+  uint32_t available = buffer->size - ring_used(read, write, buffer->size);
+  if(available == 0){
+    *size = 0;
+    *off = 0;
+    return 0;
+  }
+  *size = MIN(*size, available);
+  *off = (write < buffer->size)? write : write - buffer->size;
+  buffer->reserved = *size;
+  return 1;
+}
+
+static inline int ring_finish_write(uint32_t size, struct bip *buffer){
+  if(buffer->reserved < size){
+    mixed_err(MIXED_BUFFER_OVERCOMMIT);
+    return 0;
+  }
+  uint32_t write = buffer->write + size;
+  if(2*buffer->size <= write) write -= 2*buffer->size;
+  atomic_write(buffer->write, write);
+  buffer->reserved = 0;
+  return 1;
+}
+
+static inline int ring_request_read(uint32_t *off, uint32_t *size, struct bip *buffer){
+  uint32_t read = buffer->read;
+  uint32_t write = atomic_read(buffer->write);
+  uint32_t available = ring_used(read, write, buffer->size);
+  if(available == 0){
+    *size = 0;
+    *off = 0;
+    return 0;
+  }
+  *size = MIN(*size, available);
+  *off = (read < buffer->size)? read : read - buffer->size;
+  return 1;
+}
+
+static inline int ring_finish_read(uint32_t size, struct bip *buffer){
+  uint32_t read = buffer->read;
+  uint32_t write = atomic_read(buffer->write);
+  if(ring_used(read, write, buffer->size) < size){
+    mixed_err(MIXED_BUFFER_OVERCOMMIT);
+    return 0;
+  }
+  read += size;
+  if(2*buffer->size <= read) read -= 2*buffer->size;
+  atomic_write(buffer->read, read);
+  return 1;
+}
+
+static inline uint32_t ring_available_read(struct bip *buffer){
+  return ring_used(atomic_read(buffer->read), atomic_read(buffer->write), buffer->size);
+}
+
+static inline uint32_t ring_available_write(struct bip *buffer){
+  return buffer->size - ring_available_read(buffer);
+}
+
+// Shared buffers keep their indices in a separate block, with the
+// producer's and the consumer's state on different cache lines. Each
+// side also caches the last index it saw from the other side and only
+// reloads it when the cached value does not allow the request, so
+// that the lines are not pulled across cores on every call.
+
+struct shared_ring{
+  // Producer side
+  uint32_t write;
+  uint32_t cached_read;
+  uint32_t reserved;
+  char _pad0[CACHE_LINE_SIZE - 3*sizeof(uint32_t)];
+  // Consumer side
+  uint32_t read;
+  uint32_t cached_write;
+  char _pad1[CACHE_LINE_SIZE - 2*sizeof(uint32_t)];
+  // Read-only after construction
+  void *allocation;
+};
+
+static inline int shared_request_write(uint32_t *off, uint32_t *size, uint32_t capacity, struct shared_ring *ring){
+  mixed_err(MIXED_NO_ERROR);
+  uint32_t write = ring->write;
+  uint32_t pos = (write < capacity)? write : write - capacity;
+  uint32_t wanted = MIN(*size, capacity - pos);
+  uint32_t available = capacity - ring_used(ring->cached_read, write, capacity);
+  if(available < wanted){
+    ring->cached_read = atomic_read(ring->read);
+    available = capacity - ring_used(ring->cached_read, write, capacity);
+  }
+  if(available == 0){
+    *size = 0;
+    *off = 0;
+    return 0;
+  }
+  *size = MIN(wanted, available);
+  *off = pos;
+  ring->reserved = *size;
+  return 1;
+}
+
+static inline int shared_finish_write(uint32_t size, uint32_t capacity, struct shared_ring *ring){
+  if(ring->reserved < size){
+    mixed_err(MIXED_BUFFER_OVERCOMMIT);
+    return 0;
+  }
+  uint32_t write = ring->write + size;
+  if(2*capacity <= write) write -= 2*capacity;
+  atomic_write(ring->write, write);
+  ring->reserved = 0;
+  return 1;
+}
+
+static inline int shared_request_read(uint32_t *off, uint32_t *size, uint32_t capacity, struct shared_ring *ring){
+  uint32_t read = ring->read;
+  uint32_t pos = (read < capacity)? read : read - capacity;
+  uint32_t wanted = MIN(*size, capacity - pos);
+  uint32_t available = ring_used(read, ring->cached_write, capacity);
+  if(available < wanted){
+    ring->cached_write = atomic_read(ring->write);
+    available = ring_used(read, ring->cached_write, capacity);
+  }
+  if(available == 0){
+    *size = 0;
+    *off = 0;
+    return 0;
+  }
+  *size = MIN(wanted, available);
+  *off = pos;
+  return 1;
+}
+
+static inline int shared_finish_read(uint32_t size, uint32_t capacity, struct shared_ring *ring){
+  uint32_t read = ring->read;
+  // Anything we were handed is covered by the cached write index.
+  if(ring_used(read, ring->cached_write, capacity) < size){
+    ring->cached_write = atomic_read(ring->write);
+    if(ring_used(read, ring->cached_write, capacity) < size){
+      mixed_err(MIXED_BUFFER_OVERCOMMIT);
+      return 0;
+    }
+  }
+  read += size;
+  if(2*capacity <= read) read -= 2*capacity;
+  atomic_write(ring->read, read);
+  return 1;
+}
+
+static inline uint32_t shared_available_read(uint32_t capacity, struct shared_ring *ring){
+  uint32_t read = atomic_read(ring->read);
+  uint32_t write = atomic_read(ring->write);
+  uint32_t pos = (read < capacity)? read : read - capacity;
+  return MIN(ring_used(read, write, capacity), capacity - pos);
+}
+
+static inline uint32_t shared_available_write(uint32_t capacity, struct shared_ring *ring){
+  uint32_t read = atomic_read(ring->read);
+  uint32_t write = atomic_read(ring->write);
+  uint32_t pos = (write < capacity)? write : write - capacity;
+  return MIN(capacity - ring_used(read, write, capacity), capacity - pos);
+}
+
+static inline void shared_clear(struct shared_ring *ring){
+  ring->write = 0;
+  ring->cached_read = 0;
+  ring->reserved = 0;
+  ring->read = 0;
+  ring->cached_write = 0;
+}
+
+// Allocates the index block and the data in one go, with the block
+// aligned to a cache line and the data following it.
+static inline struct shared_ring *make_shared_ring(size_t bytes, void **data){
+  char *allocation = mixed_calloc(1, sizeof(struct shared_ring) + CACHE_LINE_SIZE + bytes);
+  if(!allocation){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  uintptr_t aligned = ((uintptr_t)allocation + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+  struct shared_ring *ring = (struct shared_ring *)aligned;
+  ring->allocation = allocation;
+  *data = (char *)ring + sizeof(struct shared_ring);
+  return ring;
+}
+
+static inline void free_shared_ring(struct shared_ring *ring){
+  if(ring) mixed_free(ring->allocation);
+}
+
+// Usage counters, updated after every request and finish on buffers
+// and packs that have them enabled. The reading and writing sides
+// each only touch their own counters.
+static inline void stats_request_read(uint32_t requested, uint32_t granted, uint32_t level, struct mixed_buffer_stats *stats){
+  if(granted == 0) stats->starved_reads++;
+  else if(granted < requested && requested != UINT32_MAX) stats->short_reads++;
+  if(level < stats->low_water) stats->low_water = level;
+}
+
+static inline void stats_request_write(uint32_t requested, uint32_t granted, struct mixed_buffer_stats *stats){
+  if(granted == 0) stats->full_writes++;
+  else if(granted < requested && requested != UINT32_MAX) stats->short_writes++;
+}
+
+static inline void stats_finish_read(uint32_t size, struct mixed_buffer_stats *stats){
+  stats->read += size;
+}
+
+static inline void stats_finish_write(uint32_t size, uint32_t level, struct mixed_buffer_stats *stats){
+  stats->written += size;
+  if(stats->high_water < level) stats->high_water = level;
+}
+
+static inline void stats_reset(struct mixed_buffer_stats *stats){
+  memset(stats, 0, sizeof(struct mixed_buffer_stats));
+  stats->low_water = UINT32_MAX;
+}
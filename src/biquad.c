@@ -34,12 +34,160 @@ VECTORIZE void biquad_process(struct mixed_buffer *input, struct mixed_buffer *o
 
   state->x[0] = xn1;
   state->x[1] = xn2;
-  state->y[0] = yn1;
-  state->y[1] = yn2;
+  state->y[0] = undenormal(yn1);
+  state->y[1] = undenormal(yn2);
 }
 
 extern inline void biquad_reset(struct biquad_data *state);
 
+static inline uint32_t biquad_bank_groups(channel_t channels){
+  return (channels+BIQUAD_LANES-1)/BIQUAD_LANES;
+}
+
+int make_biquad_bank(channel_t channels, uint32_t stages, struct biquad_bank *bank){
+  if(channels == 0 || stages == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint32_t count = biquad_bank_groups(channels)*stages;
+  bank->sections = mixed_calloc(count, sizeof(struct biquad_section));
+  if(!bank->sections){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  // Every section starts out passing its input through unchanged, so
+  // that a cascade only needs to set the stages it actually uses.
+  for(uint32_t i=0; i<count; ++i){
+    for(uint32_t l=0; l<BIQUAD_LANES; ++l){
+      bank->sections[i].b0[l] = 1.0f;
+    }
+  }
+  bank->channels = channels;
+  bank->stages = stages;
+  return 1;
+}
+
+void free_biquad_bank(struct biquad_bank *bank){
+  if(bank->sections)
+    mixed_free(bank->sections);
+  bank->sections = 0;
+  bank->channels = 0;
+  bank->stages = 0;
+}
+
+void biquad_bank_set(channel_t channel, uint32_t stage, struct biquad_data *design, struct biquad_bank *bank){
+  struct biquad_section *section = &bank->sections[(channel/BIQUAD_LANES)*bank->stages + stage];
+  uint32_t l = channel % BIQUAD_LANES;
+  section->b0[l] = design->b[0];
+  section->b1[l] = design->b[1];
+  section->b2[l] = design->b[2];
+  section->a1[l] = design->a[0];
+  section->a2[l] = design->a[1];
+}
+
+void biquad_bank_reset(struct biquad_bank *bank){
+  uint32_t count = biquad_bank_groups(bank->channels)*bank->stages;
+  for(uint32_t i=0; i<count; ++i){
+    memset(bank->sections[i].z1, 0, sizeof(bank->sections[i].z1));
+    memset(bank->sections[i].z2, 0, sizeof(bank->sections[i].z2));
+  }
+}
+
+// Runs every stage over an interleaved chunk in place. One frame of a
+// group is a single vector, and the section is held in registers for
+// the whole chunk.
+#ifdef __GNUC__
+typedef float biquad_vector __attribute__((vector_size(BIQUAD_LANES*sizeof(float))));
+
+VECTORIZE static void biquad_bank_run(float frames[BIQUAD_CHUNK][BIQUAD_LANES], uint32_t samples, struct biquad_section *sections, uint32_t stages){
+  for(uint32_t s=0; s<stages; ++s){
+    biquad_vector b0, b1, b2, a1, a2, z1, z2;
+    memcpy(&b0, sections[s].b0, sizeof(b0));
+    memcpy(&b1, sections[s].b1, sizeof(b1));
+    memcpy(&b2, sections[s].b2, sizeof(b2));
+    memcpy(&a1, sections[s].a1, sizeof(a1));
+    memcpy(&a2, sections[s].a2, sizeof(a2));
+    memcpy(&z1, sections[s].z1, sizeof(z1));
+    memcpy(&z2, sections[s].z2, sizeof(z2));
+    // Substituting y into the state update takes the output off the
+    // recurrence, which shortens the dependency chain between samples.
+    biquad_vector c1 = b1 - a1 * b0, c2 = b2 - a2 * b0;
+    for(uint32_t i=0; i<samples; ++i){
+      biquad_vector x, y, z;
+      memcpy(&x, frames[i], sizeof(x));
+      y = b0 * x + z1;
+      z = (c1 * x + z2) - a1 * z1;
+      z2 = c2 * x - a2 * z1;
+      z1 = z;
+      memcpy(frames[i], &y, sizeof(y));
+    }
+    z1 = undenormal(z1);
+    z2 = undenormal(z2);
+    memcpy(sections[s].z1, &z1, sizeof(z1));
+    memcpy(sections[s].z2, &z2, sizeof(z2));
+  }
+}
+#else
+static void biquad_bank_run(float frames[BIQUAD_CHUNK][BIQUAD_LANES], uint32_t samples, struct biquad_section *sections, uint32_t stages){
+  for(uint32_t s=0; s<stages; ++s){
+    struct biquad_section *section = &sections[s];
+    for(uint32_t i=0; i<samples; ++i){
+      for(uint32_t l=0; l<BIQUAD_LANES; ++l){
+        float x = frames[i][l];
+        float y = section->b0[l] * x + section->z1[l];
+        section->z1[l] = section->b1[l] * x - section->a1[l] * y + section->z2[l];
+        section->z2[l] = section->b2[l] * x - section->a2[l] * y;
+        frames[i][l] = y;
+      }
+    }
+    for(uint32_t l=0; l<BIQUAD_LANES; ++l){
+      section->z1[l] = undenormal(section->z1[l]);
+      section->z2[l] = undenormal(section->z2[l]);
+    }
+  }
+}
+#endif
+
+// The input of a chunk is gathered completely before its output is
+// scattered, so out may alias in.
+void biquad_bank_process(float **in, float **out, uint32_t samples, struct biquad_bank *bank){
+  // Unused lanes read zeroes and write to scratch so that the transpose
+  // always moves whole frames. Lanes that are never loaded stay zero,
+  // as a section turns silence into silence.
+  float frames[BIQUAD_CHUNK][BIQUAD_LANES] = {{0}};
+  float zero[BIQUAD_CHUNK] = {0}, scratch[BIQUAD_CHUNK];
+  for(channel_t g=0; g<bank->channels; g+=BIQUAD_LANES){
+    channel_t lanes = MIN(BIQUAD_LANES, bank->channels-g);
+    struct biquad_section *sections = &bank->sections[(g/BIQUAD_LANES)*bank->stages];
+    for(uint32_t o=0; o<samples; o+=BIQUAD_CHUNK){
+      uint32_t chunk = MIN(BIQUAD_CHUNK, samples-o);
+      float *src[BIQUAD_LANES], *dst[BIQUAD_LANES];
+      for(channel_t c=0; c<BIQUAD_LANES; ++c){
+        src[c] = (c < lanes)? in[g+c]+o : zero;
+        dst[c] = (c < lanes)? out[g+c]+o : scratch;
+      }
+      // Small groups, like a stereo pair, only move half of each frame.
+      if(lanes <= BIQUAD_LANES/2){
+        for(uint32_t i=0; i<chunk; ++i)
+          for(channel_t c=0; c<BIQUAD_LANES/2; ++c)
+            frames[i][c] = src[c][i];
+        biquad_bank_run(frames, chunk, sections, bank->stages);
+        for(uint32_t i=0; i<chunk; ++i)
+          for(channel_t c=0; c<BIQUAD_LANES/2; ++c)
+            dst[c][i] = frames[i][c];
+      }else{
+        for(uint32_t i=0; i<chunk; ++i)
+          for(channel_t c=0; c<BIQUAD_LANES; ++c)
+            frames[i][c] = src[c][i];
+        biquad_bank_run(frames, chunk, sections, bank->stages);
+        for(uint32_t i=0; i<chunk; ++i)
+          for(channel_t c=0; c<BIQUAD_LANES; ++c)
+            dst[c][i] = frames[i][c];
+      }
+    }
+  }
+}
+
 static inline void state_scale(struct biquad_data *state, float amt){
   state->b[0] = amt;
   state->b[1] = 0.0f;
@@ -267,3 +415,285 @@ void biquad_highshelf(uint32_t rate, float freq, float Q, float gain, struct biq
   state->a[0] = a0inv * 2.0f * (Am1 - Ap1 * k);
   state->a[1] = a0inv * (Ap1 - Am1 * k - k2);
 }
+
+int biquad_design(enum mixed_biquad_filter type, uint32_t rate, float freq, float Q, float gain, struct biquad_data *state){
+  switch(type){
+  case MIXED_LOWPASS: biquad_lowpass(rate, freq, Q, state); break;
+  case MIXED_HIGHPASS: biquad_highpass(rate, freq, Q, state); break;
+  case MIXED_BANDPASS: biquad_bandpass(rate, freq, Q, state); break;
+  case MIXED_NOTCH: biquad_notch(rate, freq, Q, state); break;
+  case MIXED_PEAKING: biquad_peaking(rate, freq, Q, gain, state); break;
+  case MIXED_ALLPASS: biquad_allpass(rate, freq, Q, state); break;
+  case MIXED_LOWSHELF: biquad_lowshelf(rate, freq, Q, gain, state); break;
+  case MIXED_HIGHSHELF: biquad_highshelf(rate, freq, Q, gain, state); break;
+  default:
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  return 1;
+}
+
+// The grid spans BIQUAD_TABLE_LOW Hz to just below the Nyquist
+// frequency, and Q factors of BIQUAD_TABLE_Q_LOW to BIQUAD_TABLE_Q_HIGH.
+#define BIQUAD_TABLE_LOW 10.0f
+#define BIQUAD_TABLE_HIGH 0.49f
+#define BIQUAD_TABLE_Q_LOW 0.1f
+#define BIQUAD_TABLE_Q_HIGH 40.0f
+
+// Tables are few and only change when a filter is made or retyped,
+// so a plain list behind a spin lock is plenty. The tables themselves
+// are built outside of the lock.
+static struct biquad_table *biquad_tables = 0;
+static uint32_t biquad_tables_lock = 0;
+
+static void biquad_tables_acquire_lock(){
+  while(!atomic_cas(biquad_tables_lock, 0, 1));
+}
+
+static void biquad_tables_release_lock(){
+  atomic_write(biquad_tables_lock, 0);
+}
+
+// Types without a gain share a table regardless of it.
+static float biquad_table_gain(enum mixed_biquad_filter type, float gain){
+  switch(type){
+  case MIXED_PEAKING:
+  case MIXED_LOWSHELF:
+  case MIXED_HIGHSHELF:
+    return gain;
+  default:
+    return 0.0f;
+  }
+}
+
+// The low and high pass designs take the resonance in dB rather than
+// as a Q factor, which is a log scale already.
+static int biquad_table_in_db(enum mixed_biquad_filter type){
+  return type == MIXED_LOWPASS || type == MIXED_HIGHPASS;
+}
+
+int biquad_table_fits(struct biquad_table *table, enum mixed_biquad_filter type, uint32_t samplerate, float gain){
+  return table->type == type
+    && table->samplerate == samplerate
+    && table->gain == biquad_table_gain(type, gain);
+}
+
+static struct biquad_table *biquad_table_make(enum mixed_biquad_filter type, uint32_t samplerate, float gain){
+  struct biquad_table *table = mixed_calloc(1, sizeof(struct biquad_table));
+  if(!table){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  table->coefficients = mixed_calloc(BIQUAD_TABLE_FREQUENCIES*BIQUAD_TABLE_QS*5, sizeof(float));
+  if(!table->coefficients){
+    mixed_free(table);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  table->references = 1;
+  table->type = type;
+  table->samplerate = samplerate;
+  table->gain = gain;
+  table->frequency_low = log2f(BIQUAD_TABLE_LOW);
+  table->frequency_scale = (BIQUAD_TABLE_FREQUENCIES-1) / (log2f(BIQUAD_TABLE_HIGH*samplerate) - table->frequency_low);
+  table->q_low = log2f(BIQUAD_TABLE_Q_LOW);
+  table->q_scale = (BIQUAD_TABLE_QS-1) / (log2f(BIQUAD_TABLE_Q_HIGH) - table->q_low);
+
+  struct biquad_data design;
+  float *coefficients = table->coefficients;
+  for(uint32_t q=0; q<BIQUAD_TABLE_QS; ++q){
+    float Q = exp2f(table->q_low + q/table->q_scale);
+    if(biquad_table_in_db(type)) Q = 20.0f * log10f(Q);
+    for(uint32_t f=0; f<BIQUAD_TABLE_FREQUENCIES; ++f){
+      float frequency = exp2f(table->frequency_low + f/table->frequency_scale);
+      if(!biquad_design(type, samplerate, frequency, Q, gain, &design)){
+        mixed_free(table->coefficients);
+        mixed_free(table);
+        return 0;
+      }
+      *coefficients++ = design.b[0];
+      *coefficients++ = design.b[1];
+      *coefficients++ = design.b[2];
+      *coefficients++ = design.a[0];
+      *coefficients++ = design.a[1];
+    }
+  }
+  return table;
+}
+
+static struct biquad_table *biquad_table_find(enum mixed_biquad_filter type, uint32_t samplerate, float gain){
+  for(struct biquad_table *table = biquad_tables; table; table = table->next){
+    if(biquad_table_fits(table, type, samplerate, gain)){
+      table->references++;
+      return table;
+    }
+  }
+  return 0;
+}
+
+struct biquad_table *biquad_table_acquire(enum mixed_biquad_filter type, uint32_t samplerate, float gain){
+  gain = biquad_table_gain(type, gain);
+  biquad_tables_acquire_lock();
+  struct biquad_table *table = biquad_table_find(type, samplerate, gain);
+  biquad_tables_release_lock();
+  if(table) return table;
+  struct biquad_table *made = biquad_table_make(type, samplerate, gain);
+  if(!made) return 0;
+  // Someone else may have made the same table in the meantime.
+  biquad_tables_acquire_lock();
+  table = biquad_table_find(type, samplerate, gain);
+  if(!table){
+    made->next = biquad_tables;
+    biquad_tables = made;
+  }
+  biquad_tables_release_lock();
+  if(table){
+    mixed_free(made->coefficients);
+    mixed_free(made);
+    return table;
+  }
+  return made;
+}
+
+void biquad_table_release(struct biquad_table *table){
+  if(!table) return;
+  biquad_tables_acquire_lock();
+  if(--table->references == 0){
+    struct biquad_table **place = &biquad_tables;
+    while(*place != table) place = &(*place)->next;
+    *place = table->next;
+    mixed_free(table->coefficients);
+    mixed_free(table);
+  }
+  biquad_tables_release_lock();
+}
+
+// Interpolates bilinearly between the four nearest designs.
+static void biquad_table_at(struct biquad_table *table, float position[2], struct biquad_data *state){
+  uint32_t fi = MIN((uint32_t)position[0], BIQUAD_TABLE_FREQUENCIES-2);
+  uint32_t qi = MIN((uint32_t)position[1], BIQUAD_TABLE_QS-2);
+  float ft = position[0] - fi, qt = position[1] - qi;
+  float *lo = table->coefficients + (qi*BIQUAD_TABLE_FREQUENCIES + fi)*5;
+  float *hi = lo + BIQUAD_TABLE_FREQUENCIES*5;
+  float c[5];
+  for(int i=0; i<5; ++i){
+    float l = lo[i] + (lo[i+5] - lo[i]) * ft;
+    float h = hi[i] + (hi[i+5] - hi[i]) * ft;
+    c[i] = l + (h - l) * qt;
+  }
+  state->b[0] = c[0];
+  state->b[1] = c[1];
+  state->b[2] = c[2];
+  state->a[0] = c[3];
+  state->a[1] = c[4];
+}
+
+// Anything off the grid is designed exactly instead, and cannot be
+// glided to along the grid.
+void biquad_table_design(struct biquad_table *table, float frequency, float Q, struct biquad_data *state, struct biquad_glide *glide){
+  float f = (log2f(frequency) - table->frequency_low) * table->frequency_scale;
+  float q = biquad_table_in_db(table->type)
+    ? Q * 0.16609640f // log2(10)/20, from dB to an octave of Q
+    : log2f(Q);
+  q = (q - table->q_low) * table->q_scale;
+  glide->target[0] = f;
+  glide->target[1] = q;
+  glide->to_grid = (0.0f <= f && f <= BIQUAD_TABLE_FREQUENCIES-1 && 0.0f <= q && q <= BIQUAD_TABLE_QS-1);
+  if(glide->to_grid){
+    biquad_reset(state);
+    biquad_table_at(table, glide->target, state);
+  }else{
+    biquad_design(table->type, table->samplerate, frequency, Q, table->gain, state);
+  }
+}
+
+void biquad_glide_settle(struct biquad_glide *glide){
+  glide->position[0] = glide->target[0];
+  glide->position[1] = glide->target[1];
+  glide->from_grid = glide->to_grid;
+}
+
+// Moves towards the target in even steps, one every BIQUAD_STEP
+// samples, until the ramp runs out. When both ends are on the grid the
+// steps follow the designs along the grid, so every filter on the way
+// is one the table would give. Otherwise the coefficients themselves
+// are interpolated, which is stable too, as the stable region of the
+// denominator coefficients is a triangle, but may ring on wide sweeps.
+VECTORIZE void biquad_process_ramp(struct mixed_buffer *input, struct mixed_buffer *output, struct biquad_data *state, struct biquad_data *target, struct biquad_table *table, struct biquad_glide *glide){
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
+  float b0 = state->b[0];
+  float b1 = state->b[1];
+  float b2 = state->b[2];
+  float a1 = state->a[0];
+  float a2 = state->a[1];
+  float xn1 = state->x[0];
+  float xn2 = state->x[1];
+  float yn1 = state->y[0];
+  float yn2 = state->y[1];
+
+  mixed_buffer_request_read(&in, &samples, input);
+  if(input == output) out = in;
+  else mixed_buffer_request_write(&out, &samples, output);
+
+  for(uint32_t o=0; o<samples; o+=BIQUAD_STEP){
+    uint32_t block = MIN(BIQUAD_STEP, samples-o);
+    if(0 < glide->ramp){
+      float t = 1.0f / ((glide->ramp+BIQUAD_STEP-1)/BIQUAD_STEP);
+      glide->ramp -= MIN(glide->ramp, block);
+      if(glide->ramp == 0){
+        biquad_glide_settle(glide);
+        b0 = target->b[0];
+        b1 = target->b[1];
+        b2 = target->b[2];
+        a1 = target->a[0];
+        a2 = target->a[1];
+      }else if(glide->from_grid && glide->to_grid){
+        glide->position[0] += (glide->target[0] - glide->position[0]) * t;
+        glide->position[1] += (glide->target[1] - glide->position[1]) * t;
+        biquad_table_at(table, glide->position, state);
+        b0 = state->b[0];
+        b1 = state->b[1];
+        b2 = state->b[2];
+        a1 = state->a[0];
+        a2 = state->a[1];
+      }else{
+        b0 += (target->b[0] - b0) * t;
+        b1 += (target->b[1] - b1) * t;
+        b2 += (target->b[2] - b2) * t;
+        a1 += (target->a[0] - a1) * t;
+        a2 += (target->a[1] - a2) * t;
+      }
+    }
+    for(uint32_t i=o; i<o+block; ++i){
+      float xn0 = in[i];
+      float L =
+        b0 * xn0 +
+        b1 * xn1 +
+        b2 * xn2 -
+        a1 * yn1 -
+        a2 * yn2;
+
+      xn2 = xn1;
+      xn1 = xn0;
+      yn2 = yn1;
+      yn1 = L;
+      out[i] = L;
+    }
+  }
+
+  if(input != output){
+    mixed_buffer_finish_read(samples, input);
+    mixed_buffer_finish_write(samples, output);
+  }
+
+  state->b[0] = b0;
+  state->b[1] = b1;
+  state->b[2] = b2;
+  state->a[0] = a1;
+  state->a[1] = a2;
+  state->x[0] = xn1;
+  state->x[1] = xn2;
+  state->y[0] = undenormal(yn1);
+  state->y[1] = undenormal(yn2);
+}
@@ -1,6 +1,89 @@
 #include "internal.h"
 #include "bip.h"
 
+uint64_t bip_write_retries = 0;
+uint64_t bip_read_retries = 0;
+
+static inline int buffer_request_write(uint32_t *off, uint32_t *size, struct mixed_buffer *buffer){
+  uint32_t requested = *size;
+  int result = (buffer->_shared)? shared_request_write(off, size, buffer->size, buffer->_shared)
+    : (buffer->is_mirrored)? ring_request_write(off, size, (struct bip*)buffer)
+    : bip_request_write(off, size, (struct bip*)buffer);
+  if(buffer->_stats) stats_request_write(requested, *size, buffer->_stats);
+  return result;
+}
+
+static inline int buffer_finish_write(uint32_t size, struct mixed_buffer *buffer){
+  int result = (buffer->_shared)? shared_finish_write(size, buffer->size, buffer->_shared)
+    : (buffer->is_mirrored)? ring_finish_write(size, (struct bip*)buffer)
+    : bip_finish_write(size, (struct bip*)buffer);
+  if(buffer->_stats && result) stats_finish_write(size, buffer_pending(buffer), buffer->_stats);
+  return result;
+}
+
+static inline int buffer_request_read(uint32_t *off, uint32_t *size, struct mixed_buffer *buffer){
+  uint32_t requested = *size;
+  int result = (buffer->_shared)? shared_request_read(off, size, buffer->size, buffer->_shared)
+    : (buffer->is_mirrored)? ring_request_read(off, size, (struct bip*)buffer)
+    : bip_request_read(off, size, (struct bip*)buffer);
+  if(buffer->_stats) stats_request_read(requested, *size, buffer_pending(buffer), buffer->_stats);
+  return result;
+}
+
+static inline int buffer_finish_read(uint32_t size, struct mixed_buffer *buffer){
+  int result = (buffer->_shared)? shared_finish_read(size, buffer->size, buffer->_shared)
+    : (buffer->is_mirrored)? ring_finish_read(size, (struct bip*)buffer)
+    : bip_finish_read(size, (struct bip*)buffer);
+  if(buffer->_stats && result) stats_finish_read(size, buffer->_stats);
+  return result;
+}
+
+static inline void *buffer_area(struct mixed_buffer *buffer, uint32_t off){
+  return (buffer->is_half)? (void *)((uint16_t *)buffer->_data+off) : (void *)(buffer->_data+off);
+}
+
+// Float areas of half buffers would be misread by anyone asking.
+static inline int buffer_check_float(struct mixed_buffer *buffer){
+  if(buffer->is_half){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    return 0;
+  }
+  return 1;
+}
+
+// Moves samples between areas of either kind.
+static void buffer_convert(void *in, char in_half, void *out, char out_half, uint32_t samples){
+  if(in_half == out_half)
+    memcpy(out, in, samples*(in_half? sizeof(uint16_t) : sizeof(float)));
+  else if(in_half)
+    half_to_float((uint16_t *)in, (float *)out, samples);
+  else
+    half_from_float((float *)in, (uint16_t *)out, samples);
+}
+
+uint32_t buffer_pending(struct mixed_buffer *buffer){
+  if(buffer->_shared){
+    struct shared_ring *ring = (struct shared_ring *)buffer->_shared;
+    return ring_used(atomic_read(ring->read), atomic_read(ring->write), buffer->size);
+  }
+  if(buffer->is_mirrored)
+    return ring_available_read((struct bip *)buffer);
+  read_buffer_state(read, write, full_r2, buffer);
+  return (full_r2)? buffer->size - read + write : write - read;
+}
+
+void buffer_skip(float pitch, uint32_t samples, struct mixed_buffer *buffer, struct resample_data *resampler){
+  uint32_t skip = (pitch == 1.0f)? samples : (uint32_t)(samples*pitch);
+  float *in;
+  skip = MIN(skip, mixed_buffer_available_read(buffer));
+  if(0 < skip){
+    mixed_buffer_request_read(&in, &skip, buffer);
+    resampler->phase = 0.0f;
+    resampler->last = in[skip-1];
+    mixed_buffer_finish_read(skip, buffer);
+  }
+}
+
 MIXED_EXPORT int mixed_make_buffer(uint32_t size, struct mixed_buffer *buffer){
   mixed_err(MIXED_NO_ERROR);
   if(buffer->_data && !buffer->is_virtual){
@@ -13,20 +96,98 @@ MIXED_EXPORT int mixed_make_buffer(uint32_t size, struct mixed_buffer *buffer){
     return 0;
   }
   buffer->is_virtual = 0;
+  buffer->is_mirrored = 0;
+  buffer->is_half = 0;
+  buffer->_shared = 0;
+  buffer->size = size;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_buffer_half(uint32_t size, struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(buffer->_data && !buffer->is_virtual){
+    mixed_err(MIXED_BUFFER_ALLOCATED);
+    return 0;
+  }
+  buffer->_data = mixed_calloc(size, sizeof(uint16_t));
+  if(!buffer->_data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  buffer->is_virtual = 0;
+  buffer->is_mirrored = 0;
+  buffer->is_half = 1;
+  buffer->_shared = 0;
   buffer->size = size;
   return 1;
 }
 
+MIXED_EXPORT int mixed_make_buffer_mirrored(uint32_t size, struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(buffer->_data && !buffer->is_virtual){
+    mixed_err(MIXED_BUFFER_ALLOCATED);
+    return 0;
+  }
+  // Both mappings must start on a page boundary.
+  uint32_t granularity = mirror_granularity() / sizeof(float);
+  size = ((size + granularity - 1) / granularity) * granularity;
+  buffer->_data = mirror_alloc(size*sizeof(float));
+  if(!buffer->_data){
+    return 0;
+  }
+  buffer->is_virtual = 0;
+  buffer->is_mirrored = 1;
+  buffer->is_half = 0;
+  buffer->_shared = 0;
+  buffer->size = size;
+  mixed_buffer_clear(buffer);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_buffer_shared(uint32_t size, struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(buffer->_data && !buffer->is_virtual){
+    mixed_err(MIXED_BUFFER_ALLOCATED);
+    return 0;
+  }
+  void *data = 0;
+  buffer->_shared = make_shared_ring(size*sizeof(float), &data);
+  if(!buffer->_shared){
+    return 0;
+  }
+  buffer->_data = data;
+  buffer->is_virtual = 0;
+  buffer->is_mirrored = 0;
+  buffer->is_half = 0;
+  buffer->size = size;
+  mixed_buffer_clear(buffer);
+  return 1;
+}
+
 MIXED_EXPORT void mixed_free_buffer(struct mixed_buffer *buffer){
-  if(buffer->_data && !buffer->is_virtual)
-    mixed_free(buffer->_data);
+  if(buffer->_data && !buffer->is_virtual){
+    if(buffer->_shared)
+      free_shared_ring(buffer->_shared);
+    else if(buffer->is_mirrored)
+      mirror_free(buffer->_data, buffer->size*sizeof(float));
+    else
+      mixed_free(buffer->_data);
+  }
+  if(buffer->_stats)
+    mixed_free(buffer->_stats);
   buffer->_data = 0;
   buffer->size = 0;
   buffer->is_virtual = 0;
+  buffer->is_mirrored = 0;
+  buffer->is_half = 0;
+  buffer->_shared = 0;
+  buffer->_stats = 0;
   mixed_buffer_clear(buffer);
 }
 
 MIXED_EXPORT int mixed_buffer_clear(struct mixed_buffer *buffer){
+  if(buffer->_shared)
+    shared_clear(buffer->_shared);
   buffer->read = 0;
   buffer->write = 0;
   buffer->reserved = 0;
@@ -35,7 +196,8 @@ MIXED_EXPORT int mixed_buffer_clear(struct mixed_buffer *buffer){
 
 MIXED_EXPORT int mixed_buffer_request_write(float **area, uint32_t *size, struct mixed_buffer *buffer){
   uint32_t off = 0;
-  if(!bip_request_write(&off, size, (struct bip*)buffer)){
+  if(!buffer_check_float(buffer) || !buffer_request_write(&off, size, buffer)){
+    *size = 0;
     *area = 0;
     return 0;
   }
@@ -43,13 +205,58 @@ MIXED_EXPORT int mixed_buffer_request_write(float **area, uint32_t *size, struct
   return 1;
 }
 
+MIXED_EXPORT int mixed_buffer_request_write_half(uint16_t **area, uint32_t *size, struct mixed_buffer *buffer){
+  uint32_t off = 0;
+  if(!buffer->is_half){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    *size = 0;
+    *area = 0;
+    return 0;
+  }
+  if(!buffer_request_write(&off, size, buffer)){
+    *area = 0;
+    return 0;
+  }
+  *area = (uint16_t *)buffer->_data+off;
+  return 1;
+}
+
 MIXED_EXPORT int mixed_buffer_finish_write(uint32_t size, struct mixed_buffer *buffer){
-  return bip_finish_write(size, (struct bip*)buffer);
+  if(0 < size) buffer->is_silent = 0;
+  return buffer_finish_write(size, buffer);
+}
+
+// Silence only stays known while it is added to silence or to nothing.
+MIXED_EXPORT int mixed_buffer_finish_write_silence(uint32_t size, struct mixed_buffer *buffer){
+  if(mixed_buffer_available_read(buffer) == 0) buffer->is_silent = 1;
+  return buffer_finish_write(size, buffer);
+}
+
+MIXED_EXPORT int mixed_buffer_is_silent(struct mixed_buffer *buffer){
+  return buffer->is_silent;
+}
+
+uint32_t buffer_pass_silence(struct mixed_buffer *in, struct mixed_buffer *out){
+  void *read, *write;
+  uint32_t samples = UINT32_MAX;
+  buffers_request_read_any(1, &in, &read, &samples);
+  if(in == out) return samples;
+  buffers_request_write_any(1, &out, &write, &samples);
+  memset(write, 0, samples*(out->is_half? sizeof(uint16_t) : sizeof(float)));
+  mixed_buffer_finish_read(samples, in);
+  mixed_buffer_finish_write_silence(samples, out);
+  return samples;
 }
 
 MIXED_EXPORT int mixed_buffer_request_read(float **area, uint32_t *size, struct mixed_buffer *buffer){
   uint32_t off = 0;
-  if(!bip_request_read(&off, size, (struct bip*)buffer)){
+  if(!buffer_check_float(buffer)){
+    *size = 0;
+    *area = 0;
+    return 0;
+  }
+  if(!buffer_request_read(&off, size, buffer)){
+    if(trace_state) trace_event('i', "starved", buffer);
     *area = 0;
     return 0;
   }
@@ -57,28 +264,134 @@ MIXED_EXPORT int mixed_buffer_request_read(float **area, uint32_t *size, struct
   return 1;
 }
 
+MIXED_EXPORT int mixed_buffer_request_read_half(uint16_t **area, uint32_t *size, struct mixed_buffer *buffer){
+  uint32_t off = 0;
+  if(!buffer->is_half){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    *size = 0;
+    *area = 0;
+    return 0;
+  }
+  if(!buffer_request_read(&off, size, buffer)){
+    if(trace_state) trace_event('i', "starved", buffer);
+    *area = 0;
+    return 0;
+  }
+  *area = (uint16_t *)buffer->_data+off;
+  return 1;
+}
+
 MIXED_EXPORT int mixed_buffer_finish_read(uint32_t size, struct mixed_buffer *buffer){
-  return bip_finish_read(size, (struct bip*)buffer);
+  return buffer_finish_read(size, buffer);
+}
+
+int buffers_request_write_any(uint32_t count, struct mixed_buffer **buffers, void **areas, uint32_t *size){
+  uint32_t off = 0;
+  for(uint32_t i=0; i<count; ++i){
+    struct mixed_buffer *buffer = buffers[i];
+    areas[i] = 0;
+    if(!buffer) continue;
+    // The offset does not depend on the requested size, so shrinking
+    // the size for later buffers keeps the earlier areas valid.
+    if(!buffer_request_write(&off, size, buffer)){
+      *size = 0;
+      return 0;
+    }
+    areas[i] = buffer_area(buffer, off);
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_buffers_request_write(uint32_t count, struct mixed_buffer **buffers, float **areas, uint32_t *size){
+  for(uint32_t i=0; i<count; ++i){
+    if(buffers[i] && !buffer_check_float(buffers[i])){
+      for(uint32_t j=0; j<count; ++j) areas[j] = 0;
+      *size = 0;
+      return 0;
+    }
+  }
+  return buffers_request_write_any(count, buffers, (void **)areas, size);
+}
+
+MIXED_EXPORT int mixed_buffers_finish_write(uint32_t count, struct mixed_buffer **buffers, uint32_t size){
+  int result = 1;
+  for(uint32_t i=0; i<count; ++i){
+    if(buffers[i] && !mixed_buffer_finish_write(size, buffers[i]))
+      result = 0;
+  }
+  return result;
+}
+
+MIXED_EXPORT int mixed_buffers_finish_write_silence(uint32_t count, struct mixed_buffer **buffers, uint32_t size){
+  int result = 1;
+  for(uint32_t i=0; i<count; ++i){
+    if(buffers[i] && !mixed_buffer_finish_write_silence(size, buffers[i]))
+      result = 0;
+  }
+  return result;
+}
+
+int buffers_request_read_any(uint32_t count, struct mixed_buffer **buffers, void **areas, uint32_t *size){
+  uint32_t off = 0;
+  for(uint32_t i=0; i<count; ++i){
+    struct mixed_buffer *buffer = buffers[i];
+    areas[i] = 0;
+    if(!buffer) continue;
+    if(!buffer_request_read(&off, size, buffer)){
+      if(trace_state) trace_event('i', "starved", buffer);
+      *size = 0;
+      return 0;
+    }
+    areas[i] = buffer_area(buffer, off);
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_buffers_request_read(uint32_t count, struct mixed_buffer **buffers, float **areas, uint32_t *size){
+  for(uint32_t i=0; i<count; ++i){
+    if(buffers[i] && !buffer_check_float(buffers[i])){
+      for(uint32_t j=0; j<count; ++j) areas[j] = 0;
+      *size = 0;
+      return 0;
+    }
+  }
+  return buffers_request_read_any(count, buffers, (void **)areas, size);
+}
+
+MIXED_EXPORT int mixed_buffers_finish_read(uint32_t count, struct mixed_buffer **buffers, uint32_t size){
+  int result = 1;
+  for(uint32_t i=0; i<count; ++i){
+    if(buffers[i] && !buffer_finish_read(size, buffers[i]))
+      result = 0;
+  }
+  return result;
 }
 
 MIXED_EXPORT uint32_t mixed_buffer_available_read(struct mixed_buffer *buffer){
+  if(buffer->_shared) return shared_available_read(buffer->size, buffer->_shared);
+  if(buffer->is_mirrored) return ring_available_read((struct bip*)buffer);
   return bip_available_read((struct bip*)buffer);
 }
 
 MIXED_EXPORT uint32_t mixed_buffer_available_write(struct mixed_buffer *buffer){
+  if(buffer->_shared) return shared_available_write(buffer->size, buffer->_shared);
+  if(buffer->is_mirrored) return ring_available_write((struct bip*)buffer);
   return bip_available_write((struct bip*)buffer);
 }
 
 MIXED_EXPORT int mixed_buffer_transfer(struct mixed_buffer *from, struct mixed_buffer *to){
   mixed_err(MIXED_NO_ERROR);
   if(from != to){
-    float *read, *write;
+    void *read, *write;
     uint32_t samples = UINT32_MAX;
-    mixed_buffer_request_read(&read, &samples, from);
-    mixed_buffer_request_write(&write, &samples, to);
-    memcpy(write, read, sizeof(float)*samples);
+    buffers_request_read_any(1, &from, &read, &samples);
+    buffers_request_write_any(1, &to, &write, &samples);
+    buffer_convert(read, from->is_half, write, to->is_half, samples);
+    if(from->is_silent)
+      mixed_buffer_finish_write_silence(samples, to);
+    else
+      mixed_buffer_finish_write(samples, to);
     mixed_buffer_finish_read(samples, from);
-    mixed_buffer_finish_write(samples, to);
   }
   return 1;
 }
@@ -86,24 +399,104 @@ MIXED_EXPORT int mixed_buffer_transfer(struct mixed_buffer *from, struct mixed_b
 MIXED_EXPORT int mixed_buffer_copy(struct mixed_buffer *from, struct mixed_buffer *to){
   mixed_err(MIXED_NO_ERROR);
   if(from != to){
-    float *read, *write;
+    void *read, *write;
     uint32_t samples = UINT32_MAX;
-    mixed_buffer_request_read(&read, &samples, from);
-    mixed_buffer_request_write(&write, &samples, to);
-    memcpy(write, read, sizeof(float)*samples);
+    buffers_request_read_any(1, &from, &read, &samples);
+    buffers_request_write_any(1, &to, &write, &samples);
+    buffer_convert(read, from->is_half, write, to->is_half, samples);
+    if(from->is_silent)
+      mixed_buffer_finish_write_silence(samples, to);
+    else
+      mixed_buffer_finish_write(samples, to);
+  }
+  return 1;
+}
+
+// Moves as many pending samples as fit from one buffer to the other,
+// oldest first. Works for every kind of buffer, wrapped or not.
+static void buffer_move(struct mixed_buffer *from, struct mixed_buffer *to){
+  void *in, *out;
+  for(;;){
+    uint32_t samples = UINT32_MAX;
+    if(!buffers_request_read_any(1, &from, &in, &samples)) break;
+    if(!buffers_request_write_any(1, &to, &out, &samples)) break;
+    buffer_convert(in, from->is_half, out, to->is_half, samples);
     mixed_buffer_finish_write(samples, to);
+    mixed_buffer_finish_read(samples, from);
+  }
+}
+
+// Not atomic: segments read the structure directly, so there is no
+// single pointer to exchange. The caller keeps every user away.
+MIXED_EXPORT int mixed_buffer_swap(struct mixed_buffer *replacement, struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(!replacement->_data){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
   }
+  // The counters belong to the buffers, not to their storage, and
+  // moving the samples over does not count as use.
+  void *stats = buffer->_stats, *replacement_stats = replacement->_stats;
+  buffer->_stats = replacement->_stats = 0;
+  char silent = buffer->is_silent;
+  mixed_buffer_clear(replacement);
+  buffer_move(buffer, replacement);
+  replacement->is_silent = silent && mixed_buffer_available_read(replacement);
+  struct mixed_buffer old = *buffer;
+  *buffer = *replacement;
+  *replacement = old;
+  buffer->_stats = stats;
+  replacement->_stats = replacement_stats;
   return 1;
 }
 
 MIXED_EXPORT int mixed_buffer_resize(uint32_t size, struct mixed_buffer *buffer){
+  struct mixed_buffer new = {0};
+  int made = (buffer->_shared)? mixed_make_buffer_shared(size, &new)
+    : (buffer->is_mirrored)? mixed_make_buffer_mirrored(size, &new)
+    : (buffer->is_half)? mixed_make_buffer_half(size, &new)
+    : mixed_make_buffer(size, &new);
+  if(!made) return 0;
+  mixed_buffer_swap(&new, buffer);
+  mixed_free_buffer(&new);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_buffer_enable_stats(struct mixed_buffer *buffer){
   mixed_err(MIXED_NO_ERROR);
-  float *new = mixed_realloc(buffer->_data, size*sizeof(float));
-  if(!new){
+  if(buffer->_stats) return 1;
+  struct mixed_buffer_stats *stats = mixed_calloc(1, sizeof(struct mixed_buffer_stats));
+  if(!stats){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
-  buffer->_data = new;
-  buffer->size = size;
+  stats_reset(stats);
+  buffer->_stats = stats;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_buffer_stats(struct mixed_buffer_stats *stats, struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(!buffer->_stats){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  *stats = *(struct mixed_buffer_stats *)buffer->_stats;
+  if(stats->low_water == UINT32_MAX) stats->low_water = 0;
   return 1;
 }
+
+MIXED_EXPORT int mixed_buffer_reset_stats(struct mixed_buffer *buffer){
+  mixed_err(MIXED_NO_ERROR);
+  if(!buffer->_stats){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  stats_reset(buffer->_stats);
+  return 1;
+}
+
+MIXED_EXPORT void mixed_buffer_retries(uint64_t *write_retries, uint64_t *read_retries){
+  if(write_retries) *write_retries = __atomic_load_n(&bip_write_retries, __ATOMIC_RELAXED);
+  if(read_retries) *read_retries = __atomic_load_n(&bip_read_retries, __ATOMIC_RELAXED);
+}
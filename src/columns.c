@@ -0,0 +1,35 @@
+#include "internal.h"
+
+extern inline float *column(uint32_t i, struct columns *columns);
+
+int make_columns(uint32_t count, struct columns *columns){
+  columns->data = 0;
+  columns->size = 0;
+  columns->count = count;
+  return 1;
+}
+
+void free_columns(struct columns *columns){
+  if(columns->data)
+    mixed_free(columns->data);
+  columns->data = 0;
+  columns->size = 0;
+}
+
+int columns_reserve(uint32_t size, struct columns *columns){
+  if(size <= columns->size) return 1;
+  float *data = mixed_calloc((size_t)size*columns->count, sizeof(float));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(columns->data){
+    for(uint32_t i=0; i<columns->count; ++i){
+      memcpy(data+i*size, columns->data+i*columns->size, columns->size*sizeof(float));
+    }
+    mixed_free(columns->data);
+  }
+  columns->data = data;
+  columns->size = size;
+  return 1;
+}
@@ -89,6 +89,20 @@ MIXED_EXPORT char *mixed_error_string(int code){
     return "A segment with the requested name had already been registered.";
   case MIXED_BAD_SEGMENT:
     return "A segment with the requested name is not registered.";
+  case MIXED_GRAPH_CYCLE:
+    return "The connections of the graph form a cycle.";
+  case MIXED_THREAD_FAILED:
+    return "A worker thread could not be created.";
+  case MIXED_QUEUE_FULL:
+    return "The queue has no space left.";
+  case MIXED_FILE_OPEN_FAILED:
+    return "The file could not be opened.";
+  case MIXED_BAD_FILE_FORMAT:
+    return "The file is not in a known format.";
+  case MIXED_PLUGIN_VERSION_MISMATCH:
+    return "The plugin was built for a different version of the plugin interface.";
+  case MIXED_DEVICE_FAILED:
+    return "The audio device could not be opened or configured.";
   default:
     return "Unknown error code.";
   }
@@ -156,6 +170,14 @@ MIXED_EXPORT char *mixed_type_string(int code){
     return "error";
   case MIXED_RESAMPLE_TYPE_ENUM:
     return "resample type";
+  case MIXED_RAMP_TYPE_ENUM:
+    return "ramp type";
+  case MIXED_SPACE_LAYOUT_ENUM:
+    return "space layout";
+  case MIXED_PITCH_MODE_ENUM:
+    return "pitch mode";
+  case MIXED_WINDOW_TYPE_ENUM:
+    return "window type";
   default:
     return "unknown";
   }
@@ -224,9 +246,19 @@ void close_library(void *handle){
 #endif
 }
 
+void *find_symbol(void *handle, char *name){
+#ifdef _WIN32
+  return GetProcAddress(handle, name);
+#else
+  dlerror();
+  void *function = dlsym(handle, name);
+  return (dlerror() == 0)? function : 0;
+#endif
+}
+
 void *load_symbol(void *handle, char *name){
 #ifdef _WIN32
-  void *function = GetProcAddress(handle, "mixed_make_plugin");
+  void *function = GetProcAddress(handle, name);
   if(!function){
     mixed_err(MIXED_BAD_DYNAMIC_LIBRARY);
     return 0;
@@ -244,28 +276,36 @@ void *load_symbol(void *handle, char *name){
 #endif
 }
 
+uint64_t mixed_clock(){
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)(count.QuadPart / frequency.QuadPart) * 1000000000ull
+    + (uint64_t)(count.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+#endif
+}
+
 unsigned int hash_rng_pos = 1;
 unsigned int hash_rng_seed = 0x42574223;
 
+extern inline uint32_t hash_noise(uint32_t position, uint32_t seed);
+extern inline float fast_log2(float x);
+extern inline float fast_exp2(float x);
+
 unsigned int mixed_random_int(){
-  const unsigned int BIT_NOISE1 = 0x68E31DA4;
-  const unsigned int BIT_NOISE2 = 0xB5297A4D;
-  const unsigned int BIT_NOISE3 = 0x1B56C4E9;
-  unsigned int mangled;
+  unsigned int position;
 
  retry:
-  mangled = hash_rng_pos;
-  if(!atomic_cas(hash_rng_pos, mangled, mangled+1))
+  position = hash_rng_pos;
+  if(!atomic_cas(hash_rng_pos, position, position+1))
     goto retry;
   
-  mangled *= BIT_NOISE1;
-  mangled += hash_rng_seed;
-  mangled ^= (mangled >> 8);
-  mangled += BIT_NOISE2;
-  mangled ^= (mangled << 8);
-  mangled *= BIT_NOISE3;
-  mangled ^= (mangled >> 8);
-  return mangled;
+  return hash_noise(position, hash_rng_seed);
 }
 
 float mixed_random(){
@@ -0,0 +1,43 @@
+#include "internal.h"
+
+uint32_t cpu_features = 0;
+static uint32_t cpu_detected = 0;
+
+static uint32_t cpu_probe(){
+  uint32_t features = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2")) features |= MIXED_CPU_SSE2;
+  if(__builtin_cpu_supports("avx")) features |= MIXED_CPU_AVX;
+  if(__builtin_cpu_supports("avx2")) features |= MIXED_CPU_AVX2;
+  if(__builtin_cpu_supports("fma")) features |= MIXED_CPU_FMA;
+  if(__builtin_cpu_supports("avx512f")) features |= MIXED_CPU_AVX512;
+  if(__builtin_cpu_supports("f16c")) features |= MIXED_CPU_F16C;
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+  features |= MIXED_CPU_NEON;
+#endif
+  return features;
+}
+
+static void cpu_dispatch(){
+  transfer_dispatch();
+  half_dispatch();
+}
+
+// Probe once and fill the dispatch tables before anything can use them.
+static void cpu_init() __attribute__((constructor));
+static void cpu_init(){
+  cpu_detected = cpu_probe();
+  cpu_features = cpu_detected;
+  cpu_dispatch();
+}
+
+MIXED_EXPORT uint32_t mixed_cpu_features(){
+  return cpu_features;
+}
+
+MIXED_EXPORT uint32_t mixed_cpu_set_features(uint32_t features){
+  cpu_features = cpu_detected & features;
+  cpu_dispatch();
+  return cpu_features;
+}
@@ -0,0 +1,404 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "internal.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+struct device;
+
+struct device_backend{
+  int (*open)(char *name, struct device *device);
+  // Plays the frames and returns how many were taken, or a negative
+  // value on an unrecoverable error.
+  long (*write)(void *area, uint32_t frames, struct device *device);
+  void (*close)(struct device *device);
+};
+
+struct device{
+  struct device_backend *backend;
+  struct mixed_pack *pack;
+  uint32_t period;
+  uint32_t periods;
+  uint32_t framesize;
+  // A period of silence in the pack's encoding, played on underruns.
+  void *silence;
+  void *handle;
+  uint64_t deadline;
+  uint32_t underruns;
+  char running;
+  char stop;
+#ifndef _WIN32
+  pthread_t thread;
+#endif
+};
+
+#ifndef _WIN32
+
+// Plays nothing, but takes the data at the rate a device would. It
+// never falls behind, as deadlines are absolute.
+static int null_open(char *name, struct device *device){
+  IGNORE(name, device);
+  return 1;
+}
+
+static long null_write(void *area, uint32_t frames, struct device *device){
+  IGNORE(area);
+  uint64_t now = mixed_clock();
+  if(device->deadline == 0 || device->deadline + 1000000000ull < now)
+    device->deadline = now;
+  device->deadline += (uint64_t)frames * 1000000000ull / device->pack->samplerate;
+  if(now < device->deadline){
+    uint64_t wait = device->deadline - now;
+    struct timespec ts = {wait / 1000000000ull, wait % 1000000000ull};
+    nanosleep(&ts, 0);
+  }
+  return frames;
+}
+
+static void null_close(struct device *device){
+  IGNORE(device);
+}
+
+static struct device_backend null_backend = {null_open, null_write, null_close};
+
+#ifdef __linux__
+
+// libasound is loaded at runtime, so that the library does not depend
+// on it. Only the few calls we need are declared here.
+#define SND_PCM_STREAM_PLAYBACK 0
+#define SND_PCM_ACCESS_RW_INTERLEAVED 3
+
+struct alsa{
+  void *library;
+  void *pcm;
+  int (*open)(void **pcm, const char *name, int stream, int mode);
+  int (*close)(void *pcm);
+  int (*hw_params_malloc)(void **params);
+  void (*hw_params_free)(void *params);
+  int (*hw_params_any)(void *pcm, void *params);
+  int (*hw_params_set_access)(void *pcm, void *params, int access);
+  int (*hw_params_set_format)(void *pcm, void *params, int format);
+  int (*hw_params_set_channels)(void *pcm, void *params, unsigned int channels);
+  int (*hw_params_set_rate)(void *pcm, void *params, unsigned int rate, int dir);
+  int (*hw_params_set_period_size_near)(void *pcm, void *params, unsigned long *frames, int *dir);
+  int (*hw_params_set_periods_near)(void *pcm, void *params, unsigned int *periods, int *dir);
+  int (*hw_params)(void *pcm, void *params);
+  int (*prepare)(void *pcm);
+  long (*writei)(void *pcm, const void *buffer, unsigned long frames);
+  int (*recover)(void *pcm, int err, int silent);
+  int (*drop)(void *pcm);
+};
+
+static int alsa_format(enum mixed_encoding encoding){
+  switch(encoding){
+  case MIXED_INT8: return 0;
+  case MIXED_UINT8: return 1;
+  case MIXED_INT16: return 2;
+  case MIXED_UINT16: return 4;
+  case MIXED_INT32: return 10;
+  case MIXED_UINT32: return 12;
+  case MIXED_FLOAT: return 14;
+  case MIXED_DOUBLE: return 16;
+  case MIXED_INT24: return 32;
+  case MIXED_UINT24: return 34;
+  default: return -1;
+  }
+}
+
+static int alsa_load(struct alsa *alsa){
+  alsa->library = open_library("libasound.so.2");
+  if(!alsa->library) return 0;
+  struct { void **place; char *name; } symbols[] = {
+    {(void **)&alsa->open, "snd_pcm_open"},
+    {(void **)&alsa->close, "snd_pcm_close"},
+    {(void **)&alsa->hw_params_malloc, "snd_pcm_hw_params_malloc"},
+    {(void **)&alsa->hw_params_free, "snd_pcm_hw_params_free"},
+    {(void **)&alsa->hw_params_any, "snd_pcm_hw_params_any"},
+    {(void **)&alsa->hw_params_set_access, "snd_pcm_hw_params_set_access"},
+    {(void **)&alsa->hw_params_set_format, "snd_pcm_hw_params_set_format"},
+    {(void **)&alsa->hw_params_set_channels, "snd_pcm_hw_params_set_channels"},
+    {(void **)&alsa->hw_params_set_rate, "snd_pcm_hw_params_set_rate"},
+    {(void **)&alsa->hw_params_set_period_size_near, "snd_pcm_hw_params_set_period_size_near"},
+    {(void **)&alsa->hw_params_set_periods_near, "snd_pcm_hw_params_set_periods_near"},
+    {(void **)&alsa->hw_params, "snd_pcm_hw_params"},
+    {(void **)&alsa->prepare, "snd_pcm_prepare"},
+    {(void **)&alsa->writei, "snd_pcm_writei"},
+    {(void **)&alsa->recover, "snd_pcm_recover"},
+    {(void **)&alsa->drop, "snd_pcm_drop"}};
+  for(uint32_t i=0; i<sizeof(symbols)/sizeof(symbols[0]); ++i){
+    *symbols[i].place = load_symbol(alsa->library, symbols[i].name);
+    if(!*symbols[i].place) return 0;
+  }
+  return 1;
+}
+
+static void alsa_close(struct device *device){
+  struct alsa *alsa = (struct alsa *)device->handle;
+  if(!alsa) return;
+  if(alsa->pcm){
+    alsa->drop(alsa->pcm);
+    alsa->close(alsa->pcm);
+  }
+  close_library(alsa->library);
+  mixed_free(alsa);
+  device->handle = 0;
+}
+
+// The period and the number of periods bound the latency. They are
+// only hints to the device, which may round them.
+static int alsa_open(char *name, struct device *device){
+  struct mixed_pack *pack = device->pack;
+  void *params = 0;
+  int format = alsa_format(pack->encoding);
+  if(format < 0){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    return 0;
+  }
+  struct alsa *alsa = mixed_calloc(1, sizeof(struct alsa));
+  if(!alsa){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  device->handle = alsa;
+  if(!alsa_load(alsa))
+    goto cleanup;
+
+  if(alsa->open(&alsa->pcm, (name)? name : "default", SND_PCM_STREAM_PLAYBACK, 0) < 0){
+    alsa->pcm = 0;
+    goto error;
+  }
+  if(alsa->hw_params_malloc(&params) < 0){
+    params = 0;
+    goto error;
+  }
+  unsigned long period = device->period;
+  unsigned int periods = device->periods;
+  if(alsa->hw_params_any(alsa->pcm, params) < 0
+     || alsa->hw_params_set_access(alsa->pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0
+     || alsa->hw_params_set_format(alsa->pcm, params, format) < 0
+     || alsa->hw_params_set_channels(alsa->pcm, params, pack->channels) < 0
+     || alsa->hw_params_set_rate(alsa->pcm, params, pack->samplerate, 0) < 0
+     || alsa->hw_params_set_period_size_near(alsa->pcm, params, &period, 0) < 0
+     || alsa->hw_params_set_periods_near(alsa->pcm, params, &periods, 0) < 0
+     || alsa->hw_params(alsa->pcm, params) < 0
+     || alsa->prepare(alsa->pcm) < 0)
+    goto error;
+  alsa->hw_params_free(params);
+  device->period = period;
+  device->periods = periods;
+  return 1;
+
+ error:
+  mixed_err(MIXED_DEVICE_FAILED);
+ cleanup:
+  if(params) alsa->hw_params_free(params);
+  alsa_close(device);
+  return 0;
+}
+
+static long alsa_write(void *area, uint32_t frames, struct device *device){
+  struct alsa *alsa = (struct alsa *)device->handle;
+  long written = alsa->writei(alsa->pcm, area, frames);
+  if(written < 0){
+    // The device ran dry on its own, which counts as an underrun too.
+    __atomic_add_fetch(&device->underruns, 1, __ATOMIC_SEQ_CST);
+    if(alsa->recover(alsa->pcm, (int)written, 1) < 0)
+      return -1;
+    written = 0;
+  }
+  return written;
+}
+
+static struct device_backend alsa_backend = {alsa_open, alsa_write, alsa_close};
+
+#endif
+
+static void *device_thread(void *arg){
+  struct device *device = (struct device *)arg;
+  struct mixed_pack *pack = device->pack;
+  // Ask for real time scheduling, which is fine to be refused.
+  struct sched_param param = {sched_get_priority_max(SCHED_FIFO)};
+  pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+  while(!atomic_read(device->stop)){
+    void *area;
+    uint32_t size = device->period * device->framesize;
+    mixed_pack_request_read(&area, &size, pack);
+    uint32_t frames = size / device->framesize;
+    long written;
+    if(trace_state) trace_event('B', "device", device);
+    if(frames == 0){
+      if(trace_state) trace_event('i', "underrun", device);
+      // Keep the device running on silence, so that the latency does
+      // not grow when the mix catches up again.
+      __atomic_add_fetch(&device->underruns, 1, __ATOMIC_SEQ_CST);
+      written = device->backend->write(device->silence, device->period, device);
+      frames = 0;
+    }else{
+      written = device->backend->write(area, frames, device);
+      if(0 < written) frames = (uint32_t)written;
+      else frames = 0;
+    }
+    mixed_pack_finish_read(frames * device->framesize, pack);
+    if(trace_state) trace_event('E', "device", device);
+    if(written < 0) break;
+  }
+  return 0;
+}
+
+static struct device_backend *device_backend(enum mixed_device_backend backend){
+  switch(backend){
+#ifdef __linux__
+  case MIXED_DEVICE_DEFAULT:
+  case MIXED_DEVICE_ALSA:
+    return &alsa_backend;
+#endif
+  case MIXED_DEVICE_NULL:
+    return &null_backend;
+  default:
+    return 0;
+  }
+}
+
+static int make_silence(struct device *device){
+  uint32_t samples = device->period * device->pack->channels;
+  float *zero = mixed_calloc(samples, sizeof(float));
+  device->silence = mixed_calloc(device->period, device->framesize);
+  if(!zero || !device->silence){
+    if(zero) mixed_free(zero);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  // Unsigned encodings have their zero in the middle.
+  mixed_translator_to(device->pack->encoding)(zero, device->silence, 1, samples, 1.0, 1.0);
+  mixed_free(zero);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_device(enum mixed_device_backend backend, char *name, uint32_t period, uint32_t periods, struct mixed_pack *pack, struct mixed_device *device){
+  mixed_err(MIXED_NO_ERROR);
+  struct device_backend *implementation = device_backend(backend);
+  if(!implementation){
+    mixed_err(MIXED_NOT_IMPLEMENTED);
+    return 0;
+  }
+  if(period == 0 || periods == 0 || !pack->_shared || (pack->flags & MIXED_PLANAR)
+     || pack->channels == 0 || pack->samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct device *data = mixed_calloc(1, sizeof(struct device));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->backend = implementation;
+  data->pack = pack;
+  data->period = period;
+  data->periods = periods;
+  data->framesize = pack_frame_bytes(pack);
+  if(!implementation->open(name, data)){
+    mixed_free(data);
+    return 0;
+  }
+  if(!make_silence(data)){
+    implementation->close(data);
+    mixed_free(data);
+    return 0;
+  }
+  device->_data = data;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_device_start(struct mixed_device *device){
+  struct device *data = (struct device *)device->_data;
+  mixed_err(MIXED_NO_ERROR);
+  if(data->running){
+    mixed_err(MIXED_SEGMENT_ALREADY_STARTED);
+    return 0;
+  }
+  data->stop = 0;
+  data->deadline = 0;
+  if(pthread_create(&data->thread, 0, device_thread, data) != 0){
+    mixed_err(MIXED_THREAD_FAILED);
+    return 0;
+  }
+  data->running = 1;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_device_end(struct mixed_device *device){
+  struct device *data = (struct device *)device->_data;
+  mixed_err(MIXED_NO_ERROR);
+  if(!data->running){
+    mixed_err(MIXED_SEGMENT_ALREADY_ENDED);
+    return 0;
+  }
+  atomic_write(data->stop, 1);
+  pthread_join(data->thread, 0);
+  data->running = 0;
+  return 1;
+}
+
+MIXED_EXPORT void mixed_free_device(struct mixed_device *device){
+  struct device *data = (struct device *)device->_data;
+  if(data){
+    if(data->running)
+      mixed_device_end(device);
+    data->backend->close(data);
+    mixed_free(data->silence);
+    mixed_free(data);
+  }
+  device->_data = 0;
+}
+
+MIXED_EXPORT uint32_t mixed_device_latency(struct mixed_device *device){
+  struct device *data = (struct device *)device->_data;
+  return data->period * data->periods;
+}
+
+MIXED_EXPORT uint32_t mixed_device_underruns(struct mixed_device *device){
+  struct device *data = (struct device *)device->_data;
+  return __atomic_load_n(&data->underruns, __ATOMIC_SEQ_CST);
+}
+
+#else
+
+MIXED_EXPORT int mixed_make_device(enum mixed_device_backend backend, char *name, uint32_t period, uint32_t periods, struct mixed_pack *pack, struct mixed_device *device){
+  IGNORE(backend, name, period, periods, pack, device);
+  mixed_err(MIXED_NOT_IMPLEMENTED);
+  return 0;
+}
+
+MIXED_EXPORT int mixed_device_start(struct mixed_device *device){
+  IGNORE(device);
+  mixed_err(MIXED_NOT_IMPLEMENTED);
+  return 0;
+}
+
+MIXED_EXPORT int mixed_device_end(struct mixed_device *device){
+  IGNORE(device);
+  mixed_err(MIXED_NOT_IMPLEMENTED);
+  return 0;
+}
+
+MIXED_EXPORT void mixed_free_device(struct mixed_device *device){
+  device->_data = 0;
+}
+
+MIXED_EXPORT uint32_t mixed_device_latency(struct mixed_device *device){
+  IGNORE(device);
+  return 0;
+}
+
+MIXED_EXPORT uint32_t mixed_device_underruns(struct mixed_device *device){
+  IGNORE(device);
+  return 0;
+}
+
+#endif
@@ -10,6 +10,14 @@ MIXED_EXPORT extern inline float mixed_from_int24(int24_t sample);
 MIXED_EXPORT extern inline float mixed_from_uint24(uint24_t sample);
 MIXED_EXPORT extern inline float mixed_from_int32(int32_t sample);
 MIXED_EXPORT extern inline float mixed_from_uint32(uint32_t sample);
+MIXED_EXPORT extern inline float mixed_from_int8_fast(int8_t sample);
+MIXED_EXPORT extern inline float mixed_from_uint8_fast(uint8_t sample);
+MIXED_EXPORT extern inline float mixed_from_int16_fast(int16_t sample);
+MIXED_EXPORT extern inline float mixed_from_uint16_fast(uint16_t sample);
+MIXED_EXPORT extern inline float mixed_from_int24_fast(int24_t sample);
+MIXED_EXPORT extern inline float mixed_from_uint24_fast(uint24_t sample);
+MIXED_EXPORT extern inline float mixed_from_int32_fast(int32_t sample);
+MIXED_EXPORT extern inline float mixed_from_uint32_fast(uint32_t sample);
 MIXED_EXPORT extern inline float mixed_to_float(float sample);
 MIXED_EXPORT extern inline double mixed_to_double(float sample);
 MIXED_EXPORT extern inline int8_t mixed_to_int8(float sample);
@@ -20,3 +28,6 @@ MIXED_EXPORT extern inline int24_t mixed_to_int24(float sample);
 MIXED_EXPORT extern inline uint24_t mixed_to_uint24(float sample);
 MIXED_EXPORT extern inline int32_t mixed_to_int32(float sample);
 MIXED_EXPORT extern inline uint32_t mixed_to_uint32(float sample);
+MIXED_EXPORT extern inline float mixed_tpdf_noise(uint32_t *state);
+MIXED_EXPORT extern inline int16_t mixed_to_int16_dither(float sample, uint32_t *state);
+MIXED_EXPORT extern inline int24_t mixed_to_int24_dither(float sample, uint32_t *state);
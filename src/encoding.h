@@ -68,6 +68,50 @@ MIXED_EXPORT inline float mixed_from_uint32(uint32_t sample){
   return mixed_from_double(((double)sample-0x80000000L)/((double)0x80000000L));
 }
 
+// The fast decoders scale by a power of two on both sides of zero,
+// so the most negative value maps to -1 and the largest positive one
+// just short of 1. This saves the sign branch and the division, and
+// is the exact inverse of the encoders below.
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_int8_fast(int8_t sample){
+  return sample * (1.0f/0x80);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_uint8_fast(uint8_t sample){
+  return sample * (1.0f/0x80) - 1.0f;
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_int16_fast(int16_t sample){
+  return sample * (1.0f/0x8000);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_uint16_fast(uint16_t sample){
+  return sample * (1.0f/0x8000) - 1.0f;
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_int24_fast(int24_t sample){
+  return sample * (1.0f/0x800000);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_uint24_fast(uint24_t sample){
+  return (int32_t)(sample - 0x800000) * (1.0f/0x800000);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_int32_fast(int32_t sample){
+  return sample * (1.0f/0x80000000L);
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_from_uint32_fast(uint32_t sample){
+  return (int32_t)(sample - 0x80000000L) * (1.0f/0x80000000L);
+}
+
 __attribute__((always_inline))
 MIXED_EXPORT inline float mixed_to_float(float sample){
   return (1.0f<=sample)? 1.0f
@@ -137,3 +181,31 @@ MIXED_EXPORT inline uint32_t mixed_to_uint32(float sample){
     : (-1.0f<=sample)? (sample+1)*0x80000000L
     : 0;
 }
+
+// Triangular noise with a peak of one step, built from two uniform
+// draws of a xorshift generator. The state must not be zero.
+__attribute__((always_inline))
+MIXED_EXPORT inline float mixed_tpdf_noise(uint32_t *state){
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return ((int32_t)(x & 0xFFFF) - (int32_t)(x >> 16)) * (1.0f/0x10000);
+}
+
+// Dithered encoders round instead of truncating, and clip without
+// branches. A NaN sample stays NaN through the dither, and as fmaxf
+// returns the other argument for NaN, clipping the low end first
+// takes it to the minimum like in the plain encoders.
+__attribute__((always_inline))
+MIXED_EXPORT inline int16_t mixed_to_int16_dither(float sample, uint32_t *state){
+  float value = floorf(sample*0x8000 + mixed_tpdf_noise(state) + 0.5f);
+  return fminf(INT16_MAX, fmaxf(INT16_MIN, value));
+}
+
+__attribute__((always_inline))
+MIXED_EXPORT inline int24_t mixed_to_int24_dither(float sample, uint32_t *state){
+  float value = floorf(sample*0x800000 + mixed_tpdf_noise(state) + 0.5f);
+  return fminf(INT24_MAX, fmaxf(INT24_MIN, value));
+}
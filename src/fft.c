@@ -0,0 +1,81 @@
+#include "internal.h"
+#include "spiral_fft.h"
+
+// The even and odd samples are packed into one complex sequence of half
+// the length, and the two interleaved spectra are separated again with
+// the twiddle factors W^k = exp(-2 pi i k / n) for k in [0, n/2].
+
+int make_fft_real(uint32_t size, struct fft_real *fft){
+  if(size < 4 || FFT_MAX_SIZE < size || (size & (size-1)) != 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint32_t half = size/2;
+  fft->twiddle = mixed_calloc(2*(half+1), sizeof(float));
+  fft->work = mixed_calloc(2*half, sizeof(float));
+  if(!fft->twiddle || !fft->work){
+    free_fft_real(fft);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  for(uint32_t k=0; k<=half; ++k){
+    double w = -2.0 * M_PI * k / size;
+    fft->twiddle[2*k+0] = cos(w);
+    fft->twiddle[2*k+1] = sin(w);
+  }
+  fft->size = size;
+  return 1;
+}
+
+void free_fft_real(struct fft_real *fft){
+  if(fft->twiddle) mixed_free(fft->twiddle);
+  if(fft->work) mixed_free(fft->work);
+  fft->twiddle = 0;
+  fft->work = 0;
+  fft->size = 0;
+}
+
+VECTORIZE void fft_real_forward(float *in, float *re, float *im, struct fft_real *fft){
+  uint32_t half = fft->size/2;
+  float *z = fft->work;
+  float *w = fft->twiddle;
+  spiral_fft_float(half, -1, in, z);
+  for(uint32_t k=0; k<=half; ++k){
+    uint32_t a = (k == half)? 0 : k;
+    uint32_t b = (k == 0)? 0 : half-k;
+    float zr = z[2*a], zi = z[2*a+1];
+    float cr = z[2*b], ci = -z[2*b+1];
+    // E = (Z[k] + conj(Z[M-k])) / 2, O = (Z[k] - conj(Z[M-k])) / 2i
+    float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    float odd_r = 0.5f * (zi - ci), odd_i = -0.5f * (zr - cr);
+    re[k] = er + w[2*k] * odd_r - w[2*k+1] * odd_i;
+    im[k] = ei + w[2*k] * odd_i + w[2*k+1] * odd_r;
+  }
+}
+
+VECTORIZE void fft_real_inverse(float *re, float *im, float *out, struct fft_real *fft){
+  uint32_t half = fft->size/2;
+  float *z = fft->work;
+  float *w = fft->twiddle;
+  float scale = 1.0f / half;
+  for(uint32_t k=0; k<half; ++k){
+    float xr = re[k], xi = im[k];
+    float cr = re[half-k], ci = -im[half-k];
+    // E = (X[k] + conj(X[M-k])) / 2, O = (X[k] - conj(X[M-k])) conj(W^k) / 2
+    float er = 0.5f * (xr + cr), ei = 0.5f * (xi + ci);
+    float dr = 0.5f * (xr - cr), di = 0.5f * (xi - ci);
+    float odd_r = dr * w[2*k] + di * w[2*k+1];
+    float odd_i = di * w[2*k] - dr * w[2*k+1];
+    // Z = E + iO
+    z[2*k+0] = (er - odd_i) * scale;
+    z[2*k+1] = (ei + odd_r) * scale;
+  }
+  spiral_fft_float(half, +1, z, out);
+}
+
+VECTORIZE void fft_multiply_add(float *restrict are, float *restrict aim, float *restrict bre, float *restrict bim, float *restrict re, float *restrict im, uint32_t bins){
+  for(uint32_t k=0; k<bins; ++k){
+    re[k] += are[k] * bre[k] - aim[k] * bim[k];
+    im[k] += are[k] * bim[k] + aim[k] * bre[k];
+  }
+}
@@ -0,0 +1,124 @@
+#include "internal.h"
+
+// Conversion between floats and IEEE half floats for compact buffers.
+// Rounding is to nearest even throughout, so every kernel gives the
+// same bits, and halves that went through a float come back the same.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_F16C 1
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+void (*half_to_float)(const uint16_t *in, float *out, uint32_t samples) = 0;
+void (*half_from_float)(const float *in, uint16_t *out, uint32_t samples) = 0;
+
+static inline float half_to_float_1(uint16_t h){
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1F;
+  uint32_t mantissa = h & 0x3FF;
+  uint32_t x;
+  float f;
+  if(exponent == 0){
+    f = mantissa * (1.0f / 16777216.0f);
+    return sign? -f : f;
+  }else if(exponent == 31){
+    x = sign | 0x7F800000 | (mantissa << 13);
+  }else{
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static inline uint16_t half_from_float_1(float f){
+  uint32_t x, h, rest;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t bits = x & 0x7FFFFFFF;
+  if(0x7F800000 <= bits) // Infinity and NaN
+    return sign | 0x7C00 | ((0x7F800000 < bits)? 0x200 : 0);
+  if(0x477FF000 <= bits) // Rounds past the largest half
+    return sign | 0x7C00;
+  if(bits < 0x38800000){ // Subnormal as a half
+    if(bits < 0x33000000) return sign;
+    uint32_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+    uint32_t shift = 126 - (bits >> 23);
+    h = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    uint32_t tie = 1u << (shift - 1);
+    if(tie < rest || (rest == tie && (h & 1))) h++;
+    return sign | h;
+  }
+  h = (bits - 0x38000000) >> 13;
+  rest = bits & 0x1FFF;
+  if(0x1000 < rest || (rest == 0x1000 && (h & 1))) h++;
+  return sign | h;
+}
+
+static void half_to_float_scalar(const uint16_t *in, float *out, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = half_to_float_1(in[i]);
+}
+
+static void half_from_float_scalar(const float *in, uint16_t *out, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] = half_from_float_1(in[i]);
+}
+
+#ifdef HAVE_F16C
+__attribute__((target("avx,f16c")))
+static void half_to_float_f16c(const uint16_t *in, float *out, uint32_t samples){
+  uint32_t i = 0;
+  for(; i+8<=samples; i+=8)
+    _mm256_storeu_ps(out+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in+i))));
+  for(; i<samples; ++i)
+    out[i] = half_to_float_1(in[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void half_from_float_f16c(const float *in, uint16_t *out, uint32_t samples){
+  uint32_t i = 0;
+  for(; i+8<=samples; i+=8)
+    _mm_storeu_si128((__m128i *)(out+i), _mm256_cvtps_ph(_mm256_loadu_ps(in+i), _MM_FROUND_TO_NEAREST_INT));
+  for(; i<samples; ++i)
+    out[i] = half_from_float_1(in[i]);
+}
+#endif
+
+#ifdef HAVE_NEON
+static void half_to_float_neon(const uint16_t *in, float *out, uint32_t samples){
+  uint32_t i = 0;
+  for(; i+4<=samples; i+=4)
+    vst1q_f32(out+i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in+i))));
+  for(; i<samples; ++i)
+    out[i] = half_to_float_1(in[i]);
+}
+
+static void half_from_float_neon(const float *in, uint16_t *out, uint32_t samples){
+  uint32_t i = 0;
+  for(; i+4<=samples; i+=4)
+    vst1_u16(out+i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in+i))));
+  for(; i<samples; ++i)
+    out[i] = half_from_float_1(in[i]);
+}
+#endif
+
+void half_dispatch(){
+  half_to_float = half_to_float_scalar;
+  half_from_float = half_from_float_scalar;
+#ifdef HAVE_F16C
+  if(cpu_features & MIXED_CPU_F16C){
+    half_to_float = half_to_float_f16c;
+    half_from_float = half_from_float_f16c;
+  }
+#endif
+#ifdef HAVE_NEON
+  if(cpu_features & MIXED_CPU_NEON){
+    half_to_float = half_to_float_neon;
+    half_from_float = half_from_float_neon;
+  }
+#endif
+}
@@ -0,0 +1,121 @@
+#include "internal.h"
+
+// Directions are interpolated from the nearest measured ones, weighted
+// by how close they are in angle. The weights are applied to the
+// spectra, which is exact for time aligned responses.
+#define HRTF_NEIGHBOURS 3
+
+void hrtf_retain(struct hrtf_data *hrtf){
+  __atomic_add_fetch(&hrtf->references, 1, __ATOMIC_SEQ_CST);
+}
+
+void hrtf_release(struct hrtf_data *hrtf){
+  if(!hrtf) return;
+  if(__atomic_sub_fetch(&hrtf->references, 1, __ATOMIC_SEQ_CST) == 0){
+    if(hrtf->directions) mixed_free(hrtf->directions);
+    if(hrtf->re) mixed_free(hrtf->re);
+    if(hrtf->im) mixed_free(hrtf->im);
+    mixed_free(hrtf);
+  }
+}
+
+MIXED_EXPORT int mixed_make_hrtf(float *directions, float *left, float *right, uint32_t count, uint32_t samples, struct mixed_hrtf *hrtf){
+  struct fft_real fft = {0};
+  float *window = 0;
+  uint32_t partition = 32;
+  while(partition < samples) partition <<= 1;
+  if(count == 0 || samples == 0 || FFT_MAX_SIZE/2 < partition){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct hrtf_data *data = mixed_calloc(1, sizeof(struct hrtf_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->references = 1;
+  data->count = count;
+  data->partition = partition;
+  uint32_t bins = partition+1;
+  data->directions = mixed_calloc(3*count, sizeof(float));
+  data->re = mixed_calloc(2*count*bins, sizeof(float));
+  data->im = mixed_calloc(2*count*bins, sizeof(float));
+  window = mixed_calloc(2*partition, sizeof(float));
+  if(!data->directions || !data->re || !data->im || !window){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  if(!make_fft_real(2*partition, &fft))
+    goto cleanup;
+
+  for(uint32_t d=0; d<count; ++d){
+    float *in = directions+3*d, *out = data->directions+3*d;
+    float mag = sqrtf(in[0]*in[0] + in[1]*in[1] + in[2]*in[2]);
+    if(mag == 0.0f){
+      mixed_err(MIXED_INVALID_VALUE);
+      goto cleanup;
+    }
+    out[0] = in[0]/mag; out[1] = in[1]/mag; out[2] = in[2]/mag;
+    // Zero padded as for the convolution segment, see there.
+    for(uint32_t ear=0; ear<2; ++ear){
+      memset(window, 0, 2*partition*sizeof(float));
+      memcpy(window, (ear? right : left)+d*samples, samples*sizeof(float));
+      fft_real_forward(window, data->re+(2*d+ear)*bins, data->im+(2*d+ear)*bins, &fft);
+    }
+  }
+  free_fft_real(&fft);
+  mixed_free(window);
+
+  hrtf->_data = data;
+  hrtf->count = count;
+  hrtf->samples = samples;
+  hrtf->partition = partition;
+  return 1;
+
+ cleanup:
+  free_fft_real(&fft);
+  if(window) mixed_free(window);
+  hrtf_release(data);
+  return 0;
+}
+
+MIXED_EXPORT void mixed_free_hrtf(struct mixed_hrtf *hrtf){
+  hrtf_release((struct hrtf_data *)hrtf->_data);
+  hrtf->_data = 0;
+}
+
+void hrtf_interpolate(const float direction[3], float gain, float *re, float *im, struct hrtf_data *hrtf){
+  uint32_t nearest[HRTF_NEIGHBOURS];
+  float weights[HRTF_NEIGHBOURS];
+  uint32_t found = 0;
+  uint32_t bins = hrtf->partition+1;
+
+  // Keep the closest directions sorted by their weight.
+  for(uint32_t d=0; d<hrtf->count; ++d){
+    float *other = hrtf->directions+3*d;
+    float dot = direction[0]*other[0] + direction[1]*other[1] + direction[2]*other[2];
+    float weight = 1.0f / (1.0001f - dot);
+    uint32_t i = MIN(found, HRTF_NEIGHBOURS-1);
+    if(found == HRTF_NEIGHBOURS && weight <= weights[i]) continue;
+    for(; 0 < i && weights[i-1] < weight; --i){
+      weights[i] = weights[i-1];
+      nearest[i] = nearest[i-1];
+    }
+    weights[i] = weight;
+    nearest[i] = d;
+    if(found < HRTF_NEIGHBOURS) ++found;
+  }
+
+  float total = 0.0f;
+  for(uint32_t i=0; i<found; ++i) total += weights[i];
+  memset(re, 0, 2*bins*sizeof(float));
+  memset(im, 0, 2*bins*sizeof(float));
+  for(uint32_t i=0; i<found; ++i){
+    float w = gain * weights[i] / total;
+    float *sre = hrtf->re+2*nearest[i]*bins, *sim = hrtf->im+2*nearest[i]*bins;
+    for(uint32_t k=0; k<2*bins; ++k){
+      re[k] += w * sre[k];
+      im[k] += w * sim[k];
+    }
+  }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <math.h>
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
@@ -22,6 +23,7 @@
 # endif
 #endif
 #define BASE_VECTOR_SIZE 128
+#define BASE_POOL_SIZE 16
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -32,9 +34,13 @@ static inline void __ignore(char _, ...){(void)_;}
 
 #if defined(__GNUC__) && !defined(__WIN32__)
 #if defined(__x86_64__)
-#define VECTORIZE __attribute__((target_clones("avx2","avx","sse4.1","default")))
+#define VECTORIZE __attribute__((target_clones("avx512f","avx2","avx","sse4.1","default")))
 #elif defined(__arm__)
 #define VECTORIZE __attribute__((target_clones("neon","default")))
+#elif defined(__aarch64__) && 14 <= __GNUC__ && !defined(__clang__)
+// NEON is part of the base instruction set here, so the default
+// clone already uses it. Only SVE is worth a second one.
+#define VECTORIZE __attribute__((target_clones("sve","default")))
 #else
 #define VECTORIZE
 #endif
@@ -42,6 +48,44 @@ static inline void __ignore(char _, ...){(void)_;}
 #define VECTORIZE
 #endif
 
+// Denormals are flushed to zero while mixing by setting the FPU
+// control register, see mixed_flush_denormals. Where there is no such
+// control, the recursive filters flush their state themselves: adding
+// and removing a small constant rounds anything below it to zero.
+#if defined(__GNUC__) && (defined(__SSE__) || defined(__aarch64__))
+#define HAVE_FLUSH_DENORMALS 1
+#define undenormal(x) (x)
+#else
+#define undenormal(x) ((x) + 1e-18f - 1e-18f)
+#endif
+
+static inline uint64_t fpu_flush_denormals(){
+#if defined(HAVE_FLUSH_DENORMALS) && defined(__SSE__)
+  uint32_t csr = __builtin_ia32_stmxcsr();
+  // Flush to zero (15) and denormals are zero (6).
+  __builtin_ia32_ldmxcsr(csr | 0x8040);
+  return csr;
+#elif defined(HAVE_FLUSH_DENORMALS)
+  uint64_t fpcr;
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+  // Flush to zero (24), which covers inputs as well.
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1 << 24)));
+  return fpcr;
+#else
+  return 0;
+#endif
+}
+
+static inline void fpu_restore(uint64_t state){
+#if defined(HAVE_FLUSH_DENORMALS) && defined(__SSE__)
+  __builtin_ia32_ldmxcsr((uint32_t)state);
+#elif defined(HAVE_FLUSH_DENORMALS)
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+#else
+  IGNORE(state);
+#endif
+}
+
 struct bip{
   void *data;
   uint32_t size;
@@ -63,18 +107,253 @@ int vector_remove_count(uint32_t i, uint32_t n, struct vector *vector);
 int vector_remove_pos(uint32_t i, struct vector *vector);
 int vector_remove_item(void *element, struct vector *vector);
 int vector_clear(struct vector *vector);
+int vector_reserve(uint32_t size, struct vector *vector);
+
+// A list that readers can walk without a lock while it is changed. A
+// change copies the array and publishes the copy atomically, the old
+// array is only reused or freed once no reader is inside anymore.
+// Readers hold on to the array between rcu_enter and rcu_leave. The
+// array may be null if nothing was ever added.
+//
+// One reader may also drop elements off the front with rcu_pop, which
+// takes no lock and never allocates. The elements then start at
+// rcu_first. A change freezes the array it replaces, after which pops
+// on it fail and have to be retried on the new array.
+#define RCU_FROZEN 0x80000000u
+
+struct rcu_array{
+  struct rcu_array *next;
+  uint32_t size;
+  uint32_t count;
+  uint32_t popped;
+  void *data[];
+};
+
+struct rcu_vector{
+  struct rcu_array *current;
+  struct rcu_array *retired;
+  struct rcu_array *spare;
+  uint32_t readers;
+  uint32_t lock;
+  uint32_t capacity;
+};
+
+struct rcu_array *rcu_enter(struct rcu_vector *vector);
+void rcu_leave(struct rcu_vector *vector);
+// Drops the element at index i, which must be the first, off an array
+// the caller is inside of. Fails if it is not the first or a change is
+// replacing the array.
+int rcu_pop(uint32_t i, struct rcu_array *array);
+// Waits until no reader is inside, after which nothing that was
+// removed before the call can still be in use.
+void rcu_wait(struct rcu_vector *vector);
+int rcu_add(void *element, struct rcu_vector *vector);
+int rcu_add_pos(uint32_t i, void *element, struct rcu_vector *vector);
+int rcu_remove_pos(uint32_t i, struct rcu_vector *vector);
+int rcu_remove_item(void *element, struct rcu_vector *vector);
+// Hands the old array to the caller, who frees it with mixed_free.
+int rcu_clear(struct rcu_array **old, struct rcu_vector *vector);
+int rcu_reserve(uint32_t size, struct rcu_vector *vector);
+void free_rcu_vector(struct rcu_vector *vector);
+
+static inline uint32_t rcu_first(struct rcu_array *array){
+  return __atomic_load_n(&array->popped, __ATOMIC_SEQ_CST) & ~RCU_FROZEN;
+}
+
+// Lets a segment skip its work on a silent input. The input is consumed
+// and as many zeros are committed to the output as silence, which costs
+// nothing when both are the same buffer. Returns the number of samples.
+uint32_t buffer_pass_silence(struct mixed_buffer *in, struct mixed_buffer *out);
+// The number of samples waiting to be read, across the wrap.
+uint32_t buffer_pending(struct mixed_buffer *buffer);
+// Lets a virtual source keep its place in its input without being
+// mixed, by consuming as much as it would have played at the pitch, as
+// far as there is. The resampler continues from the last sample.
+struct resample_data;
+void buffer_skip(float pitch, uint32_t samples, struct mixed_buffer *buffer, struct resample_data *resampler);
+// Like mixed_buffers_request_read and _write, but also hand out the
+// areas of half buffers, which the caller tells apart by is_half.
+int buffers_request_read_any(uint32_t count, struct mixed_buffer **buffers, void **areas, uint32_t *size);
+int buffers_request_write_any(uint32_t count, struct mixed_buffer **buffers, void **areas, uint32_t *size);
+
+// Half buffers are converted to floats this many samples at a time,
+// which keeps the scratch in the first level cache.
+#define HALF_BLOCK 256
+extern void (*half_to_float)(const uint16_t *in, float *out, uint32_t samples);
+extern void (*half_from_float)(const float *in, uint16_t *out, uint32_t samples);
+void half_dispatch();
+
+// A float view of samples pos to pos+samples of a float or half area,
+// converted into the scratch if need be.
+static inline float *half_view(void *area, char is_half, uint32_t pos, uint32_t samples, float *scratch){
+  if(!is_half) return (float *)area+pos;
+  half_to_float((uint16_t *)area+pos, scratch, samples);
+  return scratch;
+}
+
+// Where to put float results for a float or half area. Follow up with
+// half_commit once they are written.
+static inline float *half_target(void *area, char is_half, uint32_t pos, float *scratch){
+  return is_half? scratch : (float *)area+pos;
+}
+
+static inline void half_commit(void *area, char is_half, uint32_t pos, uint32_t samples, const float *scratch){
+  if(is_half) half_from_float(scratch, (uint16_t *)area+pos, samples);
+}
+// The level below which a decaying tail counts as silence.
+#define SILENCE_FLOOR 1e-7f
+// The alignment we give data that is shared or meant for vector code.
+#define CACHE_LINE_SIZE 64
+
+// Fixed-size element pool. Reserving up front means later allocations
+// only pop the free list and never call into the allocator.
+struct pool{
+  void *blocks;
+  void *free;
+  uint32_t element_size;
+  uint32_t capacity;
+  uint32_t used;
+};
+
+int make_pool(uint32_t element_size, struct pool *pool);
+void free_pool(struct pool *pool);
+int pool_reserve(uint32_t count, struct pool *pool);
+void *pool_alloc(struct pool *pool);
+void pool_free(void *element, struct pool *pool);
+
+// A table of float columns that all share one length and one
+// allocation, so that a parameter of every element is contiguous.
+// Column pointers are invalidated by columns_reserve.
+struct columns{
+  float *data;
+  uint32_t size;
+  uint32_t count;
+};
+
+int make_columns(uint32_t count, struct columns *columns);
+void free_columns(struct columns *columns);
+int columns_reserve(uint32_t size, struct columns *columns);
+
+inline float *column(uint32_t i, struct columns *columns){
+  return columns->data + i*columns->size;
+}
+
+// Per-sample parameter smoothing. Setting a new target restarts the
+// ramp from the current value. The step is computed once so that the
+// inner loops only add or multiply.
+#define DEFAULT_RAMP_DURATION 64
+
+struct ramp{
+  float value;
+  float target;
+  float step;
+  uint32_t remaining;
+  uint32_t duration;
+  uint8_t type;
+  char multiply;
+};
+
+void ramp_init(float value, struct ramp *ramp);
+void ramp_to(float target, struct ramp *ramp);
+void ramp_skip(uint32_t samples, struct ramp *ramp);
+// The number of the next samples, at most the given count, whose gains
+// lie on one line.
+uint32_t ramp_span(uint32_t samples, struct ramp *ramp);
+// Advances the ramp past a span, whose gains are start + step*(i+1).
+void ramp_take(uint32_t samples, float *start, float *step, struct ramp *ramp);
+
+inline float ramp_next(struct ramp *ramp){
+  if(ramp->remaining == 0) return ramp->value;
+  if(--ramp->remaining == 0){
+    ramp->value = ramp->target;
+  }else if(ramp->multiply){
+    ramp->value *= ramp->step;
+  }else{
+    ramp->value += ramp->step;
+  }
+  return ramp->value;
+}
+
+// Variable rate resampling by linear interpolation, cheap enough to
+// keep one per source of a mixer. A pitch above one consumes more
+// input than it produces output. resample_frames tells how much output
+// the available input can make, resample_linear returns how much input
+// it consumed.
+struct resample_data{
+  float phase;
+  float last;
+};
+
+uint32_t resample_frames(float pitch, float phase, uint32_t available);
+uint32_t resample_linear(float pitch, float *in, float *out, uint32_t samples, struct resample_data *state);
+
+// Band limited resampling by a fixed ratio of output to input rate for
+// several planar channels in lockstep. polyphase_process consumes up to
+// in_frames and produces up to out_frames, and updates both to what it
+// actually used and made.
+struct polyphase{
+  float *bank;
+  float *history;
+  double ratio;
+  double increment;
+  double fraction;
+  uint32_t up;
+  uint32_t down;
+  uint32_t phase;
+  uint32_t phases;
+  uint32_t rows;
+  uint32_t taps;
+  uint32_t channels;
+  uint32_t start;
+  uint32_t filled;
+  char rational;
+};
+
+int make_polyphase(double ratio, uint32_t channels, struct polyphase *state);
+void free_polyphase(struct polyphase *state);
+void polyphase_reset(struct polyphase *state);
+void polyphase_process(float **in, uint32_t *in_frames, float **out, uint32_t *out_frames, struct polyphase *state);
+
+// Voice limiting for the mixers. Of the voices marked as candidates,
+// the limit with the highest priority, and of equal priority the
+// loudest, keep playing. Every other candidate is marked as stolen.
+// order is scratch space for count indices.
+void voices_limit(uint32_t count, uint32_t limit, const uint8_t *candidates, const float *priority, const float *loudness, uint32_t *order, uint8_t *stolen);
+
+// Real transforms of n samples through a complex transform of half the
+// size. The spectrum is kept as n/2+1 bins in separate real and
+// imaginary arrays, and the inverse is normalised so that it returns
+// exactly what went into the forward transform.
+#define FFT_MAX_SIZE 16384
+
+struct fft_real{
+  uint32_t size;
+  float *twiddle;
+  float *work;
+};
+
+int make_fft_real(uint32_t size, struct fft_real *fft);
+void free_fft_real(struct fft_real *fft);
+void fft_real_forward(float *in, float *re, float *im, struct fft_real *fft);
+void fft_real_inverse(float *re, float *im, float *out, struct fft_real *fft);
+// Accumulate the product of two spectra into a third.
+void fft_multiply_add(float *restrict are, float *restrict aim, float *restrict bre, float *restrict bim, float *restrict re, float *restrict im, uint32_t bins);
 
 struct pitch_data{
   float *in_fifo;
   float *out_fifo;
-  float *fft_workspace;
+  float *window;
+  float *frame;
+  float *output_accumulator;
+  float *re;
+  float *im;
   float *last_phase;
   float *phase_sum;
-  float *output_accumulator;
   float *analyzed_frequency;
   float *analyzed_magnitude;
   float *synthesized_frequency;
   float *synthesized_magnitude;
+  struct fft_real fft;
   long framesize;
   long oversampling;
   long overlap;
@@ -85,6 +364,67 @@ void free_pitch_data(struct pitch_data *data);
 int make_pitch_data(uint32_t framesize, uint32_t oversampling, uint32_t samplerate, struct pitch_data *data);
 void pitch_shift(float pitch, float *in, float *out, uint32_t samples, struct pitch_data *data);
 
+struct wsola_data{
+  float *ring;
+  uint32_t size;
+  float *window;
+  float *reference;
+  float *region;
+  float *coarse_reference;
+  float *coarse_region;
+  uint32_t grain;
+  uint32_t hop;
+  uint32_t search;
+  uint32_t length;
+  uint32_t delay;
+  int64_t time;
+  double start[2];
+  uint32_t index[2];
+  uint32_t next;
+  char started;
+};
+
+void free_wsola_data(struct wsola_data *data);
+int make_wsola_data(float pitch, uint32_t samplerate, struct wsola_data *data);
+// Makes room for the delay the pitch needs, keeping the history.
+int wsola_fit(float pitch, struct wsola_data *data);
+void wsola_shift(float pitch, float *in, float *out, uint32_t samples, struct wsola_data *data);
+
+// Head related responses as prepared by mixed_make_hrtf. Each
+// direction has the spectrum of its left and then its right response,
+// partition+1 bins each.
+struct hrtf_data{
+  uint32_t references;
+  uint32_t count;
+  uint32_t partition;
+  float *directions;
+  float *re;
+  float *im;
+};
+
+void hrtf_retain(struct hrtf_data *hrtf);
+void hrtf_release(struct hrtf_data *hrtf);
+// Write the left and right spectra for a unit direction, scaled by
+// the gain, into 2*(partition+1) bins.
+void hrtf_interpolate(const float direction[3], float gain, float *re, float *im, struct hrtf_data *hrtf);
+
+// A decoded sample as held by a sample bank. The planes of all
+// channels lie back to back, frames floats each, and are never
+// written again once the sample is made.
+struct sample_data{
+  uint32_t references;
+  uint32_t id;
+  channel_t channels;
+  uint32_t frames;
+  uint64_t last_used;
+  float *data;
+};
+
+void sample_retain(struct sample_data *sample);
+void sample_release(struct sample_data *sample);
+// Looks up a sample and marks it as used, without retaining it.
+struct sample_data *sample_bank_get(uint32_t id, struct mixed_sample_bank *bank);
+
 float attenuation_none(float min, float max, float dist, float roll);
 float attenuation_inverse(float min, float max, float dist, float roll);
 float attenuation_linear(float min, float max, float dist, float roll);
@@ -105,8 +445,79 @@ void biquad_peaking(uint32_t rate, float freq, float Q, float gain, struct biqua
 void biquad_allpass(uint32_t rate, float freq, float Q, struct biquad_data *state);
 void biquad_lowshelf(uint32_t rate, float freq, float Q, float gain, struct biquad_data *state);
 void biquad_highshelf(uint32_t rate, float freq, float Q, float gain, struct biquad_data *state);
+int biquad_design(enum mixed_biquad_filter type, uint32_t rate, float freq, float Q, float gain, struct biquad_data *state);
 void biquad_process(struct mixed_buffer *in, struct mixed_buffer *out, struct biquad_data *data);
 
+// A bank runs the same cascade of second order sections over several
+// channels at once. Channels are packed into groups of BIQUAD_LANES so
+// that every coefficient and state array of a section holds one lane
+// per channel, and the transposed direct form II update of a whole
+// group is a handful of vector operations.
+#define BIQUAD_LANES 8
+#define BIQUAD_CHUNK 64
+
+struct biquad_section{
+  float b0[BIQUAD_LANES];
+  float b1[BIQUAD_LANES];
+  float b2[BIQUAD_LANES];
+  float a1[BIQUAD_LANES];
+  float a2[BIQUAD_LANES];
+  float z1[BIQUAD_LANES];
+  float z2[BIQUAD_LANES];
+};
+
+struct biquad_bank{
+  struct biquad_section *sections;
+  uint32_t stages;
+  channel_t channels;
+};
+
+int make_biquad_bank(channel_t channels, uint32_t stages, struct biquad_bank *bank);
+void free_biquad_bank(struct biquad_bank *bank);
+void biquad_bank_set(channel_t channel, uint32_t stage, struct biquad_data *design, struct biquad_bank *bank);
+void biquad_bank_reset(struct biquad_bank *bank);
+void biquad_bank_process(float **in, float **out, uint32_t samples, struct biquad_bank *bank);
+
+// Designs of one filter type over a grid of log-spaced frequencies and
+// Q factors, shared by every filter of the same type, samplerate, and
+// gain. Designs in between are interpolated, which avoids the trig of
+// a full design when filters are swept on every block.
+#define BIQUAD_TABLE_FREQUENCIES 128
+#define BIQUAD_TABLE_QS 32
+// Changes glide over BIQUAD_RAMP samples, in steps of BIQUAD_STEP.
+#define BIQUAD_STEP 16
+#define BIQUAD_RAMP 256
+
+struct biquad_table{
+  struct biquad_table *next;
+  // Five coefficients per design, frequencies running fastest.
+  float *coefficients;
+  float frequency_low;
+  float frequency_scale;
+  float q_low;
+  float q_scale;
+  float gain;
+  uint32_t samplerate;
+  uint32_t references;
+  enum mixed_biquad_filter type;
+};
+
+// Where a filter is on its table's grid, and where it is going.
+struct biquad_glide{
+  float position[2];
+  float target[2];
+  uint32_t ramp;
+  char from_grid;
+  char to_grid;
+};
+
+struct biquad_table *biquad_table_acquire(enum mixed_biquad_filter type, uint32_t samplerate, float gain);
+void biquad_table_release(struct biquad_table *table);
+int biquad_table_fits(struct biquad_table *table, enum mixed_biquad_filter type, uint32_t samplerate, float gain);
+void biquad_table_design(struct biquad_table *table, float frequency, float Q, struct biquad_data *state, struct biquad_glide *glide);
+void biquad_glide_settle(struct biquad_glide *glide);
+void biquad_process_ramp(struct mixed_buffer *in, struct mixed_buffer *out, struct biquad_data *state, struct biquad_data *target, struct biquad_table *table, struct biquad_glide *glide);
+
 inline void biquad_reset(struct biquad_data *data){
   data->x[0] = 0.0f;
   data->x[1] = 0.0f;
@@ -134,12 +545,78 @@ inline float biquad_sample(float sample, struct biquad_data *data){
 
   data->x[0] = sample;
   data->x[1] = xn1;
-  data->y[0] = L;
+  data->y[0] = undenormal(L);
   data->y[1] = yn1;
   return L;
 }
 
-float hilbert(float input, float *delay, uint32_t delay_size, uint32_t delay_i);
+mixed_transfer_function_from simd_translator_from(enum mixed_encoding encoding, char fast);
+mixed_transfer_function_to simd_translator_to(enum mixed_encoding encoding);
+typedef void (*transfer_fused_from)(void *in, float **outs, channel_t channels, uint32_t samples, float volume, float target_volume);
+typedef void (*transfer_fused_to)(float **ins, void *out, channel_t channels, uint32_t samples, float volume, float target_volume);
+transfer_fused_from simd_fused_from(enum mixed_encoding encoding, channel_t channels, char fast);
+transfer_fused_to simd_fused_to(enum mixed_encoding encoding, channel_t channels);
+// The kernels in use by feature, as probed when the library is
+// loaded and narrowed by mixed_cpu_set_features.
+extern uint32_t cpu_features;
+void transfer_dispatch();
+
+uint32_t mirror_granularity();
+void *mirror_alloc(size_t bytes);
+void mirror_free(void *data, size_t bytes);
+
+void free_pack_mapping(void *mapping);
+
+// Planar packs keep their indices in terms of the first channel's
+// plane, with every further plane following at a distance of the
+// pack's size. All byte counts of a planar pack are thus per channel.
+static inline uint32_t pack_frame_bytes(struct mixed_pack *pack){
+  uint32_t size = mixed_samplesize(pack->encoding);
+  return (pack->flags & MIXED_PLANAR)? size : size*pack->channels;
+}
+
+static inline uint8_t pack_stride(struct mixed_pack *pack){
+  return (pack->flags & MIXED_PLANAR)? 1 : pack->channels;
+}
+
+static inline uint32_t pack_channel_offset(channel_t channel, struct mixed_pack *pack){
+  return (pack->flags & MIXED_PLANAR)? channel*pack->size : channel*mixed_samplesize(pack->encoding);
+}
+
+struct thread_pool;
+struct thread_pool *make_thread_pool(uint32_t threads);
+void free_thread_pool(struct thread_pool *pool);
+uint32_t thread_pool_size(struct thread_pool *pool);
+int thread_pool_run(struct thread_pool *pool, uint32_t tasks, int (*function)(void *arg, uint32_t index), void *arg);
+
+// Tables are indexed by the top bits of a 0.32 fixed point phase.
+#define WAVETABLE_BITS 11
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS)
+#define WAVETABLE_LEVELS WAVETABLE_BITS
+void wavetable_init();
+uint32_t wavetable_increment(float frequency, uint32_t samplerate);
+const float *wavetable_get(enum mixed_generator_type type, uint32_t increment);
+void wavetable_render(const float *table, uint32_t *phase, uint32_t increment, float volume, float *out, uint32_t samples);
+void wavetable_render_add(const float *table, uint32_t *phase, uint32_t increment, float volume, float *out, uint32_t samples);
+
+inline float wavetable_sample(const float *table, uint32_t phase){
+  uint32_t index = phase >> (32 - WAVETABLE_BITS);
+  // The fraction fits in 21 bits, so the signed conversion is exact.
+  float fraction = (int32_t)(phase & ((1 << (32 - WAVETABLE_BITS)) - 1)) * (1.0f / (1 << (32 - WAVETABLE_BITS)));
+  float a = table[index];
+  float b = table[index+1];
+  return a + (b - a) * fraction;
+}
+
+// Runs real and imag through two allpass paths in place, so that the
+// same signal in both comes out 90 degrees apart.
+#define HILBERT_STAGES 4
+struct hilbert_data{
+  float sections[2][HILBERT_STAGES][4];
+  float delayed;
+};
+void hilbert_reset(struct hilbert_data *state);
+void hilbert(float *real, float *imag, uint32_t samples, struct hilbert_data *state);
 
 int mix_noop(struct mixed_segment *segment);
 
@@ -150,6 +627,30 @@ void *crealloc(void *ptr, size_t oldcount, size_t newcount, size_t size);
 void *open_library(char *file);
 void close_library(void *handle);
 void *load_symbol(void *handle, char *name);
+// Like load_symbol, but quietly returns NULL for a missing symbol.
+void *find_symbol(void *handle, char *name);
+
+// A monotonic clock in nanoseconds for measuring how long work takes.
+uint64_t mixed_clock();
+
+// Profiling is on while the table exists. Segments are then mixed
+// through profile_mix, and buffer connections reported to it.
+struct profile_table;
+extern struct profile_table *profile_table;
+int profile_mix(struct mixed_segment *segment);
+void profile_connect(int direction, uint32_t location, void *buffer, struct mixed_segment *segment);
+int profile_get(struct mixed_segment_profile *profile, struct mixed_segment *segment);
+// Drops the counters of a segment that is being freed, so that a new
+// segment at the same address starts from nothing.
+void profile_forget(struct mixed_segment *segment);
+
+// Tracing is on while the state exists. Events take a Chrome trace
+// phase and either a static name, or none for the segment's own name.
+struct trace_state;
+extern struct trace_state *trace_state;
+void trace_event(char phase, const char *name, const void *subject);
+int trace_mix(struct mixed_segment *segment);
+void trace_forget(struct mixed_segment *segment);
 
 void set_info_field(struct mixed_segment_field_info *info, uint32_t field, enum mixed_segment_field_type type, uint32_t count, enum mixed_segment_info_flags flags, char*description);
 void clear_info_field(struct mixed_segment_field_info *info);
@@ -157,6 +658,41 @@ void clear_info_field(struct mixed_segment_field_info *info);
 float mixed_random();
 unsigned int mixed_random_int();
 
+// A counter based generator: every position hashes to an independent
+// value, so blocks of them can be computed in parallel.
+inline uint32_t hash_noise(uint32_t position, uint32_t seed){
+  uint32_t mangled = position;
+  mangled *= 0x68E31DA4;
+  mangled += seed;
+  mangled ^= (mangled >> 8);
+  mangled += 0xB5297A4D;
+  mangled ^= (mangled << 8);
+  mangled *= 0x1B56C4E9;
+  mangled ^= (mangled >> 8);
+  return mangled;
+}
+
+// Branch-free approximations of log2 and exp2 for per-sample decibel
+// math. Both stay within about 1e-4 of the exact result, which is well
+// below a hundredth of a dB. fast_log2 expects a positive argument.
+inline float fast_log2(float x){
+  union { float f; uint32_t i; } bits = {x};
+  float exponent = (float)(int32_t)((bits.i >> 23) & 0xFF) - 127.0f;
+  bits.i = (bits.i & 0x007FFFFF) | 0x3F800000;
+  float m = bits.f;
+  return exponent - 1.7417939f + (2.8212026f + (-1.4699568f + (0.44717955f - 0.056570851f*m)*m)*m)*m;
+}
+
+inline float fast_exp2(float x){
+  x = MIN(MAX(x, -126.0f), 126.0f);
+  float whole = floorf(x);
+  float f = x - whole;
+  float p = 1.0f + f*(0.69314718f + f*(0.24022651f + f*(0.05550411f + f*(0.00961813f + f*0.00133336f))));
+  union { float f; uint32_t i; } scale;
+  scale.i = (uint32_t)((int32_t)whole + 127) << 23;
+  return p*scale.f;
+}
+
 #define ARG(type, id) *(((type**)args)[id])
 #define REGISTER_SEGMENT(name, function, count, ...)                    \
   static void __register_ ## name () __attribute__((constructor));      \
@@ -0,0 +1,179 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "internal.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct pack_mapping{
+  void *base;
+  size_t size;
+};
+
+static int wrap_pack(void *base, size_t size, unsigned char *data, uint32_t bytes, struct mixed_pack *pack){
+  uint32_t framesize = pack_frame_bytes(pack);
+  if(framesize == 0 || pack->channels == 0){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    return 0;
+  }
+  struct pack_mapping *mapping = mixed_calloc(1, sizeof(struct pack_mapping));
+  if(!mapping){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  mapping->base = base;
+  mapping->size = size;
+  // Present the data as a completely filled bip buffer so that
+  // readers can consume it without anything ever being written.
+  if(pack->flags & MIXED_PLANAR)
+    bytes /= pack->channels;
+  bytes -= bytes % framesize;
+  pack->_data = data;
+  pack->size = bytes;
+  pack->read = 0;
+  pack->write = bytes;
+  pack->reserved = 0;
+  pack->_shared = 0;
+  pack->_mapping = mapping;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_pack_external(void *data, uint32_t size, struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  if(!data){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  return wrap_pack(0, 0, data, size, pack);
+}
+
+#ifndef _WIN32
+
+static uint32_t read_u16(unsigned char *data){
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t read_u32(unsigned char *data){
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static int wav_encoding(uint32_t format, uint32_t bits, enum mixed_encoding *encoding){
+  if(format == 1){
+    switch(bits){
+    case 8: *encoding = MIXED_UINT8; return 1;
+    case 16: *encoding = MIXED_INT16; return 1;
+    case 24: *encoding = MIXED_INT24; return 1;
+    case 32: *encoding = MIXED_INT32; return 1;
+    }
+  }else if(format == 3){
+    switch(bits){
+    case 32: *encoding = MIXED_FLOAT; return 1;
+    case 64: *encoding = MIXED_DOUBLE; return 1;
+    }
+  }
+  return 0;
+}
+
+// Returns 0 if the data is not a WAVE file at all, -1 if it is but
+// cannot be understood, and 1 if the pack was filled in.
+static int parse_wav(unsigned char *file, size_t size, unsigned char **data, uint32_t *bytes, struct mixed_pack *pack){
+  if(size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file+8, "WAVE", 4) != 0)
+    return 0;
+  int have_format = 0;
+  size_t i = 12;
+  while(i+8 <= size){
+    unsigned char *chunk = file+i;
+    uint32_t length = read_u32(chunk+4);
+    if(size-i-8 < length) length = size-i-8;
+    if(memcmp(chunk, "fmt ", 4) == 0 && 16 <= length){
+      uint32_t format = read_u16(chunk+8);
+      uint32_t bits = read_u16(chunk+22);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in its sub-type GUID.
+      if(format == 0xFFFE && 26 <= length)
+        format = read_u16(chunk+32);
+      if(!wav_encoding(format, bits, &pack->encoding))
+        return -1;
+      pack->channels = read_u16(chunk+10);
+      pack->samplerate = read_u32(chunk+12);
+      pack->flags &= ~MIXED_PLANAR;
+      have_format = 1;
+    }else if(memcmp(chunk, "data", 4) == 0){
+      if(!have_format) return -1;
+      *data = chunk+8;
+      *bytes = length;
+      return 1;
+    }
+    i += 8 + length + (length & 1);
+  }
+  return -1;
+}
+
+MIXED_EXPORT int mixed_make_pack_file(const char *file, struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  int fd = open(file, O_RDONLY);
+  if(fd < 0){
+    mixed_err(MIXED_FILE_OPEN_FAILED);
+    return 0;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size <= 0 || UINT32_MAX < (uint64_t)st.st_size){
+    close(fd);
+    mixed_err(MIXED_FILE_OPEN_FAILED);
+    return 0;
+  }
+  size_t size = (size_t)st.st_size;
+  unsigned char *base = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if(base == MAP_FAILED){
+    mixed_err(MIXED_FILE_OPEN_FAILED);
+    return 0;
+  }
+
+  unsigned char *data = base;
+  uint32_t bytes = (uint32_t)size;
+  int wav = parse_wav(base, size, &data, &bytes, pack);
+  if(wav < 0){
+    mixed_err(MIXED_BAD_FILE_FORMAT);
+    goto cleanup;
+  }
+  if(!wrap_pack(base, size, data, bytes, pack))
+    goto cleanup;
+
+#ifdef MADV_SEQUENTIAL
+  madvise(base, size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+  madvise(base, size, MADV_WILLNEED);
+#endif
+  return 1;
+
+ cleanup:
+  munmap(base, size);
+  return 0;
+}
+
+void free_pack_mapping(void *mapping){
+  struct pack_mapping *map = (struct pack_mapping *)mapping;
+  if(map->base) munmap(map->base, map->size);
+  mixed_free(map);
+}
+
+#else
+
+MIXED_EXPORT int mixed_make_pack_file(const char *file, struct mixed_pack *pack){
+  IGNORE(file, pack);
+  mixed_err(MIXED_NOT_IMPLEMENTED);
+  return 0;
+}
+
+void free_pack_mapping(void *mapping){
+  mixed_free(mapping);
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "internal.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+uint32_t mirror_granularity(){
+  long page = sysconf(_SC_PAGESIZE);
+  return (page <= 0)? 4096 : (uint32_t)page;
+}
+
+static int mirror_open(){
+#if defined(__linux__) && defined(SYS_memfd_create)
+  // Called through syscall so we do not depend on a new enough libc.
+  return syscall(SYS_memfd_create, "mixed-buffer", 1 /* MFD_CLOEXEC */);
+#else
+  char name[64];
+  int fd = -1;
+  for(int i=0; i<16 && fd < 0; ++i){
+    snprintf(name, sizeof(name), "/mixed-%ld-%u", (long)getpid(), mixed_random_int());
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(0 <= fd) shm_unlink(name);
+  }
+  return fd;
+#endif
+}
+
+void *mirror_alloc(size_t bytes){
+  int fd = mirror_open();
+  if(fd < 0){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(ftruncate(fd, bytes) != 0) goto cleanup;
+  // Reserve the full range first so that both halves land next to
+  // each other, then map the same pages into each half.
+  char *base = mmap(0, 2*bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(base == MAP_FAILED) goto cleanup;
+  if(mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+     || mmap(base+bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED){
+    munmap(base, 2*bytes);
+    goto cleanup;
+  }
+  close(fd);
+  return base;
+
+ cleanup:
+  close(fd);
+  mixed_err(MIXED_OUT_OF_MEMORY);
+  return 0;
+}
+
+void mirror_free(void *data, size_t bytes){
+  if(data) munmap(data, 2*bytes);
+}
+
+#else
+
+uint32_t mirror_granularity(){
+  return 4096;
+}
+
+void *mirror_alloc(size_t bytes){
+  IGNORE(bytes);
+  mixed_err(MIXED_NOT_IMPLEMENTED);
+  return 0;
+}
+
+void mirror_free(void *data, size_t bytes){
+  IGNORE(data, bytes);
+}
+
+#endif
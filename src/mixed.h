@@ -126,7 +126,27 @@ extern "C" {
     MIXED_DUPLICATE_SEGMENT,
     /// A segment with the requested name is not registered.
     /// 
-    MIXED_BAD_SEGMENT
+    MIXED_BAD_SEGMENT,
+    /// The connections in a graph form a cycle and cannot
+    /// be scheduled.
+    MIXED_GRAPH_CYCLE,
+    /// A worker thread could not be created.
+    /// 
+    MIXED_THREAD_FAILED,
+    /// A queue has no space left for another element.
+    /// 
+    MIXED_QUEUE_FULL,
+    /// A file could not be opened or mapped into memory.
+    /// 
+    MIXED_FILE_OPEN_FAILED,
+    /// The contents of a file are not in a format that can
+    /// be understood.
+    MIXED_BAD_FILE_FORMAT,
+    /// The plugin was built against a different version of the
+    /// plugin interface.
+    MIXED_PLUGIN_VERSION_MISMATCH,
+    /// The audio device could not be opened or configured.
+    MIXED_DEVICE_FAILED
   };
 
   /// This enum describes the possible sample encodings.
@@ -260,6 +280,8 @@ extern "C" {
     /// Access the closing threshold for the gate as a float.
     /// The threshold is in dB.
     /// The default is -32dB
+    /// A closing threshold above the opening threshold acts as if it
+    /// were the same as the opening threshold.
     MIXED_GATE_CLOSE_THRESHOLD,
     /// Access the attack time for the gate as a float.
     /// The attack time is in seconds.
@@ -368,7 +390,202 @@ extern "C" {
     MIXED_CHANNEL_COUNT_OUT,
     /// Access the current position of the repeater buffer.
     /// 
-    MIXED_REPEAT_POSITION
+    MIXED_REPEAT_POSITION,
+    /// The number of physical buffers a graph allocated for its
+    /// edges. The value is a uint32_t and can only be read.
+    MIXED_GRAPH_BUFFER_COUNT,
+    /// Access the number of threads a graph uses to run
+    /// independent segments in parallel. The value is a uint32_t.
+    /// The default is 1, meaning everything runs on the caller.
+    MIXED_GRAPH_THREADS,
+    /// Access the number of inputs a mixer has room for without
+    /// allocating. The value is a uint32_t.
+    /// Setting this ahead of time means that adding and removing
+    /// inputs during playback only draws from preallocated slots.
+    /// The capacity can only grow; smaller values are ignored.
+    MIXED_CAPACITY,
+    /// The number of queued changes that a commands segment could
+    /// not apply to their target. The value is a uint32_t.
+    MIXED_COMMANDS_FAILED,
+    /// Access the number of samples over which a change to a
+    /// continuous parameter like the volume is spread.
+    /// The value is a uint32_t. A duration of zero makes changes
+    /// take effect immediately.
+    MIXED_RAMP_DURATION,
+    /// Access the shape of parameter ramps. The value is an enum
+    /// mixed_ramp_type.
+    MIXED_RAMP_TYPE,
+    /// Access one band of an equalizer. The value is a pointer to
+    /// a struct mixed_equalizer_band, whose band field selects the
+    /// band to read or change.
+    MIXED_EQUALIZER_BAND,
+    /// The number of bands in an equalizer. The value is a
+    /// uint32_t and can only be read.
+    MIXED_EQUALIZER_BAND_COUNT,
+    /// Access the head related transfer function a space mixer
+    /// renders through. The value is a pointer to a struct
+    /// mixed_hrtf, or null to go back to amplitude panning.
+    /// The default is null.
+    MIXED_SPACE_HRTF,
+    /// Access the output layout of a space mixer. The value is an
+    /// enum mixed_space_layout, and decides how many output buffers
+    /// the mixer needs. A response set can only be used with
+    /// stereo output.
+    /// The default is MIXED_SPACE_STEREO.
+    MIXED_SPACE_LAYOUT,
+    /// Access the volume below which a source of a space or plane
+    /// mixer becomes virtual. The value is a float, compared against
+    /// the source's attenuated volume before panning. A virtual
+    /// source is not mixed, but its input is still consumed so that
+    /// it resumes at the right position once it is audible again.
+    /// The default is 0, which never makes a source virtual.
+    MIXED_SPACE_CULL_THRESHOLD,
+    /// Whether a source of a space or plane mixer is currently
+    /// virtual. The value is a bool and can only be read. Sources
+    /// feeding from expensive decoders may pause decoding while
+    /// virtual, as a virtual source never holds up the mix for lack
+    /// of input.
+    MIXED_SPACE_VIRTUAL,
+    /// Access the most voices a mixer mixes at once. The value is a
+    /// uint32_t. When more voices play, those of the lowest
+    /// priority, and of those the quietest, fade out and become
+    /// virtual until there is room again. A voice of a basic mixer
+    /// is one input per channel, of a space or plane mixer one
+    /// source. The default is 0, which puts no limit on voices.
+    MIXED_MAX_VOICES,
+    /// Access the priority of an input of a mixer. The value is a
+    /// float, and higher priorities are kept over lower ones when
+    /// the mixer limits its voices. For a basic mixer, any input of
+    /// a voice sets the priority for all of its channels.
+    /// The default is 0.
+    MIXED_PRIORITY,
+    /// Access the gain with which an input of a bus segment is sent
+    /// to one of its busses. The value is a pointer to a struct
+    /// mixed_bus_send, whose bus field selects the bus to read or
+    /// change. Changes are spread over the next mixed block.
+    MIXED_BUS_SEND,
+    /// Access the conversion matrix of a channel converter. The
+    /// value is a pointer to an array of floats with one row of
+    /// input gains per output channel, so the gain of input i in
+    /// output o is at o*in_channels+i. Setting the matrix replaces
+    /// the preset for the layouts, including its filters, until the
+    /// channel counts change again.
+    MIXED_CHANNEL_MATRIX,
+    /// Whether a compressor acts as a brickwall limiter. The value
+    /// is a bool. A limiter keeps the pregained signal below the
+    /// threshold, looking ahead by the predelay and recovering over
+    /// the release time. The knee, ratio, attack, release zones,
+    /// postgain and wet fields do not apply to it.
+    /// The default is false.
+    MIXED_COMPRESSOR_LIMITER,
+    /// Access one tap of a delay segment. The value is a pointer to
+    /// a struct mixed_delay_tap, whose tap field selects the tap to
+    /// read or change. Tap 0 is the one MIXED_DELAY_TIME refers to.
+    MIXED_DELAY_TAP,
+    /// The number of taps of a delay segment. The value is a
+    /// uint32_t and must be at least one. Taps that are added
+    /// start out silent.
+    MIXED_DELAY_TAP_COUNT,
+    /// Access the longest repeat time, in seconds, that a repeat
+    /// segment holds without allocating. The value is a float.
+    /// Setting it only ever grows the loop memory. Changing the
+    /// repeat time within it keeps what was recorded.
+    MIXED_REPEAT_MAX_TIME,
+    /// Access the number of samples for which a quantize segment
+    /// holds each value. The value is a uint32_t. Holding values
+    /// lowers the effective samplerate as in a bitcrusher.
+    /// The default is 1, which holds nothing.
+    MIXED_QUANTIZE_HOLD,
+    /// Access the algorithm a pitch segment shifts with. The value
+    /// is an enum mixed_pitch_mode.
+    /// The default is MIXED_PITCH_SPECTRAL.
+    MIXED_PITCH_MODE,
+    /// Access the fixed number of frames a segment processes per
+    /// mix. The value is a uint32_t.
+    /// With a block size of N, a segment that supports it either
+    /// produces exactly N frames in a mix or none at all, holding
+    /// back partial blocks until they are complete. Setting it on a
+    /// graph or chain passes it on to every segment within. The
+    /// default is 0, meaning as many frames as are available.
+    MIXED_BLOCK_SIZE,
+    /// Read the number of frames by which a segment delays its
+    /// input on the way to its output. The value is a uint32_t.
+    /// Segments that do not support this field do not delay their
+    /// input. A graph reports the latency of its longest path.
+    MIXED_LATENCY,
+    /// Access the time in seconds a graph may take for one mix. The
+    /// value is a float. When a mix takes longer, the graph trades
+    /// quality for speed until it fits again. See
+    /// mixed_make_segment_graph. The default is 0, which never
+    /// degrades anything.
+    MIXED_DEADLINE,
+    /// Read how many steps a graph has degraded its segments by to
+    /// meet its deadline. The value is a uint32_t, and 0 means
+    /// everything runs at full quality.
+    MIXED_DEGRADATION,
+    /// Access the internal state of a segment that its other fields
+    /// do not cover. The value is a pointer to a struct
+    /// mixed_segment_state. Reading it with a null data pointer only
+    /// stores the number of bytes needed in size. Starting a segment
+    /// resets this state, so restore it after the segment is
+    /// started. See mixed_segment_save.
+    MIXED_STATE,
+    /// Access the pack of a packer or unpacker. The value is a
+    /// pointer to a struct mixed_pack, which must have as many
+    /// channels as the one the segment was made with. Change it
+    /// only while the segment is not started.
+    MIXED_PACK,
+    /// Read the statistics of a jitter segment. The value is a
+    /// pointer to a struct mixed_jitter_stats.
+    MIXED_JITTER_STATS,
+    /// Read the performance counters of any segment while profiling
+    /// is on. The value is a pointer to a struct
+    /// mixed_segment_profile. See mixed_profile_start
+    MIXED_PROFILE,
+    /// Read the levels of a meter segment. The value is a pointer to
+    /// a struct mixed_meter_levels, whose channel field selects the
+    /// channel to read.
+    MIXED_METER_LEVELS,
+    /// Read the latest spectrum of a spectrum segment. The value is a
+    /// pointer to a struct mixed_spectrum.
+    MIXED_SPECTRUM,
+    /// The window applied to the frames of a spectrum segment. The
+    /// value is an enum mixed_window_type.
+    MIXED_SPECTRUM_WINDOW,
+    /// How much consecutive frames of a spectrum segment overlap. The
+    /// value is a float in [0, 1).
+    MIXED_SPECTRUM_OVERLAP,
+    /// Access the sample a sample segment plays. The value is the
+    /// uint32_t id of a sample in the segment's bank, which must
+    /// have as many channels as the one the segment was made with.
+    /// Setting it starts the new sample from the beginning.
+    MIXED_SAMPLE,
+    /// Access the frame a sample segment plays next. The value is a
+    /// uint32_t. Once a sample that does not loop has played through,
+    /// this is its length in frames.
+    MIXED_SAMPLE_POSITION,
+    /// Whether a sample segment starts over when it reaches the end.
+    /// The value is a bool, and the default is false.
+    MIXED_SAMPLE_LOOP,
+    /// Whether a biquad filter takes its coefficients from a table
+    /// of designs shared by all filters of the same type, samplerate,
+    /// and gain. The value is a bool, and the default is false.
+    /// Changes to the frequency and Q are then interpolated from the
+    /// table rather than designed, and glide to the new response over
+    /// a few milliseconds instead of jumping. The table is made for
+    /// the gain the filter has when it is turned on, and later gain
+    /// changes are designed exactly instead of making a new table.
+    MIXED_BIQUAD_TABLE,
+    /// Access the seed of a noise segment's random stream. The value
+    /// is a uint32_t. Setting it restarts the stream, so that the
+    /// same seed always produces the same noise.
+    MIXED_NOISE_SEED,
+    /// Access whether a resampling segment falls back to linear
+    /// interpolation instead of its MIXED_RESAMPLE_TYPE. The value is
+    /// a bool, and the default is false. The linear states are made
+    /// when the segment starts, so switching does not allocate and
+    /// may be done while mixing.
+    MIXED_RESAMPLE_FALLBACK
   };
 
   /// This enum descripbes the possible resampling quality options.
@@ -396,7 +613,15 @@ extern "C" {
     MIXED_ZERO_ORDER_HOLD,
     /// A linear converter. Again the quality is poor, but
     /// the conversion speed is blindingly fast.
-    MIXED_LINEAR_INTERPOLATION
+    MIXED_LINEAR_INTERPOLATION,
+    /// A polyphase FIR converter with a Kaiser windowed sinc
+    /// kernel that is tabulated when the ratio is set, with a
+    /// bandwidth of about 90% and an SNR near 80dB. Ratios that
+    /// reduce to a small fraction, such as 44.1kHz to 48kHz or
+    /// integer factors, are exact. It is several times faster
+    /// than MIXED_SINC_FASTEST, but changing the ratio has to
+    /// recompute the filter bank.
+    MIXED_POLYPHASE
   };
 
   /// This enum describes the possible preset attenuation functions.
@@ -408,6 +633,42 @@ extern "C" {
     MIXED_EXPONENTIAL_ATTENUATION
   };
 
+  /// This enum describes the output layouts of the space mixer.
+  ///
+  /// Surround layouts pan every source between the two speakers
+  /// around its direction on the horizontal plane, with outputs at the
+  /// speaker's mixed_location. The subwoofer output stays silent.
+  /// Ambisonic layouts encode every source in ACN channel order with
+  /// SN3D normalisation, for a decoder further down to render.
+  MIXED_EXPORT enum mixed_space_layout{
+    MIXED_SPACE_STEREO = 1,
+    MIXED_SPACE_SURROUND_5_1,
+    MIXED_SPACE_SURROUND_7_1,
+    MIXED_SPACE_AMBISONICS_FIRST_ORDER,
+    MIXED_SPACE_AMBISONICS_THIRD_ORDER
+  };
+
+  /// This enum describes the algorithms of the pitch segment.
+  ///
+  /// The spectral shifter is a phase vocoder over 2048 sample frames,
+  /// which keeps the timbre well but delays by several frames. The
+  /// WSOLA shifter overlaps grains of about 20ms in the time domain,
+  /// delaying by about a grain at a fraction of the cost. Transients
+  /// and complex mixes suffer more, which matters little for voices.
+  MIXED_EXPORT enum mixed_pitch_mode{
+    MIXED_PITCH_SPECTRAL = 1,
+    MIXED_PITCH_WSOLA
+  };
+
+  /// This enum describes the windows a spectrum segment can apply to
+  /// its frames before analysing them.
+  MIXED_EXPORT enum mixed_window_type{
+    MIXED_RECTANGULAR_WINDOW = 1,
+    MIXED_HANN_WINDOW,
+    MIXED_HAMMING_WINDOW,
+    MIXED_BLACKMAN_WINDOW
+  };
+
   /// This enum describes the possible fade easing function types.
   /// 
   MIXED_EXPORT enum mixed_fade_type{
@@ -417,6 +678,34 @@ extern "C" {
     MIXED_CUBIC_IN_OUT
   };
 
+  /// This enum describes the possible parameter ramp shapes.
+  ///
+  /// Exponential ramps move by a constant factor per sample, which
+  /// sounds even for gains. Ramps from or to silence start or end at
+  /// -80dB and jump the remaining distance.
+  MIXED_EXPORT enum mixed_ramp_type{
+    MIXED_LINEAR_RAMP = 1,
+    MIXED_EXPONENTIAL_RAMP
+  };
+
+  /// This enum describes the flags that change how a pack's
+  /// samples are converted.
+  ///
+  /// MIXED_FAST_CONVERSION decodes integers with a single multiply
+  /// by a power of two, see mixed_from_int16_fast. The result is off
+  /// from the exact conversion by less than one step.
+  /// MIXED_DITHER adds triangular noise of one step when encoding to
+  /// int16 or int24, and rounds to the nearest value. Other encodings
+  /// ignore it.
+  /// MIXED_PLANAR stores each channel in a plane of its own instead of
+  /// interleaving frames. It must be set before the pack is made and
+  /// not changed afterwards. See mixed_make_pack.
+  MIXED_EXPORT enum mixed_pack_flags{
+    MIXED_FAST_CONVERSION = 0x1,
+    MIXED_DITHER = 0x2,
+    MIXED_PLANAR = 0x4
+  };
+
   /// This enum describes the possible generator wave types.
   /// 
   MIXED_EXPORT enum mixed_generator_type{
@@ -439,7 +728,10 @@ extern "C" {
   MIXED_EXPORT enum mixed_repeat_mode{
     MIXED_RECORD = 1,
     MIXED_PLAY,
-    MIXED_RECORD_ONCE
+    MIXED_RECORD_ONCE,
+    /// Adds the input to the loop as another layer, and outputs
+    /// the sum.
+    MIXED_OVERDUB
   };
 
   /// This enum describes the possible biquad filters.
@@ -455,12 +747,29 @@ extern "C" {
     MIXED_HIGHSHELF
   };
 
+  /// This enum describes the CPU features the library has kernels for.
+  ///
+  /// See mixed_cpu_features
+  MIXED_EXPORT enum mixed_cpu_feature{
+    MIXED_CPU_SSE2 = 0x1,
+    MIXED_CPU_AVX = 0x2,
+    MIXED_CPU_AVX2 = 0x4,
+    MIXED_CPU_FMA = 0x8,
+    /// The AVX-512 foundation instructions.
+    MIXED_CPU_AVX512 = 0x10,
+    MIXED_CPU_NEON = 0x20,
+    /// The half float conversion instructions.
+    MIXED_CPU_F16C = 0x40
+  };
+
   /// This enum holds property flags for segments.
   /// 
   MIXED_EXPORT enum mixed_segment_info_flags{
     /// This means that the segment's output and input
     /// buffers may be the same, as it processes the samples
-    /// in place.
+    /// in place. Such a segment must process every available
+    /// sample of the input at once, since whatever it leaves
+    /// behind is seen as its output.
     MIXED_INPLACE = 0x1,
     /// This means that the segment will modify the samples in
     /// its input buffers, making them unusable for virtual
@@ -544,7 +853,11 @@ extern "C" {
     MIXED_ENCODING_ENUM,
     MIXED_ERROR_ENUM,
     MIXED_RESAMPLE_TYPE_ENUM,
-    MIXED_CHANNEL_T
+    MIXED_CHANNEL_T,
+    MIXED_RAMP_TYPE_ENUM,
+    MIXED_SPACE_LAYOUT_ENUM,
+    MIXED_PITCH_MODE_ENUM,
+    MIXED_WINDOW_TYPE_ENUM
   };
 
   /// Type used for channel count descriptions.
@@ -567,6 +880,21 @@ extern "C" {
     /// Whether the buffer owns the data array.
     /// 
     char is_virtual;
+    /// Whether the data array is mapped twice back to back.
+    /// 
+    char is_mirrored;
+    /// Whether every sample that can be read is known to be zero.
+    /// See mixed_buffer_finish_write_silence
+    char is_silent;
+    /// Whether the samples are stored as half floats.
+    /// See mixed_make_buffer_half
+    char is_half;
+    /// Cache-line padded indices for buffers that are shared
+    /// between threads. See mixed_make_buffer_shared
+    void *_shared;
+    /// Usage counters, if enabled.
+    /// See mixed_buffer_enable_stats
+    void *_stats;
   };
 
   /// Information struct to encapsulate a "channel"
@@ -595,6 +923,243 @@ extern "C" {
     /// The sample rate at which data is encoded in Hz.
     /// 
     uint32_t samplerate;
+    /// Cache-line padded indices for packs that are shared
+    /// between threads. See mixed_make_pack_shared
+    void *_shared;
+    /// A combination of mixed_pack_flags.
+    /// 
+    uint32_t flags;
+    /// The state of the dither noise generator.
+    /// 
+    uint32_t _dither;
+    /// The file mapping backing the data, if any.
+    /// See mixed_make_pack_file and mixed_make_pack_external
+    void *_mapping;
+    /// Usage counters, if enabled.
+    /// See mixed_pack_enable_stats
+    void *_stats;
+  };
+
+  /// Usage counters of a buffer or pack.
+  ///
+  /// Counts are in samples for buffers, and in frames for packs. A
+  /// request for UINT32_MAX asks for whatever there is, and so never
+  /// counts as short.
+  /// See mixed_buffer_stats and mixed_pack_stats
+  MIXED_EXPORT struct mixed_buffer_stats{
+    /// The number of read requests that found nothing to read.
+    /// 
+    uint64_t starved_reads;
+    /// The number of read requests that got less than they asked for.
+    /// 
+    uint64_t short_reads;
+    /// The number of write requests that found no space.
+    /// 
+    uint64_t full_writes;
+    /// The number of write requests that got less than they asked for.
+    /// 
+    uint64_t short_writes;
+    /// The total amount written.
+    /// 
+    uint64_t written;
+    /// The total amount read.
+    /// 
+    uint64_t read;
+    /// The most that was waiting to be read right after a write.
+    /// 
+    uint32_t high_water;
+    /// The least that was waiting to be read when a read was
+    /// requested, or zero if none was requested yet.
+    uint32_t low_water;
+  };
+
+  /// Statistics of a jitter segment.
+  ///
+  /// All frame counts are in the frames of the packets.
+  /// See mixed_make_segment_jitter
+  MIXED_EXPORT struct mixed_jitter_stats{
+    /// The number of packets inserted.
+    /// 
+    uint32_t received;
+    /// The number of packets that came after their time to play had
+    /// passed, were duplicates, or had to make way for newer ones.
+    uint32_t late;
+    /// The number of frames that were made up for missing packets.
+    /// 
+    uint32_t concealed;
+    /// The number of frames that were dropped to reduce latency.
+    /// 
+    uint32_t skipped;
+    /// The number of times playback ran out of packets.
+    /// 
+    uint32_t underruns;
+    /// The number of frames currently waiting to be played.
+    /// 
+    uint32_t buffered;
+    /// The current target latency in frames.
+    /// 
+    uint32_t latency;
+  };
+
+  /// The levels measured by a meter segment.
+  ///
+  /// The peaks are held until they are read, and reading them starts
+  /// over. The other levels are those of the last complete step of
+  /// 100ms. All levels but the loudness are linear.
+  /// See mixed_make_segment_meter
+  MIXED_EXPORT struct mixed_meter_levels{
+    /// The channel to read the levels of.
+    /// 
+    channel_t channel;
+    /// The highest absolute sample value since the last read.
+    /// 
+    float peak;
+    /// The highest absolute value of the signal oversampled four
+    /// times since the last read, as in ITU-R BS.1770.
+    float true_peak;
+    /// The root mean square over the last 300ms.
+    /// 
+    float rms;
+    /// The EBU R128 momentary loudness of all channels over the last
+    /// 400ms, in LUFS.
+    float momentary;
+    /// The EBU R128 short term loudness of all channels over the last
+    /// 3s, in LUFS.
+    float short_term;
+  };
+
+  /// A spectrum read from a spectrum segment.
+  ///
+  /// See mixed_make_segment_spectrum
+  MIXED_EXPORT struct mixed_spectrum{
+    /// The array to fill with the magnitudes of the frequency bins,
+    /// the i-th of which is centred on i*samplerate/framesize Hz. The
+    /// magnitudes are linear and scaled so that a sine shows its
+    /// amplitude.
+    float *magnitudes;
+    /// The size of the array. This is set to the number of bins
+    /// filled in, which is at most framesize/2+1.
+    uint32_t bins;
+    /// The number of frames analysed so far. This is set when the
+    /// spectrum is read and tells whether it has changed since.
+    uint64_t frames;
+  };
+
+  /// Describes one band of an equalizer segment.
+  ///
+  /// The band field selects which band of the equalizer is meant
+  /// when the struct is passed to MIXED_EQUALIZER_BAND. The other
+  /// fields carry the same meaning as on a biquad filter segment.
+  MIXED_EXPORT struct mixed_equalizer_band{
+    /// The index of the band, starting from zero.
+    /// 
+    uint32_t band;
+    /// The filter shape, usually MIXED_LOWSHELF, MIXED_PEAKING,
+    /// or MIXED_HIGHSHELF.
+    enum mixed_biquad_filter type;
+    /// The centre or corner frequency in Hertz.
+    /// 
+    float frequency;
+    /// The Q or resonance factor of the band.
+    /// 
+    float Q;
+    /// The gain of the band in dB.
+    /// 
+    float gain;
+  };
+
+  /// Describes the send of one input of a bus segment.
+  ///
+  /// The bus field selects which bus is meant when the struct is
+  /// passed to MIXED_BUS_SEND.
+  MIXED_EXPORT struct mixed_bus_send{
+    /// The index of the bus, starting from zero.
+    /// 
+    uint32_t bus;
+    /// The linear gain with which the input reaches the bus.
+    /// 
+    float gain;
+  };
+
+  /// Holds the internal state of a segment as plain bytes.
+  ///
+  /// See MIXED_STATE
+  MIXED_EXPORT struct mixed_segment_state{
+    /// The bytes of the state.
+    /// 
+    void *data;
+    /// The number of bytes the data holds.
+    /// 
+    uint32_t size;
+    /// Whether to include what changes as the segment mixes, such
+    /// as filter memory or delay lines. Without it, only state that
+    /// is part of the configuration is included.
+    int runtime;
+  };
+
+  /// Describes one read tap of a delay segment.
+  ///
+  /// The tap field selects which tap is meant when the struct is
+  /// passed to MIXED_DELAY_TAP. A tap with a depth sweeps its delay
+  /// around the time with a sine at the given rate, as for a chorus
+  /// or flanger, and reads between samples. Without a depth the
+  /// time is rounded up to whole samples.
+  MIXED_EXPORT struct mixed_delay_tap{
+    /// The index of the tap, starting from zero.
+    /// 
+    uint32_t tap;
+    /// The time, in seconds, by which the tap is delayed.
+    /// 
+    float time;
+    /// The linear gain of the tap in the output.
+    /// 
+    float gain;
+    /// How far, in seconds, the delay is swept to either side.
+    /// 
+    float depth;
+    /// The frequency of the sweep, in Hz.
+    /// 
+    float rate;
+  };
+
+  /// An impulse response prepared for convolution.
+  ///
+  /// The response is split into partitions that are transformed
+  /// once when it is made. Every convolution segment made from it
+  /// shares the same preprocessed data, which stays alive until
+  /// the response and all of its segments have been freed.
+  MIXED_EXPORT struct mixed_impulse_response{
+    /// Internal shared partition spectra.
+    /// 
+    void *_data;
+    /// The length of the response in samples.
+    /// 
+    uint32_t samples;
+    /// The number of samples per partition, which is also the
+    /// latency of segments using this response.
+    uint32_t partition;
+  };
+
+  /// A set of head related impulse responses for binaural output.
+  ///
+  /// Each response pair belongs to one direction seen from the
+  /// listener, with X pointing to the right, Y up, and Z ahead. The
+  /// responses are transformed once when the set is made and shared
+  /// by every space mixer using it, until the set and all of those
+  /// mixers have been freed.
+  MIXED_EXPORT struct mixed_hrtf{
+    /// Internal shared response spectra.
+    /// 
+    void *_data;
+    /// The number of measured directions.
+    /// 
+    uint32_t count;
+    /// The length of each response in samples.
+    /// 
+    uint32_t samples;
+    /// The number of samples per block, which is also the latency
+    /// of a space mixer rendering through this set.
+    uint32_t partition;
   };
 
   /// Metadata struct for a segment's field.
@@ -701,11 +1266,49 @@ extern "C" {
   /// The frames designates the number of frames that can be stored in
   /// the pack's data array. Meaning a total number of bytes of:
   ///   frames*channels*mixed_samplesize(encoding)
+  ///
+  /// If the MIXED_PLANAR flag is set, the channels are not interleaved
+  /// and each has a plane of frames samples of its own. The size and
+  /// all indices and byte counts of the pack then refer to a single
+  /// plane, and the area handed out by the read and write functions
+  /// is that of the first channel. The area of channel c is found at
+  ///   area + c*pack->size
+  /// Unpackers and packers convert planar float packs with a single
+  /// pass per channel and no interleaving.
   /// 
   /// For the write and read functions, please see the analogous buffer
   /// functions.
   MIXED_EXPORT int mixed_make_pack(uint32_t frames, struct mixed_pack *pack);
 
+  /// Allocate a new pack for handing data between two threads.
+  ///
+  /// See mixed_make_pack and mixed_make_buffer_shared
+  MIXED_EXPORT int mixed_make_pack_shared(uint32_t frames, struct mixed_pack *pack);
+
+  /// Wrap an existing byte range as a full, read-only pack.
+  ///
+  /// The encoding, channels, and samplerate of the pack must be set
+  /// beforehand. The data is not copied and remains owned by you; it
+  /// must stay alive until the pack is freed. Any trailing bytes that
+  /// do not make up a full frame are left out.
+  /// Packs made this way must never be written to.
+  MIXED_EXPORT int mixed_make_pack_external(void *data, uint32_t size, struct mixed_pack *pack);
+
+  /// Map a file read-only into memory as a full pack.
+  ///
+  /// If the file is a RIFF WAVE file, the encoding, channels, and
+  /// samplerate are read from its header and the pack covers its
+  /// sample data. Otherwise the file is taken as raw samples and the
+  /// encoding, channels, and samplerate of the pack must be set
+  /// beforehand.
+  /// The samples are read straight out of the page cache, without a
+  /// decode buffer. The kernel is told that the file will be read
+  /// sequentially so that it can read ahead.
+  /// Packs made this way must never be written to. The mapping is
+  /// released by mixed_free_pack.
+  /// This is not implemented on Windows.
+  MIXED_EXPORT int mixed_make_pack_file(const char *file, struct mixed_pack *pack);
+
   /// Free the pack
   /// See mixed_free_buffer
   MIXED_EXPORT void mixed_free_pack(struct mixed_pack *pack);
@@ -730,22 +1333,101 @@ extern "C" {
   /// Complete a free operation
   /// See mixed_buffer_finish_read
   MIXED_EXPORT int mixed_pack_finish_read(uint32_t size, struct mixed_pack *pack); 
+  /// Start counting the pack's usage
+  /// See mixed_buffer_enable_stats
+  MIXED_EXPORT int mixed_pack_enable_stats(struct mixed_pack *pack);
+  /// Read the pack's usage counters
+  /// See mixed_buffer_stats
+  MIXED_EXPORT int mixed_pack_stats(struct mixed_buffer_stats *stats, struct mixed_pack *pack);
+  /// Zero the pack's usage counters
+  /// See mixed_buffer_reset_stats
+  MIXED_EXPORT int mixed_pack_reset_stats(struct mixed_pack *pack);
 
   /// Allocate the buffer's internal storage array.
   ///
   MIXED_EXPORT int mixed_make_buffer(uint32_t size, struct mixed_buffer *buffer);
 
+  /// Allocate the buffer's storage as a mirrored ring.
+  ///
+  /// The storage is mapped twice in a row in memory, so that reads
+  /// and writes never have to stop at the end of the array. A request
+  /// for UINT32_MAX samples therefore always returns everything that
+  /// is available, rather than just the part up to the wrap.
+  /// The size is rounded up so that the storage fills whole pages.
+  /// This is not available on all platforms, in which case
+  /// MIXED_NOT_IMPLEMENTED is signalled and you should fall back to
+  /// mixed_make_buffer.
+  MIXED_EXPORT int mixed_make_buffer_mirrored(uint32_t size, struct mixed_buffer *buffer);
+
+  /// Allocate the buffer's storage for use between two threads.
+  ///
+  /// The buffer behaves the same as one made by mixed_make_buffer,
+  /// but keeps the reader's and the writer's positions on separate
+  /// cache lines, and lets each side remember the other's position
+  /// until it runs out of room. Use this when one thread fills the
+  /// buffer and another drains it, as otherwise every request and
+  /// finish bounces the same cache line between the two cores.
+  /// For buffers used by a single thread this only costs memory.
+  MIXED_EXPORT int mixed_make_buffer_shared(uint32_t size, struct mixed_buffer *buffer);
+
+  /// Allocate the buffer's storage as IEEE half floats.
+  ///
+  /// This halves the memory traffic of a buffer, for busses with many
+  /// voices where the precision of floats is not needed. Half floats
+  /// keep about three decimal digits, or some 66dB of signal over
+  /// their rounding noise, and hold values up to 65504.
+  ///
+  /// Only some segments read and write half buffers: the basic mixer,
+  /// the volume control, and the unpacker when it does not resample.
+  /// The float request functions fail on half buffers with
+  /// MIXED_UNKNOWN_ENCODING, so that other segments do not misread
+  /// them. Transfers and copies between buffers convert as needed.
+  /// See mixed_buffer_request_read_half
+  MIXED_EXPORT int mixed_make_buffer_half(uint32_t size, struct mixed_buffer *buffer);
+
   /// Free the buffer's internal storage array.
   ///
   MIXED_EXPORT void mixed_free_buffer(struct mixed_buffer *buffer);
 
+  /// Prepare an impulse response for convolution.
+  ///
+  /// The samples are copied, so the array may be freed afterwards.
+  /// The partition size must be a power of two between 32 and 8192.
+  /// Smaller partitions lower the latency at the cost of more work
+  /// per sample. The response fields are filled in by this.
+  MIXED_EXPORT int mixed_make_impulse_response(float *samples, uint32_t length, uint32_t partition, struct mixed_impulse_response *response);
+
+  /// Release the impulse response.
+  ///
+  /// Segments made from the response keep their own reference and
+  /// continue to work.
+  MIXED_EXPORT void mixed_free_impulse_response(struct mixed_impulse_response *response);
+
+  /// Prepare a set of head related impulse responses.
+  ///
+  /// directions holds three floats per response, left and right
+  /// each hold the samples of all responses back to back. The
+  /// arrays are copied, so they may be freed afterwards. Responses
+  /// may be at most 8192 samples long. The measured responses should
+  /// be aligned in time, as the responses in between are
+  /// interpolated from the nearest three.
+  MIXED_EXPORT int mixed_make_hrtf(float *directions, float *left, float *right, uint32_t count, uint32_t samples, struct mixed_hrtf *hrtf);
+
+  /// Release the set of head related impulse responses.
+  ///
+  /// Space mixers using the set keep their own reference and
+  /// continue to work.
+  MIXED_EXPORT void mixed_free_hrtf(struct mixed_hrtf *hrtf);
+
   /// Convert the packed data to buffer data.
   ///
   /// This appropriately converts sample format and channel layout.
   /// You are responsible for passing in an array of buffers that is
   /// at least as long as the channel's channel count.
   /// The volume is a multiplier you can pass to adjust the volume
-  /// in the resulting buffers.
+  /// in the resulting buffers. If target_volume differs, the volume is
+  /// ramped linearly towards it over the transferred frames, and
+  /// volume is set to target_volume afterwards.
   /// pack.frames should be set to the number of frames in the input
   /// pack, and will be set to the number of frames that have actually
   /// been read from the packed buffer. This may be less if the
@@ -758,13 +1440,30 @@ extern "C" {
   /// You are responsible for passing in an array of buffers that is
   /// at least as long as the channel's channel count.
   /// The volume is a multiplier you can pass to adjust the volume
-  /// in the resulting channel.
+  /// in the resulting channel. If target_volume differs, the volume is
+  /// ramped linearly towards it over the transferred frames, and
+  /// volume is set to target_volume afterwards.
   /// pack.frames should be set to the number of frames in the output
   /// pack, and will be set to the number of frames that have actually
   /// been written to the pack. This may be less if the input buffers
   /// do not have enough data available.
   MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struct mixed_pack *out, float *volume, float target_volume);
 
+  /// Convert packed data directly into another pack.
+  ///
+  /// This moves as many frames as are available in the input and fit
+  /// into the output, converting the sample encoding, layout, and
+  /// channels as needed. Both packs must have the same samplerate.
+  /// If map is null both packs must have the same number of channels.
+  /// Otherwise it must hold one entry per output channel naming the
+  /// input channel to take it from, with an out of range entry
+  /// producing silence.
+  /// Between integer encodings samples are shifted into place without
+  /// going through floats, which is exact when widening and truncates
+  /// when narrowing, unless the output asks for MIXED_DITHER. The
+  /// same encoding is copied as is.
+  MIXED_EXPORT int mixed_pack_convert(struct mixed_pack *in, struct mixed_pack *out, const channel_t *map);
+
   /// Transfers data from one buffer to the other.
   ///
   /// This is equivalent to requesting a read from the from buffer,
@@ -825,6 +1524,24 @@ extern "C" {
   /// write is illegal.
   MIXED_EXPORT int mixed_buffer_finish_write(uint32_t size, struct mixed_buffer *buffer);
 
+  /// Commit a reserved block that was filled with zeros.
+  ///
+  /// This behaves like mixed_buffer_finish_write, but lets the
+  /// buffer remember that it holds silence, as long as everything
+  /// else that is left to be read is silent as well. Segments that
+  /// see a silent input can then skip their work and only write
+  /// zeros themselves. The block must still be zeroed, as readers
+  /// are free to ignore the flag.
+  /// See mixed_buffer_is_silent
+  MIXED_EXPORT int mixed_buffer_finish_write_silence(uint32_t size, struct mixed_buffer *buffer);
+
+  /// Returns whether every sample that can be read is known to be zero.
+  ///
+  /// A buffer is only known to be silent if all of its readable
+  /// samples were committed with mixed_buffer_finish_write_silence
+  /// or the equivalent. Any other committed write clears the mark.
+  MIXED_EXPORT int mixed_buffer_is_silent(struct mixed_buffer *buffer);
+
   /// Retrieve a memory block for reading.
   ///
   /// Stores the start of the block in area and the minimum between
@@ -845,12 +1562,118 @@ extern "C" {
   /// read is illegal.
   MIXED_EXPORT int mixed_buffer_finish_read(uint32_t size, struct mixed_buffer *buffer);
 
+  /// Request an area of a half buffer to write to.
+  ///
+  /// Works as mixed_buffer_request_write, but hands out the half
+  /// floats of a buffer made with mixed_make_buffer_half. Finish the
+  /// write with the usual functions.
+  MIXED_EXPORT int mixed_buffer_request_write_half(uint16_t **area, uint32_t *size, struct mixed_buffer *buffer);
+
+  /// Request an area of a half buffer to read from.
+  ///
+  /// See mixed_buffer_request_write_half
+  MIXED_EXPORT int mixed_buffer_request_read_half(uint16_t **area, uint32_t *size, struct mixed_buffer *buffer);
+
+  /// Retrieve memory blocks for writing from several buffers at once.
+  ///
+  /// This behaves like calling mixed_buffer_request_write on every
+  /// buffer in turn, except that size ends up as the size that all
+  /// buffers can accommodate, and every area is valid for that size.
+  /// Null entries in buffers are skipped and get a null area.
+  /// If any buffer has no space left, size is set to zero and the
+  /// operation fails. You must still call mixed_buffers_finish_write
+  /// to release the buffers that were reserved.
+  MIXED_EXPORT int mixed_buffers_request_write(uint32_t count, struct mixed_buffer **buffers, float **areas, uint32_t *size);
+
+  /// Commit the same amount of samples to several buffers at once.
+  ///
+  /// See mixed_buffer_finish_write
+  MIXED_EXPORT int mixed_buffers_finish_write(uint32_t count, struct mixed_buffer **buffers, uint32_t size);
+
+  /// Commit the same amount of zeros to several buffers at once.
+  ///
+  /// See mixed_buffer_finish_write_silence
+  MIXED_EXPORT int mixed_buffers_finish_write_silence(uint32_t count, struct mixed_buffer **buffers, uint32_t size);
+
+  /// Retrieve memory blocks for reading from several buffers at once.
+  ///
+  /// This behaves like calling mixed_buffer_request_read on every
+  /// buffer in turn, except that size ends up as the number of
+  /// samples that all buffers can provide, and every area is valid
+  /// for that size. Null entries in buffers are skipped and get a
+  /// null area. If any buffer is empty, size is set to zero and the
+  /// operation fails.
+  MIXED_EXPORT int mixed_buffers_request_read(uint32_t count, struct mixed_buffer **buffers, float **areas, uint32_t *size);
+
+  /// Free the same amount of samples from several buffers at once.
+  ///
+  /// See mixed_buffer_finish_read
+  MIXED_EXPORT int mixed_buffers_finish_read(uint32_t count, struct mixed_buffer **buffers, uint32_t size);
+
   /// Resize the buffer to a new size.
   ///
+  /// The samples that are waiting to be read are kept, in order, as
+  /// far as they fit into the new size. Shared and mirrored buffers
+  /// stay shared and mirrored. Neither side may hold a requested area
+  /// while the buffer is resized, and as with mixed_buffer_swap, no
+  /// segment connected to it may mix at the same time.
+  ///
+  /// This allocates, so to resize from the audio thread, make the new
+  /// buffer elsewhere and hand it over with mixed_buffer_swap instead.
   /// If the resizing operation fails due to a lack of memory, the
   /// old data is preserved and the buffer is not changed.
   MIXED_EXPORT int mixed_buffer_resize(uint32_t size, struct mixed_buffer *buffer);
 
+  /// Move the buffer's contents into a replacement buffer and take over
+  /// its storage.
+  ///
+  /// The samples waiting to be read are moved over as far as they fit,
+  /// after which the two structures are exchanged. The buffer thus
+  /// keeps its address, and segments connected to it carry on with the
+  /// new storage, while the replacement ends up with the old storage,
+  /// ready to be freed. This neither allocates nor frees, so the
+  /// replacement can be made and freed on another thread while the
+  /// swap itself runs on the audio thread between mixes.
+  ///
+  /// The swap copies the structures field by field and is not atomic.
+  /// It must not run concurrently with the mix of any segment connected
+  /// to either buffer, nor with any other thread using them, such as
+  /// the far side of a shared buffer. Neither side may hold a requested
+  /// area at that time.
+  MIXED_EXPORT int mixed_buffer_swap(struct mixed_buffer *replacement, struct mixed_buffer *buffer);
+
+  /// Start counting the buffer's usage.
+  ///
+  /// From then on every request and finish on the buffer updates its
+  /// counters, which are freed along with the buffer. The reading and
+  /// writing sides each only update their own counters, so this works
+  /// for shared buffers, too. A buffer keeps its counters when it is
+  /// resized or swapped. This allocates.
+  MIXED_EXPORT int mixed_buffer_enable_stats(struct mixed_buffer *buffer);
+
+  /// Read the buffer's usage counters.
+  ///
+  /// While the buffer is in use on other threads the counters may be
+  /// slightly out of date.
+  MIXED_EXPORT int mixed_buffer_stats(struct mixed_buffer_stats *stats, struct mixed_buffer *buffer);
+
+  /// Zero the buffer's usage counters.
+  ///
+  /// This must not happen while the buffer is in use.
+  MIXED_EXPORT int mixed_buffer_reset_stats(struct mixed_buffer *buffer);
+
+  /// Read how often writers and readers of buffers and packs had to
+  /// retry an index update because the other side changed it first.
+  ///
+  /// The counts are totals over all plain buffers and packs since the
+  /// library was loaded. Shared and mirrored ones never retry.
+  /// Either pointer may be NULL.
+  ///
+  /// Counting costs an atomic increment shared by all threads, so it
+  /// is only done if the library was built with BUILD_RETRY_COUNTERS.
+  /// Otherwise both counts stay zero.
+  MIXED_EXPORT void mixed_buffer_retries(uint64_t *write_retries, uint64_t *read_retries);
+
   /// Convenience macro for the common operation of transferring
   /// from one buffer to another.
   ///
@@ -903,8 +1726,23 @@ extern "C" {
   /// restarted. This happens if the segment is some kind of
   /// finite source and has ended, or if an internal error
   /// occurred that prevents the segment from operating.
+  ///
+  /// Unless disabled with mixed_flush_denormals, the segment runs
+  /// with denormal numbers flushed to zero.
   MIXED_EXPORT int mixed_segment_mix(struct mixed_segment *segment);
 
+  /// Set whether denormal numbers are flushed to zero while mixing.
+  ///
+  /// Decaying filter and envelope states eventually fall into the
+  /// denormal range, where arithmetic is many times slower on most
+  /// CPUs. This shows up as load spikes exactly when the output goes
+  /// quiet. When enabled, which is the default, the outermost
+  /// mixed_segment_mix on a thread switches the FPU to flush them to
+  /// zero and restores the previous mode before returning. This uses
+  /// the MXCSR flags on x86 and FPCR on AArch64. Elsewhere the
+  /// recursive filters flush their state on their own instead.
+  MIXED_EXPORT int mixed_flush_denormals(int flush);
+
   /// End the segment's mixing process.
   ///
   /// If the method is not implemented, the error is set to
@@ -978,6 +1816,82 @@ extern "C" {
   /// MIXED_NOT_IMPLEMENTED.
   MIXED_EXPORT int mixed_segment_set(uint32_t field, void *value, struct mixed_segment *segment);
 
+  /// Performance counters of a segment.
+  ///
+  /// Times are in nanoseconds and include the time spent in any
+  /// segments mixed from within the segment. Frames are counted on
+  /// the segment's first output buffer, or on its first input if it
+  /// has no output, as far as those buffers were connected while
+  /// profiling was on. A short mix is one that handled fewer frames
+  /// than the most the segment has handled in one mix before.
+  MIXED_EXPORT struct mixed_segment_profile{
+    uint64_t calls;
+    uint64_t frames;
+    uint64_t short_mixes;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    /// The time that 99% of the mixes stayed within. This is exact to
+    /// within a quarter of its value.
+    uint64_t p99_ns;
+  };
+
+  /// Start recording performance counters for every segment mixed.
+  ///
+  /// Counters are kept for up to the given number of segments, after
+  /// which further segments go unrecorded. Each segment's counters
+  /// are only written by the thread mixing it, so the overhead is
+  /// two clock reads and a table lookup per mix. Connect the buffers
+  /// after profiling was started to have frames counted. Freeing a
+  /// segment drops its counters and makes room for another one.
+  ///
+  /// Do not start or end profiling while segments are being mixed.
+  MIXED_EXPORT int mixed_profile_start(uint32_t segments);
+
+  /// Stop recording performance counters and drop them.
+  ///
+  /// Like mixed_profile_start, this must not be called while segments
+  /// are being mixed. Fails if profiling was not started.
+  MIXED_EXPORT int mixed_profile_end();
+
+  /// Zero all performance counters.
+  ///
+  /// The recorded segments stay recorded. Fails if profiling was not
+  /// started.
+  MIXED_EXPORT int mixed_profile_reset();
+
+  /// Read the performance counters of all recorded segments.
+  ///
+  /// count must hold the size of the arrays and is set to the number
+  /// of entries filled in. If both arrays are NULL, count is only set
+  /// to the number of recorded segments. Either array may be NULL.
+  MIXED_EXPORT int mixed_profile_dump(uint32_t *count, struct mixed_segment **segments, struct mixed_segment_profile *profiles);
+
+  /// Start recording a timeline of the pipeline's execution.
+  ///
+  /// Every thread records into its own ring of the given number of
+  /// events, rounded up to a power of two, keeping the most recent
+  /// ones. Recorded are the begin and end of every segment mix, any
+  /// buffer that had nothing to read, and the periods of the device
+  /// threads along with their underruns. The rings for the first 16
+  /// threads to record are allocated here, so recording never
+  /// allocates. Events of further threads are dropped.
+  ///
+  /// Do not start or end tracing while segments are being mixed.
+  MIXED_EXPORT int mixed_trace_start(uint32_t events);
+
+  /// Stop recording the timeline and drop it.
+  ///
+  MIXED_EXPORT int mixed_trace_end();
+
+  /// Write the recorded timeline to a file in the Chrome trace event
+  /// JSON format, as read by Perfetto and chrome://tracing.
+  ///
+  /// Times are taken from the monotonic system clock, so the trace
+  /// can be lined up with others recorded on the same machine. Do not
+  /// write the trace while segments are being mixed.
+  MIXED_EXPORT int mixed_trace_write(const char *path);
+
   /// Get the value of a field in the segment.
   /// 
   /// The value must be a pointer to a place that can be set to
@@ -992,6 +1906,31 @@ extern "C" {
   /// MIXED_NOT_IMPLEMENTED.
   MIXED_EXPORT int mixed_segment_get(uint32_t field, void *value, struct mixed_segment *segment);
 
+  /// Save a snapshot of the segment into a block of memory.
+  ///
+  /// The snapshot holds the value of every segment field that can
+  /// be both read and set and is not a pointer, along with
+  /// MIXED_STATE for segments that support it. If runtime is true,
+  /// that includes the segment's DSP state, so a restored segment
+  /// continues exactly where it left off.
+  ///
+  /// If data is null, only the number of bytes needed is stored in
+  /// size. Otherwise size must hold the number of bytes available,
+  /// and is set to the number of bytes used. The snapshot is plain
+  /// bytes and can be written to a file as is, but it is only valid
+  /// for the same build of the library.
+  MIXED_EXPORT int mixed_segment_save(void *data, uint32_t *size, int runtime, struct mixed_segment *segment);
+
+  /// Restore a segment from a snapshot made by mixed_segment_save.
+  ///
+  /// The segment must have been made the same way as the one that
+  /// was saved, and with the same connections if it is a graph. The
+  /// snapshot is only read, and values are handed to the segment
+  /// straight from it, so it may well be a file mapped into memory.
+  /// If the snapshot is of a different type of segment, this fails
+  /// with MIXED_INVALID_VALUE.
+  MIXED_EXPORT int mixed_segment_load(void *data, uint32_t size, struct mixed_segment *segment);
+
   /// An audio unpacker.
   ///
   /// This segment convers the data from the channel's data
@@ -1031,14 +1970,50 @@ extern "C" {
   /// Depending on how many sources you have, adding and removing
   /// sources at random locations may prove expensive. Especially
   /// adding more sources might involve allocations, which may not
-  /// be suitable for real-time behaviour. Aside from this caveat,
+  /// be suitable for real-time behaviour. You can avoid this by
+  /// setting MIXED_CAPACITY ahead of time. Aside from this caveat,
   /// sources can be added or changed at any point in time.
+  ///
+  /// Each input has its own gain that can be accessed through
+  /// set_in/get_in with MIXED_VOLUME. It starts out at one, and
+  /// changes to it are spread over the next mixed block.
   MIXED_EXPORT int mixed_make_segment_basic_mixer(channel_t channels, struct mixed_segment *segment);
 
+  /// A mixer that feeds several busses at once.
+  ///
+  /// Every input is a mono source that is added to each of the
+  /// busses outputs with its own gain, as set through set_in with
+  /// MIXED_BUS_SEND. This replaces a distribute segment, a volume
+  /// control per send and a basic mixer per bus, and reads each
+  /// input only once instead of once per stage.
+  ///
+  /// An input starts out sent to bus 0 at unity gain, and not at
+  /// all to the other busses. Sends at zero cost nothing.
+  /// Inputs are added and removed like on the basic mixer, and
+  /// MIXED_CAPACITY can be set to avoid allocating when they are.
+  MIXED_EXPORT int mixed_make_segment_bus(uint32_t busses, struct mixed_segment *segment);
+
   /// A dynamic compressor
   /// 
+  /// This is a linked compressor for a single channel.
+  ///
+  /// An optional sidechain can be set as input location 1. Its level
+  /// then drives the compression of the input in place of the input's
+  /// own level, as for ducking music under speech.
   MIXED_EXPORT int mixed_make_segment_compressor(uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A dynamic compressor for several linked channels
+  ///
+  /// All channels share one detector that follows the loudest of
+  /// them, and are attenuated by the same gain, which keeps the
+  /// stereo image in place and costs little more than one channel.
+  /// Input and output locations are per channel. The input location
+  /// after the last channel takes an optional sidechain, which then
+  /// drives the shared detector in place of the channels, so one key
+  /// ducks every channel by the same gain. The sidechain is an
+  /// ordinary buffer and can be connected in a graph like any other.
+  MIXED_EXPORT int mixed_make_segment_linked_compressor(channel_t channels, uint32_t samplerate, struct mixed_segment *segment);
+
   /// A very basic volume control segment
   /// 
   /// This segment can be used to regulate the volume and pan of the
@@ -1073,6 +2048,17 @@ extern "C" {
   /// create a very primitive synthesizer.
   MIXED_EXPORT int mixed_make_segment_generator(enum mixed_generator_type type, uint32_t frequency, uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A bank of wave generators summed into one output
+  ///
+  /// This renders all voices straight into the output buffer, which
+  /// is much cheaper than a generator and mixer input per voice. The
+  /// number of voices is fixed. Each voice is addressed as an input
+  /// location through set_in/get_in with MIXED_GENERATOR_FREQUENCY,
+  /// MIXED_GENERATOR_TYPE, and MIXED_VOLUME for its amplitude. All
+  /// voices start out silent at 440Hz with the given wave type, and
+  /// MIXED_VOLUME on the segment itself scales the whole bank.
+  MIXED_EXPORT int mixed_make_segment_oscillator_bank(uint32_t voices, enum mixed_generator_type type, uint32_t samplerate, struct mixed_segment *segment);
+
   /// A LADSPA plugin segment
   /// 
   /// LADSPA (Linux Audio Developers Simple Plugin API) is a standard for
@@ -1121,12 +2107,29 @@ extern "C" {
   /// your plugin's source or documentation.
   MIXED_EXPORT int mixed_make_segment_ladspa(char *file, uint32_t index, uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A segment running several instances of the same LADSPA plugin
+  ///
+  /// This is useful to process many channels with a plugin that only
+  /// handles one, without the overhead of a segment per channel. The
+  /// buffer locations of the instances follow one another, so with a
+  /// mono plugin, in and out MIXED_BUFFER N belong to instance N.
+  ///
+  /// All instances share the same control inputs, and fields read back
+  /// the output controls of the first instance. Every instance
+  /// processes the same number of samples on each mix.
+  ///
+  /// If THREADS is larger than one, the instances are run in parallel
+  /// on up to that many threads, including the calling one. This is
+  /// not supported on Windows. Otherwise see mixed_make_segment_ladspa.
+  MIXED_EXPORT int mixed_make_segment_ladspa_multi(char *file, uint32_t index, uint32_t samplerate, uint32_t instances, uint32_t threads, struct mixed_segment *segment);
+
   /// A space (3D) processed mixer
   ///
   /// This segment is capable of mixing sources according to their position
   /// and movement in space. It thus simulates the behaviour of sound in a
   /// 3D environment. This segment takes an arbitrary number of mono inputs
-  /// and has two outputs (left and right). Each input has two additional
+  /// and has two outputs (left and right) unless MIXED_SPACE_LAYOUT
+  /// asks for more. Each input has two additional
   /// fields aside from the buffer:
   ///
   /// * MIXED_SPACE_LOCATION
@@ -1146,10 +2149,18 @@ extern "C" {
   /// * MIXED_SPACE_MAX_DISTANCE
   /// * MIXED_SPACE_ROLLOFF
   /// * MIXED_SPACE_ATTENUATION
+  /// * MIXED_SPACE_HRTF
+  /// * MIXED_SPACE_LAYOUT
+  /// * MIXED_SPACE_CULL_THRESHOLD
   ///
   /// See the MIXED_FIELDS enum for the documentation of each field.
   /// This segment does allow you to change fields and buffers while the
   /// mixing has already been started.
+  ///
+  /// With a positive doppler factor every moving source is resampled
+  /// to its shifted pitch. Such a source consumes more or less input
+  /// than the segment outputs, and a block is only as long as the input
+  /// of every source lasts.
   MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixed_segment *segment);
 
   /// A planar (2D) processed mixer
@@ -1175,31 +2186,43 @@ extern "C" {
   /// * MIXED_SPACE_MAX_DISTANCE
   /// * MIXED_SPACE_ROLLOFF
   /// * MIXED_SPACE_ATTENUATION
+  /// * MIXED_SPACE_CULL_THRESHOLD
   ///
   /// See the MIXED_FIELDS enum for the documentation of each field.
   /// This segment does allow you to change fields and buffers while the
   /// mixing has already been started.
+  ///
+  /// With a positive doppler factor every moving source is resampled
+  /// to its shifted pitch. Such a source consumes more or less input
+  /// than the segment outputs, and a block is only as long as the input
+  /// of every source lasts.
   MIXED_EXPORT int mixed_make_segment_plane_mixer(uint32_t samplerate, struct mixed_segment *segment);
 
   /// A delay segment
   ///
   /// This segment will simply delay the incoming samples to the output by
   /// a specified amount of time. To do this, it will keep an internal
-  /// buffer of time*samplerate samples to store the incoming samples before
-  /// outputting them again once the delay time has been passed.
-  ///
-  /// This buffering means that delaying for a long time may take a lot of
-  /// memory, so watch out for that.
+  /// ring of at least time*samplerate samples to store the incoming
+  /// samples before outputting them again once the delay time has been
+  /// passed.
+  ///
+  /// The output is the sum of one or more taps that read from the same
+  /// ring, see MIXED_DELAY_TAP, which makes multi-tap echoes and chorus
+  /// a single segment. The ring only ever grows to fit the longest tap.
+  /// Delaying for a long time may take a lot of memory, so watch out
+  /// for that.
   MIXED_EXPORT int mixed_make_segment_delay(float time, uint32_t samplerate, struct mixed_segment *segment);
 
   /// A repeat segment
   ///
   /// This segment allows you to repeat some input from a buffer, and then
   /// simply loops the recorded bit to its output continuously. During the
-  /// recording time, the input is simply passed through.
+  /// recording time, the input is simply passed through. In overdub mode
+  /// the input is layered on top of the loop instead.
   ///
   /// Since the repeated audio data needs to be recorded, a long repeat time
-  /// may take a lot of memory.
+  /// may take a lot of memory. Set MIXED_REPEAT_MAX_TIME up front so that
+  /// later changes to the repeat time never allocate.
   MIXED_EXPORT int mixed_make_segment_repeat(float time, uint32_t samplerate, struct mixed_segment *segment);
 
   /// A pitch shift segment
@@ -1207,7 +2230,7 @@ extern "C" {
   /// This segment will shift the pitch of the incoming samples by a specified
   /// amount. The pitch should be a float in the range ]0, infty[, where 1.0
   /// means no change in pitch, 0.5 means half the pitch, 2.0 means double the
-  /// pitch and so on.
+  /// pitch and so on. See MIXED_PITCH_MODE for a low latency alternative.
   MIXED_EXPORT int mixed_make_segment_pitch(float pitch, uint32_t samplerate, struct mixed_segment *segment);
 
   /// A noise gate segment
@@ -1218,8 +2241,55 @@ extern "C" {
   /// If the volume then ever goes below the close threshold, the gate stays
   /// open for the duration of the hold time, after which it goes through a
   /// linear fade out for the duration of the release time.
+  ///
+  /// An optional sidechain can be set as input location 1. The gate
+  /// then opens and closes on the sidechain's level instead of the
+  /// input's, as for keying a drum track off another.
   MIXED_EXPORT int mixed_make_segment_gate(uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A noise gate for several linked channels
+  ///
+  /// All channels open and close together, following the loudest of
+  /// them, or the sidechain at the input location after the last
+  /// channel if one is set. Input and output locations are per
+  /// channel.
+  MIXED_EXPORT int mixed_make_segment_linked_gate(channel_t channels, uint32_t samplerate, struct mixed_segment *segment);
+
+  /// A jitter buffer segment for packetised streams.
+  ///
+  /// Packets of up to packet_frames interleaved frames in the given
+  /// encoding are inserted with mixed_jitter_insert, each stamped
+  /// with the position of its first frame in the stream. The segment
+  /// plays them out in order on its channels outputs, with
+  /// out of order packets sorted back into place.
+  ///
+  /// Playback waits until the target latency is buffered. The target
+  /// adapts to the variation in packet arrival times, from a single
+  /// packet up to half of the slots. When more than a packet beyond
+  /// the target piles up, a little audio is dropped on every mix to
+  /// catch up. Missing packets are concealed by repeating the last
+  /// packet length of audio with a decaying volume, and if the
+  /// packets run out, playback waits for the target again.
+  ///
+  /// Packets are decoded into a fixed slab of slots, so inserting
+  /// never allocates. Starting the segment discards any waiting
+  /// packets and resets its statistics, and must not happen while
+  /// packets are inserted. Packets may be inserted from one thread
+  /// other than the one that mixes, which then does the decoding, but
+  /// never from several threads at once.
+  MIXED_EXPORT int mixed_make_segment_jitter(enum mixed_encoding encoding, channel_t channels, uint32_t packet_frames, uint32_t slots, struct mixed_segment *segment);
+
+  /// Insert a packet into a jitter segment.
+  ///
+  /// The timestamp is the stream position of the packet's first
+  /// frame, which may wrap around. The packet is sorted in on the
+  /// next mix. Packets that are too late to be played or duplicates
+  /// are then counted and ignored, and if all slots are full, the
+  /// oldest packet makes way. If more packets are inserted between
+  /// two mixes than there are free slots, this fails with
+  /// MIXED_QUEUE_FULL.
+  MIXED_EXPORT int mixed_jitter_insert(uint32_t timestamp, void *packet, uint32_t frames, struct mixed_segment *segment);
+
   /// A noise generator segment.
   ///
   /// This segment can generate white, pink, and brown noise.
@@ -1236,6 +2306,45 @@ extern "C" {
   /// occur, so tread carefully.
   MIXED_EXPORT int mixed_make_segment_biquad_filter(enum mixed_biquad_filter type, float frequency, uint32_t samplerate, struct mixed_segment *segment);
 
+  /// A multi-band equalizer segment.
+  ///
+  /// Each of the channels is run through the same cascade of biquad
+  /// bands in a single pass. Every band starts out as a flat
+  /// MIXED_PEAKING band at 1kHz, and can be changed through the
+  /// MIXED_EQUALIZER_BAND field. Filter coefficients are computed
+  /// when a band is changed, not while mixing.
+  MIXED_EXPORT int mixed_make_segment_equalizer(channel_t channels, uint32_t bands, uint32_t samplerate, struct mixed_segment *segment);
+
+  /// A level meter segment.
+  ///
+  /// The channels are passed through unchanged while their levels are
+  /// measured. The levels are published with atomic stores, so any
+  /// thread may read them with MIXED_METER_LEVELS while the segment is
+  /// being mixed. All channels are weighted equally for the loudness.
+  MIXED_EXPORT int mixed_make_segment_meter(channel_t channels, uint32_t samplerate, struct mixed_segment *segment);
+
+  /// A spectrum analyser segment.
+  ///
+  /// The signal is passed through unchanged while it is analysed in
+  /// frames of the given size, which must be a power of two. Frames
+  /// start every framesize*(1-overlap) samples, and are windowed with
+  /// a Hann window unless set otherwise. Each frame's spectrum is
+  /// published into one of two arrays, which any thread can read with
+  /// MIXED_SPECTRUM without ever holding up the mix.
+  MIXED_EXPORT int mixed_make_segment_spectrum(uint32_t framesize, uint32_t samplerate, struct mixed_segment *segment);
+
+  /// A convolution segment.
+  ///
+  /// Convolves its input with an impulse response, for instance to
+  /// apply the reverb of a room or the sound of a speaker cabinet.
+  /// The convolution is done in the frequency domain one partition
+  /// at a time, which makes responses that are seconds long
+  /// practical. The output lags the input by the partition size of
+  /// the response.
+  /// MIXED_MIX controls the balance of the dry and the convolved
+  /// signal.
+  MIXED_EXPORT int mixed_make_segment_convolution(struct mixed_impulse_response *response, struct mixed_segment *segment);
+
   /// A speed change segment.
   ///
   /// Speed should be a factor, with 1.0 being 'same speed'. Higher factors will
@@ -1268,12 +2377,265 @@ extern "C" {
   ///
   /// The queue's info will reflect the capabilities of the first segment, if any,
   /// and the queue's maximal capabilities otherwise.
+  ///
+  /// Segments can be added and removed while the queue is being mixed on
+  /// another thread, without locking the mix. Removing a segment waits until
+  /// the mix is done with it. The mix ends, disconnects and drops a finished
+  /// segment itself, without locking or allocating. Setting MIXED_CAPACITY
+  /// avoids allocation when segments are added.
   MIXED_EXPORT int mixed_make_segment_queue(struct mixed_segment *segment);
   MIXED_EXPORT int mixed_queue_add(struct mixed_segment *news, struct mixed_segment *queue);
   MIXED_EXPORT int mixed_queue_remove(struct mixed_segment *old, struct mixed_segment *queue);
   MIXED_EXPORT int mixed_queue_remove_at(uint32_t pos, struct mixed_segment *queue);
   MIXED_EXPORT int mixed_queue_clear(struct mixed_segment *queue);
 
+  /// A pool of voices for playing many short sounds.
+  ///
+  /// Every voice is an unpacker that is made once, along with its
+  /// resampler and scratch memory, and is then reused for one sound
+  /// after another by pointing it at a different pack.
+  ///
+  /// You should not touch the fields beginning with an underscore.
+  MIXED_EXPORT struct mixed_voice_pool{
+    /// The voices, all of which are unpacker segments.
+    /// 
+    struct mixed_segment *voices;
+    /// The number of voices in the pool.
+    /// 
+    uint32_t count;
+    uint32_t *_free;
+    uint32_t _free_count;
+    char *_taken;
+    struct mixed_pack _pack;
+  };
+
+  /// Make a pool of voices.
+  ///
+  /// Every voice unpacks packs of the given number of channels to
+  /// the samplerate. Frames is the largest pack, in frames, that the
+  /// voices can play without allocating scratch memory when they are
+  /// started. The resamplers are prepared for packs at the same
+  /// samplerate, starting a voice with a pack of another samplerate
+  /// than before allocates a new resampler.
+  MIXED_EXPORT int mixed_make_voice_pool(uint32_t count, channel_t channels, uint32_t samplerate, uint32_t frames, struct mixed_voice_pool *pool);
+
+  /// Free the voices of the pool.
+  ///
+  /// The voices must not be in use anywhere anymore.
+  MIXED_EXPORT void mixed_free_voice_pool(struct mixed_voice_pool *pool);
+
+  /// Take a voice from the pool to play the pack.
+  ///
+  /// The voice starts out at a volume of one and not bypassed. Add
+  /// it to a queue, or connect its output buffers and start it
+  /// yourself. If all voices are taken, this fails with
+  /// MIXED_QUEUE_FULL. The pool is not thread safe, so take and
+  /// return voices from one thread only.
+  MIXED_EXPORT int mixed_voice_pool_take(struct mixed_pack *pack, struct mixed_segment **voice, struct mixed_voice_pool *pool);
+
+  /// Return a voice to the pool.
+  ///
+  /// The voice must be removed from wherever it was added first.
+  /// It is ended and its buffers are disconnected.
+  MIXED_EXPORT int mixed_voice_pool_return(struct mixed_segment *voice, struct mixed_voice_pool *pool);
+
+  /// A bank of decoded samples shared between voices.
+  ///
+  /// Each sample is decoded and resampled once when it is added, and
+  /// is then kept as immutable planar floats. Sample segments read it
+  /// through cursors of their own, so any number of voices can play
+  /// the same sample without decoding or storing it again. Samples
+  /// are reference counted: one that is removed or evicted is only
+  /// freed once no sample segment plays it anymore.
+  ///
+  /// With a budget, adding a sample first evicts the least recently
+  /// used samples that no segment plays until the new one fits. The
+  /// bank is not thread safe, so add, remove and make segments from
+  /// one thread only.
+  ///
+  /// You should not touch the fields beginning with an underscore.
+  MIXED_EXPORT struct mixed_sample_bank{
+    void *_data;
+    /// The samplerate every sample is stored at.
+    /// 
+    uint32_t samplerate;
+    /// The most bytes of sample data to keep, or zero for no limit.
+    /// 
+    uint64_t budget;
+    /// The bytes of sample data currently kept.
+    /// 
+    uint64_t size;
+    /// The number of samples in the bank.
+    /// 
+    uint32_t count;
+  };
+
+  /// Make an empty sample bank.
+  MIXED_EXPORT int mixed_make_sample_bank(uint32_t samplerate, uint64_t budget, struct mixed_sample_bank *bank);
+
+  /// Free the sample bank.
+  ///
+  /// Sample segments keep their own reference to what they play and
+  /// continue to work, but can no longer switch samples.
+  MIXED_EXPORT void mixed_free_sample_bank(struct mixed_sample_bank *bank);
+
+  /// Decode everything that can be read from the pack into the bank.
+  ///
+  /// The pack is read out, and its data resampled to the bank's
+  /// samplerate. A sample of the same id is replaced, though segments
+  /// still playing it go on doing so. If the sample does not fit into
+  /// the budget even after evicting, this fails with
+  /// MIXED_OUT_OF_MEMORY.
+  MIXED_EXPORT int mixed_sample_bank_add(uint32_t id, struct mixed_pack *pack, struct mixed_sample_bank *bank);
+
+  /// Remove a sample from the bank.
+  MIXED_EXPORT int mixed_sample_bank_remove(uint32_t id, struct mixed_sample_bank *bank);
+
+  /// Returns the length of a sample in frames, or zero if the bank
+  /// does not hold it.
+  MIXED_EXPORT uint32_t mixed_sample_bank_frames(uint32_t id, struct mixed_sample_bank *bank);
+
+  /// A segment playing a sample from a sample bank.
+  ///
+  /// There is one output per channel of the sample. Outputs that are
+  /// connected as empty structs, as for the distribute segment, are
+  /// pointed straight at the bank's storage, which costs nothing per
+  /// voice. These buffers are read only, so do not process them in
+  /// place. Allocated buffers also work, and are copied into.
+  /// Once a sample that does not loop has played through, the
+  /// outputs are silent.
+  MIXED_EXPORT int mixed_make_segment_sample(uint32_t id, struct mixed_sample_bank *bank, struct mixed_segment *segment);
+
+  /// Decodes more data into a pack for a streamer.
+  ///
+  /// The area is where the data goes, and size holds how many bytes
+  /// fit there. Set size to the number of bytes actually written,
+  /// which may be zero if nothing is ready yet. Return zero once the
+  /// stream has ended, after which it is no longer filled.
+  typedef int (*mixed_stream_decoder)(void *area, uint32_t *size, void *user);
+
+  /// Keeps packs topped up from a background thread.
+  ///
+  /// Register packs with a decoder and a watermark. Whenever the data
+  /// available in a pack falls below its watermark, a worker runs the
+  /// decoder until it is above again. Packs with a higher priority are
+  /// served first, and among the same priority the emptiest pack goes
+  /// first. This keeps disk access and decoding off the audio thread.
+  ///
+  /// You should not touch the fields beginning with an underscore.
+  MIXED_EXPORT struct mixed_streamer{
+    void *_data;
+  };
+
+  /// Create a streamer with the given number of worker threads.
+  ///
+  /// With zero threads nothing runs in the background and you must
+  /// call mixed_streamer_update yourself. Worker threads are not
+  /// implemented on Windows.
+  MIXED_EXPORT int mixed_make_streamer(uint32_t threads, struct mixed_streamer *streamer);
+
+  /// Stop the workers and free the streamer.
+  ///
+  /// The packs themselves are not freed.
+  MIXED_EXPORT void mixed_free_streamer(struct mixed_streamer *streamer);
+
+  /// Register a pack to be kept filled.
+  ///
+  /// The watermark is in frames and must fit within the pack. The
+  /// decoder is called with the user pointer from a worker thread.
+  /// When the streamer has workers, the pack must have been made with
+  /// mixed_make_pack_shared.
+  MIXED_EXPORT int mixed_streamer_add(struct mixed_pack *pack, uint32_t watermark, int priority, mixed_stream_decoder decoder, void *user, struct mixed_streamer *streamer);
+
+  /// Stop filling the pack.
+  ///
+  /// If a worker is currently filling the pack, this waits for it to
+  /// finish. Afterwards the decoder is not called anymore.
+  MIXED_EXPORT int mixed_streamer_remove(struct mixed_pack *pack, struct mixed_streamer *streamer);
+
+  /// Returns whether the decoder of the pack has reported its end.
+  /// 
+  MIXED_EXPORT int mixed_streamer_done(struct mixed_pack *pack, struct mixed_streamer *streamer);
+
+  /// Fill every pack below its watermark on the calling thread.
+  /// 
+  MIXED_EXPORT int mixed_streamer_update(struct mixed_streamer *streamer);
+
+  /// Wake the workers to check the packs right away.
+  ///
+  /// Workers check on their own every two milliseconds. Calling this
+  /// after a large read shortens the wait.
+  MIXED_EXPORT void mixed_streamer_wake(struct mixed_streamer *streamer);
+
+  /// The audio systems a device can play through.
+  enum mixed_device_backend{
+    /// The native audio system of the platform.
+    MIXED_DEVICE_DEFAULT,
+    /// Plays nothing, but consumes the pack in real time.
+    MIXED_DEVICE_NULL,
+    /// ALSA on Linux, loaded at runtime from libasound.
+    MIXED_DEVICE_ALSA,
+    MIXED_DEVICE_PULSEAUDIO,
+    MIXED_DEVICE_WASAPI,
+    MIXED_DEVICE_COREAUDIO
+  };
+
+  /// Plays a pack on an audio device.
+  ///
+  /// The device runs its own thread that takes a period of frames at
+  /// a time from the pack and hands it to the audio system. The pack
+  /// is the only connection to the thread that mixes, so neither ever
+  /// waits on the other. Usually the pack is the output of a packer
+  /// segment, which the mix thread keeps filled.
+  ///
+  /// If the pack runs dry, a period of silence is played instead so
+  /// that the latency stays put, and the underrun is counted.
+  ///
+  /// You should not touch the fields beginning with an underscore.
+  MIXED_EXPORT struct mixed_device{
+    void *_data;
+  };
+
+  /// Open an audio device to play the pack.
+  ///
+  /// The pack must have been made with mixed_make_pack_shared, be
+  /// interleaved, and its encoding, channels, and samplerate must be
+  /// supported by the device. The name selects a device of the audio
+  /// system, NULL picks the default one. With ALSA, a "hw:" device
+  /// gives exclusive, direct access for the lowest latency.
+  ///
+  /// period is the number of frames handed over at once, and periods
+  /// the number of periods the device buffers. Together they bound
+  /// the latency, but the audio system may round them. Backends that
+  /// are not implemented on the platform fail with
+  /// MIXED_NOT_IMPLEMENTED. Currently only the null and ALSA backends
+  /// exist.
+  MIXED_EXPORT int mixed_make_device(enum mixed_device_backend backend, char *name, uint32_t period, uint32_t periods, struct mixed_pack *pack, struct mixed_device *device);
+
+  /// Stop the device and close it.
+  ///
+  /// The pack itself is not freed.
+  MIXED_EXPORT void mixed_free_device(struct mixed_device *device);
+
+  /// Start playing the pack.
+  /// 
+  MIXED_EXPORT int mixed_device_start(struct mixed_device *device);
+
+  /// Stop playing the pack.
+  ///
+  /// Whatever is left in the pack stays there.
+  MIXED_EXPORT int mixed_device_end(struct mixed_device *device);
+
+  /// Returns the latency of the device in frames.
+  ///
+  /// This is the period times the number of periods, as the device
+  /// actually set them up.
+  MIXED_EXPORT uint32_t mixed_device_latency(struct mixed_device *device);
+
+  /// Returns how often the device has run dry so far.
+  /// 
+  MIXED_EXPORT uint32_t mixed_device_underruns(struct mixed_device *device);
+
   /// A segment that throws away all of its input.
   /// 
   MIXED_EXPORT int mixed_make_segment_void(struct mixed_segment *segment);
@@ -1285,7 +2647,17 @@ extern "C" {
   /// A segment for channel conversion
   ///
   /// This segment allows changing between different channel representations.
-  /// If a requested configuration is not supported, an error is created.
+  /// Every output channel is a weighted sum of the input channels, and
+  /// the weights can be read and replaced through MIXED_CHANNEL_MATRIX.
+  /// The channels follow the order of enum mixed_location.
+  ///
+  /// Each pair of channel counts starts out with a preset matrix.
+  /// Upmixes from stereo derive the centre and rear channels,
+  /// low-pass the centre and LFE channels, and band-limit the rear
+  /// channels and shift them 90 degrees apart. Downmixes to stereo or mono
+  /// follow ITU-R BS.775 and drop the LFE channel. Other
+  /// configurations map each channel to the one of the same index.
+  /// Zero channels on either side are not supported.
   MIXED_EXPORT int mixed_make_segment_channel_convert(uint8_t in, uint8_t out, uint32_t samplerate, struct mixed_segment *segment);
 
   /// Create a chain segment
@@ -1296,36 +2668,219 @@ extern "C" {
   /// A segment to quantize the amplitude
   ///
   /// The signal will be quantized into STEPS number of discrete amplitudes.
+  /// With MIXED_QUANTIZE_HOLD the samplerate can be reduced in the same pass.
   MIXED_EXPORT int mixed_make_segment_quantize(uint32_t steps, struct mixed_segment *segment);
 
   /// Add a new segment to the chain's end.
   ///
-  /// It is /NOT/ safe to add elements to a chain from multiple
-  /// threads at once.
+  /// This is safe to do while the chain is being mixed on another
+  /// thread. The mix sees either the old or the new list of segments.
   MIXED_EXPORT int mixed_chain_add(struct mixed_segment *segment, struct mixed_segment *chain);
 
   /// Add a new segment at the specified index in the chain.
   /// elements at or after the index are pushed back to make space.
-  /// It is /NOT/ safe to add elements to a chain from multiple
-  /// threads at once.
+  /// This is safe to do while the chain is being mixed on another
+  /// thread. The mix sees either the old or the new list of segments.
   MIXED_EXPORT int mixed_chain_add_at(uint32_t i, struct mixed_segment *segment, struct mixed_segment *chain);
 
   /// Remove a segment from the chain.
   ///
   /// Segments after it will be shifted down as necessary.
   ///
-  /// It is /NOT/ safe to remove elements from a chain from multiple
-  /// threads at once.
+  /// This is safe to do while the chain is being mixed on another
+  /// thread. Once this returns, the chain's mix no longer touches
+  /// the segment, which must thus not be called from within it.
   MIXED_EXPORT int mixed_chain_remove(struct mixed_segment *segment, struct mixed_segment *chain);
 
   /// Remove a segment at the specified index from the chain.
   /// 
   /// Segments after it will be shifted down as necessary.
   /// 
-  /// It is /NOT/ safe to remove elements from a chain from multiple
-  /// threads at once.
+  /// This is safe to do while the chain is being mixed on another
+  /// thread. Once this returns, the chain's mix no longer touches
+  /// the segment, which must thus not be called from within it.
   MIXED_EXPORT int mixed_chain_remove_at(uint32_t i, struct mixed_segment *chain);
 
+  /// Create a segment that applies field changes from other threads.
+  ///
+  /// Setting a field on a segment while it is being mixed on another
+  /// thread is not safe. Instead, queue the change on this segment
+  /// from any number of threads with mixed_commands_set and friends.
+  /// The changes are then applied in order the next time this
+  /// segment is mixed, without taking any lock. Mix it on the audio
+  /// thread right before the segments it targets, for instance as
+  /// the first segment of a chain. It must not run at the same time
+  /// as its targets, so do not add it to a graph using threads.
+  ///
+  /// The size is the number of changes that can be pending at once,
+  /// rounded up to a power of two.
+  MIXED_EXPORT int mixed_make_segment_commands(uint32_t size, struct mixed_segment *segment);
+
+  /// Queue a change to a field on the target segment.
+  ///
+  /// The size bytes at value are copied, up to 32 bytes. If size is
+  /// zero the value pointer itself is passed on, which is what
+  /// fields like MIXED_BUFFER expect. Signals MIXED_QUEUE_FULL if
+  /// too many changes are pending.
+  /// This is safe to call from multiple threads at once.
+  MIXED_EXPORT int mixed_commands_set(uint32_t field, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment);
+
+  /// Queue a change to a field of an input on the target segment.
+  ///
+  /// See mixed_commands_set
+  MIXED_EXPORT int mixed_commands_set_in(uint32_t field, uint32_t location, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment);
+
+  /// Queue a change to a field of an output on the target segment.
+  ///
+  /// See mixed_commands_set
+  MIXED_EXPORT int mixed_commands_set_out(uint32_t field, uint32_t location, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment);
+
+  /// Create a graph segment
+  ///
+  /// A graph holds a set of segments and the connections between
+  /// their buffers. When the graph is compiled, the segments are
+  /// put into a topological order and every connection is backed by
+  /// a buffer of buffer_size samples that the graph manages for you.
+  /// Connections that are never live at the same time share the same
+  /// buffer, so a long pipeline only needs as many buffers as there
+  /// are connections alive in parallel. Segments that declare
+  /// MIXED_INPLACE get the same buffer for an output as for the
+  /// input at the same location, so they and their bypass do not
+  /// copy anything.
+  ///
+  /// Ports that are not connected within the graph are left alone,
+  /// and you are free to attach your own buffers to them to feed data
+  /// into or out of the graph. The graph does not free the segments
+  /// it holds.
+  ///
+  /// If a segment does not consume all of its input in one mix step
+  /// the remaining samples are moved to a dedicated buffer for that
+  /// connection, so sharing never alters the result.
+  ///
+  /// Segments are grouped into levels, where each level only depends
+  /// on the levels before it. If MIXED_GRAPH_THREADS is set to more
+  /// than one, the segments within a level are mixed in parallel and
+  /// the graph waits for the whole level before moving on to the
+  /// next. The segments in a graph must then not share any state
+  /// outside of the graph's connections.
+  ///
+  /// If MIXED_BLOCK_SIZE is set, every buffer the graph manages
+  /// holds exactly one block instead of buffer_size samples, and its
+  /// data starts on a 64 byte boundary. As long as every block is
+  /// consumed in full, the areas handed out by
+  /// mixed_buffer_request_read and mixed_buffer_request_write on
+  /// those buffers are then aligned as well. The block size is passed on
+  /// to all segments when the graph is compiled.
+  ///
+  /// When the graph is compiled it also reads MIXED_LATENCY from its
+  /// segments. If the paths leading into a segment's inputs differ
+  /// in latency, the graph delays the faster connections, so that
+  /// parallel branches arrive aligned to the sample. If a latency
+  /// changes afterwards, compile the graph again.
+  ///
+  /// A run of MIXED_INPLACE segments that each take all of their
+  /// inputs from the one before shares one set of buffers. The graph
+  /// mixes such a run in strips of a few hundred samples, passing
+  /// each strip through every segment of the run while it is still
+  /// in the cache. Segments in a run thus see their input in several
+  /// smaller pieces per mix. This is not done if MIXED_BLOCK_SIZE is
+  /// set.
+  ///
+  /// If MIXED_DEADLINE is set, the graph times every segment and
+  /// every mix. A mix that overruns the deadline degrades the graph
+  /// by one step, and after a while of mixes well within it, the
+  /// last step is undone again. The steps are taken in this order:
+  /// segments that resample are switched to their linear
+  /// MIXED_RESAMPLE_FALLBACK, segments marked with mixed_graph_optional
+  /// are bypassed, the most expensive first, and finally the voice
+  /// limit of every mixer with a MIXED_MAX_VOICES set is halved,
+  /// virtualising the voices that no longer fit. None of these steps
+  /// allocate. Segments get their settings back when they are
+  /// restored or removed from the graph.
+  MIXED_EXPORT int mixed_make_segment_graph(uint32_t buffer_size, struct mixed_segment *segment);
+
+  /// Add a segment to the graph.
+  ///
+  /// Adding the same segment twice fails with MIXED_INVALID_VALUE.
+  MIXED_EXPORT int mixed_graph_add(struct mixed_segment *segment, struct mixed_segment *graph);
+
+  /// Remove a segment and all of its connections from the graph.
+  ///
+  MIXED_EXPORT int mixed_graph_remove(struct mixed_segment *segment, struct mixed_segment *graph);
+
+  /// Connect an output of one segment to the input of another.
+  ///
+  /// Both segments must have been added to the graph first. Each
+  /// output and each input may only take part in one connection. If
+  /// you need to feed one output to several inputs, use a distribute
+  /// segment.
+  MIXED_EXPORT int mixed_graph_connect(struct mixed_segment *source, uint32_t source_location, struct mixed_segment *target, uint32_t target_location, struct mixed_segment *graph);
+
+  /// Remove a connection between two segments.
+  ///
+  MIXED_EXPORT int mixed_graph_disconnect(struct mixed_segment *source, uint32_t source_location, struct mixed_segment *target, uint32_t target_location, struct mixed_segment *graph);
+
+  /// Mark a segment as optional for the graph.
+  ///
+  /// Optional segments may be bypassed through MIXED_BYPASS when the
+  /// graph overruns its MIXED_DEADLINE. The segment must have been
+  /// added to the graph first.
+  MIXED_EXPORT int mixed_graph_optional(struct mixed_segment *segment, int optional, struct mixed_segment *graph);
+
+  /// Schedule the graph and assign buffers to its connections.
+  ///
+  /// This is done automatically when the graph is started or mixed
+  /// after its structure was changed, but you may call it yourself
+  /// to avoid the allocations at that point. If the connections form
+  /// a cycle, this fails with MIXED_GRAPH_CYCLE.
+  MIXED_EXPORT int mixed_graph_compile(struct mixed_segment *graph);
+
+  /// Render a segment offline.
+  ///
+  /// The segment is started, mixed until frames frames have arrived
+  /// in the pack, and ended again. The pack should be the one a
+  /// packer within the segment writes to. Its contents are moved to
+  /// out after every mix, so the pack only needs to hold what a
+  /// single mix produces, while out needs room for frames frames in
+  /// the pack's encoding and channel layout. The pack must not be
+  /// planar. As nothing waits on a device here, use a graph with a
+  /// large buffer size to mix in big blocks.
+  ///
+  /// Rendering stops early once a mix produces no output, in which
+  /// case frames is updated to the number of frames rendered.
+  MIXED_EXPORT int mixed_render(uint64_t *frames, void *out, struct mixed_pack *pack, struct mixed_segment *segment);
+
+  /// Describes how to build copies of a pipeline for parallel rendering.
+  ///
+  /// make should construct an independent copy of the pipeline, with
+  /// its sources set to start at the given frame, and store the
+  /// segment to mix and the pack its output arrives in. free should
+  /// release the segment and everything else make created. Both are
+  /// called from the rendering threads, so they must not share state
+  /// that is not safe to use concurrently.
+  MIXED_EXPORT struct mixed_render_pipeline{
+    int (*make)(uint64_t frame, struct mixed_segment **segment, struct mixed_pack **pack, void *user);
+    void (*free)(struct mixed_segment *segment, void *user);
+    void *user;
+  };
+
+  /// Render a pipeline offline by splitting it across threads.
+  ///
+  /// The timeline is cut into chunks of chunk frames, each of which
+  /// is rendered by its own copy of the pipeline as by mixed_render.
+  /// Each copy starts overlap frames before its chunk, and the output
+  /// of that lead-in is discarded, so that filters and other segments
+  /// with a short memory have settled by the time the chunk begins.
+  /// The overlap should therefore be at least the pipeline's
+  /// MIXED_LATENCY plus the time its segments take to forget their
+  /// past. Segments whose state never settles, such as oscillators
+  /// with a running phase, will not line up across chunks.
+  ///
+  /// threads is the total number of threads to use, including the
+  /// calling one. As with mixed_render, frames is updated if the
+  /// pipeline runs out of output early.
+  MIXED_EXPORT int mixed_render_parallel(uint64_t *frames, uint32_t chunk, uint32_t overlap, uint32_t threads, void *out, struct mixed_render_pipeline *pipeline);
+
   /// Function prototype for a plugin's segment construction function.
   ///
   /// This type of function will be called with an opaque argument list
@@ -1355,11 +2910,83 @@ extern "C" {
   /// segment that it initially registered.
   typedef int (*mixed_free_plugin_function)(mixed_deregister_segment_function registrar);
 
+  /// The version of the block processor interface.
+  ///
+  /// A processor must put this into its version field. Processors
+  /// built against another version are refused.
+#define MIXED_BLOCK_PROCESSOR_VERSION 1
+
+  /// Capabilities a block processor declares in its flags field.
+  enum mixed_block_processor_flags{
+    /// The processor may be handed the same block as an input and an
+    /// output. Output N then shares its block with input N.
+    MIXED_BLOCK_INPLACE = 0x1,
+    /// The processor uses vector code. Its blocks are then always
+    /// aligned to 64 bytes, and its block size must be a multiple
+    /// of 16 samples.
+    MIXED_BLOCK_SIMD = 0x2
+  };
+
+  /// Describes a native block processor.
+  ///
+  /// A block processor only ever sees blocks of exactly block_size
+  /// samples, one separate block per channel. The host takes care of
+  /// all buffer handling, collects input until a full block is there,
+  /// and drains the results to the output buffers as they have room.
+  /// Blocks are taken straight from the buffers where possible, and
+  /// staged in aligned memory owned by the host otherwise.
+  ///
+  /// The description must stay valid for as long as any segment made
+  /// from it exists.
+  struct mixed_block_processor{
+    /// Must be MIXED_BLOCK_PROCESSOR_VERSION.
+    uint32_t version;
+    /// The name under which the processor is registered.
+    char *name;
+    /// A human readable description.
+    char *description;
+    /// The number of input channels.
+    uint32_t inputs;
+    /// The number of output channels.
+    uint32_t outputs;
+    /// The number of samples per block.
+    uint32_t block_size;
+    /// The delay in samples the processor adds to the signal.
+    uint32_t latency;
+    /// A combination of mixed_block_processor_flags.
+    uint32_t flags;
+    /// Creates the processor's state for the given samplerate.
+    /// Returns NULL on failure.
+    void *(*make)(uint32_t samplerate);
+    /// Frees the state again.
+    void (*free)(void *state);
+    /// Optional. Resets the state when the segment is started.
+    void (*reset)(void *state);
+    /// Processes one block from the input blocks into the output blocks.
+    int (*process)(float **in, float **out, uint32_t samples, void *state);
+    /// Optional. Sets a field of the processor.
+    int (*set)(uint32_t field, void *value, void *state);
+    /// Optional. Gets a field of the processor.
+    int (*get)(uint32_t field, void *value, void *state);
+  };
+
+  /// Function prototype for registering a block processor.
+  typedef int (*mixed_register_block_processor_function)(const struct mixed_block_processor *processor);
+
+  /// If you write a block processor plugin library, you must define
+  /// an exported function of this signature named
+  /// mixed_make_block_plugin instead of mixed_make_plugin.
+  /// The function should call the given function for every
+  /// processor that the library should provide. Closing the library
+  /// works the same as for segment plugins.
+  typedef int (*mixed_make_block_plugin_function)(mixed_register_block_processor_function registrar);
+
   /// Load a new plugin library.
   ///
   /// The function may fail if the library was previously loaded already,
   /// cannot be opened, does not contain the required mixed_make_plugin
-  /// function, or that function fails for some reason.
+  /// or mixed_make_block_plugin function, or that function fails for
+  /// some reason.
   /// The file name is copied and may be deallocated again after this
   /// function has been called.
   MIXED_EXPORT int mixed_load_plugin(char *file);
@@ -1378,8 +3005,29 @@ extern "C" {
   /// via mixed_make_segment.
   /// The name and args are copied and may be deallocated again after this
   /// function has been called.
+  /// Segments may be registered and deregistered while other threads
+  /// look up or make segments.
   MIXED_EXPORT int mixed_register_segment(char *name, uint32_t argc, struct mixed_segment_field_info *args, mixed_make_segment_function function);
 
+  /// Register a block processor globally.
+  ///
+  /// The processor becomes constructible through mixed_make_segment
+  /// under its name, with its samplerate as the only argument.
+  /// Unlike the name, the processor description is not copied.
+  MIXED_EXPORT int mixed_register_block_processor(const struct mixed_block_processor *processor);
+
+  /// A segment running a native block processor
+  ///
+  /// See mixed_block_processor. The segment has as many input and
+  /// output buffers as the processor has channels. Reading
+  /// MIXED_LATENCY gives the processor's latency, and all other
+  /// fields are passed on to the processor's set and get functions.
+  ///
+  /// Output only appears once a full block of input has arrived, so
+  /// to avoid extra delay, feed the segment multiples of the block
+  /// size.
+  MIXED_EXPORT int mixed_make_segment_block(const struct mixed_block_processor *processor, uint32_t samplerate, struct mixed_segment *segment);
+
   /// Remove a globally registered segment constructor.
   ///
   /// If successful, the given name can be registered again afterwards.
@@ -1405,6 +3053,24 @@ extern "C" {
   /// segment_field_info structure for the constructor.
   MIXED_EXPORT int mixed_make_segment(char *name, void *args, struct mixed_segment *segment);
 
+  /// A handle to a registered segment constructor.
+  ///
+  /// The handle stays valid until the segment is deregistered.
+  struct mixed_segment_constructor;
+
+  /// Look up a segment constructor by name.
+  ///
+  /// Returns NULL if there is no segment of the given name. Using the
+  /// handle with mixed_make_segment_from skips the name lookup, which
+  /// pays off when many segments of the same type are made.
+  MIXED_EXPORT struct mixed_segment_constructor *mixed_find_segment(char *name);
+
+  /// Create a segment from a constructor handle.
+  ///
+  /// See mixed_make_segment. The segment must not be deregistered
+  /// while this function runs.
+  MIXED_EXPORT int mixed_make_segment_from(struct mixed_segment_constructor *constructor, void *args, struct mixed_segment *segment);
+
   /// Return the size of a sample in the given encoding in bytes.
   /// 
   MIXED_EXPORT uint8_t mixed_samplesize(enum mixed_encoding encoding);
@@ -1440,6 +3106,24 @@ extern "C" {
   ///
   MIXED_EXPORT char *mixed_version();
 
+  /// Returns the CPU features the library's kernels currently use.
+  ///
+  /// This is a combination of mixed_cpu_feature flags. The CPU is
+  /// probed once when the library is loaded, and the conversion
+  /// kernels are picked from that right away. The vectorised
+  /// segments are picked by the loader through the same probe.
+  MIXED_EXPORT uint32_t mixed_cpu_features();
+
+  /// Restrict the conversion kernels to the given CPU features.
+  ///
+  /// Features the CPU lacks are ignored, so 0 selects the portable
+  /// kernels and UINT32_MAX everything the CPU has. Returns the
+  /// features now in use. This is meant for comparing kernels, the
+  /// vectorised segments are not affected.
+  ///
+  /// Do not call this while packs are being converted.
+  MIXED_EXPORT uint32_t mixed_cpu_set_features(uint32_t features);
+
   //// Allow customising how libmixed allocates things.
   
   /// Allocates a new block of memory.
@@ -8,53 +8,141 @@ MIXED_EXPORT int mixed_make_pack(uint32_t frames, struct mixed_pack *pack){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
-  pack->size = frames*pack->channels*mixed_samplesize(pack->encoding);
+  pack->size = frames*pack_frame_bytes(pack);
+  pack->_shared = 0;
+  pack->_mapping = 0;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_pack_shared(uint32_t frames, struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  void *data = 0;
+  uint32_t size = frames*pack_frame_bytes(pack);
+  pack->_shared = make_shared_ring(frames*pack->channels*mixed_samplesize(pack->encoding), &data);
+  if(!pack->_shared){
+    return 0;
+  }
+  pack->_data = data;
+  pack->size = size;
+  pack->_mapping = 0;
+  mixed_pack_clear(pack);
   return 1;
 }
 
 MIXED_EXPORT void mixed_free_pack(struct mixed_pack *pack){
-  if(pack->_data)
+  if(pack->_shared)
+    free_shared_ring(pack->_shared);
+  else if(pack->_mapping)
+    free_pack_mapping(pack->_mapping);
+  else if(pack->_data)
     mixed_free(pack->_data);
+  if(pack->_stats)
+    mixed_free(pack->_stats);
   pack->_data = 0;
+  pack->_shared = 0;
+  pack->_mapping = 0;
+  pack->_stats = 0;
   pack->size = 0;
   mixed_pack_clear(pack);
 }
 
 MIXED_EXPORT int mixed_pack_clear(struct mixed_pack *pack){
+  if(pack->_shared)
+    shared_clear(pack->_shared);
   pack->read = 0;
   pack->write = 0;
   pack->reserved = 0;
   return 1;
 }
 
+static uint32_t pack_pending(struct mixed_pack *pack){
+  if(pack->_shared){
+    struct shared_ring *ring = (struct shared_ring *)pack->_shared;
+    return ring_used(atomic_read(ring->read), atomic_read(ring->write), pack->size);
+  }
+  read_buffer_state(read, write, full_r2, pack);
+  return (full_r2)? pack->size - read + write : write - read;
+}
+
 MIXED_EXPORT int mixed_pack_request_write(void **area, uint32_t *size, struct mixed_pack *pack){
-  uint32_t off = 0;
-  if(!bip_request_write(&off, size, (struct bip*)pack))
-     return 0;
+  uint32_t off = 0, requested = *size;
+  int result = (pack->_shared)? shared_request_write(&off, size, pack->size, pack->_shared)
+    : bip_request_write(&off, size, (struct bip*)pack);
+  if(pack->_stats) stats_request_write(requested, *size, pack->_stats);
+  if(!result) return 0;
   *area = pack->_data+off;
   return 1;
 }
 
 MIXED_EXPORT int mixed_pack_finish_write(uint32_t size, struct mixed_pack *pack){
-  return bip_finish_write(size, (struct bip*)pack);
+  int result = (pack->_shared)? shared_finish_write(size, pack->size, pack->_shared)
+    : bip_finish_write(size, (struct bip*)pack);
+  if(pack->_stats && result) stats_finish_write(size, pack_pending(pack), pack->_stats);
+  return result;
 }
 
 MIXED_EXPORT int mixed_pack_request_read(void **area, uint32_t *size, struct mixed_pack *pack){
-  uint32_t off = 0;
-  if(!bip_request_read(&off, size, (struct bip*)pack))
-    return 0;
+  uint32_t off = 0, requested = *size;
+  int result = (pack->_shared)? shared_request_read(&off, size, pack->size, pack->_shared)
+    : bip_request_read(&off, size, (struct bip*)pack);
+  if(pack->_stats) stats_request_read(requested, *size, pack_pending(pack), pack->_stats);
+  if(!result) return 0;
   *area = pack->_data+off;
   return 1;
 }
 
 MIXED_EXPORT int mixed_pack_finish_read(uint32_t size, struct mixed_pack *pack){
-  return bip_finish_read(size, (struct bip*)pack);
+  int result = (pack->_shared)? shared_finish_read(size, pack->size, pack->_shared)
+    : bip_finish_read(size, (struct bip*)pack);
+  if(pack->_stats && result) stats_finish_read(size, pack->_stats);
+  return result;
 }
 
 MIXED_EXPORT uint32_t mixed_pack_available_read(struct mixed_pack *pack){
+  if(pack->_shared) return shared_available_read(pack->size, pack->_shared);
   return bip_available_read((struct bip*)pack);
 }
 
+MIXED_EXPORT int mixed_pack_enable_stats(struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  if(pack->_stats) return 1;
+  struct mixed_buffer_stats *stats = mixed_calloc(1, sizeof(struct mixed_buffer_stats));
+  if(!stats){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  stats_reset(stats);
+  pack->_stats = stats;
+  return 1;
+}
+
+// The counters are kept in octets and handed out in frames.
+MIXED_EXPORT int mixed_pack_stats(struct mixed_buffer_stats *stats, struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  if(!pack->_stats){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  uint32_t frame = pack_frame_bytes(pack);
+  *stats = *(struct mixed_buffer_stats *)pack->_stats;
+  stats->written /= frame;
+  stats->read /= frame;
+  stats->high_water /= frame;
+  stats->low_water = (stats->low_water == UINT32_MAX)? 0 : stats->low_water / frame;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_pack_reset_stats(struct mixed_pack *pack){
+  mixed_err(MIXED_NO_ERROR);
+  if(!pack->_stats){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  stats_reset(pack->_stats);
+  return 1;
+}
+
 MIXED_EXPORT uint32_t mixed_pack_available_write(struct mixed_pack *pack){
+  if(pack->_shared) return shared_available_write(pack->size, pack->_shared);
   return bip_available_write((struct bip*)pack);
 }
@@ -17,17 +17,48 @@
  *****************************************************************************/ 
 
 #include "internal.h"
-#include "spiral_fft.h"
+
+// Bins are converted between rectangular and polar form with these
+// approximations rather than libm, so that the per-bin loops can be
+// vectorised. Phases stay within about 1e-5 radians, which is far below
+// what the phase vocoder's own smearing does to them.
+
+static inline float pitch_atan2(float y, float x){
+  float ax = fabsf(x), ay = fabsf(y);
+  float a = MIN(ax, ay) / (MAX(ax, ay) + 1e-30f);
+  float s = a*a;
+  float r = ((-0.0464964749f*s + 0.15931422f)*s - 0.327622764f)*s*a + a;
+  r = (ax < ay)? 1.57079637f - r : r;
+  r = (x < 0.0f)? 3.14159274f - r : r;
+  return (y < 0.0f)? -r : r;
+}
+
+// Maps a phase into [-pi, pi].
+static inline float pitch_wrap(float x){
+  return x - 6.28318531f * rintf(x * 0.159154943f);
+}
+
+// sin(x) for x in [-pi, pi].
+static inline float pitch_sin(float x){
+  x = (1.57079637f < x)? 3.14159274f - x : x;
+  x = (x < -1.57079637f)? -3.14159274f - x : x;
+  float x2 = x*x;
+  return x*(1.0f + x2*(-0.166666667f + x2*(0.00833333333f + x2*(-0.000198412698f + x2*0.00000275573192f))));
+}
 
 void free_pitch_data(struct pitch_data *data){
   if(data->in_fifo)
     mixed_free(data->in_fifo);
+  free_fft_real(&data->fft);
   data->in_fifo = 0;
   data->out_fifo = 0;
-  data->fft_workspace = 0;
+  data->window = 0;
+  data->frame = 0;
+  data->output_accumulator = 0;
+  data->re = 0;
+  data->im = 0;
   data->last_phase = 0;
   data->phase_sum = 0;
-  data->output_accumulator = 0;
   data->analyzed_frequency = 0;
   data->analyzed_magnitude = 0;
   data->synthesized_frequency = 0;
@@ -35,184 +66,322 @@ void free_pitch_data(struct pitch_data *data){
 }
 
 int make_pitch_data(uint32_t framesize, uint32_t oversampling, uint32_t samplerate, struct pitch_data *data){
-  // FIXME: determine which of these can be static and which actually
-  //        need to be retained for processing over contiguous buffers
-  float *mem = (float *)mixed_calloc(framesize
-                                     +framesize
-                                     +framesize*2
-                                     +framesize/2+1
-                                     +framesize/2+1
-                                     +framesize*2
-                                     +framesize
-                                     +framesize
-                                     +framesize
-                                     +framesize, sizeof(float));
+  // Everything that has to survive from one frame to the next lives in
+  // the FIFOs, the accumulator, and the two phase arrays. The rest is
+  // scratch space for a single frame, sized by the real spectrum.
+  uint32_t bins = framesize/2+1;
+  float *mem = (float *)mixed_calloc(framesize*4 + framesize*2 + bins*8, sizeof(float));
   if(!mem){
     mixed_err(MIXED_OUT_OF_MEMORY);
     free_pitch_data(data);
     return 0;
   }
-
   data->in_fifo = mem;
-  mem += (framesize); data->out_fifo = mem;
-  mem += (framesize); data->fft_workspace = mem;
-  mem += (framesize*2); data->last_phase = mem;
-  mem += (framesize/2+1); data->phase_sum = mem;
-  mem += (framesize/2+1); data->output_accumulator = mem;
-  mem += (framesize*2); data->analyzed_frequency = mem;
-  mem += (framesize); data->analyzed_magnitude = mem;
-  mem += (framesize); data->synthesized_frequency = mem;
-  mem += (framesize); data->synthesized_magnitude = mem;
+  mem += framesize; data->out_fifo = mem;
+  mem += framesize; data->window = mem;
+  mem += framesize; data->frame = mem;
+  mem += framesize; data->output_accumulator = mem;
+  mem += framesize*2; data->re = mem;
+  mem += bins; data->im = mem;
+  mem += bins; data->last_phase = mem;
+  mem += bins; data->phase_sum = mem;
+  mem += bins; data->analyzed_frequency = mem;
+  mem += bins; data->analyzed_magnitude = mem;
+  mem += bins; data->synthesized_frequency = mem;
+  mem += bins; data->synthesized_magnitude = mem;
+
+  if(!make_fft_real(framesize, &data->fft)){
+    free_pitch_data(data);
+    return 0;
+  }
+
+  for(uint32_t k=0; k<framesize; ++k){
+    data->window[k] = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
+  }
 
   data->framesize = framesize;
   data->oversampling = oversampling;
   data->samplerate = samplerate;
+  data->overlap = 0;
 
   return 1;
 }
 
-VECTORIZE void pitch_shift(float pitch, float *in, float *out, uint32_t samples, struct pitch_data *data){
+VECTORIZE static void pitch_window(const float *restrict in, const float *restrict window, float *restrict out, uint32_t samples){
+  for(uint32_t k=0; k<samples; ++k){
+    out[k] = in[k] * window[k];
+  }
+}
+
+// Computes the magnitude and true frequency of each bin from the phase
+// advance since the last frame.
+VECTORIZE static void pitch_analyze(struct pitch_data *data, uint32_t bins, float expected, float bin_frequency){
+  float *restrict re = data->re;
+  float *restrict im = data->im;
+  float *restrict last_phase = data->last_phase;
+  float *restrict magnitude = data->analyzed_magnitude;
+  float *restrict frequency = data->analyzed_frequency;
+  float deviation = data->oversampling * 0.159154943f;
+  for(uint32_t k=0; k<bins; ++k){
+    float real = re[k], imag = im[k];
+    float phase = pitch_atan2(imag, real);
+    float delta = pitch_wrap(phase - last_phase[k] - (float)k*expected);
+    last_phase[k] = phase;
+    magnitude[k] = 2.0f*sqrtf(real*real + imag*imag);
+    frequency[k] = ((float)k + delta*deviation) * bin_frequency;
+  }
+}
+
+// Advances the phase of each bin by its frequency and converts it back
+// into rectangular form.
+VECTORIZE static void pitch_synthesize(struct pitch_data *data, uint32_t bins, float expected, float bin_frequency){
+  float *restrict re = data->re;
+  float *restrict im = data->im;
+  float *restrict phase_sum = data->phase_sum;
+  float *restrict magnitude = data->synthesized_magnitude;
+  float *restrict frequency = data->synthesized_frequency;
+  float advance = 6.28318531f / (data->oversampling * bin_frequency);
+  for(uint32_t k=0; k<bins; ++k){
+    float delta = (frequency[k] - (float)k*bin_frequency) * advance + (float)k*expected;
+    // Keeping the sum wrapped preserves its precision over long runs.
+    float phase = pitch_wrap(phase_sum[k] + delta);
+    phase_sum[k] = phase;
+    float cosine = pitch_sin(pitch_wrap(phase + 1.57079637f));
+    re[k] = magnitude[k] * cosine;
+    im[k] = magnitude[k] * pitch_sin(phase);
+  }
+}
+
+VECTORIZE static void pitch_accumulate(float *restrict accumulator, const float *restrict frame, const float *restrict window, float gain, uint32_t samples){
+  for(uint32_t k=0; k<samples; ++k){
+    accumulator[k] += window[k] * frame[k] * gain;
+  }
+}
+
+void pitch_shift(float pitch, float *in, float *out, uint32_t samples, struct pitch_data *data){
   uint32_t framesize = data->framesize;
   uint32_t oversampling = data->oversampling;
   float *in_fifo = data->in_fifo;
   float *out_fifo = data->out_fifo;
-  float *fft_workspace = data->fft_workspace;
-  float *last_phase = data->last_phase;
-  float *phase_sum = data->phase_sum;
   float *output_accumulator = data->output_accumulator;
-  float *analyzed_frequency = data->analyzed_frequency;
-  float *analyzed_magnitude = data->analyzed_magnitude;
   float *synthesized_frequency = data->synthesized_frequency;
   float *synthesized_magnitude = data->synthesized_magnitude;
-  double magnitude, phase, tmp, window, real, imag;
-  long i, k, qpd, index;
-  
-  /* set up some handy variables */
-  long framesize2 = framesize/2;
-  long step = framesize/oversampling;
-  double bin_frequencies = (double)data->samplerate/(double)framesize;
-  double expected = 2.*M_PI*(double)step/(double)framesize;
-  long fifo_latency = framesize-step;
-  if (data->overlap == 0) data->overlap = fifo_latency;
-
-  /* main processing loop */
-  for (i = 0; i < samples; i++){
 
-    /* As long as we have not yet collected enough data just read in */
-    in_fifo[data->overlap] = in[i];
-    out[i] = out_fifo[data->overlap-fifo_latency];
-    data->overlap++;
-
-    /* now we have enough data for processing */
-    if (data->overlap >= framesize) {
-      data->overlap = fifo_latency;
+  uint32_t framesize2 = framesize/2;
+  uint32_t bins = framesize2+1;
+  uint32_t step = framesize/oversampling;
+  float bin_frequency = (float)data->samplerate/(float)framesize;
+  float expected = 2.*M_PI*(double)step/(double)framesize;
+  uint32_t fifo_latency = framesize-step;
+  if (data->overlap == 0) data->overlap = fifo_latency;
 
-      /* do windowing and re,im interleave */
-      for (k = 0; k < framesize;k++) {
-        window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        fft_workspace[2*k] = in_fifo[k] * window;
-        fft_workspace[2*k+1] = 0.;
+  for(uint32_t i=0; i<samples; ){
+    // Move as much as fits until the next frame in and out at once.
+    uint32_t run = MIN(samples-i, framesize-data->overlap);
+    memcpy(in_fifo+data->overlap, in+i, run*sizeof(float));
+    memcpy(out+i, out_fifo+data->overlap-fifo_latency, run*sizeof(float));
+    data->overlap += run;
+    i += run;
+    if(data->overlap < framesize) break;
+    data->overlap = fifo_latency;
+
+    pitch_window(in_fifo, data->window, data->frame, framesize);
+    fft_real_forward(data->frame, data->re, data->im, &data->fft);
+    pitch_analyze(data, bins, expected, bin_frequency);
+
+    // Scatter each bin to where its shifted frequency lands.
+    memset(synthesized_magnitude, 0, bins*sizeof(float));
+    memset(synthesized_frequency, 0, bins*sizeof(float));
+    for(uint32_t k=0; k<bins; ++k){
+      uint32_t index = k*pitch;
+      if(index <= framesize2){
+        synthesized_magnitude[index] += data->analyzed_magnitude[k];
+        synthesized_frequency[index] = data->analyzed_frequency[k] * pitch;
       }
+    }
 
-      /* ***************** ANALYSIS ******************* */
-      /* do transform */
-      spiral_fft_float(framesize, -1, fft_workspace, fft_workspace);
-
-      /* this is the analysis step */
-      for (k = 0; k <= framesize2; k++) {
-
-        /* de-interlace FFT buffer */
-        real = fft_workspace[2*k];
-        imag = fft_workspace[2*k+1];
-
-        /* compute magnitudeitude and phase */
-        magnitude = 2.*sqrt(real*real + imag*imag);
-        phase = atan2(imag,real);
-
-        /* compute phase difference */
-        tmp = phase - last_phase[k];
-        last_phase[k] = phase;
-
-        /* subtract expected phase difference */
-        tmp -= (double)k*expected;
-
-        /* map delta phase into +/- Pi interval */
-        qpd = tmp/M_PI;
-        if (qpd >= 0) qpd += qpd&1;
-        else qpd -= qpd&1;
-        tmp -= M_PI*(double)qpd;
-
-        /* get deviation from bin frequency from the +/- Pi interval */
-        tmp = oversampling*tmp/(2.*M_PI);
+    pitch_synthesize(data, bins, expected, bin_frequency);
+    // Only the real part of the outer bins contributes to a real signal.
+    data->im[0] = 0.0f;
+    data->im[framesize2] = 0.0f;
+    fft_real_inverse(data->re, data->im, data->frame, &data->fft);
+
+    // The real inverse restores the signal at unit scale, which leaves
+    // the doubled analysis magnitudes and the overlap to compensate.
+    pitch_accumulate(output_accumulator, data->frame, data->window, 2.0f/oversampling, framesize);
+    memcpy(out_fifo, output_accumulator, step*sizeof(float));
+    memmove(output_accumulator, output_accumulator+step, framesize*sizeof(float));
+    memmove(in_fifo, in_fifo+step, fifo_latency*sizeof(float));
+  }
+}
 
-        /* compute the k-th partials' true frequency */
-        tmp = (double)k*bin_frequencies + tmp*bin_frequencies;
+// A time-domain shifter after WSOLA. Grains of about 20ms are read from
+// the input history at the pitch's rate and overlapped by half with a
+// Hann window. Each grain starts a fixed delay behind the input, moved
+// by up to the search range to where the input best continues the
+// previous grain, which keeps the splices in phase. The delay is only
+// as long as a grain needs to read ahead at the pitch, so latency stays
+// around a grain rather than an FFT frame.
 
-        /* store magnitudeitude and true frequency in analysis arrays */
-        analyzed_magnitude[k] = magnitude;
-        analyzed_frequency[k] = tmp;
+static uint32_t wsola_delay(float pitch, struct wsola_data *data){
+  return data->search + data->length + (uint32_t)ceilf(data->grain * MAX(pitch - 1.0f, 0.0f)) + 2;
+}
 
-      }
+void free_wsola_data(struct wsola_data *data){
+  if(data->ring)
+    mixed_free(data->ring);
+  if(data->window)
+    mixed_free(data->window);
+  data->ring = 0;
+  data->window = 0;
+  data->reference = 0;
+  data->region = 0;
+  data->size = 0;
+}
 
-      /* ***************** PROCESSING ******************* */
-      /* this does the actual pitch shifting */
-      memset(synthesized_magnitude, 0, framesize*sizeof(float));
-      memset(synthesized_frequency, 0, framesize*sizeof(float));
-      for (k = 0; k <= framesize2; k++) { 
-        index = k*pitch;
-        if (index <= framesize2) { 
-          synthesized_magnitude[index] += analyzed_magnitude[k]; 
-          synthesized_frequency[index] = analyzed_frequency[k] * pitch; 
-        } 
+int wsola_fit(float pitch, struct wsola_data *data){
+  uint32_t delay = wsola_delay(pitch, data);
+  uint32_t needed = data->grain + delay + data->search + data->hop + 2;
+  if(data->size < needed){
+    uint32_t size = 1;
+    while(size < needed) size <<= 1;
+    float *ring = mixed_calloc(size, sizeof(float));
+    if(!ring){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(data->ring){
+      for(uint32_t i=1; i<=data->size; ++i){
+        ring[(uint64_t)(data->time-i) & (size-1)] = data->ring[(uint64_t)(data->time-i) & (data->size-1)];
       }
-			
-      /* ***************** SYNTHESIS ******************* */
-      /* this is the synthesis step */
-      for (k = 0; k <= framesize2; k++) {
-
-        /* get magnitudeitude and true frequency from synthesis arrays */
-        magnitude = synthesized_magnitude[k];
-        tmp = synthesized_frequency[k];
-
-        /* subtract bin mid frequency */
-        tmp -= (double)k*bin_frequencies;
-
-        /* get bin deviation from freq deviation */
-        tmp /= bin_frequencies;
-
-        /* take oversampling into account */
-        tmp = 2.*M_PI*tmp/oversampling;
-
-        /* add the overlap phase advance back in */
-        tmp += (double)k*expected;
-
-        /* accumulate delta phase to get bin phase */
-        phase_sum[k] += tmp;
-        phase = phase_sum[k];
+      mixed_free(data->ring);
+    }
+    data->ring = ring;
+    data->size = size;
+  }
+  data->delay = delay;
+  return 1;
+}
 
-        /* get real and imag part and re-interleave */
-        fft_workspace[2*k] = magnitude*cos(phase);
-        fft_workspace[2*k+1] = magnitude*sin(phase);
-      } 
+int make_wsola_data(float pitch, uint32_t samplerate, struct wsola_data *data){
+  uint32_t hop = MAX(8, (uint32_t)ceilf(0.01f * samplerate));
+  data->grain = hop*2;
+  data->hop = hop;
+  data->search = (hop/2) & ~3;
+  data->length = (hop/2) & ~3;
+  data->time = 0;
+  data->next = 0;
+  data->index[0] = data->index[1] = data->grain;
+  data->started = 0;
+  // The window, then the reference and search region at full rate,
+  // then both again at a quarter of the rate for the coarse search.
+  uint32_t region = 2*data->search + data->length;
+  data->window = mixed_calloc(data->grain + (data->length + region)*2, sizeof(float));
+  if(!data->window){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->reference = data->window + data->grain;
+  data->region = data->reference + data->length;
+  data->coarse_reference = data->region + region;
+  data->coarse_region = data->coarse_reference + data->length;
+  for(uint32_t k=0; k<data->grain; ++k){
+    data->window[k] = -.5*cos(2.*M_PI*(double)k/(double)data->grain)+.5;
+  }
+  if(!wsola_fit(pitch, data)){
+    free_wsola_data(data);
+    return 0;
+  }
+  return 1;
+}
 
-      /* zero negative frequencies */
-      for (k = framesize+2; k < 2*framesize; k++) fft_workspace[k] = 0.;
+VECTORIZE static float wsola_dot(const float *restrict a, const float *restrict b, uint32_t samples){
+  float sum = 0.0f;
+  for(uint32_t i=0; i<samples; ++i){
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
 
-      /* do inverse transform */
-      spiral_fft_float(framesize, +1, fft_workspace, fft_workspace);
+static void wsola_copy(int64_t from, float *out, uint32_t samples, uint32_t stride, struct wsola_data *data){
+  uint32_t mask = data->size - 1;
+  for(uint32_t i=0; i<samples; ++i){
+    out[i] = data->ring[(uint64_t)(from + i*stride) & mask];
+  }
+}
 
-      /* do windowing and add to output accumulator */ 
-      for(k=0; k < framesize; k++) {
-        window = -.5*cos(2.*M_PI*(double)k/(double)framesize)+.5;
-        output_accumulator[k] += 2.*window*fft_workspace[2*k]/(framesize2*oversampling);
+static void wsola_start_grain(float pitch, struct wsola_data *data){
+  uint32_t slot = data->next, previous = 1 - slot;
+  uint32_t search = data->search, length = data->length;
+  int64_t nominal = data->time - data->delay;
+  int64_t start = nominal;
+  if(data->started){
+    // Where the previous grain would have gone on reading.
+    int64_t continuation = (int64_t)floor(data->start[previous] + data->hop*pitch);
+    int64_t from = nominal - search;
+    uint32_t region = 2*search + length;
+    wsola_copy(continuation, data->coarse_reference, length/4, 4, data);
+    wsola_copy(from, data->coarse_region, region/4, 4, data);
+    uint32_t best = 0;
+    float best_score = -INFINITY;
+    for(uint32_t m=0; m<=2*search/4; ++m){
+      float score = wsola_dot(data->coarse_reference, data->coarse_region+m, length/4);
+      if(best_score < score){
+        best_score = score;
+        best = m*4;
+      }
+    }
+    wsola_copy(continuation, data->reference, length, 1, data);
+    wsola_copy(from, data->region, region, 1, data);
+    uint32_t lo = (3 < best)? best-3 : 0, hi = MIN(best+3, 2*search);
+    best_score = -INFINITY;
+    for(uint32_t o=lo; o<=hi; ++o){
+      float score = wsola_dot(data->reference, data->region+o, length);
+      if(best_score < score){
+        best_score = score;
+        best = o;
       }
-      for (k = 0; k < step; k++) out_fifo[k] = output_accumulator[k];
+    }
+    start = from + best;
+  }
+  data->start[slot] = (double)start;
+  data->index[slot] = 0;
+  data->next = previous;
+  data->started = 1;
+}
 
-      /* shift accumulator */
-      memmove(output_accumulator, output_accumulator+step, framesize*sizeof(float));
+static void wsola_render(float pitch, float *out, uint32_t samples, uint32_t slot, struct wsola_data *data){
+  uint32_t index = data->index[slot];
+  if(data->grain <= index) return;
+  uint32_t count = MIN(samples, data->grain - index);
+  uint32_t mask = data->size - 1;
+  const float *ring = data->ring, *window = data->window + index;
+  double position = data->start[slot] + index*(double)pitch;
+  for(uint32_t j=0; j<count; ++j){
+    double at = position + j*(double)pitch;
+    double whole = floor(at);
+    float fraction = (float)(at - whole);
+    uint64_t i = (uint64_t)(int64_t)whole;
+    float a = ring[i & mask], b = ring[(i+1) & mask];
+    out[j] += window[j] * (a + (b - a) * fraction);
+  }
+  data->index[slot] = index + count;
+}
 
-      /* move input FIFO */
-      for (k = 0; k < fifo_latency; k++) in_fifo[k] = in_fifo[k+step];
-    }
+void wsola_shift(float pitch, float *in, float *out, uint32_t samples, struct wsola_data *data){
+  uint32_t mask = data->size - 1;
+  for(uint32_t i=0; i<samples; ){
+    uint32_t phase = (uint32_t)(data->time % data->hop);
+    if(phase == 0) wsola_start_grain(pitch, data);
+    uint32_t run = MIN(samples-i, data->hop - phase);
+    uint32_t at = (uint32_t)((uint64_t)data->time & mask);
+    uint32_t first = MIN(run, data->size - at);
+    memcpy(data->ring+at, in+i, first*sizeof(float));
+    memcpy(data->ring, in+i+first, (run-first)*sizeof(float));
+    memset(out+i, 0, run*sizeof(float));
+    wsola_render(pitch, out+i, run, 0, data);
+    wsola_render(pitch, out+i, run, 1, data);
+    data->time += run;
+    i += run;
   }
 }
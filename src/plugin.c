@@ -11,21 +11,37 @@ struct plugin_vector{
   uint32_t size;
 };
 
+// Entries are handed out as mixed_segment_constructor handles and stay
+// where they are until they are deregistered.
 struct segment_entry{
   char *name;
+  uint32_t hash;
   uint32_t argc;
   struct mixed_segment_field_info *args;
   mixed_make_segment_function function;
+  const struct mixed_block_processor *processor;
 };
 
-struct segment_vector{
-  struct segment_entry **entries;
-  uint32_t count;
+// An open addressed hash table that is never changed in place. A
+// change builds a new table and publishes it atomically, so lookups
+// need no lock. As with the rcu vectors, old tables and removed
+// entries are only freed once no lookup is inside anymore.
+struct segment_table{
+  struct segment_table *next;
   uint32_t size;
+  uint32_t count;
+  struct segment_entry *slots[];
+};
+
+struct segment_registry{
+  struct segment_table *current;
+  struct segment_table *retired;
+  uint32_t readers;
+  uint32_t lock;
 };
 
 struct plugin_vector plugins = {0};
-struct segment_vector segments = {0};
+static struct segment_registry registry = {0};
 
 MIXED_EXPORT int mixed_load_plugin(char *file){
   struct plugin_entry *entry = 0;
@@ -40,12 +56,20 @@ MIXED_EXPORT int mixed_load_plugin(char *file){
   handle = open_library(file);
   if(!handle) goto cleanup;
   
-  mixed_make_plugin_function function;
-  *(void **)(&function) = load_symbol(handle, "mixed_make_plugin");
-  if(!function) goto cleanup;
+  // Block processor plugins leave the segment handling to us.
+  mixed_make_block_plugin_function block_function;
+  *(void **)(&block_function) = find_symbol(handle, "mixed_make_block_plugin");
+  if(block_function){
+    if(!block_function(mixed_register_block_processor))
+      goto cleanup;
+  }else{
+    mixed_make_plugin_function function;
+    *(void **)(&function) = load_symbol(handle, "mixed_make_plugin");
+    if(!function) goto cleanup;
 
-  if(!function(mixed_register_segment)){
-    goto cleanup;
+    if(!function(mixed_register_segment)){
+      goto cleanup;
+    }
   }
 
   entry->file = strdup(file);
@@ -88,7 +112,104 @@ MIXED_EXPORT int mixed_close_plugin(char *file){
   return 0;
 }
 
-MIXED_EXPORT int mixed_register_segment(char *name, uint32_t argc, struct mixed_segment_field_info *args, mixed_make_segment_function function){
+static uint32_t registry_hash(const char *name){
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for(; *name; ++name)
+    hash = (hash ^ (unsigned char)*name) * 16777619u;
+  return hash;
+}
+
+static struct segment_table *registry_enter(){
+  __atomic_add_fetch(&registry.readers, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&registry.current, __ATOMIC_SEQ_CST);
+}
+
+static void registry_leave(){
+  __atomic_sub_fetch(&registry.readers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void registry_lock(){
+  while(!atomic_cas(registry.lock, 0, 1));
+}
+
+static void registry_unlock(){
+  atomic_write(registry.lock, 0);
+}
+
+static struct segment_entry *registry_find(const char *name, struct segment_table *table){
+  if(!table) return 0;
+  uint32_t hash = registry_hash(name);
+  uint32_t mask = table->size-1;
+  // The table is never more than half full, so there always is a hole.
+  for(uint32_t i=hash&mask; table->slots[i]; i=(i+1)&mask){
+    struct segment_entry *entry = table->slots[i];
+    if(entry->hash == hash && strcmp(entry->name, name) == 0)
+      return entry;
+  }
+  return 0;
+}
+
+static void registry_insert(struct segment_entry *entry, struct segment_table *table){
+  uint32_t mask = table->size-1;
+  uint32_t i = entry->hash&mask;
+  while(table->slots[i]) i = (i+1)&mask;
+  table->slots[i] = entry;
+  table->count++;
+}
+
+// Builds a copy of the current table with entry added, or without
+// removed. Must be called with the lock held.
+static struct segment_table *registry_rebuild(struct segment_entry *entry, struct segment_entry *removed){
+  struct segment_table *old = registry.current;
+  uint32_t count = (old)? old->count : 0;
+  uint32_t size = 64;
+  while(size < 2*(count+1)) size *= 2;
+  struct segment_table *table = mixed_calloc(1, sizeof(struct segment_table) + size*sizeof(struct segment_entry *));
+  if(!table){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  table->size = size;
+  for(uint32_t i=0; old && i<old->size; ++i){
+    if(old->slots[i] && old->slots[i] != removed)
+      registry_insert(old->slots[i], table);
+  }
+  if(entry)
+    registry_insert(entry, table);
+  return table;
+}
+
+static void registry_reclaim(){
+  if(__atomic_load_n(&registry.readers, __ATOMIC_SEQ_CST) != 0) return;
+  struct segment_table *table = registry.retired;
+  registry.retired = 0;
+  while(table){
+    struct segment_table *next = table->next;
+    mixed_free(table);
+    table = next;
+  }
+}
+
+static void registry_publish(struct segment_table *table){
+  struct segment_table *old = registry.current;
+  __atomic_store_n(&registry.current, table, __ATOMIC_SEQ_CST);
+  if(old){
+    old->next = registry.retired;
+    registry.retired = old;
+  }
+  registry_reclaim();
+}
+
+static void free_segment_entry(struct segment_entry *entry){
+  if(entry->name)
+    mixed_free(entry->name);
+  if(entry->args)
+    mixed_free(entry->args);
+  mixed_free(entry);
+}
+
+static int register_entry(char *name, uint32_t argc, struct mixed_segment_field_info *args, mixed_make_segment_function function, const struct mixed_block_processor *processor){
   struct segment_entry *entry = 0;
 
   entry = mixed_calloc(1, sizeof(struct segment_entry));
@@ -98,84 +219,124 @@ MIXED_EXPORT int mixed_register_segment(char *name, uint32_t argc, struct mixed_
   }
 
   entry->args = mixed_calloc(argc, sizeof(struct mixed_segment_field_info));
-  if(!entry->args){
+  entry->name = strdup(name);
+  if(!entry->args || !entry->name){
     mixed_err(MIXED_OUT_OF_MEMORY);
     goto cleanup;
   }
-
-  for(uint32_t i=0; i<segments.count; ++i){
-    struct segment_entry *entry = segments.entries[i];
-    if(strcmp(entry->name, name) == 0){
-      mixed_err(MIXED_DUPLICATE_SEGMENT);
-      goto cleanup;
-    }
-  }
-  
-  entry->name = strdup(name);
+  entry->hash = registry_hash(name);
   entry->argc = argc;
   memcpy(entry->args, args, argc*sizeof(struct mixed_segment_field_info));
   entry->function = function;
-  if(!vector_add(entry, (struct vector *)&segments)){
+  entry->processor = processor;
+
+  registry_lock();
+  if(registry_find(name, registry.current)){
+    registry_unlock();
+    mixed_err(MIXED_DUPLICATE_SEGMENT);
     goto cleanup;
   }
-
+  struct segment_table *table = registry_rebuild(entry, 0);
+  if(!table){
+    registry_unlock();
+    goto cleanup;
+  }
+  registry_publish(table);
+  registry_unlock();
   return 1;
   
  cleanup:
-  if(entry){
-    if(entry->name)
-      mixed_free(entry->name);
-    if(entry->args)
-      mixed_free(entry->args);
-    mixed_free(entry);
-  }
+  if(entry)
+    free_segment_entry(entry);
   return 0;
 }
 
+MIXED_EXPORT int mixed_register_segment(char *name, uint32_t argc, struct mixed_segment_field_info *args, mixed_make_segment_function function){
+  return register_entry(name, argc, args, function, 0);
+}
+
+MIXED_EXPORT int mixed_register_block_processor(const struct mixed_block_processor *processor){
+  struct mixed_segment_field_info args[] = {
+    {.description = "samplerate", .type = MIXED_UINT32}};
+  if(processor->version != MIXED_BLOCK_PROCESSOR_VERSION){
+    mixed_err(MIXED_PLUGIN_VERSION_MISMATCH);
+    return 0;
+  }
+  // Segments of the processor are made directly by mixed_make_segment.
+  return register_entry(processor->name, 1, args, 0, processor);
+}
+
 MIXED_EXPORT int mixed_deregister_segment(char *name){
-  for(uint32_t i=0; i<segments.count; ++i){
-    struct segment_entry *entry = segments.entries[i];
-    if(strcmp(entry->name, name) == 0){
-      mixed_free(entry->name);
-      mixed_free(entry->args);
-      mixed_free(entry);
-      return vector_remove_pos(i, (struct vector *)&segments);
-    }
+  registry_lock();
+  struct segment_entry *entry = registry_find(name, registry.current);
+  if(!entry){
+    registry_unlock();
+    mixed_err(MIXED_BAD_SEGMENT);
+    return 0;
   }
-  mixed_err(MIXED_BAD_SEGMENT);
-  return 0;
+  struct segment_table *table = registry_rebuild(0, entry);
+  if(!table){
+    registry_unlock();
+    return 0;
+  }
+  registry_publish(table);
+  // Lookups that started before the change may still see the entry.
+  while(__atomic_load_n(&registry.readers, __ATOMIC_SEQ_CST) != 0);
+  registry_reclaim();
+  registry_unlock();
+  free_segment_entry(entry);
+  return 1;
 }
 
 MIXED_EXPORT int mixed_list_segments(uint32_t *count, char **names){
-  *count = segments.count;
+  struct segment_table *table = registry_enter();
+  *count = (table)? table->count : 0;
   if(names){
-    for(uint32_t i=0; i<segments.count; ++i){
-      names[i] = segments.entries[i]->name;
+    for(uint32_t i=0, j=0; table && i<table->size; ++i){
+      if(table->slots[i])
+        names[j++] = table->slots[i]->name;
     }
   }
+  registry_leave();
   return 1;
 }
 
+MIXED_EXPORT struct mixed_segment_constructor *mixed_find_segment(char *name){
+  struct segment_entry *entry = registry_find(name, registry_enter());
+  registry_leave();
+  if(!entry)
+    mixed_err(MIXED_BAD_SEGMENT);
+  return (struct mixed_segment_constructor *)entry;
+}
+
 MIXED_EXPORT int mixed_make_segment_info(char *name, uint32_t *argc, const struct mixed_segment_field_info **args){
-  for(uint32_t i=0; i<segments.count; ++i){
-    struct segment_entry *entry = segments.entries[i];
-    if(strcmp(entry->name, name) == 0){
-      *argc = entry->argc;
-      *args = entry->args;
-      return 1;
-    }
+  struct segment_entry *entry = registry_find(name, registry_enter());
+  if(entry){
+    *argc = entry->argc;
+    *args = entry->args;
   }
-  mixed_err(MIXED_BAD_SEGMENT);
-  return 0;
+  registry_leave();
+  if(!entry){
+    mixed_err(MIXED_BAD_SEGMENT);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_from(struct mixed_segment_constructor *constructor, void *args, struct mixed_segment *segment){
+  struct segment_entry *entry = (struct segment_entry *)constructor;
+  if(entry->processor)
+    return mixed_make_segment_block(entry->processor, ARG(uint32_t, 0), segment);
+  return entry->function(args, segment);
 }
 
 MIXED_EXPORT int mixed_make_segment(char *name, void *args, struct mixed_segment *segment){
-  for(uint32_t i=0; i<segments.count; ++i){
-    struct segment_entry *entry = segments.entries[i];
-    if(strcmp(entry->name, name) == 0){
-      return entry->function(args, segment);
-    }
-  }
-  mixed_err(MIXED_BAD_SEGMENT);
-  return 0;
+  struct segment_entry *entry = registry_find(name, registry_enter());
+  int result = 0;
+  if(entry)
+    result = mixed_make_segment_from((struct mixed_segment_constructor *)entry, args, segment);
+  else
+    mixed_err(MIXED_BAD_SEGMENT);
+  registry_leave();
+  return result;
 }
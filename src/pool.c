@@ -0,0 +1,75 @@
+#include "internal.h"
+
+// Each block starts with a pointer to the next block, padded so that
+// the elements after it stay aligned.
+#define POOL_HEADER 16
+
+static uint32_t pool_element_size(struct pool *pool){
+  uint32_t align = sizeof(void *);
+  uint32_t size = MAX(pool->element_size, align);
+  return (size + align - 1) & ~(align - 1);
+}
+
+int make_pool(uint32_t element_size, struct pool *pool){
+  pool->blocks = 0;
+  pool->free = 0;
+  pool->element_size = element_size;
+  pool->capacity = 0;
+  pool->used = 0;
+  return 1;
+}
+
+void free_pool(struct pool *pool){
+  void *block = pool->blocks;
+  while(block){
+    void *next = *(void **)block;
+    mixed_free(block);
+    block = next;
+  }
+  pool->blocks = 0;
+  pool->free = 0;
+  pool->capacity = 0;
+  pool->used = 0;
+}
+
+int pool_reserve(uint32_t count, struct pool *pool){
+  if(count <= pool->capacity) return 1;
+  uint32_t size = pool_element_size(pool);
+  uint32_t new = count - pool->capacity;
+  char *block = mixed_calloc(1, POOL_HEADER + (size_t)new*size);
+  if(!block){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  *(void **)block = pool->blocks;
+  pool->blocks = block;
+  // Thread the new elements onto the free list, back to front so
+  // that they are handed out in address order.
+  for(uint32_t i=new; 0<i; --i){
+    void *element = block + POOL_HEADER + (size_t)(i-1)*size;
+    *(void **)element = pool->free;
+    pool->free = element;
+  }
+  pool->capacity = count;
+  return 1;
+}
+
+void *pool_alloc(struct pool *pool){
+  if(!pool->free){
+    uint32_t grow = (pool->capacity)? pool->capacity : BASE_POOL_SIZE;
+    if(!pool_reserve(pool->capacity + grow, pool))
+      return 0;
+  }
+  void *element = pool->free;
+  pool->free = *(void **)element;
+  memset(element, 0, pool_element_size(pool));
+  pool->used++;
+  return element;
+}
+
+void pool_free(void *element, struct pool *pool){
+  if(!element) return;
+  *(void **)element = pool->free;
+  pool->free = element;
+  pool->used--;
+}
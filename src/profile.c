@@ -0,0 +1,240 @@
+#include "internal.h"
+
+// Durations are kept in a histogram with four buckets per power of
+// two, which places the percentiles within a quarter of their value.
+#define PROFILE_BUCKETS 256
+
+struct profile_entry{
+  struct mixed_segment *segment;
+  // The first input and output, for counting frames.
+  struct mixed_buffer *in;
+  struct mixed_buffer *out;
+  uint64_t calls;
+  uint64_t frames;
+  uint64_t short_mixes;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint32_t peak;
+  uint32_t histogram[PROFILE_BUCKETS];
+};
+
+// A fixed open addressed table keyed by the segment's address. Slots
+// are claimed with a compare and swap, so segments mixed on different
+// threads can enter themselves without a lock. Every entry is only
+// ever written by the thread that mixes its segment. The entry of a
+// freed segment is marked PROFILE_FREED rather than emptied, so that
+// it does not cut short the search for the entries behind it, and is
+// claimed again by the next segment that comes past it.
+#define PROFILE_FREED ((struct mixed_segment *)1)
+
+struct profile_table{
+  uint32_t size;
+  struct profile_entry entries[];
+};
+
+struct profile_table *profile_table = 0;
+
+static inline uint32_t profile_bucket(uint64_t ns){
+  if(ns < 4) return (uint32_t)ns;
+  uint32_t msb = 63 - __builtin_clzll(ns);
+  return 4*(msb-1) + ((ns >> (msb-2)) & 3);
+}
+
+static inline uint64_t profile_bucket_limit(uint32_t bucket){
+  if(bucket < 4) return bucket;
+  uint32_t msb = bucket/4 + 1;
+  return ((uint64_t)(4 + bucket%4) << (msb-2)) + ((uint64_t)1 << (msb-2)) - 1;
+}
+
+static struct profile_entry *profile_entry(struct mixed_segment *segment, struct profile_table *table){
+  uint32_t mask = table->size-1;
+  uint32_t start = (uint32_t)(((uintptr_t)segment >> 4) * 2654435761u) & mask;
+  for(;;){
+    // The segment may sit behind a freed entry, so look all the way to
+    // an empty one before claiming the first free one on the way.
+    struct profile_entry *free = 0;
+    struct mixed_segment *free_owner = 0;
+    for(uint32_t n=0, i=start; n<table->size; ++n, i=(i+1)&mask){
+      struct profile_entry *entry = &table->entries[i];
+      struct mixed_segment *owner = atomic_read(entry->segment);
+      if(owner == segment) return entry;
+      if(owner == 0 || owner == PROFILE_FREED){
+        if(!free){
+          free = entry;
+          free_owner = owner;
+        }
+        if(owner == 0) break;
+      }
+    }
+    if(!free) return 0;
+    if(atomic_cas(free->segment, free_owner, segment)){
+      free->min = UINT64_MAX;
+      return free;
+    }
+  }
+}
+
+static struct profile_entry *profile_find(struct mixed_segment *segment, struct profile_table *table){
+  uint32_t mask = table->size-1;
+  uint32_t i = (uint32_t)(((uintptr_t)segment >> 4) * 2654435761u) & mask;
+  for(uint32_t n=0; n<table->size; ++n, i=(i+1)&mask){
+    struct mixed_segment *owner = atomic_read(table->entries[i].segment);
+    if(owner == segment) return &table->entries[i];
+    if(owner == 0) break;
+  }
+  return 0;
+}
+
+int profile_mix(struct mixed_segment *segment){
+  struct profile_table *table = __atomic_load_n(&profile_table, __ATOMIC_ACQUIRE);
+  struct profile_entry *entry = (table)? profile_entry(segment, table) : 0;
+  if(!entry) return segment->mix(segment);
+
+  struct mixed_buffer *in = entry->in, *out = entry->out;
+  uint32_t before = (out && out != in)? buffer_pending(out) : (in)? buffer_pending(in) : 0;
+  uint64_t start = mixed_clock();
+  int result = segment->mix(segment);
+  uint64_t elapsed = mixed_clock() - start;
+
+  uint32_t frames = 0;
+  if(out && out != in){
+    uint32_t after = buffer_pending(out);
+    frames = (before < after)? after - before : 0;
+  }else if(in == out && in){
+    // Working in place leaves everything where it was.
+    frames = before;
+  }else if(in){
+    uint32_t after = buffer_pending(in);
+    frames = (after < before)? before - after : 0;
+  }
+  entry->calls++;
+  entry->frames += frames;
+  if(frames < entry->peak) entry->short_mixes++;
+  else entry->peak = frames;
+  entry->total += elapsed;
+  if(elapsed < entry->min) entry->min = elapsed;
+  if(entry->max < elapsed) entry->max = elapsed;
+  entry->histogram[profile_bucket(elapsed)]++;
+  return result;
+}
+
+void profile_connect(int direction, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct profile_table *table = __atomic_load_n(&profile_table, __ATOMIC_ACQUIRE);
+  if(!table || location != 0) return;
+  struct profile_entry *entry = profile_entry(segment, table);
+  if(!entry) return;
+  if(direction == MIXED_IN) entry->in = (struct mixed_buffer *)buffer;
+  else entry->out = (struct mixed_buffer *)buffer;
+}
+
+void profile_forget(struct mixed_segment *segment){
+  struct profile_table *table = __atomic_load_n(&profile_table, __ATOMIC_ACQUIRE);
+  struct profile_entry *entry = (table)? profile_find(segment, table) : 0;
+  if(!entry) return;
+  entry->in = entry->out = 0;
+  entry->calls = entry->frames = entry->short_mixes = 0;
+  entry->total = entry->max = 0;
+  entry->min = UINT64_MAX;
+  entry->peak = 0;
+  memset(entry->histogram, 0, sizeof(entry->histogram));
+  atomic_write(entry->segment, PROFILE_FREED);
+}
+
+static void profile_fill(struct mixed_segment_profile *profile, struct profile_entry *entry){
+  profile->calls = entry->calls;
+  profile->frames = entry->frames;
+  profile->short_mixes = entry->short_mixes;
+  profile->total_ns = entry->total;
+  profile->min_ns = (entry->calls)? entry->min : 0;
+  profile->max_ns = entry->max;
+  // The smallest duration that at least 99% of the mixes stay within.
+  uint64_t rank = entry->calls - entry->calls/100, seen = 0;
+  profile->p99_ns = 0;
+  for(uint32_t i=0; i<PROFILE_BUCKETS && seen < rank; ++i){
+    seen += entry->histogram[i];
+    profile->p99_ns = MIN(profile_bucket_limit(i), entry->max);
+  }
+}
+
+int profile_get(struct mixed_segment_profile *profile, struct mixed_segment *segment){
+  struct profile_table *table = __atomic_load_n(&profile_table, __ATOMIC_ACQUIRE);
+  struct profile_entry *entry = (table)? profile_find(segment, table) : 0;
+  if(!entry){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  profile_fill(profile, entry);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_profile_start(uint32_t segments){
+  mixed_err(MIXED_NO_ERROR);
+  if(profile_table){
+    mixed_err(MIXED_SEGMENT_ALREADY_STARTED);
+    return 0;
+  }
+  uint32_t size = 16;
+  while(size < 2*segments) size *= 2;
+  struct profile_table *table = mixed_calloc(1, sizeof(struct profile_table) + size*sizeof(struct profile_entry));
+  if(!table){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  table->size = size;
+  __atomic_store_n(&profile_table, table, __ATOMIC_RELEASE);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_profile_end(){
+  mixed_err(MIXED_NO_ERROR);
+  struct profile_table *table = profile_table;
+  if(!table){
+    mixed_err(MIXED_SEGMENT_ALREADY_ENDED);
+    return 0;
+  }
+  __atomic_store_n(&profile_table, 0, __ATOMIC_RELEASE);
+  mixed_free(table);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_profile_reset(){
+  struct profile_table *table = profile_table;
+  mixed_err(MIXED_NO_ERROR);
+  if(!table){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  for(uint32_t i=0; i<table->size; ++i){
+    struct profile_entry *entry = &table->entries[i];
+    if(!entry->segment || entry->segment == PROFILE_FREED) continue;
+    entry->calls = entry->frames = entry->short_mixes = 0;
+    entry->total = entry->max = 0;
+    entry->min = UINT64_MAX;
+    entry->peak = 0;
+    memset(entry->histogram, 0, sizeof(entry->histogram));
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_profile_dump(uint32_t *count, struct mixed_segment **segments, struct mixed_segment_profile *profiles){
+  struct profile_table *table = profile_table;
+  mixed_err(MIXED_NO_ERROR);
+  if(!table){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  uint32_t found = 0;
+  for(uint32_t i=0; i<table->size; ++i){
+    struct profile_entry *entry = &table->entries[i];
+    if(!entry->segment || entry->segment == PROFILE_FREED) continue;
+    if(segments || profiles){
+      if(*count <= found) break;
+      if(segments) segments[found] = entry->segment;
+      if(profiles) profile_fill(&profiles[found], entry);
+    }
+    ++found;
+  }
+  *count = found;
+  return 1;
+}
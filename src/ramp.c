@@ -0,0 +1,71 @@
+#include "internal.h"
+
+// Gains below this are treated as silence by exponential ramps.
+#define RAMP_SILENCE 0.0001f
+// Exponential ramps are handed out as lines this many samples long.
+#define RAMP_SPAN 32
+
+extern inline float ramp_next(struct ramp *ramp);
+
+void ramp_init(float value, struct ramp *ramp){
+  ramp->value = value;
+  ramp->target = value;
+  ramp->step = 0.0f;
+  ramp->remaining = 0;
+  ramp->duration = DEFAULT_RAMP_DURATION;
+  ramp->type = MIXED_LINEAR_RAMP;
+  ramp->multiply = 0;
+}
+
+void ramp_to(float target, struct ramp *ramp){
+  ramp->target = target;
+  if(ramp->duration == 0 || ramp->value == target){
+    ramp->value = target;
+    ramp->remaining = 0;
+    return;
+  }
+  ramp->remaining = ramp->duration;
+  if(ramp->type == MIXED_EXPONENTIAL_RAMP && 0.0f <= ramp->value && 0.0f <= target){
+    float from = MAX(ramp->value, RAMP_SILENCE);
+    float to = MAX(target, RAMP_SILENCE);
+    ramp->value = from;
+    ramp->multiply = 1;
+    ramp->step = powf(to / from, 1.0f / ramp->duration);
+  }else{
+    // Exponential ramps cannot cross zero, fall back to linear.
+    ramp->multiply = 0;
+    ramp->step = (target - ramp->value) / ramp->duration;
+  }
+}
+
+void ramp_skip(uint32_t samples, struct ramp *ramp){
+  // Step one by one so that skipping agrees exactly with ramp_next.
+  uint32_t count = MIN(samples, ramp->remaining);
+  for(uint32_t i=0; i<count; ++i)
+    ramp_next(ramp);
+}
+
+uint32_t ramp_span(uint32_t samples, struct ramp *ramp){
+  if(ramp->remaining == 0) return samples;
+  if(ramp->multiply) return MIN(samples, MIN(ramp->remaining, RAMP_SPAN));
+  return MIN(samples, ramp->remaining);
+}
+
+void ramp_take(uint32_t samples, float *start, float *step, struct ramp *ramp){
+  *start = ramp->value;
+  if(ramp->remaining == 0 || samples == 0){
+    *step = 0.0f;
+    return;
+  }
+  float end;
+  if(samples == ramp->remaining){
+    end = ramp->target;
+  }else if(ramp->multiply){
+    end = ramp->value * powf(ramp->step, samples);
+  }else{
+    end = ramp->value + ramp->step * samples;
+  }
+  *step = (end - ramp->value) / samples;
+  ramp->value = end;
+  ramp->remaining -= samples;
+}
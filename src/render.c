@@ -0,0 +1,115 @@
+#include "internal.h"
+
+// Mixes until frames frames past the first skip ones have been moved
+// from the pack into out, or until a mix produces nothing.
+static int render(uint64_t skip, uint64_t *frames, char *out, struct mixed_pack *pack, struct mixed_segment *segment){
+  uint32_t framesize = pack->channels * mixed_samplesize(pack->encoding);
+  uint64_t done = 0, total = *frames;
+  // The output is interleaved, so we cannot copy from planes.
+  if(pack->flags & MIXED_PLANAR){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  if(!mixed_segment_start(segment)) return 0;
+  while(done < total){
+    if(!mixed_segment_mix(segment)){
+      mixed_segment_end(segment);
+      return 0;
+    }
+    if(mixed_pack_available_read(pack) < framesize) break;
+    while(done < total){
+      char *data;
+      uint32_t bytes = UINT32_MAX;
+      mixed_pack_request_read((void **)&data, &bytes, pack);
+      uint32_t available = bytes / framesize;
+      if(available == 0) break;
+      uint32_t discard = (uint32_t)MIN(available, skip);
+      uint32_t copy = (uint32_t)MIN(available - discard, total - done);
+      memcpy(out + done*framesize, data + discard*framesize, copy*framesize);
+      mixed_pack_finish_read((discard + copy)*framesize, pack);
+      skip -= discard;
+      done += copy;
+    }
+  }
+  *frames = done;
+  return mixed_segment_end(segment);
+}
+
+MIXED_EXPORT int mixed_render(uint64_t *frames, void *out, struct mixed_pack *pack, struct mixed_segment *segment){
+  mixed_err(MIXED_NO_ERROR);
+  return render(0, frames, out, pack, segment);
+}
+
+struct render_job{
+  struct mixed_render_pipeline *pipeline;
+  char *out;
+  uint64_t frames;
+  uint64_t *rendered;
+  uint32_t chunk;
+  uint32_t overlap;
+  int error;
+};
+
+static int render_chunk(void *arg, uint32_t index){
+  struct render_job *job = (struct render_job *)arg;
+  struct mixed_segment *segment = 0;
+  struct mixed_pack *pack = 0;
+  uint64_t start = (uint64_t)index * job->chunk;
+  uint64_t lead = MIN(start, job->overlap);
+  uint64_t frames = MIN(job->chunk, job->frames - start);
+  int result = 0;
+  if(job->pipeline->make(start - lead, &segment, &pack, job->pipeline->user)){
+    uint32_t framesize = pack->channels * mixed_samplesize(pack->encoding);
+    result = render(lead, &frames, job->out + start*framesize, pack, segment);
+    job->pipeline->free(segment, job->pipeline->user);
+  }
+  // Errors are per thread, so we carry the first one back to the caller.
+  if(!result) atomic_cas(job->error, 0, mixed_error());
+  job->rendered[index] = frames;
+  return result;
+}
+
+MIXED_EXPORT int mixed_render_parallel(uint64_t *frames, uint32_t chunk, uint32_t overlap, uint32_t threads, void *out, struct mixed_render_pipeline *pipeline){
+  mixed_err(MIXED_NO_ERROR);
+  if(chunk == 0 || threads == 0 || !pipeline->make || !pipeline->free){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint64_t chunks = (*frames + chunk - 1) / chunk;
+  if(UINT32_MAX < chunks){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  if(chunks == 0) return 1;
+
+  struct render_job job = {pipeline, out, *frames, 0, chunk, overlap, 0};
+  job.rendered = mixed_calloc(chunks, sizeof(uint64_t));
+  if(!job.rendered){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  // The calling thread takes part in the work, so we need one less.
+  struct thread_pool *pool = 0;
+  if(1 < threads && 1 < chunks){
+    pool = make_thread_pool(MIN(threads, chunks) - 1);
+    if(!pool){
+      mixed_free(job.rendered);
+      return 0;
+    }
+  }
+  int result = thread_pool_run(pool, (uint32_t)chunks, render_chunk, &job);
+  free_thread_pool(pool);
+  if(result){
+    // The output ends with the first chunk that came up short.
+    for(uint32_t i=0; i<chunks; ++i){
+      if(job.rendered[i] < MIN(chunk, *frames - (uint64_t)i*chunk)){
+        *frames = (uint64_t)i*chunk + job.rendered[i];
+        break;
+      }
+    }
+  }else{
+    mixed_err(job.error? job.error : MIXED_THREAD_FAILED);
+  }
+  mixed_free(job.rendered);
+  return result;
+}
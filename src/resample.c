@@ -0,0 +1,244 @@
+#include "internal.h"
+
+// The position is counted from the last sample of the previous call,
+// so that the first interpolation of a call can still reach back to it.
+
+uint32_t resample_frames(float pitch, float phase, uint32_t available){
+  if(available == 0) return 0;
+  uint32_t frames = (uint32_t)((available - phase) / pitch);
+  // Make sure rounding in the division never lets us read past the end.
+  while(0 < frames && available < phase + frames*pitch) --frames;
+  return frames;
+}
+
+uint32_t resample_linear(float pitch, float *in, float *out, uint32_t samples, struct resample_data *state){
+  float phase = state->phase;
+  float last = state->last;
+  for(uint32_t i=0; i<samples; ++i){
+    float position = phase + i*pitch;
+    uint32_t k = (uint32_t)position;
+    float t = position - k;
+    float a = (k == 0)? last : in[k-1];
+    out[i] = a + (in[k] - a) * t;
+  }
+  float end = phase + samples*pitch;
+  uint32_t used = (uint32_t)end;
+  state->phase = end - used;
+  if(0 < used) state->last = in[used-1];
+  return used;
+}
+
+// The polyphase resampler evaluates a Kaiser windowed sinc at the
+// fractional position of every output sample. The kernel is tabulated
+// for a set of phases ahead of time, so that an output sample is a
+// single dot product of the input history with one row of the bank.
+// A ratio that reduces to a fraction out/in with a small numerator has
+// exactly that many phases and steps through them in integers. Any
+// other ratio uses a fixed number of phases and blends the two rows
+// around the position.
+
+// Zero crossings of the kernel on either side at a ratio of one.
+#define POLYPHASE_TAPS 64
+#define POLYPHASE_MAX_TAPS 1024
+#define POLYPHASE_PHASES 256
+#define POLYPHASE_CHUNK 512
+#define POLYPHASE_BETA 8.6
+// Where the cutoff sits relative to the lower of the two nyquists.
+#define POLYPHASE_CUTOFF 0.91
+
+static double bessel_i0(double x){
+  double sum = 1.0, term = 1.0;
+  for(int k=1; k<32; ++k){
+    term *= (x*x) / (4.0*k*k);
+    sum += term;
+  }
+  return sum;
+}
+
+static int polyphase_rational(double ratio, uint32_t *up, uint32_t *down){
+  for(uint32_t m=1; m<=POLYPHASE_PHASES*2; ++m){
+    double l = round(ratio*m);
+    if(1.0 <= l && l <= POLYPHASE_PHASES && fabs(l/m - ratio) < 1e-9){
+      *up = (uint32_t)l;
+      *down = m;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void polyphase_fill_bank(struct polyphase *state){
+  uint32_t taps = state->taps, half = taps/2;
+  double cutoff = POLYPHASE_CUTOFF * MIN(1.0, state->ratio);
+  double norm = 1.0 / bessel_i0(POLYPHASE_BETA);
+  for(uint32_t p=0; p<state->rows; ++p){
+    float *row = state->bank + p*taps;
+    for(uint32_t k=0; k<taps; ++k){
+      double x = (double)p/state->phases + half - 1 - k;
+      double u = x / half;
+      double window = (u*u < 1.0)? bessel_i0(POLYPHASE_BETA*sqrt(1.0-u*u))*norm : 0.0;
+      double sinc = (x == 0.0)? 1.0 : sin(M_PI*cutoff*x) / (M_PI*cutoff*x);
+      row[k] = (float)(cutoff * sinc * window);
+    }
+  }
+}
+
+int make_polyphase(double ratio, uint32_t channels, struct polyphase *state){
+  uint32_t up = 0, down = 0;
+  char rational = polyphase_rational(ratio, &up, &down);
+  uint32_t phases = rational? up : POLYPHASE_PHASES;
+  uint32_t rows = rational? up : POLYPHASE_PHASES+1;
+  // The kernel widens with the ratio when it has to cut off below the
+  // input's nyquist, in whole vectors of eight.
+  double width = POLYPHASE_TAPS / MIN(1.0, ratio);
+  uint32_t taps = MIN(POLYPHASE_MAX_TAPS, ((uint32_t)ceil(width) + 7) & ~7u);
+
+  float *bank = state->bank;
+  if(state->rows*state->taps < rows*taps){
+    bank = crealloc(state->bank, state->rows*state->taps, rows*taps, sizeof(float));
+    if(!bank){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    state->bank = bank;
+  }
+  float *history = state->history;
+  if(state->channels != channels || state->taps != taps || !history){
+    history = mixed_calloc(channels*(taps+POLYPHASE_CHUNK), sizeof(float));
+    if(!history){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(state->history) mixed_free(state->history);
+    state->history = history;
+  }
+
+  state->ratio = ratio;
+  state->rational = rational;
+  state->up = up;
+  state->down = down;
+  state->increment = 1.0 / ratio;
+  state->phases = phases;
+  state->rows = rows;
+  state->taps = taps;
+  state->channels = channels;
+  polyphase_fill_bank(state);
+  polyphase_reset(state);
+  return 1;
+}
+
+void free_polyphase(struct polyphase *state){
+  if(state->bank) mixed_free(state->bank);
+  if(state->history) mixed_free(state->history);
+  *state = (struct polyphase){0};
+}
+
+// The history starts with half a kernel of silence, so that the first
+// output sample is centred on the first input sample.
+void polyphase_reset(struct polyphase *state){
+  memset(state->history, 0, state->channels*(state->taps+POLYPHASE_CHUNK)*sizeof(float));
+  state->filled = state->taps/2 - 1;
+  state->start = 0;
+  state->phase = 0;
+  state->fraction = 0.0;
+}
+
+// Eight running sums keep the reduction in vector lanes without
+// having to reassociate the additions.
+VECTORIZE static inline float polyphase_dot(const float *restrict a, const float *restrict b, uint32_t taps){
+  float sum[8] = {0};
+  for(uint32_t i=0; i<taps; i+=8, a+=8, b+=8){
+    for(uint32_t j=0; j<8; ++j){
+      sum[j] += a[j] * b[j];
+    }
+  }
+  return ((sum[0]+sum[1])+(sum[2]+sum[3]))+((sum[4]+sum[5])+(sum[6]+sum[7]));
+}
+
+VECTORIZE static inline float polyphase_dot2(const float *restrict a, const float *restrict b, const float *restrict c, float t, uint32_t taps){
+  float sum[8] = {0};
+  for(uint32_t i=0; i<taps; i+=8, a+=8, b+=8, c+=8){
+    for(uint32_t j=0; j<8; ++j){
+      sum[j] += a[j] * (b[j] + t*(c[j]-b[j]));
+    }
+  }
+  return ((sum[0]+sum[1])+(sum[2]+sum[3]))+((sum[4]+sum[5])+(sum[6]+sum[7]));
+}
+
+// Produces output while the history covers a whole kernel, returning
+// how many samples were made.
+static uint32_t polyphase_run(float **out, uint32_t made, uint32_t frames, struct polyphase *state){
+  uint32_t taps = state->taps, stride = taps+POLYPHASE_CHUNK;
+  uint32_t start = state->start, filled = state->filled;
+  if(state->rational){
+    uint32_t phase = state->phase, up = state->up;
+    uint32_t skip = state->down / up, rest = state->down % up;
+    while(made < frames && start + taps <= filled){
+      const float *row = state->bank + phase*taps;
+      for(uint32_t c=0; c<state->channels; ++c)
+        out[c][made] = polyphase_dot(state->history + c*stride + start, row, taps);
+      ++made;
+      start += skip;
+      phase += rest;
+      if(up <= phase){
+        phase -= up;
+        ++start;
+      }
+    }
+    state->phase = phase;
+  }else{
+    double fraction = state->fraction, increment = state->increment;
+    while(made < frames && start + taps <= filled){
+      // In single precision a fraction just short of one can round up
+      // to the last row, which has no row after it to blend with.
+      double position = fraction * state->phases;
+      uint32_t p = MIN((uint32_t)position, state->phases-1);
+      float t = (float)MIN(1.0, position-p);
+      const float *row = state->bank + p*taps;
+      for(uint32_t c=0; c<state->channels; ++c)
+        out[c][made] = polyphase_dot2(state->history + c*stride + start, row, row+taps, t, taps);
+      ++made;
+      fraction += increment;
+      uint32_t whole = (uint32_t)fraction;
+      start += whole;
+      fraction -= whole;
+    }
+    state->fraction = fraction;
+  }
+  state->start = start;
+  return made;
+}
+
+void polyphase_process(float **in, uint32_t *in_frames, float **out, uint32_t *out_frames, struct polyphase *state){
+  uint32_t taps = state->taps, stride = taps+POLYPHASE_CHUNK;
+  uint32_t used = 0, made = 0;
+  for(;;){
+    made = polyphase_run(out, made, *out_frames, state);
+    if(made == *out_frames) break;
+    // Drop what lies before the kernel, and any input it skipped past.
+    uint32_t drop = MIN(state->start, state->filled);
+    if(0 < drop){
+      uint32_t keep = state->filled - drop;
+      for(uint32_t c=0; c<state->channels; ++c){
+        float *history = state->history + c*stride;
+        memmove(history, history + drop, keep*sizeof(float));
+      }
+      state->filled = keep;
+      state->start -= drop;
+    }
+    if(0 < state->start){
+      uint32_t skip = MIN(state->start, *in_frames - used);
+      used += skip;
+      state->start -= skip;
+      if(0 < state->start) break;
+    }
+    uint32_t count = MIN(stride - state->filled, *in_frames - used);
+    if(count == 0) break;
+    for(uint32_t c=0; c<state->channels; ++c)
+      memcpy(state->history + c*stride + state->filled, in[c] + used, count*sizeof(float));
+    state->filled += count;
+    used += count;
+  }
+  *in_frames = used;
+  *out_frames = made;
+}
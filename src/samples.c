@@ -0,0 +1,307 @@
+#include "internal.h"
+
+// Resamplers may hand out a few more frames than the ratio predicts.
+#define SAMPLE_SLACK 64
+
+struct sample_bank_data{
+  // Sorted by id.
+  struct sample_data **samples;
+  uint32_t count;
+  uint32_t capacity;
+  // Counts up on every use, to find the least recently used sample.
+  uint64_t clock;
+};
+
+void sample_retain(struct sample_data *sample){
+  __atomic_add_fetch(&sample->references, 1, __ATOMIC_SEQ_CST);
+}
+
+void sample_release(struct sample_data *sample){
+  if(!sample) return;
+  if(__atomic_sub_fetch(&sample->references, 1, __ATOMIC_SEQ_CST) == 0){
+    if(sample->data) mixed_free(sample->data);
+    mixed_free(sample);
+  }
+}
+
+static inline uint64_t sample_bytes(struct sample_data *sample){
+  return (uint64_t)sample->channels * sample->frames * sizeof(float);
+}
+
+// Returns whether the id is in the bank. Index is where it is, or
+// where it would have to be inserted.
+static int sample_bank_find(uint32_t id, uint32_t *index, struct sample_bank_data *data){
+  uint32_t lo = 0, hi = data->count;
+  while(lo < hi){
+    uint32_t mid = lo+(hi-lo)/2;
+    if(data->samples[mid]->id < id) lo = mid+1;
+    else hi = mid;
+  }
+  *index = lo;
+  return lo < data->count && data->samples[lo]->id == id;
+}
+
+static void sample_bank_remove_at(uint32_t index, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  struct sample_data *sample = data->samples[index];
+  bank->size -= sample_bytes(sample);
+  memmove(data->samples+index, data->samples+index+1, (data->count-index-1)*sizeof(struct sample_data *));
+  data->count--;
+  bank->count = data->count;
+  sample_release(sample);
+}
+
+// Evicts the least recently used samples that nothing but the bank
+// holds on to, until the bytes fit into the budget.
+static int sample_bank_evict(uint64_t bytes, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  if(bank->budget == 0) return 1;
+  while(bank->budget < bank->size + bytes){
+    uint32_t oldest = UINT32_MAX;
+    for(uint32_t i=0; i<data->count; ++i){
+      struct sample_data *sample = data->samples[i];
+      if(atomic_read(sample->references) != 1) continue;
+      if(oldest == UINT32_MAX || sample->last_used < data->samples[oldest]->last_used)
+        oldest = i;
+    }
+    if(oldest == UINT32_MAX) return 0;
+    sample_bank_remove_at(oldest, bank);
+  }
+  return 1;
+}
+
+// Runs an unpacker over the pack straight into the planes, which the
+// output buffers reference virtually. Returns the frames written.
+static int sample_unpack(struct mixed_pack *pack, uint32_t samplerate, float *planes, uint32_t capacity, uint32_t *frames){
+  struct mixed_segment unpacker = {0};
+  struct mixed_buffer buffers[12] = {0};
+  int result = 0;
+  if(!mixed_make_segment_unpacker(pack, samplerate, &unpacker))
+    return 0;
+  for(channel_t c=0; c<pack->channels; ++c){
+    buffers[c]._data = planes + c*capacity;
+    buffers[c].size = capacity;
+    buffers[c].is_virtual = 1;
+    mixed_segment_set_out(MIXED_BUFFER, c, &buffers[c], &unpacker);
+  }
+  if(!mixed_segment_start(&unpacker))
+    goto cleanup;
+  // The pack may wrap, so keep going for as long as anything moves.
+  uint32_t written;
+  do{
+    written = buffers[0].write;
+    if(!mixed_segment_mix(&unpacker)){
+      mixed_segment_end(&unpacker);
+      goto cleanup;
+    }
+  }while(written != buffers[0].write && buffers[0].write < capacity);
+  mixed_segment_end(&unpacker);
+  *frames = buffers[0].write;
+  result = 1;
+
+ cleanup: {
+    int error = mixed_error();
+    mixed_free_segment(&unpacker);
+    mixed_err(error);
+  }
+  return result;
+}
+
+// Decodes at the pack's own rate first. Resampling then works on a
+// copy padded with silence, so that the resampler gives up the tail
+// it holds back, and is cut to the length the ratio calls for.
+static struct sample_data *sample_decode(struct mixed_pack *pack, uint32_t samplerate){
+  channel_t channels = pack->channels;
+  uint32_t framesize = pack_frame_bytes(pack);
+  float *planes = 0;
+  if(channels == 0 || 12 < channels || framesize == 0 || pack->samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint64_t frames = mixed_pack_available_read(pack) / framesize;
+  if(frames == 0){
+    mixed_err(MIXED_BUFFER_EMPTY);
+    return 0;
+  }
+  uint64_t padded = frames + SAMPLE_SLACK;
+  uint64_t capacity = padded * samplerate / pack->samplerate + SAMPLE_SLACK;
+  if(UINT32_MAX / (channels*sizeof(float)) < MAX(padded, capacity)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct sample_data *sample = mixed_calloc(1, sizeof(struct sample_data));
+  if(!sample){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  sample->references = 1;
+  sample->channels = channels;
+
+  uint32_t decoded;
+  if(pack->samplerate == samplerate){
+    capacity = padded;
+    sample->data = mixed_calloc(channels*capacity, sizeof(float));
+    if(!sample->data){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      goto cleanup;
+    }
+    if(!sample_unpack(pack, samplerate, sample->data, capacity, &decoded))
+      goto cleanup;
+    sample->frames = decoded;
+  }else{
+    planes = mixed_calloc(channels*padded, sizeof(float));
+    sample->data = mixed_calloc(channels*capacity, sizeof(float));
+    if(!planes || !sample->data){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      goto cleanup;
+    }
+    if(!sample_unpack(pack, pack->samplerate, planes, padded, &decoded))
+      goto cleanup;
+    // The silence after the decoded frames is already there from calloc.
+    if(decoded < padded){
+      for(channel_t c=1; c<channels; ++c){
+        memmove(planes + c*(decoded+SAMPLE_SLACK), planes + c*padded, decoded*sizeof(float));
+        memset(planes + c*(decoded+SAMPLE_SLACK) + decoded, 0, SAMPLE_SLACK*sizeof(float));
+      }
+    }
+    struct mixed_pack padding = {0};
+    padding._data = (unsigned char *)planes;
+    padding.size = (decoded+SAMPLE_SLACK)*sizeof(float);
+    padding.write = padding.size;
+    padding.encoding = MIXED_FLOAT;
+    padding.channels = channels;
+    padding.samplerate = pack->samplerate;
+    padding.flags = MIXED_PLANAR;
+    if(!sample_unpack(&padding, samplerate, sample->data, capacity, &sample->frames))
+      goto cleanup;
+    sample->frames = MIN(sample->frames, (uint32_t)(((uint64_t)decoded*samplerate + pack->samplerate/2) / pack->samplerate));
+    mixed_free(planes);
+    planes = 0;
+  }
+
+  if(sample->frames == 0){
+    mixed_err(MIXED_BUFFER_EMPTY);
+    goto cleanup;
+  }
+  // Pack the planes tightly, as the sample lives for a long time.
+  if(sample->frames < capacity){
+    for(channel_t c=1; c<channels; ++c)
+      memmove(sample->data + c*sample->frames, sample->data + c*capacity, sample->frames*sizeof(float));
+    float *data = mixed_realloc(sample->data, channels*sample->frames*sizeof(float));
+    if(data) sample->data = data;
+  }
+  return sample;
+
+ cleanup:
+  if(planes) mixed_free(planes);
+  sample_release(sample);
+  return 0;
+}
+
+struct sample_data *sample_bank_get(uint32_t id, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  uint32_t index;
+  if(!data || !sample_bank_find(id, &index, data)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct sample_data *sample = data->samples[index];
+  sample->last_used = ++data->clock;
+  return sample;
+}
+
+MIXED_EXPORT int mixed_make_sample_bank(uint32_t samplerate, uint64_t budget, struct mixed_sample_bank *bank){
+  mixed_err(MIXED_NO_ERROR);
+  if(samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct sample_bank_data *data = mixed_calloc(1, sizeof(struct sample_bank_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  bank->_data = data;
+  bank->samplerate = samplerate;
+  bank->budget = budget;
+  bank->size = 0;
+  bank->count = 0;
+  return 1;
+}
+
+MIXED_EXPORT void mixed_free_sample_bank(struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  if(data){
+    for(uint32_t i=0; i<data->count; ++i)
+      sample_release(data->samples[i]);
+    if(data->samples) mixed_free(data->samples);
+    mixed_free(data);
+  }
+  bank->_data = 0;
+  bank->size = 0;
+  bank->count = 0;
+}
+
+MIXED_EXPORT int mixed_sample_bank_add(uint32_t id, struct mixed_pack *pack, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  uint32_t index;
+  mixed_err(MIXED_NO_ERROR);
+  if(!data){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+
+  struct sample_data *sample = sample_decode(pack, bank->samplerate);
+  if(!sample) return 0;
+  sample->id = id;
+  sample->last_used = ++data->clock;
+
+  // A sample that is replaced does not count against the new one.
+  if(sample_bank_find(id, &index, data))
+    sample_bank_remove_at(index, bank);
+  if(!sample_bank_evict(sample_bytes(sample), bank)){
+    sample_release(sample);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  if(data->count == data->capacity){
+    uint32_t capacity = MAX(16, data->capacity*2);
+    struct sample_data **samples = mixed_realloc(data->samples, capacity*sizeof(struct sample_data *));
+    if(!samples){
+      sample_release(sample);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    data->samples = samples;
+    data->capacity = capacity;
+  }
+  sample_bank_find(id, &index, data);
+  memmove(data->samples+index+1, data->samples+index, (data->count-index)*sizeof(struct sample_data *));
+  data->samples[index] = sample;
+  data->count++;
+  bank->count = data->count;
+  bank->size += sample_bytes(sample);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_sample_bank_remove(uint32_t id, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  uint32_t index;
+  mixed_err(MIXED_NO_ERROR);
+  if(!data || !sample_bank_find(id, &index, data)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  sample_bank_remove_at(index, bank);
+  return 1;
+}
+
+MIXED_EXPORT uint32_t mixed_sample_bank_frames(uint32_t id, struct mixed_sample_bank *bank){
+  struct sample_bank_data *data = (struct sample_bank_data *)bank->_data;
+  uint32_t index;
+  if(!data || !sample_bank_find(id, &index, data))
+    return 0;
+  return data->samples[index]->frames;
+}
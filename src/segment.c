@@ -2,6 +2,8 @@
 
 MIXED_EXPORT int mixed_free_segment(struct mixed_segment *segment){
   mixed_err(MIXED_NO_ERROR);
+  if(trace_state) trace_forget(segment);
+  if(profile_table) profile_forget(segment);
   if(segment->free)
     return segment->free(segment);
   mixed_err(MIXED_NOT_IMPLEMENTED);
@@ -16,10 +18,35 @@ MIXED_EXPORT int mixed_segment_start(struct mixed_segment *segment){
   return 1;
 }
 
-MIXED_EXPORT int mixed_segment_mix(struct mixed_segment *segment){
+static char flush_denormals = 1;
+// Only the outermost mix on a thread switches the FPU mode, the
+// segments it mixes in turn run in it already.
+static thread_local uint32_t mix_depth = 0;
+
+static inline int segment_mix(struct mixed_segment *segment){
+  if(__builtin_expect(trace_state != 0, 0))
+    return trace_mix(segment);
+  if(__builtin_expect(profile_table != 0, 0))
+    return profile_mix(segment);
   return segment->mix(segment);
 }
 
+MIXED_EXPORT int mixed_segment_mix(struct mixed_segment *segment){
+  if(!flush_denormals || mix_depth)
+    return segment_mix(segment);
+  uint64_t state = fpu_flush_denormals();
+  mix_depth = 1;
+  int result = segment_mix(segment);
+  mix_depth = 0;
+  fpu_restore(state);
+  return result;
+}
+
+MIXED_EXPORT int mixed_flush_denormals(int flush){
+  flush_denormals = (flush != 0);
+  return 1;
+}
+
 MIXED_EXPORT int mixed_segment_end(struct mixed_segment *segment){
   mixed_err(MIXED_NO_ERROR);
   if(segment->end)
@@ -30,6 +57,8 @@ MIXED_EXPORT int mixed_segment_end(struct mixed_segment *segment){
 
 MIXED_EXPORT int mixed_segment_set_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
   mixed_err(MIXED_NO_ERROR);
+  if(profile_table && field == MIXED_BUFFER)
+    profile_connect(MIXED_IN, location, value, segment);
   if(segment->set_in)
     return segment->set_in(field, location, value, segment);
   mixed_err(MIXED_NOT_IMPLEMENTED);
@@ -38,6 +67,8 @@ MIXED_EXPORT int mixed_segment_set_in(uint32_t field, uint32_t location, void *v
 
 MIXED_EXPORT int mixed_segment_set_out(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
   mixed_err(MIXED_NO_ERROR);
+  if(profile_table && field == MIXED_BUFFER)
+    profile_connect(MIXED_OUT, location, value, segment);
   if(segment->set_out)
     return segment->set_out(field, location, value, segment);
   mixed_err(MIXED_NOT_IMPLEMENTED);
@@ -69,6 +100,8 @@ MIXED_EXPORT int mixed_segment_info(struct mixed_segment_info *info, struct mixe
 
 MIXED_EXPORT int mixed_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
   mixed_err(MIXED_NO_ERROR);
+  if(field == MIXED_PROFILE)
+    return profile_get((struct mixed_segment_profile *)value, segment);
   if(segment->get)
     return segment->get(field, value, segment);
   mixed_err(MIXED_NOT_IMPLEMENTED);
@@ -82,3 +115,128 @@ MIXED_EXPORT int mixed_segment_set(uint32_t field, void *value, struct mixed_seg
   mixed_err(MIXED_NOT_IMPLEMENTED);
   return 0;
 }
+
+// A snapshot starts with a magic number and a hash of the segment's
+// name, followed by a record per field. Every record is padded to
+// eight bytes, so values can be handed out from where they lie.
+#define SNAPSHOT_MAGIC 0x4E53584D
+#define SNAPSHOT_PAD(x) (((x)+7) & ~7u)
+
+struct snapshot_record{
+  uint32_t field;
+  uint32_t size;
+};
+
+static uint32_t snapshot_name_hash(const char *name){
+  uint32_t hash = 2166136261u;
+  for(; *name; ++name){
+    hash ^= (uint8_t)*name;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t snapshot_value_size(enum mixed_segment_field_type type){
+  switch((int)type){
+  case MIXED_INT8: case MIXED_UINT8: case MIXED_CHANNEL_T: return 1;
+  case MIXED_INT16: case MIXED_UINT16: return 2;
+  case MIXED_INT32: case MIXED_UINT32: case MIXED_FLOAT: return 4;
+  case MIXED_DOUBLE: return 8;
+  case MIXED_BOOL: return sizeof(bool);
+  case MIXED_SIZE_T: return sizeof(size_t);
+  case MIXED_LOCATION_ENUM:
+  case MIXED_BIQUAD_FILTER_ENUM:
+  case MIXED_REPEAT_MODE_ENUM:
+  case MIXED_NOISE_TYPE_ENUM:
+  case MIXED_GENERATOR_TYPE_ENUM:
+  case MIXED_FADE_TYPE_ENUM:
+  case MIXED_ATTENUATION_ENUM:
+  case MIXED_ENCODING_ENUM:
+  case MIXED_RESAMPLE_TYPE_ENUM:
+  case MIXED_RAMP_TYPE_ENUM:
+  case MIXED_SPACE_LAYOUT_ENUM:
+  case MIXED_PITCH_MODE_ENUM:
+  case MIXED_WINDOW_TYPE_ENUM: return sizeof(enum mixed_resample_type);
+  default: return 0;
+  }
+}
+
+MIXED_EXPORT int mixed_segment_save(void *data, uint32_t *size, int runtime, struct mixed_segment *segment){
+  struct mixed_segment_info info = {0};
+  char *base = (char *)data;
+  uint32_t offset = 2*sizeof(uint32_t);
+  mixed_err(MIXED_NO_ERROR);
+  if(!mixed_segment_info(&info, segment)) return 0;
+  if(base){
+    if(*size < offset){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    ((uint32_t *)base)[0] = SNAPSHOT_MAGIC;
+    ((uint32_t *)base)[1] = snapshot_name_hash(info.name);
+  }
+  for(struct mixed_segment_field_info *field = info.fields; field->description; ++field){
+    uint32_t flags = MIXED_SEGMENT | MIXED_SET | MIXED_GET;
+    if((field->flags & flags) != flags) continue;
+    struct mixed_segment_state state = {0};
+    uint32_t bytes = snapshot_value_size(field->type) * field->type_count;
+    if(field->field == MIXED_STATE){
+      state.runtime = runtime;
+      if(!mixed_segment_get(MIXED_STATE, &state, segment)) return 0;
+      bytes = state.size;
+    }
+    if(bytes == 0) continue;
+    uint32_t record = sizeof(struct snapshot_record) + SNAPSHOT_PAD(bytes);
+    if(base){
+      if(*size < offset + record){
+        mixed_err(MIXED_INVALID_VALUE);
+        return 0;
+      }
+      struct snapshot_record *header = (struct snapshot_record *)(base + offset);
+      void *value = base + offset + sizeof(struct snapshot_record);
+      header->field = field->field;
+      header->size = bytes;
+      if(field->field == MIXED_STATE){
+        state.data = value;
+        if(!mixed_segment_get(MIXED_STATE, &state, segment)) return 0;
+      }else if(!mixed_segment_get(field->field, value, segment)){
+        return 0;
+      }
+    }
+    offset += record;
+  }
+  *size = offset;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_segment_load(void *data, uint32_t size, struct mixed_segment *segment){
+  struct mixed_segment_info info = {0};
+  char *base = (char *)data;
+  uint32_t offset = 2*sizeof(uint32_t);
+  mixed_err(MIXED_NO_ERROR);
+  if(!mixed_segment_info(&info, segment)) return 0;
+  if(size < offset
+     || ((uint32_t *)base)[0] != SNAPSHOT_MAGIC
+     || ((uint32_t *)base)[1] != snapshot_name_hash(info.name)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  while(offset < size){
+    struct snapshot_record *header = (struct snapshot_record *)(base + offset);
+    void *value = base + offset + sizeof(struct snapshot_record);
+    if(size - offset < sizeof(struct snapshot_record)
+       || size - offset - sizeof(struct snapshot_record) < header->size){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    uint32_t record = sizeof(struct snapshot_record) + SNAPSHOT_PAD(header->size);
+    if(header->field == MIXED_STATE){
+      struct mixed_segment_state state = {value, header->size, 0};
+      if(!mixed_segment_set(MIXED_STATE, &state, segment)) return 0;
+    }else if(!mixed_segment_set(header->field, value, segment)){
+      return 0;
+    }
+    offset += record;
+  }
+  return 1;
+}
@@ -1,16 +1,91 @@
 #include "../internal.h"
 
+// A gain change is spread over the next block to avoid a click.
+struct basic_mixer_gain{
+  float value;
+  float target;
+};
+
 struct basic_mixer_data{
   struct mixed_buffer **in;
   uint32_t count;
   uint32_t size;
   struct mixed_buffer **out;
   channel_t channels;
-  float volume;
-  float target_volume;
+  struct ramp volume;
+  float **areas;
+  struct basic_mixer_gain *gains;
+  float **active;
+  float *factors;
+  uint32_t area_count;
+  // Voice limiting, see voices_limit. Voice v is made of the inputs
+  // v*channels up to (v+1)*channels.
+  uint32_t max_voices;
+  float *priorities;
+  float *loudness;
+  uint8_t *candidates;
+  uint8_t *stolen;
+  uint32_t *order;
+  uint8_t voices_changed;
 };
 
+// Keep the scratch space for input areas and gains as large as the
+// input vector, so that mixing never has to allocate it.
+static int basic_mixer_fit_areas(struct basic_mixer_data *data){
+  if(data->area_count < data->size){
+    float **areas = crealloc(data->areas, data->area_count, data->size, sizeof(float *));
+    if(areas) data->areas = areas;
+    struct basic_mixer_gain *gains = crealloc(data->gains, data->area_count, data->size, sizeof(struct basic_mixer_gain));
+    if(gains) data->gains = gains;
+    float **active = crealloc(data->active, data->area_count, data->size, sizeof(float *));
+    if(active) data->active = active;
+    float *factors = crealloc(data->factors, data->area_count*2, data->size*2, sizeof(float));
+    if(factors) data->factors = factors;
+    float *priorities = crealloc(data->priorities, data->area_count, data->size, sizeof(float));
+    if(priorities) data->priorities = priorities;
+    float *loudness = crealloc(data->loudness, data->area_count, data->size, sizeof(float));
+    if(loudness) data->loudness = loudness;
+    uint8_t *candidates = crealloc(data->candidates, data->area_count, data->size, sizeof(uint8_t));
+    if(candidates) data->candidates = candidates;
+    uint8_t *stolen = crealloc(data->stolen, data->area_count, data->size, sizeof(uint8_t));
+    if(stolen) data->stolen = stolen;
+    uint32_t *order = crealloc(data->order, data->area_count, data->size, sizeof(uint32_t));
+    if(order) data->order = order;
+    if(!areas || !gains || !active || !factors
+       || !priorities || !loudness || !candidates || !stolen || !order){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    for(uint32_t i=data->area_count; i<data->size; ++i){
+      data->gains[i].value = 1.0f;
+      data->gains[i].target = 1.0f;
+    }
+    data->area_count = data->size;
+  }
+  return 1;
+}
+
 int basic_mixer_free(struct mixed_segment *segment){
+  struct basic_mixer_data *data = (struct basic_mixer_data *)segment->data;
+  if(data->areas)
+    mixed_free(data->areas);
+  if(data->gains)
+    mixed_free(data->gains);
+  if(data->active)
+    mixed_free(data->active);
+  if(data->factors)
+    mixed_free(data->factors);
+  if(data->priorities)
+    mixed_free(data->priorities);
+  if(data->loudness)
+    mixed_free(data->loudness);
+  if(data->candidates)
+    mixed_free(data->candidates);
+  if(data->stolen)
+    mixed_free(data->stolen);
+  if(data->order)
+    mixed_free(data->order);
+  data->areas = 0;
   free_vector((struct vector *)segment->data);
   return 1;
 }
@@ -54,9 +129,14 @@ int basic_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
   case MIXED_BUFFER:
     if(buffer){ // Add or set an element
       if(location < data->count){
+        if(!data->in[location])
+          data->gains[location] = (struct basic_mixer_gain){1.0f, 1.0f};
         data->in[location] = (struct mixed_buffer *)buffer;
       }else{
-        return vector_add_pos(location, buffer, (struct vector *)data);
+        if(!vector_add_pos(location, buffer, (struct vector *)data)
+           || !basic_mixer_fit_areas(data))
+          return 0;
+        data->gains[location] = (struct basic_mixer_gain){1.0f, 1.0f};
       }
     }else{ // Remove an element
       if(data->count <= location){
@@ -64,8 +144,24 @@ int basic_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
         return 0;
       }
       data->in[location] = 0;
-      return 1;
     }
+    data->voices_changed = 1;
+    return 1;
+  case MIXED_VOLUME:
+    if(data->count <= location || !data->in[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->gains[location].target = *(float *)buffer;
+    data->voices_changed = 1;
+    return 1;
+  case MIXED_PRIORITY:
+    if(data->count <= location || !data->in[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->priorities[location/data->channels] = *(float *)buffer;
+    data->voices_changed = 1;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -73,59 +169,191 @@ int basic_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
   }
 }
 
-VECTORIZE int basic_mixer_mix(struct mixed_segment *segment){
+int basic_mixer_get_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  struct basic_mixer_data *data = (struct basic_mixer_data *)segment->data;
+  if(data->count <= location || !data->in[location]){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  switch(field){
+  case MIXED_BUFFER: *((struct mixed_buffer **)value) = data->in[location]; break;
+  case MIXED_VOLUME: *((float *)value) = data->gains[location].target; break;
+  case MIXED_PRIORITY: *((float *)value) = data->priorities[location/data->channels]; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+// Sums the inputs eight and then four at a time, so that every pass
+// over the output reads as many streams as possible. Each input has a linear gain of start + j*step,
+// which is constant when the step is zero and keeps the loop free of
+// branches in either case.
+VECTORIZE static void basic_mixer_accumulate(float *restrict out, float **in, float *factors, uint32_t inputs, uint32_t samples){
+  uint32_t i = 0;
+  for(; i+8<=inputs; i+=8){
+    const float *a = in[i+0], *b = in[i+1], *c = in[i+2], *d = in[i+3];
+    const float *e = in[i+4], *g = in[i+5], *h = in[i+6], *k = in[i+7];
+    const float *f = factors+i*2;
+    for(uint32_t j=0; j<samples; ++j){
+      float t = (float)j;
+      out[j] += a[j]*(f[0]+f[1]*t) + b[j]*(f[2]+f[3]*t) + c[j]*(f[4]+f[5]*t) + d[j]*(f[6]+f[7]*t)
+        + e[j]*(f[8]+f[9]*t) + g[j]*(f[10]+f[11]*t) + h[j]*(f[12]+f[13]*t) + k[j]*(f[14]+f[15]*t);
+    }
+  }
+  for(; i+4<=inputs; i+=4){
+    const float *a = in[i+0], *b = in[i+1], *c = in[i+2], *d = in[i+3];
+    const float *f = factors+i*2;
+    float ga = f[0], sa = f[1], gb = f[2], sb = f[3];
+    float gc = f[4], sc = f[5], gd = f[6], sd = f[7];
+    for(uint32_t j=0; j<samples; ++j){
+      float t = (float)j;
+      out[j] += a[j]*(ga+sa*t) + b[j]*(gb+sb*t) + c[j]*(gc+sc*t) + d[j]*(gd+sd*t);
+    }
+  }
+  for(; i<inputs; ++i){
+    const float *a = in[i];
+    float ga = factors[i*2], sa = factors[i*2+1];
+    for(uint32_t j=0; j<samples; ++j){
+      out[j] += a[j]*(ga+sa*(float)j);
+    }
+  }
+}
+
+VECTORIZE static void basic_mixer_scale(float *out, struct ramp *ramp, uint32_t samples){
+  uint32_t j = 0;
+  for(; j<samples && ramp->remaining; ++j){
+    out[j] *= ramp_next(ramp);
+  }
+  float volume = ramp->value;
+  for(; j<samples; ++j){
+    out[j] *= volume;
+  }
+}
+
+// Mixes one channel where the output or some inputs are half buffers.
+// Float inputs are at the front of active and half inputs at the
+// back, from slot size-1 down. The work goes a block at a time, with
+// the half inputs converted into a scratch one after the other and
+// the sum kept in another until it is converted out, so that nothing
+// but the buffers themselves leaves the cache.
+static void basic_mixer_sum_half(void *out, char out_half, uint32_t inputs, uint32_t halves, struct ramp *volume, char ramping, uint32_t samples, struct basic_mixer_data *data){
+  float scratch[HALF_BLOCK], sum[HALF_BLOCK];
+  float **active = data->active, **half = data->active+data->size-halves;
+  float *factors = data->factors, *half_factors = data->factors+2*(data->size-halves);
+  for(uint32_t pos=0; pos<samples; pos+=HALF_BLOCK){
+    uint32_t block = MIN(HALF_BLOCK, samples-pos);
+    float *target = half_target(out, out_half, pos, sum);
+    memset(target, 0, block*sizeof(float));
+    basic_mixer_accumulate(target, active, factors, inputs, block);
+    for(uint32_t i=0; i<halves; ++i){
+      half_to_float((uint16_t *)half[i], scratch, block);
+      float *in = scratch;
+      basic_mixer_accumulate(target, &in, half_factors+2*i, 1, block);
+    }
+    if(ramping)
+      basic_mixer_scale(target, volume, block);
+    half_commit(out, out_half, pos, block, target);
+    // Move every input and its gain line on to the next block.
+    for(uint32_t i=0; i<inputs; ++i){
+      active[i] += block;
+      factors[2*i] += factors[2*i+1]*block;
+    }
+    for(uint32_t i=0; i<halves; ++i){
+      half[i] = (float *)((uint16_t *)half[i] + block);
+      half_factors[2*i] += half_factors[2*i+1]*block;
+    }
+  }
+}
+
+// A voice is as loud as the loudest of its channels.
+static void basic_mixer_limit(struct basic_mixer_data *data){
+  channel_t channels = data->channels;
+  uint32_t voices = (data->count+channels-1)/channels;
+  for(uint32_t v=0; v<voices; ++v){
+    data->candidates[v] = 0;
+    data->loudness[v] = 0.0f;
+    for(uint32_t i=v*channels; i<(v+1)*channels && i<data->count; ++i){
+      if(!data->in[i]) continue;
+      data->candidates[v] = 1;
+      data->loudness[v] = MAX(data->loudness[v], fabsf(data->gains[i].target));
+    }
+  }
+  voices_limit(voices, data->max_voices, data->candidates, data->priorities, data->loudness, data->order, data->stolen);
+}
+
+int basic_mixer_mix(struct mixed_segment *segment){
   struct basic_mixer_data *data = (struct basic_mixer_data *)segment->data;
   channel_t channels = data->channels;
-  float initial_volume = data->volume;
-  float target_volume = data->target_volume;
   uint32_t count = data->count;
-  bool changed = 0;
+  float **areas = data->areas;
+  float *outs[channels];
+  char silent[channels];
+  uint32_t samples = UINT32_MAX;
 
-  for(channel_t c=0; c<channels; ++c){
-    float *in=0, *out=0;
-    uint32_t samples = UINT32_MAX;
-    
-    // Compute how much we can mix on this channel.
-    mixed_buffer_request_write(&out, &samples, data->out[c]);
-    for(uint32_t i=c; i<count; i+=channels){
-      struct mixed_buffer *buffer = data->in[i];
-      if(!buffer) continue;
-      
-      mixed_buffer_request_read(&in, &samples, buffer);
-      if(samples == 0) break;
-    }
-
-    if(0 < samples){
-      memset(out, 0, samples*sizeof(float));
+  // Resolve all buffers in one pass to find the common sample count.
+  buffers_request_write_any(channels, data->out, (void **)outs, &samples);
+  buffers_request_read_any(count, data->in, (void **)areas, &samples);
+
+  if(data->voices_changed){
+    if(data->max_voices)
+      basic_mixer_limit(data);
+    data->voices_changed = 0;
+  }
+
+  if(0 < samples){
+    // A settled volume folds into the input gains, a moving one is
+    // applied to the sum afterwards, which is the same for every input.
+    char ramping = (data->volume.remaining != 0);
+    float volume = ramping? 1.0f : data->volume.value;
+    float inv = 1.0f / samples;
+    for(channel_t c=0; c<channels; ++c){
+      float *out = outs[c];
+      uint32_t inputs = 0, halves = 0;
       for(uint32_t i=c; i<count; i+=channels){
-        struct mixed_buffer *buffer = data->in[i];
-        if(!buffer) continue;
-      
-        mixed_buffer_request_read(&in, &samples, buffer);
-        float volume = initial_volume;
-        float previous = in[0];
-        out[0] += previous * volume;
-        for(uint32_t j=1; j<samples; ++j){
-          float sample = in[j];
-          if(previous * sample < 0.0f){
-            volume = target_volume;
-          }
-          out[j] += sample * volume;
-          previous = sample;
+        if(!areas[i]) continue;
+        struct basic_mixer_gain *gain = &data->gains[i];
+        // A stolen voice fades out over one block and is then skipped,
+        // while its input is still consumed to keep its place.
+        float target = gain->target;
+        if(data->stolen[i/channels]){
+          if(gain->value == 0.0f) continue;
+          target = 0.0f;
         }
-        // KLUDGE: This is not entirely correct, ideally we would
-        //         have to keep this check per input buffer. We make the
-        //         optimistic assumption here that if one buffer can make
-        //         the jump, we have enough samples that they all did.
-        if(volume != initial_volume){
-          changed = 1;
+        // Silent and muted inputs add nothing.
+        if(mixed_buffer_is_silent(data->in[i]) || (gain->value == 0.0f && target == 0.0f)){
+          gain->value = target;
+          continue;
         }
-        mixed_buffer_finish_read(samples, buffer);
+        uint32_t slot = data->in[i]->is_half? data->size-1-halves++ : inputs++;
+        data->active[slot] = areas[i];
+        data->factors[slot*2+0] = gain->value*volume;
+        data->factors[slot*2+1] = (target - gain->value)*inv*volume;
+        gain->value = target;
+      }
+      silent[c] = (inputs == 0 && halves == 0);
+      if(halves || data->out[c]->is_half){
+        struct ramp ramp = data->volume;
+        basic_mixer_sum_half(out, data->out[c]->is_half, inputs, halves, &ramp, ramping && !silent[c], samples, data);
+        continue;
+      }
+      memset(out, 0, samples*sizeof(float));
+      if(silent[c]) continue;
+      basic_mixer_accumulate(out, data->active, data->factors, inputs, samples);
+      if(ramping){
+        struct ramp ramp = data->volume;
+        basic_mixer_scale(out, &ramp, samples);
       }
     }
-    mixed_buffer_finish_write(samples, data->out[c]);
+    mixed_buffers_finish_read(count, data->in, samples);
+  }
+  for(channel_t c=0; c<channels; ++c){
+    if(0 < samples && silent[c])
+      mixed_buffer_finish_write_silence(samples, data->out[c]);
+    else
+      mixed_buffer_finish_write(samples, data->out[c]);
   }
-  if(changed) data->volume = target_volume;
+  ramp_skip(samples, &data->volume);
   return 1;
 }
 
@@ -135,7 +363,29 @@ int basic_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   
   switch(field){
   case MIXED_VOLUME:
-    data->target_volume = *((float *)value);
+    ramp_to(*((float *)value), &data->volume);
+    return 1;
+  case MIXED_RAMP_DURATION:
+    data->volume.duration = *((uint32_t *)value);
+    return 1;
+  case MIXED_RAMP_TYPE:
+    switch(*(enum mixed_ramp_type *)value){
+    case MIXED_LINEAR_RAMP:
+    case MIXED_EXPONENTIAL_RAMP:
+      data->volume.type = *(enum mixed_ramp_type *)value;
+      return 1;
+    default:
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+  case MIXED_CAPACITY:
+    return vector_reserve(*(uint32_t *)value, (struct vector *)data)
+      && basic_mixer_fit_areas(data);
+  case MIXED_MAX_VOICES:
+    data->max_voices = *(uint32_t *)value;
+    if(data->max_voices == 0 && data->stolen)
+      memset(data->stolen, 0, data->area_count*sizeof(uint8_t));
+    data->voices_changed = 1;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -148,7 +398,19 @@ int basic_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   
   switch(field){
   case MIXED_VOLUME:
-    *((float *)value) = data->target_volume;
+    *((float *)value) = data->volume.target;
+    return 1;
+  case MIXED_RAMP_DURATION:
+    *((uint32_t *)value) = data->volume.duration;
+    return 1;
+  case MIXED_RAMP_TYPE:
+    *((enum mixed_ramp_type *)value) = data->volume.type;
+    return 1;
+  case MIXED_CAPACITY:
+    *((uint32_t *)value) = data->size;
+    return 1;
+  case MIXED_MAX_VOICES:
+    *((uint32_t *)value) = data->max_voices;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -170,8 +432,28 @@ int basic_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  "The buffer for audio data attached to the location.");
 
   set_info_field(field++, MIXED_VOLUME,
-                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
-                 "The volume scaling factor for the output.");
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The gain of an input, or the volume scaling factor for the output.");
+
+  set_info_field(field++, MIXED_RAMP_DURATION,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of samples over which volume changes are spread.");
+
+  set_info_field(field++, MIXED_RAMP_TYPE,
+                 MIXED_RAMP_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The shape of the volume ramp.");
+
+  set_info_field(field++, MIXED_CAPACITY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of input buffers that can be attached without allocating.");
+
+  set_info_field(field++, MIXED_MAX_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The most voices that are mixed at once, or 0 for no limit.");
+
+  set_info_field(field++, MIXED_PRIORITY,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The priority of the voice the input belongs to.");
   clear_info_field(field++);
   return 1;
 }
@@ -183,8 +465,7 @@ MIXED_EXPORT int mixed_make_segment_basic_mixer(channel_t channels, struct mixed
     return 0;
   }
 
-  data->volume = 1.0f;
-  data->target_volume = 1.0f;
+  ramp_init(1.0f, &data->volume);
   data->channels = channels;
   data->out = mixed_calloc(channels, sizeof(struct mixed_buffer *));
   if(!data->out){
@@ -199,6 +480,7 @@ MIXED_EXPORT int mixed_make_segment_basic_mixer(channel_t channels, struct mixed
   segment->set = basic_mixer_set;
   segment->get = basic_mixer_get;
   segment->set_in = basic_mixer_set_in;
+  segment->get_in = basic_mixer_get_in;
   segment->set_out = basic_mixer_set_out;
   segment->info = basic_mixer_info;
   segment->data = data;
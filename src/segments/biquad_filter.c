@@ -5,6 +5,9 @@ struct biquad_filter_segment_data{
   struct mixed_buffer *out;
   struct biquad_data data;
   struct biquad_data data_2;
+  // Set while the coefficients come from a shared table.
+  struct biquad_table *table;
+  struct biquad_glide glide;
   uint32_t samplerate;
   float frequency;
   float Q;
@@ -13,25 +16,35 @@ struct biquad_filter_segment_data{
 };
 
 static int biquad_reinit(struct biquad_filter_segment_data *data){
-  switch(data->type){
-  case MIXED_LOWPASS: biquad_lowpass(data->samplerate, data->frequency, data->Q, &data->data_2); break;
-  case MIXED_HIGHPASS: biquad_highpass(data->samplerate, data->frequency, data->Q, &data->data_2); break;
-  case MIXED_BANDPASS: biquad_bandpass(data->samplerate, data->frequency, data->Q, &data->data_2); break;
-  case MIXED_NOTCH: biquad_notch(data->samplerate, data->frequency, data->Q, &data->data_2); break;
-  case MIXED_PEAKING: biquad_peaking(data->samplerate, data->frequency, data->Q, data->gain, &data->data_2); break;
-  case MIXED_ALLPASS: biquad_allpass(data->samplerate, data->frequency, data->Q, &data->data_2); break;
-  case MIXED_LOWSHELF: biquad_lowshelf(data->samplerate, data->frequency, data->Q, data->gain, &data->data_2); break;
-  case MIXED_HIGHSHELF: biquad_highshelf(data->samplerate, data->frequency, data->Q, data->gain, &data->data_2); break;
-  default:
-    mixed_err(MIXED_INVALID_VALUE);
-    return 0;
+  if(data->table){
+    if(data->table->type != data->type || data->table->samplerate != data->samplerate){
+      struct biquad_table *table = biquad_table_acquire(data->type, data->samplerate, data->gain);
+      if(!table) return 0;
+      biquad_table_release(data->table);
+      data->table = table;
+      // Positions on the old grid mean nothing on the new one.
+      data->glide.from_grid = 0;
+    }
+    if(biquad_table_fits(data->table, data->type, data->samplerate, data->gain)){
+      biquad_table_design(data->table, data->frequency, data->Q, &data->data_2, &data->glide);
+    }else{
+      // Only the gain moved away from the table's. A new table for
+      // every gain would cost far more than designing exactly.
+      data->glide.to_grid = 0;
+      if(!biquad_design(data->type, data->samplerate, data->frequency, data->Q, data->gain, &data->data_2))
+        return 0;
+    }
+    data->glide.ramp = BIQUAD_RAMP;
+    return 1;
   }
-  return 1;
+  return biquad_design(data->type, data->samplerate, data->frequency, data->Q, data->gain, &data->data_2);
 }
 
 int biquad_filter_segment_free(struct mixed_segment *segment){
-  if(segment->data){
-    mixed_free(segment->data);
+  struct biquad_filter_segment_data *data = (struct biquad_filter_segment_data *)segment->data;
+  if(data){
+    biquad_table_release(data->table);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
@@ -41,6 +54,8 @@ int biquad_filter_segment_start(struct mixed_segment *segment){
   struct biquad_filter_segment_data *data = (struct biquad_filter_segment_data *)segment->data;
   memcpy(&data->data, &data->data_2, sizeof(struct biquad_data));
   biquad_reset(&data->data);
+  data->glide.ramp = 0;
+  biquad_glide_settle(&data->glide);
 
   if(data->in == 0 || data->out == 0){
     mixed_err(MIXED_BUFFER_MISSING);
@@ -83,9 +98,36 @@ int biquad_filter_segment_set_out(uint32_t field, uint32_t location, void *buffe
   }
 }
 
+// Once the input is silent and the tail has decayed, the filter only
+// ever produces zeros until something comes in again.
+static int biquad_decayed(struct biquad_data *state){
+  return fabsf(state->x[0]) < SILENCE_FLOOR && fabsf(state->x[1]) < SILENCE_FLOOR
+    && fabsf(state->y[0]) < SILENCE_FLOOR && fabsf(state->y[1]) < SILENCE_FLOOR;
+}
+
 int biquad_segment_mix(struct mixed_segment *segment){
   struct biquad_filter_segment_data *data = (struct biquad_filter_segment_data *)segment->data;
-  biquad_process(data->in, data->out, &data->data);
+  if(mixed_buffer_is_silent(data->in) && biquad_decayed(&data->data)){
+    biquad_reset(&data->data);
+    buffer_pass_silence(data->in, data->out);
+    // Nothing can be heard jumping while the filter is silent.
+    data->glide.ramp = 0;
+    biquad_glide_settle(&data->glide);
+  }else if(data->table){
+    biquad_process_ramp(data->in, data->out, &data->data, &data->data_2, data->table, &data->glide);
+    if(data->in == data->out) data->in->is_silent = 0;
+  }else{
+    biquad_process(data->in, data->out, &data->data);
+    // Working in place, the tail replaces the silence.
+    if(data->in == data->out) data->in->is_silent = 0;
+  }
+  if(data->table){
+    if(data->glide.ramp == 0){
+      memcpy(data->data.a, data->data_2.a, sizeof(data->data.a));
+      memcpy(data->data.b, data->data_2.b, sizeof(data->data.b));
+    }
+    return 1;
+  }
   float a = 0.99f;
   float b = 1.f - a;
 
@@ -141,6 +183,14 @@ int biquad_filter_segment_info(struct mixed_segment_info *info, struct mixed_seg
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
 
+  set_info_field(field++, MIXED_BIQUAD_TABLE,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether coefficients are interpolated from a shared table.");
+
+  set_info_field(field++, MIXED_STATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The running coefficients and memory of the filter.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -154,6 +204,20 @@ int biquad_filter_segment_get(uint32_t field, void *value, struct mixed_segment
   case MIXED_GAIN: *((float *)value) = data->gain; break;
   case MIXED_BIQUAD_FILTER: *((enum mixed_biquad_filter *)value) = data->type; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == biquad_filter_segment_mix_bypass); break;
+  case MIXED_BIQUAD_TABLE: *((bool *)value) = (data->table != 0); break;
+  case MIXED_STATE: {
+    // Everything but the filter's memory follows from the fields.
+    struct mixed_segment_state *state = (struct mixed_segment_state *)value;
+    uint32_t size = state->runtime? sizeof(struct biquad_data) : 0;
+    if(state->data){
+      if(state->size < size){
+        mixed_err(MIXED_INVALID_VALUE);
+        return 0;
+      }
+      memcpy(state->data, &data->data, size);
+    }
+    state->size = size;
+  } break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -203,6 +267,26 @@ int biquad_filter_segment_set(uint32_t field, void *value, struct mixed_segment
       segment->mix = biquad_segment_mix;
     }
     break;
+  case MIXED_BIQUAD_TABLE:
+    if(*(bool *)value && !data->table){
+      data->table = biquad_table_acquire(data->type, data->samplerate, data->gain);
+      if(!data->table) return 0;
+      biquad_reinit(data);
+    }else if(!*(bool *)value && data->table){
+      biquad_table_release(data->table);
+      data->table = 0;
+      data->glide.from_grid = 0;
+      biquad_reinit(data);
+    }
+    break;
+  case MIXED_STATE: {
+    struct mixed_segment_state *state = (struct mixed_segment_state *)value;
+    if(state->size != sizeof(struct biquad_data)){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    memcpy(&data->data, state->data, sizeof(struct biquad_data));
+  } break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
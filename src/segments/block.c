@@ -0,0 +1,306 @@
+#include "../internal.h"
+
+struct block_segment_data{
+  const struct mixed_block_processor *processor;
+  void *state;
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
+  // Block pointers handed to the processor.
+  float **in_blocks;
+  float **out_blocks;
+  // Staging blocks for when the buffers cannot be used directly.
+  float **in_staging;
+  float **out_staging;
+  void *staging;
+  // Input samples collected into the staging blocks so far.
+  uint32_t filled;
+  // Processed samples still waiting in the staging blocks, from offset.
+  uint32_t pending;
+  uint32_t offset;
+};
+
+int block_segment_free(struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  if(data){
+    if(data->state)
+      data->processor->free(data->state);
+    if(data->staging)
+      mixed_free(data->staging);
+    if(data->in)
+      mixed_free(data->in);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int block_segment_start(struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  const struct mixed_block_processor *processor = data->processor;
+  for(uint32_t i=0; i<processor->inputs; ++i){
+    if(!data->in[i]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  for(uint32_t i=0; i<processor->outputs; ++i){
+    if(!data->out[i]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  data->filled = 0;
+  data->pending = 0;
+  data->offset = 0;
+  if(processor->reset)
+    processor->reset(data->state);
+  return 1;
+}
+
+int block_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location < data->processor->inputs){
+      data->in[location] = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int block_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location < data->processor->outputs){
+      data->out[location] = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+static int block_aligned(uint32_t count, float **areas){
+  for(uint32_t i=0; i<count; ++i){
+    if((uintptr_t)areas[i] & (CACHE_LINE_SIZE-1)) return 0;
+  }
+  return 1;
+}
+
+static int block_aliased(struct block_segment_data *data){
+  for(uint32_t i=0; i<data->processor->inputs; ++i){
+    for(uint32_t j=0; j<data->processor->outputs; ++j){
+      if(data->in[i] == data->out[j]) return 1;
+    }
+  }
+  return 0;
+}
+
+// Runs the processor straight on the buffers for as many whole blocks
+// as all of them can take at once.
+static int block_mix_direct(struct block_segment_data *data){
+  const struct mixed_block_processor *processor = data->processor;
+  uint32_t block = processor->block_size;
+  uint32_t samples = UINT32_MAX;
+  float **in = data->in_blocks, **out = data->out_blocks;
+  mixed_buffers_request_read(processor->inputs, data->in, in, &samples);
+  mixed_buffers_request_write(processor->outputs, data->out, out, &samples);
+  samples -= samples % block;
+  if(0 < samples && (!(processor->flags & MIXED_BLOCK_SIMD)
+                     || (block_aligned(processor->inputs, in) && block_aligned(processor->outputs, out)))){
+    for(uint32_t i=0; i<samples; i+=block){
+      if(!processor->process(in, out, block, data->state)){
+        samples = i;
+        break;
+      }
+      for(uint32_t c=0; c<processor->inputs; ++c) in[c] += block;
+      for(uint32_t c=0; c<processor->outputs; ++c) out[c] += block;
+    }
+  }else{
+    samples = 0;
+  }
+  mixed_buffers_finish_write(processor->outputs, data->out, samples);
+  mixed_buffers_finish_read(processor->inputs, data->in, samples);
+  return samples;
+}
+
+int block_segment_mix(struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  const struct mixed_block_processor *processor = data->processor;
+  uint32_t block = processor->block_size;
+
+  if(data->filled == 0 && data->pending == 0 && !block_aliased(data))
+    block_mix_direct(data);
+
+  for(;;){
+    if(0 < data->pending){
+      uint32_t samples = data->pending;
+      mixed_buffers_request_write(processor->outputs, data->out, data->out_blocks, &samples);
+      // A full output hands out no areas to copy to.
+      for(uint32_t c=0; c<processor->outputs && samples; ++c)
+        memcpy(data->out_blocks[c], data->out_staging[c]+data->offset, samples*sizeof(float));
+      mixed_buffers_finish_write(processor->outputs, data->out, samples);
+      data->pending -= samples;
+      data->offset += samples;
+      if(0 < data->pending) break;
+    }
+
+    uint32_t samples = block - data->filled;
+    mixed_buffers_request_read(processor->inputs, data->in, data->in_blocks, &samples);
+    for(uint32_t c=0; c<processor->inputs && samples; ++c)
+      memcpy(data->in_staging[c]+data->filled, data->in_blocks[c], samples*sizeof(float));
+    mixed_buffers_finish_read(processor->inputs, data->in, samples);
+    data->filled += samples;
+    if(data->filled < block) break;
+
+    if(!processor->process(data->in_staging, data->out_staging, block, data->state))
+      return 0;
+    data->filled = 0;
+    data->pending = block;
+    data->offset = 0;
+  }
+  return 1;
+}
+
+int block_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  info->name = data->processor->name;
+  info->description = data->processor->description;
+  info->min_inputs = data->processor->inputs;
+  info->max_inputs = data->processor->inputs;
+  info->outputs = data->processor->outputs;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_LATENCY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The delay in samples the processor adds.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int block_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  switch(field){
+  case MIXED_LATENCY: *((uint32_t *)value) = data->processor->latency; break;
+  default:
+    if(data->processor->get)
+      return data->processor->get(field, value, data->state);
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+int block_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct block_segment_data *data = (struct block_segment_data *)segment->data;
+  if(data->processor->set)
+    return data->processor->set(field, value, data->state);
+  mixed_err(MIXED_INVALID_FIELD);
+  return 0;
+}
+
+// All staging blocks share one allocation. Each block is padded to a
+// whole number of cache lines so that every one of them is aligned.
+// In place processors get their outputs on top of their inputs.
+static int block_make_staging(struct block_segment_data *data){
+  const struct mixed_block_processor *processor = data->processor;
+  uint32_t lines = CACHE_LINE_SIZE/sizeof(float);
+  uint32_t stride = (processor->block_size + lines - 1) / lines * lines;
+  uint32_t blocks = processor->inputs + processor->outputs;
+  if(processor->flags & MIXED_BLOCK_INPLACE)
+    blocks = MAX(processor->inputs, processor->outputs);
+  data->staging = mixed_calloc(1, (size_t)blocks*stride*sizeof(float) + CACHE_LINE_SIZE);
+  if(!data->staging){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  uintptr_t aligned = ((uintptr_t)data->staging + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+  float *area = (float *)aligned;
+  for(uint32_t c=0; c<processor->inputs; ++c)
+    data->in_staging[c] = area + c*stride;
+  for(uint32_t c=0; c<processor->outputs; ++c){
+    if(processor->flags & MIXED_BLOCK_INPLACE)
+      data->out_staging[c] = area + c*stride;
+    else
+      data->out_staging[c] = area + (processor->inputs + c)*stride;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_block(const struct mixed_block_processor *processor, uint32_t samplerate, struct mixed_segment *segment){
+  struct mixed_segment tmp = {0};
+  struct block_segment_data *data = 0;
+
+  if(processor->version != MIXED_BLOCK_PROCESSOR_VERSION){
+    mixed_err(MIXED_PLUGIN_VERSION_MISMATCH);
+    return 0;
+  }
+  if(processor->block_size == 0 || processor->inputs + processor->outputs == 0
+     || !processor->make || !processor->free || !processor->process
+     || ((processor->flags & MIXED_BLOCK_SIMD) && processor->block_size % 16 != 0)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  data = mixed_calloc(1, sizeof(struct block_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->processor = processor;
+  tmp.data = data;
+
+  // The buffer and block pointer arrays share one allocation.
+  uint32_t channels = processor->inputs + processor->outputs;
+  void **pointers = mixed_calloc(3*channels, sizeof(void *));
+  if(!pointers){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  data->in = (struct mixed_buffer **)pointers;
+  data->out = data->in + processor->inputs;
+  data->in_blocks = (float **)(pointers + channels);
+  data->out_blocks = data->in_blocks + processor->inputs;
+  data->in_staging = (float **)(pointers + 2*channels);
+  data->out_staging = data->in_staging + processor->inputs;
+
+  if(!block_make_staging(data))
+    goto cleanup;
+
+  data->state = processor->make(samplerate);
+  if(!data->state){
+    mixed_err(MIXED_INVALID_VALUE);
+    goto cleanup;
+  }
+
+  segment->free = block_segment_free;
+  segment->start = block_segment_start;
+  segment->mix = block_segment_mix;
+  segment->set_in = block_segment_set_in;
+  segment->set_out = block_segment_set_out;
+  segment->info = block_segment_info;
+  segment->get = block_segment_get;
+  segment->set = block_segment_set;
+  segment->data = data;
+  return 1;
+
+ cleanup:
+  block_segment_free(&tmp);
+  return 0;
+}
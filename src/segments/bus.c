@@ -0,0 +1,291 @@
+#include "../internal.h"
+
+// Inputs are summed into the busses in chunks small enough that a
+// chunk of input stays in cache while it is added to every bus.
+#define BUS_CHUNK 256
+
+// A send change is spread over the next block to avoid a click.
+struct bus_send{
+  float value;
+  float target;
+};
+
+struct bus_data{
+  struct mixed_buffer **in;
+  uint32_t count;
+  uint32_t size;
+  struct mixed_buffer **out;
+  uint32_t busses;
+  float **areas;
+  // The sends of input i to all busses start at i*busses.
+  struct bus_send *sends;
+  uint32_t area_count;
+};
+
+static void bus_reset_sends(uint32_t location, struct bus_data *data){
+  struct bus_send *sends = data->sends + location*data->busses;
+  for(uint32_t b=0; b<data->busses; ++b){
+    float gain = (b == 0)? 1.0f : 0.0f;
+    sends[b] = (struct bus_send){gain, gain};
+  }
+}
+
+// Keep the scratch space for input areas and sends as large as the
+// input vector, so that mixing never has to allocate it.
+static int bus_fit_areas(struct bus_data *data){
+  if(data->area_count < data->size){
+    float **areas = crealloc(data->areas, data->area_count, data->size, sizeof(float *));
+    if(areas) data->areas = areas;
+    struct bus_send *sends = crealloc(data->sends, data->area_count*data->busses, data->size*data->busses, sizeof(struct bus_send));
+    if(sends) data->sends = sends;
+    if(!areas || !sends){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    for(uint32_t i=data->area_count; i<data->size; ++i){
+      bus_reset_sends(i, data);
+    }
+    data->area_count = data->size;
+  }
+  return 1;
+}
+
+int bus_free(struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+  if(data->areas)
+    mixed_free(data->areas);
+  if(data->sends)
+    mixed_free(data->sends);
+  if(data->out)
+    mixed_free(data->out);
+  free_vector((struct vector *)segment->data);
+  mixed_free(data);
+  segment->data = 0;
+  return 1;
+}
+
+int bus_start(struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+  for(uint32_t i=0; i<data->busses; ++i){
+    if(data->out[i] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int bus_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->busses <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int bus_set_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(value){ // Add or set an element
+      if(location < data->count){
+        if(!data->in[location])
+          bus_reset_sends(location, data);
+        data->in[location] = (struct mixed_buffer *)value;
+      }else{
+        if(!vector_add_pos(location, value, (struct vector *)data)
+           || !bus_fit_areas(data))
+          return 0;
+        bus_reset_sends(location, data);
+      }
+    }else{ // Remove an element
+      if(data->count <= location){
+        mixed_err(MIXED_INVALID_LOCATION);
+        return 0;
+      }
+      data->in[location] = 0;
+    }
+    return 1;
+  case MIXED_BUS_SEND: {
+    struct mixed_bus_send *send = (struct mixed_bus_send *)value;
+    if(data->count <= location || !data->in[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    if(data->busses <= send->bus){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->sends[location*data->busses+send->bus].target = send->gain;
+    return 1; }
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int bus_get_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+  if(data->count <= location || !data->in[location]){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  switch(field){
+  case MIXED_BUFFER: *((struct mixed_buffer **)value) = data->in[location]; break;
+  case MIXED_BUS_SEND: {
+    struct mixed_bus_send *send = (struct mixed_bus_send *)value;
+    if(data->busses <= send->bus){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    send->gain = data->sends[location*data->busses+send->bus].target;
+    break; }
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+// Adds one chunk of input with a linear gain of start + j*step, which
+// is constant when the step is zero and keeps the loop free of branches.
+VECTORIZE static void bus_accumulate(float *restrict out, const float *restrict in, float start, float step, uint32_t samples){
+  for(uint32_t j=0; j<samples; ++j){
+    out[j] += in[j]*(start+step*(float)j);
+  }
+}
+
+int bus_mix(struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+  uint32_t busses = data->busses;
+  uint32_t count = data->count;
+  float **areas = data->areas;
+  float *outs[busses];
+  uint32_t samples = UINT32_MAX;
+
+  mixed_buffers_request_write(busses, data->out, outs, &samples);
+  mixed_buffers_request_read(count, data->in, areas, &samples);
+
+  if(0 < samples){
+    float inv = 1.0f / samples;
+    for(uint32_t b=0; b<busses; ++b)
+      memset(outs[b], 0, samples*sizeof(float));
+    for(uint32_t i=0; i<count; ++i){
+      if(!areas[i]) continue;
+      struct bus_send *sends = data->sends + i*busses;
+      for(uint32_t c=0; c<samples; c+=BUS_CHUNK){
+        uint32_t chunk = MIN(BUS_CHUNK, samples-c);
+        for(uint32_t b=0; b<busses; ++b){
+          float value = sends[b].value, target = sends[b].target;
+          // Silent sends cost nothing.
+          if(value == 0.0f && target == 0.0f) continue;
+          float step = (target - value)*inv;
+          bus_accumulate(outs[b]+c, areas[i]+c, value+step*c, step, chunk);
+        }
+      }
+      for(uint32_t b=0; b<busses; ++b)
+        sends[b].value = sends[b].target;
+    }
+    mixed_buffers_finish_read(count, data->in, samples);
+  }
+  mixed_buffers_finish_write(busses, data->out, samples);
+  return 1;
+}
+
+int bus_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+
+  switch(field){
+  case MIXED_CAPACITY:
+    return vector_reserve(*(uint32_t *)value, (struct vector *)data)
+      && bus_fit_areas(data);
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int bus_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+
+  switch(field){
+  case MIXED_CAPACITY:
+    *((uint32_t *)value) = data->size;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int bus_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct bus_data *data = (struct bus_data *)segment->data;
+  info->name = "bus";
+  info->description = "Mixes multiple buffers into several busses at once";
+  info->min_inputs = 0;
+  info->max_inputs = -1;
+  info->outputs = data->busses;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_BUS_SEND,
+                 MIXED_POINTER, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The gain with which an input is sent to one of the busses.");
+
+  set_info_field(field++, MIXED_CAPACITY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of input buffers that can be attached without allocating.");
+  clear_info_field(field++);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_bus(uint32_t busses, struct mixed_segment *segment){
+  if(busses == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct bus_data *data = mixed_calloc(1, sizeof(struct bus_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->busses = busses;
+  data->out = mixed_calloc(busses, sizeof(struct mixed_buffer *));
+  if(!data->out){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    mixed_free(data);
+    return 0;
+  }
+
+  segment->free = bus_free;
+  segment->start = bus_start;
+  segment->mix = bus_mix;
+  segment->set = bus_set;
+  segment->get = bus_get;
+  segment->set_in = bus_set_in;
+  segment->get_in = bus_get_in;
+  segment->set_out = bus_set_out;
+  segment->info = bus_info;
+  segment->data = data;
+  return 1;
+}
+
+int __make_bus(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_bus(ARG(uint32_t, 0), segment);
+}
+
+REGISTER_SEGMENT(bus, __make_bus, 1, {{.description = "busses", .type = MIXED_UINT32}})
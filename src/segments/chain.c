@@ -1,44 +1,214 @@
 #include "../internal.h"
 
+// The segment list is swapped out as a whole on every change, so the
+// mix can walk it while another thread adds or removes segments.
+struct chain_segment_data{
+  struct rcu_vector segments;
+  // The plan the mix runs, replaced as a whole by whoever changes a
+  // chain it was built from.
+  struct chain_plan *plan;
+  // Bumped by every change to this chain.
+  uint32_t generation;
+};
+
+// A chain a plan was taken from, its generation at the time, and the
+// segments it makes up in the plan. Skip is the index of the next list
+// that is not nested in this one.
+struct chain_list{
+  struct chain_segment_data *data;
+  struct mixed_segment *owner;
+  uint32_t generation;
+  uint32_t start;
+  uint32_t end;
+  uint32_t skip;
+};
+
+#define CHAIN_LIST_FIELDS 6
+
+// All segments to mix in order, with nested chains flattened into it,
+// and the chains it was taken from, in the order they start. The first
+// of those is the chain the plan belongs to.
+struct chain_plan{
+  uint32_t count;
+  uint32_t list_count;
+  struct mixed_segment **segments;
+  struct chain_list *lists;
+};
+
+// Every live chain, so that a change to a nested chain can rebuild
+// the plans of the chains around it.
+static struct vector chains = {0};
+static uint32_t chains_lock = 0;
+
+static void chains_acquire(){
+  while(!atomic_cas(chains_lock, 0, 1));
+}
+
+static void chains_release(){
+  atomic_write(chains_lock, 0);
+}
+
+int chain_segment_mix(struct mixed_segment *segment);
+int chain_segment_free(struct mixed_segment *segment);
+
+// Lists holds the fields of a chain_list for every chain in turn.
+// Nested chains are flattened whether they are bypassed or not, so
+// that bypassing one does not need a new plan.
+static int chain_flatten(struct chain_segment_data *chain, struct mixed_segment *owner, struct vector *segments, struct vector *lists){
+  uint32_t base = lists->count;
+  // Take the generation first, so that a change while we read the
+  // list leaves the plan stale rather than wrong.
+  uint32_t generation = __atomic_load_n(&chain->generation, __ATOMIC_SEQ_CST);
+  void *fields[CHAIN_LIST_FIELDS] = {chain, owner, (void *)(uintptr_t)generation,
+                                     (void *)(uintptr_t)segments->count, 0, 0};
+  for(uint32_t i=0; i<CHAIN_LIST_FIELDS; ++i)
+    if(!vector_add(fields[i], lists)) return 0;
+  struct rcu_array *array = rcu_enter(&chain->segments);
+  uint32_t count = (array)? array->count : 0;
+  int result = 1;
+  for(uint32_t i=0; i<count && result; ++i){
+    struct mixed_segment *segment = (struct mixed_segment *)array->data[i];
+    if(segment->free == chain_segment_free){
+      result = chain_flatten((struct chain_segment_data *)segment->data, segment, segments, lists);
+    }else if(segment->mix){
+      result = vector_add(segment, segments);
+    }
+  }
+  rcu_leave(&chain->segments);
+  lists->data[base+4] = (void *)(uintptr_t)segments->count;
+  lists->data[base+5] = (void *)(uintptr_t)(lists->count/CHAIN_LIST_FIELDS);
+  return result;
+}
+
+static int chain_plan_stale(struct chain_plan *plan){
+  if(!plan) return 1;
+  for(uint32_t i=0; i<plan->list_count; ++i){
+    struct chain_list *list = &plan->lists[i];
+    if(__atomic_load_n(&list->data->generation, __ATOMIC_SEQ_CST) != list->generation)
+      return 1;
+  }
+  return 0;
+}
+
+// Builds a new plan and swaps it in, then waits for the mix to let go
+// of the old one. Only ever called from the threads changing chains.
+static int chain_rebuild(struct chain_segment_data *data){
+  struct vector segments = {0}, lists = {0};
+  struct chain_plan *plan = 0;
+  int result = chain_flatten(data, 0, &segments, &lists);
+  if(result){
+    uint32_t list_count = lists.count/CHAIN_LIST_FIELDS;
+    plan = mixed_calloc(1, sizeof(struct chain_plan)
+                        + list_count*sizeof(struct chain_list)
+                        + segments.count*sizeof(struct mixed_segment *));
+    if(plan){
+      plan->count = segments.count;
+      plan->list_count = list_count;
+      plan->lists = (struct chain_list *)(plan+1);
+      plan->segments = (struct mixed_segment **)(plan->lists+list_count);
+      for(uint32_t i=0; i<segments.count; ++i)
+        plan->segments[i] = segments.data[i];
+      for(uint32_t i=0; i<list_count; ++i){
+        void **fields = &lists.data[CHAIN_LIST_FIELDS*i];
+        plan->lists[i].data = fields[0];
+        plan->lists[i].owner = fields[1];
+        plan->lists[i].generation = (uint32_t)(uintptr_t)fields[2];
+        plan->lists[i].start = (uint32_t)(uintptr_t)fields[3];
+        plan->lists[i].end = (uint32_t)(uintptr_t)fields[4];
+        plan->lists[i].skip = (uint32_t)(uintptr_t)fields[5];
+      }
+    }else{
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      result = 0;
+    }
+  }
+  free_vector(&segments);
+  free_vector(&lists);
+  if(result){
+    struct chain_plan *old = __atomic_exchange_n(&data->plan, plan, __ATOMIC_SEQ_CST);
+    rcu_wait(&data->segments);
+    if(old) mixed_free(old);
+  }
+  return result;
+}
+
+// A stale plan still mixes correctly, only more slowly, so we do not
+// fail the change if a rebuild runs out of memory. The next change
+// tries again.
+static void chain_changed(struct chain_segment_data *data){
+  __atomic_add_fetch(&data->generation, 1, __ATOMIC_SEQ_CST);
+  chains_acquire();
+  for(uint32_t i=0; i<chains.count; ++i){
+    struct chain_segment_data *chain = chains.data[i];
+    if(chain_plan_stale(chain->plan))
+      chain_rebuild(chain);
+  }
+  chains_release();
+}
+
 MIXED_EXPORT int mixed_chain_add(struct mixed_segment *segment, struct mixed_segment *chain){
   mixed_err(MIXED_NO_ERROR);
-  return vector_add(segment, (struct vector *)chain->data);
+  if(!rcu_add(segment, (struct rcu_vector *)chain->data)) return 0;
+  chain_changed((struct chain_segment_data *)chain->data);
+  return 1;
 }
 
-MIXED_EXPORT int mixed_chain_add_pos(uint32_t i, struct mixed_segment *segment, struct mixed_segment *chain){
+MIXED_EXPORT int mixed_chain_add_at(uint32_t i, struct mixed_segment *segment, struct mixed_segment *chain){
   mixed_err(MIXED_NO_ERROR);
-  return vector_add_pos(i, segment, (struct vector *)chain->data);
+  if(!rcu_add_pos(i, segment, (struct rcu_vector *)chain->data)) return 0;
+  chain_changed((struct chain_segment_data *)chain->data);
+  return 1;
 }
 
+// Once removed, the caller is free to dispose of the segment, so we
+// wait for a mix that might still be running it. A plan of an outer
+// chain holds on to our list as well, and is replaced before we
+// return.
 MIXED_EXPORT int mixed_chain_remove(struct mixed_segment *segment, struct mixed_segment *chain){
   mixed_err(MIXED_NO_ERROR);
-  return vector_remove_item(segment, (struct vector *)chain->data);
+  if(!rcu_remove_item(segment, (struct rcu_vector *)chain->data)) return 0;
+  chain_changed((struct chain_segment_data *)chain->data);
+  rcu_wait((struct rcu_vector *)chain->data);
+  return 1;
 }
 
 MIXED_EXPORT int mixed_chain_remove_at(uint32_t i, struct mixed_segment *chain){
   mixed_err(MIXED_NO_ERROR);
-  return vector_remove_pos(i, (struct vector *)chain->data);
+  if(!rcu_remove_pos(i, (struct rcu_vector *)chain->data)) return 0;
+  chain_changed((struct chain_segment_data *)chain->data);
+  rcu_wait((struct rcu_vector *)chain->data);
+  return 1;
 }
 
 int chain_segment_free(struct mixed_segment *segment){
-  if(segment->data){
-    free_vector(segment->data);
-    mixed_free(segment->data);
+  struct chain_segment_data *data = (struct chain_segment_data *)segment->data;
+  if(data){
+    chains_acquire();
+    vector_remove_item(data, &chains);
+    chains_release();
+    free_rcu_vector(&data->segments);
+    if(data->plan) mixed_free(data->plan);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
 }
 
 int chain_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
 
   switch(field){
-  case MIXED_BUFFER:
-    if(0 < data->count){
-      return mixed_segment_set_in(field, location, buffer, data->data[0]);
+  case MIXED_BUFFER: {
+    struct rcu_array *data = rcu_enter(vector);
+    int result = 0;
+    if(data && 0 < data->count){
+      result = mixed_segment_set_in(field, location, buffer, data->data[0]);
+    }else{
+      mixed_err(MIXED_INVALID_LOCATION);
     }
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
+    rcu_leave(vector);
+    return result;
+  }
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -46,15 +216,20 @@ int chain_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct
 }
 
 int chain_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
 
   switch(field){
-  case MIXED_BUFFER:
-    if(0 < data->count){
-      return mixed_segment_set_out(field, location, buffer, data->data[data->count-1]);
+  case MIXED_BUFFER: {
+    struct rcu_array *data = rcu_enter(vector);
+    int result = 0;
+    if(data && 0 < data->count){
+      result = mixed_segment_set_out(field, location, buffer, data->data[data->count-1]);
+    }else{
+      mixed_err(MIXED_INVALID_LOCATION);
     }
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
+    rcu_leave(vector);
+    return result;
+  }
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -62,36 +237,73 @@ int chain_segment_set_out(uint32_t field, uint32_t location, void *buffer, struc
 }
 
 int chain_segment_start(struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
-  uint32_t count = data->count;
-  for(uint32_t i=0; i<count; ++i){
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
+  struct rcu_array *data = rcu_enter(vector);
+  uint32_t count = (data)? data->count : 0;
+  int result = 1;
+  for(uint32_t i=0; i<count && result; ++i){
     struct mixed_segment *segment = (struct mixed_segment *)data->data[i];
     if(segment->start){
-      if(!segment->start(segment)){
-        return 0;
-      }
+      result = segment->start(segment);
     }
   }
-  return 1;
+  rcu_leave(vector);
+  return result;
 }
 
-int chain_segment_mix(struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
-  uint32_t count = data->count;
-  for(uint32_t i=0; i<count; ++i){
-    struct mixed_segment *segment = (struct mixed_segment *)data->data[i];
-    if(segment->mix){
-      if(!segment->mix(segment)){
-        return 0;
+// Bypassing a chain only swaps its mix function, which may well happen
+// halfway through a mix, so we check each nested chain as we reach it
+// and let a bypassed one mix itself in place of its segments.
+static int chain_plan_mix(struct chain_plan *plan){
+  uint32_t next = 1, i = 0;
+  int result = 1;
+  while(result){
+    if(next < plan->list_count && plan->lists[next].start == i){
+      struct chain_list *list = &plan->lists[next];
+      if(__atomic_load_n(&list->owner->mix, __ATOMIC_RELAXED) != chain_segment_mix){
+        result = mixed_segment_mix(list->owner);
+        i = list->end;
+        next = list->skip;
+      }else{
+        ++next;
       }
+    }else if(i < plan->count){
+      result = mixed_segment_mix(plan->segments[i++]);
+    }else{
+      break;
     }
   }
-  return 1;
+  return result;
 }
 
-int chain_segment_mix_bypass(struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
-  uint32_t count = data->count;
+// Instead of recursing through nested chains on every mix, we run a
+// flat plan that the threads changing chains keep up to date. While
+// it runs it counts as a reader of every list it was built from, so
+// that removals still wait for it. If a nested chain changed and the
+// plan was not replaced yet, we walk our own list instead.
+int chain_segment_mix(struct mixed_segment *segment){
+  struct chain_segment_data *data = (struct chain_segment_data *)segment->data;
+  struct rcu_array *array = rcu_enter(&data->segments);
+  struct chain_plan *plan = __atomic_load_n(&data->plan, __ATOMIC_SEQ_CST);
+  uint32_t lists = (plan)? plan->list_count : 0;
+  for(uint32_t i=1; i<lists; ++i)
+    rcu_enter(&plan->lists[i].data->segments);
+  int result = 1;
+  if(!chain_plan_stale(plan)){
+    result = chain_plan_mix(plan);
+  }else{
+    uint32_t count = (array)? array->count : 0;
+    for(uint32_t i=0; i<count && result; ++i)
+      result = mixed_segment_mix((struct mixed_segment *)array->data[i]);
+  }
+  for(uint32_t i=1; i<lists; ++i)
+    rcu_leave(&plan->lists[i].data->segments);
+  rcu_leave(&data->segments);
+  return result;
+}
+
+static int chain_transfer(struct rcu_array *data){
+  uint32_t count = (data)? data->count : 0;
 
   if(count == 0) return 1;
 
@@ -111,18 +323,26 @@ int chain_segment_mix_bypass(struct mixed_segment *segment){
   return 1;
 }
 
+int chain_segment_mix_bypass(struct mixed_segment *segment){
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
+  int result = chain_transfer(rcu_enter(vector));
+  rcu_leave(vector);
+  return result;
+}
+
 int chain_segment_end(struct mixed_segment *segment){
-  struct vector *data = (struct vector *)segment->data;
-  uint32_t count = data->count;
-  for(uint32_t i=0; i<count; ++i){
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
+  struct rcu_array *data = rcu_enter(vector);
+  uint32_t count = (data)? data->count : 0;
+  int result = 1;
+  for(uint32_t i=0; i<count && result; ++i){
     struct mixed_segment *segment = (struct mixed_segment *)data->data[i];
     if(segment->end){
-      if(!segment->end(segment)){
-        return 0;
-      }
+      result = segment->end(segment);
     }
   }
-  return 1;
+  rcu_leave(vector);
+  return result;
 }
 
 int chain_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
@@ -143,20 +363,43 @@ int chain_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
+
+  set_info_field(field++, MIXED_BLOCK_SIZE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET,
+                 "The number of frames every segment processes per mix, or 0.");
+
+  set_info_field(field++, MIXED_LATENCY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The summed latency of the chained segments in frames.");
   
   clear_info_field(field++);
   return 1;
 }
 
 int chain_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
   switch(field){
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == chain_segment_mix_bypass); break;
+  case MIXED_LATENCY: {
+    // The segments run one after the other, so their latencies add up.
+    struct rcu_array *data = rcu_enter(vector);
+    uint32_t total = 0, count = (data)? data->count : 0;
+    for(uint32_t i=0; i<count && segment->mix != chain_segment_mix_bypass; ++i){
+      uint32_t latency = 0;
+      if(mixed_segment_get(field, &latency, data->data[i]))
+        total += latency;
+    }
+    rcu_leave(vector);
+    mixed_err(MIXED_NO_ERROR);
+    *((uint32_t *)value) = total;
+  } break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
 }
 
 int chain_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct rcu_vector *vector = (struct rcu_vector *)segment->data;
   switch(field){
   case MIXED_BYPASS:
     if(*(bool *)value){
@@ -165,6 +408,14 @@ int chain_segment_set(uint32_t field, void *value, struct mixed_segment *segment
       segment->mix = chain_segment_mix;
     }
     break;
+  case MIXED_BLOCK_SIZE: {
+    // Segments that cannot work in blocks are left as they are.
+    struct rcu_array *data = rcu_enter(vector);
+    for(uint32_t i=0; data && i<data->count; ++i)
+      mixed_segment_set(field, value, data->data[i]);
+    rcu_leave(vector);
+    mixed_err(MIXED_NO_ERROR);
+  } break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -173,11 +424,18 @@ int chain_segment_set(uint32_t field, void *value, struct mixed_segment *segment
 }
 
 MIXED_EXPORT int mixed_make_segment_chain(struct mixed_segment *segment){
-  struct vector *data = mixed_calloc(1, sizeof(struct vector));
+  struct chain_segment_data *data = mixed_calloc(1, sizeof(struct chain_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
+  chains_acquire();
+  int result = vector_add(data, &chains);
+  chains_release();
+  if(!result){
+    mixed_free(data);
+    return 0;
+  }
   
   segment->free = chain_segment_free;
   segment->start = chain_segment_start;
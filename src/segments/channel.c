@@ -1,19 +1,59 @@
 #include "../internal.h"
 
+// Frames are mixed in chunks small enough that all input lanes of a
+// chunk stay in cache while every output lane is computed from them.
+#define CHANNEL_CHUNK 256
+#define CHANNEL_SQRT1_2 0.70710678f
+
+// What runs after the matrix on a stereo upmix, see channel_preset.
+enum channel_filter{
+  CHANNEL_NO_FILTER,
+  CHANNEL_CENTER_FILTER,
+  CHANNEL_CENTER_LFE_FILTER
+};
+
+// One non-zero coefficient of the matrix.
+struct channel_term{
+  channel_t in;
+  float gain;
+};
+
 struct channel_data{
-  struct mixed_buffer *in[14];
-  struct mixed_buffer *out[14];
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
   channel_t in_channels;
   channel_t out_channels;
-  struct biquad_data lp[3];
-  uint32_t delay_i;
-  uint32_t delay_size;
-  float *delay;
+  // The channel counts the arrays were allocated for.
+  channel_t in_count;
+  channel_t out_count;
+  // Row o holds the gains of every input for output o.
+  float *matrix;
+  // The terms of output o are terms[offsets[o]] up to terms[offsets[o+1]].
+  struct channel_term *terms;
+  uint32_t *offsets;
+  enum channel_filter filter;
+  struct biquad_bank lp;
+  // Whether the rears are band-limited and phase split after the matrix.
+  char rear_split;
+  struct biquad_bank band;
+  struct hilbert_data rear;
 };
 
+static void free_channel_arrays(struct channel_data *data){
+  if(data->in) mixed_free(data->in);
+  if(data->out) mixed_free(data->out);
+  if(data->matrix) mixed_free(data->matrix);
+  if(data->terms) mixed_free(data->terms);
+  if(data->offsets) mixed_free(data->offsets);
+}
+
 int channel_free(struct mixed_segment *segment){
-  if(segment->data){
-    mixed_free(segment->data);
+  struct channel_data *data = (struct channel_data *)segment->data;
+  if(data){
+    free_channel_arrays(data);
+    free_biquad_bank(&data->lp);
+    free_biquad_bank(&data->band);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
@@ -33,12 +73,15 @@ int channel_start(struct mixed_segment *segment){
       return 0;
     }
   }
+  biquad_bank_reset(&data->lp);
+  biquad_bank_reset(&data->band);
+  hilbert_reset(&data->rear);
   return 1;
 }
 
 int channel_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct channel_data *data = (struct channel_data *)segment->data;
-  
+
   switch(field){
   case MIXED_BUFFER:
     if(data->out_channels <= location){
@@ -77,252 +120,203 @@ int channel_mix_transfer(struct mixed_segment *segment){
   return 1;
 }
 
-int channel_mix_2_0_to_1_0(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *out;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&out, &frames, data->out[MIXED_MONO]);
-  for(uint32_t i=0; i<frames; ++i){
-    out[i] = (l[i]+r[i])*0.5;
+VECTORIZE static void channel_scale(float *restrict out, const float *restrict in, float gain, uint32_t samples){
+  for(uint32_t j=0; j<samples; ++j){
+    out[j] = in[j]*gain;
   }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_MONO]);
-  
-  return 1;
 }
 
-int channel_mix_1_0_to_2_0(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *in;
-  mixed_buffer_request_write(&l, &frames, data->out[MIXED_LEFT]);
-  mixed_buffer_request_write(&r, &frames, data->out[MIXED_RIGHT]);
-  mixed_buffer_request_read(&in, &frames, data->in[MIXED_MONO]);
-  for(uint32_t i=0; i<frames; ++i){
-    l[i] = in[i];
-    r[i] = in[i];
+VECTORIZE static void channel_scale_add(float *restrict out, const float *restrict in, float gain, uint32_t samples){
+  for(uint32_t j=0; j<samples; ++j){
+    out[j] += in[j]*gain;
   }
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_MONO]);
-  
-  return 1;
 }
 
-int channel_mix_2_0_to_3_0(struct mixed_segment *segment){
+int channel_mix_matrix(struct mixed_segment *segment){
   struct channel_data *data = (struct channel_data *)segment->data;
-  
+  channel_t in_channels = data->in_channels;
+  channel_t out_channels = data->out_channels;
+  float *ins[in_channels], *outs[out_channels];
   uint32_t frames = UINT32_MAX;
-  float *l, *r, *fl, *fr, *fc;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&fl, &frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_request_write(&fr, &frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_request_write(&fc, &frames, data->out[2]);
-  for(uint32_t i=0; i<frames; ++i){
-    float li = l[i];
-    float ri = r[i];
-    float c = (li+ri)*0.5f;
-
-    fl[i] = li;
-    fr[i] = ri;
-    fc[i] = c;
-  }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[2]);
-
-  return 1;
-}
 
-int channel_mix_2_0_to_4_0(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-  
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *fl, *fr, *rl, *rr;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&fl, &frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_request_write(&fr, &frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_request_write(&rl, &frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_request_write(&rr, &frames, data->out[MIXED_RIGHT_REAR]);
-  for(uint32_t i=0; i<frames; ++i){
-    float li = l[i];
-    float ri = r[i];
-
-    fl[i] = li;
-    fr[i] = ri;
-    rl[i] = li;
-    rr[i] = ri;
+  mixed_buffers_request_read(in_channels, data->in, ins, &frames);
+  mixed_buffers_request_write(out_channels, data->out, outs, &frames);
+  for(uint32_t c=0; c<frames; c+=CHANNEL_CHUNK){
+    uint32_t chunk = MIN(CHANNEL_CHUNK, frames-c);
+    for(channel_t o=0; o<out_channels; ++o){
+      struct channel_term *term = data->terms + data->offsets[o];
+      struct channel_term *end = data->terms + data->offsets[o+1];
+      if(term == end){
+        memset(outs[o]+c, 0, chunk*sizeof(float));
+        continue;
+      }
+      channel_scale(outs[o]+c, ins[term->in]+c, term->gain, chunk);
+      for(++term; term<end; ++term)
+        channel_scale_add(outs[o]+c, ins[term->in]+c, term->gain, chunk);
+    }
   }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_REAR]);
-
-  return 1;
-}
-
-int channel_mix_2_0_to_5_0(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *fl, *fr, *rl, *rr, *ce;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&fl, &frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_request_write(&fr, &frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_request_write(&rl, &frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_request_write(&rr, &frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_request_write(&ce, &frames, data->out[MIXED_CENTER]);
-  for(uint32_t i=0; i<frames; ++i){
-    float li = l[i];
-    float ri = r[i];
-
-    float c = (li+ri)*0.5f;
-    float ci = biquad_sample(c, &data->lp[0]);
-    float rli = 0.571f * (li + (li - 0.5f * c));
-    float rri = 0.571f * (ri + (ri - 0.5f * c));
-
-    fl[i] = li;
-    fr[i] = ri;
-    rl[i] = rli;
-    rr[i] = rri;
-    ce[i] = ci;
+  // Based on Real-Time Conversion of Stereo Audio to 5.1 Channel Audio for Providing Realistic Sounds by Chan Jun Chun et al.
+  //   https://core.ac.uk/download/pdf/25789335.pdf
+  // The rears are band-limited and split 90 degrees apart, so that
+  // they no longer sound like the fronts, nor like each other.
+  if(0 < frames && data->rear_split){
+    float *rears[2] = {outs[MIXED_LEFT_REAR], outs[MIXED_RIGHT_REAR]};
+    biquad_bank_process(rears, rears, frames, &data->band);
+    hilbert(rears[0], rears[1], frames, &data->rear);
   }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_CENTER]);
+  if(0 < frames && data->filter == CHANNEL_CENTER_FILTER){
+    // The centre lane is scattered last and overwrites the unused LFE.
+    float *ce = outs[MIXED_CENTER];
+    float *lp_in[2] = {ce, ce}, *lp_out[2] = {ce, ce};
+    biquad_bank_process(lp_in, lp_out, frames, &data->lp);
+  }else if(0 < frames && data->filter == CHANNEL_CENTER_LFE_FILTER){
+    float *lp_in[2] = {outs[MIXED_SUBWOOFER], outs[MIXED_CENTER]};
+    biquad_bank_process(lp_in, lp_in, frames, &data->lp);
+  }
+  mixed_buffers_finish_read(in_channels, data->in, frames);
+  mixed_buffers_finish_write(out_channels, data->out, frames);
   return 1;
 }
 
-// Based on Real-Time Conversion of Stereo Audio to 5.1 Channel Audio for Providing Realistic Sounds by Chan Jun Chun et al.
-//   https://core.ac.uk/download/pdf/25789335.pdf
-int channel_mix_2_0_to_5_1(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *fl, *fr, *rl, *rr, *ce, *lfe;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&fl, &frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_request_write(&fr, &frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_request_write(&rl, &frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_request_write(&rr, &frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_request_write(&ce, &frames, data->out[MIXED_CENTER]);
-  mixed_buffer_request_write(&lfe, &frames, data->out[MIXED_SUBWOOFER]);
-  for(uint32_t i=0; i<frames; ++i){
-    float li = l[i];
-    float ri = r[i];
-
-    float c = (li+ri)*0.5f;
-    float ci = biquad_sample(c, &data->lp[0]);
-    float lfei = biquad_sample(c, &data->lp[1]);
-    float rli = 0.571f * (li + (li - 0.5f * c));
-    float rri = 0.571f * (ri + (ri - 0.5f * c));
-
-    // FIXME: Hilbert is fucked. Reinstate when it works again.
-    /* float r = biquad_sample(s, &data->lp[2]); */
-    /* // 90 deg hilbert phase shift. This "automatically" induces a delay as well. */
-    /* float rri = hilbert(r, delay, delay_size, delay_i); */
-    /* delay_i = (delay_i+1) % delay_size; */
-    /* float rli = -rri; */
-
-    fl[i] = li;
-    fr[i] = ri;
-    rl[i] = rli;
-    rr[i] = rri;
-    ce[i] = ci;
-    lfe[i] = lfei;
+// Fills the matrix with the default conversion between the layouts.
+// Stereo upmixes derive centre and rears as in the paper above, and
+// downmixes follow ITU-R BS.775. Layouts without a preset are mapped
+// channel by channel.
+static void channel_preset(struct channel_data *data){
+  channel_t in = data->in_channels, out = data->out_channels;
+  float *m = data->matrix;
+#define M(o, i) m[(o)*in+(i)]
+  memset(m, 0, in*out*sizeof(float));
+  for(channel_t c=0; c<MIN(in, out); ++c)
+    M(c, c) = 1.0f;
+  data->filter = CHANNEL_NO_FILTER;
+  data->rear_split = 0;
+
+  if(in == 1 && 1 < out){
+    if(out == 3 || 5 <= out){
+      M(0, 0) = 0.0f;
+      M((out == 3)? 2 : MIXED_CENTER, 0) = 1.0f;
+    }else{
+      M(MIXED_RIGHT, 0) = 1.0f;
+    }
+  }else if(in == 2 && out == 3){
+    M(2, MIXED_LEFT) = 0.5f;
+    M(2, MIXED_RIGHT) = 0.5f;
+  }else if(in == 2 && out == 4){
+    M(MIXED_LEFT_REAR, MIXED_LEFT) = 1.0f;
+    M(MIXED_RIGHT_REAR, MIXED_RIGHT) = 1.0f;
+  }else if(in == 2 && (out == 5 || out == 6 || out == 8)){
+    // rear = 0.571 * (side + (side - 0.5*centre)) with centre = (l+r)/2
+    float direct = 0.571f*1.75f, cross = -0.571f*0.25f;
+    M(MIXED_CENTER, MIXED_LEFT) = 0.5f;
+    M(MIXED_CENTER, MIXED_RIGHT) = 0.5f;
+    M(MIXED_LEFT_REAR, MIXED_LEFT) = direct;
+    M(MIXED_LEFT_REAR, MIXED_RIGHT) = cross;
+    M(MIXED_RIGHT_REAR, MIXED_RIGHT) = direct;
+    M(MIXED_RIGHT_REAR, MIXED_LEFT) = cross;
+    data->rear_split = 1;
+    if(out == 5){
+      data->filter = CHANNEL_CENTER_FILTER;
+    }else{
+      M(MIXED_SUBWOOFER, MIXED_LEFT) = 0.5f;
+      M(MIXED_SUBWOOFER, MIXED_RIGHT) = 0.5f;
+      data->filter = CHANNEL_CENTER_LFE_FILTER;
+    }
+    if(out == 8){
+      // side = (front + rear) / 2
+      M(MIXED_LEFT_SIDE, MIXED_LEFT) = 0.5f*(1.0f+direct);
+      M(MIXED_LEFT_SIDE, MIXED_RIGHT) = 0.5f*cross;
+      M(MIXED_RIGHT_SIDE, MIXED_RIGHT) = 0.5f*(1.0f+direct);
+      M(MIXED_RIGHT_SIDE, MIXED_LEFT) = 0.5f*cross;
+    }
+  }else if(out <= 2 && 2 <= in){
+    // Fold into stereo first, the LFE is dropped.
+    float l[in], r[in];
+    for(channel_t c=0; c<in; ++c) l[c] = r[c] = 0.0f;
+    l[MIXED_LEFT] = 1.0f;
+    r[MIXED_RIGHT] = 1.0f;
+    if(in == 3){
+      l[2] = r[2] = CHANNEL_SQRT1_2;
+    }else if(4 <= in){
+      l[MIXED_LEFT_REAR] = r[MIXED_RIGHT_REAR] = CHANNEL_SQRT1_2;
+    }
+    if(5 <= in)
+      l[MIXED_CENTER] = r[MIXED_CENTER] = CHANNEL_SQRT1_2;
+    if(8 <= in){
+      l[MIXED_LEFT_SIDE] = CHANNEL_SQRT1_2;
+      r[MIXED_RIGHT_SIDE] = CHANNEL_SQRT1_2;
+    }
+    for(channel_t c=0; c<in; ++c){
+      if(out == 1){
+        M(MIXED_MONO, c) = 0.5f*(l[c]+r[c]);
+      }else{
+        M(MIXED_LEFT, c) = l[c];
+        M(MIXED_RIGHT, c) = r[c];
+      }
+    }
+  }else if(in == 8 && out == 6){
+    M(MIXED_LEFT_REAR, MIXED_LEFT_REAR) = CHANNEL_SQRT1_2;
+    M(MIXED_LEFT_REAR, MIXED_LEFT_SIDE) = CHANNEL_SQRT1_2;
+    M(MIXED_RIGHT_REAR, MIXED_RIGHT_REAR) = CHANNEL_SQRT1_2;
+    M(MIXED_RIGHT_REAR, MIXED_RIGHT_SIDE) = CHANNEL_SQRT1_2;
   }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_CENTER]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_SUBWOOFER]);
-
-  return 1;
+#undef M
 }
 
-int channel_mix_2_0_to_7_1(struct mixed_segment *segment){
-  struct channel_data *data = (struct channel_data *)segment->data;
-  
-  uint32_t frames = UINT32_MAX;
-  float *l, *r, *fl, *fr, *sl, *sr, *rl, *rr, *ce, *lfe;
-  mixed_buffer_request_read(&l, &frames, data->in[MIXED_LEFT]);
-  mixed_buffer_request_read(&r, &frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&fl, &frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_request_write(&fr, &frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_request_write(&sl, &frames, data->out[MIXED_LEFT_SIDE]);
-  mixed_buffer_request_write(&sr, &frames, data->out[MIXED_RIGHT_SIDE]);
-  mixed_buffer_request_write(&rl, &frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_request_write(&rr, &frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_request_write(&ce, &frames, data->out[MIXED_CENTER]);
-  mixed_buffer_request_write(&lfe, &frames, data->out[MIXED_SUBWOOFER]);
-  for(uint32_t i=0; i<frames; ++i){
-    float li = l[i];
-    float ri = r[i];
-
-    float c = (li+ri)*0.5f;
-    float ci = biquad_sample(c, &data->lp[0]);
-    float lfei = biquad_sample(c, &data->lp[1]);
-    float rli = 0.571f * (li + (li - 0.5f * c));
-    float rri = 0.571f * (ri + (ri - 0.5f * c));
-
-    fl[i] = li;
-    fr[i] = ri;
-    sl[i] = (li+rli)*0.5f;
-    sr[i] = (ri+rri)*0.5f;
-    rl[i] = rli;
-    rr[i] = rri;
-    ce[i] = ci;
-    lfe[i] = lfei;
+// Gathers the non-zero coefficients of every row, so that the mix
+// only touches inputs that contribute.
+static void channel_compile(struct channel_data *data){
+  channel_t in = data->in_channels, out = data->out_channels;
+  uint32_t count = 0;
+  for(channel_t o=0; o<out; ++o){
+    data->offsets[o] = count;
+    for(channel_t i=0; i<in; ++i){
+      float gain = data->matrix[o*in+i];
+      if(gain != 0.0f)
+        data->terms[count++] = (struct channel_term){i, gain};
+    }
   }
-  mixed_buffer_finish_read(frames, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_read(frames, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_FRONT]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_SIDE]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_SIDE]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_LEFT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_RIGHT_REAR]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_CENTER]);
-  mixed_buffer_finish_write(frames, data->out[MIXED_SUBWOOFER]);
-
-  return 1;
+  data->offsets[out] = count;
 }
 
 static int channel_update(struct mixed_segment *segment){
   struct channel_data *data = (struct channel_data *)segment->data;
+  channel_t in = data->in_channels, out = data->out_channels;
 
-  if(data->in_channels == data->out_channels)                segment->mix = channel_mix_transfer;
-  else if(data->in_channels == 1 && data->out_channels == 2) segment->mix = channel_mix_1_0_to_2_0;
-  else if(data->in_channels == 2 && data->out_channels == 1) segment->mix = channel_mix_2_0_to_1_0;
-  else if(data->in_channels == 2 && data->out_channels == 3) segment->mix = channel_mix_2_0_to_3_0;
-  else if(data->in_channels == 2 && data->out_channels == 4) segment->mix = channel_mix_2_0_to_4_0;
-  else if(data->in_channels == 2 && data->out_channels == 5) segment->mix = channel_mix_2_0_to_5_0;
-  else if(data->in_channels == 2 && data->out_channels == 6) segment->mix = channel_mix_2_0_to_5_1;
-  else if(data->in_channels == 2 && data->out_channels == 8) segment->mix = channel_mix_2_0_to_7_1;
-  else{
+  if(in == 0 || out == 0){
     mixed_err(MIXED_BAD_CHANNEL_CONFIGURATION);
     return 0;
   }
+
+  struct mixed_buffer **ins = mixed_calloc(in, sizeof(struct mixed_buffer *));
+  struct mixed_buffer **outs = mixed_calloc(out, sizeof(struct mixed_buffer *));
+  float *matrix = mixed_calloc(in*out, sizeof(float));
+  struct channel_term *terms = mixed_calloc(in*out, sizeof(struct channel_term));
+  uint32_t *offsets = mixed_calloc(out+1, sizeof(uint32_t));
+  if(!ins || !outs || !matrix || !terms || !offsets){
+    if(ins) mixed_free(ins);
+    if(outs) mixed_free(outs);
+    if(matrix) mixed_free(matrix);
+    if(terms) mixed_free(terms);
+    if(offsets) mixed_free(offsets);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  // Keep what buffers are already attached.
+  if(data->in) memcpy(ins, data->in, MIN(in, data->in_count)*sizeof(struct mixed_buffer *));
+  if(data->out) memcpy(outs, data->out, MIN(out, data->out_count)*sizeof(struct mixed_buffer *));
+  free_channel_arrays(data);
+  data->in = ins;
+  data->out = outs;
+  data->matrix = matrix;
+  data->terms = terms;
+  data->offsets = offsets;
+  data->in_count = in;
+  data->out_count = out;
+
+  channel_preset(data);
+  channel_compile(data);
+  segment->mix = (in == out)? channel_mix_transfer : channel_mix_matrix;
   return 1;
 }
 
@@ -335,6 +329,9 @@ int channel_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_CHANNEL_COUNT_OUT:
     *((channel_t *)value) = data->out_channels;
     break;
+  case MIXED_CHANNEL_MATRIX:
+    memcpy(value, data->matrix, data->in_channels*data->out_channels*sizeof(float));
+    break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -362,6 +359,13 @@ int channel_set(uint32_t field, void *value, struct mixed_segment *segment){
       return 0;
     }
     break;
+  case MIXED_CHANNEL_MATRIX:
+    memcpy(data->matrix, value, data->in_channels*data->out_channels*sizeof(float));
+    data->filter = CHANNEL_NO_FILTER;
+    data->rear_split = 0;
+    channel_compile(data);
+    segment->mix = channel_mix_matrix;
+    break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -376,7 +380,7 @@ int channel_info(struct mixed_segment_info *info, struct mixed_segment *segment)
   info->min_inputs = data->in_channels;
   info->max_inputs = data->in_channels;
   info->outputs = data->out_channels;
-  
+
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BUFFER,
                  MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
@@ -390,6 +394,10 @@ int channel_info(struct mixed_segment_info *info, struct mixed_segment *segment)
                  MIXED_CHANNEL_T, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The number of output channels.");
 
+  set_info_field(field++, MIXED_CHANNEL_MATRIX,
+                 MIXED_FLOAT, data->in_channels*data->out_channels, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The gain of every input channel in every output channel.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -403,23 +411,36 @@ MIXED_EXPORT int mixed_make_segment_channel_convert(channel_t in, channel_t out,
 
   data->in_channels = in;
   data->out_channels = out;
-  data->delay_size = (samplerate*12)/1000;
-  data->delay = mixed_calloc(data->delay_size, sizeof(float));
-  if(!data->delay){
+  // Lane 0 is the LFE and lane 1 the centre, see channel_mix_matrix.
+  struct biquad_data lowpass;
+  if(!make_biquad_bank(2, 1, &data->lp)){
     mixed_free(data);
-    mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
-  biquad_lowpass(samplerate, 4000, 1, &data->lp[0]);
-  biquad_lowpass(samplerate,  200, 1, &data->lp[1]);
-  biquad_lowpass(samplerate, 7000, 1, &data->lp[2]);
+  biquad_lowpass(samplerate,  200, 1, &lowpass);
+  biquad_bank_set(0, 0, &lowpass, &data->lp);
+  biquad_lowpass(samplerate, 4000, 1, &lowpass);
+  biquad_bank_set(1, 0, &lowpass, &data->lp);
+  // Lanes 0 and 1 are the left and right rear.
+  if(!make_biquad_bank(2, 2, &data->band)){
+    free_biquad_bank(&data->lp);
+    mixed_free(data);
+    return 0;
+  }
+  struct biquad_data highpass;
+  biquad_highpass(samplerate, 100, 1, &highpass);
+  biquad_lowpass(samplerate, 7000, 1, &lowpass);
+  for(channel_t c=0; c<2; ++c){
+    biquad_bank_set(c, 0, &highpass, &data->band);
+    biquad_bank_set(c, 1, &lowpass, &data->band);
+  }
 
   segment->data = data;
   if(!channel_update(segment)){
-    mixed_free(data->delay);
+    free_biquad_bank(&data->lp);
+    free_biquad_bank(&data->band);
     mixed_free(data);
     segment->data = 0;
-    mixed_err(MIXED_BAD_CHANNEL_CONFIGURATION);
     return 0;
   }
 
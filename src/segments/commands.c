@@ -0,0 +1,192 @@
+#include "../internal.h"
+
+#define COMMAND_VALUE_SIZE 32
+
+enum command_kind{
+  COMMAND_SET,
+  COMMAND_SET_IN,
+  COMMAND_SET_OUT
+};
+
+struct command_body{
+  uint32_t kind;
+  uint32_t field;
+  uint32_t location;
+  uint32_t size;
+  struct mixed_segment *target;
+  // Used as is if size is zero, otherwise the value is copied.
+  void *pointer;
+  uint64_t value[COMMAND_VALUE_SIZE/sizeof(uint64_t)];
+};
+
+struct command{
+  // Sequence number of the cell, see commands_push.
+  uint32_t sequence;
+  struct command_body body;
+};
+
+struct commands_segment_data{
+  struct command *cells;
+  uint32_t mask;
+  // The producer and the consumer positions are kept on their own
+  // cache lines, as they are touched by different threads.
+  char _pad0[64];
+  uint32_t write;
+  char _pad1[64];
+  uint32_t read;
+  uint32_t failed;
+};
+
+// This is a bounded multi-producer queue where every cell carries a
+// sequence number. A producer claims a position by bumping the write
+// index, fills the cell, and then publishes it by advancing the cell's
+// sequence. The consumer only ever looks at the cell at its own read
+// position, so it needs no atomic read-modify-write at all.
+static int commands_push(struct command_body *body, struct commands_segment_data *data){
+  uint32_t pos = atomic_read(data->write);
+  for(;;){
+    struct command *cell = &data->cells[pos & data->mask];
+    uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t)(sequence - pos);
+    if(diff == 0){
+      if(__atomic_compare_exchange_n(&data->write, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        cell->body = *body;
+        __atomic_store_n(&cell->sequence, pos+1, __ATOMIC_RELEASE);
+        return 1;
+      }
+    }else if(diff < 0){
+      mixed_err(MIXED_QUEUE_FULL);
+      return 0;
+    }else{
+      pos = atomic_read(data->write);
+    }
+  }
+}
+
+static int commands_apply(struct command_body *command){
+  void *value = (command->size)? (void *)command->value : command->pointer;
+  switch(command->kind){
+  case COMMAND_SET: return mixed_segment_set(command->field, value, command->target);
+  case COMMAND_SET_IN: return mixed_segment_set_in(command->field, command->location, value, command->target);
+  case COMMAND_SET_OUT: return mixed_segment_set_out(command->field, command->location, value, command->target);
+  default: mixed_err(MIXED_INVALID_VALUE); return 0;
+  }
+}
+
+int commands_segment_free(struct mixed_segment *segment){
+  struct commands_segment_data *data = (struct commands_segment_data *)segment->data;
+  if(data){
+    mixed_free(data->cells);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int commands_segment_mix(struct mixed_segment *segment){
+  struct commands_segment_data *data = (struct commands_segment_data *)segment->data;
+  uint32_t pos = data->read;
+  for(;;){
+    struct command *cell = &data->cells[pos & data->mask];
+    uint32_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    if(sequence != pos+1) break;
+    if(!commands_apply(&cell->body))
+      data->failed++;
+    __atomic_store_n(&cell->sequence, pos+data->mask+1, __ATOMIC_RELEASE);
+    ++pos;
+  }
+  data->read = pos;
+  return 1;
+}
+
+int commands_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  IGNORE(segment);
+
+  info->name = "commands";
+  info->description = "Apply field changes queued from other threads.";
+  info->flags = 0;
+  info->min_inputs = 0;
+  info->max_inputs = 0;
+  info->outputs = 0;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_COMMANDS_FAILED,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of queued changes the target segments rejected.");
+  clear_info_field(field++);
+  return 1;
+}
+
+int commands_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct commands_segment_data *data = (struct commands_segment_data *)segment->data;
+  switch(field){
+  case MIXED_COMMANDS_FAILED: *((uint32_t *)value) = data->failed; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_commands(uint32_t size, struct mixed_segment *segment){
+  // Round up to a power of two so positions can be masked.
+  uint32_t count = 2;
+  while(count < size) count *= 2;
+
+  struct commands_segment_data *data = mixed_calloc(1, sizeof(struct commands_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->cells = mixed_calloc(count, sizeof(struct command));
+  if(!data->cells){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    mixed_free(data);
+    return 0;
+  }
+  for(uint32_t i=0; i<count; ++i){
+    data->cells[i].sequence = i;
+  }
+  data->mask = count-1;
+
+  segment->free = commands_segment_free;
+  segment->mix = commands_segment_mix;
+  segment->info = commands_segment_info;
+  segment->get = commands_segment_get;
+  segment->data = data;
+  return 1;
+}
+
+static int commands_queue(uint32_t kind, uint32_t field, uint32_t location, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment){
+  struct commands_segment_data *data = (struct commands_segment_data *)segment->data;
+  struct command_body command = {0};
+  mixed_err(MIXED_NO_ERROR);
+  if(COMMAND_VALUE_SIZE < size){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  command.kind = kind;
+  command.field = field;
+  command.location = location;
+  command.size = size;
+  command.target = target;
+  command.pointer = value;
+  if(size) memcpy(command.value, value, size);
+  return commands_push(&command, data);
+}
+
+MIXED_EXPORT int mixed_commands_set(uint32_t field, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment){
+  return commands_queue(COMMAND_SET, field, 0, value, size, target, segment);
+}
+
+MIXED_EXPORT int mixed_commands_set_in(uint32_t field, uint32_t location, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment){
+  return commands_queue(COMMAND_SET_IN, field, location, value, size, target, segment);
+}
+
+MIXED_EXPORT int mixed_commands_set_out(uint32_t field, uint32_t location, void *value, uint32_t size, struct mixed_segment *target, struct mixed_segment *segment){
+  return commands_queue(COMMAND_SET_OUT, field, location, value, size, target, segment);
+}
+
+int __make_commands(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_commands(ARG(uint32_t, 0), segment);
+}
+
+REGISTER_SEGMENT(commands, __make_commands, 1, {{.description = "size", .type = MIXED_UINT32}})
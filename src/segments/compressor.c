@@ -2,13 +2,15 @@
 
 // Adapted from https://github.com/velipso/sndfilter/blob/master/src/compressor.c
 
-#define MIXED_COMPRESSOR_MAXDELAY 1024
 #define MIXED_COMPRESSOR_SAMPLES_PER_UPDATE 32
 #define MIXED_COMPRESSOR_SPACING 5.0f
 
 struct compressor_segment_data{
-  struct mixed_buffer *in;
-  struct mixed_buffer *out;
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
+  // Drives the detector in place of the inputs if set.
+  struct mixed_buffer *sidechain;
+  channel_t channels;
   // user can read the metergain data variable after processing a chunk to see how much dB the
   // compressor would have liked to compress the sample; the meter values aren't used to shape the
   // sound in any way, only used for output if desired
@@ -36,10 +38,28 @@ struct compressor_segment_data{
   float detectoravg;
   float compgain;
   float maxcompdiffdb;
+  // One ring per channel holding the pregained input. Each ring has
+  // room for the delay and one chunk, so a whole chunk can be written
+  // before the delayed chunk is read back.
+  float *delaybuf;
   uint32_t delaybufsize;
+  uint32_t delay;
   uint32_t delaywritepos;
-  uint32_t delayreadpos;
-  float delaybuf[MIXED_COMPRESSOR_MAXDELAY];
+  // Lookahead limiter: a running minimum of the gain each sample needs
+  // over the lookahead window, released and then averaged over the
+  // same window, so the gain has reached its floor when a peak leaves
+  // the delay.
+  bool limiter;
+  float limitrelease;
+  float limitgain;
+  float *limitmin;
+  uint32_t *limitminpos;
+  uint32_t limitminhead;
+  uint32_t limitmincount;
+  float *limitavg;
+  uint32_t limitavgpos;
+  double limitavgsum;
+  uint32_t limitclock;
 
   // Raw settings
   uint32_t samplerate;
@@ -62,10 +82,6 @@ static inline float clampf(float v, float min, float max){
   return v < min ? min : (v > max ? max : v);
 }
 
-static inline float absf(float v){
-  return v < 0.0f ? -v : v;
-}
-
 static inline float fixf(float v, float def){
   // fix NaN and infinity values that sneak in... not sure why this is needed, but it is
   if (isnan(v) || isinf(v))
@@ -81,6 +97,21 @@ static inline float lin2db(float lin){
   return 20.0f * log10f(lin);
 }
 
+// The per-sample variants, see fast_log2.
+static inline float fastdb2lin(float db){
+  return fast_exp2(0.16609640f * db);
+}
+
+static inline float fastlin2db(float lin){
+  return 6.0205999f * fast_log2(lin);
+}
+
+// sin(x * pi/2) for x in [0, 1]
+static inline float fastsin90(float x){
+  float x2 = x * x;
+  return x * (1.5707963f - x2 * (0.64596409f - x2 * (0.079692626f - x2 * (0.0046817541f - x2 * 0.00016044118f))));
+}
+
 static inline float kneecurve(float x, float k, float linearthreshold){
   return linearthreshold + (1.0f - expf(-k * (x - linearthreshold))) / k;
 }
@@ -99,169 +130,335 @@ static inline float compcurve(float x, float k, float slope, float linearthresho
   return db2lin(kneedboffset + slope * (lin2db(x) - threshold - knee));
 }
 
-VECTORIZE int compressor_segment_mix(struct mixed_segment *segment){
-  struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
+// The detector input is the loudest channel, so that all channels
+// share one gain and the stereo image does not shift. The pregained
+// input also goes into the delay rings here.
+// The peak follows the key if there is one, and the loudest channel
+// otherwise. The rings are always filled from the channels.
+VECTORIZE static void compressor_detect(float **input, const float *key, channel_t channels, uint32_t pos, float *peak, struct compressor_segment_data *data){
+  uint32_t n = MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+  uint32_t size = data->delaybufsize;
+  uint32_t first = MIN(n, size - data->delaywritepos);
+  float linearpregain = data->linearpregain;
+  for (uint32_t i = 0; i < n; i++)
+    peak[i] = 0.0f;
+  for (channel_t ch = 0; ch < channels; ch++){
+    const float *in = input[ch] + pos;
+    float *ring = data->delaybuf + ch * size;
+    if (!key)
+      for (uint32_t i = 0; i < n; i++)
+        peak[i] = MAX(peak[i], fabsf(in[i]));
+    for (uint32_t i = 0; i < first; i++)
+      ring[data->delaywritepos + i] = in[i] * linearpregain;
+    for (uint32_t i = first; i < n; i++)
+      ring[i - first] = in[i] * linearpregain;
+  }
+  if (key)
+    for (uint32_t i = 0; i < n; i++)
+      peak[i] = fabsf(key[pos + i]);
+  for (uint32_t i = 0; i < n; i++)
+    peak[i] *= linearpregain;
+}
+
+// Applies the gain of every sample to the delayed input.
+VECTORIZE static void compressor_apply(float **output, channel_t channels, uint32_t pos, const float *gain, struct compressor_segment_data *data){
+  uint32_t n = MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+  uint32_t size = data->delaybufsize;
+  uint32_t read = (data->delaywritepos + n) % size;
+  uint32_t first = MIN(n, size - read);
+  for (channel_t ch = 0; ch < channels; ch++){
+    float *out = output[ch] + pos;
+    const float *ring = data->delaybuf + ch * size;
+    for (uint32_t i = 0; i < first; i++)
+      out[i] = ring[read + i] * gain[i];
+    for (uint32_t i = first; i < n; i++)
+      out[i] = ring[i - first] * gain[i];
+  }
+  data->delaywritepos = (data->delaywritepos + n) % size;
+}
 
-  float metergain            = data->metergain;
-  float meterrelease         = data->meterrelease;
-  float threshold            = data->threshold;
-  float knee                 = data->knee;
-  float linearpregain        = data->linearpregain;
-  float linearthreshold      = data->linearthreshold;
-  float slope                = data->slope;
-  float attacksamplesinv     = data->attacksamplesinv;
+// The curve and detector release rate only depend on the sample, so
+// they are computed for a whole chunk ahead of the envelope. The
+// branches of compcurve become selects to keep the loop vectorised.
+VECTORIZE static void compressor_attenuation(const float *peak, float *attenuation, float *releaserate, struct compressor_segment_data *data){
+  float threshold = data->threshold;
+  float slope = data->slope;
+  float k = data->k;
+  float linearthreshold = data->linearthreshold;
   float satreleasesamplesinv = data->satreleasesamplesinv;
-  float wet                  = data->wet;
-  float dry                  = data->dry;
-  float k                    = data->k;
-  float kneedboffset         = data->kneedboffset;
-  float linearthresholdknee  = data->linearthresholdknee;
-  float mastergain           = data->mastergain;
-  float a                    = data->a;
-  float b                    = data->b;
-  float c                    = data->c;
-  float d                    = data->d;
-  float detectoravg          = data->detectoravg;
-  float compgain             = data->compgain;
-  float maxcompdiffdb        = data->maxcompdiffdb;
-  int delaybufsize           = data->delaybufsize;
-  int delaywritepos          = data->delaywritepos;
-  int delayreadpos           = data->delayreadpos;
-  float *delaybuf            = data->delaybuf;
-
-  int samplesperchunk = MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
-  float ang90 = (float)M_PI * 0.5f;
+  // Without a knee the curve above the threshold is the same line as
+  // above the knee, just anchored at the threshold instead.
+  float kneeedge = linearthreshold;
+  float lineoffset = threshold;
+  float linestart = threshold;
+  if (data->knee > 0.0f){
+    kneeedge = data->linearthresholdknee;
+    lineoffset = data->kneedboffset;
+    linestart = threshold + data->knee;
+  }
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++){
+    float x = MAX(peak[i], 0.0001f);
+    float soft = linearthreshold + (1.0f - fast_exp2(-1.4426950f * k * (x - linearthreshold))) / k;
+    float line = fastdb2lin(lineoffset + slope * (fastlin2db(x) - linestart));
+    float inputcomp = (x < kneeedge)? soft : line;
+    inputcomp = (x < linearthreshold)? x : inputcomp;
+    float att = (peak[i] < 0.0001f)? 1.0f : inputcomp / x;
+    attenuation[i] = att;
+    float attenuationdb = MAX(-fastlin2db(att), 2.0f);
+    releaserate[i] = fastdb2lin(attenuationdb * satreleasesamplesinv) - 1.0f;
+  }
+}
+
+VECTORIZE static void compressor_gain(const float *compgain, float *gain, float *gaindb, struct compressor_segment_data *data){
+  float dry = data->dry;
+  float wetgain = data->wet * data->mastergain;
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++){
+    float premixgain = fastsin90(compgain[i]);
+    gain[i] = dry + wetgain * premixgain;
+    gaindb[i] = fastlin2db(MAX(premixgain, 1e-6f));
+  }
+}
+
+static void compressor_meter(const float *gaindb, struct compressor_segment_data *data){
+  // calculate metering (not used in core algo, but used to output a meter if desired)
+  float metergain = data->metergain;
+  float meterrelease = data->meterrelease;
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++){
+    if (gaindb[i] < metergain)
+      metergain = gaindb[i]; // spike immediately
+    else
+      metergain += (gaindb[i] - metergain) * meterrelease; // fall slowly
+  }
+  data->metergain = metergain;
+}
+
+static void compressor_chunk(const float *peak, float *gain, struct compressor_segment_data *data){
+  float attenuation[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  float releaserate[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  float compgains[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  float gaindb[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
   float ang90inv = 2.0f / (float)M_PI;
-  int samplepos = 0;
   float spacingdb = MIXED_COMPRESSOR_SPACING;
+  float detectoravg = fixf(data->detectoravg, 1.0f);
+  float compgain = data->compgain;
+  float maxcompdiffdb = data->maxcompdiffdb;
+
+  float desiredgain = detectoravg;
+  float scaleddesiredgain = asinf(desiredgain) * ang90inv;
+  float compdiffdb = lin2db(compgain / scaleddesiredgain);
+
+  // calculate envelope rate based on whether we're attacking or releasing
+  float enveloperate;
+  if (compdiffdb < 0.0f){ // compgain < scaleddesiredgain, so we're releasing
+    compdiffdb = fixf(compdiffdb, -1.0f);
+    maxcompdiffdb = -1; // reset for a future attack mode
+    // apply the adaptive release curve
+    // scale compdiffdb between 0-3
+    float x = (clampf(compdiffdb, -12.0f, 0.0f) + 12.0f) * 0.25f;
+    float releasesamples = adaptivereleasecurve(x, data->a, data->b, data->c, data->d);
+    enveloperate = db2lin(spacingdb / releasesamples);
+  }
+  else{ // compresorgain > scaleddesiredgain, so we're attacking
+    compdiffdb = fixf(compdiffdb, 1.0f);
+    if (maxcompdiffdb == -1 || maxcompdiffdb < compdiffdb)
+      maxcompdiffdb = compdiffdb;
+    float attenuate = maxcompdiffdb;
+    if (attenuate < 0.5f)
+      attenuate = 0.5f;
+    enveloperate = 1.0f - powf(0.25f / attenuate, data->attacksamplesinv);
+  }
 
-  uint32_t samples = UINT32_MAX;
-  float *input, *output;
-  mixed_buffer_request_read(&input, &samples, data->in);
-  mixed_buffer_request_write(&output, &samples, data->out);
-  
-  int chunks = samples / samplesperchunk;
-  samples = chunks * samplesperchunk;
+  compressor_attenuation(peak, attenuation, releaserate, data);
 
-  for (int ch = 0; ch < chunks; ch++){
+  // Only the envelopes themselves depend on the previous sample.
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++){
+    float rate = (attenuation[i] > detectoravg)? releaserate[i] : 1.0f;
+    detectoravg += (attenuation[i] - detectoravg) * rate;
+    if (detectoravg > 1.0f)
+      detectoravg = 1.0f;
     detectoravg = fixf(detectoravg, 1.0f);
-    float desiredgain = detectoravg;
-    float scaleddesiredgain = asinf(desiredgain) * ang90inv;
-    float compdiffdb = lin2db(compgain / scaleddesiredgain);
-
-    // calculate envelope rate based on whether we're attacking or releasing
-    float enveloperate;
-    if (compdiffdb < 0.0f){ // compgain < scaleddesiredgain, so we're releasing
-      compdiffdb = fixf(compdiffdb, -1.0f);
-      maxcompdiffdb = -1; // reset for a future attack mode
-      // apply the adaptive release curve
-      // scale compdiffdb between 0-3
-      float x = (clampf(compdiffdb, -12.0f, 0.0f) + 12.0f) * 0.25f;
-      float releasesamples = adaptivereleasecurve(x, a, b, c, d);
-      enveloperate = db2lin(spacingdb / releasesamples);
-    }
-    else{ // compresorgain > scaleddesiredgain, so we're attacking
-      compdiffdb = fixf(compdiffdb, 1.0f);
-      if (maxcompdiffdb == -1 || maxcompdiffdb < compdiffdb)
-        maxcompdiffdb = compdiffdb;
-      float attenuate = maxcompdiffdb;
-      if (attenuate < 0.5f)
-        attenuate = 0.5f;
-      enveloperate = 1.0f - powf(0.25f / attenuate, attacksamplesinv);
-    }
 
-    // process the chunk
-    for (int chi = 0; chi < samplesperchunk; chi++, samplepos++,
-           delayreadpos = (delayreadpos + 1) % delaybufsize,
-           delaywritepos = (delaywritepos + 1) % delaybufsize){
-
-      float inputL = input[samplepos] * linearpregain;
-      delaybuf[delaywritepos] = inputL;
-
-      inputL = absf(inputL);
-
-      float attenuation;
-      if (inputL < 0.0001f)
-        attenuation = 1.0f;
-      else{
-        float inputcomp = compcurve(inputL, k, slope, linearthreshold, linearthresholdknee, threshold, knee, kneedboffset);
-        attenuation = inputcomp / inputL;
-      }
-
-      float rate;
-      if (attenuation > detectoravg){ // if releasing
-        float attenuationdb = -lin2db(attenuation);
-        if (attenuationdb < 2.0f)
-          attenuationdb = 2.0f;
-        float dbpersample = attenuationdb * satreleasesamplesinv;
-        rate = db2lin(dbpersample) - 1.0f;
-      }
-      else
-        rate = 1.0f;
-
-      detectoravg += (attenuation - detectoravg) * rate;
-      if (detectoravg > 1.0f)
-        detectoravg = 1.0f;
-      detectoravg = fixf(detectoravg, 1.0f);
-
-      if (enveloperate < 1) // attack, reduce gain
-        compgain += (scaleddesiredgain - compgain) * enveloperate;
-      else{ // release, increase gain
-        compgain *= enveloperate;
-        if (compgain > 1.0f)
-          compgain = 1.0f;
-      }
-
-      // the final gain value!
-      float premixgain = sinf(ang90 * compgain);
-      float gain = dry + wet * mastergain * premixgain;
-
-      // calculate metering (not used in core algo, but used to output a meter if desired)
-      float premixgaindb = lin2db(premixgain);
-      if (premixgaindb < metergain)
-        metergain = premixgaindb; // spike immediately
-      else
-        metergain += (premixgaindb - metergain) * meterrelease; // fall slowly
-
-      // apply the gain
-      output[samplepos] = delaybuf[delayreadpos] * gain;
+    if (enveloperate < 1) // attack, reduce gain
+      compgain += (scaleddesiredgain - compgain) * enveloperate;
+    else{ // release, increase gain
+      compgain *= enveloperate;
+      if (compgain > 1.0f)
+        compgain = 1.0f;
     }
+    compgains[i] = compgain;
   }
 
-  mixed_buffer_finish_write(samples, data->out);
-  mixed_buffer_finish_read(samples, data->in);
+  compressor_gain(compgains, gain, gaindb, data);
+  compressor_meter(gaindb, data);
 
-  data->metergain     = metergain;
   data->detectoravg   = detectoravg;
   data->compgain      = compgain;
   data->maxcompdiffdb = maxcompdiffdb;
-  data->delaywritepos = delaywritepos;
-  data->delayreadpos  = delayreadpos;
-  
+}
+
+VECTORIZE static void limiter_required(const float *peak, float *required, float ceiling){
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++)
+    required[i] = (peak[i] > ceiling)? ceiling / peak[i] : 1.0f;
+}
+
+static void limiter_chunk(const float *peak, float *gain, struct compressor_segment_data *data){
+  float required[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  float gaindb[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  uint32_t window = data->delay + 1;
+  float *minimum = data->limitmin;
+  uint32_t *minimumpos = data->limitminpos;
+  uint32_t head = data->limitminhead;
+  uint32_t count = data->limitmincount;
+  uint32_t clock = data->limitclock;
+  float limitgain = data->limitgain;
+  float release = data->limitrelease;
+  double sum = data->limitavgsum;
+  uint32_t avgpos = data->limitavgpos;
+  float windowinv = 1.0f / window;
+
+  limiter_required(peak, required, data->linearthreshold);
+  for (uint32_t i = 0; i < MIXED_COMPRESSOR_SAMPLES_PER_UPDATE; i++, clock++){
+    // Running minimum over the window, as a queue of increasing gains.
+    if (0 < count && window <= clock - minimumpos[head]){
+      head = (head + 1) % window;
+      count--;
+    }
+    while (0 < count && required[i] <= minimum[(head + count - 1) % window])
+      count--;
+    minimum[(head + count) % window] = required[i];
+    minimumpos[(head + count) % window] = clock;
+    count++;
+    float floor = minimum[head];
+    // Dropping is immediate, recovering follows the release.
+    if (floor < limitgain)
+      limitgain = floor;
+    else
+      limitgain += (floor - limitgain) * release;
+    sum += limitgain - data->limitavg[avgpos];
+    data->limitavg[avgpos] = limitgain;
+    avgpos = (avgpos + 1) % window;
+    gain[i] = (float)sum * windowinv;
+    gaindb[i] = fastlin2db(MAX(gain[i], 1e-6f));
+  }
+  compressor_meter(gaindb, data);
+
+  data->limitminhead  = head;
+  data->limitmincount = count;
+  data->limitclock    = clock;
+  data->limitgain     = limitgain;
+  data->limitavgsum   = sum;
+  data->limitavgpos   = avgpos;
+}
+
+int compressor_segment_mix(struct mixed_segment *segment){
+  struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
+  channel_t channels = data->channels;
+  float *input[channels], *output[channels];
+  float *key = 0;
+  float peak[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+  float gain[MIXED_COMPRESSOR_SAMPLES_PER_UPDATE];
+
+  uint32_t samples = UINT32_MAX;
+  mixed_buffers_request_read(channels, data->in, input, &samples);
+  if (data->sidechain)
+    mixed_buffer_request_read(&key, &samples, data->sidechain);
+  mixed_buffers_request_write(channels, data->out, output, &samples);
+
+  uint32_t chunks = samples / MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+  samples = chunks * MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+
+  for (uint32_t ch = 0; ch < chunks; ch++){
+    uint32_t pos = ch * MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+    compressor_detect(input, key, channels, pos, peak, data);
+    if (data->limiter)
+      limiter_chunk(peak, gain, data);
+    else
+      compressor_chunk(peak, gain, data);
+    compressor_apply(output, channels, pos, gain, data);
+  }
+
+  mixed_buffers_finish_write(channels, data->out, samples);
+  mixed_buffers_finish_read(channels, data->in, samples);
+  if (key)
+    mixed_buffer_finish_read(samples, data->sidechain);
+  return 1;
+}
+
+static void free_compressor_buffers(struct compressor_segment_data *data){
+  if (data->delaybuf) mixed_free(data->delaybuf);
+  if (data->limitmin) mixed_free(data->limitmin);
+  if (data->limitminpos) mixed_free(data->limitminpos);
+  if (data->limitavg) mixed_free(data->limitavg);
+  data->delaybuf = 0;
+  data->limitmin = 0;
+  data->limitminpos = 0;
+  data->limitavg = 0;
+}
+
+int compressor_segment_free(struct mixed_segment *segment){
+  struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
+  if (data){
+    free_compressor_buffers(data);
+    if (data->in) mixed_free(data->in);
+    if (data->out) mixed_free(data->out);
+    mixed_free(data);
+  }
+  segment->data = 0;
   return 1;
 }
 
+static void compressor_reset(struct compressor_segment_data *data){
+  uint32_t window = data->delay + 1;
+  memset(data->delaybuf, 0, sizeof(float) * data->delaybufsize * data->channels);
+  data->delaywritepos = 0;
+  data->limitminhead = 0;
+  data->limitmincount = 0;
+  data->limitclock = 0;
+  data->limitgain = 1.0f;
+  data->limitavgpos = 0;
+  data->limitavgsum = window;
+  for (uint32_t i = 0; i < window; i++)
+    data->limitavg[i] = 1.0f;
+}
+
 int compressor_segment_start(struct mixed_segment *segment){
   struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
   data->metergain = 1.0;
   data->detectoravg = 0.0;
   data->compgain = 1.0;
   data->maxcompdiffdb = -1.0;
-  data->delaywritepos = 0;
-  data->delayreadpos = (data->delaybufsize > 1)? 1 : 0;
+  compressor_reset(data);
   return 1;
 }
 
-void compressor_reinit(struct compressor_segment_data *data){
+int compressor_reinit(struct compressor_segment_data *data){
   uint32_t rate = data->samplerate;
-  // setup the predelay buffer
-  int delaybufsize = rate * data->predelay;
-  if (delaybufsize < 1){
-    delaybufsize = 1;
-  }else if (delaybufsize > MIXED_COMPRESSOR_MAXDELAY){
-    delaybufsize = MIXED_COMPRESSOR_MAXDELAY;
+  // setup the predelay buffer, which doubles as the limiter's lookahead
+  float predelaysamples = rate * data->predelay;
+  uint32_t delay = (predelaysamples < 1.0f)? 0 : (uint32_t)predelaysamples - 1;
+  uint32_t delaybufsize = delay + MIXED_COMPRESSOR_SAMPLES_PER_UPDATE;
+  if (delay != data->delay || !data->delaybuf){
+    float *delaybuf = mixed_calloc(delaybufsize * data->channels, sizeof(float));
+    float *limitmin = mixed_calloc(delay + 1, sizeof(float));
+    uint32_t *limitminpos = mixed_calloc(delay + 1, sizeof(uint32_t));
+    float *limitavg = mixed_calloc(delay + 1, sizeof(float));
+    if (!delaybuf || !limitmin || !limitminpos || !limitavg){
+      if (delaybuf) mixed_free(delaybuf);
+      if (limitmin) mixed_free(limitmin);
+      if (limitminpos) mixed_free(limitminpos);
+      if (limitavg) mixed_free(limitavg);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    free_compressor_buffers(data);
+    data->delaybuf    = delaybuf;
+    data->limitmin    = limitmin;
+    data->limitminpos = limitminpos;
+    data->limitavg    = limitavg;
   }
-  memset(data->delaybuf, 0, sizeof(float) * delaybufsize);
+  data->delay        = delay;
+  data->delaybufsize = delaybufsize;
+  compressor_reset(data);
 
   // useful values
   float linearpregain = db2lin(data->pregain);
@@ -273,6 +470,7 @@ void compressor_reinit(struct compressor_segment_data *data){
   float satrelease = 0.0025f; // seconds
   float satreleasesamplesinv = 1.0f / ((float)rate * satrelease);
   float dry = 1.0f - data->wet;
+  float limitrelease = 1.0f - expf(-1.0f / (rate * data->release));
 
   // metering values (not used in core algorithm, but used to output a meter if desired)
   float metergain = 1.0f; // gets overwritten immediately because gain will always be negative
@@ -336,14 +534,24 @@ void compressor_reinit(struct compressor_segment_data *data){
   data->detectoravg          = 0.0f;
   data->compgain             = 1.0f;
   data->maxcompdiffdb        = -1.0f;
-  data->delaybufsize         = delaybufsize;
-  data->delaywritepos        = 0;
-  data->delayreadpos         = delaybufsize > 1 ? 1 : 0;
+  data->limitrelease         = limitrelease;
+  return 1;
 }
 
 int compressor_segment_mix_bypass(struct mixed_segment *segment){
   struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
-  return mixed_buffer_transfer(data->in, data->out);
+  for (channel_t ch = 0; ch < data->channels; ch++){
+    if (!mixed_buffer_transfer(data->in[ch], data->out[ch]))
+      return 0;
+  }
+  // Drain the sidechain so that its producer does not stall.
+  if (data->sidechain){
+    float *key;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_read(&key, &samples, data->sidechain);
+    mixed_buffer_finish_read(samples, data->sidechain);
+  }
+  return 1;
 }
 
 int compressor_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
@@ -351,8 +559,12 @@ int compressor_segment_set_in(uint32_t field, uint32_t location, void *buffer, s
 
   switch(field){
   case MIXED_BUFFER:
-    if(location == 0){
-      data->in = (struct mixed_buffer *)buffer;
+    if(location < data->channels){
+      data->in[location] = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    if(location == data->channels){
+      data->sidechain = (struct mixed_buffer *)buffer;
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -368,8 +580,8 @@ int compressor_segment_set_out(uint32_t field, uint32_t location, void *buffer,
 
   switch(field){
   case MIXED_BUFFER:
-    if(location == 0){
-      data->out = (struct mixed_buffer *)buffer;
+    if(location < data->channels){
+      data->out[location] = (struct mixed_buffer *)buffer;
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -393,6 +605,10 @@ int compressor_segment_get(uint32_t field, void *value, struct mixed_segment *se
   case MIXED_COMPRESSOR_PREDELAY: *((float *)value) = data->predelay; break;
   case MIXED_COMPRESSOR_POSTGAIN: *((float *)value) = data->postgain; break;
   case MIXED_COMPRESSOR_WET: *((float *)value) = data->wet; break;
+  case MIXED_COMPRESSOR_LIMITER: *((bool *)value) = data->limiter; break;
+  case MIXED_LATENCY:
+    *((uint32_t *)value) = (segment->mix == compressor_segment_mix_bypass)? 0 : data->delay;
+    break;
   case MIXED_COMPRESSOR_RELEASEZONE: {
     float *zone = (float *)value;
     zone[0] = data->releasezone[0];
@@ -424,6 +640,7 @@ int compressor_segment_set(uint32_t field, void *value, struct mixed_segment *se
   case MIXED_COMPRESSOR_PREDELAY: data->predelay = *(float *)value; break;
   case MIXED_COMPRESSOR_POSTGAIN: data->postgain = *(float *)value; break;
   case MIXED_COMPRESSOR_WET: data->wet = *(float *)value; break;
+  case MIXED_COMPRESSOR_LIMITER: data->limiter = *(bool *)value; break;
   case MIXED_COMPRESSOR_RELEASEZONE: {
     float *parts = (float *)value;
     data->releasezone[0] = parts[0];
@@ -435,28 +652,32 @@ int compressor_segment_set(uint32_t field, void *value, struct mixed_segment *se
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
   }
-  compressor_reinit(data);
-  return 1;
+  return compressor_reinit(data);
 }
 
 int compressor_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
-  IGNORE(segment);
+  struct compressor_segment_data *data = (struct compressor_segment_data *)segment->data;
   info->name = "compressor";
   info->description = "Dynamically compress the audio volume.";
-  info->flags = MIXED_INPLACE;
-  info->min_inputs = 1;
-  info->max_inputs = 1;
-  info->outputs = 1;
+  // Only whole chunks are processed, so input may be left behind.
+  info->flags = 0;
+  info->min_inputs = data->channels;
+  info->max_inputs = data->channels+1;
+  info->outputs = data->channels;
   
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BUFFER,
                  MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
-                 "The buffer for audio data attached to the location.");
+                 "The buffer for audio data attached to the location. The input after the last channel is the sidechain.");
 
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
 
+  set_info_field(field++, MIXED_LATENCY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of frames the predelay holds the output back.");
+
   set_info_field(field++, MIXED_COMPRESSOR_PREGAIN,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The gain before compression, in dB.");
@@ -497,6 +718,10 @@ int compressor_segment_info(struct mixed_segment_info *info, struct mixed_segmen
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The dry/wet mix");
 
+  set_info_field(field++, MIXED_COMPRESSOR_LIMITER,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether to act as a brickwall limiter with the predelay as lookahead.");
+
   set_info_field(field++, MIXED_COMPRESSOR_GAIN,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_GET,
                  "Retrieve the actual gain that was set during the last mixing step.");
@@ -505,13 +730,19 @@ int compressor_segment_info(struct mixed_segment_info *info, struct mixed_segmen
   return 1;
 }
 
-MIXED_EXPORT int mixed_make_segment_compressor(uint32_t samplerate, struct mixed_segment *segment){
+MIXED_EXPORT int mixed_make_segment_linked_compressor(channel_t channels, uint32_t samplerate, struct mixed_segment *segment){
+  if(channels == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
   struct compressor_segment_data *data = mixed_calloc(1, sizeof(struct compressor_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
 
+  data->channels = channels;
   data->samplerate = samplerate;
   data->pregain = 0.0;
   data->threshold = -24;
@@ -527,8 +758,18 @@ MIXED_EXPORT int mixed_make_segment_compressor(uint32_t samplerate, struct mixed
   data->postgain = 0;
   data->wet = 1;
 
-  compressor_reinit(data);
+  data->in = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  data->out = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  if(!data->in || !data->out || !compressor_reinit(data)){
+    if(data->in) mixed_free(data->in);
+    if(data->out) mixed_free(data->out);
+    free_compressor_buffers(data);
+    mixed_free(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
   
+  segment->free = compressor_segment_free;
   segment->start = compressor_segment_start;
   segment->mix = compressor_segment_mix;
   segment->set_in = compressor_segment_set_in;
@@ -540,6 +781,18 @@ MIXED_EXPORT int mixed_make_segment_compressor(uint32_t samplerate, struct mixed
   return 1;
 }
 
+MIXED_EXPORT int mixed_make_segment_compressor(uint32_t samplerate, struct mixed_segment *segment){
+  return mixed_make_segment_linked_compressor(1, samplerate, segment);
+}
+
+int __make_linked_compressor(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_linked_compressor(ARG(channel_t, 0), ARG(uint32_t, 1), segment);
+}
+
+REGISTER_SEGMENT(linked_compressor, __make_linked_compressor, 2, {
+    {.description = "channels", .type = MIXED_UINT8},
+    {.description = "samplerate", .type = MIXED_UINT32}})
+
 int __make_compressor(void *args, struct mixed_segment *segment){
   return mixed_make_segment_compressor(ARG(uint32_t, 0), segment);
 }
@@ -0,0 +1,346 @@
+#include "../internal.h"
+
+// Uniformly partitioned overlap-save convolution. Every block of one
+// partition of input is transformed together with the block before
+// it, kept in a ring of past spectra, and multiplied with the matching
+// partition spectrum of the response. One inverse transform of the sum
+// then yields a whole block of output.
+
+struct impulse_data{
+  uint32_t references;
+  uint32_t partition;
+  uint32_t partitions;
+  // The spectra of all partitions back to back, partition+1 bins each.
+  float *re;
+  float *im;
+};
+
+struct convolution_segment_data{
+  struct mixed_buffer *in;
+  struct mixed_buffer *out;
+  struct impulse_data *impulse;
+  struct fft_real fft;
+  // The last two blocks of input, the oldest first.
+  float *window;
+  // The output of the last full block, played back during the next.
+  float *block;
+  float *time;
+  // A ring of the spectra of past input blocks.
+  float *history_re;
+  float *history_im;
+  float *sum_re;
+  float *sum_im;
+  uint32_t head;
+  uint32_t fill;
+  float mix;
+};
+
+static void release_impulse(struct impulse_data *impulse){
+  if(!impulse) return;
+  if(__atomic_sub_fetch(&impulse->references, 1, __ATOMIC_SEQ_CST) == 0){
+    if(impulse->re) mixed_free(impulse->re);
+    if(impulse->im) mixed_free(impulse->im);
+    mixed_free(impulse);
+  }
+}
+
+MIXED_EXPORT int mixed_make_impulse_response(float *samples, uint32_t length, uint32_t partition, struct mixed_impulse_response *response){
+  struct fft_real fft = {0};
+  float *window = 0;
+  if(length == 0 || partition < 32 || FFT_MAX_SIZE/2 < partition
+     || (partition & (partition-1)) != 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct impulse_data *impulse = mixed_calloc(1, sizeof(struct impulse_data));
+  if(!impulse){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  impulse->references = 1;
+  impulse->partition = partition;
+  impulse->partitions = (length+partition-1)/partition;
+  uint32_t bins = partition+1;
+  impulse->re = mixed_calloc(impulse->partitions*bins, sizeof(float));
+  impulse->im = mixed_calloc(impulse->partitions*bins, sizeof(float));
+  window = mixed_calloc(2*partition, sizeof(float));
+  if(!impulse->re || !impulse->im || !window){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  if(!make_fft_real(2*partition, &fft))
+    goto cleanup;
+
+  // Each partition is zero padded to the transform size, so that the
+  // circular convolution leaves the second half of a block intact.
+  for(uint32_t p=0; p<impulse->partitions; ++p){
+    uint32_t count = MIN(partition, length-p*partition);
+    memset(window, 0, 2*partition*sizeof(float));
+    memcpy(window, samples+p*partition, count*sizeof(float));
+    fft_real_forward(window, impulse->re+p*bins, impulse->im+p*bins, &fft);
+  }
+  free_fft_real(&fft);
+  mixed_free(window);
+
+  response->_data = impulse;
+  response->samples = length;
+  response->partition = partition;
+  return 1;
+
+ cleanup:
+  free_fft_real(&fft);
+  if(window) mixed_free(window);
+  release_impulse(impulse);
+  return 0;
+}
+
+MIXED_EXPORT void mixed_free_impulse_response(struct mixed_impulse_response *response){
+  release_impulse((struct impulse_data *)response->_data);
+  response->_data = 0;
+}
+
+static void free_convolution_data(struct convolution_segment_data *data){
+  release_impulse(data->impulse);
+  free_fft_real(&data->fft);
+  if(data->window) mixed_free(data->window);
+  if(data->block) mixed_free(data->block);
+  if(data->time) mixed_free(data->time);
+  if(data->history_re) mixed_free(data->history_re);
+  if(data->history_im) mixed_free(data->history_im);
+  if(data->sum_re) mixed_free(data->sum_re);
+  if(data->sum_im) mixed_free(data->sum_im);
+  mixed_free(data);
+}
+
+static void convolution_block(struct convolution_segment_data *data){
+  struct impulse_data *impulse = data->impulse;
+  uint32_t partition = impulse->partition;
+  uint32_t partitions = impulse->partitions;
+  uint32_t bins = partition+1;
+  uint32_t head = data->head;
+
+  fft_real_forward(data->window, data->history_re+head*bins, data->history_im+head*bins, &data->fft);
+  memset(data->sum_re, 0, bins*sizeof(float));
+  memset(data->sum_im, 0, bins*sizeof(float));
+  // The newest input block meets the first partition, the one before
+  // it meets the second, and so on.
+  for(uint32_t p=0; p<partitions; ++p){
+    uint32_t h = (head+partitions-p) % partitions;
+    fft_multiply_add(data->history_re+h*bins, data->history_im+h*bins,
+                         impulse->re+p*bins, impulse->im+p*bins,
+                         data->sum_re, data->sum_im, bins);
+  }
+  fft_real_inverse(data->sum_re, data->sum_im, data->time, &data->fft);
+  // Only the second half is free of wrapped around contributions.
+  memcpy(data->block, data->time+partition, partition*sizeof(float));
+  data->head = (head+1) % partitions;
+}
+
+int convolution_segment_free(struct mixed_segment *segment){
+  if(segment->data)
+    free_convolution_data((struct convolution_segment_data *)segment->data);
+  segment->data = 0;
+  return 1;
+}
+
+int convolution_segment_start(struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+  if(data->out == 0 || data->in == 0){
+    mixed_err(MIXED_BUFFER_MISSING);
+    return 0;
+  }
+  return 1;
+}
+
+int convolution_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location == 0){
+      data->in = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int convolution_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location == 0){
+      data->out = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int convolution_segment_mix(struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+  uint32_t partition = data->impulse->partition;
+  float mix = data->mix;
+  float *in, *out;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_read(&in, &samples, data->in);
+  if(data->in == data->out)
+    out = in;
+  else
+    mixed_buffer_request_write(&out, &samples, data->out);
+  for(uint32_t i=0; i<samples;){
+    uint32_t fill = data->fill;
+    uint32_t count = MIN(partition-fill, samples-i);
+    float *window = data->window+partition+fill;
+    float *block = data->block+fill;
+    // The input is saved first, so that the output may alias it.
+    memcpy(window, in+i, count*sizeof(float));
+    for(uint32_t j=0; j<count; ++j){
+      out[i+j] = LERP(window[j], block[j], mix);
+    }
+    i += count;
+    data->fill = fill+count;
+    if(data->fill == partition){
+      convolution_block(data);
+      memcpy(data->window, data->window+partition, partition*sizeof(float));
+      data->fill = 0;
+    }
+  }
+  if(data->in != data->out){
+    mixed_buffer_finish_read(samples, data->in);
+    mixed_buffer_finish_write(samples, data->out);
+  }else{
+    // The reverb tail replaces whatever silence was there.
+    data->in->is_silent = 0;
+  }
+  return 1;
+}
+
+int convolution_segment_mix_bypass(struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+  return mixed_buffer_transfer(data->in, data->out);
+}
+
+int convolution_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  IGNORE(segment);
+
+  info->name = "convolution";
+  info->description = "Convolve the audio with an impulse response.";
+  info->flags = MIXED_INPLACE;
+  info->min_inputs = 1;
+  info->max_inputs = 1;
+  info->outputs = 1;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_MIX,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "How much of the output to mix with the input.");
+
+  set_info_field(field++, MIXED_BYPASS,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Bypass the segment's processing.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int convolution_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+  switch(field){
+  case MIXED_MIX: *((float *)value) = data->mix; break;
+  case MIXED_BYPASS: *((bool *)value) = (segment->mix == convolution_segment_mix_bypass); break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int convolution_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct convolution_segment_data *data = (struct convolution_segment_data *)segment->data;
+  switch(field){
+  case MIXED_MIX:
+    if(*(float *)value < 0 || 1 < *(float *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->mix = *(float *)value;
+    break;
+  case MIXED_BYPASS:
+    if(*(bool *)value){
+      segment->mix = convolution_segment_mix_bypass;
+    }else{
+      segment->mix = convolution_segment_mix;
+    }
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_convolution(struct mixed_impulse_response *response, struct mixed_segment *segment){
+  struct impulse_data *impulse = (struct impulse_data *)response->_data;
+  if(!impulse){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct convolution_segment_data *data = mixed_calloc(1, sizeof(struct convolution_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  __atomic_add_fetch(&impulse->references, 1, __ATOMIC_SEQ_CST);
+  data->impulse = impulse;
+
+  uint32_t partition = impulse->partition;
+  uint32_t bins = partition+1;
+  data->window = mixed_calloc(2*partition, sizeof(float));
+  data->block = mixed_calloc(partition, sizeof(float));
+  data->time = mixed_calloc(2*partition, sizeof(float));
+  data->history_re = mixed_calloc(impulse->partitions*bins, sizeof(float));
+  data->history_im = mixed_calloc(impulse->partitions*bins, sizeof(float));
+  data->sum_re = mixed_calloc(bins, sizeof(float));
+  data->sum_im = mixed_calloc(bins, sizeof(float));
+  if(!data->window || !data->block || !data->time || !data->history_re || !data->history_im
+     || !data->sum_re || !data->sum_im){
+    free_convolution_data(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_fft_real(2*partition, &data->fft)){
+    free_convolution_data(data);
+    return 0;
+  }
+  data->mix = 1.0f;
+
+  segment->free = convolution_segment_free;
+  segment->start = convolution_segment_start;
+  segment->mix = convolution_segment_mix;
+  segment->set_in = convolution_segment_set_in;
+  segment->set_out = convolution_segment_set_out;
+  segment->info = convolution_segment_info;
+  segment->get = convolution_segment_get;
+  segment->set = convolution_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_convolution(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_convolution(ARG(struct mixed_impulse_response *, 0), segment);
+}
+
+REGISTER_SEGMENT(convolution, __make_convolution, 1, {
+    {.description = "response", .type = MIXED_POINTER}})
@@ -1,17 +1,165 @@
 #include "../internal.h"
 
+// The input is written into the ring a chunk at a time and the taps
+// read their chunk right after, so the ring only needs to hold the
+// longest delay plus one chunk.
+#define DELAY_CHUNK 256
+
+struct delay_tap{
+  struct mixed_delay_tap params;
+  // The delay in samples, rounded up for an unmodulated tap.
+  float delay;
+  float depth;
+  uint32_t phase;
+  uint32_t increment;
+};
+
 struct delay_segment_data{
   struct mixed_buffer *in;
   struct mixed_buffer *out;
-  struct mixed_buffer buffer;
-  float time;
+  float *ring;
+  uint32_t size;
+  uint32_t position;
+  struct delay_tap *taps;
+  uint32_t count;
   uint32_t samplerate;
 };
 
+static void delay_update_tap(struct delay_tap *tap, struct delay_segment_data *data){
+  float samplerate = data->samplerate;
+  tap->depth = tap->params.depth * samplerate;
+  if(tap->depth == 0.0f){
+    tap->delay = ceilf(tap->params.time * samplerate);
+  }else{
+    tap->delay = tap->params.time * samplerate;
+  }
+  tap->increment = wavetable_increment(tap->params.rate, data->samplerate);
+}
+
+// Grows the ring to fit the longest tap, keeping the history that is
+// already in it. Shorter delays never shrink it again.
+static int delay_fit_ring(struct delay_segment_data *data){
+  uint32_t longest = 0;
+  for(uint32_t t=0; t<data->count; ++t){
+    struct delay_tap *tap = &data->taps[t];
+    longest = MAX(longest, (uint32_t)ceilf(tap->delay + tap->depth));
+  }
+  uint32_t needed = longest + DELAY_CHUNK + 2;
+  if(needed <= data->size) return 1;
+
+  uint32_t size = 1;
+  while(size < needed) size <<= 1;
+  float *ring = mixed_calloc(size, sizeof(float));
+  if(!ring){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(data->ring){
+    uint32_t position = data->position;
+    for(uint32_t i=1; i<=data->size; ++i){
+      ring[(position-i) & (size-1)] = data->ring[(position-i) & (data->size-1)];
+    }
+    mixed_free(data->ring);
+  }
+  data->ring = ring;
+  data->size = size;
+  return 1;
+}
+
+// The layout of MIXED_STATE: the header, the parameters of every tap,
+// and with runtime set the phase of every tap and the ring.
+struct delay_state{
+  uint32_t count;
+  uint32_t size;
+  uint32_t position;
+  uint32_t runtime;
+};
+
+static int delay_get_state(struct mixed_segment_state *state, struct delay_segment_data *data){
+  uint32_t needed = sizeof(struct delay_state) + data->count*sizeof(struct mixed_delay_tap);
+  if(state->runtime)
+    needed += data->count*sizeof(uint32_t) + data->size*sizeof(float);
+  if(!state->data){
+    state->size = needed;
+    return 1;
+  }
+  if(state->size < needed){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct delay_state *header = (struct delay_state *)state->data;
+  struct mixed_delay_tap *params = (struct mixed_delay_tap *)(header+1);
+  header->count = data->count;
+  header->size = data->size;
+  header->position = data->position;
+  header->runtime = (state->runtime != 0);
+  for(uint32_t t=0; t<data->count; ++t)
+    params[t] = data->taps[t].params;
+  if(state->runtime){
+    uint32_t *phases = (uint32_t *)(params + data->count);
+    for(uint32_t t=0; t<data->count; ++t)
+      phases[t] = data->taps[t].phase;
+    memcpy(phases + data->count, data->ring, data->size*sizeof(float));
+  }
+  state->size = needed;
+  return 1;
+}
+
+int delay_segment_set(uint32_t field, void *value, struct mixed_segment *segment);
+
+static int delay_set_state(struct mixed_segment_state *state, struct mixed_segment *segment){
+  struct delay_segment_data *data = (struct delay_segment_data *)segment->data;
+  struct delay_state *header = (struct delay_state *)state->data;
+  if(state->size < sizeof(struct delay_state)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint64_t needed = sizeof(struct delay_state) + (uint64_t)header->count*sizeof(struct mixed_delay_tap);
+  if(header->runtime)
+    needed += (uint64_t)header->count*sizeof(uint32_t) + (uint64_t)header->size*sizeof(float);
+  if(state->size < needed || (header->runtime && (header->size & (header->size-1)))){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct mixed_delay_tap *params = (struct mixed_delay_tap *)(header+1);
+  if(!delay_segment_set(MIXED_DELAY_TAP_COUNT, &header->count, segment))
+    return 0;
+  for(uint32_t t=0; t<header->count; ++t){
+    if(!delay_segment_set(MIXED_DELAY_TAP, &params[t], segment))
+      return 0;
+  }
+  if(header->runtime){
+    uint32_t *phases = (uint32_t *)(params + header->count);
+    float *ring = (float *)(phases + header->count);
+    if(data->size < header->size){
+      float *grown = mixed_calloc(header->size, sizeof(float));
+      if(!grown){
+        mixed_err(MIXED_OUT_OF_MEMORY);
+        return 0;
+      }
+      mixed_free(data->ring);
+      data->ring = grown;
+      data->size = header->size;
+    }
+    // Lay the saved history out behind the saved position.
+    memset(data->ring, 0, data->size*sizeof(float));
+    data->position = header->position;
+    for(uint32_t i=1; i<=header->size; ++i)
+      data->ring[(data->position-i) & (data->size-1)] = ring[(header->position-i) & (header->size-1)];
+    for(uint32_t t=0; t<header->count; ++t)
+      data->taps[t].phase = phases[t];
+  }
+  return 1;
+}
+
 int delay_segment_free(struct mixed_segment *segment){
-  if(segment->data){
-    mixed_free_buffer(&((struct delay_segment_data *)segment->data)->buffer);
-    mixed_free(segment->data);
+  struct delay_segment_data *data = (struct delay_segment_data *)segment->data;
+  if(data){
+    if(data->ring)
+      mixed_free(data->ring);
+    if(data->taps)
+      mixed_free(data->taps);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
@@ -23,15 +171,11 @@ int delay_segment_start(struct mixed_segment *segment){
     mixed_err(MIXED_BUFFER_MISSING);
     return 0;
   }
-  // Fill the entire buffer with nothing to initiate the delay.
-  mixed_buffer_clear(&data->buffer);
-  uint32_t samples = UINT32_MAX;
-  float *out;
-  mixed_buffer_request_write(&out, &samples, &data->buffer);
-  for(uint32_t i=0; i<samples; ++i){
-    out[i] = 0.0f;
-  }
-  mixed_buffer_finish_write(samples, &data->buffer);
+  // Start out with nothing but silence in the past.
+  memset(data->ring, 0, data->size*sizeof(float));
+  data->position = 0;
+  for(uint32_t t=0; t<data->count; ++t)
+    data->taps[t].phase = 0;
   return 1;
 }
 
@@ -69,31 +213,103 @@ int delay_segment_set_out(uint32_t field, uint32_t location, void *buffer, struc
   }
 }
 
+VECTORIZE static void delay_add(float *restrict out, const float *restrict ring, float gain, uint32_t samples){
+  for(uint32_t j=0; j<samples; ++j){
+    out[j] += ring[j] * gain;
+  }
+}
+
+// An unmodulated tap reads whole samples, at most in two contiguous
+// spans of the ring.
+static void delay_read(struct delay_tap *tap, uint32_t position, float *out, uint32_t samples, struct delay_segment_data *data){
+  uint32_t mask = data->size - 1;
+  uint32_t start = (position - (uint32_t)tap->delay) & mask;
+  uint32_t first = MIN(samples, data->size - start);
+  delay_add(out, data->ring+start, tap->params.gain, first);
+  delay_add(out+first, data->ring, tap->params.gain, samples-first);
+}
+
+// A modulated tap sweeps its delay with a sine and interpolates
+// linearly between the two samples around the fractional read point.
+static void delay_read_modulated(struct delay_tap *tap, uint32_t position, float *out, uint32_t samples, struct delay_segment_data *data){
+  const float *sine = wavetable_get(MIXED_SINE, tap->increment);
+  const float *ring = data->ring;
+  uint32_t mask = data->size - 1;
+  uint32_t phase = tap->phase, increment = tap->increment;
+  float delay = tap->delay, depth = tap->depth, gain = tap->params.gain;
+  for(uint32_t j=0; j<samples; ++j){
+    float offset = (float)j - MAX(0.0f, delay + depth * wavetable_sample(sine, phase + j*increment));
+    float whole = floorf(offset);
+    float fraction = offset - whole;
+    uint32_t index = position + (int32_t)whole;
+    float a = ring[index & mask];
+    float b = ring[(index+1) & mask];
+    out[j] += (a + (b - a) * fraction) * gain;
+  }
+  tap->phase = phase + samples*increment;
+}
+
+static void delay_process(float *in, float *out, uint32_t samples, struct delay_segment_data *data){
+  uint32_t mask = data->size - 1;
+  for(uint32_t c=0; c<samples; c+=DELAY_CHUNK){
+    uint32_t chunk = MIN(DELAY_CHUNK, samples-c);
+    uint32_t position = data->position;
+    // Store the input first, which also makes working in place safe.
+    uint32_t start = position & mask;
+    uint32_t first = MIN(chunk, data->size - start);
+    memcpy(data->ring+start, in+c, first*sizeof(float));
+    memcpy(data->ring, in+c+first, (chunk-first)*sizeof(float));
+
+    memset(out+c, 0, chunk*sizeof(float));
+    for(uint32_t t=0; t<data->count; ++t){
+      struct delay_tap *tap = &data->taps[t];
+      if(tap->params.gain == 0.0f) continue;
+      if(tap->depth == 0.0f){
+        delay_read(tap, position, out+c, chunk, data);
+      }else{
+        delay_read_modulated(tap, position, out+c, chunk, data);
+      }
+    }
+    data->position = position + chunk;
+  }
+}
+
 int delay_segment_mix(struct mixed_segment *segment){
   struct delay_segment_data *data = (struct delay_segment_data *)segment->data;
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
 
-  mixed_buffer_transfer(&data->buffer, data->out);
-  mixed_buffer_transfer(data->in, &data->buffer);
-
+  if(data->in == data->out){
+    mixed_buffer_request_read(&in, &samples, data->in);
+    delay_process(in, in, samples, data);
+    // The echoes replace whatever silence was there.
+    data->in->is_silent = 0;
+  }else{
+    mixed_buffer_request_read(&in, &samples, data->in);
+    mixed_buffer_request_write(&out, &samples, data->out);
+    delay_process(in, out, samples, data);
+    mixed_buffer_finish_read(samples, data->in);
+    mixed_buffer_finish_write(samples, data->out);
+  }
   return 1;
 }
 
 int delay_segment_mix_bypass(struct mixed_segment *segment){
   struct delay_segment_data *data = (struct delay_segment_data *)segment->data;
-  
+
   return mixed_buffer_transfer(data->in, data->out);
 }
 
 int delay_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
   IGNORE(segment);
-  
+
   info->name = "delay";
   info->description = "Delay the output by some time.";
   info->flags = MIXED_INPLACE;
   info->min_inputs = 1;
   info->max_inputs = 1;
   info->outputs = 1;
-  
+
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BUFFER,
                  MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
@@ -103,6 +319,14 @@ int delay_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The time, in seconds, by which the output is delayed.");
 
+  set_info_field(field++, MIXED_DELAY_TAP,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "One of the taps that read from the delay line.");
+
+  set_info_field(field++, MIXED_DELAY_TAP_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of taps that read from the delay line.");
+
   set_info_field(field++, MIXED_SAMPLERATE,
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
@@ -110,7 +334,11 @@ int delay_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
-  
+
+  set_info_field(field++, MIXED_STATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "All taps, and the contents of the delay line.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -118,9 +346,19 @@ int delay_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
 int delay_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
   struct delay_segment_data *data = (struct delay_segment_data *)segment->data;
   switch(field){
-  case MIXED_DELAY_TIME: *((float *)value) = data->time; break;
+  case MIXED_DELAY_TIME: *((float *)value) = data->taps[0].params.time; break;
+  case MIXED_DELAY_TAP: {
+    struct mixed_delay_tap *tap = (struct mixed_delay_tap *)value;
+    if(data->count <= tap->tap){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    *tap = data->taps[tap->tap].params;
+    break; }
+  case MIXED_DELAY_TAP_COUNT: *((uint32_t *)value) = data->count; break;
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == delay_segment_mix_bypass); break;
+  case MIXED_STATE: return delay_get_state((struct mixed_segment_state *)value, data);
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -135,16 +373,46 @@ int delay_segment_set(uint32_t field, void *value, struct mixed_segment *segment
       return 0;
     }
     data->samplerate = *(uint32_t *)value;
-    mixed_buffer_resize(ceil(data->samplerate * data->time), &data->buffer);
-    break;
+    for(uint32_t t=0; t<data->count; ++t)
+      delay_update_tap(&data->taps[t], data);
+    return delay_fit_ring(data);
   case MIXED_DELAY_TIME:
     if(*(float *)value < 0.0){
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
-    data->time = *(float *)value;
-    mixed_buffer_resize(ceil(data->samplerate * data->time), &data->buffer);
-    break;
+    data->taps[0].params.time = *(float *)value;
+    delay_update_tap(&data->taps[0], data);
+    return delay_fit_ring(data);
+  case MIXED_DELAY_TAP: {
+    struct mixed_delay_tap *params = (struct mixed_delay_tap *)value;
+    if(data->count <= params->tap || params->time < 0.0 ||
+       params->depth < 0.0 || params->rate < 0.0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    struct delay_tap *tap = &data->taps[params->tap];
+    tap->params = *params;
+    delay_update_tap(tap, data);
+    return delay_fit_ring(data); }
+  case MIXED_DELAY_TAP_COUNT: {
+    uint32_t count = *(uint32_t *)value;
+    if(count == 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(count == data->count) break;
+    struct delay_tap *taps = crealloc(data->taps, data->count, count, sizeof(struct delay_tap));
+    if(!taps){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    // New taps start out silent.
+    for(uint32_t t=data->count; t<count; ++t)
+      taps[t].params.tap = t;
+    data->taps = taps;
+    data->count = count;
+    break; }
   case MIXED_BYPASS:
     if(*(bool *)value){
       segment->mix = delay_segment_mix_bypass;
@@ -152,6 +420,8 @@ int delay_segment_set(uint32_t field, void *value, struct mixed_segment *segment
       segment->mix = delay_segment_mix;
     }
     break;
+  case MIXED_STATE:
+    return delay_set_state((struct mixed_segment_state *)value, segment);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -160,20 +430,32 @@ int delay_segment_set(uint32_t field, void *value, struct mixed_segment *segment
 }
 
 MIXED_EXPORT int mixed_make_segment_delay(float time, uint32_t samplerate, struct mixed_segment *segment){
+  if(time < 0.0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
   struct delay_segment_data *data = mixed_calloc(1, sizeof(struct delay_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
 
-  if(!mixed_make_buffer(ceil(time * samplerate), &data->buffer)){
-    mixed_free(data);
-    return 0;
+  data->taps = mixed_calloc(1, sizeof(struct delay_tap));
+  if(!data->taps){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
   }
 
-  data->time = time;
+  wavetable_init();
+  data->count = 1;
   data->samplerate = samplerate;
-  
+  data->taps[0].params.time = time;
+  data->taps[0].params.gain = 1.0;
+  delay_update_tap(&data->taps[0], data);
+  if(!delay_fit_ring(data))
+    goto cleanup;
+
   segment->free = delay_segment_free;
   segment->start = delay_segment_start;
   segment->mix = delay_segment_mix;
@@ -184,6 +466,12 @@ MIXED_EXPORT int mixed_make_segment_delay(float time, uint32_t samplerate, struc
   segment->set = delay_segment_set;
   segment->data = data;
   return 1;
+
+ cleanup:
+  if(data->taps)
+    mixed_free(data->taps);
+  mixed_free(data);
+  return 0;
 }
 
 int __make_delay(void *args, struct mixed_segment *segment){
@@ -70,12 +70,22 @@ int distribute_start(struct mixed_segment *segment){
     return 0;
   }
 
+  // Shared buffers keep their positions elsewhere, so we cannot
+  // mirror them into the virtual outputs.
+  if(in->_shared){
+    mixed_err(MIXED_NOT_IMPLEMENTED);
+    return 0;
+  }
+
   for(uint32_t i=0; i<data->count; ++i){
     struct mixed_buffer *buffer = data->out[i];
     buffer->_data = in->_data;
     buffer->size = in->size;
+    buffer->is_mirrored = in->is_mirrored;
+    buffer->is_half = in->is_half;
     buffer->read = in->read;
     buffer->write = in->write;
+    buffer->is_silent = in->is_silent;
   }
 
   data->was_available = 0;
@@ -99,6 +109,7 @@ int distribute_mix(struct mixed_segment *segment){
     struct mixed_buffer *buffer = data->out[i];
     atomic_write(buffer->write, write);
     atomic_write(buffer->read, read);
+    buffer->is_silent = in->is_silent;
   }
   return 1;
 }
@@ -0,0 +1,287 @@
+#include "../internal.h"
+
+// Bands are designed as they change and only copied into the bank at
+// the start of the next mix, so the mix itself never touches trig.
+struct equalizer_segment_data{
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
+  float **ins;
+  float **outs;
+  struct mixed_equalizer_band *bands;
+  struct biquad_data *designs;
+  struct biquad_bank bank;
+  uint32_t count;
+  uint32_t samplerate;
+  channel_t channels;
+  char dirty;
+};
+
+static void free_equalizer_data(struct equalizer_segment_data *data){
+  if(data->in) mixed_free(data->in);
+  if(data->out) mixed_free(data->out);
+  if(data->ins) mixed_free(data->ins);
+  if(data->outs) mixed_free(data->outs);
+  if(data->bands) mixed_free(data->bands);
+  if(data->designs) mixed_free(data->designs);
+  free_biquad_bank(&data->bank);
+  mixed_free(data);
+}
+
+static int equalizer_design(uint32_t band, struct equalizer_segment_data *data){
+  struct mixed_equalizer_band *params = &data->bands[band];
+  if(!biquad_design(params->type, data->samplerate, params->frequency, params->Q, params->gain, &data->designs[band]))
+    return 0;
+  atomic_write(data->dirty, 1);
+  return 1;
+}
+
+static void equalizer_apply(struct equalizer_segment_data *data){
+  atomic_write(data->dirty, 0);
+  for(uint32_t b=0; b<data->count; ++b){
+    for(channel_t c=0; c<data->channels; ++c){
+      biquad_bank_set(c, b, &data->designs[b], &data->bank);
+    }
+  }
+}
+
+int equalizer_segment_free(struct mixed_segment *segment){
+  if(segment->data)
+    free_equalizer_data((struct equalizer_segment_data *)segment->data);
+  segment->data = 0;
+  return 1;
+}
+
+int equalizer_segment_start(struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] == 0 || data->out[c] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  equalizer_apply(data);
+  biquad_bank_reset(&data->bank);
+  return 1;
+}
+
+int equalizer_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->in[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int equalizer_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int equalizer_segment_mix(struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+  if(atomic_read(data->dirty))
+    equalizer_apply(data);
+
+  uint32_t samples = UINT32_MAX;
+  for(channel_t c=0; c<data->channels; ++c){
+    mixed_buffer_request_read(&data->ins[c], &samples, data->in[c]);
+  }
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] == data->out[c])
+      data->outs[c] = data->ins[c];
+    else
+      mixed_buffer_request_write(&data->outs[c], &samples, data->out[c]);
+  }
+  biquad_bank_process(data->ins, data->outs, samples, &data->bank);
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] != data->out[c]){
+      mixed_buffer_finish_read(samples, data->in[c]);
+      mixed_buffer_finish_write(samples, data->out[c]);
+    }else{
+      data->in[c]->is_silent = 0;
+    }
+  }
+  return 1;
+}
+
+int equalizer_segment_mix_bypass(struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+  for(channel_t c=0; c<data->channels; ++c){
+    mixed_buffer_transfer(data->in[c], data->out[c]);
+  }
+  return 1;
+}
+
+int equalizer_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+
+  info->name = "equalizer";
+  info->description = "A multi-band equalizer.";
+  info->flags = MIXED_INPLACE;
+  info->min_inputs = data->channels;
+  info->max_inputs = data->channels;
+  info->outputs = data->channels;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_EQUALIZER_BAND,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The parameters of one of the bands.");
+
+  set_info_field(field++, MIXED_EQUALIZER_BAND_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of bands in the cascade.");
+
+  set_info_field(field++, MIXED_SAMPLERATE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The samplerate at which the segment operates.");
+
+  set_info_field(field++, MIXED_BYPASS,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Bypass the segment's processing.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int equalizer_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+  struct mixed_equalizer_band *band = (struct mixed_equalizer_band *)value;
+  switch(field){
+  case MIXED_EQUALIZER_BAND:
+    if(data->count <= band->band){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    *band = data->bands[band->band];
+    break;
+  case MIXED_EQUALIZER_BAND_COUNT: *((uint32_t *)value) = data->count; break;
+  case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  case MIXED_BYPASS: *((bool *)value) = (segment->mix == equalizer_segment_mix_bypass); break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int equalizer_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct equalizer_segment_data *data = (struct equalizer_segment_data *)segment->data;
+  struct mixed_equalizer_band *band = (struct mixed_equalizer_band *)value;
+  switch(field){
+  case MIXED_EQUALIZER_BAND:
+    if(data->count <= band->band ||
+       band->type < MIXED_LOWPASS || MIXED_HIGHSHELF < band->type ||
+       band->frequency <= 0 || data->samplerate < band->frequency){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->bands[band->band] = *band;
+    return equalizer_design(band->band, data);
+  case MIXED_SAMPLERATE:
+    if(*(uint32_t *)value <= 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->samplerate = *(uint32_t *)value;
+    for(uint32_t b=0; b<data->count; ++b){
+      if(!equalizer_design(b, data)) return 0;
+    }
+    break;
+  case MIXED_BYPASS:
+    biquad_bank_reset(&data->bank);
+    if(*(bool *)value){
+      segment->mix = equalizer_segment_mix_bypass;
+    }else{
+      segment->mix = equalizer_segment_mix;
+    }
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_equalizer(channel_t channels, uint32_t bands, uint32_t samplerate, struct mixed_segment *segment){
+  if(channels == 0 || bands == 0 || samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct equalizer_segment_data *data = mixed_calloc(1, sizeof(struct equalizer_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->in = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  data->out = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  data->ins = mixed_calloc(channels, sizeof(float *));
+  data->outs = mixed_calloc(channels, sizeof(float *));
+  data->bands = mixed_calloc(bands, sizeof(struct mixed_equalizer_band));
+  data->designs = mixed_calloc(bands, sizeof(struct biquad_data));
+  if(!data->in || !data->out || !data->ins || !data->outs
+     || !data->bands || !data->designs){
+    free_equalizer_data(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_biquad_bank(channels, bands, &data->bank)){
+    free_equalizer_data(data);
+    return 0;
+  }
+
+  data->channels = channels;
+  data->count = bands;
+  data->samplerate = samplerate;
+  for(uint32_t b=0; b<bands; ++b){
+    data->bands[b].band = b;
+    data->bands[b].type = MIXED_PEAKING;
+    data->bands[b].frequency = MIN(1000.0f, samplerate*0.25f);
+    data->bands[b].Q = 1.0f;
+    data->bands[b].gain = 0.0f;
+    equalizer_design(b, data);
+  }
+  equalizer_apply(data);
+
+  segment->free = equalizer_segment_free;
+  segment->start = equalizer_segment_start;
+  segment->mix = equalizer_segment_mix;
+  segment->set_in = equalizer_segment_set_in;
+  segment->set_out = equalizer_segment_set_out;
+  segment->info = equalizer_segment_info;
+  segment->get = equalizer_segment_get;
+  segment->set = equalizer_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_equalizer(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_equalizer(ARG(channel_t, 0), ARG(uint32_t, 1), ARG(uint32_t, 2), segment);
+}
+
+REGISTER_SEGMENT(equalizer, __make_equalizer, 3, {
+    {.description = "channels", .type = MIXED_CHANNEL_T},
+    {.description = "bands", .type = MIXED_UINT32},
+    {.description = "samplerate", .type = MIXED_UINT32}})
@@ -64,58 +64,62 @@ int fade_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct
   }
 }
 
-float fade_linear(float x){
-  return x;
-}
+// The easing curves are polynomials in the fade position, which is
+// linear in the sample index, so a whole block is rendered with one
+// branch-free loop per curve.
+#define FADE_KERNEL(NAME, EASE)                                         \
+  VECTORIZE static void NAME(const float *in, float *out, float x0, float dx, float from, float range, uint32_t samples){ \
+    for(uint32_t i=0; i<samples; ++i){                                  \
+      float x = MIN(x0 + dx*i, 1.0f);                                   \
+      out[i] = in[i]*(from+(EASE)*range);                               \
+    }                                                                   \
+  }
 
-float fade_cubic_in(float x){
-  return x*x*x;
-}
+FADE_KERNEL(fade_linear, x)
+FADE_KERNEL(fade_cubic_in, x*x*x)
+FADE_KERNEL(fade_cubic_out, (x-1.0f)*(x-1.0f)*(x-1.0f)+1.0f)
+FADE_KERNEL(fade_cubic_in_out, (x < 0.5f)
+            ? 4.0f*x*x*x
+            : (2.0f*x-2.0f)*(2.0f*x-2.0f)*(2.0f*x-2.0f)/2.0f+1.0f)
 
-float fade_cubic_out(float x){
-  x = x-1.0;
-  return x*x*x+1.0;
-}
+static void fade_process(float *in, float *out, uint32_t samples, struct fade_segment_data *data){
+  double time = data->time_passed;
+  double endtime = data->time;
+  double sampletime = 1.0/data->samplerate;
+  // A fade without any time is over right away.
+  float x0 = (time < endtime)? time/endtime : 1.0f;
+  float dx = (0.0 < endtime)? sampletime/endtime : 0.0f;
+  float from = data->from;
+  float range = data->to - data->from;
 
-float fade_cubic_in_out(float x){
-  if(x < 0.5f){
-    x = 2.0*x;
-    return x*x*x/2.0;
-  }else{
-    x = 2.0*(x-1.0);
-    return x*x*x/2.0+1.0;
+  switch(data->type){
+  case MIXED_CUBIC_IN: fade_cubic_in(in, out, x0, dx, from, range, samples); break;
+  case MIXED_CUBIC_OUT: fade_cubic_out(in, out, x0, dx, from, range, samples); break;
+  case MIXED_CUBIC_IN_OUT: fade_cubic_in_out(in, out, x0, dx, from, range, samples); break;
+  default: fade_linear(in, out, x0, dx, from, range, samples); break;
   }
+  data->time_passed = time + sampletime*samples;
 }
 
 int fade_segment_mix(struct mixed_segment *segment){
   struct fade_segment_data *data = (struct fade_segment_data *)segment->data;
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
 
-  double time = data->time_passed;
-  float endtime = data->time;
-  float from = data->from;
-  float range = data->to - data->from;
-  double sampletime = 1.0f/data->samplerate;
-  
-  float (*ease)(float x);
-  switch(data->type){
-  case MIXED_LINEAR: ease = fade_linear; break;
-  case MIXED_CUBIC_IN: ease = fade_cubic_in; break;
-  case MIXED_CUBIC_OUT: ease = fade_cubic_out; break;
-  case MIXED_CUBIC_IN_OUT: ease = fade_cubic_in_out; break;
-  default: ease = fade_linear; break;
+  // Silence stays silent, only the fade has to move on.
+  if(mixed_buffer_is_silent(data->in)){
+    samples = buffer_pass_silence(data->in, data->out);
+    data->time_passed += (double)samples/data->samplerate;
+  }else if(data->in == data->out){
+    mixed_buffer_request_read(&in, &samples, data->in);
+    fade_process(in, in, samples, data);
+  }else{
+    mixed_buffer_request_read(&in, &samples, data->in);
+    mixed_buffer_request_write(&out, &samples, data->out);
+    fade_process(in, out, samples, data);
+    mixed_buffer_finish_read(samples, data->in);
+    mixed_buffer_finish_write(samples, data->out);
   }
-  
-  // NOTE: You could probably get away with having the same fade factor
-  //       for the entirety of the sample range if the total duration
-  //       of the buffer is small enough (~1ms?) as the human ear
-  //       wouldn't be able to properly notice it.
-  with_mixed_buffer_transfer(i, samples, in, data->in, out, data->out, {
-      float x = (time < endtime)? time/endtime : 1.0f;
-      float fade = from+ease(x)*range;
-      out[i] = in[i]*fade;
-      time += sampletime;
-    });
-  data->time_passed = time;
   return 1;
 }
 
@@ -9,18 +9,30 @@ enum state{
 };
 
 struct gate_segment_data{
-  struct mixed_buffer *in;
-  struct mixed_buffer *out;
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
+  // Opens and closes the gate in place of the inputs if set.
+  struct mixed_buffer *sidechain;
+  channel_t channels;
   float close_threshold;
   float open_threshold;
   float attack;
   float hold;
   float release;
   uint32_t samplerate;
-  float time;
+  // The gain of the next sample, and for HOLDING the samples left.
+  float gain;
+  uint32_t holding;
   enum state state;
 };
 
+// Transitions are searched for a block of samples at a time, as a
+// compare over the block vectorises where an early exit does not.
+#define GATE_SCAN 16
+// Linked channels are detected on their peak, built up this many
+// samples at a time.
+#define GATE_BLOCK 256
+
 float db_to_linear(float db){
   return pow(10, db/20.0);
 }
@@ -30,8 +42,11 @@ float linear_to_db(float linear){
 }
 
 int gate_segment_free(struct mixed_segment *segment){
-  if(segment->data){
-    mixed_free(segment->data);
+  struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
+  if(data){
+    if(data->in) mixed_free(data->in);
+    if(data->out) mixed_free(data->out);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
@@ -39,11 +54,15 @@ int gate_segment_free(struct mixed_segment *segment){
 
 int gate_segment_start(struct mixed_segment *segment){
   struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
-  data->time = 0.0;
+  data->gain = 0.0f;
+  data->holding = 0;
+  data->state = CLOSED;
 
-  if(data->in == 0 || data->out == 0){
-    mixed_err(MIXED_BUFFER_MISSING);
-    return 0;
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] == 0 || data->out[c] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
   }
 
   return 1;
@@ -54,8 +73,12 @@ int gate_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct
 
   switch(field){
   case MIXED_BUFFER:
-    if(location == 0){
-      data->in = (struct mixed_buffer *)buffer;
+    if(location < data->channels){
+      data->in[location] = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    if(location == data->channels){
+      data->sidechain = (struct mixed_buffer *)buffer;
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -71,8 +94,8 @@ int gate_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct
 
   switch(field){
   case MIXED_BUFFER:
-    if(location == 0){
-      data->out = (struct mixed_buffer *)buffer;
+    if(location < data->channels){
+      data->out[location] = (struct mixed_buffer *)buffer;
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -83,93 +106,229 @@ int gate_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct
   }
 }
 
-int gate_segment_mix(struct mixed_segment *segment){
-  struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
+// Returns the first sample at or above the threshold, or samples.
+VECTORIZE static uint32_t gate_find_above(const float *in, uint32_t samples, float threshold){
+  uint32_t i = 0;
+  for(; i+GATE_SCAN<=samples; i+=GATE_SCAN){
+    int hits = 0;
+    for(uint32_t j=0; j<GATE_SCAN; ++j)
+      hits |= (threshold <= fabsf(in[i+j]));
+    if(hits) break;
+  }
+  for(; i<samples; ++i)
+    if(threshold <= fabsf(in[i])) break;
+  return i;
+}
+
+// Returns the first sample below the threshold, or samples.
+VECTORIZE static uint32_t gate_find_below(const float *in, uint32_t samples, float threshold){
+  uint32_t i = 0;
+  for(; i+GATE_SCAN<=samples; i+=GATE_SCAN){
+    int hits = 0;
+    for(uint32_t j=0; j<GATE_SCAN; ++j)
+      hits |= (fabsf(in[i+j]) < threshold);
+    if(hits) break;
+  }
+  for(; i<samples; ++i)
+    if(fabsf(in[i]) < threshold) break;
+  return i;
+}
+
+// Scales a span by a gain of gain + j*step. In and out may alias.
+VECTORIZE static void gate_ramp(const float *in, float *out, uint32_t samples, float gain, float step){
+  for(uint32_t j=0; j<samples; ++j)
+    out[j] = in[j] * (gain + step*(float)j);
+}
+
+static void gate_copy(const float *in, float *out, uint32_t samples){
+  if(in != out) memcpy(out, in, samples*sizeof(float));
+}
+
+VECTORIZE static void gate_peak(float **in, channel_t channels, uint32_t pos, uint32_t samples, float *peak){
+  for(uint32_t j=0; j<samples; ++j)
+    peak[j] = 0.0f;
+  for(channel_t c=0; c<channels; ++c){
+    const float *channel = in[c]+pos;
+    for(uint32_t j=0; j<samples; ++j)
+      peak[j] = MAX(peak[j], fabsf(channel[j]));
+  }
+}
 
-  float stime = 1.0/data->samplerate;
-  float time = data->time;
+// The state only changes at a handful of samples per block, so each
+// pass finds the next transition in the detector signal and handles
+// the whole span up to it on every channel. The key holds the
+// detector samples starting at pos. Returns whether the gate stayed
+// closed over the whole block.
+static int gate_process(float **in, float **out, uint32_t pos, const float *key, uint32_t samples, struct gate_segment_data *data){
+  channel_t channels = data->channels;
   float open = data->open_threshold;
-  float close = data->close_threshold;
-  float attack = data->attack;
-  float hold = data->hold;
-  float release = data->release;
-  float volume = 1.0;
-  
-  with_mixed_buffer_transfer(i, samples, in, data->in, out, data->out, {
-      float sample = in[i];
-      switch(data->state){
-      case CLOSED:
-        volume = 0.0;
-        if(open <= sample){
-          time = 0.0;
-          data->state = ATTACKING;
-        }
-        break;
-      case ATTACKING:
-        if(attack < time){
-          data->state = OPEN;
-        }else{
-          volume = time/attack;
-          time += stime;
-        }
-        break;
-      case OPEN:
-        if(sample < close){
-          time = hold;
-          data->state = HOLDING;
-        }
-        break;
-      case HOLDING:
-        if(open <= sample){
-          data->state = OPEN;
-        }else if(time <= 0){
-          time = release;
-          data->state = RELEASING;
-        }else{
-          time -= stime;
-        }
-        break;
-      case RELEASING:
-        if(open <= sample){
-          volume = time/release;
-          time = time/release*attack;
-          data->state = ATTACKING;
-        }else if(time <= 0){
-          volume = 0.0;
-          time = 0.0;
-          data->state = CLOSED;
-        }else{
-          volume = time/release;
-          time -= stime;
-        }
-        break;
+  // A closing threshold above the opening one would let a sample in
+  // between open and close the gate without ever moving on.
+  float close = MIN(data->close_threshold, open);
+  float attack = MAX(1.0f, data->attack * data->samplerate);
+  float release = MAX(1.0f, data->release * data->samplerate);
+  uint32_t hold = data->hold * data->samplerate;
+  float gain = data->gain;
+  uint32_t i = 0;
+  int closed = 1;
+
+  while(i < samples){
+    if(data->state != CLOSED) closed = 0;
+    uint32_t left = samples - i;
+    uint32_t at = pos + i;
+    uint32_t span;
+    switch(data->state){
+    case CLOSED:
+      span = gate_find_above(key+i, left, open);
+      for(channel_t c=0; c<channels; ++c)
+        memset(out[c]+at, 0, span*sizeof(float));
+      if(span < left){
+        gain = 0.0f;
+        data->state = ATTACKING;
       }
-      out[i] = sample * volume;
-    })
-  data->time = time;
+      break;
+    case ATTACKING: {
+      uint32_t needed = (uint32_t)ceilf((1.0f - gain) * attack);
+      span = MIN(left, needed);
+      for(channel_t c=0; c<channels; ++c)
+        gate_ramp(in[c]+at, out[c]+at, span, gain, 1.0f / attack);
+      gain += span / attack;
+      if(span == needed){
+        gain = 1.0f;
+        data->state = OPEN;
+      }
+    } break;
+    case OPEN:
+      span = gate_find_below(key+i, left, close);
+      for(channel_t c=0; c<channels; ++c)
+        gate_copy(in[c]+at, out[c]+at, span);
+      if(span < left){
+        data->holding = hold;
+        data->state = HOLDING;
+      }
+      break;
+    case HOLDING: {
+      uint32_t limit = MIN(left, data->holding);
+      span = gate_find_above(key+i, limit, open);
+      for(channel_t c=0; c<channels; ++c)
+        gate_copy(in[c]+at, out[c]+at, span);
+      data->holding -= span;
+      if(span < limit){
+        data->state = OPEN;
+      }else if(data->holding == 0){
+        data->state = RELEASING;
+      }
+    } break;
+    case RELEASING: {
+      uint32_t needed = (uint32_t)ceilf(gain * release);
+      uint32_t limit = MIN(left, needed);
+      span = gate_find_above(key+i, limit, open);
+      for(channel_t c=0; c<channels; ++c)
+        gate_ramp(in[c]+at, out[c]+at, span, gain, -1.0f / release);
+      gain = MAX(0.0f, gain - span / release);
+      if(span < limit){
+        // Reopen from wherever the release got to.
+        data->state = ATTACKING;
+      }else if(span == needed){
+        gain = 0.0f;
+        data->state = CLOSED;
+      }
+    } break;
+    default:
+      span = left;
+      break;
+    }
+    i += span;
+  }
+  data->gain = gain;
+  return closed;
+}
+
+int gate_segment_mix(struct mixed_segment *segment){
+  struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
+  channel_t channels = data->channels;
+  uint32_t samples = UINT32_MAX;
+  float *in[channels], *out[channels];
+  float *side = 0;
+  int closed = 1;
+
+  for(channel_t c=0; c<channels; ++c)
+    mixed_buffer_request_read(&in[c], &samples, data->in[c]);
+  if(data->sidechain)
+    mixed_buffer_request_read(&side, &samples, data->sidechain);
+  for(channel_t c=0; c<channels; ++c){
+    if(data->in[c] == data->out[c])
+      out[c] = in[c];
+    else
+      mixed_buffer_request_write(&out[c], &samples, data->out[c]);
+  }
+
+  if(side){
+    closed = gate_process(in, out, 0, side, samples, data);
+  }else if(channels == 1){
+    closed = gate_process(in, out, 0, in[0], samples, data);
+  }else{
+    float peak[GATE_BLOCK];
+    for(uint32_t pos=0; pos<samples; pos+=GATE_BLOCK){
+      uint32_t block = MIN(GATE_BLOCK, samples-pos);
+      gate_peak(in, channels, pos, block, peak);
+      closed &= gate_process(in, out, pos, peak, block, data);
+    }
+  }
+
+  // A closed gate and a silent input both leave nothing but silence,
+  // as long as the gate saw any samples at all. In place that has to
+  // cover the whole buffer, as the samples a short sidechain held us
+  // back from stay in it untouched.
+  if(samples == 0) closed = 0;
+  if(side)
+    mixed_buffer_finish_read(samples, data->sidechain);
+  for(channel_t c=0; c<channels; ++c){
+    if(data->in[c] == data->out[c]){
+      if(closed && samples == mixed_buffer_available_read(data->in[c]))
+        data->in[c]->is_silent = 1;
+    }else{
+      int silent = closed || mixed_buffer_is_silent(data->in[c]);
+      mixed_buffer_finish_read(samples, data->in[c]);
+      if(silent)
+        mixed_buffer_finish_write_silence(samples, data->out[c]);
+      else
+        mixed_buffer_finish_write(samples, data->out[c]);
+    }
+  }
   return 1;
 }
 
+// The sidechain is still drained, so that its producer does not stall.
 int gate_segment_mix_bypass(struct mixed_segment *segment){
   struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
-  
-  return mixed_buffer_transfer(data->in, data->out);
+  for(channel_t c=0; c<data->channels; ++c){
+    if(!mixed_buffer_transfer(data->in[c], data->out[c]))
+      return 0;
+  }
+  if(data->sidechain){
+    float *side;
+    uint32_t samples = UINT32_MAX;
+    mixed_buffer_request_read(&side, &samples, data->sidechain);
+    mixed_buffer_finish_read(samples, data->sidechain);
+  }
+  return 1;
 }
 
 int gate_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
-  IGNORE(segment);
+  struct gate_segment_data *data = (struct gate_segment_data *)segment->data;
   
   info->name = "gate";
   info->description = "A noise gate segment to filter out low-volume frequencies.";
   info->flags = MIXED_INPLACE;
-  info->min_inputs = 1;
-  info->max_inputs = 1;
-  info->outputs = 1;
+  info->min_inputs = data->channels;
+  info->max_inputs = data->channels+1;
+  info->outputs = data->channels;
 
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BUFFER,
                  MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
-                 "The buffer for audio data attached to the location.");
+                 "The buffer for audio data attached to the location. The input after the last channel is the sidechain.");
 
   set_info_field(field++, MIXED_GATE_OPEN_THRESHOLD,
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
@@ -269,13 +428,29 @@ int gate_segment_set(uint32_t field, void *value, struct mixed_segment *segment)
   return 1;
 }
 
-MIXED_EXPORT int mixed_make_segment_gate(uint32_t samplerate, struct mixed_segment *segment){
+MIXED_EXPORT int mixed_make_segment_linked_gate(channel_t channels, uint32_t samplerate, struct mixed_segment *segment){
+  if(channels == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
   struct gate_segment_data *data = mixed_calloc(1, sizeof(struct gate_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
 
+  data->in = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  data->out = mixed_calloc(channels, sizeof(struct mixed_buffer *));
+  if(!data->in || !data->out){
+    if(data->in) mixed_free(data->in);
+    if(data->out) mixed_free(data->out);
+    mixed_free(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->channels = channels;
   data->samplerate = samplerate;
   data->open_threshold = db_to_linear(-24.0);
   data->close_threshold = db_to_linear(-32.0);
@@ -296,6 +471,18 @@ MIXED_EXPORT int mixed_make_segment_gate(uint32_t samplerate, struct mixed_segme
   return 1;
 }
 
+MIXED_EXPORT int mixed_make_segment_gate(uint32_t samplerate, struct mixed_segment *segment){
+  return mixed_make_segment_linked_gate(1, samplerate, segment);
+}
+
+int __make_linked_gate(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_linked_gate(ARG(channel_t, 0), ARG(uint32_t, 1), segment);
+}
+
+REGISTER_SEGMENT(linked_gate, __make_linked_gate, 2, {
+    {.description = "channels", .type = MIXED_UINT8},
+    {.description = "samplerate", .type = MIXED_UINT32}})
+
 int __make_gate(void *args, struct mixed_segment *segment){
   return mixed_make_segment_gate(ARG(uint32_t, 0), segment);
 }
@@ -4,11 +4,21 @@ struct generator_segment_data{
   struct mixed_buffer *out;
   enum mixed_generator_type type;
   float frequency;
-  double phase;
+  uint32_t phase;
+  uint32_t increment;
+  const float *table;
   uint32_t samplerate;
   float volume;
 };
 
+// The phase is a 0.32 fixed point fraction of a cycle, so it wraps by
+// itself and never drifts. The table depends on both the frequency and
+// the type, as higher tones need band-limited tables with fewer harmonics.
+static void generator_update(struct generator_segment_data *data){
+  data->increment = wavetable_increment(data->frequency, data->samplerate);
+  data->table = wavetable_get(data->type, data->increment);
+}
+
 int generator_segment_free(struct mixed_segment *segment){
   if(segment->data)
     mixed_free(segment->data);
@@ -39,50 +49,14 @@ int generator_segment_set_out(uint32_t field, uint32_t location, void *buffer, s
   }
 }
 
-float sine_wave(float frequency, double phase, float samplerate){
-  return sinf(2 * M_PI * frequency * phase / samplerate);
-}
-
-float square_wave(float frequency, double phase, float samplerate){
-  float length = samplerate / frequency;
-  return (fmod(phase, length) < length/2)? 1.0f : -1.0f;
-}
-
-float triangle_wave(float frequency, double phase, float samplerate){
-  float length = samplerate / frequency;
-  float temp = fmod(phase, length) / length;
-  float abs  = (0.5 < temp)? 1.0-temp : temp;
-  return abs*4.0 - 1.0;
-}
-
-float sawtooth_wave(float frequency, double phase, float samplerate){
-  float length = samplerate / frequency;
-  return fmod(phase, length) / length * 2.0 - 1.0;
-}
-
 int generator_segment_mix(struct mixed_segment *segment){
   struct generator_segment_data *data = (struct generator_segment_data *)segment->data;
-  uint32_t phase = data->phase;
-  float (*generator)(float frequency, double phase, float samplerate) = 0;
-  float volume = data->volume;
-
-  switch(data->type){
-  case MIXED_SINE: generator = sine_wave; break;
-  case MIXED_SQUARE: generator = square_wave; break;
-  case MIXED_TRIANGLE: generator = triangle_wave; break;
-  case MIXED_SAWTOOTH: generator = sawtooth_wave; break;
-  }
   
   float *out;
   uint32_t samples = UINT32_MAX;
   mixed_buffer_request_write(&out, &samples, data->out);
-  for(uint32_t i=0; i<samples; ++i){
-    out[i] = generator(data->frequency, phase, data->samplerate) * volume;
-    phase = fmod(phase+1, data->samplerate);
-  }
+  wavetable_render(data->table, &data->phase, data->increment, data->volume, out, samples);
   mixed_buffer_finish_write(samples, data->out);
-
-  data->phase = phase;
   return 1;
 }
 
@@ -148,6 +122,7 @@ int generator_segment_set(uint32_t field, void *value, struct mixed_segment *seg
       return 0;
     }
     data->frequency = *(float *)value;
+    generator_update(data);
     break;
   case MIXED_GENERATOR_TYPE:
     if(*(enum mixed_generator_type *)value < MIXED_SINE ||
@@ -156,6 +131,7 @@ int generator_segment_set(uint32_t field, void *value, struct mixed_segment *seg
       return 0;
     }
     data->type = *(enum mixed_generator_type *)value;
+    generator_update(data);
     break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
@@ -163,6 +139,10 @@ int generator_segment_set(uint32_t field, void *value, struct mixed_segment *seg
 }
 
 MIXED_EXPORT int mixed_make_segment_generator(enum mixed_generator_type type, uint32_t frequency, uint32_t samplerate, struct mixed_segment *segment){
+  if(type < MIXED_SINE || MIXED_SAWTOOTH < type){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
   struct generator_segment_data *data = mixed_calloc(1, sizeof(struct generator_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
@@ -173,6 +153,8 @@ MIXED_EXPORT int mixed_make_segment_generator(enum mixed_generator_type type, ui
   data->type = type;
   data->samplerate = samplerate;
   data->volume = 0.8f;
+  wavetable_init();
+  generator_update(data);
   
   segment->free = generator_segment_free;
   segment->start = generator_segment_start;
@@ -0,0 +1,1166 @@
+#include "../internal.h"
+// How many mixes in a row need to finish within half the deadline
+// before the graph undoes a degradation step.
+#define GRAPH_RELAX_MIXES 64
+// How many samples a run of fused segments processes at a time, so
+// that the strip stays in the cache from one segment to the next.
+#define GRAPH_STRIP 256
+
+struct graph_edge{
+  struct mixed_segment *source;
+  uint32_t source_location;
+  struct mixed_segment *target;
+  uint32_t target_location;
+  struct mixed_buffer *buffer;
+  // Level of the producer and the consumer within the order.
+  uint32_t start;
+  uint32_t end;
+  // The edge leaving the consumer that shares this edge's buffer,
+  // if the consumer processes it in place.
+  struct graph_edge *alias;
+  // Delay line that aligns this edge with the slowest path into its
+  // consumer. delayed counts the samples at the front of the buffer
+  // that already went through it, available the samples there were.
+  float *delay;
+  uint32_t latency;
+  uint32_t delay_at;
+  uint32_t delayed;
+  uint32_t available;
+};
+
+// The state the graph keeps per scheduled segment to meet a deadline.
+struct graph_node{
+  struct mixed_segment *segment;
+  // Running average of the seconds the segment takes to mix.
+  float cost;
+  // Whether the graph switched the segment to its resampling
+  // fallback, and the voice limit it had before, or 0.
+  char lowered;
+  uint32_t voices;
+  // Position in the stack of bypassed segments, or 0.
+  uint32_t bypassed;
+  char optional;
+  // The run this segment leads, or whether it is mixed as part of
+  // another segment's run.
+  struct graph_run *run;
+  char fused;
+};
+
+// In-place segments that each take all of their input from the one
+// before share the same buffers, so the graph mixes them strip by
+// strip instead of passing over the whole buffer once per segment.
+struct graph_run{
+  uint32_t count;
+  uint32_t buffer_count;
+  struct mixed_buffer **buffers;
+  uint32_t *reads;
+  // Whether each buffer was silent before the run, and whether it was
+  // after every strip so far.
+  char *was_silent;
+  char *silent;
+  struct mixed_segment *segments[];
+};
+
+struct graph_segment_data{
+  struct vector nodes;
+  struct vector edges;
+  struct vector order;
+  struct vector buffers;
+  // Spare buffers for edges that may have to move off a shared buffer
+  // during the mix, one per such edge, of which spilled are in use.
+  struct vector spills;
+  uint32_t spilled;
+  // levels[i] is the index into order at which level i starts.
+  uint32_t *levels;
+  uint32_t level_count;
+  struct thread_pool *pool;
+  uint32_t buffer_size;
+  uint32_t block_size;
+  uint32_t latency;
+  // Parallel to order once compiled.
+  struct graph_node *states;
+  uint32_t state_count;
+  struct vector optional;
+  float deadline;
+  uint32_t bypassed;
+  uint32_t voice_shift;
+  uint32_t relaxed;
+  char lowered;
+  char dirty;
+};
+
+
+static int graph_index_of(void *element, struct vector *vector){
+  for(uint32_t i=0; i<vector->count; ++i){
+    if(vector->data[i] == element) return i;
+  }
+  return -1;
+}
+
+static void graph_free_buffer_vector(struct vector *buffers){
+  for(uint32_t i=0; i<buffers->count; ++i){
+    struct mixed_buffer *buffer = (struct mixed_buffer *)buffers->data[i];
+    mixed_free_buffer(buffer);
+    mixed_free(buffer);
+  }
+  vector_clear(buffers);
+}
+
+static void graph_free_buffers(struct graph_segment_data *data){
+  graph_free_buffer_vector(&data->buffers);
+  graph_free_buffer_vector(&data->spills);
+  data->spilled = 0;
+}
+
+static int graph_sort(struct graph_segment_data *data){
+  uint32_t count = data->nodes.count;
+  uint32_t *degree = mixed_calloc(count+1, sizeof(uint32_t));
+  uint32_t *levels = mixed_calloc(count+1, sizeof(uint32_t));
+  if(!degree || !levels){
+    mixed_free(degree);
+    mixed_free(levels);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    degree[graph_index_of(edge->target, &data->nodes)]++;
+  }
+
+  // Kahn's algorithm, taking all ready nodes at once to form a level.
+  // Within a level the insertion order is kept, so the schedule stays
+  // stable across recompilations.
+  uint32_t level_count = 0;
+  vector_clear(&data->order);
+  while(data->order.count < count){
+    uint32_t level = data->order.count;
+    for(uint32_t i=0; i<count; ++i){
+      if(degree[i] == 0){
+        degree[i] = UINT32_MAX;
+        if(!vector_add(data->nodes.data[i], &data->order)) goto cleanup;
+      }
+    }
+    if(data->order.count == level){
+      mixed_err(MIXED_GRAPH_CYCLE);
+      goto cleanup;
+    }
+    for(uint32_t n=level; n<data->order.count; ++n){
+      for(uint32_t i=0; i<data->edges.count; ++i){
+        struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+        if(edge->source == data->order.data[n])
+          degree[graph_index_of(edge->target, &data->nodes)]--;
+      }
+    }
+    levels[level_count++] = level;
+  }
+  levels[level_count] = count;
+  mixed_free(degree);
+  mixed_free(data->levels);
+  data->levels = levels;
+  data->level_count = level_count;
+  return 1;
+
+ cleanup:
+  vector_clear(&data->order);
+  mixed_free(degree);
+  mixed_free(levels);
+  return 0;
+}
+
+static uint32_t graph_level_of(struct mixed_segment *segment, struct graph_segment_data *data){
+  uint32_t index = graph_index_of(segment, &data->order);
+  uint32_t level = 0;
+  while(data->levels[level+1] <= index) ++level;
+  return level;
+}
+
+// With a block size each buffer holds exactly one block. Its samples
+// are then allocated along with the struct and aligned to a cache
+// line by hand, which the buffer only references virtually.
+static struct mixed_buffer *graph_make_block_buffer(struct graph_segment_data *data){
+  char *allocation = mixed_calloc(1, sizeof(struct mixed_buffer) + CACHE_LINE_SIZE + data->block_size*sizeof(float));
+  if(!allocation){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  struct mixed_buffer *buffer = (struct mixed_buffer *)allocation;
+  uintptr_t aligned = ((uintptr_t)(allocation + sizeof(struct mixed_buffer)) + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+  buffer->_data = (float *)aligned;
+  buffer->size = data->block_size;
+  buffer->is_virtual = 1;
+  return buffer;
+}
+
+static struct mixed_buffer *graph_make_buffer(struct vector *buffers, struct graph_segment_data *data){
+  struct mixed_buffer *buffer;
+  if(data->block_size){
+    buffer = graph_make_block_buffer(data);
+    if(!buffer) return 0;
+  }else{
+    buffer = mixed_calloc(1, sizeof(struct mixed_buffer));
+    if(!buffer){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(!mixed_make_buffer(data->buffer_size, buffer)){
+      mixed_free(buffer);
+      return 0;
+    }
+  }
+  if(!vector_add(buffer, buffers)){
+    mixed_free_buffer(buffer);
+    mixed_free(buffer);
+    return 0;
+  }
+  return buffer;
+}
+
+// Every segment's output lags behind by the latency of the slowest
+// path into it plus its own. Each edge then needs to make up for the
+// difference between its source's lag and the lag its target expects.
+static int graph_compensate(struct graph_segment_data *data){
+  uint32_t count = data->order.count;
+  uint32_t *arrival = mixed_calloc(count+1, sizeof(uint32_t));
+  uint32_t *lag = mixed_calloc(count+1, sizeof(uint32_t));
+  if(!arrival || !lag){
+    mixed_free(arrival);
+    mixed_free(lag);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->latency = 0;
+  for(uint32_t n=0; n<count; ++n){
+    struct mixed_segment *node = (struct mixed_segment *)data->order.data[n];
+    for(uint32_t i=0; i<data->edges.count; ++i){
+      struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+      if(edge->target == node)
+        arrival[n] = MAX(arrival[n], lag[graph_index_of(edge->source, &data->order)]);
+    }
+    uint32_t latency = 0;
+    if(!mixed_segment_get(MIXED_LATENCY, &latency, node))
+      latency = 0;
+    lag[n] = arrival[n] + latency;
+    data->latency = MAX(data->latency, lag[n]);
+  }
+  mixed_err(MIXED_NO_ERROR);
+
+  int result = 1;
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    uint32_t latency = arrival[graph_index_of(edge->target, &data->order)]
+      - lag[graph_index_of(edge->source, &data->order)];
+    edge->delay_at = 0;
+    edge->delayed = 0;
+    if(latency != edge->latency){
+      mixed_free(edge->delay);
+      edge->delay = 0;
+      edge->latency = 0;
+      if(latency){
+        edge->delay = mixed_calloc(latency, sizeof(float));
+        if(!edge->delay){
+          mixed_err(MIXED_OUT_OF_MEMORY);
+          result = 0;
+          break;
+        }
+        edge->latency = latency;
+      }
+    }else if(edge->delay){
+      memset(edge->delay, 0, latency*sizeof(float));
+    }
+  }
+  mixed_free(arrival);
+  mixed_free(lag);
+  return result;
+}
+
+// Runs the samples the consumer has not seen yet through the edge's
+// delay line, in place.
+static void graph_delay(struct graph_edge *edge){
+  float *area;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_read(&area, &samples, edge->buffer);
+  float *line = edge->delay;
+  uint32_t size = edge->latency, at = edge->delay_at;
+  for(uint32_t i=edge->delayed; i<samples; ++i){
+    float sample = area[i];
+    area[i] = line[at];
+    line[at] = sample;
+    if(++at == size) at = 0;
+  }
+  edge->delay_at = at;
+  edge->delayed = MAX(edge->delayed, samples);
+  edge->available = mixed_buffer_available_read(edge->buffer);
+}
+
+// An in-place segment can write its output straight into the buffer
+// of the input at the same location, as long as it is the only one
+// reading that input. Bypassing such a segment then costs no copy
+// either, as transferring a buffer onto itself does nothing.
+static struct graph_edge *graph_inplace_input(struct graph_edge *edge, struct graph_segment_data *data){
+  struct mixed_segment_info info = {0};
+  if(!mixed_segment_info(&info, edge->source) || !(info.flags & MIXED_INPLACE))
+    return 0;
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *input = (struct graph_edge *)data->edges.data[i];
+    if(input->target == edge->source && input->target_location == edge->source_location
+       && input->buffer && !input->alias)
+      return input;
+  }
+  return 0;
+}
+
+static int graph_allocate(struct graph_segment_data *data){
+  uint32_t edges = data->edges.count;
+  for(uint32_t i=0; i<edges; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    edge->start = graph_level_of(edge->source, data);
+    edge->end = graph_level_of(edge->target, data);
+    edge->buffer = 0;
+    edge->alias = 0;
+  }
+
+  graph_free_buffers(data);
+  // free_after[i] holds the position of the last reader of buffers[i].
+  uint32_t *free_after = mixed_calloc(edges+1, sizeof(uint32_t));
+  if(!free_after){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  // Visit the edges in order of their producer. An edge can reuse a
+  // buffer whose last reader ran in a level strictly before the one of
+  // the edge's producer, since segments in a level may run in parallel.
+  for(uint32_t p=0; p<data->level_count; ++p){
+    for(uint32_t i=0; i<edges; ++i){
+      struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+      if(edge->start != p) continue;
+      struct graph_edge *input = graph_inplace_input(edge, data);
+      if(input){
+        input->alias = edge;
+        edge->buffer = input->buffer;
+        free_after[graph_index_of(edge->buffer, &data->buffers)] = edge->end;
+        continue;
+      }
+      for(uint32_t b=0; b<data->buffers.count; ++b){
+        if(free_after[b] < p){
+          edge->buffer = data->buffers.data[b];
+          free_after[b] = edge->end;
+          break;
+        }
+      }
+      if(!edge->buffer){
+        uint32_t b = data->buffers.count;
+        edge->buffer = graph_make_buffer(&data->buffers, data);
+        if(!edge->buffer){
+          mixed_free(free_after);
+          return 0;
+        }
+        free_after[b] = edge->end;
+      }
+    }
+  }
+  mixed_free(free_after);
+
+  for(uint32_t i=0; i<edges; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    mixed_buffer_clear(edge->buffer);
+    if(!mixed_segment_set_out(MIXED_BUFFER, edge->source_location, edge->buffer, edge->source))
+      return 0;
+    if(!mixed_segment_set_in(MIXED_BUFFER, edge->target_location, edge->buffer, edge->target))
+      return 0;
+  }
+  return 1;
+}
+
+static int graph_shared(struct graph_edge *edge, struct graph_segment_data *data){
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *other = (struct graph_edge *)data->edges.data[i];
+    if(other != edge && other->buffer == edge->buffer) return 1;
+  }
+  return 0;
+}
+
+// If a consumer leaves samples behind in a shared buffer they would
+// leak into the next edge using the same storage. In that case we move
+// the edge onto its own buffer, which only happens once per edge. The
+// buffers for this are made when compiling, as this runs in the mix.
+// An edge feeding an in-place consumer only spills once the edge it
+// aliases moved away, and spilling only ever makes sharing rarer.
+static int graph_may_spill(struct graph_edge *edge, struct graph_segment_data *data){
+  if(!graph_shared(edge, data)) return 0;
+  return !edge->alias || graph_may_spill(edge->alias, data);
+}
+
+static int graph_make_spills(struct graph_segment_data *data){
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if(graph_may_spill(edge, data) && !graph_make_buffer(&data->spills, data))
+      return 0;
+  }
+  return 1;
+}
+
+static int graph_spill(struct graph_edge *edge, struct graph_segment_data *data){
+  if(data->spills.count <= data->spilled){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  struct mixed_buffer *buffer = (struct mixed_buffer *)data->spills.data[data->spilled++];
+  mixed_buffer_transfer(edge->buffer, buffer);
+  edge->buffer = buffer;
+  if(!mixed_segment_set_out(MIXED_BUFFER, edge->source_location, buffer, edge->source))
+    return 0;
+  return mixed_segment_set_in(MIXED_BUFFER, edge->target_location, buffer, edge->target);
+}
+
+static struct graph_node *graph_state_of(struct mixed_segment *segment, struct graph_segment_data *data){
+  for(uint32_t i=0; i<data->state_count; ++i){
+    if(data->states[i].segment == segment) return &data->states[i];
+  }
+  return 0;
+}
+
+// Whether the segment consumes all of its inputs in place and takes
+// them all from the same source. Returns that source.
+static struct mixed_segment *graph_fusable(struct mixed_segment *segment, struct graph_segment_data *data){
+  struct mixed_segment_info info = {0};
+  struct mixed_segment *source = 0;
+  uint32_t inputs = 0;
+  if(!mixed_segment_info(&info, segment) || !(info.flags & MIXED_INPLACE))
+    return 0;
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if(edge->target != segment) continue;
+    if(!edge->alias || edge->alias->buffer != edge->buffer || edge->delay)
+      return 0;
+    if(source && source != edge->source)
+      return 0;
+    source = edge->source;
+    inputs++;
+  }
+  // Optional inputs, like a sidechain, may be left unconnected.
+  return (info.min_inputs <= inputs && inputs <= info.max_inputs)? source : 0;
+}
+
+// The segment that takes all outputs of the given one, if it can
+// join its run.
+static struct graph_node *graph_follower(struct mixed_segment *segment, struct graph_segment_data *data){
+  struct mixed_segment_info info = {0};
+  struct mixed_segment *target = 0;
+  uint32_t outputs = 0;
+  if(!mixed_segment_info(&info, segment))
+    return 0;
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if(edge->source != segment) continue;
+    if(target && target != edge->target)
+      return 0;
+    target = edge->target;
+    outputs++;
+  }
+  if(!target || outputs != info.outputs || graph_fusable(target, data) != segment)
+    return 0;
+  return graph_state_of(target, data);
+}
+
+static void graph_free_runs(struct graph_segment_data *data){
+  for(uint32_t i=0; i<data->state_count; ++i){
+    mixed_free(data->states[i].run);
+    data->states[i].run = 0;
+    data->states[i].fused = 0;
+  }
+}
+
+static int graph_fuse(struct graph_segment_data *data){
+  // Segments working in blocks need to see all of them at once.
+  if(data->block_size) return 1;
+  for(uint32_t i=0; i<data->state_count; ++i){
+    struct graph_node *head = &data->states[i];
+    if(head->fused || !graph_fusable(head->segment, data)) continue;
+    uint32_t count = 1, buffers = 0;
+    for(struct graph_node *next = graph_follower(head->segment, data); next; next = graph_follower(next->segment, data))
+      count++;
+    if(count < 2) continue;
+    for(uint32_t e=0; e<data->edges.count; ++e){
+      if(((struct graph_edge *)data->edges.data[e])->target == head->segment)
+        buffers++;
+    }
+    struct graph_run *run = mixed_calloc(1, sizeof(struct graph_run)
+                                         + count*sizeof(struct mixed_segment *)
+                                         + buffers*(sizeof(struct mixed_buffer *) + sizeof(uint32_t) + 2));
+    if(!run){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    run->count = count;
+    run->buffer_count = buffers;
+    run->buffers = (struct mixed_buffer **)(run->segments + count);
+    run->reads = (uint32_t *)(run->buffers + buffers);
+    run->was_silent = (char *)(run->reads + buffers);
+    run->silent = run->was_silent + buffers;
+    buffers = 0;
+    for(uint32_t e=0; e<data->edges.count; ++e){
+      struct graph_edge *edge = (struct graph_edge *)data->edges.data[e];
+      if(edge->target == head->segment)
+        run->buffers[buffers++] = edge->buffer;
+    }
+    run->segments[0] = head->segment;
+    count = 1;
+    for(struct graph_node *next = graph_follower(head->segment, data); next; next = graph_follower(next->segment, data)){
+      run->segments[count++] = next->segment;
+      next->fused = 1;
+    }
+    head->run = run;
+  }
+  return 1;
+}
+
+static void graph_unbypass(struct graph_node *state, struct graph_segment_data *data){
+  bool bypass = false;
+  mixed_segment_set(MIXED_BYPASS, &bypass, state->segment);
+  for(uint32_t i=0; i<data->state_count; ++i){
+    if(state->bypassed < data->states[i].bypassed)
+      data->states[i].bypassed--;
+  }
+  data->bypassed--;
+  state->bypassed = 0;
+}
+
+static void graph_restore_node(struct graph_node *state, struct graph_segment_data *data){
+  if(state->lowered){
+    bool fallback = false;
+    mixed_segment_set(MIXED_RESAMPLE_FALLBACK, &fallback, state->segment);
+    state->lowered = 0;
+  }
+  if(state->voices){
+    mixed_segment_set(MIXED_MAX_VOICES, &state->voices, state->segment);
+    state->voices = 0;
+  }
+  if(state->bypassed)
+    graph_unbypass(state, data);
+}
+
+static void graph_restore(struct graph_segment_data *data){
+  for(uint32_t i=0; i<data->state_count; ++i){
+    if(data->states[i].segment)
+      graph_restore_node(&data->states[i], data);
+  }
+  data->lowered = 0;
+  data->voice_shift = 0;
+  data->relaxed = 0;
+  mixed_err(MIXED_NO_ERROR);
+}
+
+static int graph_make_states(struct graph_segment_data *data){
+  graph_free_runs(data);
+  mixed_free(data->states);
+  data->states = mixed_calloc(MAX(1, data->order.count), sizeof(struct graph_node));
+  if(!data->states){
+    data->state_count = 0;
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->state_count = data->order.count;
+  for(uint32_t i=0; i<data->order.count; ++i){
+    struct graph_node *state = &data->states[i];
+    state->segment = (struct mixed_segment *)data->order.data[i];
+    state->optional = (0 <= graph_index_of(state->segment, &data->optional));
+  }
+  return 1;
+}
+
+// Take the cheapest step towards a faster mix that is left. Returns
+// false if everything is degraded as far as it goes.
+static int graph_degrade(struct graph_segment_data *data){
+  uint32_t count = data->state_count;
+  if(!data->lowered){
+    for(uint32_t i=0; i<count; ++i){
+      struct graph_node *state = &data->states[i];
+      enum mixed_resample_type quality;
+      bool fallback = true;
+      // The fallback states are made when the segment starts, so this
+      // only switches over to them.
+      if(mixed_segment_get(MIXED_RESAMPLE_TYPE, &quality, state->segment)
+         && quality != MIXED_LINEAR_INTERPOLATION && quality != MIXED_ZERO_ORDER_HOLD
+         && mixed_segment_set(MIXED_RESAMPLE_FALLBACK, &fallback, state->segment)){
+        state->lowered = 1;
+        data->lowered = 1;
+      }
+    }
+    mixed_err(MIXED_NO_ERROR);
+    if(data->lowered) return 1;
+    // Nothing resamples, so remember that we are past this step.
+    data->lowered = 2;
+  }
+  for(;;){
+    struct graph_node *worst = 0;
+    for(uint32_t i=0; i<count; ++i){
+      struct graph_node *state = &data->states[i];
+      if(state->optional && !state->bypassed && (!worst || worst->cost < state->cost))
+        worst = state;
+    }
+    if(!worst) break;
+    bool bypass = true;
+    if(mixed_segment_set(MIXED_BYPASS, &bypass, worst->segment)){
+      worst->bypassed = ++data->bypassed;
+      return 1;
+    }
+    // It cannot be bypassed, so do not try again.
+    worst->optional = 0;
+    mixed_err(MIXED_NO_ERROR);
+  }
+  int halved = 0;
+  for(uint32_t i=0; i<count; ++i){
+    struct graph_node *state = &data->states[i];
+    if(data->voice_shift == 0 && !mixed_segment_get(MIXED_MAX_VOICES, &state->voices, state->segment))
+      state->voices = 0;
+    if(1 < (state->voices >> data->voice_shift)){
+      uint32_t voices = state->voices >> (data->voice_shift+1);
+      mixed_segment_set(MIXED_MAX_VOICES, &voices, state->segment);
+      halved = 1;
+    }
+  }
+  mixed_err(MIXED_NO_ERROR);
+  if(halved){
+    data->voice_shift++;
+  }else if(data->voice_shift == 0){
+    for(uint32_t i=0; i<count; ++i)
+      data->states[i].voices = 0;
+  }
+  return halved;
+}
+
+// Undo the last step graph_degrade took.
+static void graph_relax(struct graph_segment_data *data){
+  uint32_t count = data->state_count;
+  if(data->voice_shift){
+    data->voice_shift--;
+    for(uint32_t i=0; i<count; ++i){
+      struct graph_node *state = &data->states[i];
+      if(state->voices){
+        uint32_t voices = state->voices >> data->voice_shift;
+        mixed_segment_set(MIXED_MAX_VOICES, &voices, state->segment);
+        if(data->voice_shift == 0) state->voices = 0;
+      }
+    }
+  }else if(data->bypassed){
+    for(uint32_t i=0; i<count; ++i){
+      if(data->states[i].bypassed == data->bypassed){
+        graph_unbypass(&data->states[i], data);
+        break;
+      }
+    }
+  }else if(data->lowered){
+    for(uint32_t i=0; i<count; ++i){
+      struct graph_node *state = &data->states[i];
+      if(state->lowered){
+        bool fallback = false;
+        mixed_segment_set(MIXED_RESAMPLE_FALLBACK, &fallback, state->segment);
+        state->lowered = 0;
+      }
+    }
+    data->lowered = 0;
+  }
+  mixed_err(MIXED_NO_ERROR);
+}
+
+MIXED_EXPORT int mixed_graph_compile(struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  // Segments may have moved, so start over at full quality.
+  graph_restore(data);
+  if(!graph_sort(data)) return 0;
+  if(!graph_allocate(data)) return 0;
+  if(!graph_make_spills(data)) return 0;
+  if(!graph_compensate(data)) return 0;
+  if(!graph_make_states(data)) return 0;
+  if(!graph_fuse(data)) return 0;
+  if(data->block_size){
+    // Not every segment can work in blocks, those simply take what
+    // they are given.
+    for(uint32_t i=0; i<data->order.count; ++i)
+      mixed_segment_set(MIXED_BLOCK_SIZE, &data->block_size, data->order.data[i]);
+    mixed_err(MIXED_NO_ERROR);
+  }
+  data->dirty = 0;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_graph_add(struct mixed_segment *segment, struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  if(0 <= graph_index_of(segment, &data->nodes)){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  data->dirty = 1;
+  return vector_add(segment, &data->nodes);
+}
+
+MIXED_EXPORT int mixed_graph_remove(struct mixed_segment *segment, struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  for(uint32_t i=0; i<data->edges.count;){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if(edge->source == segment || edge->target == segment){
+      mixed_graph_disconnect(edge->source, edge->source_location, edge->target, edge->target_location, graph);
+    }else{
+      ++i;
+    }
+  }
+  for(uint32_t i=0; i<data->state_count; ++i){
+    if(data->states[i].segment == segment){
+      graph_restore_node(&data->states[i], data);
+      data->states[i].segment = 0;
+    }
+  }
+  if(data->optional.count)
+    vector_remove_item(segment, &data->optional);
+  data->dirty = 1;
+  vector_remove_item(segment, &data->order);
+  return vector_remove_item(segment, &data->nodes);
+}
+
+MIXED_EXPORT int mixed_graph_connect(struct mixed_segment *source, uint32_t source_location, struct mixed_segment *target, uint32_t target_location, struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  if(graph_index_of(source, &data->nodes) < 0 || graph_index_of(target, &data->nodes) < 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if((edge->source == source && edge->source_location == source_location)
+       || (edge->target == target && edge->target_location == target_location)){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+  }
+
+  struct graph_edge *edge = mixed_calloc(1, sizeof(struct graph_edge));
+  if(!edge){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  edge->source = source;
+  edge->source_location = source_location;
+  edge->target = target;
+  edge->target_location = target_location;
+  if(!vector_add(edge, &data->edges)){
+    mixed_free(edge);
+    return 0;
+  }
+  data->dirty = 1;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_graph_disconnect(struct mixed_segment *source, uint32_t source_location, struct mixed_segment *target, uint32_t target_location, struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  for(uint32_t i=0; i<data->edges.count; ++i){
+    struct graph_edge *edge = (struct graph_edge *)data->edges.data[i];
+    if(edge->source == source && edge->source_location == source_location
+       && edge->target == target && edge->target_location == target_location){
+      if(edge->buffer){
+        mixed_segment_set_out(MIXED_BUFFER, source_location, 0, source);
+        mixed_segment_set_in(MIXED_BUFFER, target_location, 0, target);
+      }
+      vector_remove_pos(i, &data->edges);
+      mixed_free(edge->delay);
+      mixed_free(edge);
+      data->dirty = 1;
+      return 1;
+    }
+  }
+  mixed_err(MIXED_INVALID_LOCATION);
+  return 0;
+}
+
+MIXED_EXPORT int mixed_graph_optional(struct mixed_segment *segment, int optional, struct mixed_segment *graph){
+  struct graph_segment_data *data = (struct graph_segment_data *)graph->data;
+  mixed_err(MIXED_NO_ERROR);
+  if(graph_index_of(segment, &data->nodes) < 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  int index = graph_index_of(segment, &data->optional);
+  if(optional && index < 0){
+    if(!vector_add(segment, &data->optional)) return 0;
+  }else if(!optional && 0 <= index){
+    vector_remove_pos(index, &data->optional);
+  }
+  for(uint32_t i=0; i<data->state_count; ++i){
+    if(data->states[i].segment == segment)
+      data->states[i].optional = optional;
+  }
+  return 1;
+}
+
+int graph_segment_free(struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  if(data){
+    for(uint32_t i=0; i<data->edges.count; ++i){
+      mixed_free(((struct graph_edge *)data->edges.data[i])->delay);
+      mixed_free(data->edges.data[i]);
+    }
+    free_thread_pool(data->pool);
+    graph_free_buffers(data);
+    graph_free_runs(data);
+    mixed_free(data->states);
+    free_vector(&data->optional);
+    free_vector(&data->buffers);
+    free_vector(&data->spills);
+    mixed_free(data->levels);
+    free_vector(&data->edges);
+    free_vector(&data->order);
+    free_vector(&data->nodes);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int graph_segment_start(struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  if(data->dirty && !mixed_graph_compile(segment)){
+    return 0;
+  }
+  for(uint32_t i=0; i<data->order.count; ++i){
+    struct mixed_segment *node = (struct mixed_segment *)data->order.data[i];
+    if(node->start){
+      if(!node->start(node)){
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// Shows the segments of the run one strip of their shared buffers at
+// a time. As they work in place, nothing is consumed, and the buffers
+// end up as they were with the output where the input was.
+static int graph_mix_run(struct graph_run *run){
+  struct mixed_buffer **buffers = run->buffers;
+  uint32_t available = mixed_buffer_available_read(buffers[0]);
+  int strips = (GRAPH_STRIP < available);
+  for(uint32_t b=0; b<run->buffer_count && strips; ++b){
+    struct mixed_buffer *buffer = buffers[b];
+    // Only a contiguous region of a plain buffer can be cut up.
+    if(buffer->_shared || buffer->is_mirrored || (buffer->write & 0x80000000)
+       || buffer->write - buffer->read != available)
+      strips = 0;
+  }
+  if(!strips){
+    for(uint32_t s=0; s<run->count; ++s){
+      if(!mixed_segment_mix(run->segments[s])) return 0;
+    }
+    return 1;
+  }
+  int result = 1;
+  for(uint32_t b=0; b<run->buffer_count; ++b){
+    run->reads[b] = buffers[b]->read;
+    run->was_silent[b] = buffers[b]->is_silent;
+    run->silent[b] = 1;
+  }
+  for(uint32_t i=0; i<available && result; i+=GRAPH_STRIP){
+    uint32_t strip = MIN(GRAPH_STRIP, available-i);
+    // What a segment found out about one strip says nothing about the
+    // next, which is still as it came in.
+    for(uint32_t b=0; b<run->buffer_count; ++b){
+      buffers[b]->read = run->reads[b] + i;
+      buffers[b]->write = run->reads[b] + i + strip;
+      buffers[b]->is_silent = run->was_silent[b];
+    }
+    for(uint32_t s=0; s<run->count && result; ++s)
+      result = mixed_segment_mix(run->segments[s]);
+    for(uint32_t b=0; b<run->buffer_count; ++b)
+      run->silent[b] &= buffers[b]->is_silent;
+  }
+  for(uint32_t b=0; b<run->buffer_count; ++b){
+    buffers[b]->read = run->reads[b];
+    buffers[b]->write = run->reads[b] + available;
+    buffers[b]->is_silent = run->silent[b];
+  }
+  return result;
+}
+
+static inline int graph_mix_state(struct graph_node *state){
+  if(state->run) return graph_mix_run(state->run);
+  return mixed_segment_mix(state->segment);
+}
+
+static int graph_mix_node(void *arg, uint32_t index){
+  struct graph_node *state = ((struct graph_node *)arg)+index;
+  if(state->fused) return 1;
+  return graph_mix_state(state);
+}
+
+static int graph_mix_timed(void *arg, uint32_t index){
+  struct graph_node *state = ((struct graph_node *)arg)+index;
+  if(state->fused) return 1;
+  uint64_t start = mixed_clock();
+  int result = graph_mix_state(state);
+  float cost = (mixed_clock() - start) * 1e-9f;
+  state->cost += (cost - state->cost) * 0.125f;
+  return result;
+}
+
+// Compare the time a mix took against the deadline and adjust the
+// quality for the next one.
+static void graph_schedule(uint64_t start, struct graph_segment_data *data){
+  float elapsed = (mixed_clock() - start) * 1e-9f;
+  if(data->deadline < elapsed){
+    data->relaxed = 0;
+    graph_degrade(data);
+  }else if(elapsed < data->deadline*0.5f){
+    if(GRAPH_RELAX_MIXES <= ++data->relaxed){
+      data->relaxed = 0;
+      graph_relax(data);
+    }
+  }else{
+    data->relaxed = 0;
+  }
+}
+
+int graph_segment_mix(struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  // Changing the topology requires a recompilation before the next run.
+  if(data->dirty && !mixed_graph_compile(segment)){
+    return 0;
+  }
+  uint64_t time = (0 < data->deadline)? mixed_clock() : 0;
+  for(uint32_t l=0; l<data->level_count; ++l){
+    uint32_t start = data->levels[l];
+    uint32_t count = data->levels[l+1] - start;
+    for(uint32_t e=0; e<data->edges.count; ++e){
+      struct graph_edge *edge = (struct graph_edge *)data->edges.data[e];
+      if(edge->end == l && edge->delay) graph_delay(edge);
+    }
+    if(0 < data->deadline){
+      if(!thread_pool_run(data->pool, count, graph_mix_timed, data->states+start))
+        return 0;
+    }else if(!thread_pool_run(data->pool, count, graph_mix_node, data->states+start)){
+      return 0;
+    }
+    for(uint32_t e=0; e<data->edges.count; ++e){
+      struct graph_edge *edge = (struct graph_edge *)data->edges.data[e];
+      // Whatever is left in an in-place input is its consumer's output.
+      if(edge->alias && edge->alias->buffer == edge->buffer){
+        edge->delayed = 0;
+        continue;
+      }
+      if(edge->end == l && edge->delay){
+        uint32_t consumed = edge->available - mixed_buffer_available_read(edge->buffer);
+        edge->delayed = (consumed < edge->delayed)? edge->delayed - consumed : 0;
+      }
+      if(edge->end == l && mixed_buffer_available_read(edge->buffer) && graph_shared(edge, data)){
+        if(!graph_spill(edge, data)) return 0;
+      }
+    }
+  }
+  if(0 < data->deadline) graph_schedule(time, data);
+  return 1;
+}
+
+int graph_segment_end(struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  for(uint32_t i=0; i<data->order.count; ++i){
+    struct mixed_segment *node = (struct mixed_segment *)data->order.data[i];
+    if(node->end){
+      if(!node->end(node)){
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int graph_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  IGNORE(segment);
+
+  info->name = "graph";
+  info->description = "Schedule a graph of segments and manage their internal buffers.";
+  info->flags = 0;
+  info->min_inputs = 0;
+  info->max_inputs = 0;
+  info->outputs = 0;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_GRAPH_BUFFER_COUNT,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of physical buffers backing the graph's edges.");
+
+  set_info_field(field++, MIXED_GRAPH_THREADS,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of threads used to mix independent segments.");
+
+  set_info_field(field++, MIXED_BLOCK_SIZE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of frames every segment processes per mix, or 0.");
+
+  set_info_field(field++, MIXED_LATENCY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The latency of the longest path through the graph in frames.");
+
+  set_info_field(field++, MIXED_DEADLINE,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The time in seconds a mix may take before the graph degrades.");
+
+  set_info_field(field++, MIXED_DEGRADATION,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of steps the graph degraded its segments by.");
+
+  set_info_field(field++, MIXED_STATE,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "A snapshot of every segment within the graph.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+// The state of a graph is the snapshot of each of its segments in
+// the order they were added, each behind its size.
+static int graph_get_state(struct mixed_segment_state *state, struct graph_segment_data *data){
+  char *base = (char *)state->data;
+  uint32_t offset = 2*sizeof(uint32_t);
+  if(base){
+    if(state->size < offset){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    ((uint32_t *)base)[0] = data->nodes.count;
+  }
+  for(uint32_t i=0; i<data->nodes.count; ++i){
+    uint32_t size = 0;
+    if(!mixed_segment_save(0, &size, state->runtime, data->nodes.data[i]))
+      return 0;
+    if(base){
+      if(state->size - offset < 2*sizeof(uint32_t) + size){
+        mixed_err(MIXED_INVALID_VALUE);
+        return 0;
+      }
+      if(!mixed_segment_save(base + offset + 2*sizeof(uint32_t), &size, state->runtime, data->nodes.data[i]))
+        return 0;
+      ((uint32_t *)(base + offset))[0] = size;
+    }
+    offset += 2*sizeof(uint32_t) + ((size+7) & ~7u);
+  }
+  state->size = offset;
+  return 1;
+}
+
+static int graph_set_state(struct mixed_segment_state *state, struct graph_segment_data *data){
+  char *base = (char *)state->data;
+  uint32_t offset = 2*sizeof(uint32_t);
+  if(state->size < offset || ((uint32_t *)base)[0] != data->nodes.count){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  for(uint32_t i=0; i<data->nodes.count; ++i){
+    if(state->size - offset < 2*sizeof(uint32_t)){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    uint32_t size = ((uint32_t *)(base + offset))[0];
+    offset += 2*sizeof(uint32_t);
+    if(state->size - offset < size){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(!mixed_segment_load(base + offset, size, data->nodes.data[i]))
+      return 0;
+    offset += MIN((size+7) & ~7u, state->size - offset);
+  }
+  return 1;
+}
+
+int graph_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  switch(field){
+  case MIXED_GRAPH_BUFFER_COUNT: *((uint32_t *)value) = data->buffers.count + data->spilled; break;
+  case MIXED_GRAPH_THREADS: *((uint32_t *)value) = thread_pool_size(data->pool); break;
+  case MIXED_BLOCK_SIZE: *((uint32_t *)value) = data->block_size; break;
+  case MIXED_LATENCY: *((uint32_t *)value) = data->latency; break;
+  case MIXED_DEADLINE: *((float *)value) = data->deadline; break;
+  case MIXED_DEGRADATION: *((uint32_t *)value) = (data->lowered == 1) + data->bypassed + data->voice_shift; break;
+  case MIXED_STATE: return graph_get_state((struct mixed_segment_state *)value, data);
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int graph_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct graph_segment_data *data = (struct graph_segment_data *)segment->data;
+  switch(field){
+  case MIXED_GRAPH_THREADS: {
+    uint32_t threads = *(uint32_t *)value;
+    if(threads == 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(threads == thread_pool_size(data->pool)) break;
+    struct thread_pool *pool = 0;
+    // The calling thread takes part in the work, so we need one less.
+    if(1 < threads){
+      pool = make_thread_pool(threads-1);
+      if(!pool) return 0;
+    }
+    free_thread_pool(data->pool);
+    data->pool = pool;
+  } break;
+  case MIXED_BLOCK_SIZE:
+    // The buffers need to be remade to the new size.
+    if(data->block_size == *(uint32_t *)value) break;
+    data->block_size = *(uint32_t *)value;
+    data->dirty = 1;
+    break;
+  case MIXED_DEADLINE:
+    if(*(float *)value < 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->deadline = *(float *)value;
+    if(data->deadline == 0) graph_restore(data);
+    break;
+  case MIXED_STATE:
+    return graph_set_state((struct mixed_segment_state *)value, data);
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_graph(uint32_t buffer_size, struct mixed_segment *segment){
+  if(buffer_size == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
+  struct graph_segment_data *data = mixed_calloc(1, sizeof(struct graph_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->buffer_size = buffer_size;
+
+  segment->free = graph_segment_free;
+  segment->start = graph_segment_start;
+  segment->mix = graph_segment_mix;
+  segment->end = graph_segment_end;
+  segment->info = graph_segment_info;
+  segment->get = graph_segment_get;
+  segment->set = graph_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_graph(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_graph(ARG(uint32_t, 0), segment);
+}
+
+REGISTER_SEGMENT(graph, __make_graph, 1, {
+    {.description = "buffer_size", .type = MIXED_UINT32}})
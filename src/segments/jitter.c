@@ -0,0 +1,429 @@
+#include "../internal.h"
+// Concealed audio loses this much volume per packet length, and turns
+// to silence after this many packet lengths.
+#define JITTER_CONCEAL_DECAY 0.5f
+#define JITTER_CONCEAL_PACKETS 4
+// At most this fraction of a mix is dropped to catch up on latency.
+#define JITTER_CATCH_UP 16
+
+struct jitter_packet{
+  uint32_t timestamp;
+  uint32_t frames;
+};
+
+struct jitter_segment_data{
+  struct mixed_buffer *out[12];
+  channel_t channels;
+  enum mixed_encoding encoding;
+  uint32_t packet_frames;
+  uint32_t slots;
+  // One slab holds the decoded planar samples of every slot.
+  float *slab;
+  struct jitter_packet *packets;
+  // Two rings of slots+1 entries hand slots between the inserting
+  // thread and the mix: free slots go from the mix to the inserter,
+  // and decoded packets back. Each ring has one writer and one reader.
+  uint32_t *free;
+  uint32_t free_read;
+  uint32_t free_write;
+  uint32_t *incoming;
+  uint32_t incoming_read;
+  uint32_t incoming_write;
+  // Slot indices of the waiting packets, sorted by timestamp.
+  uint32_t *queue;
+  uint32_t queued;
+  // The last packet length of played audio, per channel, which is
+  // repeated to conceal lost packets.
+  float *history;
+  uint32_t history_pos;
+  uint32_t concealed;
+  char playing;
+  char started;
+  uint32_t play;
+  uint64_t clock;
+  float jitter;
+  int64_t last_transit;
+  char have_transit;
+  uint32_t target;
+  float volume;
+  struct mixed_jitter_stats stats;
+};
+
+static inline int32_t jitter_diff(uint32_t a, uint32_t b){
+  return (int32_t)(a - b);
+}
+
+int jitter_segment_free(struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  if(data){
+    if(data->slab) mixed_free(data->slab);
+    if(data->packets) mixed_free(data->packets);
+    if(data->free) mixed_free(data->free);
+    if(data->incoming) mixed_free(data->incoming);
+    if(data->queue) mixed_free(data->queue);
+    if(data->history) mixed_free(data->history);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+static void jitter_reset(struct jitter_segment_data *data){
+  for(uint32_t i=0; i<data->slots; ++i)
+    data->free[i] = i;
+  __atomic_store_n(&data->free_read, 0, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&data->free_write, data->slots, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&data->incoming_read, 0, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&data->incoming_write, 0, __ATOMIC_SEQ_CST);
+  data->queued = 0;
+  memset(data->history, 0, data->channels*data->packet_frames*sizeof(float));
+  data->history_pos = 0;
+  data->concealed = JITTER_CONCEAL_PACKETS*data->packet_frames;
+  data->playing = 0;
+  data->started = 0;
+  data->clock = 0;
+  data->jitter = 0.0f;
+  data->have_transit = 0;
+  data->target = data->packet_frames;
+  memset(&data->stats, 0, sizeof(data->stats));
+  data->stats.latency = data->target;
+}
+
+int jitter_segment_start(struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->out[c] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  jitter_reset(data);
+  return 1;
+}
+
+int jitter_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+static inline float *jitter_slot(uint32_t slot, channel_t channel, struct jitter_segment_data *data){
+  return data->slab + ((uint64_t)slot*data->channels + channel)*data->packet_frames;
+}
+
+// Hands a slot back to the inserting thread. Only called by the mix.
+static void jitter_free_slot(uint32_t slot, struct jitter_segment_data *data){
+  uint32_t write = data->free_write;
+  data->free[write] = slot;
+  __atomic_store_n(&data->free_write, (write+1) % (data->slots+1), __ATOMIC_RELEASE);
+}
+
+static void jitter_release_head(struct jitter_segment_data *data){
+  jitter_free_slot(data->queue[0], data);
+  data->queued--;
+  memmove(data->queue, data->queue+1, data->queued*sizeof(uint32_t));
+}
+
+// The number of frames from the play position to the end of the
+// newest waiting packet.
+static uint32_t jitter_buffered(struct jitter_segment_data *data){
+  if(data->queued == 0) return 0;
+  struct jitter_packet *last = &data->packets[data->queue[data->queued-1]];
+  int32_t end = jitter_diff(last->timestamp + last->frames, data->play);
+  return (end < 0)? 0 : (uint32_t)end;
+}
+
+// Repeats the last packet length of audio with a decaying volume,
+// which hides short losses far better than a hard drop to silence.
+static void jitter_conceal(struct jitter_segment_data *data, float **out, uint32_t offset, uint32_t frames){
+  uint32_t length = data->packet_frames;
+  for(uint32_t i=0; i<frames; ++i){
+    float gain = 0.0f;
+    if(data->concealed < JITTER_CONCEAL_PACKETS*length)
+      gain = powf(JITTER_CONCEAL_DECAY, (float)(data->concealed / length + 1)) * data->volume;
+    for(channel_t c=0; c<data->channels; ++c)
+      out[c][offset+i] = data->history[c*length + data->history_pos] * gain;
+    data->history_pos = (data->history_pos + 1) % length;
+    data->concealed++;
+  }
+}
+
+static void jitter_play(struct jitter_segment_data *data, float **out, uint32_t offset, float **in, uint32_t frames){
+  uint32_t length = data->packet_frames;
+  for(channel_t c=0; c<data->channels; ++c){
+    float *history = data->history + c*length;
+    uint32_t pos = data->history_pos;
+    for(uint32_t i=0; i<frames; ++i){
+      out[c][offset+i] = in[c][i] * data->volume;
+      history[pos] = in[c][i];
+      pos = (pos+1 == length)? 0 : pos+1;
+    }
+  }
+  data->history_pos = (data->history_pos + frames) % length;
+  data->concealed = 0;
+}
+
+// Tracks the variation in transit time as in RFC 3550, with the
+// frames we have played standing in for the arrival time, and keeps
+// the target latency a few deviations above a single packet.
+static void jitter_adapt(uint32_t timestamp, struct jitter_segment_data *data){
+  int64_t transit = (int64_t)data->clock - (int64_t)timestamp;
+  if(data->have_transit){
+    int64_t deviation = transit - data->last_transit;
+    if(deviation < 0) deviation = -deviation;
+    data->jitter += ((float)deviation - data->jitter) / 16.0f;
+  }
+  data->last_transit = transit;
+  data->have_transit = 1;
+  uint32_t target = data->packet_frames + (uint32_t)(3.0f*data->jitter);
+  uint32_t limit = data->packet_frames*data->slots/2;
+  data->target = MAX(data->packet_frames, MIN(target, limit));
+  data->stats.latency = data->target;
+}
+
+// Sorts a decoded packet into the queue, or gives up on it if it is
+// too late or a duplicate.
+static void jitter_queue(uint32_t slot, struct jitter_segment_data *data){
+  struct jitter_packet *packet = &data->packets[slot];
+  data->stats.received++;
+  jitter_adapt(packet->timestamp, data);
+  if(data->started && jitter_diff(packet->timestamp + packet->frames, data->play) <= 0){
+    data->stats.late++;
+    jitter_free_slot(slot, data);
+    return;
+  }
+  // Find the place in the queue, dropping duplicates.
+  uint32_t at = data->queued;
+  while(0 < at){
+    int32_t diff = jitter_diff(packet->timestamp, data->packets[data->queue[at-1]].timestamp);
+    if(diff == 0){
+      data->stats.late++;
+      jitter_free_slot(slot, data);
+      return;
+    }
+    if(0 < diff) break;
+    at--;
+  }
+  memmove(data->queue+at+1, data->queue+at, (data->queued-at)*sizeof(uint32_t));
+  data->queue[at] = slot;
+  data->queued++;
+  // Keep a slot free for the next insert by giving up on the oldest
+  // packet, which may well be the one we just queued.
+  if(data->queued == data->slots){
+    jitter_release_head(data);
+    data->stats.late++;
+  }
+}
+
+// Takes in the packets inserted since the last mix.
+static void jitter_receive(struct jitter_segment_data *data){
+  uint32_t read = data->incoming_read;
+  uint32_t write = __atomic_load_n(&data->incoming_write, __ATOMIC_ACQUIRE);
+  for(; read != write; read = (read+1) % (data->slots+1))
+    jitter_queue(data->incoming[read], data);
+  __atomic_store_n(&data->incoming_read, read, __ATOMIC_RELEASE);
+}
+
+int jitter_segment_mix(struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  channel_t channels = data->channels;
+  float *out[channels], *in[channels];
+  uint32_t samples = UINT32_MAX, done = 0;
+  mixed_buffers_request_write(channels, data->out, out, &samples);
+  jitter_receive(data);
+
+  // Wait until the target latency is buffered before playing. After
+  // running dry we resume where we left off, unless the stream has
+  // moved on past that.
+  if(!data->playing && data->queued){
+    uint32_t head = data->packets[data->queue[0]].timestamp;
+    if(!data->started || 0 < jitter_diff(head, data->play))
+      data->play = head;
+    if(data->target <= jitter_buffered(data))
+      data->playing = data->started = 1;
+  }
+  // Drop audio when we have fallen behind by more than a packet.
+  if(data->playing){
+    uint32_t buffered = jitter_buffered(data);
+    if(data->target + data->packet_frames < buffered){
+      uint32_t skip = MIN(buffered - data->target, samples / JITTER_CATCH_UP);
+      data->play += skip;
+      data->stats.skipped += skip;
+    }
+  }
+
+  while(done < samples){
+    uint32_t frames = samples - done;
+    if(!data->playing || data->queued == 0){
+      // Out of data, so buffer up to the target again.
+      if(data->playing) data->stats.underruns++;
+      data->playing = 0;
+      jitter_conceal(data, out, done, frames);
+      data->stats.concealed += frames;
+      done += frames;
+      break;
+    }
+    uint32_t slot = data->queue[0];
+    struct jitter_packet *packet = &data->packets[slot];
+    int32_t ahead = jitter_diff(packet->timestamp, data->play);
+    if(ahead + (int32_t)packet->frames <= 0){
+      jitter_release_head(data);
+    }else if(0 < ahead){
+      // The packet for the play position never arrived.
+      frames = MIN(frames, (uint32_t)ahead);
+      jitter_conceal(data, out, done, frames);
+      data->stats.concealed += frames;
+      data->play += frames;
+      done += frames;
+    }else{
+      uint32_t offset = (uint32_t)-ahead;
+      frames = MIN(frames, packet->frames - offset);
+      for(channel_t c=0; c<channels; ++c)
+        in[c] = jitter_slot(slot, c, data) + offset;
+      jitter_play(data, out, done, in, frames);
+      data->play += frames;
+      done += frames;
+    }
+  }
+
+  data->clock += samples;
+  data->stats.buffered = (data->playing)? jitter_buffered(data) : 0;
+  mixed_buffers_finish_write(channels, data->out, samples);
+  return 1;
+}
+
+int jitter_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+
+  info->name = "jitter";
+  info->description = "Turns timestamped packets into a steady stream.";
+  info->min_inputs = 0;
+  info->max_inputs = 0;
+  info->outputs = data->channels;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_VOLUME,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The volume scaling factor.");
+
+  set_info_field(field++, MIXED_JITTER_STATS,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_GET,
+                 "Statistics about the packets and latency.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int jitter_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  switch(field){
+  case MIXED_VOLUME: *((float *)value) = data->volume; break;
+  case MIXED_JITTER_STATS: *((struct mixed_jitter_stats *)value) = data->stats; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int jitter_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  switch(field){
+  case MIXED_VOLUME: data->volume = *((float *)value); break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+// The packet is decoded here, on the inserting thread, into a slot
+// the mix gave back earlier. Sorting it in is left to the mix.
+MIXED_EXPORT int mixed_jitter_insert(uint32_t timestamp, void *packet, uint32_t frames, struct mixed_segment *segment){
+  struct jitter_segment_data *data = (struct jitter_segment_data *)segment->data;
+  mixed_err(MIXED_NO_ERROR);
+  if(frames == 0 || data->packet_frames < frames){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint32_t read = data->free_read;
+  if(read == __atomic_load_n(&data->free_write, __ATOMIC_ACQUIRE)){
+    mixed_err(MIXED_QUEUE_FULL);
+    return 0;
+  }
+  uint32_t slot = data->free[read];
+  __atomic_store_n(&data->free_read, (read+1) % (data->slots+1), __ATOMIC_RELEASE);
+  mixed_transfer_function_from decode = mixed_translator_from(data->encoding);
+  uint8_t size = mixed_samplesize(data->encoding);
+  for(channel_t c=0; c<data->channels; ++c)
+    decode((char *)packet + c*size, jitter_slot(slot, c, data), data->channels, frames, 1.0f, 1.0f);
+  data->packets[slot].timestamp = timestamp;
+  data->packets[slot].frames = frames;
+  uint32_t write = data->incoming_write;
+  data->incoming[write] = slot;
+  __atomic_store_n(&data->incoming_write, (write+1) % (data->slots+1), __ATOMIC_RELEASE);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_jitter(enum mixed_encoding encoding, channel_t channels, uint32_t packet_frames, uint32_t slots, struct mixed_segment *segment){
+  if(channels == 0 || 12 < channels || packet_frames == 0 || slots < 2){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  if(encoding < MIXED_INT8 || MIXED_DOUBLE < encoding){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    return 0;
+  }
+  struct jitter_segment_data *data = mixed_calloc(1, sizeof(struct jitter_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  segment->data = data;
+  data->slab = mixed_calloc((size_t)slots*channels*packet_frames, sizeof(float));
+  data->packets = mixed_calloc(slots, sizeof(struct jitter_packet));
+  data->free = mixed_calloc(slots+1, sizeof(uint32_t));
+  data->incoming = mixed_calloc(slots+1, sizeof(uint32_t));
+  data->queue = mixed_calloc(slots, sizeof(uint32_t));
+  data->history = mixed_calloc((size_t)channels*packet_frames, sizeof(float));
+  if(!data->slab || !data->packets || !data->free || !data->incoming || !data->queue || !data->history){
+    jitter_segment_free(segment);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->encoding = encoding;
+  data->channels = channels;
+  data->packet_frames = packet_frames;
+  data->slots = slots;
+  data->volume = 1.0f;
+  jitter_reset(data);
+
+  segment->free = jitter_segment_free;
+  segment->start = jitter_segment_start;
+  segment->mix = jitter_segment_mix;
+  segment->set_out = jitter_segment_set_out;
+  segment->info = jitter_segment_info;
+  segment->get = jitter_segment_get;
+  segment->set = jitter_segment_set;
+  return 1;
+}
+
+int __make_jitter(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_jitter(ARG(enum mixed_encoding, 0), ARG(channel_t, 1), ARG(uint32_t, 2), ARG(uint32_t, 3), segment);
+}
+
+REGISTER_SEGMENT(jitter, __make_jitter, 4, {
+    {.description = "encoding", .type = MIXED_ENCODING_ENUM},
+    {.description = "channels", .type = MIXED_CHANNEL_T},
+    {.description = "packet_frames", .type = MIXED_UINT32},
+    {.description = "slots", .type = MIXED_UINT32}})
@@ -5,23 +5,40 @@ struct ladspa_port{
   struct mixed_buffer *buffer;
   char direction;
   float control;
+  // The area the port was last connected to, so that unchanged
+  // connections are not made again on every mix.
+  float *connected;
 };
 
 struct ladspa_segment_data{
   LADSPA_Descriptor *descriptor;
-  LADSPA_Handle *handle;
+  // One handle per instance, each with its own row of ports.
+  LADSPA_Handle *handles;
+  uint32_t instances;
   char active;
   uint32_t samplerate;
   struct ladspa_port *ports;
+  uint32_t samples;
+  struct thread_pool *pool;
 };
 
+static inline struct ladspa_port *ladspa_ports(uint32_t instance, struct ladspa_segment_data *data){
+  return data->ports + instance*data->descriptor->PortCount;
+}
+
 int ladspa_segment_free(struct mixed_segment *segment){
   struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
   if(data){
-    if(data->active && data->descriptor->deactivate)
-      data->descriptor->deactivate(data->handle);
-    if(data->descriptor->cleanup)
-      data->descriptor->cleanup(data->handle);
+    for(uint32_t i=0; i<data->instances; ++i){
+      if(!data->handles[i]) continue;
+      if(data->active && data->descriptor->deactivate)
+        data->descriptor->deactivate(data->handles[i]);
+      if(data->descriptor->cleanup)
+        data->descriptor->cleanup(data->handles[i]);
+    }
+    free_thread_pool(data->pool);
+    if(data->handles)
+      mixed_free(data->handles);
     if(data->ports)
       mixed_free(data->ports);
     mixed_free(segment->data);
@@ -32,25 +49,47 @@ int ladspa_segment_free(struct mixed_segment *segment){
 
 // FIXME: add start method that checks for buffer completeness.
 
+static inline int ladspa_audio_port(LADSPA_PortDescriptor port, char direction){
+  return LADSPA_IS_PORT_AUDIO(port)
+    && ((direction == MIXED_IN)? LADSPA_IS_PORT_INPUT(port) : LADSPA_IS_PORT_OUTPUT(port));
+}
+
+// Locations count through the audio ports of the given direction of
+// the first instance, then of the second, and so on.
+static int ladspa_set_buffer(char direction, uint32_t location, void *buffer, struct ladspa_segment_data *data){
+  uint32_t per_instance = 0;
+  for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
+    const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
+    if(ladspa_audio_port(port, direction))
+      ++per_instance;
+  }
+  if(per_instance == 0 || data->instances*per_instance <= location){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  struct ladspa_port *ports = ladspa_ports(location / per_instance, data);
+  uint32_t index = 0;
+  for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
+    const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
+    if(ladspa_audio_port(port, direction)){
+      if(index == location % per_instance){
+        ports[i].buffer = ((struct mixed_buffer *)buffer);
+        ports[i].direction = direction;
+        return 1;
+      }
+      ++index;
+    }
+  }
+  mixed_err(MIXED_INVALID_LOCATION);
+  return 0;
+}
+
 int ladspa_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
-  uint32_t index = 0;
 
   switch(field){
   case MIXED_BUFFER:
-    for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
-      const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
-      if(LADSPA_IS_PORT_AUDIO(port) && LADSPA_IS_PORT_INPUT(port)){
-        if(index == location){
-          data->ports[i].buffer = ((struct mixed_buffer *)buffer);
-          data->ports[i].direction = MIXED_IN;
-          return 1;
-        }
-        ++index;
-      }
-    }
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
+    return ladspa_set_buffer(MIXED_IN, location, buffer, data);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -59,51 +98,78 @@ int ladspa_segment_set_in(uint32_t field, uint32_t location, void *buffer, struc
 
 int ladspa_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
-  uint32_t index = 0;
 
   switch(field){
   case MIXED_BUFFER:
-    for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
-      const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
-      if(LADSPA_IS_PORT_AUDIO(port) && LADSPA_IS_PORT_OUTPUT(port)){
-        if(index == location){
-          data->ports[i].buffer = ((struct mixed_buffer *)buffer);
-          data->ports[i].direction = MIXED_OUT;
-          return 1;
-        }
-        ++index;
-      }
-    }
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
+    return ladspa_set_buffer(MIXED_OUT, location, buffer, data);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
   }
 }
 
-int ladspa_segment_mix(struct mixed_segment *segment){
-  struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
-  uint32_t samples = UINT32_MAX;
+// If the plugin works in place, an output port may share its buffer
+// with an input port. That buffer then carries the output on and must
+// be neither written to separately nor consumed.
+static struct ladspa_port *ladspa_aliased_port(struct ladspa_port *ports, uint32_t index, struct ladspa_segment_data *data){
+  struct ladspa_port *port = &ports[index];
   for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
-    struct ladspa_port *port = &data->ports[i];
+    struct ladspa_port *other = &ports[i];
+    if(i != index && other->buffer == port->buffer && other->direction != port->direction)
+      return other;
+  }
+  return 0;
+}
+
+static int ladspa_run_instance(void *arg, uint32_t instance){
+  struct ladspa_segment_data *data = (struct ladspa_segment_data *)arg;
+  struct ladspa_port *ports = ladspa_ports(instance, data);
+  for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
+    struct ladspa_port *port = &ports[i];
     if(port->buffer){
       float *buffer;
-      if(port->direction == MIXED_IN)
+      uint32_t samples = data->samples;
+      if(port->direction == MIXED_IN || ladspa_aliased_port(ports, i, data))
         mixed_buffer_request_read(&buffer, &samples, port->buffer);
       else
         mixed_buffer_request_write(&buffer, &samples, port->buffer);
-      data->descriptor->connect_port(data->handle, i, buffer);
+      if(buffer != port->connected){
+        data->descriptor->connect_port(data->handles[instance], i, buffer);
+        port->connected = buffer;
+      }
     }
   }
-  data->descriptor->run(data->handle, samples);
-  for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
+  data->descriptor->run(data->handles[instance], data->samples);
+  return 1;
+}
+
+int ladspa_segment_mix(struct mixed_segment *segment){
+  struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
+  uint32_t ports = data->descriptor->PortCount;
+  // All instances advance by the same amount, so that the channels
+  // they stand for stay in step.
+  uint32_t samples = UINT32_MAX;
+  for(uint32_t i=0; i<data->instances*ports; ++i){
     struct ladspa_port *port = &data->ports[i];
     if(port->buffer){
+      uint32_t available = (port->direction == MIXED_IN || ladspa_aliased_port(ladspa_ports(i/ports, data), i%ports, data))
+        ? mixed_buffer_available_read(port->buffer)
+        : mixed_buffer_available_write(port->buffer);
+      samples = MIN(samples, available);
+    }
+  }
+  data->samples = (samples == UINT32_MAX)? 0 : samples;
+  thread_pool_run(data->pool, data->instances, ladspa_run_instance, data);
+  for(uint32_t i=0; i<data->instances*ports; ++i){
+    struct ladspa_port *port = &data->ports[i];
+    if(port->buffer && !ladspa_aliased_port(ladspa_ports(i/ports, data), i%ports, data)){
       if(port->direction == MIXED_IN)
-        mixed_buffer_finish_read(samples, port->buffer);
+        mixed_buffer_finish_read(data->samples, port->buffer);
       else
-        mixed_buffer_finish_write(samples, port->buffer);
+        mixed_buffer_finish_write(data->samples, port->buffer);
+    }else if(port->buffer){
+      // The plugin may well have written sound over a silent input.
+      port->buffer->is_silent = 0;
     }
   }
   return 1;
@@ -117,7 +183,8 @@ int ladspa_segment_start(struct mixed_segment *segment){
   }
   
   if(data->descriptor->activate){
-    data->descriptor->activate(data->handle);
+    for(uint32_t i=0; i<data->instances; ++i)
+      data->descriptor->activate(data->handles[i]);
   }
   data->active = 1;
   return 1;
@@ -131,7 +198,8 @@ int ladspa_segment_end(struct mixed_segment *segment){
   }
   
   if(data->descriptor->deactivate){
-    data->descriptor->deactivate(data->handle);
+    for(uint32_t i=0; i<data->instances; ++i)
+      data->descriptor->deactivate(data->handles[i]);
   }else{
     mixed_err(MIXED_NOT_IMPLEMENTED);
   }
@@ -156,10 +224,10 @@ int ladspa_segment_info(struct mixed_segment_info *info, struct mixed_segment *s
     const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
     if(LADSPA_IS_PORT_AUDIO(port)){
       if(LADSPA_IS_PORT_INPUT(port)){
-        ++info->max_inputs;
-        ++info->min_inputs;
+        info->max_inputs += data->instances;
+        info->min_inputs += data->instances;
       }else{
-        ++info->outputs;
+        info->outputs += data->instances;
       }
     }
 
@@ -177,6 +245,20 @@ int ladspa_segment_get(uint32_t field, void *value, struct mixed_segment *segmen
   // what we want here in most cases.
   struct ladspa_segment_data *data = (struct ladspa_segment_data *)segment->data;
   uint32_t index = 0;
+  if(field == MIXED_LATENCY){
+    // By convention plugins report their delay on an output control
+    // port called "latency".
+    *((uint32_t *)value) = 0;
+    for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
+      const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
+      if(LADSPA_IS_PORT_CONTROL(port) && LADSPA_IS_PORT_OUTPUT(port)
+         && strcmp(data->descriptor->PortNames[i], "latency") == 0
+         && 0.0f < data->ports[i].control){
+        *((uint32_t *)value) = (uint32_t)data->ports[i].control;
+      }
+    }
+    return 1;
+  }
   for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
     const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[i];
     if(LADSPA_IS_PORT_CONTROL(port) && LADSPA_IS_PORT_OUTPUT(port)){
@@ -215,7 +297,7 @@ int ladspa_load_descriptor(char *file, uint32_t index, LADSPA_Descriptor **_desc
   void *handle = open_library(file);
   if(!handle) goto cleanup;
 
-  *(void **)(&descriptor_function) = load_symbol(handle, "descriptor_function");
+  *(void **)(&descriptor_function) = load_symbol(handle, "ladspa_descriptor");
   if(!descriptor_function) goto cleanup;
   
   descriptor = descriptor_function(index);
@@ -232,34 +314,58 @@ int ladspa_load_descriptor(char *file, uint32_t index, LADSPA_Descriptor **_desc
   return 0;
 }
 
-MIXED_EXPORT int mixed_make_segment_ladspa(char *file, uint32_t index, uint32_t samplerate, struct mixed_segment *segment){
+MIXED_EXPORT int mixed_make_segment_ladspa_multi(char *file, uint32_t index, uint32_t samplerate, uint32_t instances, uint32_t threads, struct mixed_segment *segment){
+  struct mixed_segment tmp = {0};
   struct ladspa_segment_data *data = 0;
 
+  if(instances == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
   data = mixed_calloc(1, sizeof(struct ladspa_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     goto cleanup;
   }
+  tmp.data = data;
 
   if(!ladspa_load_descriptor(file, index, &data->descriptor)){
     goto cleanup;
   }
 
-  data->ports = mixed_calloc(data->descriptor->PortCount, sizeof(struct ladspa_port));
-  if(!data->ports){
+  data->ports = mixed_calloc(instances*data->descriptor->PortCount, sizeof(struct ladspa_port));
+  data->handles = mixed_calloc(instances, sizeof(LADSPA_Handle));
+  if(!data->ports || !data->handles){
     mixed_err(MIXED_OUT_OF_MEMORY);
     goto cleanup;
   }
+  data->instances = instances;
 
-  data->handle = data->descriptor->instantiate(data->descriptor, samplerate);  
-  if(!data->handle){
-    mixed_err(MIXED_LADSPA_INSTANTIATION_FAILED);
-    goto cleanup;
+  // The calling thread runs instances too, so we need one less.
+  if(1 < threads && 1 < instances){
+    data->pool = make_thread_pool(MIN(threads, instances) - 1);
+    if(!data->pool) goto cleanup;
   }
 
-  // Connect all ports to shims
-  for(uint32_t i=0; i<data->descriptor->PortCount; ++i){
-    data->descriptor->connect_port(data->handle, i, &data->ports[i].control);
+  for(uint32_t i=0; i<instances; ++i){
+    data->handles[i] = data->descriptor->instantiate(data->descriptor, samplerate);
+    if(!data->handles[i]){
+      mixed_err(MIXED_LADSPA_INSTANTIATION_FAILED);
+      goto cleanup;
+    }
+
+    // Connect all ports to shims. Control inputs go to the first
+    // instance's shims so that all instances share their settings.
+    struct ladspa_port *ports = ladspa_ports(i, data);
+    for(uint32_t j=0; j<data->descriptor->PortCount; ++j){
+      const LADSPA_PortDescriptor port = data->descriptor->PortDescriptors[j];
+      float *control = (LADSPA_IS_PORT_CONTROL(port) && LADSPA_IS_PORT_INPUT(port))
+        ? &data->ports[j].control
+        : &ports[j].control;
+      data->descriptor->connect_port(data->handles[i], j, control);
+      ports[j].connected = control;
+    }
   }
 
   segment->free = ladspa_segment_free;
@@ -275,15 +381,14 @@ MIXED_EXPORT int mixed_make_segment_ladspa(char *file, uint32_t index, uint32_t
   return 1;
 
  cleanup:
-  if(data){
-    if(data->ports)
-      mixed_free(data->ports);
-    mixed_free(data);
-  }
-  
+  ladspa_segment_free(&tmp);
   return 0;
 }
 
+MIXED_EXPORT int mixed_make_segment_ladspa(char *file, uint32_t index, uint32_t samplerate, struct mixed_segment *segment){
+  return mixed_make_segment_ladspa_multi(file, index, samplerate, 1, 1, segment);
+}
+
 int __make_ladspa(void *args, struct mixed_segment *segment){
   return mixed_make_segment_ladspa(ARG(char *, 0), ARG(uint32_t, 1), ARG(uint32_t, 2), segment);
 }
@@ -292,3 +397,14 @@ REGISTER_SEGMENT(ladspa, __make_ladspa, 3, {
     {.description = "file", .type = MIXED_STRING},
     {.description = "index", .type = MIXED_UINT32},
     {.description = "samplerate", .type = MIXED_UINT32}})
+
+int __make_ladspa_multi(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_ladspa_multi(ARG(char *, 0), ARG(uint32_t, 1), ARG(uint32_t, 2), ARG(uint32_t, 3), ARG(uint32_t, 4), segment);
+}
+
+REGISTER_SEGMENT(ladspa_multi, __make_ladspa_multi, 5, {
+    {.description = "file", .type = MIXED_STRING},
+    {.description = "index", .type = MIXED_UINT32},
+    {.description = "samplerate", .type = MIXED_UINT32},
+    {.description = "instances", .type = MIXED_UINT32},
+    {.description = "threads", .type = MIXED_UINT32}})
@@ -0,0 +1,457 @@
+#include "../internal.h"
+
+// Samples are measured a chunk at a time, out of the scratch space.
+#define METER_CHUNK 256
+// The true peak interpolator of BS.1770 Annex 2: four phases of a
+// 48 tap low pass filter.
+#define METER_PHASES 4
+#define METER_TAPS 12
+#define METER_LINE (METER_TAPS-1 + METER_CHUNK)
+// Loudness is gated in steps of 100ms, of which the momentary
+// loudness covers four, the short term loudness thirty, and the RMS
+// three.
+#define METER_STEPS 30
+#define METER_MOMENTARY 4
+#define METER_RMS 3
+
+// Everything the UI reads is kept as the bits of a float, so that it
+// can be published with plain atomic stores. Peaks are never negative,
+// and non-negative floats order the same way as their bits, which lets
+// a peak be raised with an integer compare.
+struct meter_channel{
+  uint32_t peak;
+  uint32_t true_peak;
+  uint32_t rms;
+  double power;
+  float powers[METER_RMS];
+};
+
+struct meter_segment_data{
+  struct mixed_buffer **in;
+  struct mixed_buffer **out;
+  float **ins;
+  float **outs;
+  float **chunk;
+  float **weighted;
+  float **lines;
+  struct meter_channel *channels_data;
+  struct biquad_bank bank;
+  float taps[METER_PHASES][METER_TAPS];
+  float loudness[METER_STEPS];
+  double weighted_power;
+  uint32_t step;
+  uint32_t step_samples;
+  uint32_t steps;
+  uint32_t momentary;
+  uint32_t short_term;
+  uint32_t samplerate;
+  channel_t channels;
+};
+
+static inline uint32_t meter_bits(float value){
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline float meter_float(uint32_t bits){
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static inline void meter_raise(uint32_t *place, float value){
+  uint32_t bits = meter_bits(value);
+  uint32_t old = atomic_read(*place);
+  while(old < bits && !atomic_cas(*place, old, bits))
+    old = atomic_read(*place);
+}
+
+static inline float meter_lufs(double power){
+  return -0.691f + 10.0f*log10f((float)power);
+}
+
+static void free_meter_data(struct meter_segment_data *data){
+  if(data->in){
+    if(data->lines[0]) mixed_free(data->lines[0]);
+    mixed_free(data->in);
+  }
+  if(data->channels_data) mixed_free(data->channels_data);
+  free_biquad_bank(&data->bank);
+  mixed_free(data);
+}
+
+// The exact K-weighting filters of BS.1770 at any rate, as derived by
+// the libebur128 project: a high shelf for the head, followed by a high
+// pass.
+static void meter_design(struct meter_segment_data *data){
+  double rate = data->samplerate;
+  struct biquad_data shelf = {0}, pass = {0};
+
+  double f0 = 1681.974450955533;
+  double G = 3.999843853973347;
+  double Q = 0.7071752369554196;
+  double K = tan(M_PI * f0 / rate);
+  double Vh = pow(10.0, G / 20.0);
+  double Vb = pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+  shelf.b[0] = (Vh + Vb * K / Q + K * K) / a0;
+  shelf.b[1] = 2.0 * (K * K - Vh) / a0;
+  shelf.b[2] = (Vh - Vb * K / Q + K * K) / a0;
+  shelf.a[0] = 2.0 * (K * K - 1.0) / a0;
+  shelf.a[1] = (1.0 - K / Q + K * K) / a0;
+
+  f0 = 38.13547087602444;
+  Q = 0.5003270373238773;
+  K = tan(M_PI * f0 / rate);
+  a0 = 1.0 + K / Q + K * K;
+  pass.b[0] = 1.0f;
+  pass.b[1] = -2.0f;
+  pass.b[2] = 1.0f;
+  pass.a[0] = 2.0 * (K * K - 1.0) / a0;
+  pass.a[1] = (1.0 - K / Q + K * K) / a0;
+
+  for(channel_t c=0; c<data->channels; ++c){
+    biquad_bank_set(c, 0, &shelf, &data->bank);
+    biquad_bank_set(c, 1, &pass, &data->bank);
+  }
+  data->step = MAX(1, data->samplerate / 10);
+}
+
+// A Hann windowed sinc split into its phases, each normalised to unity
+// gain so that a constant signal interpolates to itself.
+static void meter_design_taps(struct meter_segment_data *data){
+  uint32_t length = METER_PHASES*METER_TAPS;
+  for(uint32_t p=0; p<METER_PHASES; ++p){
+    float sum = 0.0f;
+    for(uint32_t k=0; k<METER_TAPS; ++k){
+      uint32_t n = k*METER_PHASES + p;
+      double x = ((double)n - (length-1)*0.5) / METER_PHASES;
+      double sinc = (x == 0.0)? 1.0 : sin(M_PI*x) / (M_PI*x);
+      double window = 0.5 - 0.5*cos(2.0*M_PI*(n+0.5)/length);
+      data->taps[p][k] = (float)(sinc * window);
+      sum += data->taps[p][k];
+    }
+    for(uint32_t k=0; k<METER_TAPS; ++k)
+      data->taps[p][k] /= sum;
+  }
+}
+
+static void meter_reset(struct meter_segment_data *data){
+  biquad_bank_reset(&data->bank);
+  for(channel_t c=0; c<data->channels; ++c){
+    struct meter_channel *channel = &data->channels_data[c];
+    memset(data->lines[c], 0, METER_LINE*sizeof(float));
+    memset(channel->powers, 0, sizeof(channel->powers));
+    channel->power = 0.0;
+    atomic_write(channel->peak, 0);
+    atomic_write(channel->true_peak, 0);
+    atomic_write(channel->rms, 0);
+  }
+  memset(data->loudness, 0, sizeof(data->loudness));
+  data->weighted_power = 0.0;
+  data->step_samples = 0;
+  data->steps = 0;
+  atomic_write(data->momentary, meter_bits(-INFINITY));
+  atomic_write(data->short_term, meter_bits(-INFINITY));
+}
+
+VECTORIZE static float meter_peak(const float *in, uint32_t samples){
+  float peak = 0.0f;
+  for(uint32_t i=0; i<samples; ++i)
+    peak = MAX(peak, fabsf(in[i]));
+  return peak;
+}
+
+VECTORIZE static float meter_power(const float *in, uint32_t samples){
+  float power = 0.0f;
+  for(uint32_t i=0; i<samples; ++i)
+    power += in[i]*in[i];
+  return power;
+}
+
+// The line holds the last METER_TAPS-1 samples of the previous chunk
+// followed by the current one.
+VECTORIZE static float meter_true_peak(const float *line, uint32_t samples, float taps[METER_PHASES][METER_TAPS]){
+  float acc[METER_CHUNK];
+  float peak = 0.0f;
+  for(uint32_t p=0; p<METER_PHASES; ++p){
+    for(uint32_t i=0; i<samples; ++i)
+      acc[i] = 0.0f;
+    for(uint32_t k=0; k<METER_TAPS; ++k){
+      const float h = taps[p][k];
+      const float *x = line + METER_TAPS-1 - k;
+      for(uint32_t i=0; i<samples; ++i)
+        acc[i] += h*x[i];
+    }
+    for(uint32_t i=0; i<samples; ++i)
+      peak = MAX(peak, fabsf(acc[i]));
+  }
+  return peak;
+}
+
+// Closes a 100ms step and publishes the windows that end with it.
+static void meter_step(struct meter_segment_data *data){
+  uint32_t step = data->steps % METER_STEPS;
+  data->loudness[step] = data->weighted_power / data->step_samples;
+  data->weighted_power = 0.0;
+  for(channel_t c=0; c<data->channels; ++c){
+    struct meter_channel *channel = &data->channels_data[c];
+    channel->powers[data->steps % METER_RMS] = channel->power / data->step_samples;
+    channel->power = 0.0;
+    float rms = 0.0f;
+    for(uint32_t i=0; i<METER_RMS; ++i)
+      rms += channel->powers[i];
+    atomic_write(channel->rms, meter_bits(sqrtf(rms / METER_RMS)));
+  }
+  data->steps++;
+  data->step_samples = 0;
+
+  double momentary = 0.0, short_term = 0.0;
+  for(uint32_t i=0; i<METER_STEPS; ++i){
+    short_term += data->loudness[i];
+    if((step + METER_STEPS - i) % METER_STEPS < METER_MOMENTARY)
+      momentary += data->loudness[i];
+  }
+  atomic_write(data->momentary, meter_bits(meter_lufs(momentary / METER_MOMENTARY)));
+  atomic_write(data->short_term, meter_bits(meter_lufs(short_term / METER_STEPS)));
+}
+
+static void meter_measure(uint32_t samples, struct meter_segment_data *data){
+  uint32_t offset = 0;
+  while(offset < samples){
+    uint32_t chunk = MIN(METER_CHUNK, MIN(samples - offset, data->step - data->step_samples));
+    for(channel_t c=0; c<data->channels; ++c){
+      struct meter_channel *channel = &data->channels_data[c];
+      float *in = data->ins[c] + offset;
+      float *line = data->lines[c];
+      data->chunk[c] = in;
+      memcpy(line + METER_TAPS-1, in, chunk*sizeof(float));
+      // The phases all fall between the samples, so the samples
+      // themselves count towards the true peak, too.
+      float peak = meter_peak(in, chunk);
+      meter_raise(&channel->peak, peak);
+      meter_raise(&channel->true_peak, MAX(peak, meter_true_peak(line, chunk, data->taps)));
+      memmove(line, line + chunk, (METER_TAPS-1)*sizeof(float));
+      channel->power += meter_power(in, chunk);
+    }
+    biquad_bank_process(data->chunk, data->weighted, chunk, &data->bank);
+    for(channel_t c=0; c<data->channels; ++c)
+      data->weighted_power += meter_power(data->weighted[c], chunk);
+    data->step_samples += chunk;
+    if(data->step_samples == data->step)
+      meter_step(data);
+    offset += chunk;
+  }
+}
+
+int meter_segment_free(struct mixed_segment *segment){
+  if(segment->data)
+    free_meter_data((struct meter_segment_data *)segment->data);
+  segment->data = 0;
+  return 1;
+}
+
+int meter_segment_start(struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] == 0 || data->out[c] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  meter_reset(data);
+  return 1;
+}
+
+int meter_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->in[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int meter_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    data->out[location] = (struct mixed_buffer *)buffer;
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int meter_segment_mix(struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+
+  uint32_t samples = UINT32_MAX;
+  for(channel_t c=0; c<data->channels; ++c){
+    mixed_buffer_request_read(&data->ins[c], &samples, data->in[c]);
+  }
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] != data->out[c])
+      mixed_buffer_request_write(&data->outs[c], &samples, data->out[c]);
+  }
+  meter_measure(samples, data);
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->in[c] != data->out[c]){
+      int silent = mixed_buffer_is_silent(data->in[c]);
+      memcpy(data->outs[c], data->ins[c], samples*sizeof(float));
+      mixed_buffer_finish_read(samples, data->in[c]);
+      if(silent)
+        mixed_buffer_finish_write_silence(samples, data->out[c]);
+      else
+        mixed_buffer_finish_write(samples, data->out[c]);
+    }
+  }
+  return 1;
+}
+
+int meter_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+
+  info->name = "meter";
+  info->description = "Measures peak, true peak, RMS, and loudness levels of the signal passing through.";
+  info->flags = MIXED_INPLACE;
+  info->min_inputs = data->channels;
+  info->max_inputs = data->channels;
+  info->outputs = data->channels;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_METER_LEVELS,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The current levels of one of the channels.");
+
+  set_info_field(field++, MIXED_SAMPLERATE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The samplerate at which the segment operates.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int meter_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+  struct mixed_meter_levels *levels = (struct mixed_meter_levels *)value;
+  switch(field){
+  case MIXED_METER_LEVELS: {
+    if(data->channels <= levels->channel){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    struct meter_channel *channel = &data->channels_data[levels->channel];
+    levels->peak = meter_float(__atomic_exchange_n(&channel->peak, 0, __ATOMIC_SEQ_CST));
+    levels->true_peak = meter_float(__atomic_exchange_n(&channel->true_peak, 0, __ATOMIC_SEQ_CST));
+    levels->rms = meter_float(atomic_read(channel->rms));
+    levels->momentary = meter_float(atomic_read(data->momentary));
+    levels->short_term = meter_float(atomic_read(data->short_term));
+  } break;
+  case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int meter_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct meter_segment_data *data = (struct meter_segment_data *)segment->data;
+  switch(field){
+  case MIXED_SAMPLERATE:
+    if(*(uint32_t *)value <= 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->samplerate = *(uint32_t *)value;
+    meter_design(data);
+    meter_reset(data);
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_meter(channel_t channels, uint32_t samplerate, struct mixed_segment *segment){
+  if(channels == 0 || samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct meter_segment_data *data = mixed_calloc(1, sizeof(struct meter_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  // The pointer arrays share one allocation, as do the delay lines
+  // and the weighted scratch space.
+  void **pointers = mixed_calloc(7*channels, sizeof(void *));
+  float *scratch = mixed_calloc(channels*(METER_LINE + METER_CHUNK), sizeof(float));
+  data->channels_data = mixed_calloc(channels, sizeof(struct meter_channel));
+  if(!pointers || !scratch || !data->channels_data){
+    if(pointers) mixed_free(pointers);
+    if(scratch) mixed_free(scratch);
+    free_meter_data(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->in = (struct mixed_buffer **)pointers;
+  data->out = (struct mixed_buffer **)pointers + channels;
+  data->ins = (float **)pointers + 2*channels;
+  data->outs = (float **)pointers + 3*channels;
+  data->chunk = (float **)pointers + 4*channels;
+  data->weighted = (float **)pointers + 5*channels;
+  data->lines = (float **)pointers + 6*channels;
+  for(channel_t c=0; c<channels; ++c){
+    data->lines[c] = scratch + c*METER_LINE;
+    data->weighted[c] = scratch + channels*METER_LINE + c*METER_CHUNK;
+  }
+  if(!make_biquad_bank(channels, 2, &data->bank)){
+    free_meter_data(data);
+    return 0;
+  }
+
+  data->channels = channels;
+  data->samplerate = samplerate;
+  meter_design(data);
+  meter_design_taps(data);
+  meter_reset(data);
+
+  segment->free = meter_segment_free;
+  segment->start = meter_segment_start;
+  segment->mix = meter_segment_mix;
+  segment->set_in = meter_segment_set_in;
+  segment->set_out = meter_segment_set_out;
+  segment->info = meter_segment_info;
+  segment->get = meter_segment_get;
+  segment->set = meter_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_meter(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_meter(ARG(channel_t, 0), ARG(uint32_t, 1), segment);
+}
+
+REGISTER_SEGMENT(meter, __make_meter, 2, {
+    {.description = "channels", .type = MIXED_CHANNEL_T},
+    {.description = "samplerate", .type = MIXED_UINT32}})
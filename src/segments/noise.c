@@ -1,10 +1,16 @@
 #include "../internal.h"
-#define WHITE_NOISE_SAMPLES 4096
+// Random values are drawn a block at a time so that the hashing
+// vectorises, and only the shaping of pink and brown noise is serial.
+#define NOISE_BLOCK 256
+// Separates the second stream used by pink noise from the first.
+#define NOISE_SECOND_SEED 0x9E3779B9
 
 struct noise_segment_data{
   struct mixed_buffer *out;
-  float (*type)(struct noise_segment_data *data);
+  enum mixed_noise_type type;
   float volume;
+  uint32_t seed;
+  uint32_t position;
   int64_t pink_rows[30];
   int64_t pink_running_sum;
   int32_t pink_index;
@@ -13,6 +19,16 @@ struct noise_segment_data{
   float brown;
 };
 
+// Restarts the stream from the seed.
+static void noise_reseed(uint32_t seed, struct noise_segment_data *data){
+  data->seed = seed;
+  data->position = 0;
+  data->pink_index = 0;
+  data->pink_running_sum = 0;
+  for(uint32_t i=0; i<30; ++i) data->pink_rows[i] = 0;
+  data->brown = 0.0f;
+}
+
 int noise_segment_free(struct mixed_segment *segment){
   if(segment->data)
     mixed_free(segment->data);
@@ -43,53 +59,64 @@ int noise_segment_set_out(uint32_t field, uint32_t location, void *buffer, struc
   }
 }
 
-float noise_white(struct noise_segment_data *data){
-  IGNORE(data);
-  return mixed_random()*2.0-1.0;
+// Uniform values in [-1, 1), scaled by the volume.
+VECTORIZE static void noise_uniform(uint32_t position, uint32_t seed, float volume, float *out, uint32_t samples){
+  float scale = volume * (1.0f / 0x80000000L);
+  for(uint32_t i=0; i<samples; ++i){
+    out[i] = (int32_t)hash_noise(position+i, seed) * scale;
+  }
 }
 
-float noise_pink(struct noise_segment_data *data){
-  int64_t random;
-  int64_t sum;
-
-  data->pink_index = (data->pink_index + 1) & data->pink_index_mask;
-
-  if(data->pink_index != 0) {
-    int zeroes = 0;
-    int n = data->pink_index;
-    while((n & 1) == 0){
-      n = n >> 1;
-      zeroes++;
+// Voss-McCartney: each row is redrawn every 2^n samples, picked by
+// the trailing zeroes of the index, plus one white value per sample.
+static void noise_pink(struct noise_segment_data *data, float *out, uint32_t samples){
+  float rows[NOISE_BLOCK], white[NOISE_BLOCK];
+  for(uint32_t start=0; start<samples; start+=NOISE_BLOCK){
+    uint32_t count = MIN(NOISE_BLOCK, samples-start);
+    noise_uniform(data->position, data->seed, 8388608.0f, rows, count);
+    noise_uniform(data->position, data->seed ^ NOISE_SECOND_SEED, 8388608.0f, white, count);
+    data->position += count;
+    for(uint32_t i=0; i<count; ++i){
+      data->pink_index = (data->pink_index + 1) & data->pink_index_mask;
+      if(data->pink_index != 0){
+        int zeroes = __builtin_ctz(data->pink_index);
+        data->pink_running_sum -= data->pink_rows[zeroes];
+        data->pink_rows[zeroes] = (int64_t)rows[i];
+        data->pink_running_sum += data->pink_rows[zeroes];
+      }
+      out[start+i] = data->pink_scalar * (data->pink_running_sum + (int64_t)white[i]) * data->volume;
     }
-
-    data->pink_running_sum -= data->pink_rows[zeroes];
-    random = (mixed_random()-0.5)*67108864;
-    data->pink_running_sum += random;
-    data->pink_rows[zeroes] = random;
   }
-  
-  random = (mixed_random()-0.5)*67108864;
-  sum = data->pink_running_sum + random;
-
-  return data->pink_scalar * sum;
 }
 
-float noise_brown(struct noise_segment_data *data){
-  data->brown += (mixed_random()*2.0-1.0);
-  data->brown -= data->brown * 0.03125;
-  return data->brown * 0.06250;
+// A leaky integrator that keeps 31/32 of its value every sample. Fed
+// values in [-1, 1), it can never get past 31 either way.
+static void noise_brown(struct noise_segment_data *data, float *out, uint32_t samples){
+  float brown = data->brown;
+  float scale = data->volume / 31.0f;
+  noise_uniform(data->position, data->seed, 1.0f, out, samples);
+  data->position += samples;
+  for(uint32_t i=0; i<samples; ++i){
+    brown += out[i];
+    brown -= brown * 0.03125;
+    out[i] = brown * scale;
+  }
+  data->brown = brown;
 }
 
 int noise_segment_mix(struct mixed_segment *segment){
   struct noise_segment_data *data = (struct noise_segment_data *)segment->data;
 
-  float (*noise)(struct noise_segment_data *data) = data->type;
-  float volume = data->volume;
   float *out;
   uint32_t samples = UINT32_MAX;
   mixed_buffer_request_write(&out, &samples, data->out);
-  for(uint32_t i=0; i<samples; ++i){
-    out[i] = noise(data) * volume;
+  switch(data->type){
+  case MIXED_WHITE_NOISE:
+    noise_uniform(data->position, data->seed, data->volume, out, samples);
+    data->position += samples;
+    break;
+  case MIXED_PINK_NOISE: noise_pink(data, out, samples); break;
+  case MIXED_BROWN_NOISE: noise_brown(data, out, samples); break;
   }
   mixed_buffer_finish_write(samples, data->out);
   return 1;
@@ -116,7 +143,11 @@ int noise_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   set_info_field(field++, MIXED_NOISE_TYPE,
                  MIXED_NOISE_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The type of noise that is produced.");
-  
+
+  set_info_field(field++, MIXED_NOISE_SEED,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The seed of the random stream.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -129,12 +160,11 @@ int noise_segment_get(uint32_t field, void *value, struct mixed_segment *segment
     *((float *)value) = data->volume;
     break;
   case MIXED_GENERATOR_TYPE:
-    if(data->type == noise_white)
-      *((enum mixed_noise_type *)value) = MIXED_WHITE_NOISE;
-    else if(data->type == noise_pink)
-      *((enum mixed_noise_type *)value) = MIXED_PINK_NOISE;
-    else if(data->type == noise_brown)
-      *((enum mixed_noise_type *)value) = MIXED_BROWN_NOISE;
+  case MIXED_NOISE_TYPE:
+    *((enum mixed_noise_type *)value) = data->type;
+    break;
+  case MIXED_NOISE_SEED:
+    *((uint32_t *)value) = data->seed;
     break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
@@ -151,15 +181,20 @@ int noise_segment_set(uint32_t field, void *value, struct mixed_segment *segment
   case MIXED_NOISE_TYPE: {
     enum mixed_noise_type type = *(enum mixed_noise_type *)value;
     switch(type){
-    case MIXED_WHITE_NOISE: data->type = noise_white; break;
-    case MIXED_PINK_NOISE: data->type = noise_pink; break;
-    case MIXED_BROWN_NOISE: data->type = noise_brown; break;
+    case MIXED_WHITE_NOISE:
+    case MIXED_PINK_NOISE:
+    case MIXED_BROWN_NOISE:
+      data->type = type;
+      break;
     default: 
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
     break;
   }
+  case MIXED_NOISE_SEED:
+    noise_reseed(*(uint32_t *)value, data);
+    break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -173,15 +208,17 @@ MIXED_EXPORT int mixed_make_segment_noise(enum mixed_noise_type type, struct mix
   }
   segment->data = data;
 
-  noise_segment_set(MIXED_NOISE_TYPE, &type, segment);
+  if(!noise_segment_set(MIXED_NOISE_TYPE, &type, segment)){
+    noise_segment_free(segment);
+    return 0;
+  }
   data->volume = 1.0f;
-
-  data->pink_index = 0;
+  // Every segment gets its own stream
+  noise_reseed(mixed_random_int(), data);
   data->pink_index_mask = (1<<30) - 1;
+  // Each of the 30 rows and the white value lies in [-2^23, 2^23).
   long pmax = ((30 + 1) * (1<<(23)));
   data->pink_scalar = 1.0 / (float)pmax;
-  data->pink_running_sum = 0;
-  for(uint32_t i=0; i<30; ++i) data->pink_rows[i] = 0;
   
   segment->free = noise_segment_free;
   segment->start = noise_segment_start;
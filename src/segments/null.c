@@ -41,7 +41,7 @@ int zero_segment_mix(struct mixed_segment *segment){
   uint32_t frames = UINT32_MAX;
   mixed_buffer_request_write(&buffer, &frames, data);
   memset(buffer, 0, frames*sizeof(float));
-  mixed_buffer_finish_write(frames, data);
+  mixed_buffer_finish_write_silence(frames, data);
   return 1;
 }
 
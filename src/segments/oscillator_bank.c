@@ -0,0 +1,236 @@
+#include "../internal.h"
+
+// Voices are kept in parallel arrays so that the mix loop only touches
+// what it needs, and all of them are rendered straight into the output.
+struct oscillator_bank_data{
+  struct mixed_buffer *out;
+  uint32_t count;
+  uint32_t *phase;
+  uint32_t *increment;
+  const float **table;
+  float *frequency;
+  float *amplitude;
+  enum mixed_generator_type *type;
+  uint32_t samplerate;
+  float volume;
+};
+
+static void free_oscillator_bank_data(struct oscillator_bank_data *data){
+  if(data->phase) mixed_free(data->phase);
+  if(data->increment) mixed_free(data->increment);
+  if(data->table) mixed_free(data->table);
+  if(data->frequency) mixed_free(data->frequency);
+  if(data->amplitude) mixed_free(data->amplitude);
+  if(data->type) mixed_free(data->type);
+  mixed_free(data);
+}
+
+static void oscillator_bank_update(uint32_t voice, struct oscillator_bank_data *data){
+  data->increment[voice] = wavetable_increment(data->frequency[voice], data->samplerate);
+  data->table[voice] = wavetable_get(data->type[voice], data->increment[voice]);
+}
+
+int oscillator_bank_segment_free(struct mixed_segment *segment){
+  if(segment->data)
+    free_oscillator_bank_data((struct oscillator_bank_data *)segment->data);
+  segment->data = 0;
+  return 1;
+}
+
+int oscillator_bank_segment_start(struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+  if(data->out == 0){
+    mixed_err(MIXED_BUFFER_MISSING);
+    return 0;
+  }
+  return 1;
+}
+
+int oscillator_bank_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+  switch(field){
+  case MIXED_BUFFER:
+    switch(location){
+    case MIXED_MONO: data->out = (struct mixed_buffer *)buffer; return 1;
+    default: mixed_err(MIXED_INVALID_LOCATION); return 0; break;
+    }
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int oscillator_bank_segment_mix(struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+  float volume = data->volume;
+
+  float *out;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_write(&out, &samples, data->out);
+  memset(out, 0, samples*sizeof(float));
+  for(uint32_t v=0; v<data->count; ++v){
+    float amplitude = data->amplitude[v] * volume;
+    // Silent voices keep running so they come back in phase.
+    if(amplitude == 0.0f)
+      data->phase[v] += samples * data->increment[v];
+    else
+      wavetable_render_add(data->table[v], &data->phase[v], data->increment[v], amplitude, out, samples);
+  }
+  mixed_buffer_finish_write(samples, data->out);
+  return 1;
+}
+
+int oscillator_bank_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  IGNORE(segment);
+
+  info->name = "oscillator_bank";
+  info->description = "Sum of many wave generators into one output";
+  info->min_inputs = 0;
+  info->max_inputs = 0;
+  info->outputs = 1;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_VOLUME,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The amplitude of a voice, or the volume of the whole bank.");
+
+  set_info_field(field++, MIXED_GENERATOR_FREQUENCY,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The frequency in Hz of a voice.");
+
+  set_info_field(field++, MIXED_GENERATOR_TYPE,
+                 MIXED_GENERATOR_TYPE_ENUM, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The type of wave form a voice produces.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int oscillator_bank_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+
+  switch(field){
+  case MIXED_VOLUME: *((float *)value) = data->volume; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int oscillator_bank_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+
+  switch(field){
+  case MIXED_VOLUME: data->volume = *((float *)value); break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int oscillator_bank_segment_get_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+  if(data->count <= location){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  switch(field){
+  case MIXED_VOLUME: *((float *)value) = data->amplitude[location]; break;
+  case MIXED_GENERATOR_FREQUENCY: *((float *)value) = data->frequency[location]; break;
+  case MIXED_GENERATOR_TYPE: *((enum mixed_generator_type *)value) = data->type[location]; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int oscillator_bank_segment_set_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  struct oscillator_bank_data *data = (struct oscillator_bank_data *)segment->data;
+  if(data->count <= location){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+
+  switch(field){
+  case MIXED_VOLUME:
+    data->amplitude[location] = *((float *)value);
+    break;
+  case MIXED_GENERATOR_FREQUENCY:
+    if(*(float *)value < 0.0 ||
+       data->samplerate < *(float *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->frequency[location] = *(float *)value;
+    oscillator_bank_update(location, data);
+    break;
+  case MIXED_GENERATOR_TYPE:
+    if(*(enum mixed_generator_type *)value < MIXED_SINE ||
+       MIXED_SAWTOOTH < *(enum mixed_generator_type *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->type[location] = *(enum mixed_generator_type *)value;
+    oscillator_bank_update(location, data);
+    break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_oscillator_bank(uint32_t voices, enum mixed_generator_type type, uint32_t samplerate, struct mixed_segment *segment){
+  if(type < MIXED_SINE || MIXED_SAWTOOTH < type){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct oscillator_bank_data *data = mixed_calloc(1, sizeof(struct oscillator_bank_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->phase = mixed_calloc(voices, sizeof(uint32_t));
+  data->increment = mixed_calloc(voices, sizeof(uint32_t));
+  data->table = mixed_calloc(voices, sizeof(float *));
+  data->frequency = mixed_calloc(voices, sizeof(float));
+  data->amplitude = mixed_calloc(voices, sizeof(float));
+  data->type = mixed_calloc(voices, sizeof(enum mixed_generator_type));
+  if(!data->phase || !data->increment || !data->table
+     || !data->frequency || !data->amplitude || !data->type){
+    free_oscillator_bank_data(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  data->count = voices;
+  data->samplerate = samplerate;
+  data->volume = 1.0f;
+  wavetable_init();
+  for(uint32_t v=0; v<voices; ++v){
+    data->frequency[v] = 440.0f;
+    data->type[v] = type;
+    oscillator_bank_update(v, data);
+  }
+
+  segment->free = oscillator_bank_segment_free;
+  segment->start = oscillator_bank_segment_start;
+  segment->mix = oscillator_bank_segment_mix;
+  segment->set_out = oscillator_bank_segment_set_out;
+  segment->info = oscillator_bank_segment_info;
+  segment->get = oscillator_bank_segment_get;
+  segment->set = oscillator_bank_segment_set;
+  segment->get_in = oscillator_bank_segment_get_in;
+  segment->set_in = oscillator_bank_segment_set_in;
+  segment->data = data;
+  return 1;
+}
+
+int __make_oscillator_bank(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_oscillator_bank(ARG(uint32_t, 0), ARG(enum mixed_generator_type, 1), ARG(uint32_t, 2), segment);
+}
+
+REGISTER_SEGMENT(oscillator_bank, __make_oscillator_bank, 3, {
+    {.description = "voices", .type = MIXED_UINT32},
+    {.description = "type", .type = MIXED_GENERATOR_TYPE_ENUM},
+    {.description = "samplerate", .type = MIXED_UINT32}})
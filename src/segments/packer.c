@@ -4,20 +4,86 @@
 struct pack_segment_data{
   struct mixed_pack *pack;
   struct mixed_buffer *buffers[12];
-  SRC_STATE *resample_state;
+  // One mono resampler per channel, so that each can work on the
+  // planar buffer memory directly.
+  SRC_STATE *resample_state[12];
+  // Used instead of the above for MIXED_POLYPHASE.
+  struct polyphase polyphase;
+  // Linear interpolators kept ready for MIXED_RESAMPLE_FALLBACK, so
+  // that switching to them never allocates on the mixing thread.
+  SRC_STATE *fallback_state[12];
+  char fallback;
+  // The rate of the output side over the rate of the input side.
+  double ratio;
   uint32_t samplerate;
   float volume;
   float target_volume;
   int quality;
-  float resample_in[512];
-  float resample_out[512];
+  // Planar floats for the pack side of the resampler, one run of
+  // planar_frames per channel.
+  float *planar;
+  uint32_t planar_frames;
+  // With a block size, the frames of the current block that are
+  // already in the output buffers but not yet committed.
+  uint32_t block_size;
+  uint32_t pending;
 };
 
+static void pack_free_states(struct pack_segment_data *data){
+  for(int i=0; i<12; ++i){
+    if(data->resample_state[i])
+      src_delete(data->resample_state[i]);
+    data->resample_state[i] = 0;
+    if(data->fallback_state[i])
+      src_delete(data->fallback_state[i]);
+    data->fallback_state[i] = 0;
+  }
+  free_polyphase(&data->polyphase);
+}
+
+static int pack_make_states(struct pack_segment_data *data){
+  pack_free_states(data);
+  // Those are as cheap as the fallback already.
+  char fallback = (data->quality != MIXED_LINEAR_INTERPOLATION && data->quality != MIXED_ZERO_ORDER_HOLD);
+  if(data->quality == MIXED_POLYPHASE
+     && !make_polyphase(data->ratio, data->pack->channels, &data->polyphase))
+    return 0;
+  for(channel_t c=0; c<data->pack->channels; ++c){
+    int e = 0;
+    if(data->quality != MIXED_POLYPHASE)
+      data->resample_state[c] = src_new(data->quality, 1, &e);
+    if(fallback)
+      data->fallback_state[c] = src_new(MIXED_LINEAR_INTERPOLATION, 1, &e);
+    if((data->quality != MIXED_POLYPHASE && !data->resample_state[c])
+       || (fallback && !data->fallback_state[c])){
+      fprintf(stderr, "libsamplerate: %s\n", src_strerror(e));
+      pack_free_states(data);
+      mixed_err(MIXED_RESAMPLE_FAILED);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Resets the states that are used from now on.
+static void pack_reset_states(struct pack_segment_data *data){
+  if(data->fallback && data->fallback_state[0]){
+    for(channel_t c=0; c<data->pack->channels; ++c)
+      src_reset(data->fallback_state[c]);
+  }else if(data->polyphase.bank){
+    polyphase_reset(&data->polyphase);
+  }else if(data->resample_state[0]){
+    for(channel_t c=0; c<data->pack->channels; ++c)
+      src_reset(data->resample_state[c]);
+  }
+}
+
 int pack_segment_free(struct mixed_segment *segment){
   struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
   if(data){
-    if(data->resample_state)
-      src_delete(data->resample_state);
+    pack_free_states(data);
+    if(data->planar)
+      mixed_free(data->planar);
     mixed_free(data);
   }
   segment->data = 0;
@@ -67,24 +133,66 @@ int pack_segment_start(struct mixed_segment *segment){
     return 0;
   }
 
-  if(data->resample_state)
-    src_reset(data->resample_state);
-  else{
-    int e = 0;
-    SRC_STATE *src_state = src_new(data->quality, data->pack->channels, &e);
-    if(!src_state){
-      fprintf(stderr, "libsamplerate: %s\n", src_strerror(e));
+  // The planar side only ever holds as many frames as fit in the pack.
+  uint32_t frames = data->pack->size / pack_frame_bytes(data->pack);
+  if(data->planar_frames < frames){
+    float *planar = crealloc(data->planar, data->planar_frames*data->pack->channels, frames*data->pack->channels, sizeof(float));
+    if(!planar){
       mixed_err(MIXED_OUT_OF_MEMORY);
       return 0;
     }
-    data->resample_state = src_state;
+    data->planar = planar;
+    data->planar_frames = frames;
+  }
+  data->pending = 0;
+  // Nothing played before, so there is nothing to ramp from.
+  data->volume = data->target_volume;
+
+  // The packer converts from our rate to the pack's.
+  if(segment->set_in == pack_segment_set_buffer)
+    ratio = 1.0 / ratio;
+  if((data->polyphase.bank && data->polyphase.ratio == ratio && data->polyphase.channels == data->pack->channels)
+     || (data->resample_state[0] && data->ratio == ratio)){
+    pack_reset_states(data);
+  }else{
+    data->ratio = ratio;
+    if(!pack_make_states(data)) return 0;
   }
   return 1;
 }
 
-// FIXME: by using separate states per channel we could alias the
-//        SRC_DATA arrays with the input buffer arrays and avoid
-//        extra allocation and copying on at least one side.
+// Runs every channel's resampler over the same span. The states all
+// share a ratio and history length, so they consume and produce in
+// lockstep, but we take the smallest counts to be safe.
+static int pack_resample(struct pack_segment_data *data, double ratio, float **in, float **out, uint32_t *frames, uint32_t *out_frames){
+  SRC_STATE **states = data->resample_state;
+  if(data->fallback && data->fallback_state[0]){
+    states = data->fallback_state;
+  }else if(data->quality == MIXED_POLYPHASE){
+    polyphase_process(in, frames, out, out_frames, &data->polyphase);
+    return 1;
+  }
+  uint32_t used = *frames, generated = *out_frames;
+  for(channel_t c=0; c<data->pack->channels; ++c){
+    SRC_DATA src_data = {0};
+    src_data.data_in = in[c];
+    src_data.data_out = out[c];
+    src_data.input_frames = *frames;
+    src_data.output_frames = *out_frames;
+    src_data.src_ratio = ratio;
+    int e = src_process(states[c], &src_data);
+    if(e){
+      fprintf(stderr, "libsamplerate: %s\n", src_strerror(e));
+      mixed_err(MIXED_RESAMPLE_FAILED);
+      return 0;
+    }
+    used = MIN(used, src_data.input_frames_used);
+    generated = MIN(generated, src_data.output_frames_gen);
+  }
+  *frames = used;
+  *out_frames = generated;
+  return 1;
+}
 
 int source_segment_mix(struct mixed_segment *segment){
   struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
@@ -93,55 +201,100 @@ int source_segment_mix(struct mixed_segment *segment){
   if(pack->samplerate == data->samplerate){
     mixed_buffer_from_pack(data->pack, data->buffers, &data->volume, data->target_volume);
   }else{
-    void *pack_data;
-    float *target = data->resample_in;
+    char *pack_data;
     channel_t channels = pack->channels;
-    uint32_t frames, buffer_frames = 512 / channels;
-    uint32_t frames_to_bytes = channels * mixed_samplesize(pack->encoding);
+    uint8_t stride = pack_stride(pack);
+    uint32_t frames, frames_to_bytes = pack_frame_bytes(pack);
+    double ratio = ((double)data->samplerate)/((double)pack->samplerate);
     mixed_transfer_function_from decoder = mixed_translator_from(pack->encoding);
-    SRC_DATA src_data = {0};
-    src_data.src_ratio = ((double)data->samplerate)/((double)pack->samplerate);
-    src_data.data_in = target;
-    src_data.data_out = data->resample_out;
+    float *planar[channels], *out[channels];
+    for(channel_t c=0; c<channels; ++c)
+      planar[c] = data->planar + c*data->planar_frames;
     do{
-      // Step 1: determine available space
-      frames = buffer_frames;
+      // Decode into the planar scratch, but no more than the output
+      // can take, then resample straight into the buffers.
+      uint32_t bytes = UINT32_MAX, out_frames = UINT32_MAX;
+      mixed_pack_request_read((void **)&pack_data, &bytes, pack);
+      mixed_buffers_request_write(channels, data->buffers, out, &out_frames);
+      frames = MIN(data->planar_frames, bytes / frames_to_bytes);
+      frames = MIN(frames, (uint32_t)(out_frames / ratio) + 1);
+      if(!pack_data || out_frames == 0){
+        mixed_buffers_finish_write(channels, data->buffers, 0);
+        break;
+      }
       for(channel_t c=0; c<channels; ++c)
-        frames = MIN(frames, mixed_buffer_available_write(data->buffers[c]));
-      src_data.output_frames = frames;
-      // Step 2: unpack to contiguous floats
-      uint32_t bytes = UINT32_MAX;
-      mixed_pack_request_read(&pack_data, &bytes, pack);
-      frames = MIN(frames, bytes / frames_to_bytes);
-      if(pack_data){
-        data->volume = decoder(pack_data, (float*)src_data.data_in, 1, frames*channels, data->volume, data->target_volume);
-        // Step 3: resample
-        src_data.input_frames = frames;
-        int e = src_process(data->resample_state, &src_data);
-        if(e){
-          fprintf(stderr, "libsamplerate: %s\n", src_strerror(e));
-          mixed_err(MIXED_RESAMPLE_FAILED);
-          return 0;
-        }
-        // Step 4: transfer from contigous to separate buffers
-        frames = src_data.input_frames_used;
-        float *source = src_data.data_out;
-        for(channel_t c=0; c<channels; ++c){
-          uint32_t out_frames = src_data.output_frames_gen;
-          mixed_buffer_request_write(&target, &out_frames, data->buffers[c]);
-          for(uint32_t i=0; i<out_frames; ++i)
-            target[i] = source[i*channels];
-          source++;
-          mixed_buffer_finish_write(out_frames, data->buffers[c]);
-        }
-        // Step 5: update consumed samples
-        mixed_pack_finish_read(frames * frames_to_bytes, pack);
+        decoder(pack_data + pack_channel_offset(c, pack), planar[c], stride, frames, data->volume, data->target_volume);
+      data->volume = data->target_volume;
+      if(!pack_resample(data, ratio, planar, out, &frames, &out_frames)){
+        mixed_buffers_finish_write(channels, data->buffers, 0);
+        return 0;
       }
+      mixed_buffers_finish_write(channels, data->buffers, out_frames);
+      mixed_pack_finish_read(frames * frames_to_bytes, pack);
     }while(frames);
   }
   return 1;
 }
 
+// In block mode we only ever commit whole blocks. A block is built up
+// in the output areas over as many mixes as it takes, which works as
+// the consumer cannot read anything we have not committed.
+int source_segment_mix_block(struct mixed_segment *segment){
+  struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
+  struct mixed_pack *pack = data->pack;
+  channel_t channels = pack->channels;
+  uint8_t stride = pack_stride(pack);
+  uint32_t block = data->block_size, frames_to_bytes = pack_frame_bytes(pack);
+  double ratio = ((double)data->samplerate)/((double)pack->samplerate);
+  mixed_transfer_function_from decoder = mixed_translator_from(pack->encoding);
+  float *planar[channels], *out[channels], *at[channels];
+
+  uint32_t out_frames = block;
+  mixed_buffers_request_write(channels, data->buffers, out, &out_frames);
+  // The last block has not been consumed yet.
+  if(out_frames < block){
+    mixed_buffers_finish_write(channels, data->buffers, 0);
+    return 1;
+  }
+  for(channel_t c=0; c<channels; ++c)
+    planar[c] = data->planar + c*data->planar_frames;
+
+  while(data->pending < block){
+    char *pack_data;
+    uint32_t bytes = UINT32_MAX, want = block - data->pending, generated;
+    mixed_pack_request_read((void **)&pack_data, &bytes, pack);
+    uint32_t frames = MIN(data->planar_frames, bytes / frames_to_bytes);
+    for(channel_t c=0; c<channels; ++c)
+      at[c] = out[c] + data->pending;
+    if(pack->samplerate == data->samplerate){
+      frames = generated = MIN(frames, want);
+      for(channel_t c=0; c<channels && frames; ++c)
+        decoder(pack_data + pack_channel_offset(c, pack), at[c], stride, frames, data->volume, data->target_volume);
+    }else{
+      frames = MIN(frames, (uint32_t)(want / ratio) + 1);
+      for(channel_t c=0; c<channels && frames; ++c)
+        decoder(pack_data + pack_channel_offset(c, pack), planar[c], stride, frames, data->volume, data->target_volume);
+      generated = want;
+      if(!pack_resample(data, ratio, planar, at, &frames, &generated)){
+        mixed_buffers_finish_write(channels, data->buffers, 0);
+        return 0;
+      }
+    }
+    if(frames) data->volume = data->target_volume;
+    mixed_pack_finish_read(frames * frames_to_bytes, pack);
+    data->pending += generated;
+    if(frames == 0 && generated == 0) break;
+  }
+
+  if(data->pending == block){
+    data->pending = 0;
+    mixed_buffers_finish_write(channels, data->buffers, block);
+  }else{
+    mixed_buffers_finish_write(channels, data->buffers, 0);
+  }
+  return 1;
+}
+
 int drain_segment_mix(struct mixed_segment *segment){
   struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
   struct mixed_pack *pack = data->pack;
@@ -149,63 +302,51 @@ int drain_segment_mix(struct mixed_segment *segment){
   if(pack->samplerate == data->samplerate){
     mixed_buffer_to_pack(data->buffers, pack, &data->volume, data->target_volume);
   }else{
-    void *pack_data;
-    float *target = data->resample_in;
+    char *pack_data;
     channel_t channels = pack->channels;
-    uint32_t frames, buffer_frames = 512 / channels;
-    uint32_t frames_to_bytes = channels * mixed_samplesize(pack->encoding);
+    uint8_t stride = pack_stride(pack);
+    uint32_t frames, frames_to_bytes = pack_frame_bytes(pack);
+    double ratio = ((double)pack->samplerate)/((double)data->samplerate);
     mixed_transfer_function_to encoder = mixed_translator_to(pack->encoding);
-    SRC_DATA src_data = {0};
-    src_data.src_ratio = ((double)pack->samplerate)/((double)data->samplerate);
-    src_data.data_in = target;
-    src_data.data_out = data->resample_out;
+    float *planar[channels], *in[channels];
+    for(channel_t c=0; c<channels; ++c)
+      planar[c] = data->planar + c*data->planar_frames;
     do{
       uint32_t bytes = UINT32_MAX;
-      // Interleave data, count frames
-      mixed_pack_request_write(&pack_data, &bytes, pack);
+      mixed_pack_request_write((void **)&pack_data, &bytes, pack);
       // If we don't even have 2 frames worth of data remaining to write, clear.
       if(bytes < 2*frames_to_bytes && mixed_pack_available_read(pack) == 0){
         mixed_pack_clear(pack);
-        mixed_pack_request_write(&pack_data, &bytes, pack);
+        mixed_pack_request_write((void **)&pack_data, &bytes, pack);
       }
-      src_data.output_frames = MIN(buffer_frames, bytes / frames_to_bytes);
-      frames = MIN(buffer_frames, (src_data.output_frames*data->samplerate) / pack->samplerate);
-      if(pack_data){
-        for(channel_t c=0; c<channels; ++c){
-          float *source;
-          mixed_buffer_request_read(&source, &frames, data->buffers[c]);
-          for(uint32_t i=0; i<frames; ++i)
-            target[c+i*channels] = source[i];
-        }
-        // Resample
-        src_data.input_frames = frames;
-        int e = src_process(data->resample_state, &src_data);
-        if(e){
-          fprintf(stderr, "libsamplerate: %s\n", src_strerror(e));
-          mixed_error(MIXED_RESAMPLE_FAILED);
-          return 0;
-        }
-        // Pack
-        frames = src_data.input_frames_used;
-        uint32_t out_frames = src_data.output_frames_gen;
-        data->volume = encoder(src_data.data_out, pack_data, 1, out_frames*channels, data->volume, data->target_volume);
-        // Update consumed buffers
-        mixed_pack_finish_write(out_frames * frames_to_bytes, pack);
-        for(channel_t c=0; c<channels; ++c){
-          mixed_buffer_finish_read(frames, data->buffers[c]);
-        }
+      if(!pack_data) break;
+      // Resample straight from the buffers into the planar scratch,
+      // then interleave that into the pack.
+      uint32_t out_frames = MIN(data->planar_frames, bytes / frames_to_bytes);
+      frames = (uint32_t)(((uint64_t)out_frames*data->samplerate) / pack->samplerate);
+      // An empty buffer hands out no area, but the resampler may still
+      // have output pending and refuses a null source, so give it the
+      // buffer's own storage to read nothing from.
+      if(!mixed_buffers_request_read(channels, data->buffers, in, &frames)){
+        for(channel_t c=0; c<channels; ++c)
+          in[c] = data->buffers[c]->_data;
       }
+      if(!pack_resample(data, ratio, in, planar, &frames, &out_frames))
+        return 0;
+      for(channel_t c=0; c<channels; ++c)
+        encoder(planar[c], pack_data + pack_channel_offset(c, pack), stride, out_frames, data->volume, data->target_volume);
+      data->volume = data->target_volume;
+      mixed_pack_finish_write(out_frames * frames_to_bytes, pack);
+      mixed_buffers_finish_read(channels, data->buffers, frames);
     }while(frames);
   }
   return 1;
 }
 
 int pack_segment_end(struct mixed_segment *segment){
-  struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
-  if(data->resample_state){
-    src_delete(data->resample_state);
-    data->resample_state = 0;
-  }
+  // The resampler states are kept, so that starting again at the
+  // same ratio only resets them instead of allocating anew.
+  IGNORE(segment);
   return 1;
 }
 
@@ -213,24 +354,34 @@ int source_segment_set(uint32_t field, void *value, struct mixed_segment *segmen
   struct pack_segment_data *data = (struct pack_segment_data *)segment->data;
   
   switch(field){
-  case MIXED_RESAMPLE_TYPE: {
-    int error;
+  case MIXED_RESAMPLE_TYPE:
+    if(MIXED_POLYPHASE < *(enum mixed_resample_type *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
     data->quality = *(enum mixed_resample_type *)value;
-    if(data->resample_state){
-      SRC_STATE *new = src_new(data->quality, data->pack->channels, &error);
-      if(!new) {
-        mixed_err(MIXED_RESAMPLE_FAILED);
-        return 0;
-      }
-      if(data->resample_state)
-        src_delete(data->resample_state);
-      data->resample_state = new;
+    if(data->resample_state[0] || data->polyphase.bank)
+      return pack_make_states(data);
+    return 1;
+  case MIXED_RESAMPLE_FALLBACK:
+    if(data->fallback != *(bool *)value){
+      data->fallback = *(bool *)value;
+      pack_reset_states(data);
     }
-  }
     return 1;
   case MIXED_VOLUME:
     data->target_volume = *((float *)value);
     return 1;
+  case MIXED_PACK: {
+    struct mixed_pack *pack = *(struct mixed_pack **)value;
+    if(!pack || pack->channels != data->pack->channels
+       || pack->encoding < MIXED_INT8 || MIXED_DOUBLE < pack->encoding){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->pack = pack;
+    data->pending = 0;
+    return 1; }
   case MIXED_BYPASS:
     if(*(bool *)value){
       for(channel_t i=0; i<data->pack->channels; ++i){
@@ -238,9 +389,15 @@ int source_segment_set(uint32_t field, void *value, struct mixed_segment *segmen
       }
       segment->mix = mix_noop;
     }else{
-      segment->mix = source_segment_mix;
+      segment->mix = (data->block_size)? source_segment_mix_block : source_segment_mix;
     }
     return 1;
+  case MIXED_BLOCK_SIZE:
+    data->block_size = *(uint32_t *)value;
+    data->pending = 0;
+    if(segment->mix != mix_noop)
+      segment->mix = (data->block_size)? source_segment_mix_block : source_segment_mix;
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -249,6 +406,10 @@ int source_segment_set(uint32_t field, void *value, struct mixed_segment *segmen
 
 int drain_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
   switch(field){
+  case MIXED_BLOCK_SIZE:
+    // The packer takes whatever it is given already.
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
   case MIXED_BYPASS:
     if(*(bool *)value){
       segment->mix = mix_noop;
@@ -268,12 +429,21 @@ int packer_segment_get(uint32_t field, void *value, struct mixed_segment *segmen
   case MIXED_RESAMPLE_TYPE:
     *((int *)value) = data->quality;
     return 1;
+  case MIXED_RESAMPLE_FALLBACK:
+    *(bool *)value = data->fallback;
+    return 1;
   case MIXED_VOLUME:
     *((float *)value) = data->target_volume;
     return 1;
+  case MIXED_PACK:
+    *(struct mixed_pack **)value = data->pack;
+    return 1;
   case MIXED_BYPASS:
     *(bool *)value = (segment->mix == mix_noop);
     return 1;
+  case MIXED_BLOCK_SIZE:
+    *(uint32_t *)value = data->block_size;
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -300,9 +470,22 @@ int source_segment_info(struct mixed_segment_info *info, struct mixed_segment *s
                  MIXED_RESAMPLE_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The type of resampling algorithm used.");
 
+  set_info_field(field++, MIXED_RESAMPLE_FALLBACK,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether to resample by linear interpolation instead.");
+
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
+
+  set_info_field(field++, MIXED_PACK,
+                 MIXED_PACK_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The pack to read from or write to.");
+
+  if(segment->set_out == pack_segment_set_buffer)
+    set_info_field(field++, MIXED_BLOCK_SIZE,
+                   MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                   "Only output whole blocks of this many frames, or 0.");
   
   clear_info_field(field++);
   return 1;
@@ -4,6 +4,8 @@ struct pitch_segment_data{
   struct mixed_buffer *in;
   struct mixed_buffer *out;
   struct pitch_data pitch_data;
+  struct wsola_data wsola_data;
+  enum mixed_pitch_mode mode;
   uint32_t samplerate;
   float pitch;
   float mix;
@@ -12,6 +14,7 @@ struct pitch_segment_data{
 int pitch_segment_free(struct mixed_segment *segment){
   if(segment->data){
     free_pitch_data(&((struct pitch_segment_data *)segment->data)->pitch_data);
+    free_wsola_data(&((struct pitch_segment_data *)segment->data)->wsola_data);
     mixed_free(segment->data);
   }
   segment->data = 0;
@@ -72,7 +75,11 @@ int pitch_segment_mix(struct mixed_segment *segment){
     float mix = data->mix;
     mixed_buffer_request_read(&in, &samples, data->in);
     mixed_buffer_request_write(&out, &samples, data->out);
-    pitch_shift(data->pitch, in, out, samples, &data->pitch_data);
+    if(data->mode == MIXED_PITCH_WSOLA){
+      wsola_shift(data->pitch, in, out, samples, &data->wsola_data);
+    }else{
+      pitch_shift(data->pitch, in, out, samples, &data->pitch_data);
+    }
     for(uint32_t i=0; i<samples; ++i){
       out[i] = LERP(in[i], out[i], mix);
     }
@@ -93,7 +100,8 @@ int pitch_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   
   info->name = "pitch";
   info->description = "Shift the pitch of the audio.";
-  info->flags = MIXED_INPLACE;
+  // The dry signal is needed after shifting, so it cannot work in place.
+  info->flags = 0;
   info->min_inputs = 1;
   info->max_inputs = 1;
   info->outputs = 1;
@@ -107,6 +115,10 @@ int pitch_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The amount of change in pitch that is excised.");
 
+  set_info_field(field++, MIXED_PITCH_MODE,
+                 MIXED_PITCH_MODE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The algorithm with which the pitch is shifted.");
+
   set_info_field(field++, MIXED_SAMPLERATE,
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
@@ -118,6 +130,10 @@ int pitch_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
+
+  set_info_field(field++, MIXED_LATENCY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The number of frames the shifted output lags behind.");
   
   clear_info_field(field++);
   return 1;
@@ -127,9 +143,18 @@ int pitch_segment_get(uint32_t field, void *value, struct mixed_segment *segment
   struct pitch_segment_data *data = (struct pitch_segment_data *)segment->data;
   switch(field){
   case MIXED_PITCH_SHIFT: *((float *)value) = data->pitch; break;
+  case MIXED_PITCH_MODE: *((enum mixed_pitch_mode *)value) = data->mode; break;
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
   case MIXED_MIX: *((float *)value) = data->mix; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == pitch_segment_mix_bypass); break;
+  case MIXED_LATENCY:
+    if(segment->mix == pitch_segment_mix_bypass || data->pitch == 1.0)
+      *((uint32_t *)value) = 0;
+    else if(data->mode == MIXED_PITCH_WSOLA)
+      *((uint32_t *)value) = data->wsola_data.delay;
+    else
+      *((uint32_t *)value) = data->pitch_data.framesize - data->pitch_data.framesize/data->pitch_data.oversampling;
+    break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -148,14 +173,37 @@ int pitch_segment_set(uint32_t field, void *value, struct mixed_segment *segment
     if(!make_pitch_data(2048, 4, data->samplerate, &data->pitch_data)){
       return 0;
     }
+    if(data->wsola_data.window){
+      free_wsola_data(&data->wsola_data);
+      if(!make_wsola_data(data->pitch, data->samplerate, &data->wsola_data))
+        return 0;
+    }
     break;
   case MIXED_PITCH_SHIFT:
     if(*(float *)value <= 0.0){
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
+    if(data->wsola_data.window && !wsola_fit(*(float *)value, &data->wsola_data)){
+      return 0;
+    }
     data->pitch = *(float *)value;
     break;
+  case MIXED_PITCH_MODE:
+    switch(*(enum mixed_pitch_mode *)value){
+    case MIXED_PITCH_SPECTRAL:
+      break;
+    case MIXED_PITCH_WSOLA:
+      // Only allocated once it is first asked for.
+      if(!data->wsola_data.window && !make_wsola_data(data->pitch, data->samplerate, &data->wsola_data))
+        return 0;
+      break;
+    default:
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->mode = *(enum mixed_pitch_mode *)value;
+    break;
   case MIXED_MIX:
     if(*(float *)value < 0 || 1 < *(float *)value){
       mixed_err(MIXED_INVALID_VALUE);
@@ -197,6 +245,7 @@ MIXED_EXPORT int mixed_make_segment_pitch(float pitch, uint32_t samplerate, stru
   }
 
   data->pitch = pitch;
+  data->mode = MIXED_PITCH_SPECTRAL;
   data->samplerate = samplerate;
   data->mix = 1.0;
   
@@ -1,21 +1,51 @@
 #include "../internal.h"
 
-struct plane_source{
-  struct mixed_buffer *buffer;
-  float location[2];
-  float velocity[2];
-  float min_distance;
-  float max_distance;
-  float rolloff;
+// Sources are kept as columns, see space_mixer.c.
+enum plane_column{
+  PLANE_X, PLANE_Y,
+  PLANE_VX, PLANE_VY,
+  PLANE_MIN_DISTANCE,
+  PLANE_MAX_DISTANCE,
+  PLANE_ROLLOFF,
+  // Results of the last calculation, see plane_mixer_mix.
+  PLANE_DISTANCE,
+  PLANE_LPAN, PLANE_RPAN,
+  PLANE_LVOLUME, PLANE_RVOLUME,
+  PLANE_LGAIN, PLANE_RGAIN,
+  PLANE_PITCH,
+  PLANE_LOUDNESS,
+  PLANE_PRIORITY,
+  PLANE_COLUMNS
 };
 
+#define PLANE_CLEAN 0
+#define PLANE_DIRTY 1
+#define PLANE_FRESH 2
+
+// See SPACE_AUDIBLE.
+#define PLANE_AUDIBLE 0
+#define PLANE_CULLED 1
+#define PLANE_STOLEN 2
+#define PLANE_FADING 3
+#define PLANE_VIRTUAL(state) ((state) == PLANE_CULLED || (state) == PLANE_STOLEN)
+
+// Shifted sources are resampled in pieces of this many samples.
+#define PLANE_CHUNK 256
+
 struct plane_mixer_data{
-  struct plane_source **sources;
+  struct mixed_buffer **buffers;
   uint32_t count;
   uint32_t size;
+  float **areas;
+  uint8_t *dirty;
+  uint8_t *culled;
+  uint8_t *candidates;
+  uint8_t *stolen;
+  uint32_t *order;
+  struct resample_data *resamplers;
+  struct columns sources;
   struct mixed_buffer *left;
   struct mixed_buffer *right;
-  struct pitch_data pitch_data;
   float location[2];
   float velocity[2];
   float soundspeed;
@@ -24,14 +54,52 @@ struct plane_mixer_data{
   float max_distance;
   float rolloff;
   float volume;
+  float cull_threshold;
+  uint32_t max_voices;
   float (*attenuation)(float min, float max, float dist, float roll);
+  uint8_t sources_changed;
+  uint8_t listener_changed;
 };
 
+static int plane_mixer_fit_sources(struct plane_mixer_data *data){
+  uint32_t size = data->sources.size;
+  if(size < data->size){
+    float **areas = crealloc(data->areas, size, data->size, sizeof(float *));
+    if(areas) data->areas = areas;
+    uint8_t *dirty = crealloc(data->dirty, size, data->size, sizeof(uint8_t));
+    if(dirty) data->dirty = dirty;
+    uint8_t *culled = crealloc(data->culled, size, data->size, sizeof(uint8_t));
+    if(culled) data->culled = culled;
+    uint8_t *candidates = crealloc(data->candidates, size, data->size, sizeof(uint8_t));
+    if(candidates) data->candidates = candidates;
+    uint8_t *stolen = crealloc(data->stolen, size, data->size, sizeof(uint8_t));
+    if(stolen) data->stolen = stolen;
+    uint32_t *order = crealloc(data->order, size, data->size, sizeof(uint32_t));
+    if(order) data->order = order;
+    struct resample_data *resamplers = crealloc(data->resamplers, size, data->size, sizeof(struct resample_data));
+    if(resamplers) data->resamplers = resamplers;
+    if(!areas || !dirty || !culled || !candidates || !stolen || !order || !resamplers){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(!columns_reserve(data->size, &data->sources))
+      return 0;
+  }
+  return 1;
+}
+
 int plane_mixer_free(struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
   if(data){
-    free_pitch_data(&data->pitch_data);
-    mixed_free(data->sources);
+    free_columns(&data->sources);
+    if(data->areas) mixed_free(data->areas);
+    if(data->dirty) mixed_free(data->dirty);
+    if(data->culled) mixed_free(data->culled);
+    if(data->candidates) mixed_free(data->candidates);
+    if(data->stolen) mixed_free(data->stolen);
+    if(data->order) mixed_free(data->order);
+    if(data->resamplers) mixed_free(data->resamplers);
+    free_vector((struct vector *)data);
     mixed_free(data);
   }
   segment->data = 0;
@@ -44,22 +112,10 @@ int plane_mixer_start(struct mixed_segment *segment){
     mixed_err(MIXED_BUFFER_MISSING);
     return 0;
   }
+  memset(data->resamplers, 0, data->count*sizeof(struct resample_data));
   return 1;
 }
 
-static inline float dot(float a[2], float b[2]){
-  return a[0]*b[0]+a[1]*b[1];
-}
-
-static inline float mag(float a[2]){
-  return sqrt(a[0]*a[0] + a[1]*a[1]);
-}
-
-static inline float dist(float a[2], float b[2]){
-  float r[2] = {a[0] - b[0], a[1] - b[1]};
-  return mag(r);
-}
-
 static inline float min(float a, float b){
   return (a < b)? a : b;
 }
@@ -68,82 +124,215 @@ static inline float clamp(float l, float v, float r){
   return (v < l)? l : ((v < r)? v : r);
 }
 
-VECTORIZE static inline void calculate_volumes(float *lvolume, float *rvolume, struct plane_source *source, struct plane_mixer_data *data){
-  float min_dist = source->min_distance;
-  float max_dist = source->max_distance;
-  float roll = source->rolloff;
-  float div = data->volume;
-  float *src = source->location;
-  float *dst = data->location;
-  float distance = clamp(min_dist, dist(src, dst), max_dist);
-  float volume = div * data->attenuation(min_dist, max_dist, distance, roll);
-  float xdiff = src[0]-dst[0];
-  float xdist = fabs(xdiff);
-  float pan = (xdist <= min_dist)
-    ? 0.0
-    : copysignf((min(max_dist,xdist)-min_dist)/(max_dist-min_dist), xdiff);
-  *lvolume = volume * ((0.0<pan)?(1.0f-pan):1.0f);
-  *rvolume = volume * ((pan<0.0)?(1.0f+pan):1.0f);
-}
+struct plane_listener{
+  float location[2];
+  float velocity[2];
+  float soundspeed;
+  float doppler_factor;
+};
 
-VECTORIZE static inline float calculate_pitch_shift(struct plane_mixer_data *listener, struct plane_source *source){
-  if(listener->doppler_factor <= 0.0) return 1.0;
-  // See OpenAL1.1 specification §3.5.2
-  float SL[2] = {listener->location[0] - source->location[0],
-                 listener->location[1] - source->location[1]};
-  float *SV = source->velocity;
-  float *LV = listener->velocity;
+// The plane version of space_sweep, panning by the horizontal offset.
+VECTORIZE static void plane_sweep(const struct plane_listener *listener, uint32_t count,
+                                  const float *restrict x, const float *restrict y,
+                                  const float *restrict vx, const float *restrict vy,
+                                  const float *restrict mind, const float *restrict maxd,
+                                  float *restrict distance, float *restrict lpan, float *restrict rpan, float *restrict pitch){
+  float Lx = listener->location[0], Ly = listener->location[1];
+  float LVx = listener->velocity[0], LVy = listener->velocity[1];
   float SS = listener->soundspeed;
   float DF = listener->doppler_factor;
-  float Mag = mag(SL);
-  float vls = dot(SL, LV) * Mag;
-  float vss = dot(SL, SV) * Mag;
   float SS_DF = SS/DF;
-  vss = min(vss, SS_DF);
-  vls = min(vls, SS_DF);
-  return (SS - DF*vls) / (SS - DF*vss);
+
+  for(uint32_t i=0; i<count; ++i){
+    float dx = x[i]-Lx, dy = y[i]-Ly;
+    float raw = sqrtf(dx*dx + dy*dy);
+    float xdist = fabsf(dx);
+    float pan = (xdist <= mind[i])
+      ? 0.0f
+      : copysignf((min(maxd[i], xdist)-mind[i])/(maxd[i]-mind[i]), dx);
+    distance[i] = clamp(mind[i], raw, maxd[i]);
+    lpan[i] = (0.0f < pan)? (1.0f-pan) : 1.0f;
+    rpan[i] = (pan < 0.0f)? (1.0f+pan) : 1.0f;
+    // See OpenAL1.1 specification §3.5.2
+    float vls = min(-(dx*LVx + dy*LVy) * raw, SS_DF);
+    float vss = min(-(dx*vx[i] + dy*vy[i]) * raw, SS_DF);
+    pitch[i] = clamp(0.5f, (SS - DF*vls) / (SS - DF*vss), 2.0f);
+  }
+}
+
+static void plane_mixer_sweep(struct plane_mixer_data *data){
+  struct columns *sources = &data->sources;
+  struct plane_listener listener = {
+    .location = {data->location[0], data->location[1]},
+    .velocity = {data->velocity[0], data->velocity[1]},
+    .soundspeed = data->soundspeed,
+    .doppler_factor = data->doppler_factor
+  };
+  plane_sweep(&listener, data->count,
+              column(PLANE_X, sources), column(PLANE_Y, sources),
+              column(PLANE_VX, sources), column(PLANE_VY, sources),
+              column(PLANE_MIN_DISTANCE, sources), column(PLANE_MAX_DISTANCE, sources),
+              column(PLANE_DISTANCE, sources), column(PLANE_LPAN, sources),
+              column(PLANE_RPAN, sources), column(PLANE_PITCH, sources));
+  if(data->doppler_factor <= 0.0f){
+    float *pitch = column(PLANE_PITCH, sources);
+    for(uint32_t i=0; i<data->count; ++i)
+      pitch[i] = 1.0f;
+  }
+}
+
+VECTORIZE static void mix_pan(float *in, float *left, float *right, float lstart, float lstep, float rstart, float rstep, uint32_t samples){
+  if(lstep == 0.0f && rstep == 0.0f){
+    for(uint32_t i=0; i<samples; ++i){
+      float sample = in[i];
+      left[i] += sample * lstart;
+      right[i] += sample * rstart;
+    }
+    return;
+  }
+  for(uint32_t i=0; i<samples; ++i){
+    float sample = in[i];
+    left[i] += sample * (lstart + lstep*i);
+    right[i] += sample * (rstart + rstep*i);
+  }
 }
 
-VECTORIZE int plane_mixer_mix(struct mixed_segment *segment){
+// See space_mixer_limit.
+static void plane_mixer_limit(struct plane_mixer_data *data){
+  struct columns *sources = &data->sources;
+  float *loudness = column(PLANE_LOUDNESS, sources);
+  for(uint32_t s=0; s<data->count; ++s)
+    data->candidates[s] = (data->buffers[s] && data->culled[s] != PLANE_CULLED);
+  voices_limit(data->count, data->max_voices, data->candidates,
+               column(PLANE_PRIORITY, sources), loudness, data->order, data->stolen);
+  for(uint32_t s=0; s<data->count; ++s){
+    if(!data->candidates[s]) continue;
+    if(data->stolen[s]){
+      if(data->culled[s] == PLANE_AUDIBLE)
+        data->culled[s] = PLANE_FADING;
+      column(PLANE_LVOLUME, sources)[s] = 0.0f;
+      column(PLANE_RVOLUME, sources)[s] = 0.0f;
+    }else if(data->culled[s] != PLANE_AUDIBLE){
+      data->culled[s] = PLANE_AUDIBLE;
+      column(PLANE_LVOLUME, sources)[s] = loudness[s] * column(PLANE_LPAN, sources)[s];
+      column(PLANE_RVOLUME, sources)[s] = loudness[s] * column(PLANE_RPAN, sources)[s];
+    }
+  }
+}
+
+// Recalculates changed sources, culls inaudible ones, limits voices, and smooths
+// their volumes over the block, like space_mixer_mix.
+int plane_mixer_mix(struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
-  float *left, *right, *in;
+  struct columns *sources = &data->sources;
   uint32_t count = data->count;
+  float *left, *right;
   uint32_t samples = UINT32_MAX;
+  int silent = 0;
+  float *distance = column(PLANE_DISTANCE, sources), *pitch = column(PLANE_PITCH, sources);
+  float *lpan = column(PLANE_LPAN, sources), *rpan = column(PLANE_RPAN, sources);
+  float *lvolume = column(PLANE_LVOLUME, sources), *rvolume = column(PLANE_RVOLUME, sources);
+  float *lgain = column(PLANE_LGAIN, sources), *rgain = column(PLANE_RGAIN, sources);
+  float *mind = column(PLANE_MIN_DISTANCE, sources), *maxd = column(PLANE_MAX_DISTANCE, sources);
+  float *roll = column(PLANE_ROLLOFF, sources);
+
+  uint8_t listener = data->listener_changed;
+  if(listener || data->sources_changed){
+    plane_mixer_sweep(data);
+    for(uint32_t s=0; s<count; ++s){
+      if(!data->buffers[s] || !(listener || data->dirty[s])) continue;
+      float volume = data->volume * data->attenuation(mind[s], maxd[s], distance[s], roll[s]);
+      lvolume[s] = volume * lpan[s];
+      rvolume[s] = volume * rpan[s];
+      uint8_t state = data->culled[s];
+      if(fabsf(volume) < data->cull_threshold)
+        data->culled[s] = PLANE_CULLED;
+      else if(!data->max_voices || state == PLANE_CULLED)
+        data->culled[s] = PLANE_AUDIBLE;
+      column(PLANE_LOUDNESS, sources)[s] = volume;
+      if(data->dirty[s] == PLANE_FRESH){
+        lgain[s] = lvolume[s];
+        rgain[s] = rvolume[s];
+      }else if(data->culled[s] == PLANE_CULLED){
+        lgain[s] = 0.0f;
+        rgain[s] = 0.0f;
+      }
+      data->dirty[s] = PLANE_CLEAN;
+    }
+    if(data->max_voices)
+      plane_mixer_limit(data);
+    data->sources_changed = 0;
+    data->listener_changed = 0;
+  }
   
-  // Compute sample counts
+  // Compute sample counts. A shifted source reads faster or slower
+  // than it plays, so the block is as long as the input of every one
+  // of them lasts.
   mixed_buffer_request_write(&left, &samples, data->left);
   mixed_buffer_request_write(&right, &samples, data->right);
   for(uint32_t s=0; s<count; ++s){
-    struct plane_source *source = data->sources[s];
-    if(!source) continue;
-
-    mixed_buffer_request_read(&in, &samples, source->buffer);
-    if(samples == 0) break;
+    uint32_t available = UINT32_MAX;
+    data->areas[s] = 0;
+    if(!data->buffers[s] || PLANE_VIRTUAL(data->culled[s])) continue;
+    mixed_buffer_request_read(&data->areas[s], &available, data->buffers[s]);
+    if(pitch[s] != 1.0f)
+      available = resample_frames(pitch[s], data->resamplers[s].phase, available);
+    samples = MIN(samples, available);
   }
 
   if(0 < samples){
+    float inv = 1.0f / samples;
+    float shifted[PLANE_CHUNK];
     memset(left, 0, samples*sizeof(float));
     memset(right, 0, samples*sizeof(float));
+    silent = 1;
     for(uint32_t s=0; s<count; ++s){
-      struct plane_source *source = data->sources[s];
-      if(!source) continue;
+      float *in = data->areas[s];
+      if(!in) continue;
+      // A silent source only has to be consumed.
+      if(mixed_buffer_is_silent(data->buffers[s])){
+        buffer_skip(pitch[s], samples, data->buffers[s], &data->resamplers[s]);
+        lgain[s] = lvolume[s];
+        rgain[s] = rvolume[s];
+        continue;
+      }
+      silent = 0;
       
-      float lvolume, rvolume;
-      mixed_buffer_request_read(&in, &samples, source->buffer);
-      calculate_volumes(&lvolume, &rvolume, source, data);
-      float pitch = clamp(0.5, calculate_pitch_shift(data, source), 2.0);
-      if(pitch != 1.0)
-        pitch_shift(pitch, in, in, samples, &data->pitch_data);
-      for(uint32_t i=0; i<samples; ++i){
-        float sample = in[i];
-        left[i] += sample * lvolume;
-        right[i] += sample * rvolume;
+      float lstart = lgain[s], rstart = rgain[s];
+      float lstep = (lvolume[s] - lstart) * inv;
+      float rstep = (rvolume[s] - rstart) * inv;
+      uint32_t used = samples;
+      if(pitch[s] != 1.0f){
+        used = 0;
+        for(uint32_t i=0; i<samples; i+=PLANE_CHUNK){
+          uint32_t chunk = MIN(PLANE_CHUNK, samples-i);
+          used += resample_linear(pitch[s], in+used, shifted, chunk, &data->resamplers[s]);
+          mix_pan(shifted, left+i, right+i, lstart+lstep*i, lstep, rstart+rstep*i, rstep, chunk);
+        }
+      }else{
+        mix_pan(in, left, right, lstart, lstep, rstart, rstep, samples);
+        data->resamplers[s].phase = 0.0f;
+        data->resamplers[s].last = in[samples-1];
       }
-      mixed_buffer_finish_read(samples, source->buffer);
+      mixed_buffer_finish_read(used, data->buffers[s]);
+      lgain[s] = lvolume[s];
+      rgain[s] = rvolume[s];
     }
   }
-  mixed_buffer_finish_write(samples, data->left);
-  mixed_buffer_finish_write(samples, data->right);
+  for(uint32_t s=0; s<count; ++s){
+    if(!data->buffers[s]) continue;
+    if(PLANE_VIRTUAL(data->culled[s]))
+      buffer_skip(pitch[s], samples, data->buffers[s], &data->resamplers[s]);
+    else if(data->culled[s] == PLANE_FADING && 0 < samples)
+      data->culled[s] = PLANE_STOLEN;
+  }
+  if(silent){
+    mixed_buffer_finish_write_silence(samples, data->left);
+    mixed_buffer_finish_write_silence(samples, data->right);
+  }else{
+    mixed_buffer_finish_write(samples, data->left);
+    mixed_buffer_finish_write(samples, data->right);
+  }
   return 1;
 }
 
@@ -181,37 +370,38 @@ int plane_mixer_get_out(uint32_t field, uint32_t location, void *buffer, struct
 
 int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
+  struct columns *sources = &data->sources;
 
   switch(field){
   case MIXED_BUFFER:
     if(buffer){ // Add or set an element
-      struct plane_source *source = 0;
-      if(location < data->count)
-        source = data->sources[location];
-      if(!source){
-        source = mixed_calloc(1, sizeof(struct plane_source));
-        if(!source){
-          mixed_err(MIXED_OUT_OF_MEMORY);
+      if(data->count <= location){
+        if(!vector_add_pos(location, buffer, (struct vector *)data)
+           || !plane_mixer_fit_sources(data))
           return 0;
-        }
-        source->min_distance = data->min_distance;
-        source->max_distance = data->max_distance;
-        source->rolloff = data->rolloff;
-        source->velocity[0] = data->velocity[0];
-        source->velocity[1] = data->velocity[1];
-        source->location[0] = data->location[0];
-        source->location[1] = data->location[1];
+      }else if(data->buffers[location]){
+        data->buffers[location] = (struct mixed_buffer *)buffer;
+        return 1;
       }
-      source->buffer = (struct mixed_buffer *)buffer;
-      if(location < data->count) data->sources[location] = source;
-      else return vector_add_pos(location, source, (struct vector *)data);
+      data->buffers[location] = (struct mixed_buffer *)buffer;
+      column(PLANE_MIN_DISTANCE, sources)[location] = data->min_distance;
+      column(PLANE_MAX_DISTANCE, sources)[location] = data->max_distance;
+      column(PLANE_ROLLOFF, sources)[location] = data->rolloff;
+      column(PLANE_VX, sources)[location] = data->velocity[0];
+      column(PLANE_VY, sources)[location] = data->velocity[1];
+      column(PLANE_X, sources)[location] = data->location[0];
+      column(PLANE_Y, sources)[location] = data->location[1];
+      data->resamplers[location] = (struct resample_data){0};
+      data->culled[location] = PLANE_AUDIBLE;
+      column(PLANE_PRIORITY, sources)[location] = 0.0f;
+      data->dirty[location] = PLANE_FRESH;
+      data->sources_changed = 1;
     }else{ // Remove an element
       if(data->count <= location){
         mixed_err(MIXED_INVALID_LOCATION);
         return 0;
       }
-      data->sources[location] = 0;
-      mixed_free(data->sources[location]);
+      data->buffers[location] = 0;
     }
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
@@ -219,31 +409,40 @@ int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
   case MIXED_SPACE_ROLLOFF:
   case MIXED_PLANE_LOCATION:
   case MIXED_PLANE_VELOCITY:
-    if(data->count <= location){
+    if(data->count <= location || !data->buffers[location]){
       mixed_err(MIXED_INVALID_LOCATION);
       return 0;
     }
-    struct plane_source *source = data->sources[location];
     float *value = (float *)buffer;
     switch(field){
     case MIXED_SPACE_MIN_DISTANCE:
-      source->min_distance = *(float *)buffer;
+      column(PLANE_MIN_DISTANCE, sources)[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_MAX_DISTANCE:
-      source->max_distance = *(float *)buffer;
+      column(PLANE_MAX_DISTANCE, sources)[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_ROLLOFF:
-      source->rolloff = *(float *)buffer;
+      column(PLANE_ROLLOFF, sources)[location] = *(float *)buffer;
       break;
     case MIXED_PLANE_LOCATION:
-      source->location[0] = value[0];
-      source->location[1] = value[1];
+      column(PLANE_X, sources)[location] = value[0];
+      column(PLANE_Y, sources)[location] = value[1];
       break;
     case MIXED_PLANE_VELOCITY:
-      source->velocity[0] = value[0];
-      source->velocity[1] = value[1];
+      column(PLANE_VX, sources)[location] = value[0];
+      column(PLANE_VY, sources)[location] = value[1];
       break;
     }
+    if(!data->dirty[location]) data->dirty[location] = PLANE_DIRTY;
+    data->sources_changed = 1;
+    return 1;
+  case MIXED_PRIORITY:
+    if(data->count <= location || !data->buffers[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    column(PLANE_PRIORITY, sources)[location] = *(float *)buffer;
+    data->sources_changed = 1;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -253,44 +452,40 @@ int plane_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
 
 int plane_mixer_get_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct plane_mixer_data *data = (struct plane_mixer_data *)segment->data;
+  struct columns *sources = &data->sources;
   
-  if(data->count <= location){
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
-  }
-  
-  struct plane_source *source = data->sources[location];
-  if(source == 0){
+  if(data->count <= location || !data->buffers[location]){
     mixed_err(MIXED_INVALID_LOCATION);
     return 0;
   }
 
+  float *value = (float *)buffer;
   switch(field){
   case MIXED_BUFFER:
-    *(struct mixed_buffer **)buffer = source->buffer;
+    *(struct mixed_buffer **)buffer = data->buffers[location];
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
-    *(float *)buffer = source->min_distance;
+    *value = column(PLANE_MIN_DISTANCE, sources)[location];
     return 1;
   case MIXED_SPACE_MAX_DISTANCE:
-    *(float *)buffer = source->max_distance;
+    *value = column(PLANE_MAX_DISTANCE, sources)[location];
     return 1;
   case MIXED_SPACE_ROLLOFF:
-    *(float *)buffer = source->rolloff;
+    *value = column(PLANE_ROLLOFF, sources)[location];
     return 1;
   case MIXED_PLANE_LOCATION:
-  case MIXED_PLANE_VELOCITY:{
-    float *value = (float *)buffer;
-    switch(field){
-    case MIXED_PLANE_LOCATION:
-      value[0] = source->location[0];
-      value[1] = source->location[1];
-      break;
-    case MIXED_PLANE_VELOCITY:
-      value[0] = source->velocity[0];
-      value[1] = source->velocity[1];
-      break;
-    }}
+    value[0] = column(PLANE_X, sources)[location];
+    value[1] = column(PLANE_Y, sources)[location];
+    return 1;
+  case MIXED_PLANE_VELOCITY:
+    value[0] = column(PLANE_VX, sources)[location];
+    value[1] = column(PLANE_VY, sources)[location];
+    return 1;
+  case MIXED_SPACE_VIRTUAL:
+    *(bool *)buffer = PLANE_VIRTUAL(data->culled[location]);
+    return 1;
+  case MIXED_PRIORITY:
+    *value = column(PLANE_PRIORITY, sources)[location];
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -328,6 +523,15 @@ int plane_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_ROLLOFF:
     *(float *)value = data->rolloff;
     break;
+  case MIXED_CAPACITY:
+    *(uint32_t *)value = data->size;
+    break;
+  case MIXED_SPACE_CULL_THRESHOLD:
+    *(float *)value = data->cull_threshold;
+    break;
+  case MIXED_MAX_VOICES:
+    *(uint32_t *)value = data->max_voices;
+    break;
   case MIXED_SPACE_ATTENUATION:
     if(data->attenuation == attenuation_none){
       *(int *)value = MIXED_NO_ATTENUATION;
@@ -378,6 +582,17 @@ int plane_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_ROLLOFF:
     data->rolloff = *(float *)value;
     break;
+  case MIXED_CAPACITY:
+    if(!vector_reserve(*(uint32_t *)value, (struct vector *)data)
+       || !plane_mixer_fit_sources(data))
+      return 0;
+    break;
+  case MIXED_SPACE_CULL_THRESHOLD:
+    data->cull_threshold = *(float *)value;
+    break;
+  case MIXED_MAX_VOICES:
+    data->max_voices = *(uint32_t *)value;
+    break;
   case MIXED_SPACE_ATTENUATION:
     switch(*(uint32_t *)value){
     case MIXED_NO_ATTENUATION:
@@ -401,6 +616,7 @@ int plane_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
   }
+  data->listener_changed = 1;
   return 1;
 }
 
@@ -409,7 +625,7 @@ int plane_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
   
   info->name = "plane_mixer";
   info->description = "Mixes multiple sources while simulating a 2D plane.";
-  info->flags = MIXED_MODIFIES_INPUT;
+  info->flags = 0;
   info->min_inputs = 0;
   info->max_inputs = -1;
   info->outputs = 2;
@@ -455,22 +671,40 @@ int plane_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_FUNCTION, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The function that calculates the attenuation curve that defines the volume of a source by its distance.");
 
+  set_info_field(field++, MIXED_CAPACITY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of sources that can be added without allocating.");
+
+  set_info_field(field++, MIXED_SPACE_CULL_THRESHOLD,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The volume below which a source is virtual and not mixed.");
+
+  set_info_field(field++, MIXED_SPACE_VIRTUAL,
+                 MIXED_BOOL, 1, MIXED_IN | MIXED_GET,
+                 "Whether the source is currently virtual.");
+
+  set_info_field(field++, MIXED_MAX_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The most sources that are mixed at once, or 0 for no limit.");
+
+  set_info_field(field++, MIXED_PRIORITY,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The priority of the source when voices are limited.");
+
   clear_info_field(field++);
   return 1;
 }
 
 MIXED_EXPORT int mixed_make_segment_plane_mixer(uint32_t samplerate, struct mixed_segment *segment){
+  IGNORE(samplerate);
   struct plane_mixer_data *data = mixed_calloc(1, sizeof(struct plane_mixer_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
 
-  // These factors might need tweaking for efficiency/quality.
-  if(!make_pitch_data(2048, 4, samplerate, &data->pitch_data)){
-    mixed_free(data);
-    return 0;
-  }
+  make_columns(PLANE_COLUMNS, &data->sources);
+
 
   data->soundspeed = 34330.0;    // Means units are in [cm].
   data->doppler_factor = 0.0;
@@ -4,7 +4,13 @@ struct quantize_segment_data{
   struct mixed_buffer *in;
   struct mixed_buffer *out;
   float steps;
+  float inverse;
   float mix;
+  // Each quantized value lasts this many samples, and the current one
+  // has been output this many times already.
+  uint32_t hold;
+  uint32_t held;
+  float value;
 };
 
 int quantize_segment_free(struct mixed_segment *segment){
@@ -20,6 +26,7 @@ int quantize_segment_start(struct mixed_segment *segment){
     mixed_err(MIXED_BUFFER_MISSING);
     return 0;
   }
+  data->held = 0;
   return 1;
 }
 
@@ -57,16 +64,51 @@ int quantize_segment_set_out(uint32_t field, uint32_t location, void *buffer, st
   }
 }
 
+VECTORIZE static void quantize_samples(const float *in, float *out, float steps, float inverse, float mix, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i){
+    float s = in[i];
+    out[i] = s + (floorf(s * steps) * inverse - s) * mix;
+  }
+}
+
+VECTORIZE static void quantize_hold(const float *in, float *out, float value, float mix, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i){
+    out[i] = in[i] + (value - in[i]) * mix;
+  }
+}
+
+// Reducing the samplerate only decides on a new value at the start of
+// each hold, so the block is processed in runs of one held value.
+static void quantize_process(const float *in, float *out, uint32_t samples, struct quantize_segment_data *data){
+  if(data->hold <= 1){
+    quantize_samples(in, out, data->steps, data->inverse, data->mix, samples);
+    return;
+  }
+  for(uint32_t i=0; i<samples; ){
+    if(data->held == 0)
+      data->value = floorf(in[i] * data->steps) * data->inverse;
+    uint32_t run = MIN(samples-i, data->hold - data->held);
+    quantize_hold(in+i, out+i, data->value, data->mix, run);
+    data->held = (data->held + run) % data->hold;
+    i += run;
+  }
+}
+
 int quantize_segment_mix(struct mixed_segment *segment){
   struct quantize_segment_data *data = (struct quantize_segment_data *)segment->data;
-
-  float steps = data->steps;
-  float mix = data->mix;
-  with_mixed_buffer_transfer(i, samples, in, data->in, out, data->out, {
-      float s = in[i];
-      float o = floor(s * steps) / steps;
-      out[i] = LERP(s, o, mix);
-    });
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
+
+  if(data->in == data->out){
+    mixed_buffer_request_read(&in, &samples, data->in);
+    quantize_process(in, in, samples, data);
+  }else{
+    mixed_buffer_request_read(&in, &samples, data->in);
+    mixed_buffer_request_write(&out, &samples, data->out);
+    quantize_process(in, out, samples, data);
+    mixed_buffer_finish_read(samples, data->in);
+    mixed_buffer_finish_write(samples, data->out);
+  }
   return 1;
 }
 
@@ -94,6 +136,14 @@ int quantize_segment_info(struct mixed_segment_info *info, struct mixed_segment
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "How much of the output to mix with the input.");
 
+  set_info_field(field++, MIXED_QUANTIZE_STEPS,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of discrete amplitudes per unit of signal.");
+
+  set_info_field(field++, MIXED_QUANTIZE_HOLD,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of samples each quantized value is held for.");
+
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
@@ -108,6 +158,7 @@ int quantize_segment_get(uint32_t field, void *value, struct mixed_segment *segm
   case MIXED_MIX: *((float *)value) = data->mix; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == quantize_segment_mix_bypass); break;
   case MIXED_QUANTIZE_STEPS: *((uint32_t *)value) = (uint32_t)data->steps; break;
+  case MIXED_QUANTIZE_HOLD: *((uint32_t *)value) = data->hold; break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -138,7 +189,20 @@ int quantize_segment_set(uint32_t field, void *value, struct mixed_segment *segm
     }
     break;
   case MIXED_QUANTIZE_STEPS:
+    if(*(uint32_t *)value == 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
     data->steps = *(uint32_t *)value;
+    data->inverse = 1.0f / data->steps;
+    break;
+  case MIXED_QUANTIZE_HOLD:
+    if(*(uint32_t *)value == 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->hold = *(uint32_t *)value;
+    data->held = 0;
     break;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -148,6 +212,11 @@ int quantize_segment_set(uint32_t field, void *value, struct mixed_segment *segm
 }
 
 MIXED_EXPORT int mixed_make_segment_quantize(uint32_t steps, struct mixed_segment *segment){
+  if(steps == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+
   struct quantize_segment_data *data = mixed_calloc(1, sizeof(struct quantize_segment_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
@@ -155,7 +224,9 @@ MIXED_EXPORT int mixed_make_segment_quantize(uint32_t steps, struct mixed_segmen
   }
 
   data->steps = steps;
+  data->inverse = 1.0f / steps;
   data->mix = 1.0;
+  data->hold = 1;
   segment->free = quantize_segment_free;
   segment->start = quantize_segment_start;
   segment->mix = quantize_segment_mix;
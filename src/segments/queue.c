@@ -1,18 +1,37 @@
 #include "../internal.h"
 
 struct queue_segment_data{
-  struct mixed_segment **queue;
-  uint32_t count;
-  uint32_t size;
+  // Swapped out as a whole on every change, so that segments can be
+  // queued from another thread while the queue is being mixed.
+  struct rcu_vector queue;
   struct mixed_buffer **out;
   uint32_t out_count;
   struct mixed_buffer **in;
   uint32_t in_count;
+  // A segment the mix ended but could not pop, because a change was
+  // replacing the list. It is popped off the new list on the next mix.
+  struct mixed_segment *finished;
 };
 
+// Disconnects an ended segment, so that the caller may dispose of it.
+static void queue_unhook(struct mixed_segment *old){
+  struct mixed_segment_info info = {0};
+  mixed_segment_info(&info, old);
+  for(uint32_t i=0; i<info.max_inputs; ++i){
+    mixed_segment_set_in(MIXED_BUFFER, i, 0, old);
+  }
+  for(uint32_t i=0; i<info.outputs; ++i){
+    mixed_segment_set_out(MIXED_BUFFER, i, 0, old);
+  }
+}
+
 int queue_segment_free(struct mixed_segment *segment){
-  if(segment->data){
-    mixed_free(segment->data);
+  struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
+  if(data){
+    free_rcu_vector(&data->queue);
+    if(data->in) mixed_free(data->in);
+    if(data->out) mixed_free(data->out);
+    mixed_free(data);
   }
   segment->data = 0;
   return 1;
@@ -43,9 +62,11 @@ int queue_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct
     if(location < data->in_count){
       data->in[location] = (struct mixed_buffer *)buffer;
       // Update existing segments in the queue.
-      for(uint32_t i=0; i<data->count; ++i){
-        mixed_segment_set_in(MIXED_BUFFER, location, buffer, data->queue[i]);
+      struct rcu_array *queue = rcu_enter(&data->queue);
+      for(uint32_t i=(queue)? rcu_first(queue) : 0; queue && i<queue->count; ++i){
+        mixed_segment_set_in(MIXED_BUFFER, location, buffer, queue->data[i]);
       }
+      rcu_leave(&data->queue);
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -64,9 +85,11 @@ int queue_segment_set_out(uint32_t field, uint32_t location, void *buffer, struc
     if(location < data->out_count){
       data->out[location] = (struct mixed_buffer *)buffer;
       // Update existing segments in the queue.
-      for(uint32_t i=0; i<data->count; ++i){
-        mixed_segment_set_out(MIXED_BUFFER, location, buffer, data->queue[i]);
+      struct rcu_array *queue = rcu_enter(&data->queue);
+      for(uint32_t i=(queue)? rcu_first(queue) : 0; queue && i<queue->count; ++i){
+        mixed_segment_set_out(MIXED_BUFFER, location, buffer, queue->data[i]);
       }
+      rcu_leave(&data->queue);
       return 1;
     }
     mixed_err(MIXED_INVALID_LOCATION);
@@ -91,21 +114,42 @@ int queue_segment_mix_bypass(struct mixed_segment *segment){
   return 1;
 }
 
+// Finished segments are popped off the list rather than removed, so
+// the mix never waits on a change or allocates.
 int queue_segment_mix(struct mixed_segment *segment){
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
- start:
-  if(0 < data->count){
-    struct mixed_segment *inner = data->queue[0];
-    int result = inner->mix(inner);
-    if(result)
-      return result;
+  struct rcu_array *queue = rcu_enter(&data->queue);
+  uint32_t count = (queue)? queue->count : 0;
+  uint32_t i = (queue)? rcu_first(queue) : 0;
+  if(data->finished){
+    if(i < count && queue->data[i] == data->finished){
+      if(rcu_pop(i, queue)) data->finished = 0;
+      ++i;
+    }else{
+      // The change removed it already.
+      data->finished = 0;
+    }
+  }
+  for(; i<count; ++i){
+    struct mixed_segment *inner = queue->data[i];
+    if(mixed_segment_mix(inner)){
+      rcu_leave(&data->queue);
+      return 1;
+    }
+    if(!rcu_pop(i, queue)){
+      // Only one segment can wait to be popped. Any other is ended
+      // on a later mix, once the change is through.
+      if(data->finished){
+        rcu_leave(&data->queue);
+        return 1;
+      }
+      data->finished = inner;
+    }
     mixed_segment_end(inner);
-    if(mixed_queue_remove(inner, segment))
-      goto start;
-    return 0;
-  }else{
-    return queue_segment_mix_bypass(segment);
+    queue_unhook(inner);
   }
+  rcu_leave(&data->queue);
+  return queue_segment_mix_bypass(segment);
 }
 
 int queue_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
@@ -113,19 +157,23 @@ int queue_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   
   info->name = "queue";
   info->description = "Queue multiple segments one after the other";
-  info->flags = MIXED_INPLACE;
+  // The inner segment may change at any time, so we cannot promise
+  // to work in place.
+  info->flags = 0;
   info->min_inputs = 0;
   info->max_inputs = data->in_count;
   info->outputs = data->out_count;
 
-  if(0 < data->count){
+  struct rcu_array *queue = rcu_enter(&data->queue);
+  if(queue && rcu_first(queue) < queue->count){
     struct mixed_segment_info inner = {0};
-    mixed_segment_info(&inner, data->queue[0]);
-    info->flags = inner.flags;
+    mixed_segment_info(&inner, queue->data[rcu_first(queue)]);
+    info->flags = inner.flags & ~MIXED_INPLACE;
     info->min_inputs = inner.min_inputs;
     info->max_inputs = inner.max_inputs;
     info->outputs = inner.outputs;
   }
+  rcu_leave(&data->queue);
   
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BYPASS,
@@ -144,6 +192,10 @@ int queue_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Access the number of available output buffers.");
 
+  set_info_field(field++, MIXED_CAPACITY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of segments that can be queued without allocating.");
+
   clear_info_field(field++);
   return 1;
 }
@@ -152,9 +204,15 @@ int queue_segment_get(uint32_t field, void *value, struct mixed_segment *segment
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
   switch(field){
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == queue_segment_mix_bypass); break;
-  case MIXED_CURRENT_SEGMENT: *((struct mixed_segment **)value) = (data->queue)?data->queue[0]:0; break;
+  case MIXED_CURRENT_SEGMENT: {
+    struct rcu_array *queue = rcu_enter(&data->queue);
+    uint32_t first = (queue)? rcu_first(queue) : 0;
+    *((struct mixed_segment **)value) = (queue && first < queue->count)? queue->data[first] : 0;
+    rcu_leave(&data->queue);
+  } break;
   case MIXED_IN_COUNT: *((uint32_t *)value) = data->in_count; break;
   case MIXED_OUT_COUNT: *((uint32_t *)value) = data->out_count; break;
+  case MIXED_CAPACITY: *((uint32_t *)value) = data->queue.capacity; break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
   return 1;
@@ -188,6 +246,7 @@ int queue_segment_set(uint32_t field, void *value, struct mixed_segment *segment
     break;
   case MIXED_IN_COUNT: return queue_resize_buffers(&data->in, &data->in_count, *(uint32_t *)value);
   case MIXED_OUT_COUNT: return queue_resize_buffers(&data->out, &data->out_count, *(uint32_t *)value);
+  case MIXED_CAPACITY: return rcu_reserve(*(uint32_t *)value, &data->queue);
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -231,12 +290,9 @@ MIXED_EXPORT int mixed_queue_add(struct mixed_segment *new, struct mixed_segment
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
   struct mixed_segment_info info = {0};
 
-  if(!mixed_segment_start(new))
-    return 0;
-  
-  if(!vector_add(new, (struct vector *)data))
-    return 0;
-  
+  // Connect it before it is started, as segments check their
+  // buffers then, and before it is published, as it may be mixed
+  // right away.
   mixed_segment_info(&info, new);
   uint32_t ins = MIN(data->in_count, info.max_inputs);
   for(uint32_t i=0; i<ins; ++i){
@@ -246,50 +302,54 @@ MIXED_EXPORT int mixed_queue_add(struct mixed_segment *new, struct mixed_segment
   for(uint32_t i=0; i<outs; ++i){
     mixed_segment_set_out(MIXED_BUFFER, i, data->out[i], new);
   }
-  return 1;
+  if(!mixed_segment_start(new))
+    return 0;
+  return rcu_add(new, &data->queue);
 }
 
 MIXED_EXPORT int mixed_queue_remove(struct mixed_segment *old, struct mixed_segment *segment){
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
-  struct mixed_segment_info info = {0};
+
+  if(!rcu_remove_item(old, &data->queue))
+    return 0;
+  // The mix may still be inside the old segment.
+  rcu_wait(&data->queue);
 
   mixed_segment_end(old);
   // If the stop fails we remove it anyway.
-  
-  if(!vector_remove_item(old, (struct vector *)data))
-    return 0;
-    
-  mixed_segment_info(&info, old);
-  for(uint32_t i=0; i<info.max_inputs; ++i){
-    mixed_segment_set_in(MIXED_BUFFER, i, 0, old);
-  }
-  for(uint32_t i=0; i<info.outputs; ++i){
-    mixed_segment_set_out(MIXED_BUFFER, i, 0, old);
-  }
+  queue_unhook(old);
   return 1;
 }
 
 MIXED_EXPORT int mixed_queue_remove_at(uint32_t pos, struct mixed_segment *segment){
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
-  return mixed_queue_remove(data->queue[pos], segment);
+  struct rcu_array *queue = rcu_enter(&data->queue);
+  uint32_t first = (queue)? rcu_first(queue) : 0;
+  struct mixed_segment *old = (queue && pos < queue->count - first)? queue->data[first+pos] : 0;
+  rcu_leave(&data->queue);
+  if(!old){
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  return mixed_queue_remove(old, segment);
 }
 
 MIXED_EXPORT int mixed_queue_clear(struct mixed_segment *segment){
   struct queue_segment_data *data = (struct queue_segment_data *)segment->data;
-  struct mixed_segment_info info = {0};
   
-  for(uint32_t i=0; i<data->count; ++i){
-    struct mixed_segment *old = data->queue[i];
+  // Unpublish first so the mix no longer reaches the segments we end.
+  struct rcu_array *queue = 0;
+  if(!rcu_clear(&queue, &data->queue))
+    return 0;
+  rcu_wait(&data->queue);
+  // The popped ones were ended and unhooked by the mix.
+  for(uint32_t i=(queue)? rcu_first(queue) : 0; queue && i<queue->count; ++i){
+    struct mixed_segment *old = queue->data[i];
     mixed_segment_end(old);
-    mixed_segment_info(&info, old);
-    for(uint32_t i=0; i<info.max_inputs; ++i){
-      mixed_segment_set_in(MIXED_BUFFER, i, 0, old);
-    }
-    for(uint32_t i=0; i<info.outputs; ++i){
-      mixed_segment_set_out(MIXED_BUFFER, i, 0, old);
-    }
+    queue_unhook(old);
   }
-  return vector_clear((struct vector *)data);
+  mixed_free(queue);
+  return 1;
 }
 
 int __make_queue(void *args, struct mixed_segment *segment){
@@ -5,23 +5,34 @@ struct repeat_segment_data{
   struct mixed_buffer *out;
   float *buffer;
   uint32_t buffer_size;
+  uint32_t buffer_capacity;
   uint32_t buffer_index;
   float time;
   uint32_t samplerate;
   enum mixed_repeat_mode mode;
+  // Whether the input last went into the loop as a new layer on top
+  // of it, rather than replacing it.
+  bool overdub;
   uint32_t fade_position;
   uint32_t fade_length;
 };
 
+// Changing the loop length within the capacity only moves its end,
+// keeping whatever was recorded. Only a loop longer than any before
+// needs more memory.
 int repeat_segment_data_resize_buffer(struct repeat_segment_data *data, uint32_t new_size) {
-  float *new_buffer = crealloc(data->buffer, data->buffer_size, new_size, sizeof(float));
-  if (!new_buffer){
-    mixed_err(MIXED_OUT_OF_MEMORY);
-    return 0;
+  if(data->buffer_capacity < new_size){
+    float *new_buffer = crealloc(data->buffer, data->buffer_capacity, new_size, sizeof(float));
+    if (!new_buffer){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    data->buffer = new_buffer;
+    data->buffer_capacity = new_size;
   }
-  data->buffer = new_buffer;
   data->buffer_size = new_size;
-  data->buffer_index = 0;
+  if(new_size <= data->buffer_index)
+    data->buffer_index %= new_size;
   return 1;
 }
 
@@ -78,12 +89,45 @@ int repeat_segment_set_out(uint32_t field, uint32_t location, void *buffer, stru
   }
 }
 
+VECTORIZE static void repeat_overdub(float *restrict buf, const float *restrict in, float *restrict out, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i){
+    buf[i] += in[i];
+    out[i] = buf[i];
+  }
+}
+
+// Processes a run of samples that does not cross the loop's end. Only
+// the crossfade after a mode change goes sample by sample, the rest of
+// the run is copied or added in one go.
+static void repeat_run(float *buf, const float *in, float *out, uint32_t samples, struct repeat_segment_data *data){
+  bool fade_in = (data->mode != MIXED_PLAY);
+  float replace = data->overdub? 0.0f : 1.0f;
+  uint32_t i = 0;
+  for(; i<samples; ++i){
+    if(fade_in? (data->fade_length <= data->fade_position) : (data->fade_position == 0)) break;
+    float x = data->fade_position/(float)data->fade_length;
+    buf[i] = buf[i]*(1-replace*x) + in[i]*x;
+    out[i] = buf[i];
+    if(fade_in) data->fade_position++;
+    else data->fade_position--;
+  }
+  buf += i; in += i; out += i;
+  samples -= i;
+  if(!fade_in){
+    memcpy(out, buf, samples*sizeof(float));
+  }else if(data->overdub){
+    repeat_overdub(buf, in, out, samples);
+  }else{
+    memcpy(buf, in, samples*sizeof(float));
+    memcpy(out, in, samples*sizeof(float));
+  }
+}
+
 int repeat_segment_mix(struct mixed_segment *segment){
   struct repeat_segment_data *data = (struct repeat_segment_data *)segment->data;
 
   uint32_t repeat_samples = data->buffer_size;
   uint32_t index = data->buffer_index;
-  float *buf = data->buffer;
 
   float *in, *out;
   uint32_t samples = UINT32_MAX;
@@ -93,19 +137,12 @@ int repeat_segment_mix(struct mixed_segment *segment){
 
   mixed_buffer_request_read(&in, &samples, data->in);
   mixed_buffer_request_write(&out, &samples, data->out);
-  for(uint32_t i=0; i<samples; ++i){
-    buf[index] = LERP(buf[index], in[i], data->fade_position/(float)data->fade_length);
-    if (data->mode == MIXED_PLAY) {
-      if (data->fade_position > 0) {
-        data->fade_position--;
-      }
-    } else {
-      if (data->fade_position < data->fade_length) {
-        data->fade_position++;
-      }
-    }
-    out[i] = buf[index];
-    index = (index+1)%repeat_samples;
+  for(uint32_t i=0; i<samples; ){
+    uint32_t run = MIN(samples-i, repeat_samples-index);
+    repeat_run(data->buffer+index, in+i, out+i, run, data);
+    i += run;
+    index += run;
+    if(index == repeat_samples) index = 0;
   }
   mixed_buffer_finish_read(samples, data->in);
   mixed_buffer_finish_write(samples, data->out);
@@ -129,7 +166,8 @@ int repeat_segment_info(struct mixed_segment_info *info, struct mixed_segment *s
 
   info->name = "repeat";
   info->description = "Allows recording some input and then repeatedly playing it back.";
-  info->flags = MIXED_INPLACE;
+  // Recording once may stop short of the available input.
+  info->flags = 0;
   info->min_inputs = 1;
   info->max_inputs = 1;
   info->outputs = 1;
@@ -143,6 +181,14 @@ int repeat_segment_info(struct mixed_segment_info *info, struct mixed_segment *s
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The time, in seconds, that is recorded and repeated.");
 
+  set_info_field(field++, MIXED_REPEAT_MAX_TIME,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The longest time, in seconds, that can be repeated without allocating.");
+
+  set_info_field(field++, MIXED_REPEAT_POSITION,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The current position, in seconds, within the repeated time.");
+
   set_info_field(field++, MIXED_SAMPLERATE,
                  MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The samplerate at which the segment operates.");
@@ -163,6 +209,7 @@ int repeat_segment_get(uint32_t field, void *value, struct mixed_segment *segmen
   struct repeat_segment_data *data = (struct repeat_segment_data *)segment->data;
   switch(field){
   case MIXED_REPEAT_TIME: *((float *)value) = data->time; break;
+  case MIXED_REPEAT_MAX_TIME: *((float *)value) = data->buffer_capacity/(float)data->samplerate; break;
   case MIXED_REPEAT_MODE: *((enum mixed_repeat_mode *)value) = data->mode; break;
   case MIXED_REPEAT_POSITION: *((float *)value) = data->buffer_index/(float)data->samplerate; break;
   case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
@@ -197,15 +244,37 @@ int repeat_segment_set(uint32_t field, void *value, struct mixed_segment *segmen
     }
     data->time = time;
     break;
-  case MIXED_REPEAT_MODE:
-    if(*(enum mixed_repeat_mode *)value != MIXED_RECORD &&
-       *(enum mixed_repeat_mode *)value != MIXED_PLAY &&
-       *(enum mixed_repeat_mode *)value != MIXED_RECORD_ONCE){
+  case MIXED_REPEAT_MAX_TIME: {
+    if(*(float *)value <= 0.0f){
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
-    data->mode = *(enum mixed_repeat_mode *)value;
-    break;
+    uint32_t capacity = ceil(data->samplerate * *(float *)value);
+    if(data->buffer_capacity < capacity){
+      float *buffer = crealloc(data->buffer, data->buffer_capacity, capacity, sizeof(float));
+      if(!buffer){
+        mixed_err(MIXED_OUT_OF_MEMORY);
+        return 0;
+      }
+      data->buffer = buffer;
+      data->buffer_capacity = capacity;
+    }
+    break; }
+  case MIXED_REPEAT_MODE: {
+    enum mixed_repeat_mode mode = *(enum mixed_repeat_mode *)value;
+    if(mode < MIXED_RECORD || MIXED_OVERDUB < mode){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    // Switching between replacing and layering restarts the fade, so
+    // that neither jumps in at full strength.
+    bool overdub = (mode == MIXED_OVERDUB);
+    if(mode != MIXED_PLAY && overdub != data->overdub){
+      data->fade_position = 0;
+      data->overdub = overdub;
+    }
+    data->mode = mode;
+    break; }
   case MIXED_REPEAT_POSITION:
     float position = (*(float *)value);
     if(position < 0.0f){
@@ -246,6 +315,7 @@ MIXED_EXPORT int mixed_make_segment_repeat(float time, uint32_t samplerate, stru
   }
 
   data->buffer_size = ceil(time * samplerate);
+  data->buffer_capacity = data->buffer_size;
   data->buffer = mixed_calloc(data->buffer_size, sizeof(float));
   if(!data->buffer){
     mixed_err(MIXED_OUT_OF_MEMORY);
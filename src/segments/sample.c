@@ -0,0 +1,270 @@
+#include "../internal.h"
+
+// Samples that have played through leave their zero-copy outputs
+// pointing here. Nothing ever writes to it.
+#define SAMPLE_SILENCE 1024
+static float sample_silence[SAMPLE_SILENCE];
+
+struct sample_segment_data{
+  struct mixed_buffer *out[12];
+  // Whether the output references the sample instead of holding a copy.
+  char zero_copy[12];
+  // The next frame of every output, as the consumers of zero-copy
+  // outputs may not all read at the same pace.
+  uint32_t position[12];
+  struct sample_data *sample;
+  struct mixed_sample_bank *bank;
+  channel_t channels;
+  bool loop;
+};
+
+// Presents the rest of the sample as a completely filled bip buffer,
+// like a mapped pack, so that consumers read it without a copy.
+static void sample_point(channel_t c, struct sample_segment_data *data){
+  struct mixed_buffer *buffer = data->out[c];
+  struct sample_data *sample = data->sample;
+  if(data->position[c] < sample->frames){
+    buffer->_data = sample->data + c*sample->frames;
+    buffer->size = sample->frames;
+    buffer->read = data->position[c];
+    buffer->write = sample->frames;
+    buffer->is_silent = 0;
+  }else{
+    buffer->_data = sample_silence;
+    buffer->size = SAMPLE_SILENCE;
+    buffer->read = 0;
+    buffer->write = SAMPLE_SILENCE;
+    buffer->is_silent = 1;
+  }
+  buffer->reserved = 0;
+}
+
+static void sample_unpoint(channel_t c, struct sample_segment_data *data){
+  struct mixed_buffer *buffer = data->out[c];
+  if(buffer && data->zero_copy[c]){
+    buffer->_data = 0;
+    buffer->size = 0;
+    buffer->read = 0;
+    buffer->write = 0;
+    buffer->is_silent = 0;
+  }
+  data->out[c] = 0;
+  data->zero_copy[c] = 0;
+}
+
+// Catches up with how far the consumers of zero-copy outputs have read.
+static void sample_sync(struct sample_segment_data *data){
+  for(channel_t c=0; c<data->channels; ++c){
+    struct mixed_buffer *buffer = data->out[c];
+    if(data->zero_copy[c] && buffer->_data != sample_silence)
+      data->position[c] = atomic_read(buffer->read);
+  }
+}
+
+static void sample_seek(uint32_t position, struct sample_segment_data *data){
+  for(channel_t c=0; c<data->channels; ++c){
+    data->position[c] = position;
+    if(data->zero_copy[c]) sample_point(c, data);
+  }
+}
+
+int sample_segment_free(struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+  if(data){
+    for(channel_t c=0; c<data->channels; ++c)
+      sample_unpoint(c, data);
+    sample_release(data->sample);
+    mixed_free(data);
+  }
+  segment->data = 0;
+  return 1;
+}
+
+int sample_segment_start(struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+  for(channel_t c=0; c<data->channels; ++c){
+    if(!data->out[c]){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void sample_copy(channel_t c, struct sample_segment_data *data){
+  struct mixed_buffer *buffer = data->out[c];
+  struct sample_data *sample = data->sample;
+  const float *plane = sample->data + c*sample->frames;
+  float *out;
+  for(;;){
+    uint32_t samples = UINT32_MAX;
+    if(!mixed_buffer_request_write(&out, &samples, buffer)) break;
+    if(sample->frames <= data->position[c]){
+      memset(out, 0, samples*sizeof(float));
+      mixed_buffer_finish_write_silence(samples, buffer);
+      break;
+    }
+    samples = MIN(samples, sample->frames - data->position[c]);
+    memcpy(out, plane + data->position[c], samples*sizeof(float));
+    mixed_buffer_finish_write(samples, buffer);
+    data->position[c] += samples;
+    if(data->position[c] == sample->frames && data->loop)
+      data->position[c] = 0;
+  }
+}
+
+int sample_segment_mix(struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+  sample_sync(data);
+  for(channel_t c=0; c<data->channels; ++c){
+    if(data->zero_copy[c]){
+      if(data->position[c] == data->sample->frames && data->loop)
+        data->position[c] = 0;
+      // Only move the buffer once it is used up, so we do not race
+      // the consumer on its read index.
+      if(data->out[c]->_data == sample_silence || data->position[c] == 0 || data->position[c] == data->sample->frames)
+        sample_point(c, data);
+    }else{
+      sample_copy(c, data);
+    }
+  }
+  return 1;
+}
+
+int sample_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    if(buffer && buffer == data->out[location])
+      return 1;
+    sample_unpoint(location, data);
+    if(buffer){
+      struct mixed_buffer *out = (struct mixed_buffer *)buffer;
+      data->out[location] = out;
+      if(!out->_data){
+        out->is_virtual = 1;
+        data->zero_copy[location] = 1;
+        sample_point(location, data);
+      }
+    }
+    return 1;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int sample_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+
+  info->name = "sample";
+  info->description = "Plays a sample from a sample bank.";
+  info->min_inputs = 0;
+  info->max_inputs = 0;
+  info->outputs = data->channels;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_SAMPLE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The id of the sample in the bank.");
+
+  set_info_field(field++, MIXED_SAMPLE_POSITION,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The frame that is played next.");
+
+  set_info_field(field++, MIXED_SAMPLE_LOOP,
+                 MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "Whether the sample starts over at the end.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int sample_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+  switch(field){
+  case MIXED_SAMPLE: *((uint32_t *)value) = data->sample->id; break;
+  case MIXED_SAMPLE_POSITION:
+    sample_sync(data);
+    *((uint32_t *)value) = data->position[0];
+    break;
+  case MIXED_SAMPLE_LOOP: *((bool *)value) = data->loop; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int sample_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct sample_segment_data *data = (struct sample_segment_data *)segment->data;
+  switch(field){
+  case MIXED_SAMPLE: {
+    struct sample_data *sample = sample_bank_get(*(uint32_t *)value, data->bank);
+    if(!sample) return 0;
+    if(sample->channels != data->channels){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    sample_retain(sample);
+    sample_release(data->sample);
+    data->sample = sample;
+    sample_seek(0, data);
+  } break;
+  case MIXED_SAMPLE_POSITION:
+    if(data->sample->frames < *(uint32_t *)value){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    sample_seek(*(uint32_t *)value, data);
+    break;
+  case MIXED_SAMPLE_LOOP:
+    data->loop = *(bool *)value;
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_sample(uint32_t id, struct mixed_sample_bank *bank, struct mixed_segment *segment){
+  struct sample_data *sample = sample_bank_get(id, bank);
+  if(!sample) return 0;
+
+  struct sample_segment_data *data = mixed_calloc(1, sizeof(struct sample_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+
+  sample_retain(sample);
+  data->sample = sample;
+  data->bank = bank;
+  data->channels = sample->channels;
+
+  segment->free = sample_segment_free;
+  segment->start = sample_segment_start;
+  segment->mix = sample_segment_mix;
+  segment->set_out = sample_segment_set_out;
+  segment->info = sample_segment_info;
+  segment->get = sample_segment_get;
+  segment->set = sample_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_sample(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_sample(ARG(uint32_t, 0), ARG(struct mixed_sample_bank *, 1), segment);
+}
+
+REGISTER_SEGMENT(sample, __make_sample, 2, {
+    {.description = "id", .type = MIXED_UINT32},
+    {.description = "bank", .type = MIXED_POINTER}})
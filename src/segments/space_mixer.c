@@ -1,21 +1,97 @@
 #include "../internal.h"
 
-struct space_source{
-  struct mixed_buffer *buffer;
-  float location[3];
-  float velocity[3];
-  float min_distance;
-  float max_distance;
-  float rolloff;
+// The most outputs any layout has, third order ambisonics.
+#define SPACE_CHANNELS 16
+
+// Sources are kept as columns, so that their volumes and pitch can be
+// recalculated for all of them in one sweep over contiguous floats.
+// The pan, volume, and gain columns each hold one column per output.
+enum space_column{
+  SPACE_X, SPACE_Y, SPACE_Z,
+  SPACE_VX, SPACE_VY, SPACE_VZ,
+  SPACE_MIN_DISTANCE,
+  SPACE_MAX_DISTANCE,
+  SPACE_ROLLOFF,
+  // Results of the last calculation, see space_mixer_mix.
+  SPACE_DISTANCE,
+  // The unit direction of the source as the listener hears it, with
+  // X to the right, Y up, and Z ahead.
+  SPACE_LX, SPACE_LY, SPACE_LZ,
+  SPACE_PITCH,
+  // The attenuated volume and priority for voice limiting.
+  SPACE_LOUDNESS,
+  SPACE_PRIORITY,
+  SPACE_PAN,
+  SPACE_VOLUME = SPACE_PAN + SPACE_CHANNELS,
+  SPACE_GAIN = SPACE_VOLUME + SPACE_CHANNELS,
+  SPACE_COLUMNS = SPACE_GAIN + SPACE_CHANNELS
+};
+
+// A source that was just added jumps straight to its volume instead
+// of fading in from whatever its slot held before.
+#define SPACE_CLEAN 0
+#define SPACE_DIRTY 1
+#define SPACE_FRESH 2
+
+// Whether a source is mixed. Culled sources are too quiet, stolen ones
+// lost out to the voice limit. A source that is stolen while audible
+// fades out over one block before it stops being mixed.
+#define SPACE_AUDIBLE 0
+#define SPACE_CULLED 1
+#define SPACE_STOLEN 2
+#define SPACE_FADING 3
+#define SPACE_VIRTUAL(state) ((state) == SPACE_CULLED || (state) == SPACE_STOLEN)
+
+// Shifted sources are resampled in pieces of this many samples.
+#define SPACE_CHUNK 256
+
+// Speakers of a surround layout on the horizontal circle, ordered by
+// their azimuth. Every speaker forms a pair with the next one, and the
+// inverse of the pair's base matrix turns a direction into gains.
+struct space_vbap{
+  uint32_t count;
+  uint32_t channels[SPACE_CHANNELS];
+  float inverse[SPACE_CHANNELS][4];
+};
+
+// Binaural rendering state. Every source keeps its last two blocks of
+// input and the left and right spectra of its current filter. All of
+// them are summed per ear before the one inverse transform per ear.
+struct space_hrtf{
+  struct hrtf_data *hrtf;
+  struct fft_real fft;
+  float *windows;
+  float *re;
+  float *im;
+  uint32_t *used;
+  float *source_re;
+  float *source_im;
+  float *sum_re;
+  float *sum_im;
+  float *time;
+  float *block;
+  uint32_t size;
+  uint32_t fill;
 };
 
 struct space_mixer_data{
-  struct space_source **sources;
+  struct mixed_buffer **buffers;
   uint32_t count;
   uint32_t size;
-  struct mixed_buffer *left;
-  struct mixed_buffer *right;
-  struct pitch_data pitch_data;
+  float **areas;
+  uint8_t *dirty;
+  uint8_t *culled;
+  uint8_t *candidates;
+  uint8_t *stolen;
+  uint32_t *order;
+  struct resample_data *resamplers;
+  struct columns sources;
+  struct mixed_buffer *outputs[SPACE_CHANNELS];
+  uint32_t channels;
+  uint32_t layout;
+  struct space_vbap vbap;
+  struct space_hrtf binaural;
+  struct mixed_hrtf *hrtf;
   float location[3];
   float velocity[3];
   float direction[3];
@@ -26,14 +102,120 @@ struct space_mixer_data{
   float max_distance;
   float rolloff;
   float volume;
+  float cull_threshold;
+  uint32_t max_voices;
   float (*attenuation)(float min, float max, float dist, float roll);
+  uint8_t sources_changed;
+  uint8_t listener_changed;
 };
 
+static void free_space_hrtf(struct space_hrtf *binaural){
+  hrtf_release(binaural->hrtf);
+  free_fft_real(&binaural->fft);
+  if(binaural->windows) mixed_free(binaural->windows);
+  if(binaural->re) mixed_free(binaural->re);
+  if(binaural->im) mixed_free(binaural->im);
+  if(binaural->used) mixed_free(binaural->used);
+  if(binaural->source_re) mixed_free(binaural->source_re);
+  if(binaural->source_im) mixed_free(binaural->source_im);
+  if(binaural->sum_re) mixed_free(binaural->sum_re);
+  if(binaural->sum_im) mixed_free(binaural->sum_im);
+  if(binaural->time) mixed_free(binaural->time);
+  if(binaural->block) mixed_free(binaural->block);
+  memset(binaural, 0, sizeof(struct space_hrtf));
+}
+
+static int space_hrtf_fit(uint32_t size, struct space_hrtf *binaural){
+  if(!binaural->hrtf || size <= binaural->size) return 1;
+  uint32_t old = binaural->size;
+  uint32_t window = 2*binaural->hrtf->partition;
+  uint32_t bins = 2*(binaural->hrtf->partition+1);
+  float *windows = crealloc(binaural->windows, old*window, size*window, sizeof(float));
+  if(windows) binaural->windows = windows;
+  float *re = crealloc(binaural->re, old*bins, size*bins, sizeof(float));
+  if(re) binaural->re = re;
+  float *im = crealloc(binaural->im, old*bins, size*bins, sizeof(float));
+  if(im) binaural->im = im;
+  uint32_t *used = crealloc(binaural->used, old, size, sizeof(uint32_t));
+  if(used) binaural->used = used;
+  if(!windows || !re || !im || !used){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  binaural->size = size;
+  return 1;
+}
+
+static int make_space_hrtf(struct hrtf_data *hrtf, uint32_t size, struct space_hrtf *binaural){
+  uint32_t partition = hrtf->partition;
+  uint32_t bins = partition+1;
+  memset(binaural, 0, sizeof(struct space_hrtf));
+  binaural->source_re = mixed_calloc(bins, sizeof(float));
+  binaural->source_im = mixed_calloc(bins, sizeof(float));
+  binaural->sum_re = mixed_calloc(2*bins, sizeof(float));
+  binaural->sum_im = mixed_calloc(2*bins, sizeof(float));
+  binaural->time = mixed_calloc(2*partition, sizeof(float));
+  binaural->block = mixed_calloc(2*partition, sizeof(float));
+  if(!binaural->source_re || !binaural->source_im || !binaural->sum_re || !binaural->sum_im
+     || !binaural->time || !binaural->block){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  if(!make_fft_real(2*partition, &binaural->fft))
+    goto cleanup;
+  hrtf_retain(hrtf);
+  binaural->hrtf = hrtf;
+  if(!space_hrtf_fit(MAX(1, size), binaural))
+    goto cleanup;
+  return 1;
+
+ cleanup:
+  free_space_hrtf(binaural);
+  return 0;
+}
+
+// Keep the per-source storage as large as the buffer vector, so that
+// sources can be added up to the capacity without allocating.
+static int space_mixer_fit_sources(struct space_mixer_data *data){
+  uint32_t size = data->sources.size;
+  if(size < data->size){
+    float **areas = crealloc(data->areas, size, data->size, sizeof(float *));
+    if(areas) data->areas = areas;
+    uint8_t *dirty = crealloc(data->dirty, size, data->size, sizeof(uint8_t));
+    if(dirty) data->dirty = dirty;
+    uint8_t *culled = crealloc(data->culled, size, data->size, sizeof(uint8_t));
+    if(culled) data->culled = culled;
+    uint8_t *candidates = crealloc(data->candidates, size, data->size, sizeof(uint8_t));
+    if(candidates) data->candidates = candidates;
+    uint8_t *stolen = crealloc(data->stolen, size, data->size, sizeof(uint8_t));
+    if(stolen) data->stolen = stolen;
+    uint32_t *order = crealloc(data->order, size, data->size, sizeof(uint32_t));
+    if(order) data->order = order;
+    struct resample_data *resamplers = crealloc(data->resamplers, size, data->size, sizeof(struct resample_data));
+    if(resamplers) data->resamplers = resamplers;
+    if(!areas || !dirty || !culled || !candidates || !stolen || !order || !resamplers){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(!columns_reserve(data->size, &data->sources))
+      return 0;
+  }
+  return space_hrtf_fit(data->size, &data->binaural);
+}
+
 int space_mixer_free(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
   if(data){
-    free_pitch_data(&data->pitch_data);
-    mixed_free(data->sources);
+    free_columns(&data->sources);
+    free_space_hrtf(&data->binaural);
+    if(data->areas) mixed_free(data->areas);
+    if(data->dirty) mixed_free(data->dirty);
+    if(data->culled) mixed_free(data->culled);
+    if(data->candidates) mixed_free(data->candidates);
+    if(data->stolen) mixed_free(data->stolen);
+    if(data->order) mixed_free(data->order);
+    if(data->resamplers) mixed_free(data->resamplers);
+    free_vector((struct vector *)data);
     mixed_free(data);
   }
   segment->data = 0;
@@ -42,9 +224,19 @@ int space_mixer_free(struct mixed_segment *segment){
 
 int space_mixer_start(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
-  if(data->left == 0 || data->right == 0){
-    mixed_err(MIXED_BUFFER_MISSING);
-    return 0;
+  for(uint32_t c=0; c<data->channels; ++c){
+    if(data->outputs[c] == 0){
+      mixed_err(MIXED_BUFFER_MISSING);
+      return 0;
+    }
+  }
+  memset(data->resamplers, 0, data->count*sizeof(struct resample_data));
+  if(data->binaural.hrtf){
+    struct space_hrtf *binaural = &data->binaural;
+    uint32_t partition = binaural->hrtf->partition;
+    memset(binaural->windows, 0, binaural->size*2*partition*sizeof(float));
+    memset(binaural->block, 0, 2*partition*sizeof(float));
+    binaural->fill = 0;
   }
   return 1;
 }
@@ -68,21 +260,8 @@ float attenuation_exponential(float min, float max, float dist, float roll){
   return 1.0/pow(dist / min, roll);
 }
 
-static inline float dot(float a[3], float b[3]){
-  return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
-}
-
-static inline float mag(float a[3]){
-  return sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
-}
-
-static inline float dist(float a[3], float b[3]){
-  float r[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
-  return mag(r);
-}
-
 static inline float *norm(float a[3]){
-  float Mag = mag(a);
+  float Mag = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
   if(Mag != 0.0){
     a[0] /= Mag; a[1] /= Mag; a[2] /= Mag;
   }
@@ -91,7 +270,7 @@ static inline float *norm(float a[3]){
 
 static inline float *cross(float a[3], float b[3], float r[3]){
   r[0] = (a[1] * b[2]) - (a[2] * b[1]);
-  r[1] = (a[2] * b[1]) - (a[0] * b[2]);
+  r[1] = (a[2] * b[0]) - (a[0] * b[2]);
   r[2] = (a[0] * b[1]) - (a[1] * b[0]);
   return r;
 }
@@ -104,91 +283,457 @@ static inline float clamp(float l, float v, float r){
   return (v < l)? l : ((v < r)? v : r);
 }
 
-static inline float calculate_pan(float S[3], float L[3], float D[3], float U[3]){
-  float t1[3], t2[3] = {L[0] - S[0], L[1] - S[1], L[2] - S[2]};
-  return dot(norm(cross(U, D, t1)), norm(t2));
+struct space_listener{
+  float right[3];
+  float up[3];
+  float direction[3];
+  float location[3];
+  float velocity[3];
+  float soundspeed;
+  float doppler_factor;
+};
+
+// Distance, direction, stereo panning, phase, and doppler shift of
+// every source against the listener. Nothing here branches per
+// source, so the loop runs over as many sources at once as the vector
+// unit holds. A source at the listener's location has no direction and
+// thus neither pan nor phase inversion. The columns are separate
+// arguments so that they can be declared as not aliasing each other.
+VECTORIZE static void space_sweep(const struct space_listener *listener, uint32_t count,
+                                  const float *restrict x, const float *restrict y, const float *restrict z,
+                                  const float *restrict vx, const float *restrict vy, const float *restrict vz,
+                                  const float *restrict mind, const float *restrict maxd,
+                                  float *restrict distance, float *restrict lx, float *restrict ly, float *restrict lz,
+                                  float *restrict lpan, float *restrict rpan, float *restrict pitch){
+  float Rx = listener->right[0], Ry = listener->right[1], Rz = listener->right[2];
+  float Ux = listener->up[0], Uy = listener->up[1], Uz = listener->up[2];
+  float Dx = listener->direction[0], Dy = listener->direction[1], Dz = listener->direction[2];
+  float Lx = listener->location[0], Ly = listener->location[1], Lz = listener->location[2];
+  float LVx = listener->velocity[0], LVy = listener->velocity[1], LVz = listener->velocity[2];
+  float SS = listener->soundspeed;
+  float DF = listener->doppler_factor;
+  float SS_DF = SS/DF;
+
+  for(uint32_t i=0; i<count; ++i){
+    float dx = x[i]-Lx, dy = y[i]-Ly, dz = z[i]-Lz;
+    float raw = sqrtf(dx*dx + dy*dy + dz*dz);
+    // The offsets are all zero when the distance is, so the products
+    // below vanish without a branch to guard the division. FLT_MIN
+    // disappears in the rounding of any distance that matters.
+    float inv = 1.0f / (raw + FLT_MIN);
+    float dist = clamp(mind[i], raw, maxd[i]);
+    float side = -(Rx*dx + Ry*dy + Rz*dz)*inv;
+    float pan = (dist <= mind[i])? 0.0f : side;
+    float phase = Dx*dx + Dy*dy + Dz*dz;
+    float l = (0.0f < pan)? (1.0f-pan) : 1.0f;
+    float r = (pan < 0.0f)? (1.0f+pan) : 1.0f;
+    distance[i] = dist;
+    lx[i] = side;
+    ly[i] = (Ux*dx + Uy*dy + Uz*dz)*inv;
+    lz[i] = phase*inv;
+    lpan[i] = l;
+    rpan[i] = (phase < 0.0f)? -r : r;
+    // See OpenAL1.1 specification §3.5.2
+    float vls = min(-(dx*LVx + dy*LVy + dz*LVz) * raw, SS_DF);
+    float vss = min(-(dx*vx[i] + dy*vy[i] + dz*vz[i]) * raw, SS_DF);
+    pitch[i] = clamp(0.5f, (SS - DF*vls) / (SS - DF*vss), 2.0f);
+  }
+}
+
+static void space_mixer_sweep(struct space_mixer_data *data){
+  struct columns *sources = &data->sources;
+  struct space_listener listener = {
+    .direction = {data->direction[0], data->direction[1], data->direction[2]},
+    .location = {data->location[0], data->location[1], data->location[2]},
+    .velocity = {data->velocity[0], data->velocity[1], data->velocity[2]},
+    .soundspeed = data->soundspeed,
+    .doppler_factor = data->doppler_factor
+  };
+  norm(cross(data->up, data->direction, listener.right));
+  norm(listener.direction);
+  cross(listener.direction, listener.right, listener.up);
+  space_sweep(&listener, data->count,
+              column(SPACE_X, sources), column(SPACE_Y, sources), column(SPACE_Z, sources),
+              column(SPACE_VX, sources), column(SPACE_VY, sources), column(SPACE_VZ, sources),
+              column(SPACE_MIN_DISTANCE, sources), column(SPACE_MAX_DISTANCE, sources),
+              column(SPACE_DISTANCE, sources),
+              column(SPACE_LX, sources), column(SPACE_LY, sources), column(SPACE_LZ, sources),
+              column(SPACE_PAN+0, sources), column(SPACE_PAN+1, sources), column(SPACE_PITCH, sources));
+  if(data->doppler_factor <= 0.0f){
+    float *pitch = column(SPACE_PITCH, sources);
+    for(uint32_t i=0; i<data->count; ++i)
+      pitch[i] = 1.0f;
+  }
+}
+
+// The direction of a source on top of the listener is zero, and it is
+// then heard from straight ahead.
+static inline void space_direction(struct columns *sources, uint32_t s, float local[3]){
+  local[0] = column(SPACE_LX, sources)[s];
+  local[1] = column(SPACE_LY, sources)[s];
+  local[2] = column(SPACE_LZ, sources)[s];
+  if(local[0] == 0.0f && local[1] == 0.0f && local[2] == 0.0f)
+    local[2] = 1.0f;
 }
 
-static inline float calculate_phase(float S[3], float L[3], float D[3]){
-  float t2[3] = {S[0] - L[0], S[1] - L[1], S[2] - L[2]};
-  return dot(norm(D), norm(t2));
+static void space_hrtf_filter(struct space_mixer_data *data, uint32_t s, float volume){
+  struct space_hrtf *binaural = &data->binaural;
+  uint32_t bins = 2*(binaural->hrtf->partition+1);
+  float local[3];
+  space_direction(&data->sources, s, local);
+  hrtf_interpolate(local, volume, binaural->re+s*bins, binaural->im+s*bins, binaural->hrtf);
 }
 
-VECTORIZE static inline void calculate_volumes(float *lvolume, float *rvolume, struct space_source *source, struct space_mixer_data *data){
-  float min = source->min_distance;
-  float max = source->max_distance;
-  float roll = source->rolloff;
-  float div = data->volume;
-  float distance = clamp(min, dist(source->location, data->location), max);
-  float volume = div * data->attenuation(min, max, distance, roll);
-  float pan = (distance <= min)
-    ? 0.0
-    : calculate_pan(source->location, data->location, data->direction, data->up);
-  *lvolume = volume * ((0.0<pan)?(1.0f-pan):1.0f);
-  *rvolume = volume * ((pan<0.0)?(1.0f+pan):1.0f);
-  if(calculate_phase(source->location, data->location, data->direction) < 0){
-    *rvolume *= -1.0;
+// Every source's window is transformed once and multiplied with both
+// of its filters into the per ear sums, so that the expensive inverse
+// transform happens twice per block no matter how many sources play.
+static void space_hrtf_block(struct space_mixer_data *data){
+  struct space_hrtf *binaural = &data->binaural;
+  uint32_t partition = binaural->hrtf->partition;
+  uint32_t bins = partition+1;
+  memset(binaural->sum_re, 0, 2*bins*sizeof(float));
+  memset(binaural->sum_im, 0, 2*bins*sizeof(float));
+  for(uint32_t s=0; s<data->count; ++s){
+    if(!data->buffers[s]) continue;
+    float *window = binaural->windows+s*2*partition;
+    // A virtual source starts from silence once it is audible again.
+    if(SPACE_VIRTUAL(data->culled[s])){
+      memset(window, 0, 2*partition*sizeof(float));
+      continue;
+    }
+    float *re = binaural->re+s*2*bins, *im = binaural->im+s*2*bins;
+    fft_real_forward(window, binaural->source_re, binaural->source_im, &binaural->fft);
+    fft_multiply_add(binaural->source_re, binaural->source_im, re, im,
+                     binaural->sum_re, binaural->sum_im, bins);
+    fft_multiply_add(binaural->source_re, binaural->source_im, re+bins, im+bins,
+                     binaural->sum_re+bins, binaural->sum_im+bins, bins);
+    memcpy(window, window+partition, partition*sizeof(float));
+  }
+  for(uint32_t ear=0; ear<2; ++ear){
+    fft_real_inverse(binaural->sum_re+ear*bins, binaural->sum_im+ear*bins, binaural->time, &binaural->fft);
+    memcpy(binaural->block+ear*partition, binaural->time+partition, partition*sizeof(float));
   }
 }
 
-VECTORIZE static inline float calculate_pitch_shift(struct space_mixer_data *listener, struct space_source *source){
-  if(listener->doppler_factor <= 0.0) return 1.0;
-  // See OpenAL1.1 specification §3.5.2
-  float SL[3] = {listener->location[0] - source->location[0],
-                 listener->location[1] - source->location[1],
-                 listener->location[2] - source->location[2]};
-  float *SV = source->velocity;
-  float *LV = listener->velocity;
-  float SS = listener->soundspeed;
-  float DF = listener->doppler_factor;
-  float Mag = mag(SL);
-  float vls = dot(SL, LV) * Mag;
-  float vss = dot(SL, SV) * Mag;
-  float SS_DF = SS/DF;
-  vss = min(vss, SS_DF);
-  vls = min(vls, SS_DF);
-  return (SS - DF*vls) / (SS - DF*vss);
+// Sources are gathered into their windows a piece at a time while the
+// output plays back the block computed last, as for the convolution
+// segment.
+static void space_hrtf_mix(struct space_mixer_data *data, float *left, float *right, uint32_t samples){
+  struct space_hrtf *binaural = &data->binaural;
+  uint32_t partition = binaural->hrtf->partition;
+  float *pitch = column(SPACE_PITCH, &data->sources);
+  memset(binaural->used, 0, data->count*sizeof(uint32_t));
+  for(uint32_t i=0; i<samples;){
+    uint32_t fill = binaural->fill;
+    uint32_t count = MIN(partition-fill, samples-i);
+    for(uint32_t s=0; s<data->count; ++s){
+      float *in = data->areas[s];
+      if(!in) continue;
+      float *window = binaural->windows+s*2*partition+partition+fill;
+      if(pitch[s] != 1.0f){
+        binaural->used[s] += resample_linear(pitch[s], in+binaural->used[s], window, count, &data->resamplers[s]);
+      }else{
+        memcpy(window, in+binaural->used[s], count*sizeof(float));
+        binaural->used[s] += count;
+      }
+    }
+    memcpy(left+i, binaural->block+fill, count*sizeof(float));
+    memcpy(right+i, binaural->block+partition+fill, count*sizeof(float));
+    i += count;
+    binaural->fill = fill+count;
+    if(binaural->fill == partition){
+      space_hrtf_block(data);
+      binaural->fill = 0;
+    }
+  }
+  for(uint32_t s=0; s<data->count; ++s){
+    float *in = data->areas[s];
+    if(!in) continue;
+    if(pitch[s] == 1.0f){
+      data->resamplers[s].phase = 0.0f;
+      data->resamplers[s].last = in[samples-1];
+    }
+    mixed_buffer_finish_read(binaural->used[s], data->buffers[s]);
+  }
+}
+
+// Surround speakers by their azimuth in degrees, clockwise from ahead.
+struct space_speaker{
+  uint32_t channel;
+  float azimuth;
+};
+
+static const struct space_speaker space_surround_5_1[] = {
+  {MIXED_LEFT_REAR, -110.0f}, {MIXED_LEFT_FRONT, -30.0f}, {MIXED_CENTER, 0.0f},
+  {MIXED_RIGHT_FRONT, 30.0f}, {MIXED_RIGHT_REAR, 110.0f}};
+
+static const struct space_speaker space_surround_7_1[] = {
+  {MIXED_LEFT_REAR, -150.0f}, {MIXED_LEFT_SIDE, -90.0f}, {MIXED_LEFT_FRONT, -30.0f},
+  {MIXED_CENTER, 0.0f}, {MIXED_RIGHT_FRONT, 30.0f}, {MIXED_RIGHT_SIDE, 90.0f},
+  {MIXED_RIGHT_REAR, 150.0f}};
+
+static void make_space_vbap(const struct space_speaker *speakers, uint32_t count, struct space_vbap *vbap){
+  vbap->count = count;
+  for(uint32_t k=0; k<count; ++k){
+    float a = speakers[k].azimuth * (float)M_PI / 180.0f;
+    float b = speakers[(k+1)%count].azimuth * (float)M_PI / 180.0f;
+    float sa = sinf(a), ca = cosf(a), sb = sinf(b), cb = cosf(b);
+    float det = sa*cb - sb*ca;
+    vbap->channels[k] = speakers[k].channel;
+    vbap->inverse[k][0] = cb/det;
+    vbap->inverse[k][1] = -sb/det;
+    vbap->inverse[k][2] = -ca/det;
+    vbap->inverse[k][3] = sa/det;
+  }
 }
 
-VECTORIZE int space_mixer_mix(struct mixed_segment *segment){
+static uint32_t space_layout_channels(uint32_t layout){
+  switch(layout){
+  case MIXED_SPACE_STEREO: return 2;
+  case MIXED_SPACE_SURROUND_5_1: return 6;
+  case MIXED_SPACE_SURROUND_7_1: return 8;
+  case MIXED_SPACE_AMBISONICS_FIRST_ORDER: return 4;
+  case MIXED_SPACE_AMBISONICS_THIRD_ORDER: return 16;
+  default: return 0;
+  }
+}
+
+// Pairwise amplitude panning on the horizontal circle. The pair whose
+// gains for the direction are both positive encloses it. Elevation is
+// dropped, and a source straight above or below plays from ahead.
+static void space_vbap_pans(struct space_vbap *vbap, struct columns *sources, uint32_t count){
+  float *lx = column(SPACE_LX, sources), *lz = column(SPACE_LZ, sources);
+  for(uint32_t s=0; s<count; ++s){
+    float x = lx[s], z = lz[s];
+    float mag = sqrtf(x*x + z*z);
+    if(mag == 0.0f){ x = 0.0f; z = 1.0f; }
+    else{ x /= mag; z /= mag; }
+    for(uint32_t c=0; c<SPACE_CHANNELS; ++c)
+      column(SPACE_PAN+c, sources)[s] = 0.0f;
+    for(uint32_t k=0; k<vbap->count; ++k){
+      float *inverse = vbap->inverse[k];
+      float a = inverse[0]*x + inverse[1]*z;
+      float b = inverse[2]*x + inverse[3]*z;
+      if(a < -0.0001f || b < -0.0001f) continue;
+      a = MAX(a, 0.0f); b = MAX(b, 0.0f);
+      float power = 1.0f / sqrtf(a*a + b*b);
+      column(SPACE_PAN+vbap->channels[k], sources)[s] = a*power;
+      column(SPACE_PAN+vbap->channels[(k+1)%vbap->count], sources)[s] = b*power;
+      break;
+    }
+  }
+}
+
+// Ambisonic encoding in ACN channel order with SN3D normalisation.
+// The pan columns are one stride apart, which lets the whole sweep
+// write through one pointer.
+VECTORIZE static void space_ambisonic_pans(uint32_t order, uint32_t count, uint32_t stride,
+                                           const float *restrict lx, const float *restrict ly, const float *restrict lz,
+                                           float *restrict pan){
+  for(uint32_t i=0; i<count; ++i){
+    // Ambisonics has X ahead, Y to the left, and Z up.
+    float x = lz[i], y = -lx[i], z = ly[i];
+    pan[0*stride+i] = 1.0f;
+    pan[1*stride+i] = y;
+    pan[2*stride+i] = z;
+    pan[3*stride+i] = x;
+  }
+  if(order < 3) return;
+  for(uint32_t i=0; i<count; ++i){
+    float x = lz[i], y = -lx[i], z = ly[i];
+    float xx = x*x, yy = y*y, zz = z*z;
+    pan[4*stride+i] = 1.7320508f*x*y;
+    pan[5*stride+i] = 1.7320508f*y*z;
+    pan[6*stride+i] = 0.5f*(3.0f*zz - 1.0f);
+    pan[7*stride+i] = 1.7320508f*x*z;
+    pan[8*stride+i] = 0.8660254f*(xx - yy);
+    pan[9*stride+i] = 0.7905694f*y*(3.0f*xx - yy);
+    pan[10*stride+i] = 3.8729833f*x*y*z;
+    pan[11*stride+i] = 0.6123724f*y*(5.0f*zz - 1.0f);
+    pan[12*stride+i] = 0.5f*z*(5.0f*zz - 3.0f);
+    pan[13*stride+i] = 0.6123724f*x*(5.0f*zz - 1.0f);
+    pan[14*stride+i] = 1.9364917f*z*(xx - yy);
+    pan[15*stride+i] = 0.7905694f*x*(xx - 3.0f*yy);
+  }
+}
+
+// The stereo pans come straight out of the sweep, every other layout
+// derives its pans from the directions it left behind.
+static void space_mixer_pans(struct space_mixer_data *data){
+  struct columns *sources = &data->sources;
+  switch(data->layout){
+  case MIXED_SPACE_SURROUND_5_1:
+  case MIXED_SPACE_SURROUND_7_1:
+    space_vbap_pans(&data->vbap, sources, data->count);
+    break;
+  case MIXED_SPACE_AMBISONICS_FIRST_ORDER:
+  case MIXED_SPACE_AMBISONICS_THIRD_ORDER:
+    space_ambisonic_pans((data->layout == MIXED_SPACE_AMBISONICS_FIRST_ORDER)? 1 : 3,
+                         data->count, sources->size,
+                         column(SPACE_LX, sources), column(SPACE_LY, sources), column(SPACE_LZ, sources),
+                         column(SPACE_PAN, sources));
+    break;
+  }
+}
+
+VECTORIZE static void mix_gain(float *restrict in, float *restrict out, float start, float step, uint32_t samples){
+  // Most sources sit still, and they do not need the ramp.
+  if(step == 0.0f){
+    if(start == 0.0f) return;
+    for(uint32_t i=0; i<samples; ++i)
+      out[i] += in[i] * start;
+    return;
+  }
+  for(uint32_t i=0; i<samples; ++i)
+    out[i] += in[i] * (start + step*i);
+}
+
+// Stolen sources go silent, and sources no longer stolen get their
+// volumes back from their loudness.
+static void space_mixer_limit(struct space_mixer_data *data){
+  struct columns *sources = &data->sources;
+  float *loudness = column(SPACE_LOUDNESS, sources);
+  for(uint32_t s=0; s<data->count; ++s)
+    data->candidates[s] = (data->buffers[s] && data->culled[s] != SPACE_CULLED);
+  voices_limit(data->count, data->max_voices, data->candidates,
+               column(SPACE_PRIORITY, sources), loudness, data->order, data->stolen);
+  for(uint32_t s=0; s<data->count; ++s){
+    if(!data->candidates[s]) continue;
+    if(data->stolen[s]){
+      if(data->culled[s] == SPACE_AUDIBLE)
+        data->culled[s] = data->binaural.hrtf? SPACE_STOLEN : SPACE_FADING;
+      for(uint32_t c=0; c<data->channels; ++c)
+        column(SPACE_VOLUME+c, sources)[s] = 0.0f;
+    }else if(data->culled[s] != SPACE_AUDIBLE){
+      data->culled[s] = SPACE_AUDIBLE;
+      for(uint32_t c=0; c<data->channels; ++c)
+        column(SPACE_VOLUME+c, sources)[s] = loudness[s] * column(SPACE_PAN+c, sources)[s];
+    }
+  }
+}
+
+// Only sources whose parameters or listener changed get their volume
+// and pitch recalculated. The volumes then move linearly from their
+// old to their new values over the block, so that motion does not
+// step audibly from one block to the next. With a response set the
+// volume is folded into each source's filters instead. Sources are
+// mixed a chunk at a time, so that a chunk stays in the cache while it
+// is spread over all outputs.
+int space_mixer_mix(struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
-  float *left, *right, *in;
+  struct columns *sources = &data->sources;
+  uint32_t count = data->count;
+  uint32_t channels = data->channels;
+  float *outputs[SPACE_CHANNELS];
   uint32_t samples = UINT32_MAX;
-  
-  // Compute sample counts
-  mixed_buffer_request_write(&left, &samples, data->left);
-  mixed_buffer_request_write(&right, &samples, data->right);
-  for(uint32_t s=0; s<data->count; ++s){
-    struct space_source *source = data->sources[s];
-    if(!source) continue;
+  int silent = 0;
+  float *distance = column(SPACE_DISTANCE, sources), *pitch = column(SPACE_PITCH, sources);
+  float *mind = column(SPACE_MIN_DISTANCE, sources), *maxd = column(SPACE_MAX_DISTANCE, sources);
+  float *roll = column(SPACE_ROLLOFF, sources);
 
-    mixed_buffer_request_read(&in, &samples, source->buffer);
-    if(samples == 0) break;
+  uint8_t listener = data->listener_changed;
+  if(listener || data->sources_changed){
+    space_mixer_sweep(data);
+    space_mixer_pans(data);
+    for(uint32_t s=0; s<count; ++s){
+      if(!data->buffers[s] || !(listener || data->dirty[s])) continue;
+      float volume = data->volume * data->attenuation(mind[s], maxd[s], distance[s], roll[s]);
+      uint8_t state = data->culled[s];
+      if(fabsf(volume) < data->cull_threshold)
+        data->culled[s] = SPACE_CULLED;
+      else if(!data->max_voices || state == SPACE_CULLED)
+        data->culled[s] = SPACE_AUDIBLE;
+      column(SPACE_LOUDNESS, sources)[s] = volume;
+      for(uint32_t c=0; c<channels; ++c){
+        column(SPACE_VOLUME+c, sources)[s] = volume * column(SPACE_PAN+c, sources)[s];
+        // A virtual source fades in from silence when it comes back.
+        if(data->dirty[s] == SPACE_FRESH)
+          column(SPACE_GAIN+c, sources)[s] = column(SPACE_VOLUME+c, sources)[s];
+        else if(data->culled[s] == SPACE_CULLED)
+          column(SPACE_GAIN+c, sources)[s] = 0.0f;
+      }
+      if(data->binaural.hrtf)
+        space_hrtf_filter(data, s, volume);
+      data->dirty[s] = SPACE_CLEAN;
+    }
+    if(data->max_voices)
+      space_mixer_limit(data);
+    data->sources_changed = 0;
+    data->listener_changed = 0;
+  }
+  
+  // Compute sample counts. A shifted source reads faster or slower
+  // than it plays, so the block is as long as the input of every one
+  // of them lasts. Virtual sources do not count.
+  for(uint32_t c=0; c<channels; ++c)
+    mixed_buffer_request_write(&outputs[c], &samples, data->outputs[c]);
+  for(uint32_t s=0; s<count; ++s){
+    uint32_t available = UINT32_MAX;
+    data->areas[s] = 0;
+    if(!data->buffers[s] || SPACE_VIRTUAL(data->culled[s])) continue;
+    mixed_buffer_request_read(&data->areas[s], &available, data->buffers[s]);
+    if(pitch[s] != 1.0f)
+      available = resample_frames(pitch[s], data->resamplers[s].phase, available);
+    samples = MIN(samples, available);
   }
 
-  if(0 < samples){
-    memset(left, 0, samples*sizeof(float));
-    memset(right, 0, samples*sizeof(float));
-    for(uint32_t s=0; s<data->count; ++s){
-      struct space_source *source = data->sources[s];
-      if(!source) continue;
-      
-      float lvolume, rvolume;
-      mixed_buffer_request_read(&in, &samples, source->buffer);
-      calculate_volumes(&lvolume, &rvolume, source, data);
-      float pitch = clamp(0.5, calculate_pitch_shift(data, source), 2.0);
-      if(pitch != 1.0)
-        pitch_shift(pitch, in, in, samples, &data->pitch_data);
-      for(uint32_t i=0; i<samples; ++i){
-        float sample = in[i];
-        left[i] += sample * lvolume;
-        right[i] += sample * rvolume;
+  if(0 < samples && data->binaural.hrtf){
+    space_hrtf_mix(data, outputs[0], outputs[1], samples);
+  }else if(0 < samples){
+    float inv = 1.0f / samples;
+    float shifted[SPACE_CHUNK];
+    for(uint32_t c=0; c<channels; ++c)
+      memset(outputs[c], 0, samples*sizeof(float));
+    silent = 1;
+    for(uint32_t s=0; s<count; ++s){
+      float *in = data->areas[s];
+      if(!in) continue;
+      // A silent source only has to be consumed.
+      if(mixed_buffer_is_silent(data->buffers[s])){
+        buffer_skip(pitch[s], samples, data->buffers[s], &data->resamplers[s]);
+        for(uint32_t c=0; c<channels; ++c)
+          column(SPACE_GAIN+c, sources)[s] = column(SPACE_VOLUME+c, sources)[s];
+        continue;
       }
-      mixed_buffer_finish_read(samples, source->buffer);
+      silent = 0;
+
+      uint32_t used = 0;
+      for(uint32_t i=0; i<samples; i+=SPACE_CHUNK){
+        uint32_t chunk = MIN(SPACE_CHUNK, samples-i);
+        float *piece = in+i;
+        if(pitch[s] != 1.0f){
+          used += resample_linear(pitch[s], in+used, shifted, chunk, &data->resamplers[s]);
+          piece = shifted;
+        }
+        for(uint32_t c=0; c<channels; ++c){
+          float start = column(SPACE_GAIN+c, sources)[s];
+          float step = (column(SPACE_VOLUME+c, sources)[s] - start) * inv;
+          mix_gain(piece, outputs[c]+i, start+step*i, step, chunk);
+        }
+      }
+      if(pitch[s] == 1.0f){
+        used = samples;
+        data->resamplers[s].phase = 0.0f;
+        data->resamplers[s].last = in[samples-1];
+      }
+      mixed_buffer_finish_read(used, data->buffers[s]);
+      for(uint32_t c=0; c<channels; ++c)
+        column(SPACE_GAIN+c, sources)[s] = column(SPACE_VOLUME+c, sources)[s];
     }
   }
-  mixed_buffer_finish_write(samples, data->left);
-  mixed_buffer_finish_write(samples, data->right);
+  for(uint32_t s=0; s<count; ++s){
+    if(!data->buffers[s]) continue;
+    if(SPACE_VIRTUAL(data->culled[s]))
+      buffer_skip(pitch[s], samples, data->buffers[s], &data->resamplers[s]);
+    else if(data->culled[s] == SPACE_FADING && 0 < samples)
+      data->culled[s] = SPACE_STOLEN;
+  }
+  for(uint32_t c=0; c<channels; ++c){
+    if(silent)
+      mixed_buffer_finish_write_silence(samples, data->outputs[c]);
+    else
+      mixed_buffer_finish_write(samples, data->outputs[c]);
+  }
   return 1;
 }
 
@@ -197,11 +742,12 @@ int space_mixer_set_out(uint32_t field, uint32_t location, void *buffer, struct
   
   switch(field){
   case MIXED_BUFFER:
-    switch(location){
-    case MIXED_LEFT: data->left = (struct mixed_buffer *)buffer; return 1;
-    case MIXED_RIGHT: data->right = (struct mixed_buffer *)buffer; return 1;
-    default: mixed_err(MIXED_INVALID_LOCATION); return 0;
+    if(SPACE_CHANNELS <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
     }
+    data->outputs[location] = (struct mixed_buffer *)buffer;
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -213,11 +759,12 @@ int space_mixer_get_out(uint32_t field, uint32_t location, void *buffer, struct
   
   switch(field){
   case MIXED_BUFFER:
-    switch(location){
-    case MIXED_LEFT: *(struct mixed_buffer **)buffer = data->left; return 1;
-    case MIXED_RIGHT: *(struct mixed_buffer **)buffer = data->right; return 1;
-    default: mixed_err(MIXED_INVALID_LOCATION); return 0;
+    if(data->channels <= location){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
     }
+    *(struct mixed_buffer **)buffer = data->outputs[location];
+    return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
@@ -226,39 +773,44 @@ int space_mixer_get_out(uint32_t field, uint32_t location, void *buffer, struct
 
 int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+  struct columns *sources = &data->sources;
 
   switch(field){
   case MIXED_BUFFER:
     if(buffer){ // Add or set an element
-      struct space_source *source = 0;
-      if(location < data->count)
-        source = data->sources[location];
-      if(!source){
-        source = mixed_calloc(1, sizeof(struct space_source));
-        if(!source){
-          mixed_err(MIXED_OUT_OF_MEMORY);
+      if(data->count <= location){
+        if(!vector_add_pos(location, buffer, (struct vector *)data)
+           || !space_mixer_fit_sources(data))
           return 0;
-        }
-        source->min_distance = data->min_distance;
-        source->max_distance = data->max_distance;
-        source->rolloff = data->rolloff;
-        source->velocity[0] = data->velocity[0];
-        source->velocity[1] = data->velocity[1];
-        source->velocity[2] = data->velocity[2];
-        source->location[0] = data->location[0];
-        source->location[1] = data->location[1];
-        source->location[2] = data->location[2];
+      }else if(data->buffers[location]){
+        data->buffers[location] = (struct mixed_buffer *)buffer;
+        return 1;
+      }
+      data->buffers[location] = (struct mixed_buffer *)buffer;
+      column(SPACE_MIN_DISTANCE, sources)[location] = data->min_distance;
+      column(SPACE_MAX_DISTANCE, sources)[location] = data->max_distance;
+      column(SPACE_ROLLOFF, sources)[location] = data->rolloff;
+      column(SPACE_VX, sources)[location] = data->velocity[0];
+      column(SPACE_VY, sources)[location] = data->velocity[1];
+      column(SPACE_VZ, sources)[location] = data->velocity[2];
+      column(SPACE_X, sources)[location] = data->location[0];
+      column(SPACE_Y, sources)[location] = data->location[1];
+      column(SPACE_Z, sources)[location] = data->location[2];
+      data->resamplers[location] = (struct resample_data){0};
+      data->culled[location] = SPACE_AUDIBLE;
+      column(SPACE_PRIORITY, sources)[location] = 0.0f;
+      if(data->binaural.hrtf){
+        uint32_t window = 2*data->binaural.hrtf->partition;
+        memset(data->binaural.windows+location*window, 0, window*sizeof(float));
       }
-      source->buffer = (struct mixed_buffer *)buffer;
-      if(location < data->count) data->sources[location] = source;
-      else return vector_add_pos(location, source, (struct vector *)data);
+      data->dirty[location] = SPACE_FRESH;
+      data->sources_changed = 1;
     }else{ // Remove an element
       if(data->count <= location){
         mixed_err(MIXED_INVALID_LOCATION);
         return 0;
       }
-      mixed_free(data->sources[location]);
-      data->sources[location] = 0;
+      data->buffers[location] = 0;
     }
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
@@ -266,33 +818,42 @@ int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
   case MIXED_SPACE_ROLLOFF:
   case MIXED_SPACE_LOCATION:
   case MIXED_SPACE_VELOCITY:
-    if(data->count <= location){
+    if(data->count <= location || !data->buffers[location]){
       mixed_err(MIXED_INVALID_LOCATION);
       return 0;
     }
-    struct space_source *source = data->sources[location];
     float *value = (float *)buffer;
     switch(field){
     case MIXED_SPACE_MIN_DISTANCE:
-      source->min_distance = *(float *)buffer;
+      column(SPACE_MIN_DISTANCE, sources)[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_MAX_DISTANCE:
-      source->max_distance = *(float *)buffer;
+      column(SPACE_MAX_DISTANCE, sources)[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_ROLLOFF:
-      source->rolloff = *(float *)buffer;
+      column(SPACE_ROLLOFF, sources)[location] = *(float *)buffer;
       break;
     case MIXED_SPACE_LOCATION:
-      source->location[0] = value[0];
-      source->location[1] = value[1];
-      source->location[2] = value[2];
+      column(SPACE_X, sources)[location] = value[0];
+      column(SPACE_Y, sources)[location] = value[1];
+      column(SPACE_Z, sources)[location] = value[2];
       break;
     case MIXED_SPACE_VELOCITY:
-      source->velocity[0] = value[0];
-      source->velocity[1] = value[1];
-      source->velocity[2] = value[2];
+      column(SPACE_VX, sources)[location] = value[0];
+      column(SPACE_VY, sources)[location] = value[1];
+      column(SPACE_VZ, sources)[location] = value[2];
       break;
     }
+    if(!data->dirty[location]) data->dirty[location] = SPACE_DIRTY;
+    data->sources_changed = 1;
+    return 1;
+  case MIXED_PRIORITY:
+    if(data->count <= location || !data->buffers[location]){
+      mixed_err(MIXED_INVALID_LOCATION);
+      return 0;
+    }
+    column(SPACE_PRIORITY, sources)[location] = *(float *)buffer;
+    data->sources_changed = 1;
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -302,46 +863,42 @@ int space_mixer_set_in(uint32_t field, uint32_t location, void *buffer, struct m
 
 int space_mixer_get_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
   struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+  struct columns *sources = &data->sources;
   
-  if(data->count <= location){
-    mixed_err(MIXED_INVALID_LOCATION);
-    return 0;
-  }
-  
-  struct space_source *source = data->sources[location];
-  if(source == 0){
+  if(data->count <= location || !data->buffers[location]){
     mixed_err(MIXED_INVALID_LOCATION);
     return 0;
   }
 
+  float *value = (float *)buffer;
   switch(field){
   case MIXED_BUFFER:
-    *(struct mixed_buffer **)buffer = source->buffer;
+    *(struct mixed_buffer **)buffer = data->buffers[location];
     return 1;
   case MIXED_SPACE_MIN_DISTANCE:
-    *(float *)buffer = source->min_distance;
+    *value = column(SPACE_MIN_DISTANCE, sources)[location];
     return 1;
   case MIXED_SPACE_MAX_DISTANCE:
-    *(float *)buffer = source->max_distance;
+    *value = column(SPACE_MAX_DISTANCE, sources)[location];
     return 1;
   case MIXED_SPACE_ROLLOFF:
-    *(float *)buffer = source->rolloff;
+    *value = column(SPACE_ROLLOFF, sources)[location];
     return 1;
   case MIXED_SPACE_LOCATION:
-  case MIXED_SPACE_VELOCITY:{
-    float *value = (float *)buffer;
-    switch(field){
-    case MIXED_SPACE_LOCATION:
-      value[0] = source->location[0];
-      value[1] = source->location[1];
-      value[2] = source->location[2];
-      break;
-    case MIXED_SPACE_VELOCITY:
-      value[0] = source->velocity[0];
-      value[1] = source->velocity[1];
-      value[2] = source->velocity[2];
-      break;
-    }}
+    value[0] = column(SPACE_X, sources)[location];
+    value[1] = column(SPACE_Y, sources)[location];
+    value[2] = column(SPACE_Z, sources)[location];
+    return 1;
+  case MIXED_SPACE_VELOCITY:
+    value[0] = column(SPACE_VX, sources)[location];
+    value[1] = column(SPACE_VY, sources)[location];
+    value[2] = column(SPACE_VZ, sources)[location];
+    return 1;
+  case MIXED_SPACE_VIRTUAL:
+    *(bool *)buffer = SPACE_VIRTUAL(data->culled[location]);
+    return 1;
+  case MIXED_PRIORITY:
+    *value = column(SPACE_PRIORITY, sources)[location];
     return 1;
   default:
     mixed_err(MIXED_INVALID_FIELD);
@@ -391,6 +948,21 @@ int space_mixer_get(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_ROLLOFF:
     *(float *)value = data->rolloff;
     break;
+  case MIXED_CAPACITY:
+    *(uint32_t *)value = data->size;
+    break;
+  case MIXED_SPACE_HRTF:
+    *(struct mixed_hrtf **)value = data->hrtf;
+    break;
+  case MIXED_SPACE_LAYOUT:
+    *(uint32_t *)value = data->layout;
+    break;
+  case MIXED_SPACE_CULL_THRESHOLD:
+    *(float *)value = data->cull_threshold;
+    break;
+  case MIXED_MAX_VOICES:
+    *(uint32_t *)value = data->max_voices;
+    break;
   case MIXED_SPACE_ATTENUATION:
     if(data->attenuation == attenuation_none){
       *(int *)value = MIXED_NO_ATTENUATION;
@@ -453,6 +1025,46 @@ int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
   case MIXED_SPACE_ROLLOFF:
     data->rolloff = *(float *)value;
     break;
+  case MIXED_CAPACITY:
+    if(!vector_reserve(*(uint32_t *)value, (struct vector *)data)
+       || !space_mixer_fit_sources(data))
+      return 0;
+    break;
+  case MIXED_SPACE_HRTF: {
+    struct mixed_hrtf *hrtf = (struct mixed_hrtf *)value;
+    struct space_hrtf binaural = {0};
+    if(hrtf && data->layout != MIXED_SPACE_STEREO){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(hrtf && !make_space_hrtf((struct hrtf_data *)hrtf->_data, data->size, &binaural))
+      return 0;
+    free_space_hrtf(&data->binaural);
+    data->binaural = binaural;
+    data->hrtf = hrtf;
+    break;}
+  case MIXED_SPACE_LAYOUT: {
+    uint32_t layout = *(uint32_t *)value;
+    if(space_layout_channels(layout) == 0 || (data->hrtf && layout != MIXED_SPACE_STEREO)){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    if(layout == MIXED_SPACE_SURROUND_5_1)
+      make_space_vbap(space_surround_5_1, sizeof(space_surround_5_1)/sizeof(struct space_speaker), &data->vbap);
+    if(layout == MIXED_SPACE_SURROUND_7_1)
+      make_space_vbap(space_surround_7_1, sizeof(space_surround_7_1)/sizeof(struct space_speaker), &data->vbap);
+    // The gains of one layout mean nothing in another.
+    for(uint32_t s=0; s<data->count; ++s)
+      data->dirty[s] = SPACE_FRESH;
+    data->layout = layout;
+    data->channels = space_layout_channels(layout);
+    break;}
+  case MIXED_SPACE_CULL_THRESHOLD:
+    data->cull_threshold = *(float *)value;
+    break;
+  case MIXED_MAX_VOICES:
+    data->max_voices = *(uint32_t *)value;
+    break;
   case MIXED_SPACE_ATTENUATION:
     switch(*(uint32_t *)value){
     case MIXED_NO_ATTENUATION:
@@ -476,18 +1088,19 @@ int space_mixer_set(uint32_t field, void *value, struct mixed_segment *segment){
     mixed_err(MIXED_INVALID_FIELD);
     return 0;
   }
+  data->listener_changed = 1;
   return 1;
 }
 
 int space_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segment){
-  IGNORE(segment);
-  
+  struct space_mixer_data *data = (struct space_mixer_data *)segment->data;
+
   info->name = "space_mixer";
   info->description = "Mixes multiple sources while simulating 3D space.";
-  info->flags = MIXED_MODIFIES_INPUT;
+  info->flags = 0;
   info->min_inputs = 0;
   info->max_inputs = -1;
-  info->outputs = 2;
+  info->outputs = data->channels;
     
   struct mixed_segment_field_info *field = info->fields;
   set_info_field(field++, MIXED_BUFFER,
@@ -538,22 +1151,48 @@ int space_mixer_info(struct mixed_segment_info *info, struct mixed_segment *segm
                  MIXED_FUNCTION, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The function that calculates the attenuation curve that defines the volume of a source by its distance.");
 
+  set_info_field(field++, MIXED_CAPACITY,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of sources that can be added without allocating.");
+
+  set_info_field(field++, MIXED_SPACE_HRTF,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The head related impulse responses to render binaural output with, if any.");
+
+  set_info_field(field++, MIXED_SPACE_LAYOUT,
+                 MIXED_SPACE_LAYOUT_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The speaker layout or ambisonic order the sources are panned to.");
+
+  set_info_field(field++, MIXED_SPACE_CULL_THRESHOLD,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The volume below which a source is virtual and not mixed.");
+
+  set_info_field(field++, MIXED_SPACE_VIRTUAL,
+                 MIXED_BOOL, 1, MIXED_IN | MIXED_GET,
+                 "Whether the source is currently virtual.");
+
+  set_info_field(field++, MIXED_MAX_VOICES,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The most sources that are mixed at once, or 0 for no limit.");
+
+  set_info_field(field++, MIXED_PRIORITY,
+                 MIXED_FLOAT, 1, MIXED_IN | MIXED_SET | MIXED_GET,
+                 "The priority of the source when voices are limited.");
+
   clear_info_field(field++);
   return 1;
 }
 
 MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixed_segment *segment){
+  IGNORE(samplerate);
   struct space_mixer_data *data = mixed_calloc(1, sizeof(struct space_mixer_data));
   if(!data){
     mixed_err(MIXED_OUT_OF_MEMORY);
     return 0;
   }
 
-  // These factors might need tweaking for efficiency/quality.
-  if(!make_pitch_data(2048, 4, samplerate, &data->pitch_data)){
-    mixed_free(data);
-    return 0;
-  }
+  make_columns(SPACE_COLUMNS, &data->sources);
+
 
   data->direction[2] = 1.0;      // Facing in Z+ direction
   data->up[1] = 1.0;             // OpenGL-like. Y+ is up.
@@ -564,6 +1203,8 @@ MIXED_EXPORT int mixed_make_segment_space_mixer(uint32_t samplerate, struct mixe
   data->rolloff = 0.5;
   data->attenuation = attenuation_exponential;
   data->volume = 1.0;
+  data->layout = MIXED_SPACE_STEREO;
+  data->channels = 2;
   
   segment->free = space_mixer_free;
   segment->info = space_mixer_info;
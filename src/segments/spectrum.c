@@ -0,0 +1,349 @@
+#include "../internal.h"
+
+// Spectra are published seqlock style: the frame count says which of
+// the two result arrays was completed last, and the mix only ever
+// writes into the other one. A reader copies the last one and checks
+// that no new frame was started on it in the meantime.
+//
+// A new window is handed to the mix through next_window. dirty is
+// WINDOW_PENDING while it waits there and WINDOW_TAKEN while the mix
+// copies it, during which the setter must not write to it.
+#define WINDOW_IDLE 0
+#define WINDOW_PENDING 1
+#define WINDOW_TAKEN 2
+
+struct spectrum_segment_data{
+  struct mixed_buffer *in;
+  struct mixed_buffer *out;
+  struct fft_real fft;
+  float *fifo;
+  float *frame;
+  float *window;
+  float *next_window;
+  float *re;
+  float *im;
+  float *results[2];
+  uint64_t frames;
+  uint32_t framesize;
+  uint32_t filled;
+  uint32_t hop;
+  uint32_t samplerate;
+  float overlap;
+  float scale;
+  float next_scale;
+  enum mixed_window_type window_type;
+  char dirty;
+};
+
+static void free_spectrum_data(struct spectrum_segment_data *data){
+  if(data->fifo) mixed_free(data->fifo);
+  free_fft_real(&data->fft);
+  mixed_free(data);
+}
+
+// Fills in a periodic window and returns the scale that turns the sum
+// of a bin into the amplitude of a sine.
+static float spectrum_window(enum mixed_window_type type, uint32_t size, float *window){
+  double sum = 0.0;
+  for(uint32_t k=0; k<size; ++k){
+    double x = 2.0*M_PI*k/size;
+    switch(type){
+    case MIXED_HANN_WINDOW: window[k] = 0.5 - 0.5*cos(x); break;
+    case MIXED_HAMMING_WINDOW: window[k] = 0.54 - 0.46*cos(x); break;
+    case MIXED_BLACKMAN_WINDOW: window[k] = 0.42 - 0.5*cos(x) + 0.08*cos(2.0*x); break;
+    default: window[k] = 1.0f; break;
+    }
+    sum += window[k];
+  }
+  return (float)(2.0 / sum);
+}
+
+VECTORIZE static void spectrum_apply_window(const float *restrict in, const float *restrict window, float *restrict out, uint32_t samples){
+  for(uint32_t k=0; k<samples; ++k)
+    out[k] = in[k] * window[k];
+}
+
+VECTORIZE static void spectrum_magnitudes(const float *restrict re, const float *restrict im, float *restrict out, float scale, uint32_t bins){
+  for(uint32_t k=0; k<bins; ++k)
+    out[k] = sqrtf(re[k]*re[k] + im[k]*im[k]) * scale;
+}
+
+static void spectrum_frame(struct spectrum_segment_data *data){
+  uint32_t bins = data->framesize/2+1;
+  uint64_t frames = data->frames;
+  float *result = data->results[frames & 1];
+  // The previous count bump handed this array back to us. None of the
+  // writes below may become visible before it, or a reader could copy
+  // them and still find the count it started with.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  spectrum_apply_window(data->fifo, data->window, data->frame, data->framesize);
+  fft_real_forward(data->frame, data->re, data->im, &data->fft);
+  spectrum_magnitudes(data->re, data->im, result, data->scale, bins);
+  // The edge bins have no mirror image to share their energy with.
+  result[0] *= 0.5f;
+  result[bins-1] *= 0.5f;
+  __atomic_store_n(&data->frames, frames+1, __ATOMIC_RELEASE);
+}
+
+static void spectrum_analyse(float *in, uint32_t samples, struct spectrum_segment_data *data){
+  if(atomic_cas(data->dirty, WINDOW_PENDING, WINDOW_TAKEN)){
+    memcpy(data->window, data->next_window, data->framesize*sizeof(float));
+    data->scale = data->next_scale;
+    atomic_write(data->dirty, WINDOW_IDLE);
+  }
+  uint32_t hop = atomic_read(data->hop);
+  uint32_t offset = 0;
+  while(offset < samples){
+    uint32_t take = MIN(samples - offset, data->framesize - data->filled);
+    memcpy(data->fifo + data->filled, in + offset, take*sizeof(float));
+    data->filled += take;
+    offset += take;
+    if(data->filled == data->framesize){
+      spectrum_frame(data);
+      data->filled = data->framesize - hop;
+      memmove(data->fifo, data->fifo + hop, data->filled*sizeof(float));
+    }
+  }
+}
+
+static int spectrum_read(struct mixed_spectrum *spectrum, struct spectrum_segment_data *data){
+  uint32_t bins = MIN(spectrum->bins, data->framesize/2+1);
+  for(;;){
+    uint64_t frames = __atomic_load_n(&data->frames, __ATOMIC_ACQUIRE);
+    if(frames == 0){
+      spectrum->bins = 0;
+      spectrum->frames = 0;
+      return 1;
+    }
+    memcpy(spectrum->magnitudes, data->results[(frames-1) & 1], bins*sizeof(float));
+    // Read the count again after the copy. If it moved, the mix may
+    // have started writing over what we copied, so take the new one.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&data->frames, __ATOMIC_RELAXED) == frames){
+      spectrum->bins = bins;
+      spectrum->frames = frames;
+      return 1;
+    }
+  }
+}
+
+int spectrum_segment_free(struct mixed_segment *segment){
+  if(segment->data)
+    free_spectrum_data((struct spectrum_segment_data *)segment->data);
+  segment->data = 0;
+  return 1;
+}
+
+int spectrum_segment_start(struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+  if(data->in == 0 || data->out == 0){
+    mixed_err(MIXED_BUFFER_MISSING);
+    return 0;
+  }
+  data->filled = 0;
+  return 1;
+}
+
+int spectrum_segment_set_in(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location == 0){
+      data->in = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int spectrum_segment_set_out(uint32_t field, uint32_t location, void *buffer, struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+
+  switch(field){
+  case MIXED_BUFFER:
+    if(location == 0){
+      data->out = (struct mixed_buffer *)buffer;
+      return 1;
+    }
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+}
+
+int spectrum_segment_mix(struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+  uint32_t samples = UINT32_MAX;
+  float *in, *out;
+
+  mixed_buffer_request_read(&in, &samples, data->in);
+  if(data->in != data->out)
+    mixed_buffer_request_write(&out, &samples, data->out);
+  spectrum_analyse(in, samples, data);
+  if(data->in != data->out){
+    int silent = mixed_buffer_is_silent(data->in);
+    memcpy(out, in, samples*sizeof(float));
+    mixed_buffer_finish_read(samples, data->in);
+    if(silent)
+      mixed_buffer_finish_write_silence(samples, data->out);
+    else
+      mixed_buffer_finish_write(samples, data->out);
+  }
+  return 1;
+}
+
+int spectrum_segment_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  IGNORE(segment);
+
+  info->name = "spectrum";
+  info->description = "Analyses the frequency spectrum of the signal passing through.";
+  info->flags = MIXED_INPLACE;
+  info->min_inputs = 1;
+  info->max_inputs = 1;
+  info->outputs = 1;
+
+  struct mixed_segment_field_info *field = info->fields;
+  set_info_field(field++, MIXED_BUFFER,
+                 MIXED_BUFFER_POINTER, 1, MIXED_IN | MIXED_OUT | MIXED_SET,
+                 "The buffer for audio data attached to the location.");
+
+  set_info_field(field++, MIXED_SPECTRUM,
+                 MIXED_POINTER, 1, MIXED_SEGMENT | MIXED_GET,
+                 "The magnitudes of the last analysed frame.");
+
+  set_info_field(field++, MIXED_SPECTRUM_WINDOW,
+                 MIXED_WINDOW_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The window applied to each frame.");
+
+  set_info_field(field++, MIXED_SPECTRUM_OVERLAP,
+                 MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "How much consecutive frames overlap.");
+
+  set_info_field(field++, MIXED_SAMPLERATE,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The samplerate at which the segment operates.");
+
+  clear_info_field(field++);
+  return 1;
+}
+
+int spectrum_segment_get(uint32_t field, void *value, struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+  switch(field){
+  case MIXED_SPECTRUM: return spectrum_read((struct mixed_spectrum *)value, data);
+  case MIXED_SPECTRUM_WINDOW: *((enum mixed_window_type *)value) = data->window_type; break;
+  case MIXED_SPECTRUM_OVERLAP: *((float *)value) = data->overlap; break;
+  case MIXED_SAMPLERATE: *((uint32_t *)value) = data->samplerate; break;
+  default: mixed_err(MIXED_INVALID_FIELD); return 0;
+  }
+  return 1;
+}
+
+int spectrum_segment_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct spectrum_segment_data *data = (struct spectrum_segment_data *)segment->data;
+  switch(field){
+  case MIXED_SPECTRUM_WINDOW: {
+    enum mixed_window_type type = *(enum mixed_window_type *)value;
+    if(type < MIXED_RECTANGULAR_WINDOW || MIXED_BLACKMAN_WINDOW < type){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    // Applied at the start of the next mix, so the mix never sees a
+    // window that is only half computed. A window still pending is
+    // taken back, but one the mix is copying has to be waited out.
+    for(;;){
+      char state = atomic_read(data->dirty);
+      if(state == WINDOW_IDLE || (state == WINDOW_PENDING && atomic_cas(data->dirty, WINDOW_PENDING, WINDOW_IDLE)))
+        break;
+    }
+    data->next_scale = spectrum_window(type, data->framesize, data->next_window);
+    data->window_type = type;
+    atomic_write(data->dirty, WINDOW_PENDING);
+  } break;
+  case MIXED_SPECTRUM_OVERLAP: {
+    float overlap = *(float *)value;
+    if(overlap < 0.0f || 1.0f <= overlap){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->overlap = overlap;
+    atomic_write(data->hop, MAX(1, (uint32_t)(data->framesize * (1.0f - overlap))));
+  } break;
+  case MIXED_SAMPLERATE:
+    if(*(uint32_t *)value <= 0){
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
+    data->samplerate = *(uint32_t *)value;
+    break;
+  default:
+    mixed_err(MIXED_INVALID_FIELD);
+    return 0;
+  }
+  return 1;
+}
+
+MIXED_EXPORT int mixed_make_segment_spectrum(uint32_t framesize, uint32_t samplerate, struct mixed_segment *segment){
+  if(samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  struct spectrum_segment_data *data = mixed_calloc(1, sizeof(struct spectrum_segment_data));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  if(!make_fft_real(framesize, &data->fft)){
+    free_spectrum_data(data);
+    return 0;
+  }
+  // All the arrays share one allocation.
+  uint32_t bins = framesize/2+1;
+  float *mem = mixed_calloc(4*framesize + 4*bins, sizeof(float));
+  if(!mem){
+    free_spectrum_data(data);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  data->fifo = mem; mem += framesize;
+  data->frame = mem; mem += framesize;
+  data->window = mem; mem += framesize;
+  data->next_window = mem; mem += framesize;
+  data->re = mem; mem += bins;
+  data->im = mem; mem += bins;
+  data->results[0] = mem; mem += bins;
+  data->results[1] = mem;
+
+  data->framesize = framesize;
+  data->samplerate = samplerate;
+  data->window_type = MIXED_HANN_WINDOW;
+  data->scale = spectrum_window(data->window_type, framesize, data->window);
+  data->overlap = 0.5f;
+  data->hop = framesize/2;
+
+  segment->free = spectrum_segment_free;
+  segment->start = spectrum_segment_start;
+  segment->mix = spectrum_segment_mix;
+  segment->set_in = spectrum_segment_set_in;
+  segment->set_out = spectrum_segment_set_out;
+  segment->info = spectrum_segment_info;
+  segment->get = spectrum_segment_get;
+  segment->set = spectrum_segment_set;
+  segment->data = data;
+  return 1;
+}
+
+int __make_spectrum(void *args, struct mixed_segment *segment){
+  return mixed_make_segment_spectrum(ARG(uint32_t, 0), ARG(uint32_t, 1), segment);
+}
+
+REGISTER_SEGMENT(spectrum, __make_spectrum, 2, {
+    {.description = "framesize", .type = MIXED_UINT32},
+    {.description = "samplerate", .type = MIXED_UINT32}})
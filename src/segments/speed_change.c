@@ -6,6 +6,8 @@ struct speed_segment_data{
   struct mixed_buffer *in;
   struct mixed_buffer *out;
   SRC_STATE *resample_state;
+  // Used instead of the above for MIXED_POLYPHASE.
+  struct polyphase polyphase;
   double speed;
 };
 
@@ -15,6 +17,7 @@ int speed_segment_free(struct mixed_segment *segment){
     if(data->resample_state){
       src_delete(data->resample_state);
     }
+    free_polyphase(&data->polyphase);
     mixed_free(data);
   }
   segment->data = 0;
@@ -59,6 +62,8 @@ int speed_segment_start(struct mixed_segment *segment){
   struct speed_segment_data *data = (struct speed_segment_data *)segment->data;
   if(data->resample_state)
     src_reset(data->resample_state);
+  if(data->polyphase.bank)
+    polyphase_reset(&data->polyphase);
   if(data->out == 0 || data->in == 0){
     mixed_err(MIXED_BUFFER_MISSING);
     return 0;
@@ -75,7 +80,11 @@ int speed_segment_mix(struct mixed_segment *segment){
   src_data.src_ratio = 1.0 / data->speed;
   src_data.input_frames = in;
   src_data.output_frames = out;
-  if(src_data.input_frames && src_data.output_frames){
+  if(data->polyphase.bank){
+    polyphase_process((float **)&src_data.data_in, &in, &src_data.data_out, &out, &data->polyphase);
+    mixed_buffer_finish_read(in, data->in);
+    mixed_buffer_finish_write(out, data->out);
+  }else if(src_data.input_frames && src_data.output_frames){
     int e = src_process(data->resample_state, &src_data);
     if(e){
       printf("%s\n", src_strerror(e));
@@ -101,7 +110,8 @@ int speed_segment_info(struct mixed_segment_info *info, struct mixed_segment *se
   
   info->name = "speed";
   info->description = "Change the speed of the audio.";
-  info->flags = MIXED_INPLACE;
+  // The output length differs from the input length.
+  info->flags = 0;
   info->min_inputs = 1;
   info->max_inputs = 1;
   info->outputs = 1;
@@ -142,6 +152,14 @@ int speed_segment_set(uint32_t field, void *value, struct mixed_segment *segment
   switch(field){
   case MIXED_RESAMPLE_TYPE: {
     int error;
+    if(*(enum mixed_resample_type *)value == MIXED_POLYPHASE){
+      if(!make_polyphase(1.0 / data->speed, 1, &data->polyphase))
+        return 0;
+      if(data->resample_state)
+        src_delete(data->resample_state);
+      data->resample_state = 0;
+      return 1;
+    }
     SRC_STATE *new = src_new(*(enum mixed_resample_type *)value, 1, &error);
     if(!new) {
       mixed_err(MIXED_RESAMPLE_FAILED);
@@ -150,6 +168,7 @@ int speed_segment_set(uint32_t field, void *value, struct mixed_segment *segment
     if(data->resample_state)
       src_delete(data->resample_state);
     data->resample_state = new;
+    free_polyphase(&data->polyphase);
   }
     return 1;
   case MIXED_SPEED_FACTOR:
@@ -157,6 +176,9 @@ int speed_segment_set(uint32_t field, void *value, struct mixed_segment *segment
       mixed_err(MIXED_INVALID_VALUE);
       return 0;
     }
+    // The polyphase bank is tabulated for one ratio.
+    if(data->polyphase.bank && !make_polyphase(1.0 / *(double *)value, 1, &data->polyphase))
+      return 0;
     data->speed = *(double *)value;
     break;
   case MIXED_BYPASS:
@@ -6,8 +6,14 @@ struct volume_control_segment_data{
   struct mixed_buffer *out[2];
   float volume;
   float pan;
+  struct ramp gain[2];
 };
 
+static void volume_control_update(struct volume_control_segment_data *data){
+  ramp_to(data->volume * ((0.0<data->pan)?(1.0f-data->pan):1.0f), &data->gain[MIXED_LEFT]);
+  ramp_to(data->volume * ((data->pan<0.0)?(1.0f+data->pan):1.0f), &data->gain[MIXED_RIGHT]);
+}
+
 int volume_control_segment_free(struct mixed_segment *segment){
   if(segment->data)
     mixed_free(segment->data);
@@ -57,26 +63,82 @@ int volume_control_segment_set_out(uint32_t field, uint32_t location, void *buff
   }
 }
 
+// Both channels go through one loop, each with a gain that runs along
+// a line over the span, so ramps cost no more than constant gains.
+VECTORIZE static void volume_control_apply(float *li, float *ri, float *lo, float *ro, float l, float ls, float r, float rs, uint32_t samples){
+  for(uint32_t i=0; i<samples; ++i){
+    float k = (float)(i+1);
+    lo[i] = li[i]*(l+ls*k);
+    ro[i] = ri[i]*(r+rs*k);
+  }
+}
+
+// Applies the lines to a span where some buffers hold half floats, by
+// way of float scratch a block at a time.
+static void volume_control_apply_half(void **in, void **out, char *half, uint32_t pos, float l, float ls, float r, float rs, uint32_t samples){
+  float scratch[4][HALF_BLOCK];
+  for(uint32_t i=0; i<samples; i+=HALF_BLOCK){
+    uint32_t block = MIN(HALF_BLOCK, samples-i), at = pos+i;
+    float *li = half_view(in[0], half[0], at, block, scratch[0]);
+    float *ri = half_view(in[1], half[1], at, block, scratch[1]);
+    float *lo = half_target(out[0], half[2], at, scratch[2]);
+    float *ro = half_target(out[1], half[3], at, scratch[3]);
+    volume_control_apply(li, ri, lo, ro, l+ls*i, ls, r+rs*i, rs, block);
+    half_commit(out[0], half[2], at, block, lo);
+    half_commit(out[1], half[3], at, block, ro);
+  }
+}
+
 int volume_control_segment_mix(struct mixed_segment *segment){
   struct volume_control_segment_data *data = (struct volume_control_segment_data *)segment->data;
-  float lvolume = data->volume * ((0.0<data->pan)?(1.0f-data->pan):1.0f);
-  float rvolume = data->volume * ((data->pan<0.0)?(1.0f+data->pan):1.0f);
-  float *in, *out;
-  uint32_t samples;
-
-  mixed_buffer_request_read(&in, &samples, data->in[MIXED_LEFT]);
-  mixed_buffer_request_write(&out, &samples, data->out[MIXED_LEFT]);
-  for(uint32_t i=0; i<samples; ++i)
-    out[i] = in[i]*lvolume;
-  mixed_buffer_finish_read(samples, data->in[MIXED_LEFT]);
-  mixed_buffer_finish_write(samples, data->out[MIXED_LEFT]);
-  
-  mixed_buffer_request_read(&in, &samples, data->in[MIXED_RIGHT]);
-  mixed_buffer_request_write(&out, &samples, data->out[MIXED_RIGHT]);
-  for(uint32_t i=0; i<samples; ++i)
-    out[i] = in[i]*rvolume;
-  mixed_buffer_finish_read(samples, data->in[MIXED_RIGHT]);
-  mixed_buffer_finish_write(samples, data->out[MIXED_RIGHT]);
+  struct mixed_buffer *reads[2], *writes[2];
+  void *in[2], *out[2];
+  uint32_t samples = UINT32_MAX;
+
+  // Silence stays silent, only the ramps have to move on, each by as
+  // much as its own channel passed.
+  if(mixed_buffer_is_silent(data->in[0]) && mixed_buffer_is_silent(data->in[1])){
+    ramp_skip(buffer_pass_silence(data->in[0], data->out[0]), &data->gain[MIXED_LEFT]);
+    ramp_skip(buffer_pass_silence(data->in[1], data->out[1]), &data->gain[MIXED_RIGHT]);
+    return 1;
+  }
+
+  // A channel that works in place neither claims a write area nor
+  // consumes its input.
+  for(int c=0; c<2; ++c){
+    int inplace = (data->in[c] == data->out[c]);
+    reads[c] = inplace? 0 : data->in[c];
+    writes[c] = inplace? 0 : data->out[c];
+  }
+  buffers_request_read_any(2, data->in, in, &samples);
+  buffers_request_write_any(2, writes, out, &samples);
+  for(int c=0; c<2; ++c){
+    if(!writes[c]) out[c] = in[c];
+  }
+  char half[4] = {data->in[0]->is_half, data->in[1]->is_half, data->out[0]->is_half, data->out[1]->is_half};
+  char any_half = half[0] | half[1] | half[2] | half[3];
+
+  for(uint32_t i=0; i<samples; ){
+    struct ramp *left = &data->gain[MIXED_LEFT], *right = &data->gain[MIXED_RIGHT];
+    uint32_t span = ramp_span(ramp_span(samples-i, left), right);
+    float l, ls, r, rs;
+    ramp_take(span, &l, &ls, left);
+    ramp_take(span, &r, &rs, right);
+    if(any_half)
+      volume_control_apply_half(in, out, half, i, l, ls, r, rs, span);
+    else
+      volume_control_apply((float *)in[0]+i, (float *)in[1]+i, (float *)out[0]+i, (float *)out[1]+i, l, ls, r, rs, span);
+    i += span;
+  }
+
+  for(int c=0; c<2; ++c){
+    if(!writes[c]) continue;
+    if(mixed_buffer_is_silent(data->in[c]))
+      mixed_buffer_finish_write_silence(samples, writes[c]);
+    else
+      mixed_buffer_finish_write(samples, writes[c]);
+  }
+  mixed_buffers_finish_read(2, reads, samples);
   return 1;
 }
 
@@ -110,6 +172,14 @@ int volume_control_segment_info(struct mixed_segment_info *info, struct mixed_se
                  MIXED_FLOAT, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "The left/right stereo panning.");
 
+  set_info_field(field++, MIXED_RAMP_DURATION,
+                 MIXED_UINT32, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The number of samples over which volume and pan changes are spread.");
+
+  set_info_field(field++, MIXED_RAMP_TYPE,
+                 MIXED_RAMP_TYPE_ENUM, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
+                 "The shape of the volume and pan ramps.");
+
   set_info_field(field++, MIXED_BYPASS,
                  MIXED_BOOL, 1, MIXED_SEGMENT | MIXED_SET | MIXED_GET,
                  "Bypass the segment's processing.");
@@ -123,6 +193,8 @@ int volume_control_segment_get(uint32_t field, void *value, struct mixed_segment
   switch(field){
   case MIXED_VOLUME: *((float *)value) = data->volume; break;
   case MIXED_VOLUME_CONTROL_PAN: *((float *)value) = data->pan; break;
+  case MIXED_RAMP_DURATION: *((uint32_t *)value) = data->gain[MIXED_LEFT].duration; break;
+  case MIXED_RAMP_TYPE: *((enum mixed_ramp_type *)value) = data->gain[MIXED_LEFT].type; break;
   case MIXED_BYPASS: *((bool *)value) = (segment->mix == volume_control_segment_mix_bypass); break;
   default: mixed_err(MIXED_INVALID_FIELD); return 0;
   }
@@ -138,6 +210,7 @@ int volume_control_segment_set(uint32_t field, void *value, struct mixed_segment
       return 0;
     }
     data->volume = *(float *)value;
+    volume_control_update(data);
     break;
   case MIXED_VOLUME_CONTROL_PAN: 
     if(*(float *)value < -1.0 ||
@@ -146,6 +219,23 @@ int volume_control_segment_set(uint32_t field, void *value, struct mixed_segment
       return 0;
     }
     data->pan = *(float *)value;
+    volume_control_update(data);
+    break;
+  case MIXED_RAMP_DURATION:
+    data->gain[MIXED_LEFT].duration = *(uint32_t *)value;
+    data->gain[MIXED_RIGHT].duration = *(uint32_t *)value;
+    break;
+  case MIXED_RAMP_TYPE:
+    switch(*(enum mixed_ramp_type *)value){
+    case MIXED_LINEAR_RAMP:
+    case MIXED_EXPONENTIAL_RAMP:
+      data->gain[MIXED_LEFT].type = *(enum mixed_ramp_type *)value;
+      data->gain[MIXED_RIGHT].type = *(enum mixed_ramp_type *)value;
+      break;
+    default:
+      mixed_err(MIXED_INVALID_VALUE);
+      return 0;
+    }
     break;
   case MIXED_BYPASS:
     if(*(bool *)value){
@@ -170,6 +260,8 @@ MIXED_EXPORT int mixed_make_segment_volume_control(float volume, float pan, stru
 
   data->volume = volume;
   data->pan = pan;
+  ramp_init(volume * ((0.0<pan)?(1.0f-pan):1.0f), &data->gain[MIXED_LEFT]);
+  ramp_init(volume * ((pan<0.0)?(1.0f+pan):1.0f), &data->gain[MIXED_RIGHT]);
   
   segment->free = volume_control_segment_free;
   segment->start = volume_control_segment_start;
@@ -0,0 +1,318 @@
+#include "internal.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+// How long an idle worker sleeps before it looks at the packs again.
+#define STREAMER_PERIOD_NS 2000000
+
+struct stream{
+  struct mixed_pack *pack;
+  uint32_t watermark;
+  int priority;
+  mixed_stream_decoder decoder;
+  void *user;
+  char busy;
+  char done;
+  char stalled;
+};
+
+struct streamer{
+  struct stream **streams;
+  uint32_t count;
+  uint32_t size;
+  char stop;
+#ifndef _WIN32
+  pthread_t *threads;
+  uint32_t thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+#endif
+};
+
+static inline void streamer_lock(struct streamer *data){
+#ifndef _WIN32
+  pthread_mutex_lock(&data->lock);
+#else
+  IGNORE(data);
+#endif
+}
+
+static inline void streamer_unlock(struct streamer *data){
+#ifndef _WIN32
+  pthread_mutex_unlock(&data->lock);
+#else
+  IGNORE(data);
+#endif
+}
+
+static inline uint32_t stream_level(struct stream *stream){
+  return mixed_pack_available_read(stream->pack);
+}
+
+// Picks the stream that most urgently needs data: the highest
+// priority first, and among those the one that is the emptiest
+// relative to its watermark. Must be called with the lock held.
+static struct stream *streamer_next(struct streamer *data){
+  struct stream *best = 0;
+  uint64_t best_fill = 0;
+  for(uint32_t i=0; i<data->count; ++i){
+    struct stream *stream = data->streams[i];
+    if(stream->busy || stream->done || stream->stalled) continue;
+    uint32_t level = stream_level(stream);
+    if(stream->watermark <= level) continue;
+    uint64_t fill = ((uint64_t)level << 16) / stream->watermark;
+    if(!best || best->priority < stream->priority
+       || (best->priority == stream->priority && fill < best_fill)){
+      best = stream;
+      best_fill = fill;
+    }
+  }
+  return best;
+}
+
+// Runs the decoder until the pack is topped up past its watermark,
+// is full, or the decoder has nothing more to give. A stream whose
+// decoder gives nothing is left alone until the next period.
+static void stream_fill(struct stream *stream){
+  uint32_t total = 0;
+  while(stream_level(stream) < stream->watermark){
+    void *area;
+    uint32_t size = UINT32_MAX;
+    if(!mixed_pack_request_write(&area, &size, stream->pack) || size == 0)
+      break;
+    uint32_t written = size;
+    int more = stream->decoder(area, &written, stream->user);
+    if(size < written) written = size;
+    mixed_pack_finish_write(written, stream->pack);
+    total += written;
+    if(!more){
+      stream->done = 1;
+      break;
+    }
+    if(written == 0) break;
+  }
+  if(total == 0) stream->stalled = 1;
+}
+
+// Must be called with the lock held.
+static void streamer_unstall(struct streamer *data){
+  for(uint32_t i=0; i<data->count; ++i)
+    data->streams[i]->stalled = 0;
+}
+
+// Fills the next stream in line. Must be called with the lock held,
+// which is released while the decoder runs.
+static int streamer_step(struct streamer *data){
+  struct stream *stream = streamer_next(data);
+  if(!stream) return 0;
+  stream->busy = 1;
+  streamer_unlock(data);
+  stream_fill(stream);
+  streamer_lock(data);
+  stream->busy = 0;
+#ifndef _WIN32
+  pthread_cond_broadcast(&data->idle);
+#endif
+  return 1;
+}
+
+#ifndef _WIN32
+static void *streamer_worker(void *arg){
+  struct streamer *data = (struct streamer *)arg;
+  pthread_mutex_lock(&data->lock);
+  while(!data->stop){
+    if(!streamer_step(data)){
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += STREAMER_PERIOD_NS;
+      if(1000000000 <= ts.tv_nsec){
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&data->wake, &data->lock, &ts);
+      streamer_unstall(data);
+    }
+  }
+  pthread_mutex_unlock(&data->lock);
+  return 0;
+}
+#endif
+
+static void free_streamer_data(struct streamer *data){
+#ifndef _WIN32
+  streamer_lock(data);
+  data->stop = 1;
+  pthread_cond_broadcast(&data->wake);
+  streamer_unlock(data);
+  for(uint32_t i=0; i<data->thread_count; ++i)
+    pthread_join(data->threads[i], 0);
+  pthread_cond_destroy(&data->idle);
+  pthread_cond_destroy(&data->wake);
+  pthread_mutex_destroy(&data->lock);
+  if(data->threads) mixed_free(data->threads);
+#endif
+  for(uint32_t i=0; i<data->count; ++i)
+    mixed_free(data->streams[i]);
+  if(data->streams) mixed_free(data->streams);
+  mixed_free(data);
+}
+
+MIXED_EXPORT int mixed_make_streamer(uint32_t threads, struct mixed_streamer *streamer){
+  mixed_err(MIXED_NO_ERROR);
+#ifdef _WIN32
+  if(0 < threads){
+    mixed_err(MIXED_NOT_IMPLEMENTED);
+    return 0;
+  }
+#endif
+  struct streamer *data = mixed_calloc(1, sizeof(struct streamer));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+#ifndef _WIN32
+  pthread_mutex_init(&data->lock, 0);
+  pthread_cond_init(&data->wake, 0);
+  pthread_cond_init(&data->idle, 0);
+  if(0 < threads){
+    data->threads = mixed_calloc(threads, sizeof(pthread_t));
+    if(!data->threads){
+      free_streamer_data(data);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+  }
+  for(; data->thread_count<threads; ++data->thread_count){
+    if(pthread_create(&data->threads[data->thread_count], 0, streamer_worker, data) != 0){
+      free_streamer_data(data);
+      mixed_err(MIXED_THREAD_FAILED);
+      return 0;
+    }
+  }
+#endif
+  streamer->_data = data;
+  return 1;
+}
+
+MIXED_EXPORT void mixed_free_streamer(struct mixed_streamer *streamer){
+  if(streamer->_data)
+    free_streamer_data((struct streamer *)streamer->_data);
+  streamer->_data = 0;
+}
+
+MIXED_EXPORT int mixed_streamer_add(struct mixed_pack *pack, uint32_t watermark, int priority, mixed_stream_decoder decoder, void *user, struct mixed_streamer *streamer){
+  struct streamer *data = (struct streamer *)streamer->_data;
+  mixed_err(MIXED_NO_ERROR);
+  uint32_t framesize = pack_frame_bytes(pack);
+  if(!decoder || framesize == 0 || pack->size < (uint64_t)watermark*framesize){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+#ifndef _WIN32
+  if(0 < data->thread_count && !pack->_shared){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+#endif
+  struct stream *stream = mixed_calloc(1, sizeof(struct stream));
+  if(!stream){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  stream->pack = pack;
+  stream->watermark = watermark*framesize;
+  stream->priority = priority;
+  stream->decoder = decoder;
+  stream->user = user;
+
+  streamer_lock(data);
+  if(data->count == data->size){
+    uint32_t size = (data->size)? data->size*2 : 8;
+    struct stream **streams = mixed_calloc(size, sizeof(struct stream *));
+    if(!streams){
+      streamer_unlock(data);
+      mixed_free(stream);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    if(data->streams){
+      memcpy(streams, data->streams, data->count*sizeof(struct stream *));
+      mixed_free(data->streams);
+    }
+    data->streams = streams;
+    data->size = size;
+  }
+  data->streams[data->count++] = stream;
+#ifndef _WIN32
+  pthread_cond_signal(&data->wake);
+#endif
+  streamer_unlock(data);
+  return 1;
+}
+
+static struct stream *streamer_find(struct mixed_pack *pack, uint32_t *index, struct streamer *data){
+  for(uint32_t i=0; i<data->count; ++i){
+    if(data->streams[i]->pack == pack){
+      *index = i;
+      return data->streams[i];
+    }
+  }
+  return 0;
+}
+
+MIXED_EXPORT int mixed_streamer_remove(struct mixed_pack *pack, struct mixed_streamer *streamer){
+  struct streamer *data = (struct streamer *)streamer->_data;
+  uint32_t i = 0;
+  mixed_err(MIXED_NO_ERROR);
+  streamer_lock(data);
+  struct stream *stream = streamer_find(pack, &i, data);
+  if(!stream){
+    streamer_unlock(data);
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+#ifndef _WIN32
+  // Wait for a worker still filling the pack to let go of it. Other
+  // removals may shuffle the list meanwhile, so look it up again.
+  while(stream->busy)
+    pthread_cond_wait(&data->idle, &data->lock);
+  streamer_find(pack, &i, data);
+#endif
+  data->streams[i] = data->streams[--data->count];
+  streamer_unlock(data);
+  mixed_free(stream);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_streamer_done(struct mixed_pack *pack, struct mixed_streamer *streamer){
+  struct streamer *data = (struct streamer *)streamer->_data;
+  uint32_t i = 0;
+  streamer_lock(data);
+  struct stream *stream = streamer_find(pack, &i, data);
+  int done = (stream)? stream->done : 0;
+  streamer_unlock(data);
+  return done;
+}
+
+MIXED_EXPORT int mixed_streamer_update(struct mixed_streamer *streamer){
+  struct streamer *data = (struct streamer *)streamer->_data;
+  mixed_err(MIXED_NO_ERROR);
+  streamer_lock(data);
+  streamer_unstall(data);
+  while(streamer_step(data));
+  streamer_unlock(data);
+  return 1;
+}
+
+MIXED_EXPORT void mixed_streamer_wake(struct mixed_streamer *streamer){
+#ifndef _WIN32
+  struct streamer *data = (struct streamer *)streamer->_data;
+  pthread_cond_signal(&data->wake);
+#else
+  IGNORE(streamer);
+#endif
+}
@@ -0,0 +1,170 @@
+#include "internal.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+
+struct thread_pool{
+  pthread_t *threads;
+  uint32_t count;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  uint32_t generation;
+  uint32_t active;
+  char stop;
+  int (*function)(void *arg, uint32_t index);
+  void *arg;
+  uint32_t tasks;
+  uint32_t next;
+  uint32_t pending;
+  uint32_t failed;
+};
+
+// Every participating thread, including the caller, claims the next
+// unclaimed task until none are left. This keeps all threads busy when
+// tasks vary in cost without needing per-thread queues.
+static void thread_pool_drain(struct thread_pool *pool){
+  uint32_t i;
+  while((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_SEQ_CST)) < pool->tasks){
+    if(!pool->function(pool->arg, i))
+      atomic_write(pool->failed, 1);
+    if(__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0){
+      pthread_mutex_lock(&pool->lock);
+      pthread_cond_broadcast(&pool->done);
+      pthread_mutex_unlock(&pool->lock);
+    }
+  }
+}
+
+static void *thread_pool_worker(void *arg){
+  struct thread_pool *pool = (struct thread_pool *)arg;
+  uint32_t seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for(;;){
+    while(pool->generation == seen && !pool->stop)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    if(pool->stop) break;
+    seen = pool->generation;
+    pool->active++;
+    pthread_mutex_unlock(&pool->lock);
+    thread_pool_drain(pool);
+    pthread_mutex_lock(&pool->lock);
+    if(--pool->active == 0)
+      pthread_cond_broadcast(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+struct thread_pool *make_thread_pool(uint32_t threads){
+  struct thread_pool *pool = mixed_calloc(1, sizeof(struct thread_pool));
+  if(!pool){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  pool->threads = mixed_calloc(threads, sizeof(pthread_t));
+  if(!pool->threads){
+    mixed_free(pool);
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->work, 0);
+  pthread_cond_init(&pool->done, 0);
+  for(; pool->count<threads; ++pool->count){
+    if(pthread_create(&pool->threads[pool->count], 0, thread_pool_worker, pool) != 0){
+      free_thread_pool(pool);
+      mixed_err(MIXED_THREAD_FAILED);
+      return 0;
+    }
+  }
+  return pool;
+}
+
+void free_thread_pool(struct thread_pool *pool){
+  if(!pool) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for(uint32_t i=0; i<pool->count; ++i){
+    pthread_join(pool->threads[i], 0);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  mixed_free(pool->threads);
+  mixed_free(pool);
+}
+
+uint32_t thread_pool_size(struct thread_pool *pool){
+  return (pool)? pool->count+1 : 1;
+}
+
+int thread_pool_run(struct thread_pool *pool, uint32_t tasks, int (*function)(void *arg, uint32_t index), void *arg){
+  if(!pool || tasks <= 1){
+    for(uint32_t i=0; i<tasks; ++i){
+      if(!function(arg, i)) return 0;
+    }
+    return 1;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  // Stragglers from the last run must be out before we reset the counters.
+  while(pool->active)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pool->function = function;
+  pool->arg = arg;
+  pool->tasks = tasks;
+  atomic_write(pool->failed, 0);
+  atomic_write(pool->pending, tasks);
+  atomic_write(pool->next, 0);
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  thread_pool_drain(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  while(atomic_read(pool->pending) || pool->active)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  return !atomic_read(pool->failed);
+}
+
+#else
+
+// Without a threading backend the pool is serial and runs every job
+// inline on the calling thread, so that callers need not care.
+struct thread_pool{
+  uint32_t count;
+};
+
+struct thread_pool *make_thread_pool(uint32_t threads){
+  struct thread_pool *pool = mixed_calloc(1, sizeof(struct thread_pool));
+  if(!pool){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  pool->count = threads;
+  return pool;
+}
+
+void free_thread_pool(struct thread_pool *pool){
+  if(pool) mixed_free(pool);
+}
+
+uint32_t thread_pool_size(struct thread_pool *pool){
+  IGNORE(pool);
+  return 1;
+}
+
+int thread_pool_run(struct thread_pool *pool, uint32_t tasks, int (*function)(void *arg, uint32_t index), void *arg){
+  IGNORE(pool);
+  for(uint32_t i=0; i<tasks; ++i){
+    if(!function(arg, i)) return 0;
+  }
+  return 1;
+}
+
+#endif
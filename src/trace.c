@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include "internal.h"
+
+#define TRACE_THREADS 16
+
+struct trace_event{
+  uint64_t time;
+  const char *name;
+  const void *subject;
+  char phase;
+};
+
+// Every thread records into its own ring, so recording needs no
+// synchronisation beyond publishing the head. Once full, the oldest
+// events are overwritten to keep the most recent window. Segment
+// events leave the name empty, it is looked up when writing.
+struct trace_ring{
+  uint32_t thread;
+  uint64_t head;
+  struct trace_event events[];
+};
+
+// The rings are all allocated when tracing starts, and threads claim
+// the next one on their first event.
+struct trace_state{
+  uint32_t capacity;
+  uint32_t threads;
+  uint32_t generation;
+  struct trace_ring *rings[TRACE_THREADS];
+};
+
+struct trace_state *trace_state = 0;
+static uint32_t trace_generation = 0;
+static thread_local struct trace_ring *trace_local = 0;
+static thread_local uint32_t trace_local_generation = 0;
+
+static struct trace_ring *trace_ring(struct trace_state *state){
+  if(trace_local_generation == state->generation)
+    return trace_local;
+  // Threads beyond the rings we have go unrecorded.
+  uint32_t i = __atomic_fetch_add(&state->threads, 1, __ATOMIC_SEQ_CST);
+  trace_local = (i < TRACE_THREADS)? state->rings[i] : 0;
+  trace_local_generation = state->generation;
+  return trace_local;
+}
+
+static const char *trace_segment_name(struct mixed_segment *segment){
+  struct mixed_segment_info info = {0};
+  return (segment->info && segment->info(&info, segment) && info.name)? info.name : "segment";
+}
+
+void trace_event(char phase, const char *name, const void *subject){
+  struct trace_state *state = __atomic_load_n(&trace_state, __ATOMIC_ACQUIRE);
+  if(!state) return;
+  struct trace_ring *ring = trace_ring(state);
+  if(!ring) return;
+  struct trace_event *event = &ring->events[ring->head & (state->capacity-1)];
+  event->time = mixed_clock();
+  event->name = name;
+  event->subject = subject;
+  event->phase = phase;
+  __atomic_store_n(&ring->head, ring->head+1, __ATOMIC_RELEASE);
+}
+
+// A segment that goes away can no longer be asked for its name when
+// the trace is written, so we name its events now.
+void trace_forget(struct mixed_segment *segment){
+  struct trace_state *state = __atomic_load_n(&trace_state, __ATOMIC_ACQUIRE);
+  if(!state) return;
+  const char *name = 0;
+  uint32_t threads = MIN(atomic_read(state->threads), TRACE_THREADS);
+  for(uint32_t t=0; t<threads; ++t){
+    struct trace_ring *ring = state->rings[t];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t from = (state->capacity < head)? head - state->capacity : 0;
+    for(uint64_t i=from; i<head; ++i){
+      struct trace_event *event = &ring->events[i & (state->capacity-1)];
+      if(event->subject == segment && !event->name){
+        if(!name) name = trace_segment_name(segment);
+        event->name = name;
+      }
+    }
+  }
+}
+
+int trace_mix(struct mixed_segment *segment){
+  trace_event('B', 0, segment);
+  int result = (profile_table)? profile_mix(segment) : segment->mix(segment);
+  trace_event('E', 0, segment);
+  return result;
+}
+
+static void trace_write_string(FILE *file, const char *string){
+  fputc('"', file);
+  for(; *string; ++string){
+    if(*string == '"' || *string == '\\') fputc('\\', file);
+    if((unsigned char)*string < 0x20) continue;
+    fputc(*string, file);
+  }
+  fputc('"', file);
+}
+
+MIXED_EXPORT int mixed_trace_start(uint32_t events){
+  mixed_err(MIXED_NO_ERROR);
+  if(trace_state){
+    mixed_err(MIXED_SEGMENT_ALREADY_STARTED);
+    return 0;
+  }
+  uint32_t capacity = 16;
+  while(capacity < events) capacity *= 2;
+  struct trace_state *state = mixed_calloc(1, sizeof(struct trace_state));
+  if(!state){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  state->capacity = capacity;
+  for(uint32_t i=0; i<TRACE_THREADS; ++i){
+    state->rings[i] = mixed_calloc(1, sizeof(struct trace_ring) + capacity*sizeof(struct trace_event));
+    if(!state->rings[i]){
+      for(uint32_t j=0; j<i; ++j) mixed_free(state->rings[j]);
+      mixed_free(state);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    state->rings[i]->thread = i+1;
+  }
+  state->generation = __atomic_add_fetch(&trace_generation, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&trace_state, state, __ATOMIC_RELEASE);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_trace_end(){
+  mixed_err(MIXED_NO_ERROR);
+  struct trace_state *state = trace_state;
+  if(!state){
+    mixed_err(MIXED_SEGMENT_ALREADY_ENDED);
+    return 0;
+  }
+  __atomic_store_n(&trace_state, 0, __ATOMIC_RELEASE);
+  for(uint32_t i=0; i<TRACE_THREADS; ++i)
+    mixed_free(state->rings[i]);
+  mixed_free(state);
+  return 1;
+}
+
+MIXED_EXPORT int mixed_trace_write(const char *path){
+  struct trace_state *state = trace_state;
+  mixed_err(MIXED_NO_ERROR);
+  if(!state){
+    mixed_err(MIXED_NOT_INITIALIZED);
+    return 0;
+  }
+  FILE *file = fopen(path, "w");
+  if(!file){
+    mixed_err(MIXED_FILE_OPEN_FAILED);
+    return 0;
+  }
+  int first = 1;
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+  uint32_t threads = MIN(atomic_read(state->threads), TRACE_THREADS);
+  for(uint32_t t=0; t<threads; ++t){
+    struct trace_ring *ring = state->rings[t];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t from = (state->capacity < head)? head - state->capacity : 0;
+    for(uint64_t i=from; i<head; ++i){
+      struct trace_event *event = &ring->events[i & (state->capacity-1)];
+      fputs((first)? "\n{\"name\":" : ",\n{\"name\":", file);
+      first = 0;
+      trace_write_string(file, (event->name)? event->name : trace_segment_name((struct mixed_segment *)event->subject));
+      // Chrome wants microseconds. The clock is the monotonic system
+      // clock, so the times line up with other traces taken on it.
+      fprintf(file, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u",
+              event->phase, (unsigned long long)(event->time / 1000), (unsigned)(event->time % 1000), ring->thread);
+      if(event->phase == 'i')
+        fprintf(file, ",\"s\":\"t\",\"args\":{\"subject\":\"%p\"}", event->subject);
+      fputc('}', file);
+    }
+  }
+  fputs("\n]}\n", file);
+  if(fclose(file) != 0){
+    mixed_err(MIXED_FILE_OPEN_FAILED);
+    return 0;
+  }
+  return 1;
+}
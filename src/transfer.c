@@ -16,23 +16,37 @@ DEF_MIXED_TRANSFER_SAMPLE_FROM(uint32, uint32_t)
 DEF_MIXED_TRANSFER_SAMPLE_FROM(float, float)
 DEF_MIXED_TRANSFER_SAMPLE_FROM(double, double)
 
-extern inline void mixed_transfer_sample_from_int24(void *in, uint32_t is, float *out, uint32_t os, float volume) {
-  // Read MSB as int8, others as uint8
-  int32_t sample = (((int8_t *)in)[3*is+2] << 16) + \
-                  (((uint8_t *)in)[3*is+1] << 8 ) + \
-                  (((uint8_t *)in)[3*is]);
-  out[os] = mixed_from_int24(sample) * volume;
-}
+DEF_MIXED_TRANSFER_SAMPLE_FROM(int8_fast, int8_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(uint8_fast, uint8_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(int16_fast, int16_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(uint16_fast, uint16_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(int32_fast, int32_t)
+DEF_MIXED_TRANSFER_SAMPLE_FROM(uint32_fast, uint32_t)
 
-extern inline void mixed_transfer_sample_from_uint24(void *in, uint32_t is, float *out, uint32_t os, float volume) {
-  uint8_t *data = (uint8_t *)in;
-  uint24_t sample = (data[3*is+2] << 16) + (data[3*is+1] << 8) + (data[3*is]);
-  out[os] = mixed_from_uint24(sample) * volume;
-}
+// Read MSB as int8, others as uint8
+#define DEF_MIXED_TRANSFER_SAMPLE_FROM_INT24(name)                      \
+  extern inline void mixed_transfer_sample_from_##name(void *in, uint32_t is, float *out, uint32_t os, float volume) { \
+    int32_t sample = (((int8_t *)in)[3*is+2] << 16) +                   \
+      (((uint8_t *)in)[3*is+1] << 8 ) +                                 \
+      (((uint8_t *)in)[3*is]);                                          \
+    out[os] = mixed_from_##name(sample) * volume;                       \
+  }
+
+#define DEF_MIXED_TRANSFER_SAMPLE_FROM_UINT24(name)                     \
+  extern inline void mixed_transfer_sample_from_##name(void *in, uint32_t is, float *out, uint32_t os, float volume) { \
+    uint8_t *data = (uint8_t *)in;                                      \
+    uint24_t sample = (data[3*is+2] << 16) + (data[3*is+1] << 8) + (data[3*is]); \
+    out[os] = mixed_from_##name(sample) * volume;                       \
+  }
+
+DEF_MIXED_TRANSFER_SAMPLE_FROM_INT24(int24)
+DEF_MIXED_TRANSFER_SAMPLE_FROM_INT24(int24_fast)
+DEF_MIXED_TRANSFER_SAMPLE_FROM_UINT24(uint24)
+DEF_MIXED_TRANSFER_SAMPLE_FROM_UINT24(uint24_fast)
 
 #define DEF_MIXED_TRANSFER_SAMPLE_TO(name, datatype)                    \
   static inline void mixed_transfer_sample_to_##name(float *in, uint32_t is, void *out, uint32_t os, float volume){ \
-    ((datatype *)out)[os] = mixed_to_##name(in[is]) * volume;           \
+    ((datatype *)out)[os] = mixed_to_##name(in[is] * volume);           \
   }
 
 DEF_MIXED_TRANSFER_SAMPLE_TO(int8, int8_t)
@@ -58,32 +72,51 @@ extern inline void mixed_transfer_sample_to_uint24(float *in, uint32_t is, void
   ((uint8_t *)out)[3*os+0] = (sample >>  0) & 0xFF;
 }
 
+// The dithered encoders carry the noise generator's state along.
+static inline void mixed_transfer_sample_to_int16_dither(float *in, uint32_t is, void *out, uint32_t os, float volume, uint32_t *state){
+  ((int16_t *)out)[os] = mixed_to_int16_dither(in[is] * volume, state);
+}
+
+static inline void mixed_transfer_sample_to_int24_dither(float *in, uint32_t is, void *out, uint32_t os, float volume, uint32_t *state){
+  int24_t sample = mixed_to_int24_dither(in[is] * volume, state);
+  ((uint8_t *)out)[3*os+2] = (sample >> 16) & 0xFF;
+  ((uint8_t *)out)[3*os+1] = (sample >>  8) & 0xFF;
+  ((uint8_t *)out)[3*os+0] = (sample >>  0) & 0xFF;
+}
+
 //// Array transfer functions
+// Volume changes are spread linearly over the whole block, so every
+// channel reaches the target on the same frame.
 #define DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(datatype)             \
   VECTORIZE float mixed_transfer_array_from_alternating_##datatype(void *in, float *out, uint8_t stride, uint32_t samples, float volume, float target_volume) { \
     if(samples == 0) return volume;                                     \
-    mixed_transfer_sample_from_##datatype(in, 0, out, 0, volume);       \
-    for(uint32_t sample=1; sample<samples; ++sample){                   \
-      mixed_transfer_sample_from_##datatype(in, sample*stride, out, sample, volume); \
-      if(out[sample-1] * out[sample] < 0.0f) {                          \
-        volume = target_volume;                                         \
+    if(volume == target_volume){                                        \
+      for(uint32_t sample=0; sample<samples; ++sample){                 \
         mixed_transfer_sample_from_##datatype(in, sample*stride, out, sample, volume); \
       }                                                                 \
+    }else{                                                              \
+      float step = (target_volume - volume) / samples;                  \
+      for(uint32_t sample=0; sample<samples; ++sample){                 \
+        mixed_transfer_sample_from_##datatype(in, sample*stride, out, sample, volume + step*(sample+1)); \
+      }                                                                 \
     }                                                                   \
-    return volume;                                                      \
+    return target_volume;                                               \
   }
 
 #define DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(datatype)               \
   VECTORIZE static inline float mixed_transfer_array_to_alternating_##datatype(float *in, void *out, uint8_t stride, uint32_t samples, float volume, float target_volume){ \
     if(samples == 0) return volume;                                     \
-    mixed_transfer_sample_to_##datatype(in, 0, out, 0, volume);         \
-    for(uint32_t sample=1; sample<samples; ++sample){                   \
-      if(in[sample-1] * in[sample] < 0.0f){                             \
-        volume = target_volume;                                         \
+    if(volume == target_volume){                                        \
+      for(uint32_t sample=0; sample<samples; ++sample){                 \
+        mixed_transfer_sample_to_##datatype(in, sample, out, sample*stride, volume); \
+      }                                                                 \
+    }else{                                                              \
+      float step = (target_volume - volume) / samples;                  \
+      for(uint32_t sample=0; sample<samples; ++sample){                 \
+        mixed_transfer_sample_to_##datatype(in, sample, out, sample*stride, volume + step*(sample+1)); \
       }                                                                 \
-      mixed_transfer_sample_to_##datatype(in, sample, out, sample*stride, volume); \
     }                                                                   \
-    return volume;                                                      \
+    return target_volume;                                               \
   }
 
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int8)
@@ -96,6 +129,14 @@ DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int32)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint32)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(float)
 DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(double)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int8_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint8_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int16_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint16_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int24_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint24_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(int32_fast)
+DEF_MIXED_TRANSFER_ARRAY_FROM_ALTERNATING(uint32_fast)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(int8)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(uint8)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(int16)
@@ -107,8 +148,33 @@ DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(uint32)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(float)
 DEF_MIXED_TRANSFER_ARRAY_TO_ALTERNATING(double)
 
+#define DEF_MIXED_TRANSFER_ARRAY_TO_DITHER(datatype)                    \
+  static float mixed_transfer_array_to_dither_##datatype(float *in, void *out, uint8_t stride, uint32_t samples, float volume, float target_volume, uint32_t *state){ \
+    if(samples == 0) return volume;                                     \
+    float step = (target_volume - volume) / samples;                    \
+    for(uint32_t sample=0; sample<samples; ++sample){                   \
+      mixed_transfer_sample_to_##datatype##_dither(in, sample, out, sample*stride, volume + step*(sample+1), state); \
+    }                                                                   \
+    return target_volume;                                               \
+  }
+
+DEF_MIXED_TRANSFER_ARRAY_TO_DITHER(int16)
+DEF_MIXED_TRANSFER_ARRAY_TO_DITHER(int24)
+
 //// Buffer transfer functions
-static mixed_transfer_function_from transfer_array_functions_from[20] =
+// Frames per pass when converting one channel at a time. A chunk of a
+// wide pack stays in cache between channels, while the per-call setup
+// is still spread over enough frames not to matter.
+#define TRANSFER_CHUNK 1024
+
+// Kernels that handle all channels of a frame in one pass, by
+// encoding and channel count, if any.
+#define FUSED_CHANNELS 8
+static transfer_fused_from transfer_fused_functions_from[20][FUSED_CHANNELS+1] = {{0}};
+static transfer_fused_to transfer_fused_functions_to[20][FUSED_CHANNELS+1] = {{0}};
+static transfer_fused_from transfer_fused_fast_functions_from[20][FUSED_CHANNELS+1] = {{0}};
+
+static const mixed_transfer_function_from transfer_scalar_functions_from[20] =
   { mixed_transfer_array_from_alternating_int8,
     mixed_transfer_array_from_alternating_uint8,
     mixed_transfer_array_from_alternating_int16,
@@ -121,31 +187,69 @@ static mixed_transfer_function_from transfer_array_functions_from[20] =
     mixed_transfer_array_from_alternating_double,
   };
 
+static const mixed_transfer_function_from transfer_scalar_fast_functions_from[20] =
+  { mixed_transfer_array_from_alternating_int8_fast,
+    mixed_transfer_array_from_alternating_uint8_fast,
+    mixed_transfer_array_from_alternating_int16_fast,
+    mixed_transfer_array_from_alternating_uint16_fast,
+    mixed_transfer_array_from_alternating_int24_fast,
+    mixed_transfer_array_from_alternating_uint24_fast,
+    mixed_transfer_array_from_alternating_int32_fast,
+    mixed_transfer_array_from_alternating_uint32_fast,
+    mixed_transfer_array_from_alternating_float,
+    mixed_transfer_array_from_alternating_double,
+  };
+
+// The kernels in use, filled by transfer_dispatch.
+static mixed_transfer_function_from transfer_array_functions_from[20] = {0};
+static mixed_transfer_function_from transfer_fast_functions_from[20] = {0};
+
 MIXED_EXPORT mixed_transfer_function_from mixed_translator_from(enum mixed_encoding encoding){
   return transfer_array_functions_from[encoding-1];
 }
 
 VECTORIZE MIXED_EXPORT int mixed_buffer_from_pack(struct mixed_pack *in, struct mixed_buffer **outs, float *volume, float target_volume){
   channel_t channels = in->channels;
-  uint32_t frames_to_bytes = channels * mixed_samplesize(in->encoding);
+  uint32_t frames_to_bytes = pack_frame_bytes(in);
   uint32_t frames = UINT32_MAX;
   char *ind;
   float *outd[channels];
+  char half = 0;
 
   mixed_pack_request_read((void**)&ind, &frames, in);
   frames = frames / frames_to_bytes;
+  buffers_request_write_any(channels, outs, (void **)outd, &frames);
   for(uint32_t i=0; i<channels; ++i)
-    mixed_buffer_request_write(&outd[i], &frames, outs[i]);
+    half |= outs[i]->is_half;
 
   if(0 < frames){
-    mixed_transfer_function_from fun = transfer_array_functions_from[in->encoding-1];
-    uint8_t size = mixed_samplesize(in->encoding);
+    char fast = (in->flags & MIXED_FAST_CONVERSION) != 0;
+    transfer_fused_from fused = (channels <= FUSED_CHANNELS && !(in->flags & MIXED_PLANAR) && !half)
+      ? (fast? transfer_fused_fast_functions_from : transfer_fused_functions_from)[in->encoding-1][channels]
+      : 0;
+    mixed_transfer_function_from fun = (fast? transfer_fast_functions_from : transfer_array_functions_from)[in->encoding-1];
+    uint8_t stride = pack_stride(in);
     float vol = *volume;
-    // KLUDGE: this is not necessarily correct...
     *volume = target_volume;
-    for(int8_t c=0; c<channels; ++c){
-      fun(ind, outd[c], channels, frames, vol, target_volume);
-      ind += size;
+    if(fused){
+      fused(ind, outd, channels, frames, vol, target_volume);
+    }else{
+      // Convert a chunk of frames for all channels at a time, so that
+      // the later channels find the interleaved frames still in cache.
+      // Planar packs go through the same path with a stride of one.
+      // Half buffers take the chunk through a float scratch.
+      float scratch[half? TRANSFER_CHUNK : 1];
+      for(uint32_t start=0; start<frames; start+=TRANSFER_CHUNK){
+        uint32_t count = MIN(TRANSFER_CHUNK, frames-start);
+        float from = vol + (target_volume-vol)*start/frames;
+        float to = vol + (target_volume-vol)*(start+count)/frames;
+        char *chunk = ind + start*frames_to_bytes;
+        for(int8_t c=0; c<channels; ++c){
+          float *target = half_target(outd[c], outs[c]->is_half, start, scratch);
+          fun(chunk + pack_channel_offset(c, in), target, stride, count, from, to);
+          half_commit(outd[c], outs[c]->is_half, start, count, target);
+        }
+      }
     }
   }
 
@@ -156,7 +260,7 @@ VECTORIZE MIXED_EXPORT int mixed_buffer_from_pack(struct mixed_pack *in, struct
   return 1;
 }
 
-static mixed_transfer_function_to transfer_array_functions_to[20] =
+static const mixed_transfer_function_to transfer_scalar_functions_to[20] =
   { mixed_transfer_array_to_alternating_int8,
     mixed_transfer_array_to_alternating_uint8,
     mixed_transfer_array_to_alternating_int16,
@@ -169,13 +273,33 @@ static mixed_transfer_function_to transfer_array_functions_to[20] =
     mixed_transfer_array_to_alternating_double,
   };
 
+static mixed_transfer_function_to transfer_array_functions_to[20] = {0};
+
 MIXED_EXPORT mixed_transfer_function_to mixed_translator_to(enum mixed_encoding encoding){
   return transfer_array_functions_to[encoding-1];
 }
 
+// Swap in the vectorised kernels for the enabled CPU features, and
+// the scalar ones wherever there are none.
+void transfer_dispatch(){
+  for(enum mixed_encoding encoding=MIXED_INT8; encoding<=MIXED_DOUBLE; ++encoding){
+    mixed_transfer_function_from from = simd_translator_from(encoding, 0);
+    mixed_transfer_function_from fast = simd_translator_from(encoding, 1);
+    mixed_transfer_function_to to = simd_translator_to(encoding);
+    transfer_array_functions_from[encoding-1] = (from)? from : transfer_scalar_functions_from[encoding-1];
+    transfer_fast_functions_from[encoding-1] = (fast)? fast : transfer_scalar_fast_functions_from[encoding-1];
+    transfer_array_functions_to[encoding-1] = (to)? to : transfer_scalar_functions_to[encoding-1];
+    for(channel_t channels=2; channels<=FUSED_CHANNELS; ++channels){
+      transfer_fused_functions_from[encoding-1][channels] = simd_fused_from(encoding, channels, 0);
+      transfer_fused_fast_functions_from[encoding-1][channels] = simd_fused_from(encoding, channels, 1);
+      transfer_fused_functions_to[encoding-1][channels] = simd_fused_to(encoding, channels);
+    }
+  }
+}
+
 VECTORIZE MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struct mixed_pack *out, float *volume, float target_volume){
   channel_t channels = out->channels;
-  uint32_t frames_to_bytes = channels * mixed_samplesize(out->encoding);
+  uint32_t frames_to_bytes = pack_frame_bytes(out);
   uint32_t frames = UINT32_MAX;
   char *outd;
   float *ind[channels];
@@ -186,14 +310,32 @@ VECTORIZE MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struc
     mixed_buffer_request_read(&ind[i], &frames, ins[i]);
 
   if(0 < frames){
+    transfer_fused_to fused = (channels <= FUSED_CHANNELS && !(out->flags & MIXED_PLANAR))? transfer_fused_functions_to[out->encoding-1][channels] : 0;
     mixed_transfer_function_to fun = transfer_array_functions_to[out->encoding-1];
-    uint8_t size = mixed_samplesize(out->encoding);
+    uint8_t stride = pack_stride(out);
     float vol = *volume;
-    // KLUDGE: this is not necessarily correct...
     *volume = target_volume;
-    for(int8_t c=0; c<channels; ++c){
-      fun(ind[c], outd, channels, frames, vol, target_volume);
-      outd += size;
+    if((out->flags & MIXED_DITHER) && (out->encoding == MIXED_INT16 || out->encoding == MIXED_INT24)){
+      // The generator gets stuck at zero, so seed it on first use.
+      if(out->_dither == 0) out->_dither = 0x9E3779B9;
+      for(int8_t c=0; c<channels; ++c){
+        if(out->encoding == MIXED_INT16)
+          mixed_transfer_array_to_dither_int16(ind[c], outd + pack_channel_offset(c, out), stride, frames, vol, target_volume, &out->_dither);
+        else
+          mixed_transfer_array_to_dither_int24(ind[c], outd + pack_channel_offset(c, out), stride, frames, vol, target_volume, &out->_dither);
+      }
+    }else if(fused){
+      fused(ind, outd, channels, frames, vol, target_volume);
+    }else{
+      for(uint32_t start=0; start<frames; start+=TRANSFER_CHUNK){
+        uint32_t count = MIN(TRANSFER_CHUNK, frames-start);
+        float from = vol + (target_volume-vol)*start/frames;
+        float to = vol + (target_volume-vol)*(start+count)/frames;
+        char *chunk = outd + start*frames_to_bytes;
+        for(int8_t c=0; c<channels; ++c){
+          fun(ind[c]+start, chunk + pack_channel_offset(c, out), stride, count, from, to);
+        }
+      }
     }
   }
 
@@ -203,3 +345,168 @@ VECTORIZE MIXED_EXPORT int mixed_buffer_to_pack(struct mixed_buffer **ins, struc
   
   return 1;
 }
+
+//// Pack to pack conversion
+// Integer encodings are converted among each other by widening every
+// sample to a left-aligned signed 32 bit value and narrowing it again,
+// which is exact when widening and truncates when narrowing.
+static inline int pack_integer(enum mixed_encoding encoding){
+  return MIXED_INT8 <= encoding && encoding <= MIXED_UINT32;
+}
+
+VECTORIZE static void convert_read_int(enum mixed_encoding encoding, uint8_t *in, uint8_t stride, uint32_t samples, int32_t *out){
+  switch(encoding){
+  case MIXED_INT8:
+    for(uint32_t i=0; i<samples; ++i) out[i] = (int32_t)((uint32_t)((int8_t *)in)[i*stride] << 24);
+    break;
+  case MIXED_UINT8:
+    for(uint32_t i=0; i<samples; ++i) out[i] = (int32_t)(((uint32_t)in[i*stride] << 24) ^ 0x80000000u);
+    break;
+  case MIXED_INT16:
+    for(uint32_t i=0; i<samples; ++i) out[i] = (int32_t)((uint32_t)((int16_t *)in)[i*stride] << 16);
+    break;
+  case MIXED_UINT16:
+    for(uint32_t i=0; i<samples; ++i) out[i] = (int32_t)(((uint32_t)((uint16_t *)in)[i*stride] << 16) ^ 0x80000000u);
+    break;
+  case MIXED_INT24:
+  case MIXED_UINT24:{
+    uint32_t flip = (encoding == MIXED_UINT24)? 0x80000000u : 0;
+    for(uint32_t i=0; i<samples; ++i){
+      uint8_t *sample = in + 3*i*stride;
+      out[i] = (int32_t)((((uint32_t)sample[2] << 24) | ((uint32_t)sample[1] << 16) | ((uint32_t)sample[0] << 8)) ^ flip);
+    }
+    break;}
+  case MIXED_INT32:
+    for(uint32_t i=0; i<samples; ++i) out[i] = ((int32_t *)in)[i*stride];
+    break;
+  case MIXED_UINT32:
+    for(uint32_t i=0; i<samples; ++i) out[i] = (int32_t)(((uint32_t *)in)[i*stride] ^ 0x80000000u);
+    break;
+  default: break;
+  }
+}
+
+VECTORIZE static void convert_write_int(enum mixed_encoding encoding, int32_t *in, uint8_t *out, uint8_t stride, uint32_t samples){
+  switch(encoding){
+  case MIXED_INT8:
+    for(uint32_t i=0; i<samples; ++i) ((int8_t *)out)[i*stride] = in[i] >> 24;
+    break;
+  case MIXED_UINT8:
+    for(uint32_t i=0; i<samples; ++i) out[i*stride] = ((uint32_t)in[i] ^ 0x80000000u) >> 24;
+    break;
+  case MIXED_INT16:
+    for(uint32_t i=0; i<samples; ++i) ((int16_t *)out)[i*stride] = in[i] >> 16;
+    break;
+  case MIXED_UINT16:
+    for(uint32_t i=0; i<samples; ++i) ((uint16_t *)out)[i*stride] = ((uint32_t)in[i] ^ 0x80000000u) >> 16;
+    break;
+  case MIXED_INT24:
+  case MIXED_UINT24:{
+    uint32_t flip = (encoding == MIXED_UINT24)? 0x80000000u : 0;
+    for(uint32_t i=0; i<samples; ++i){
+      uint32_t value = (uint32_t)in[i] ^ flip;
+      uint8_t *sample = out + 3*i*stride;
+      sample[0] = (value >>  8) & 0xFF;
+      sample[1] = (value >> 16) & 0xFF;
+      sample[2] = (value >> 24) & 0xFF;
+    }
+    break;}
+  case MIXED_INT32:
+    for(uint32_t i=0; i<samples; ++i) ((int32_t *)out)[i*stride] = in[i];
+    break;
+  case MIXED_UINT32:
+    for(uint32_t i=0; i<samples; ++i) ((uint32_t *)out)[i*stride] = (uint32_t)in[i] ^ 0x80000000u;
+    break;
+  default: break;
+  }
+}
+
+static void convert_copy(uint8_t *in, uint8_t in_stride, uint8_t *out, uint8_t out_stride, uint8_t size, uint32_t samples){
+  if(in_stride == 1 && out_stride == 1){
+    memcpy(out, in, samples*size);
+  }else{
+    for(uint32_t i=0; i<samples; ++i)
+      memcpy(out + i*out_stride*size, in + i*in_stride*size, size);
+  }
+}
+
+// Converts one contiguous span of frames, a chunk at a time so that
+// the intermediate samples stay in cache.
+static void convert_span(struct mixed_pack *in, uint8_t *ind, struct mixed_pack *out, uint8_t *outd, const channel_t *map, uint32_t frames){
+  enum mixed_encoding from = in->encoding, to = out->encoding;
+  uint8_t in_stride = pack_stride(in), out_stride = pack_stride(out);
+  uint8_t in_size = mixed_samplesize(from), out_size = mixed_samplesize(to);
+  int dither = (out->flags & MIXED_DITHER) && (to == MIXED_INT16 || to == MIXED_INT24);
+  // Narrowing integers should not bypass the dither the pack asks for.
+  int integer = pack_integer(from) && pack_integer(to) && !(dither && out_size < in_size);
+  mixed_transfer_function_from decode = ((in->flags & MIXED_FAST_CONVERSION)? transfer_fast_functions_from : transfer_array_functions_from)[from-1];
+  mixed_transfer_function_to encode = transfer_array_functions_to[to-1];
+  union{ int32_t i[TRANSFER_CHUNK]; float f[TRANSFER_CHUNK]; } scratch;
+  if(dither && out->_dither == 0) out->_dither = 0x9E3779B9;
+
+  for(uint32_t start=0; start<frames; start+=TRANSFER_CHUNK){
+    uint32_t count = MIN(TRANSFER_CHUNK, frames-start);
+    uint8_t *in_chunk = ind + start*pack_frame_bytes(in);
+    uint8_t *out_chunk = outd + start*pack_frame_bytes(out);
+    for(channel_t c=0; c<out->channels; ++c){
+      channel_t source = (map)? map[c] : c;
+      uint8_t *o = out_chunk + pack_channel_offset(c, out);
+      if(in->channels <= source){
+        for(uint32_t i=0; i<count; ++i) scratch.f[i] = 0.0f;
+        encode(scratch.f, o, out_stride, count, 1.0f, 1.0f);
+        continue;
+      }
+      uint8_t *s = in_chunk + pack_channel_offset(source, in);
+      if(from == to){
+        convert_copy(s, in_stride, o, out_stride, in_size, count);
+      }else if(integer){
+        convert_read_int(from, s, in_stride, count, scratch.i);
+        convert_write_int(to, scratch.i, o, out_stride, count);
+      }else{
+        decode(s, scratch.f, in_stride, count, 1.0f, 1.0f);
+        if(dither && to == MIXED_INT16)
+          mixed_transfer_array_to_dither_int16(scratch.f, o, out_stride, count, 1.0f, 1.0f, &out->_dither);
+        else if(dither)
+          mixed_transfer_array_to_dither_int24(scratch.f, o, out_stride, count, 1.0f, 1.0f, &out->_dither);
+        else
+          encode(scratch.f, o, out_stride, count, 1.0f, 1.0f);
+      }
+    }
+  }
+}
+
+MIXED_EXPORT int mixed_pack_convert(struct mixed_pack *in, struct mixed_pack *out, const channel_t *map){
+  mixed_err(MIXED_NO_ERROR);
+  if(in->samplerate != out->samplerate){
+    mixed_err(MIXED_BAD_RESAMPLE_FACTOR);
+    return 0;
+  }
+  if(!map && in->channels != out->channels){
+    mixed_err(MIXED_BAD_CHANNEL_CONFIGURATION);
+    return 0;
+  }
+  if(in->encoding < MIXED_INT8 || MIXED_DOUBLE < in->encoding
+     || out->encoding < MIXED_INT8 || MIXED_DOUBLE < out->encoding){
+    mixed_err(MIXED_UNKNOWN_ENCODING);
+    return 0;
+  }
+  uint32_t in_frame = pack_frame_bytes(in), out_frame = pack_frame_bytes(out);
+  // Either side may wrap around, so it can take two spans to move
+  // everything that is there.
+  for(int span=0; span<2; ++span){
+    uint8_t *ind, *outd;
+    uint32_t in_bytes = UINT32_MAX, out_bytes = UINT32_MAX;
+    if(!mixed_pack_request_read((void **)&ind, &in_bytes, in)) break;
+    if(!mixed_pack_request_write((void **)&outd, &out_bytes, out)) break;
+    uint32_t frames = MIN(in_bytes / in_frame, out_bytes / out_frame);
+    if(frames == 0){
+      mixed_pack_finish_write(0, out);
+      break;
+    }
+    convert_span(in, ind, out, outd, map, frames);
+    mixed_pack_finish_write(frames * out_frame, out);
+    mixed_pack_finish_read(frames * in_frame, in);
+  }
+  mixed_err(MIXED_NO_ERROR);
+  return 1;
+}
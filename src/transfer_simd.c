@@ -0,0 +1,1245 @@
+#include "internal.h"
+
+// Hand-written kernels for the most common pack encodings. The
+// strided samples of one channel are gathered into a vector, and
+// everything from there on, the conversion, the clipping and the
+// volume ramp, runs on full vectors. Common layouts additionally get
+// fused kernels that handle every channel of a frame at once. The
+// results match the scalar functions in transfer.c bit for bit.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_SSE2 1
+#define HAVE_AVX2 1
+#define HAVE_AVX512 1
+#elif defined(__GNUC__) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+//// Scalar sample access
+static inline int32_t load_int16(void *in, uint32_t i){
+  return ((int16_t *)in)[i];
+}
+
+static inline int32_t load_int24(void *in, uint32_t i){
+  return (((int8_t *)in)[3*i+2] << 16)
+    + (((uint8_t *)in)[3*i+1] << 8)
+    + (((uint8_t *)in)[3*i]);
+}
+
+static inline int32_t load_int32(void *in, uint32_t i){
+  return ((int32_t *)in)[i];
+}
+
+// Reads one byte past the sample, use only with a frame to spare.
+static inline int32_t load_int24_wide(void *in, uint32_t i){
+  int32_t sample;
+  memcpy(&sample, ((uint8_t *)in)+3*i, sizeof(int32_t));
+  return (int32_t)((uint32_t)sample << 8) >> 8;
+}
+
+static inline void store_int16(void *out, uint32_t i, int32_t sample){
+  ((int16_t *)out)[i] = sample;
+}
+
+static inline void store_int24(void *out, uint32_t i, int32_t sample){
+  ((uint8_t *)out)[3*i+2] = (sample >> 16) & 0xFF;
+  ((uint8_t *)out)[3*i+1] = (sample >>  8) & 0xFF;
+  ((uint8_t *)out)[3*i+0] = (sample >>  0) & 0xFF;
+}
+
+// Rewrites the byte past the sample with its old value, the same
+// constraint as for load_int24_wide applies.
+static inline void store_int24_wide(void *out, uint32_t i, int32_t sample){
+  uint32_t word;
+  uint8_t *p = ((uint8_t *)out)+3*i;
+  memcpy(&word, p, sizeof(uint32_t));
+  word = (word & 0xFF000000) | ((uint32_t)sample & 0x00FFFFFF);
+  memcpy(p, &word, sizeof(uint32_t));
+}
+
+// Packs both samples of a frame into one word and writes it with a single
+// store. Overlapping wide stores are fine as long as they run in order,
+// it's reading back the bytes of a pending store that stalls. Like the
+// wide load, this clobbers two bytes of the following frame.
+static inline void store_int24_stereo(void *out, uint32_t i, int32_t *left, int32_t *right, uint32_t count){
+  uint8_t *p = ((uint8_t *)out)+6*i;
+  for(uint32_t k=0; k<count; ++k){
+    uint64_t word = ((uint64_t)left[k] & 0xFFFFFF) | (((uint64_t)right[k] & 0xFFFFFF) << 24);
+    memcpy(p+6*k, &word, sizeof(uint64_t));
+  }
+}
+
+static inline void store_int32(void *out, uint32_t i, int32_t sample){
+  ((int32_t *)out)[i] = sample;
+}
+
+static inline float load_float(void *in, uint32_t i){
+  return ((float *)in)[i];
+}
+
+static inline void store_float(void *out, uint32_t i, float sample){
+  ((float *)out)[i] = sample;
+}
+
+//// Kernel templates
+// Each ISA provides ISA_vf/ISA_vi vector types, ISA_N lanes, and the
+// primitives used below. Gathers and scatters may touch the bytes
+// right after the last sample they handle, so the vector loop always
+// leaves the final frame to the scalar tail to stay inside the pack.
+#define DEF_SIMD_FROM(isa, name, type)                                  \
+  isa##_TARGET static float isa##_from_##name(void *in, float *out, uint8_t stride, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (0 < samples)? samples-1 : 0;                      \
+    isa##_vf base = isa##_set(volume);                                  \
+    isa##_vf delta = isa##_set(step);                                   \
+    isa##_vf index = isa##_index();                                     \
+    isa##_vf lanes = isa##_set(isa##_N);                                \
+    uint32_t i = 0;                                                     \
+    for(; i+isa##_N<=limit; i+=isa##_N){                                \
+      isa##_vf sample = isa##_decode_##name(isa##_gather_##type(in, i, stride)); \
+      isa##_store_f(out+i, isa##_mul(sample, isa##_add(base, isa##_mul(delta, index)))); \
+      index = isa##_add(index, lanes);                                  \
+    }                                                                   \
+    for(; i<samples; ++i)                                               \
+      out[i] = mixed_from_##name(load_##type(in, i*stride)) * (volume + step*(i+1)); \
+    return target_volume;                                               \
+  }
+
+#define DEF_SIMD_TO(isa, name)                                          \
+  isa##_TARGET static float isa##_to_##name(float *in, void *out, uint8_t stride, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (0 < samples)? samples-1 : 0;                      \
+    isa##_vf base = isa##_set(volume);                                  \
+    isa##_vf delta = isa##_set(step);                                   \
+    isa##_vf index = isa##_index();                                     \
+    isa##_vf lanes = isa##_set(isa##_N);                                \
+    uint32_t i = 0;                                                     \
+    for(; i+isa##_N<=limit; i+=isa##_N){                                \
+      isa##_vf sample = isa##_mul(isa##_load_f(in+i), isa##_add(base, isa##_mul(delta, index))); \
+      isa##_scatter_##name(out, i, stride, isa##_encode_##name(sample)); \
+      index = isa##_add(index, lanes);                                  \
+    }                                                                   \
+    for(; i<samples; ++i)                                               \
+      store_##name(out, i*stride, mixed_to_##name(in[i] * (volume + step*(i+1)))); \
+    return target_volume;                                               \
+  }
+
+// Stereo is common enough for kernels that read each frame once and
+// produce both channels from the same loads. The channel count is
+// only there to share a signature with the wider layouts below.
+#define DEF_SIMD_FUSED_FROM(isa, name, type)                            \
+  isa##_TARGET static void isa##_fused_from_##name(void *in, float **outs, channel_t channels, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (0 < samples)? samples-1 : 0;                      \
+    float *left = outs[0], *right = outs[1];                            \
+    IGNORE(channels);                                                   \
+    isa##_vf base = isa##_set(volume);                                  \
+    isa##_vf delta = isa##_set(step);                                   \
+    isa##_vf index = isa##_index();                                     \
+    isa##_vf lanes = isa##_set(isa##_N);                                \
+    uint32_t i = 0;                                                     \
+    for(; i+isa##_N<=limit; i+=isa##_N){                                \
+      __typeof__(isa##_gather_##type(in, 0, 2)) l, r;                   \
+      isa##_vf gain = isa##_add(base, isa##_mul(delta, index));         \
+      isa##_split_##type(in, i, &l, &r);                                \
+      isa##_store_f(left+i, isa##_mul(isa##_decode_##name(l), gain));   \
+      isa##_store_f(right+i, isa##_mul(isa##_decode_##name(r), gain));  \
+      index = isa##_add(index, lanes);                                  \
+    }                                                                   \
+    for(; i<samples; ++i){                                              \
+      float gain = volume + step*(i+1);                                 \
+      left[i] = mixed_from_##name(load_##type(in, 2*i)) * gain;         \
+      right[i] = mixed_from_##name(load_##type(in, 2*i+1)) * gain;      \
+    }                                                                   \
+  }
+
+#define DEF_SIMD_FUSED_TO(isa, name)                                    \
+  isa##_TARGET static void isa##_fused_to_##name(float **ins, void *out, channel_t channels, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (0 < samples)? samples-1 : 0;                      \
+    float *left = ins[0], *right = ins[1];                              \
+    IGNORE(channels);                                                   \
+    isa##_vf base = isa##_set(volume);                                  \
+    isa##_vf delta = isa##_set(step);                                   \
+    isa##_vf index = isa##_index();                                     \
+    isa##_vf lanes = isa##_set(isa##_N);                                \
+    uint32_t i = 0;                                                     \
+    for(; i+isa##_N<=limit; i+=isa##_N){                                \
+      isa##_vf gain = isa##_add(base, isa##_mul(delta, index));         \
+      isa##_merge_##name(out, i,                                        \
+                         isa##_encode_##name(isa##_mul(isa##_load_f(left+i), gain)), \
+                         isa##_encode_##name(isa##_mul(isa##_load_f(right+i), gain))); \
+      index = isa##_add(index, lanes);                                  \
+    }                                                                   \
+    for(; i<samples; ++i){                                              \
+      float gain = volume + step*(i+1);                                 \
+      store_##name(out, 2*i, mixed_to_##name(left[i] * gain));          \
+      store_##name(out, 2*i+1, mixed_to_##name(right[i] * gain));       \
+    }                                                                   \
+  }
+
+// The fast decoders only scale by a power of two, see encoding.h.
+#define DEF_SIMD_FAST_DECODERS(isa)                                     \
+  isa##_TARGET static inline isa##_vf isa##_decode_int16_fast(isa##_vi a){ \
+    return isa##_mul(isa##_cvt(a), isa##_set(1.0f/0x8000));            \
+  }                                                                     \
+  isa##_TARGET static inline isa##_vf isa##_decode_int24_fast(isa##_vi a){ \
+    return isa##_mul(isa##_cvt(a), isa##_set(1.0f/0x800000));          \
+  }                                                                     \
+  isa##_TARGET static inline isa##_vf isa##_decode_int32_fast(isa##_vi a){ \
+    return isa##_mul(isa##_cvt(a), isa##_set(1.0f/0x80000000L));       \
+  }
+
+#define DEF_SIMD_KERNELS(isa)                   \
+  DEF_SIMD_FAST_DECODERS(isa)                   \
+  DEF_SIMD_FUSED_FROM(isa, int16, int16)        \
+  DEF_SIMD_FUSED_FROM(isa, int24, int24)        \
+  DEF_SIMD_FUSED_FROM(isa, int32, int32)        \
+  DEF_SIMD_FUSED_FROM(isa, float, float)        \
+  DEF_SIMD_FUSED_FROM(isa, int16_fast, int16)   \
+  DEF_SIMD_FUSED_FROM(isa, int24_fast, int24)   \
+  DEF_SIMD_FUSED_FROM(isa, int32_fast, int32)   \
+  DEF_SIMD_FUSED_TO(isa, int16)                 \
+  DEF_SIMD_FUSED_TO(isa, int24)                 \
+  DEF_SIMD_FUSED_TO(isa, int32)                 \
+  DEF_SIMD_FUSED_TO(isa, float)                 \
+  DEF_SIMD_FROM(isa, int16, int16)              \
+  DEF_SIMD_FROM(isa, int24, int24)              \
+  DEF_SIMD_FROM(isa, int32, int32)              \
+  DEF_SIMD_FROM(isa, float, float)              \
+  DEF_SIMD_FROM(isa, int16_fast, int16)         \
+  DEF_SIMD_FROM(isa, int24_fast, int24)         \
+  DEF_SIMD_FROM(isa, int32_fast, int32)         \
+  DEF_SIMD_TO(isa, int16)                       \
+  DEF_SIMD_TO(isa, int24)                       \
+  DEF_SIMD_TO(isa, int32)                       \
+  DEF_SIMD_TO(isa, float)
+
+#define SIMD_TRANSLATOR(isa, direction, encoding)               \
+  switch(encoding){                                             \
+  case MIXED_INT16: return isa##_##direction##_int16;           \
+  case MIXED_INT24: return isa##_##direction##_int24;           \
+  case MIXED_INT32: return isa##_##direction##_int32;           \
+  case MIXED_FLOAT: return isa##_##direction##_float;           \
+  default: return 0;                                            \
+  }
+
+// Floats have nothing to gain from the fast mode.
+#define SIMD_TRANSLATOR_FAST(isa, direction, encoding)          \
+  switch(encoding){                                             \
+  case MIXED_INT16: return isa##_##direction##_int16_fast;      \
+  case MIXED_INT24: return isa##_##direction##_int24_fast;      \
+  case MIXED_INT32: return isa##_##direction##_int32_fast;      \
+  case MIXED_FLOAT: return isa##_##direction##_float;           \
+  default: return 0;                                            \
+  }
+
+// The integer encoders share one shape: full scale positive clips
+// to the maximum, anything below -1 or NaN clips to the minimum, and
+// the rest is scaled and truncated.
+#define ENCODE_LIMITS(isa, sample, scale, max, min)                     \
+  isa##_select_i(isa##_ge(sample, isa##_set(1.0f)), isa##_set_i(max),   \
+                 isa##_select_i(isa##_ge(sample, isa##_set(-1.0f)),     \
+                                isa##_trunc(isa##_mul(sample, isa##_set(scale))), \
+                                isa##_set_i(min)))
+
+//// SSE2
+#ifdef HAVE_SSE2
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define SSE2_N 4
+typedef __m128 SSE2_vf;
+typedef __m128i SSE2_vi;
+
+SSE2_TARGET static inline __m128 SSE2_set(float x){ return _mm_set1_ps(x); }
+SSE2_TARGET static inline __m128i SSE2_set_i(int32_t x){ return _mm_set1_epi32(x); }
+SSE2_TARGET static inline __m128 SSE2_index(){ return _mm_setr_ps(1, 2, 3, 4); }
+SSE2_TARGET static inline __m128 SSE2_load_f(float *p){ return _mm_loadu_ps(p); }
+SSE2_TARGET static inline void SSE2_store_f(float *p, __m128 v){ _mm_storeu_ps(p, v); }
+SSE2_TARGET static inline __m128 SSE2_add(__m128 a, __m128 b){ return _mm_add_ps(a, b); }
+SSE2_TARGET static inline __m128 SSE2_mul(__m128 a, __m128 b){ return _mm_mul_ps(a, b); }
+SSE2_TARGET static inline __m128 SSE2_ge(__m128 a, __m128 b){ return _mm_cmpge_ps(a, b); }
+SSE2_TARGET static inline __m128i SSE2_trunc(__m128 a){ return _mm_cvttps_epi32(a); }
+SSE2_TARGET static inline __m128 SSE2_cvt(__m128i a){ return _mm_cvtepi32_ps(a); }
+
+SSE2_TARGET static inline __m128 SSE2_select(__m128 mask, __m128 a, __m128 b){
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+SSE2_TARGET static inline __m128i SSE2_select_i(__m128 mask, __m128i a, __m128i b){
+  __m128i m = _mm_castps_si128(mask);
+  return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+// Interleave the lanes of v into the even slots of the eight values
+// at p, keeping the odd slots that belong to the next channel.
+SSE2_TARGET static inline void SSE2_store_even(float *p, __m128 v){
+  __m128 lo = _mm_loadu_ps(p);
+  __m128 hi = _mm_loadu_ps(p+4);
+  __m128 odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+  _mm_storeu_ps(p, _mm_unpacklo_ps(v, odd));
+  _mm_storeu_ps(p+4, _mm_unpackhi_ps(v, odd));
+}
+
+SSE2_TARGET static inline __m128i SSE2_gather_int16(void *in, uint32_t i, uint8_t stride){
+  int16_t *p = ((int16_t *)in) + i*stride;
+  switch(stride){
+  case 1: {
+    __m128i x = _mm_loadl_epi64((__m128i *)p);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16); }
+  case 2:
+    return _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((__m128i *)p), 16), 16);
+  default:
+    return _mm_setr_epi32(p[0], p[stride], p[2*stride], p[3*stride]);
+  }
+}
+
+SSE2_TARGET static inline __m128i SSE2_gather_int24(void *in, uint32_t i, uint8_t stride){
+  return _mm_setr_epi32(load_int24_wide(in, i*stride), load_int24_wide(in, (i+1)*stride),
+                        load_int24_wide(in, (i+2)*stride), load_int24_wide(in, (i+3)*stride));
+}
+
+SSE2_TARGET static inline __m128 SSE2_gather_float(void *in, uint32_t i, uint8_t stride){
+  float *p = ((float *)in) + i*stride;
+  switch(stride){
+  case 1: return _mm_loadu_ps(p);
+  case 2: return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p+4), _MM_SHUFFLE(2, 0, 2, 0));
+  default: return _mm_setr_ps(p[0], p[stride], p[2*stride], p[3*stride]);
+  }
+}
+
+SSE2_TARGET static inline __m128i SSE2_gather_int32(void *in, uint32_t i, uint8_t stride){
+  return _mm_castps_si128(SSE2_gather_float(in, i, stride));
+}
+
+SSE2_TARGET static inline void SSE2_scatter_float(void *out, uint32_t i, uint8_t stride, __m128 v){
+  float *p = ((float *)out) + i*stride;
+  switch(stride){
+  case 1: _mm_storeu_ps(p, v); break;
+  case 2: SSE2_store_even(p, v); break;
+  default: {
+    float tmp[4];
+    _mm_storeu_ps(tmp, v);
+    for(int k=0; k<4; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+SSE2_TARGET static inline void SSE2_scatter_int32(void *out, uint32_t i, uint8_t stride, __m128i v){
+  SSE2_scatter_float(out, i, stride, _mm_castsi128_ps(v));
+}
+
+SSE2_TARGET static inline void SSE2_scatter_int16(void *out, uint32_t i, uint8_t stride, __m128i v){
+  int16_t *p = ((int16_t *)out) + i*stride;
+  switch(stride){
+  case 1: _mm_storel_epi64((__m128i *)p, _mm_packs_epi32(v, v)); break;
+  case 2: {
+    __m128i mask = _mm_set1_epi32(0xFFFF);
+    __m128i old = _mm_loadu_si128((__m128i *)p);
+    _mm_storeu_si128((__m128i *)p, _mm_or_si128(_mm_andnot_si128(mask, old), _mm_and_si128(mask, v)));
+  } break;
+  default: {
+    int32_t tmp[4];
+    _mm_storeu_si128((__m128i *)tmp, v);
+    for(int k=0; k<4; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+SSE2_TARGET static inline void SSE2_scatter_int24(void *out, uint32_t i, uint8_t stride, __m128i v){
+  int32_t tmp[4];
+  _mm_storeu_si128((__m128i *)tmp, v);
+  for(int k=0; k<4; ++k) store_int24_wide(out, (i+k)*stride, tmp[k]);
+}
+
+SSE2_TARGET static inline __m128 SSE2_clip(__m128 a){
+  // maxps returns the second operand for NaN, which maps it to -1.
+  return _mm_min_ps(_mm_max_ps(a, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+
+SSE2_TARGET static inline __m128 SSE2_decode(__m128i a, float negative, float positive){
+  __m128 sample = _mm_cvtepi32_ps(a);
+  __m128 scale = SSE2_select(_mm_cmplt_ps(sample, _mm_setzero_ps()), _mm_set1_ps(negative), _mm_set1_ps(positive));
+  return _mm_div_ps(sample, scale);
+}
+
+SSE2_TARGET static inline __m128 SSE2_decode_int16(__m128i a){ return SSE2_decode(a, -(float)INT16_MIN, INT16_MAX); }
+SSE2_TARGET static inline __m128 SSE2_decode_int24(__m128i a){ return SSE2_decode(a, -(float)INT24_MIN, INT24_MAX); }
+SSE2_TARGET static inline __m128 SSE2_decode_float(__m128 a){ return SSE2_clip(a); }
+
+SSE2_TARGET static inline __m128d SSE2_decode_int32_half(__m128i a){
+  __m128d sample = _mm_cvtepi32_pd(a);
+  __m128d mask = _mm_cmplt_pd(sample, _mm_setzero_pd());
+  __m128d scale = _mm_or_pd(_mm_and_pd(mask, _mm_set1_pd(-(double)INT32_MIN)),
+                            _mm_andnot_pd(mask, _mm_set1_pd(INT32_MAX)));
+  return _mm_div_pd(sample, scale);
+}
+
+SSE2_TARGET static inline __m128 SSE2_decode_int32(__m128i a){
+  __m128 lo = _mm_cvtpd_ps(SSE2_decode_int32_half(a));
+  __m128 hi = _mm_cvtpd_ps(SSE2_decode_int32_half(_mm_shuffle_epi32(a, 0xEE)));
+  return _mm_movelh_ps(lo, hi);
+}
+
+SSE2_TARGET static inline __m128i SSE2_encode_int16(__m128 a){ return ENCODE_LIMITS(SSE2, a, 0x8000, INT16_MAX, INT16_MIN); }
+SSE2_TARGET static inline __m128i SSE2_encode_int24(__m128 a){ return ENCODE_LIMITS(SSE2, a, 0x800000, INT24_MAX, INT24_MIN); }
+SSE2_TARGET static inline __m128i SSE2_encode_int32(__m128 a){ return ENCODE_LIMITS(SSE2, a, 0x80000000L, INT32_MAX, INT32_MIN); }
+SSE2_TARGET static inline __m128 SSE2_encode_float(__m128 a){ return SSE2_clip(a); }
+
+SSE2_TARGET static inline void SSE2_split_int16(void *in, uint32_t i, __m128i *l, __m128i *r){
+  __m128i x = _mm_loadu_si128((__m128i *)(((int16_t *)in) + 2*i));
+  *l = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+  *r = _mm_srai_epi32(x, 16);
+}
+
+SSE2_TARGET static inline void SSE2_split_int24(void *in, uint32_t i, __m128i *l, __m128i *r){
+  *l = SSE2_gather_int24(in, i, 2);
+  *r = SSE2_gather_int24(((uint8_t *)in)+3, i, 2);
+}
+
+SSE2_TARGET static inline void SSE2_split_float(void *in, uint32_t i, __m128 *l, __m128 *r){
+  float *p = ((float *)in) + 2*i;
+  __m128 lo = _mm_loadu_ps(p);
+  __m128 hi = _mm_loadu_ps(p+4);
+  *l = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+  *r = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+SSE2_TARGET static inline void SSE2_split_int32(void *in, uint32_t i, __m128i *l, __m128i *r){
+  __m128 lf, rf;
+  SSE2_split_float(in, i, &lf, &rf);
+  *l = _mm_castps_si128(lf);
+  *r = _mm_castps_si128(rf);
+}
+
+SSE2_TARGET static inline void SSE2_merge_int16(void *out, uint32_t i, __m128i l, __m128i r){
+  __m128i x = _mm_or_si128(_mm_and_si128(l, _mm_set1_epi32(0xFFFF)), _mm_slli_epi32(r, 16));
+  _mm_storeu_si128((__m128i *)(((int16_t *)out) + 2*i), x);
+}
+
+SSE2_TARGET static inline void SSE2_merge_int24(void *out, uint32_t i, __m128i l, __m128i r){
+  int32_t left[4], right[4];
+  _mm_storeu_si128((__m128i *)left, l);
+  _mm_storeu_si128((__m128i *)right, r);
+  store_int24_stereo(out, i, left, right, 4);
+}
+
+SSE2_TARGET static inline void SSE2_merge_float(void *out, uint32_t i, __m128 l, __m128 r){
+  float *p = ((float *)out) + 2*i;
+  _mm_storeu_ps(p, _mm_unpacklo_ps(l, r));
+  _mm_storeu_ps(p+4, _mm_unpackhi_ps(l, r));
+}
+
+SSE2_TARGET static inline void SSE2_merge_int32(void *out, uint32_t i, __m128i l, __m128i r){
+  SSE2_merge_float(out, i, _mm_castsi128_ps(l), _mm_castsi128_ps(r));
+}
+
+DEF_SIMD_KERNELS(SSE2)
+
+// Kernels for three to eight channels, as in 5.1 and 7.1 packs. Blocks
+// of frames are loaded whole and transposed in registers, so that every
+// frame is read or written once instead of once per channel. Loads and
+// stores span a full eight lanes regardless of the channel count, which
+// is what the extra frames left to the scalar tail are for. The stores
+// run in frame order, so each one fixes up the lanes the previous one
+// wrote past its frame.
+#define SSE2_FRAMES_MAX 8
+
+SSE2_TARGET static inline void SSE2_transpose_int16(__m128i *v){
+  __m128i t0 = _mm_unpacklo_epi16(v[0], v[1]), t1 = _mm_unpackhi_epi16(v[0], v[1]);
+  __m128i t2 = _mm_unpacklo_epi16(v[2], v[3]), t3 = _mm_unpackhi_epi16(v[2], v[3]);
+  __m128i t4 = _mm_unpacklo_epi16(v[4], v[5]), t5 = _mm_unpackhi_epi16(v[4], v[5]);
+  __m128i t6 = _mm_unpacklo_epi16(v[6], v[7]), t7 = _mm_unpackhi_epi16(v[6], v[7]);
+  __m128i u0 = _mm_unpacklo_epi32(t0, t2), u1 = _mm_unpackhi_epi32(t0, t2);
+  __m128i u2 = _mm_unpacklo_epi32(t1, t3), u3 = _mm_unpackhi_epi32(t1, t3);
+  __m128i u4 = _mm_unpacklo_epi32(t4, t6), u5 = _mm_unpackhi_epi32(t4, t6);
+  __m128i u6 = _mm_unpacklo_epi32(t5, t7), u7 = _mm_unpackhi_epi32(t5, t7);
+  v[0] = _mm_unpacklo_epi64(u0, u4); v[1] = _mm_unpackhi_epi64(u0, u4);
+  v[2] = _mm_unpacklo_epi64(u1, u5); v[3] = _mm_unpackhi_epi64(u1, u5);
+  v[4] = _mm_unpacklo_epi64(u2, u6); v[5] = _mm_unpackhi_epi64(u2, u6);
+  v[6] = _mm_unpacklo_epi64(u3, u7); v[7] = _mm_unpackhi_epi64(u3, u7);
+}
+
+SSE2_TARGET static inline void SSE2_transpose_wide(__m128 *v){
+  _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+}
+
+SSE2_TARGET static inline __m128 SSE2_decode_wide_int32(__m128 a){ return SSE2_decode_int32(_mm_castps_si128(a)); }
+SSE2_TARGET static inline __m128 SSE2_decode_wide_int32_fast(__m128 a){ return SSE2_decode_int32_fast(_mm_castps_si128(a)); }
+SSE2_TARGET static inline __m128 SSE2_decode_wide_float(__m128 a){ return SSE2_decode_float(a); }
+SSE2_TARGET static inline __m128 SSE2_encode_wide_int32(__m128 a){ return _mm_castsi128_ps(SSE2_encode_int32(a)); }
+SSE2_TARGET static inline __m128 SSE2_encode_wide_float(__m128 a){ return SSE2_encode_float(a); }
+
+#define DEF_SSE2_FRAMES_INT16(name)                                     \
+  SSE2_TARGET static void SSE2_frames_from_##name(void *in, float **outs, channel_t channels, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (2 < samples)? samples-2 : 0;                      \
+    int16_t *data = (int16_t *)in;                                      \
+    __m128 base = _mm_set1_ps(volume), delta = _mm_set1_ps(step);       \
+    __m128 index = SSE2_index(), lanes = _mm_set1_ps(4);                \
+    uint32_t i = 0;                                                     \
+    for(; i+8<=limit; i+=8){                                            \
+      __m128i v[8];                                                     \
+      for(int k=0; k<8; ++k) v[k] = _mm_loadu_si128((__m128i *)(data+(i+k)*channels)); \
+      SSE2_transpose_int16(v);                                          \
+      __m128 lo = _mm_add_ps(base, _mm_mul_ps(delta, index));           \
+      index = _mm_add_ps(index, lanes);                                 \
+      __m128 hi = _mm_add_ps(base, _mm_mul_ps(delta, index));           \
+      index = _mm_add_ps(index, lanes);                                 \
+      for(channel_t c=0; c<channels; ++c){                              \
+        __m128i l = _mm_srai_epi32(_mm_unpacklo_epi16(v[c], v[c]), 16); \
+        __m128i h = _mm_srai_epi32(_mm_unpackhi_epi16(v[c], v[c]), 16); \
+        _mm_storeu_ps(outs[c]+i, _mm_mul_ps(SSE2_decode_##name(l), lo)); \
+        _mm_storeu_ps(outs[c]+i+4, _mm_mul_ps(SSE2_decode_##name(h), hi)); \
+      }                                                                 \
+    }                                                                   \
+    for(; i<samples; ++i){                                              \
+      float gain = volume + step*(i+1);                                 \
+      for(channel_t c=0; c<channels; ++c)                               \
+        outs[c][i] = mixed_from_##name(load_int16(in, i*channels+c)) * gain; \
+    }                                                                   \
+  }
+
+DEF_SSE2_FRAMES_INT16(int16)
+DEF_SSE2_FRAMES_INT16(int16_fast)
+
+// Four byte samples come in two halves of four channels each. There is
+// no int16 encoder here, the 16 bit transpose costs more than the
+// strided stores of the per-channel kernels save.
+#define DEF_SSE2_FRAMES_FROM_WIDE(name, type)                           \
+  SSE2_TARGET static void SSE2_frames_from_##name(void *in, float **outs, channel_t channels, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (2 < samples)? samples-2 : 0;                      \
+    float *data = (float *)in;                                          \
+    __m128 base = _mm_set1_ps(volume), delta = _mm_set1_ps(step);       \
+    __m128 index = SSE2_index(), lanes = _mm_set1_ps(4);                \
+    uint32_t i = 0;                                                     \
+    for(; i+4<=limit; i+=4){                                            \
+      __m128 v[8];                                                      \
+      for(int k=0; k<4; ++k){                                           \
+        v[k] = _mm_loadu_ps(data+(i+k)*channels);                       \
+        if(4 < channels) v[4+k] = _mm_loadu_ps(data+(i+k)*channels+4);  \
+      }                                                                 \
+      SSE2_transpose_wide(v);                                           \
+      if(4 < channels) SSE2_transpose_wide(v+4);                        \
+      __m128 gain = _mm_add_ps(base, _mm_mul_ps(delta, index));         \
+      index = _mm_add_ps(index, lanes);                                 \
+      for(channel_t c=0; c<channels; ++c)                               \
+        _mm_storeu_ps(outs[c]+i, _mm_mul_ps(SSE2_decode_wide_##name(v[c]), gain)); \
+    }                                                                   \
+    for(; i<samples; ++i){                                              \
+      float gain = volume + step*(i+1);                                 \
+      for(channel_t c=0; c<channels; ++c)                               \
+        outs[c][i] = mixed_from_##name(load_##type(in, i*channels+c)) * gain; \
+    }                                                                   \
+  }
+
+#define DEF_SSE2_FRAMES_TO_WIDE(name)                                   \
+  SSE2_TARGET static void SSE2_frames_to_##name(float **ins, void *out, channel_t channels, uint32_t samples, float volume, float target_volume){ \
+    float step = (volume == target_volume)? 0.0f : (target_volume - volume) / samples; \
+    uint32_t limit = (2 < samples)? samples-2 : 0;                      \
+    float *data = (float *)out;                                         \
+    __m128 base = _mm_set1_ps(volume), delta = _mm_set1_ps(step);       \
+    __m128 index = SSE2_index(), lanes = _mm_set1_ps(4);                \
+    uint32_t i = 0;                                                     \
+    for(; i+4<=limit; i+=4){                                            \
+      __m128 v[8];                                                      \
+      __m128 gain = _mm_add_ps(base, _mm_mul_ps(delta, index));         \
+      index = _mm_add_ps(index, lanes);                                 \
+      for(channel_t c=0; c<8; ++c)                                      \
+        v[c] = (c < channels)? SSE2_encode_wide_##name(_mm_mul_ps(_mm_loadu_ps(ins[c]+i), gain)) : _mm_setzero_ps(); \
+      SSE2_transpose_wide(v);                                           \
+      if(4 < channels) SSE2_transpose_wide(v+4);                        \
+      for(int k=0; k<4; ++k){                                           \
+        _mm_storeu_ps(data+(i+k)*channels, v[k]);                       \
+        if(4 < channels) _mm_storeu_ps(data+(i+k)*channels+4, v[4+k]);  \
+      }                                                                 \
+    }                                                                   \
+    for(; i<samples; ++i){                                              \
+      float gain = volume + step*(i+1);                                 \
+      for(channel_t c=0; c<channels; ++c)                               \
+        store_##name(out, i*channels+c, mixed_to_##name(ins[c][i] * gain)); \
+    }                                                                   \
+  }
+
+DEF_SSE2_FRAMES_FROM_WIDE(int32, int32)
+DEF_SSE2_FRAMES_FROM_WIDE(float, float)
+DEF_SSE2_FRAMES_FROM_WIDE(int32_fast, int32)
+DEF_SSE2_FRAMES_TO_WIDE(int32)
+DEF_SSE2_FRAMES_TO_WIDE(float)
+#endif
+
+//// AVX2
+#ifdef HAVE_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX2_N 8
+typedef __m256 AVX2_vf;
+typedef __m256i AVX2_vi;
+
+AVX2_TARGET static inline __m256 AVX2_set(float x){ return _mm256_set1_ps(x); }
+AVX2_TARGET static inline __m256i AVX2_set_i(int32_t x){ return _mm256_set1_epi32(x); }
+AVX2_TARGET static inline __m256 AVX2_index(){ return _mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8); }
+AVX2_TARGET static inline __m256 AVX2_load_f(float *p){ return _mm256_loadu_ps(p); }
+AVX2_TARGET static inline void AVX2_store_f(float *p, __m256 v){ _mm256_storeu_ps(p, v); }
+AVX2_TARGET static inline __m256 AVX2_add(__m256 a, __m256 b){ return _mm256_add_ps(a, b); }
+AVX2_TARGET static inline __m256 AVX2_mul(__m256 a, __m256 b){ return _mm256_mul_ps(a, b); }
+AVX2_TARGET static inline __m256 AVX2_ge(__m256 a, __m256 b){ return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+AVX2_TARGET static inline __m256i AVX2_trunc(__m256 a){ return _mm256_cvttps_epi32(a); }
+AVX2_TARGET static inline __m256 AVX2_cvt(__m256i a){ return _mm256_cvtepi32_ps(a); }
+
+AVX2_TARGET static inline __m256i AVX2_select_i(__m256 mask, __m256i a, __m256i b){
+  return _mm256_blendv_epi8(b, a, _mm256_castps_si256(mask));
+}
+
+AVX2_TARGET static inline __m256i AVX2_offsets(uint8_t stride){
+  return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+}
+
+AVX2_TARGET static inline __m256i AVX2_gather_int16(void *in, uint32_t i, uint8_t stride){
+  int16_t *p = ((int16_t *)in) + i*stride;
+  switch(stride){
+  case 1: return _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)p));
+  case 2: return _mm256_srai_epi32(_mm256_slli_epi32(_mm256_loadu_si256((__m256i *)p), 16), 16);
+  default: {
+    // Each lane picks up its sample and the one after it.
+    __m256i x = _mm256_i32gather_epi32((int *)p, AVX2_offsets(stride), 2);
+    return _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16); }
+  }
+}
+
+AVX2_TARGET static inline __m256i AVX2_gather_int24(void *in, uint32_t i, uint8_t stride){
+  // Scalar loads beat the hardware gather on the unaligned 3-byte
+  // offsets here.
+  return _mm256_setr_epi32(load_int24_wide(in, i*stride), load_int24_wide(in, (i+1)*stride),
+                           load_int24_wide(in, (i+2)*stride), load_int24_wide(in, (i+3)*stride),
+                           load_int24_wide(in, (i+4)*stride), load_int24_wide(in, (i+5)*stride),
+                           load_int24_wide(in, (i+6)*stride), load_int24_wide(in, (i+7)*stride));
+}
+
+AVX2_TARGET static inline __m256 AVX2_gather_float(void *in, uint32_t i, uint8_t stride){
+  float *p = ((float *)in) + i*stride;
+  switch(stride){
+  case 1: return _mm256_loadu_ps(p);
+  case 2: {
+    __m256 lo = _mm256_loadu_ps(p);
+    __m256 hi = _mm256_loadu_ps(p+8);
+    __m256 even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0))); }
+  default: return _mm256_i32gather_ps(p, AVX2_offsets(stride), 4);
+  }
+}
+
+AVX2_TARGET static inline __m256i AVX2_gather_int32(void *in, uint32_t i, uint8_t stride){
+  return _mm256_castps_si256(AVX2_gather_float(in, i, stride));
+}
+
+AVX2_TARGET static inline void AVX2_scatter_float(void *out, uint32_t i, uint8_t stride, __m256 v){
+  float *p = ((float *)out) + i*stride;
+  switch(stride){
+  case 1: _mm256_storeu_ps(p, v); break;
+  case 2: {
+    // Spread the lanes to the even slots, keeping the odd ones.
+    __m256 lo = _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    __m256 hi = _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+    _mm256_storeu_ps(p, _mm256_blend_ps(lo, _mm256_loadu_ps(p), 0xAA));
+    _mm256_storeu_ps(p+8, _mm256_blend_ps(hi, _mm256_loadu_ps(p+8), 0xAA));
+  } break;
+  default: {
+    float tmp[8];
+    _mm256_storeu_ps(tmp, v);
+    for(int k=0; k<8; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+AVX2_TARGET static inline void AVX2_scatter_int32(void *out, uint32_t i, uint8_t stride, __m256i v){
+  AVX2_scatter_float(out, i, stride, _mm256_castsi256_ps(v));
+}
+
+AVX2_TARGET static inline void AVX2_scatter_int16(void *out, uint32_t i, uint8_t stride, __m256i v){
+  int16_t *p = ((int16_t *)out) + i*stride;
+  switch(stride){
+  case 1: {
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(packed));
+  } break;
+  case 2: {
+    __m256i old = _mm256_loadu_si256((__m256i *)p);
+    _mm256_storeu_si256((__m256i *)p, _mm256_blend_epi16(old, v, 0x55));
+  } break;
+  default: {
+    int32_t tmp[8];
+    _mm256_storeu_si256((__m256i *)tmp, v);
+    for(int k=0; k<8; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+AVX2_TARGET static inline void AVX2_scatter_int24(void *out, uint32_t i, uint8_t stride, __m256i v){
+  int32_t tmp[8];
+  _mm256_storeu_si256((__m256i *)tmp, v);
+  for(int k=0; k<8; ++k) store_int24_wide(out, (i+k)*stride, tmp[k]);
+}
+
+AVX2_TARGET static inline __m256 AVX2_clip(__m256 a){
+  return _mm256_min_ps(_mm256_max_ps(a, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+}
+
+AVX2_TARGET static inline __m256 AVX2_decode(__m256i a, float negative, float positive){
+  __m256 sample = _mm256_cvtepi32_ps(a);
+  __m256 mask = _mm256_cmp_ps(sample, _mm256_setzero_ps(), _CMP_LT_OQ);
+  __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(positive), _mm256_set1_ps(negative), mask);
+  return _mm256_div_ps(sample, scale);
+}
+
+AVX2_TARGET static inline __m256 AVX2_decode_int16(__m256i a){ return AVX2_decode(a, -(float)INT16_MIN, INT16_MAX); }
+AVX2_TARGET static inline __m256 AVX2_decode_int24(__m256i a){ return AVX2_decode(a, -(float)INT24_MIN, INT24_MAX); }
+AVX2_TARGET static inline __m256 AVX2_decode_float(__m256 a){ return AVX2_clip(a); }
+
+AVX2_TARGET static inline __m128 AVX2_decode_int32_half(__m128i a){
+  __m256d sample = _mm256_cvtepi32_pd(a);
+  __m256d mask = _mm256_cmp_pd(sample, _mm256_setzero_pd(), _CMP_LT_OQ);
+  __m256d scale = _mm256_blendv_pd(_mm256_set1_pd(INT32_MAX), _mm256_set1_pd(-(double)INT32_MIN), mask);
+  return _mm256_cvtpd_ps(_mm256_div_pd(sample, scale));
+}
+
+AVX2_TARGET static inline __m256 AVX2_decode_int32(__m256i a){
+  __m128 lo = AVX2_decode_int32_half(_mm256_castsi256_si128(a));
+  __m128 hi = AVX2_decode_int32_half(_mm256_extracti128_si256(a, 1));
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+AVX2_TARGET static inline __m256i AVX2_encode_int16(__m256 a){ return ENCODE_LIMITS(AVX2, a, 0x8000, INT16_MAX, INT16_MIN); }
+AVX2_TARGET static inline __m256i AVX2_encode_int24(__m256 a){ return ENCODE_LIMITS(AVX2, a, 0x800000, INT24_MAX, INT24_MIN); }
+AVX2_TARGET static inline __m256i AVX2_encode_int32(__m256 a){ return ENCODE_LIMITS(AVX2, a, 0x80000000L, INT32_MAX, INT32_MIN); }
+AVX2_TARGET static inline __m256 AVX2_encode_float(__m256 a){ return AVX2_clip(a); }
+
+AVX2_TARGET static inline void AVX2_split_int16(void *in, uint32_t i, __m256i *l, __m256i *r){
+  __m256i x = _mm256_loadu_si256((__m256i *)(((int16_t *)in) + 2*i));
+  *l = _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16);
+  *r = _mm256_srai_epi32(x, 16);
+}
+
+AVX2_TARGET static inline void AVX2_split_int24(void *in, uint32_t i, __m256i *l, __m256i *r){
+  *l = AVX2_gather_int24(in, i, 2);
+  *r = AVX2_gather_int24(((uint8_t *)in)+3, i, 2);
+}
+
+AVX2_TARGET static inline void AVX2_split_float(void *in, uint32_t i, __m256 *l, __m256 *r){
+  float *p = ((float *)in) + 2*i;
+  __m256 lo = _mm256_loadu_ps(p);
+  __m256 hi = _mm256_loadu_ps(p+8);
+  __m256 even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+  __m256 odd = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+  *l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+  *r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+AVX2_TARGET static inline void AVX2_split_int32(void *in, uint32_t i, __m256i *l, __m256i *r){
+  __m256 lf, rf;
+  AVX2_split_float(in, i, &lf, &rf);
+  *l = _mm256_castps_si256(lf);
+  *r = _mm256_castps_si256(rf);
+}
+
+AVX2_TARGET static inline void AVX2_merge_int16(void *out, uint32_t i, __m256i l, __m256i r){
+  __m256i x = _mm256_or_si256(_mm256_and_si256(l, _mm256_set1_epi32(0xFFFF)), _mm256_slli_epi32(r, 16));
+  _mm256_storeu_si256((__m256i *)(((int16_t *)out) + 2*i), x);
+}
+
+AVX2_TARGET static inline void AVX2_merge_int24(void *out, uint32_t i, __m256i l, __m256i r){
+  int32_t left[8], right[8];
+  _mm256_storeu_si256((__m256i *)left, l);
+  _mm256_storeu_si256((__m256i *)right, r);
+  store_int24_stereo(out, i, left, right, 8);
+}
+
+AVX2_TARGET static inline void AVX2_merge_float(void *out, uint32_t i, __m256 l, __m256 r){
+  float *p = ((float *)out) + 2*i;
+  __m256 lo = _mm256_unpacklo_ps(l, r);
+  __m256 hi = _mm256_unpackhi_ps(l, r);
+  _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+  _mm256_storeu_ps(p+8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+AVX2_TARGET static inline void AVX2_merge_int32(void *out, uint32_t i, __m256i l, __m256i r){
+  AVX2_merge_float(out, i, _mm256_castsi256_ps(l), _mm256_castsi256_ps(r));
+}
+
+DEF_SIMD_KERNELS(AVX2)
+#endif
+
+//// AVX-512
+// Only the foundation instructions are used, so this runs on every
+// AVX-512 CPU. The mask registers take the place of the blends.
+#ifdef HAVE_AVX512
+#define AVX512_TARGET __attribute__((target("avx512f")))
+#define AVX512_N 16
+typedef __m512 AVX512_vf;
+typedef __m512i AVX512_vi;
+
+AVX512_TARGET static inline __m512 AVX512_set(float x){ return _mm512_set1_ps(x); }
+AVX512_TARGET static inline __m512i AVX512_set_i(int32_t x){ return _mm512_set1_epi32(x); }
+AVX512_TARGET static inline __m512 AVX512_index(){ return _mm512_setr_ps(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16); }
+AVX512_TARGET static inline __m512 AVX512_load_f(float *p){ return _mm512_loadu_ps(p); }
+AVX512_TARGET static inline void AVX512_store_f(float *p, __m512 v){ _mm512_storeu_ps(p, v); }
+AVX512_TARGET static inline __m512 AVX512_add(__m512 a, __m512 b){ return _mm512_add_ps(a, b); }
+AVX512_TARGET static inline __m512 AVX512_mul(__m512 a, __m512 b){ return _mm512_mul_ps(a, b); }
+AVX512_TARGET static inline __mmask16 AVX512_ge(__m512 a, __m512 b){ return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+AVX512_TARGET static inline __m512i AVX512_trunc(__m512 a){ return _mm512_cvttps_epi32(a); }
+AVX512_TARGET static inline __m512 AVX512_cvt(__m512i a){ return _mm512_cvtepi32_ps(a); }
+
+AVX512_TARGET static inline __m512i AVX512_select_i(__mmask16 mask, __m512i a, __m512i b){
+  return _mm512_mask_blend_epi32(mask, b, a);
+}
+
+AVX512_TARGET static inline __m512i AVX512_offsets(uint8_t stride){
+  return _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stride));
+}
+
+AVX512_TARGET static inline __m512i AVX512_even(){
+  return _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+}
+
+AVX512_TARGET static inline __m512i AVX512_odd(){
+  return _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+}
+
+AVX512_TARGET static inline __m512i AVX512_gather_int16(void *in, uint32_t i, uint8_t stride){
+  int16_t *p = ((int16_t *)in) + i*stride;
+  switch(stride){
+  case 1: return _mm512_cvtepi16_epi32(_mm256_loadu_si256((__m256i *)p));
+  case 2: return _mm512_srai_epi32(_mm512_slli_epi32(_mm512_loadu_si512(p), 16), 16);
+  default: {
+    // Each lane picks up its sample and the one after it.
+    __m512i x = _mm512_i32gather_epi32(AVX512_offsets(stride), p, 2);
+    return _mm512_srai_epi32(_mm512_slli_epi32(x, 16), 16); }
+  }
+}
+
+AVX512_TARGET static inline __m512i AVX512_gather_int24(void *in, uint32_t i, uint8_t stride){
+  int32_t tmp[16];
+  for(int k=0; k<16; ++k) tmp[k] = load_int24_wide(in, (i+k)*stride);
+  return _mm512_loadu_si512(tmp);
+}
+
+AVX512_TARGET static inline __m512 AVX512_gather_float(void *in, uint32_t i, uint8_t stride){
+  float *p = ((float *)in) + i*stride;
+  switch(stride){
+  case 1: return _mm512_loadu_ps(p);
+  case 2: return _mm512_permutex2var_ps(_mm512_loadu_ps(p), AVX512_even(), _mm512_loadu_ps(p+16));
+  default: return _mm512_i32gather_ps(AVX512_offsets(stride), p, 4);
+  }
+}
+
+AVX512_TARGET static inline __m512i AVX512_gather_int32(void *in, uint32_t i, uint8_t stride){
+  return _mm512_castps_si512(AVX512_gather_float(in, i, stride));
+}
+
+AVX512_TARGET static inline void AVX512_scatter_float(void *out, uint32_t i, uint8_t stride, __m512 v){
+  float *p = ((float *)out) + i*stride;
+  switch(stride){
+  case 1: _mm512_storeu_ps(p, v); break;
+  case 2: {
+    // Spread the lanes to the even slots and only store those.
+    __m512i lo = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+    __m512i hi = _mm512_add_epi32(lo, _mm512_set1_epi32(8));
+    _mm512_mask_storeu_ps(p, 0x5555, _mm512_permutexvar_ps(lo, v));
+    _mm512_mask_storeu_ps(p+16, 0x5555, _mm512_permutexvar_ps(hi, v));
+  } break;
+  default: _mm512_i32scatter_ps(p, AVX512_offsets(stride), v, 4);
+  }
+}
+
+AVX512_TARGET static inline void AVX512_scatter_int32(void *out, uint32_t i, uint8_t stride, __m512i v){
+  AVX512_scatter_float(out, i, stride, _mm512_castsi512_ps(v));
+}
+
+AVX512_TARGET static inline void AVX512_scatter_int16(void *out, uint32_t i, uint8_t stride, __m512i v){
+  int16_t *p = ((int16_t *)out) + i*stride;
+  switch(stride){
+  case 1: _mm256_storeu_si256((__m256i *)p, _mm512_cvtepi32_epi16(v)); break;
+  case 2: {
+    __m512i old = _mm512_loadu_si512(p);
+    __m512i low = _mm512_set1_epi32(0xFFFF);
+    _mm512_storeu_si512(p, _mm512_or_si512(_mm512_andnot_si512(low, old), _mm512_and_si512(low, v)));
+  } break;
+  default: {
+    int32_t tmp[16];
+    _mm512_storeu_si512(tmp, v);
+    for(int k=0; k<16; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+AVX512_TARGET static inline void AVX512_scatter_int24(void *out, uint32_t i, uint8_t stride, __m512i v){
+  int32_t tmp[16];
+  _mm512_storeu_si512(tmp, v);
+  for(int k=0; k<16; ++k) store_int24_wide(out, (i+k)*stride, tmp[k]);
+}
+
+AVX512_TARGET static inline __m512 AVX512_clip(__m512 a){
+  return _mm512_min_ps(_mm512_max_ps(a, _mm512_set1_ps(-1.0f)), _mm512_set1_ps(1.0f));
+}
+
+AVX512_TARGET static inline __m512 AVX512_decode(__m512i a, float negative, float positive){
+  __m512 sample = _mm512_cvtepi32_ps(a);
+  __mmask16 mask = _mm512_cmp_ps_mask(sample, _mm512_setzero_ps(), _CMP_LT_OQ);
+  __m512 scale = _mm512_mask_blend_ps(mask, _mm512_set1_ps(positive), _mm512_set1_ps(negative));
+  return _mm512_div_ps(sample, scale);
+}
+
+AVX512_TARGET static inline __m512 AVX512_decode_int16(__m512i a){ return AVX512_decode(a, -(float)INT16_MIN, INT16_MAX); }
+AVX512_TARGET static inline __m512 AVX512_decode_int24(__m512i a){ return AVX512_decode(a, -(float)INT24_MIN, INT24_MAX); }
+AVX512_TARGET static inline __m512 AVX512_decode_float(__m512 a){ return AVX512_clip(a); }
+
+AVX512_TARGET static inline __m256 AVX512_decode_int32_half(__m256i a){
+  __m512d sample = _mm512_cvtepi32_pd(a);
+  __mmask8 mask = _mm512_cmp_pd_mask(sample, _mm512_setzero_pd(), _CMP_LT_OQ);
+  __m512d scale = _mm512_mask_blend_pd(mask, _mm512_set1_pd(INT32_MAX), _mm512_set1_pd(-(double)INT32_MIN));
+  return _mm512_cvtpd_ps(_mm512_div_pd(sample, scale));
+}
+
+AVX512_TARGET static inline __m512 AVX512_decode_int32(__m512i a){
+  __m256 lo = AVX512_decode_int32_half(_mm512_castsi512_si256(a));
+  __m256 hi = AVX512_decode_int32_half(_mm512_extracti64x4_epi64(a, 1));
+  return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(lo)), _mm256_castps_pd(hi), 1));
+}
+
+AVX512_TARGET static inline __m512i AVX512_encode_int16(__m512 a){ return ENCODE_LIMITS(AVX512, a, 0x8000, INT16_MAX, INT16_MIN); }
+AVX512_TARGET static inline __m512i AVX512_encode_int24(__m512 a){ return ENCODE_LIMITS(AVX512, a, 0x800000, INT24_MAX, INT24_MIN); }
+AVX512_TARGET static inline __m512i AVX512_encode_int32(__m512 a){ return ENCODE_LIMITS(AVX512, a, 0x80000000L, INT32_MAX, INT32_MIN); }
+AVX512_TARGET static inline __m512 AVX512_encode_float(__m512 a){ return AVX512_clip(a); }
+
+AVX512_TARGET static inline void AVX512_split_int16(void *in, uint32_t i, __m512i *l, __m512i *r){
+  __m512i x = _mm512_loadu_si512(((int16_t *)in) + 2*i);
+  *l = _mm512_srai_epi32(_mm512_slli_epi32(x, 16), 16);
+  *r = _mm512_srai_epi32(x, 16);
+}
+
+AVX512_TARGET static inline void AVX512_split_int24(void *in, uint32_t i, __m512i *l, __m512i *r){
+  *l = AVX512_gather_int24(in, i, 2);
+  *r = AVX512_gather_int24(((uint8_t *)in)+3, i, 2);
+}
+
+AVX512_TARGET static inline void AVX512_split_float(void *in, uint32_t i, __m512 *l, __m512 *r){
+  float *p = ((float *)in) + 2*i;
+  __m512 lo = _mm512_loadu_ps(p);
+  __m512 hi = _mm512_loadu_ps(p+16);
+  *l = _mm512_permutex2var_ps(lo, AVX512_even(), hi);
+  *r = _mm512_permutex2var_ps(lo, AVX512_odd(), hi);
+}
+
+AVX512_TARGET static inline void AVX512_split_int32(void *in, uint32_t i, __m512i *l, __m512i *r){
+  __m512 lf, rf;
+  AVX512_split_float(in, i, &lf, &rf);
+  *l = _mm512_castps_si512(lf);
+  *r = _mm512_castps_si512(rf);
+}
+
+AVX512_TARGET static inline void AVX512_merge_int16(void *out, uint32_t i, __m512i l, __m512i r){
+  __m512i x = _mm512_or_si512(_mm512_and_si512(l, _mm512_set1_epi32(0xFFFF)), _mm512_slli_epi32(r, 16));
+  _mm512_storeu_si512(((int16_t *)out) + 2*i, x);
+}
+
+AVX512_TARGET static inline void AVX512_merge_int24(void *out, uint32_t i, __m512i l, __m512i r){
+  int32_t left[16], right[16];
+  _mm512_storeu_si512(left, l);
+  _mm512_storeu_si512(right, r);
+  store_int24_stereo(out, i, left, right, 16);
+}
+
+AVX512_TARGET static inline void AVX512_merge_float(void *out, uint32_t i, __m512 l, __m512 r){
+  float *p = ((float *)out) + 2*i;
+  __m512i lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+  __m512i hi = _mm512_add_epi32(lo, _mm512_set1_epi32(8));
+  _mm512_storeu_ps(p, _mm512_permutex2var_ps(l, lo, r));
+  _mm512_storeu_ps(p+16, _mm512_permutex2var_ps(l, hi, r));
+}
+
+AVX512_TARGET static inline void AVX512_merge_int32(void *out, uint32_t i, __m512i l, __m512i r){
+  AVX512_merge_float(out, i, _mm512_castsi512_ps(l), _mm512_castsi512_ps(r));
+}
+
+DEF_SIMD_KERNELS(AVX512)
+#endif
+
+//// NEON
+#ifdef HAVE_NEON
+#define NEON_TARGET
+#define NEON_N 4
+typedef float32x4_t NEON_vf;
+typedef int32x4_t NEON_vi;
+
+static inline float32x4_t NEON_set(float x){ return vdupq_n_f32(x); }
+static inline int32x4_t NEON_set_i(int32_t x){ return vdupq_n_s32(x); }
+static inline float32x4_t NEON_load_f(float *p){ return vld1q_f32(p); }
+static inline void NEON_store_f(float *p, float32x4_t v){ vst1q_f32(p, v); }
+static inline float32x4_t NEON_add(float32x4_t a, float32x4_t b){ return vaddq_f32(a, b); }
+static inline float32x4_t NEON_mul(float32x4_t a, float32x4_t b){ return vmulq_f32(a, b); }
+static inline uint32x4_t NEON_ge(float32x4_t a, float32x4_t b){ return vcgeq_f32(a, b); }
+static inline int32x4_t NEON_trunc(float32x4_t a){ return vcvtq_s32_f32(a); }
+static inline float32x4_t NEON_cvt(int32x4_t a){ return vcvtq_f32_s32(a); }
+static inline int32x4_t NEON_select_i(uint32x4_t mask, int32x4_t a, int32x4_t b){ return vbslq_s32(mask, a, b); }
+
+static inline float32x4_t NEON_index(){
+  float index[4] = {1, 2, 3, 4};
+  return vld1q_f32(index);
+}
+
+static inline int32x4_t NEON_gather_int16(void *in, uint32_t i, uint8_t stride){
+  int16_t *p = ((int16_t *)in) + i*stride;
+  switch(stride){
+  case 1: return vmovl_s16(vld1_s16(p));
+  case 2: return vmovl_s16(vld2_s16(p).val[0]);
+  default: {
+    int32_t tmp[4] = {p[0], p[stride], p[2*stride], p[3*stride]};
+    return vld1q_s32(tmp); }
+  }
+}
+
+static inline int32x4_t NEON_gather_int24(void *in, uint32_t i, uint8_t stride){
+  int32_t tmp[4] = {load_int24_wide(in, i*stride), load_int24_wide(in, (i+1)*stride),
+                    load_int24_wide(in, (i+2)*stride), load_int24_wide(in, (i+3)*stride)};
+  return vld1q_s32(tmp);
+}
+
+static inline float32x4_t NEON_gather_float(void *in, uint32_t i, uint8_t stride){
+  float *p = ((float *)in) + i*stride;
+  switch(stride){
+  case 1: return vld1q_f32(p);
+  case 2: return vld2q_f32(p).val[0];
+  default: {
+    float tmp[4] = {p[0], p[stride], p[2*stride], p[3*stride]};
+    return vld1q_f32(tmp); }
+  }
+}
+
+static inline int32x4_t NEON_gather_int32(void *in, uint32_t i, uint8_t stride){
+  return vreinterpretq_s32_f32(NEON_gather_float(in, i, stride));
+}
+
+static inline void NEON_scatter_float(void *out, uint32_t i, uint8_t stride, float32x4_t v){
+  float *p = ((float *)out) + i*stride;
+  switch(stride){
+  case 1: vst1q_f32(p, v); break;
+  case 2: {
+    float32x4x2_t pair = vld2q_f32(p);
+    pair.val[0] = v;
+    vst2q_f32(p, pair);
+  } break;
+  default: {
+    float tmp[4];
+    vst1q_f32(tmp, v);
+    for(int k=0; k<4; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+static inline void NEON_scatter_int32(void *out, uint32_t i, uint8_t stride, int32x4_t v){
+  NEON_scatter_float(out, i, stride, vreinterpretq_f32_s32(v));
+}
+
+static inline void NEON_scatter_int16(void *out, uint32_t i, uint8_t stride, int32x4_t v){
+  int16_t *p = ((int16_t *)out) + i*stride;
+  switch(stride){
+  case 1: vst1_s16(p, vmovn_s32(v)); break;
+  case 2: {
+    int16x4x2_t pair = vld2_s16(p);
+    pair.val[0] = vmovn_s32(v);
+    vst2_s16(p, pair);
+  } break;
+  default: {
+    int32_t tmp[4];
+    vst1q_s32(tmp, v);
+    for(int k=0; k<4; ++k) p[k*stride] = tmp[k];
+  }}
+}
+
+static inline void NEON_scatter_int24(void *out, uint32_t i, uint8_t stride, int32x4_t v){
+  int32_t tmp[4];
+  vst1q_s32(tmp, v);
+  for(int k=0; k<4; ++k) store_int24_wide(out, (i+k)*stride, tmp[k]);
+}
+
+static inline float32x4_t NEON_clip(float32x4_t a){
+  // fmaxnm prefers the number over NaN, which maps NaN to -1.
+  return vminq_f32(vmaxnmq_f32(a, vdupq_n_f32(-1.0f)), vdupq_n_f32(1.0f));
+}
+
+static inline float32x4_t NEON_decode(int32x4_t a, float negative, float positive){
+  float32x4_t sample = vcvtq_f32_s32(a);
+  float32x4_t scale = vbslq_f32(vcltq_f32(sample, vdupq_n_f32(0.0f)), vdupq_n_f32(negative), vdupq_n_f32(positive));
+  return vdivq_f32(sample, scale);
+}
+
+static inline float32x4_t NEON_decode_int16(int32x4_t a){ return NEON_decode(a, -(float)INT16_MIN, INT16_MAX); }
+static inline float32x4_t NEON_decode_int24(int32x4_t a){ return NEON_decode(a, -(float)INT24_MIN, INT24_MAX); }
+static inline float32x4_t NEON_decode_float(float32x4_t a){ return NEON_clip(a); }
+
+static inline float32x2_t NEON_decode_int32_half(int32x2_t a){
+  float64x2_t sample = vcvtq_f64_s64(vmovl_s32(a));
+  float64x2_t scale = vbslq_f64(vcltq_f64(sample, vdupq_n_f64(0.0)), vdupq_n_f64(-(double)INT32_MIN), vdupq_n_f64(INT32_MAX));
+  return vcvt_f32_f64(vdivq_f64(sample, scale));
+}
+
+static inline float32x4_t NEON_decode_int32(int32x4_t a){
+  return vcombine_f32(NEON_decode_int32_half(vget_low_s32(a)), NEON_decode_int32_half(vget_high_s32(a)));
+}
+
+static inline int32x4_t NEON_encode_int16(float32x4_t a){ return ENCODE_LIMITS(NEON, a, 0x8000, INT16_MAX, INT16_MIN); }
+static inline int32x4_t NEON_encode_int24(float32x4_t a){ return ENCODE_LIMITS(NEON, a, 0x800000, INT24_MAX, INT24_MIN); }
+static inline int32x4_t NEON_encode_int32(float32x4_t a){ return ENCODE_LIMITS(NEON, a, 0x80000000L, INT32_MAX, INT32_MIN); }
+static inline float32x4_t NEON_encode_float(float32x4_t a){ return NEON_clip(a); }
+
+static inline void NEON_split_int16(void *in, uint32_t i, int32x4_t *l, int32x4_t *r){
+  int16x4x2_t pair = vld2_s16(((int16_t *)in) + 2*i);
+  *l = vmovl_s16(pair.val[0]);
+  *r = vmovl_s16(pair.val[1]);
+}
+
+static inline void NEON_split_int24(void *in, uint32_t i, int32x4_t *l, int32x4_t *r){
+  *l = NEON_gather_int24(in, i, 2);
+  *r = NEON_gather_int24(((uint8_t *)in)+3, i, 2);
+}
+
+static inline void NEON_split_float(void *in, uint32_t i, float32x4_t *l, float32x4_t *r){
+  float32x4x2_t pair = vld2q_f32(((float *)in) + 2*i);
+  *l = pair.val[0];
+  *r = pair.val[1];
+}
+
+static inline void NEON_split_int32(void *in, uint32_t i, int32x4_t *l, int32x4_t *r){
+  int32x4x2_t pair = vld2q_s32(((int32_t *)in) + 2*i);
+  *l = pair.val[0];
+  *r = pair.val[1];
+}
+
+static inline void NEON_merge_int16(void *out, uint32_t i, int32x4_t l, int32x4_t r){
+  int16x4x2_t pair = {{vmovn_s32(l), vmovn_s32(r)}};
+  vst2_s16(((int16_t *)out) + 2*i, pair);
+}
+
+static inline void NEON_merge_int24(void *out, uint32_t i, int32x4_t l, int32x4_t r){
+  int32_t left[4], right[4];
+  vst1q_s32(left, l);
+  vst1q_s32(right, r);
+  store_int24_stereo(out, i, left, right, 4);
+}
+
+static inline void NEON_merge_float(void *out, uint32_t i, float32x4_t l, float32x4_t r){
+  float32x4x2_t pair = {{l, r}};
+  vst2q_f32(((float *)out) + 2*i, pair);
+}
+
+static inline void NEON_merge_int32(void *out, uint32_t i, int32x4_t l, int32x4_t r){
+  int32x4x2_t pair = {{l, r}};
+  vst2q_s32(((int32_t *)out) + 2*i, pair);
+}
+
+DEF_SIMD_KERNELS(NEON)
+#endif
+
+//// Dispatch
+// Pick the exact or the fast decoders of an ISA.
+#define SIMD_DECODER(isa, direction, encoding, fast)            \
+  if(fast){ SIMD_TRANSLATOR_FAST(isa, direction, encoding); }   \
+  else{ SIMD_TRANSLATOR(isa, direction, encoding); }
+
+mixed_transfer_function_from simd_translator_from(enum mixed_encoding encoding, char fast){
+#if defined(HAVE_AVX2)
+  if(cpu_features & MIXED_CPU_AVX512){
+    SIMD_DECODER(AVX512, from, encoding, fast);
+  }
+  if(cpu_features & MIXED_CPU_AVX2){
+    SIMD_DECODER(AVX2, from, encoding, fast);
+  }
+  if(cpu_features & MIXED_CPU_SSE2){
+    SIMD_DECODER(SSE2, from, encoding, fast);
+  }
+#elif defined(HAVE_NEON)
+  if(cpu_features & MIXED_CPU_NEON){
+    SIMD_DECODER(NEON, from, encoding, fast);
+  }
+#endif
+  IGNORE(encoding);
+  IGNORE(fast);
+  return 0;
+}
+
+transfer_fused_from simd_fused_from(enum mixed_encoding encoding, channel_t channels, char fast){
+#if defined(HAVE_AVX2)
+  if(2 < channels && channels <= SSE2_FRAMES_MAX && (cpu_features & MIXED_CPU_SSE2)){
+    switch(encoding){
+    case MIXED_INT16: return (fast)? SSE2_frames_from_int16_fast : SSE2_frames_from_int16;
+    case MIXED_INT32: return (fast)? SSE2_frames_from_int32_fast : SSE2_frames_from_int32;
+    case MIXED_FLOAT: return SSE2_frames_from_float;
+    default: return 0;
+    }
+  }
+  if(channels != 2) return 0;
+  if(cpu_features & MIXED_CPU_AVX512){
+    SIMD_DECODER(AVX512, fused_from, encoding, fast);
+  }
+  if(cpu_features & MIXED_CPU_AVX2){
+    SIMD_DECODER(AVX2, fused_from, encoding, fast);
+  }
+  if(cpu_features & MIXED_CPU_SSE2){
+    SIMD_DECODER(SSE2, fused_from, encoding, fast);
+  }
+#elif defined(HAVE_NEON)
+  if(channels != 2) return 0;
+  if(cpu_features & MIXED_CPU_NEON){
+    SIMD_DECODER(NEON, fused_from, encoding, fast);
+  }
+#endif
+  IGNORE(encoding);
+  IGNORE(channels);
+  IGNORE(fast);
+  return 0;
+}
+
+transfer_fused_to simd_fused_to(enum mixed_encoding encoding, channel_t channels){
+#if defined(HAVE_AVX2)
+  if(2 < channels && channels <= SSE2_FRAMES_MAX && (cpu_features & MIXED_CPU_SSE2)){
+    switch(encoding){
+    case MIXED_INT32: return SSE2_frames_to_int32;
+    case MIXED_FLOAT: return SSE2_frames_to_float;
+    default: return 0;
+    }
+  }
+  if(channels != 2) return 0;
+  if(cpu_features & MIXED_CPU_AVX512){
+    SIMD_TRANSLATOR(AVX512, fused_to, encoding);
+  }
+  if(cpu_features & MIXED_CPU_AVX2){
+    SIMD_TRANSLATOR(AVX2, fused_to, encoding);
+  }
+  if(cpu_features & MIXED_CPU_SSE2){
+    SIMD_TRANSLATOR(SSE2, fused_to, encoding);
+  }
+#elif defined(HAVE_NEON)
+  if(channels != 2) return 0;
+  if(cpu_features & MIXED_CPU_NEON){
+    SIMD_TRANSLATOR(NEON, fused_to, encoding);
+  }
+#endif
+  IGNORE(encoding);
+  IGNORE(channels);
+  return 0;
+}
+
+mixed_transfer_function_to simd_translator_to(enum mixed_encoding encoding){
+#if defined(HAVE_AVX2)
+  if(cpu_features & MIXED_CPU_AVX512){
+    SIMD_TRANSLATOR(AVX512, to, encoding);
+  }
+  if(cpu_features & MIXED_CPU_AVX2){
+    SIMD_TRANSLATOR(AVX2, to, encoding);
+  }
+  if(cpu_features & MIXED_CPU_SSE2){
+    SIMD_TRANSLATOR(SSE2, to, encoding);
+  }
+#elif defined(HAVE_NEON)
+  if(cpu_features & MIXED_CPU_NEON){
+    SIMD_TRANSLATOR(NEON, to, encoding);
+  }
+#endif
+  IGNORE(encoding);
+  return 0;
+}
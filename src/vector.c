@@ -25,12 +25,16 @@ int vector_add_pos(uint32_t i, void *element, struct vector *vector){
   if(!data){
     if(vector->size == 0) vector->size = BASE_VECTOR_SIZE;
     data = mixed_calloc(vector->size, sizeof(void *));
+    vector->data = data;
     vector->count = 0;
   }
-  // Too small
-  while(data && vector->size <= i){
+  // Too small, counting the slot the shift moves the last element into
+  while(data && vector->size <= MAX(i, vector->count)){
     data = crealloc(vector->data, vector->size, vector->size*2, sizeof(void *));
-    if(data) vector->size *= 2;
+    if(data){
+      vector->data = data;
+      vector->size *= 2;
+    }
   }
   // Check completeness
   if(!data){
@@ -38,7 +42,7 @@ int vector_add_pos(uint32_t i, void *element, struct vector *vector){
     return 0;
   }
   // Shift
-  for(uint32_t j=vector->count+1; i<j; --j){
+  for(uint32_t j=vector->count; i<j; --j){
     data[j] = data[j-1];
   }
   data[i] = element;
@@ -92,3 +96,225 @@ int vector_clear(struct vector *vector){
   vector->count = 0;
   return vector_maybe_shrink(vector);
 }
+
+int vector_reserve(uint32_t size, struct vector *vector){
+  if(size == 0 || (size <= vector->size && vector->data)) return 1;
+  if(size < vector->size) size = vector->size;
+  void **data = crealloc(vector->data, (vector->data)? vector->size : 0, size, sizeof(void *));
+  if(!data){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    return 0;
+  }
+  vector->data = data;
+  vector->size = size;
+  return 1;
+}
+
+static void rcu_lock(struct rcu_vector *vector){
+  while(!atomic_cas(vector->lock, 0, 1));
+}
+
+static void rcu_unlock(struct rcu_vector *vector){
+  atomic_write(vector->lock, 0);
+}
+
+// A retired array can go once no reader is inside, as any reader that
+// enters afterwards loads the current array. One is kept as a spare so
+// that later changes do not need to allocate.
+static void rcu_reclaim(struct rcu_vector *vector){
+  if(__atomic_load_n(&vector->readers, __ATOMIC_SEQ_CST) != 0) return;
+  struct rcu_array *array = vector->retired;
+  vector->retired = 0;
+  while(array){
+    struct rcu_array *next = array->next;
+    if(!vector->spare || vector->spare->size < array->size){
+      mixed_free(vector->spare);
+      vector->spare = array;
+      array->next = 0;
+    }else{
+      mixed_free(array);
+    }
+    array = next;
+  }
+}
+
+static struct rcu_array *rcu_make_array(uint32_t count, struct rcu_vector *vector){
+  rcu_reclaim(vector);
+  struct rcu_array *array = vector->spare;
+  if(array && count <= array->size){
+    vector->spare = 0;
+  }else{
+    // Leave some room so that a spare can serve the next change.
+    uint32_t size = MAX(count + count/2 + 1, vector->capacity);
+    array = mixed_calloc(1, sizeof(struct rcu_array) + size*sizeof(void *));
+    if(!array){
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    array->size = size;
+  }
+  array->next = 0;
+  array->count = count;
+  array->popped = 0;
+  return array;
+}
+
+// Stops pops on the array and returns the index of its first element.
+// A change that gives up thaws the array again.
+static uint32_t rcu_freeze(struct rcu_array *array){
+  if(!array) return 0;
+  return __atomic_fetch_or(&array->popped, RCU_FROZEN, __ATOMIC_SEQ_CST) & ~RCU_FROZEN;
+}
+
+static void rcu_thaw(struct rcu_array *array){
+  if(array) __atomic_fetch_and(&array->popped, ~RCU_FROZEN, __ATOMIC_SEQ_CST);
+}
+
+static void rcu_publish(struct rcu_array *array, struct rcu_vector *vector){
+  struct rcu_array *old = vector->current;
+  __atomic_store_n(&vector->current, array, __ATOMIC_SEQ_CST);
+  if(old){
+    old->next = vector->retired;
+    vector->retired = old;
+  }
+  rcu_reclaim(vector);
+}
+
+struct rcu_array *rcu_enter(struct rcu_vector *vector){
+  __atomic_add_fetch(&vector->readers, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&vector->current, __ATOMIC_SEQ_CST);
+}
+
+void rcu_leave(struct rcu_vector *vector){
+  __atomic_sub_fetch(&vector->readers, 1, __ATOMIC_SEQ_CST);
+}
+
+int rcu_pop(uint32_t i, struct rcu_array *array){
+  uint32_t first = i;
+  if(array->count <= i) return 0;
+  return __atomic_compare_exchange_n(&array->popped, &first, i+1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void rcu_wait(struct rcu_vector *vector){
+  while(__atomic_load_n(&vector->readers, __ATOMIC_SEQ_CST) != 0);
+}
+
+int rcu_add_pos(uint32_t i, void *element, struct rcu_vector *vector){
+  rcu_lock(vector);
+  struct rcu_array *old = vector->current;
+  uint32_t first = rcu_freeze(old);
+  uint32_t count = (old)? old->count - first : 0;
+  if(count < i) i = count;
+  struct rcu_array *array = rcu_make_array(count+1, vector);
+  if(!array){
+    rcu_thaw(old);
+    rcu_unlock(vector);
+    return 0;
+  }
+  for(uint32_t j=0; j<i; ++j)
+    array->data[j] = old->data[first+j];
+  array->data[i] = element;
+  for(uint32_t j=i; j<count; ++j)
+    array->data[j+1] = old->data[first+j];
+  rcu_publish(array, vector);
+  rcu_unlock(vector);
+  return 1;
+}
+
+int rcu_add(void *element, struct rcu_vector *vector){
+  return rcu_add_pos(UINT32_MAX, element, vector);
+}
+
+// Removes the element at the absolute index i of the frozen current
+// array, whose elements start at first.
+static int rcu_remove(uint32_t i, uint32_t first, struct rcu_vector *vector){
+  struct rcu_array *old = vector->current;
+  struct rcu_array *array = rcu_make_array(old->count-first-1, vector);
+  if(!array){
+    rcu_thaw(old);
+    return 0;
+  }
+  for(uint32_t j=first, k=0; j<old->count; ++j){
+    if(j != i) array->data[k++] = old->data[j];
+  }
+  rcu_publish(array, vector);
+  return 1;
+}
+
+int rcu_remove_pos(uint32_t i, struct rcu_vector *vector){
+  rcu_lock(vector);
+  struct rcu_array *old = vector->current;
+  uint32_t first = rcu_freeze(old);
+  if(!old || old->count - first <= i){
+    rcu_thaw(old);
+    rcu_unlock(vector);
+    mixed_err(MIXED_INVALID_LOCATION);
+    return 0;
+  }
+  int result = rcu_remove(first+i, first, vector);
+  rcu_unlock(vector);
+  return result;
+}
+
+int rcu_remove_item(void *element, struct rcu_vector *vector){
+  rcu_lock(vector);
+  struct rcu_array *old = vector->current;
+  uint32_t first = rcu_freeze(old);
+  int result = 1;
+  uint32_t i = first;
+  for(; old && i<old->count; ++i){
+    if(old->data[i] == element) break;
+  }
+  if(old && i < old->count)
+    result = rcu_remove(i, first, vector);
+  else
+    rcu_thaw(old);
+  rcu_unlock(vector);
+  return result;
+}
+
+int rcu_clear(struct rcu_array **old, struct rcu_vector *vector){
+  rcu_lock(vector);
+  struct rcu_array *array = rcu_make_array(0, vector);
+  if(!array){
+    rcu_unlock(vector);
+    return 0;
+  }
+  *old = vector->current;
+  rcu_freeze(*old);
+  __atomic_store_n(&vector->current, array, __ATOMIC_SEQ_CST);
+  rcu_unlock(vector);
+  return 1;
+}
+
+int rcu_reserve(uint32_t size, struct rcu_vector *vector){
+  rcu_lock(vector);
+  vector->capacity = MAX(vector->capacity, size);
+  rcu_reclaim(vector);
+  if(!vector->spare || vector->spare->size < vector->capacity){
+    struct rcu_array *spare = mixed_calloc(1, sizeof(struct rcu_array) + vector->capacity*sizeof(void *));
+    if(!spare){
+      rcu_unlock(vector);
+      mixed_err(MIXED_OUT_OF_MEMORY);
+      return 0;
+    }
+    spare->size = vector->capacity;
+    mixed_free(vector->spare);
+    vector->spare = spare;
+  }
+  rcu_unlock(vector);
+  return 1;
+}
+
+void free_rcu_vector(struct rcu_vector *vector){
+  rcu_publish(0, vector);
+  struct rcu_array *array = vector->retired;
+  while(array){
+    struct rcu_array *next = array->next;
+    mixed_free(array);
+    array = next;
+  }
+  mixed_free(vector->spare);
+  vector->retired = 0;
+  vector->spare = 0;
+}
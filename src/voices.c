@@ -0,0 +1,141 @@
+#include "internal.h"
+
+static inline int voice_before(uint32_t a, uint32_t b, const float *priority, const float *loudness){
+  if(priority[a] != priority[b]) return priority[b] < priority[a];
+  if(loudness[a] != loudness[b]) return loudness[b] < loudness[a];
+  return a < b;
+}
+
+// Partial quickselect: afterwards the first limit entries of order are
+// the best ones, in no particular order. The ordering is total, as
+// ties fall to the lower index.
+static void voices_select(uint32_t *order, uint32_t count, uint32_t limit, const float *priority, const float *loudness){
+  uint32_t lo = 0, hi = count;
+  while(lo < hi){
+    uint32_t mid = lo+(hi-lo)/2, t;
+    t = order[mid]; order[mid] = order[hi-1]; order[hi-1] = t;
+    uint32_t pivot = order[hi-1], store = lo;
+    for(uint32_t i=lo; i<hi-1; ++i){
+      if(voice_before(order[i], pivot, priority, loudness)){
+        t = order[i]; order[i] = order[store]; order[store] = t;
+        ++store;
+      }
+    }
+    order[hi-1] = order[store];
+    order[store] = pivot;
+    if(store == limit || store+1 == limit) return;
+    if(store < limit) lo = store+1;
+    else hi = store;
+  }
+}
+
+void voices_limit(uint32_t count, uint32_t limit, const uint8_t *candidates, const float *priority, const float *loudness, uint32_t *order, uint8_t *stolen){
+  uint32_t n = 0;
+  for(uint32_t v=0; v<count; ++v){
+    stolen[v] = 0;
+    if(candidates[v]) order[n++] = v;
+  }
+  if(n <= limit) return;
+  voices_select(order, n, limit, priority, loudness);
+  for(uint32_t i=limit; i<n; ++i)
+    stolen[order[i]] = 1;
+}
+
+MIXED_EXPORT int mixed_make_voice_pool(uint32_t count, channel_t channels, uint32_t samplerate, uint32_t frames, struct mixed_voice_pool *pool){
+  struct mixed_buffer scratch[12] = {0};
+  mixed_err(MIXED_NO_ERROR);
+  if(count == 0 || channels == 0 || 12 < channels || samplerate == 0){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  pool->count = 0;
+  pool->voices = mixed_calloc(count, sizeof(struct mixed_segment));
+  pool->_free = mixed_calloc(count, sizeof(uint32_t));
+  pool->_taken = mixed_calloc(count, sizeof(char));
+  if(!pool->voices || !pool->_free || !pool->_taken){
+    mixed_err(MIXED_OUT_OF_MEMORY);
+    goto cleanup;
+  }
+  // The voices rest on an empty pack, which is as large as the
+  // biggest one we expect so that starting sizes the scratch memory.
+  pool->_pack._data = 0;
+  pool->_pack.encoding = MIXED_FLOAT;
+  pool->_pack.channels = channels;
+  pool->_pack.samplerate = samplerate;
+  pool->_pack.size = MAX(frames, 1) * channels * sizeof(float);
+  for(uint32_t i=0; i<count; ++i){
+    struct mixed_segment *voice = &pool->voices[i];
+    if(!mixed_make_segment_unpacker(&pool->_pack, samplerate, voice))
+      goto cleanup;
+    pool->count++;
+    for(channel_t c=0; c<channels; ++c)
+      mixed_segment_set_out(MIXED_BUFFER, c, &scratch[c], voice);
+    if(!mixed_segment_start(voice))
+      goto cleanup;
+    mixed_segment_end(voice);
+    for(channel_t c=0; c<channels; ++c)
+      mixed_segment_set_out(MIXED_BUFFER, c, 0, voice);
+    // Hand out the lowest voices first.
+    pool->_free[count-1-i] = i;
+  }
+  pool->_free_count = count;
+  return 1;
+
+ cleanup:
+  mixed_free_voice_pool(pool);
+  return 0;
+}
+
+MIXED_EXPORT void mixed_free_voice_pool(struct mixed_voice_pool *pool){
+  if(pool->voices){
+    for(uint32_t i=0; i<pool->count; ++i)
+      mixed_free_segment(&pool->voices[i]);
+    mixed_free(pool->voices);
+  }
+  if(pool->_free)
+    mixed_free(pool->_free);
+  if(pool->_taken)
+    mixed_free(pool->_taken);
+  pool->voices = 0;
+  pool->_free = 0;
+  pool->_taken = 0;
+  pool->count = 0;
+  pool->_free_count = 0;
+}
+
+MIXED_EXPORT int mixed_voice_pool_take(struct mixed_pack *pack, struct mixed_segment **voice, struct mixed_voice_pool *pool){
+  float volume = 1.0f;
+  bool bypass = false;
+  mixed_err(MIXED_NO_ERROR);
+  if(pool->_free_count == 0){
+    mixed_err(MIXED_QUEUE_FULL);
+    return 0;
+  }
+  uint32_t index = pool->_free[pool->_free_count-1];
+  struct mixed_segment *segment = &pool->voices[index];
+  if(!mixed_segment_set(MIXED_PACK, &pack, segment))
+    return 0;
+  mixed_segment_set(MIXED_VOLUME, &volume, segment);
+  mixed_segment_set(MIXED_BYPASS, &bypass, segment);
+  pool->_free_count--;
+  pool->_taken[index] = 1;
+  *voice = segment;
+  return 1;
+}
+
+MIXED_EXPORT int mixed_voice_pool_return(struct mixed_segment *voice, struct mixed_voice_pool *pool){
+  struct mixed_pack *pack = &pool->_pack;
+  mixed_err(MIXED_NO_ERROR);
+  if(voice < pool->voices || pool->voices+pool->count <= voice || !pool->_taken[voice - pool->voices]){
+    mixed_err(MIXED_INVALID_VALUE);
+    return 0;
+  }
+  uint32_t index = voice - pool->voices;
+  mixed_segment_end(voice);
+  for(channel_t c=0; c<pack->channels; ++c)
+    mixed_segment_set_out(MIXED_BUFFER, c, 0, voice);
+  mixed_segment_set(MIXED_PACK, &pack, voice);
+  pool->_taken[index] = 0;
+  pool->_free[pool->_free_count++] = index;
+  return 1;
+}
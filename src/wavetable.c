@@ -0,0 +1,95 @@
+#include "internal.h"
+
+// One cycle per table plus a guard sample, so that interpolation
+// never has to wrap the index. Square, triangle and sawtooth have a
+// table per octave, each with as many harmonics as fit below Nyquist
+// at the highest frequency that uses it.
+static float sine_table[WAVETABLE_SIZE+1];
+static float band_tables[3][WAVETABLE_LEVELS][WAVETABLE_SIZE+1];
+static int tables_state = 0;
+
+// The table index of the given harmonic's sine or cosine at step i.
+#define HARMONIC_SIN(k, i) sine_table[((k)*(i)) % WAVETABLE_SIZE]
+#define HARMONIC_COS(k, i) sine_table[((k)*(i) + WAVETABLE_SIZE/4) % WAVETABLE_SIZE]
+
+static void build_band_table(enum mixed_generator_type type, uint32_t harmonics, float *table){
+  for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+    table[i] = 0.0f;
+  for(uint32_t k=1; k<=harmonics; ++k){
+    // Lanczos sigma factors keep the Gibbs ripple down to about 1%.
+    float x = M_PI * k / (harmonics + 1);
+    float sigma = sinf(x) / x;
+    switch(type){
+    case MIXED_SQUARE:
+      if(k%2 == 0) break;
+      for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+        table[i] += sigma * HARMONIC_SIN(k, i) / k;
+      break;
+    case MIXED_TRIANGLE:
+      if(k%2 == 0) break;
+      for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+        table[i] -= sigma * HARMONIC_COS(k, i) / (k*k);
+      break;
+    case MIXED_SAWTOOTH:
+      for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+        table[i] -= sigma * HARMONIC_SIN(k, i) / k;
+      break;
+    default: break;
+    }
+  }
+  // Normalise so that what ripple is left does not push past full scale.
+  float peak = 0.0f;
+  for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+    peak = MAX(peak, fabsf(table[i]));
+  for(uint32_t i=0; i<WAVETABLE_SIZE; ++i)
+    table[i] /= peak;
+  table[WAVETABLE_SIZE] = table[0];
+}
+
+void wavetable_init(){
+  if(atomic_read(tables_state) == 2) return;
+  if(!atomic_cas(tables_state, 0, 1)){
+    while(atomic_read(tables_state) != 2);
+    return;
+  }
+  for(uint32_t i=0; i<=WAVETABLE_SIZE; ++i)
+    sine_table[i] = sin(2 * M_PI * i / WAVETABLE_SIZE);
+  for(int t=0; t<3; ++t){
+    for(uint32_t l=0; l<WAVETABLE_LEVELS; ++l){
+      build_band_table(MIXED_SQUARE+t, (WAVETABLE_SIZE/2) >> l, band_tables[t][l]);
+    }
+  }
+  atomic_write(tables_state, 2);
+}
+
+uint32_t wavetable_increment(float frequency, uint32_t samplerate){
+  double increment = (double)frequency / samplerate * 4294967296.0;
+  return (increment < 4294967295.0)? (uint32_t)increment : UINT32_MAX;
+}
+
+const float *wavetable_get(enum mixed_generator_type type, uint32_t increment){
+  if(type == MIXED_SINE) return sine_table;
+  // Level l holds SIZE/2 >> l harmonics, which stay below Nyquist as
+  // long as the increment is below 2^(l+21).
+  uint32_t top = increment >> (32 - WAVETABLE_BITS);
+  uint32_t level = (top)? 32 - __builtin_clz(top) : 0;
+  return band_tables[type-MIXED_SQUARE][MIN(level, WAVETABLE_LEVELS-1)];
+}
+
+VECTORIZE void wavetable_render(const float *table, uint32_t *phase, uint32_t increment, float volume, float *out, uint32_t samples){
+  uint32_t start = *phase;
+  for(uint32_t i=0; i<samples; ++i){
+    out[i] = wavetable_sample(table, start + i*increment) * volume;
+  }
+  *phase = start + samples*increment;
+}
+
+VECTORIZE void wavetable_render_add(const float *table, uint32_t *phase, uint32_t increment, float volume, float *out, uint32_t samples){
+  uint32_t start = *phase;
+  for(uint32_t i=0; i<samples; ++i){
+    out[i] += wavetable_sample(table, start + i*increment) * volume;
+  }
+  *phase = start + samples*increment;
+}
+
+extern inline float wavetable_sample(const float *table, uint32_t phase);
@@ -267,11 +267,56 @@ define_test(resize, {
     pass(mixed_buffer_request_write(&w_area, &w_size, &buffer));
     // Resize
     pass(mixed_buffer_resize(2048, &buffer));
+    is(mixed_buffer_available_read(&buffer), 256);
     
   cleanup:
     mixed_free_buffer(&buffer);
   });
 
+define_test(resize_wrapped, {
+    struct mixed_buffer buffer = {0}, shared = {0}, replacement = {0};
+    float *area;
+    uint32_t size, next[2] = {0}, expected = 0;
+    pass(mixed_make_buffer(8, &buffer));
+    pass(mixed_make_buffer_shared(8, &shared));
+    pass(mixed_make_buffer(16, &replacement));
+    // Leave pending samples on both sides of the wrap
+    for(int round=0; round<2; ++round){
+      struct mixed_buffer *target = (round == 0)? &buffer : &shared;
+      size = 6;
+      pass(mixed_buffer_request_write(&area, &size, target));
+      for(uint32_t i=0; i<size; ++i) area[i] = next[round]++;
+      pass(mixed_buffer_finish_write(size, target));
+      pass(mixed_buffer_finish_read(5, target));
+      size = UINT32_MAX;
+      while(mixed_buffer_request_write(&area, &size, target) && size){
+        for(uint32_t i=0; i<size; ++i) area[i] = next[round]++;
+        pass(mixed_buffer_finish_write(size, target));
+        size = UINT32_MAX;
+      }
+    }
+    pass(mixed_buffer_resize(32, &buffer));
+    pass(mixed_buffer_swap(&replacement, &shared));
+    is(shared.size, 16);
+    is(replacement.size, 8);
+    for(int round=0; round<2; ++round){
+      struct mixed_buffer *target = (round == 0)? &buffer : &shared;
+      expected = 5;
+      size = UINT32_MAX;
+      while(mixed_buffer_request_read(&area, &size, target) && size){
+        for(uint32_t i=0; i<size; ++i) is_f(area[i], (float)expected++);
+        pass(mixed_buffer_finish_read(size, target));
+        size = UINT32_MAX;
+      }
+      is(expected, next[round]);
+    }
+    
+  cleanup:
+    mixed_free_buffer(&buffer);
+    mixed_free_buffer(&shared);
+    mixed_free_buffer(&replacement);
+  });
+
 define_test(with_transfer, {
     float *area;
     uint32_t size = 1024;
@@ -312,6 +357,112 @@ define_test(with_transfer, {
     mixed_free_buffer(&b);
   });
 
+define_test(batched_read_write, {
+    struct mixed_buffer a = {0}, b = {0}, c = {0};
+    struct mixed_buffer *buffers[4] = {&a, 0, &b, &c};
+    float *areas[4] = {0};
+    uint32_t size = UINT32_MAX;
+    pass(mixed_make_buffer(64, &a));
+    pass(mixed_make_buffer(64, &b));
+    pass(mixed_make_buffer(64, &c));
+    // Fill the buffers unevenly
+    size = 16;
+    pass(mixed_buffers_request_write(1, &buffers[0], areas, &size));
+    pass(mixed_buffers_finish_write(1, &buffers[0], size));
+    size = 32;
+    pass(mixed_buffers_request_write(2, &buffers[2], areas, &size));
+    pass(mixed_buffers_finish_write(2, &buffers[2], size));
+    // The batch only reads as much as all of them provide
+    size = UINT32_MAX;
+    pass(mixed_buffers_request_read(4, buffers, areas, &size));
+    is(size, 16);
+    isnt_p(areas[0], 0);
+    is_p(areas[1], 0);
+    isnt_p(areas[2], 0);
+    isnt_p(areas[3], 0);
+    pass(mixed_buffers_finish_read(4, buffers, size));
+    is(mixed_buffer_available_read(&a), 0);
+    is(mixed_buffer_available_read(&b), 16);
+    is(mixed_buffer_available_read(&c), 16);
+    // An empty buffer stops the batch
+    size = UINT32_MAX;
+    fail(mixed_buffers_request_read(4, buffers, areas, &size));
+    is(size, 0);
+    pass(mixed_buffers_finish_read(4, buffers, size));
+  cleanup:
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+    mixed_free_buffer(&c);
+  })
+
+define_test(silence, {
+    struct mixed_buffer buffer = {0};
+    float *area = 0;
+    uint32_t size = 16;
+    pass(mixed_make_buffer(64, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 0);
+    // Silence added to nothing or to silence stays known
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write_silence(size, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 1);
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write_silence(size, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 1);
+    // Anything else ends it, and silence after it does not bring it back
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write(size, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 0);
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write_silence(size, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 0);
+    // Until everything before it has been read
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&area, &size, &buffer));
+    pass(mixed_buffer_finish_read(size, &buffer));
+    size = 16;
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write_silence(size, &buffer));
+    is(mixed_buffer_is_silent(&buffer), 1);
+  cleanup:
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(mirrored_read_write, {
+    struct mixed_buffer buffer = {0};
+    float *area = 0;
+    uint32_t size, total;
+    pass(mixed_make_buffer_mirrored(1000, &buffer));
+    total = buffer.size;
+    if(total < 1000) fail_test("Mirrored buffer is too small");
+    is(mixed_buffer_available_write(&buffer), total);
+    // Move the ring so the next write straddles the end of the array
+    size = total - 10;
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    is(size, total - 10);
+    pass(mixed_buffer_finish_write(size, &buffer));
+    pass(mixed_buffer_request_read(&area, &size, &buffer));
+    pass(mixed_buffer_finish_read(size, &buffer));
+    // The whole ring is now available in one go
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    is(size, total);
+    for(uint32_t i=0; i<size; ++i) area[i] = i;
+    pass(mixed_buffer_finish_write(size, &buffer));
+    is(mixed_buffer_available_write(&buffer), 0);
+    size = UINT32_MAX;
+    fail(mixed_buffer_request_write(&area, &size, &buffer));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&area, &size, &buffer));
+    is(size, total);
+    for(uint32_t i=0; i<size; ++i){
+      is_f(area[i], (float)i);
+    }
+    pass(mixed_buffer_finish_read(size, &buffer));
+    is(mixed_buffer_available_read(&buffer), 0);
+  cleanup:
+    mixed_free_buffer(&buffer);
+  })
+
 define_test(randomized, {
     struct mixed_buffer buffer = {0};
     uint32_t size = 1024;
@@ -369,7 +520,8 @@ define_test(randomized, {
     mixed_free_buffer(&buffer);
   });
 
-void *async_reader(struct mixed_buffer *buffer){
+void *async_reader(void *arg){
+  struct mixed_buffer *buffer = (struct mixed_buffer *)arg;
   uint32_t *status = calloc(sizeof(uint32_t), 1);
   uint32_t size = buffer->size;
   *status = 0;
@@ -392,6 +544,7 @@ define_test(async_read_write, {
     uint32_t size = 1024;
     pthread_t reader = 0;
     uint32_t *status = 0;
+    void *result = 0;
     pass(mixed_make_buffer(size, &buffer));
 
     if(pthread_create(&reader, 0, async_reader, &buffer) != 0){
@@ -409,7 +562,8 @@ define_test(async_read_write, {
       pass(mixed_buffer_finish_write(write, &buffer));
     }
 
-    pthread_join(reader, &status);
+    pthread_join(reader, &result);
+    status = (uint32_t *)result;
     reader = 0;
     if(*status != 0){
       fail_test("Reader thread failed with exit code %i", *status);
@@ -421,4 +575,209 @@ define_test(async_read_write, {
     mixed_free_buffer(&buffer);
   })
 
+#define SHARED_SAMPLES (1<<22)
+
+void *shared_reader(void *arg){
+  struct mixed_buffer *buffer = (struct mixed_buffer *)arg;
+  uint32_t *status = calloc(sizeof(uint32_t), 1);
+  uint32_t expected = 0;
+  while(expected < SHARED_SAMPLES && *status == 0){
+    float *area = 0;
+    uint32_t read = UINT32_MAX;
+    if(!mixed_buffer_request_read(&area, &read, buffer))
+      continue;
+    for(uint32_t i=0; i<read; ++i){
+      if(area[i] != (float)(expected++ % 1024))
+        *status = 1;
+    }
+    if(!mixed_buffer_finish_read(read, buffer))
+      *status = 2;
+  }
+  return status;
+}
+
+define_test(shared_read_write, {
+    struct mixed_buffer buffer = {0};
+    pthread_t reader = 0;
+    uint32_t *status = 0;
+    void *result = 0;
+    uint32_t written = 0;
+    pass(mixed_make_buffer_shared(1000, &buffer));
+    isnt_p(buffer._shared, 0);
+
+    if(pthread_create(&reader, 0, shared_reader, &buffer) != 0){
+      fail_test("Failed to spawn thread.");
+    }
+
+    while(written < SHARED_SAMPLES){
+      float *area = 0;
+      uint32_t write = rand() % 256;
+      if(!mixed_buffer_request_write(&area, &write, &buffer))
+        continue;
+      if(SHARED_SAMPLES - written < write) write = SHARED_SAMPLES - written;
+      for(uint32_t i=0; i<write; ++i){
+        area[i] = (float)((written+i) % 1024);
+      }
+      pass(mixed_buffer_finish_write(write, &buffer));
+      written += write;
+    }
+
+    pthread_join(reader, &result);
+    status = (uint32_t *)result;
+    reader = 0;
+    if(*status != 0){
+      fail_test("Reader thread failed with exit code %i", *status);
+    }
+
+  cleanup:
+    if(reader) pthread_cancel(reader);
+    if(status) free(status);
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(stats, {
+    struct mixed_buffer buffer = {0};
+    struct mixed_buffer_stats stats = {0};
+    float *area;
+    uint32_t size;
+    pass(mixed_make_buffer(8, &buffer));
+    fail(mixed_buffer_stats(&stats, &buffer));
+    pass(mixed_buffer_enable_stats(&buffer));
+    size = 6;
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    pass(mixed_buffer_finish_write(size, &buffer));
+    size = 4;
+    pass(mixed_buffer_request_read(&area, &size, &buffer));
+    pass(mixed_buffer_finish_read(size, &buffer));
+    // Only two samples fit before the end
+    size = 8;
+    pass(mixed_buffer_request_write(&area, &size, &buffer));
+    is(size, 2);
+    pass(mixed_buffer_finish_write(size, &buffer));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&area, &size, &buffer));
+    pass(mixed_buffer_finish_read(size, &buffer));
+    size = 1;
+    fail(mixed_buffer_request_read(&area, &size, &buffer));
+    pass(mixed_buffer_stats(&stats, &buffer));
+    is(stats.starved_reads, 1);
+    is(stats.short_reads, 0);
+    is(stats.full_writes, 0);
+    is(stats.short_writes, 1);
+    is(stats.written, 8);
+    is(stats.read, 8);
+    is(stats.high_water, 6);
+    is(stats.low_water, 0);
+    // The counters stay with the buffer
+    pass(mixed_buffer_resize(16, &buffer));
+    pass(mixed_buffer_stats(&stats, &buffer));
+    is(stats.written, 8);
+    pass(mixed_buffer_reset_stats(&buffer));
+    pass(mixed_buffer_stats(&stats, &buffer));
+    is(stats.written, 0);
+    is(stats.starved_reads, 0);
+
+  cleanup:
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(half, {
+    struct mixed_buffer floats = {0}, halves = {0}, left = {0}, right = {0}, out = {0};
+    struct mixed_segment mixer = {0}, volume = {0}, unpacker = {0};
+    struct mixed_pack pack = {0};
+    float values[] = {0.0f, 1.0f, -0.5f, 0.1f, 65504.0f, 70000.0f, 1e-6f, 1e-8f, 1.0f+1.0f/2048};
+    uint16_t bits[] = {0x0000, 0x3C00, 0xB800, 0x2E66, 0x7BFF, 0x7C00, 0x0011, 0x0000, 0x3C00};
+    uint32_t features = mixed_cpu_features(), size;
+    uint16_t *half = 0;
+    float *data = 0;
+    pass(mixed_make_buffer(1024, &floats));
+    pass(mixed_make_buffer_half(1024, &halves));
+    is(halves.is_half, 1);
+    // Float areas of a half buffer are refused
+    size = UINT32_MAX;
+    fail(mixed_buffer_request_write(&data, &size, &halves));
+    is(mixed_error(), MIXED_UNKNOWN_ENCODING);
+    fail(mixed_buffer_request_write_half(&half, &size, &floats));
+    // Every kernel rounds to nearest even and agrees on the bits
+    uint32_t sets[] = {0, UINT32_MAX};
+    for(int s=0; s<2; ++s){
+      mixed_cpu_set_features(sets[s]);
+      for(int r=0; r<4; ++r){
+        size = UINT32_MAX;
+        pass(mixed_buffer_request_write(&data, &size, &floats));
+        for(uint32_t i=0; i<16; ++i) data[i] = values[i%9];
+        pass(mixed_buffer_finish_write(16, &floats));
+      }
+      pass(mixed_buffer_transfer(&floats, &halves));
+      size = UINT32_MAX;
+      pass(mixed_buffer_request_read_half(&half, &size, &halves));
+      is(size, 64);
+      for(uint32_t i=0; i<size; ++i){
+        if(half[i] != bits[(i%16)%9]) fail_test("Wrong half float bits");
+      }
+      pass(mixed_buffer_transfer(&halves, &floats));
+      size = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &size, &floats));
+      is(size, 64);
+      is_f(data[1], 1.0f);
+      is_f(data[3], 0.0999755859375f);
+      is_f(data[6], 1.0132789611816406e-06f);
+      pass(mixed_buffer_finish_read(size, &floats));
+    }
+    mixed_cpu_set_features(features);
+    mixed_free_buffer(&floats);
+    // An unpacker fills, a volume control scales, and a mixer sums halves
+    pack.encoding = MIXED_INT16;
+    pack.channels = 2;
+    pack.samplerate = 44100;
+    pass(mixed_make_pack(256, &pack));
+    int16_t *frames;
+    size = UINT32_MAX;
+    pass(mixed_pack_request_write((void **)&frames, &size, &pack));
+    for(uint32_t i=0; i<256; ++i){
+      frames[2*i+0] = 16384;
+      frames[2*i+1] = -8192;
+    }
+    pass(mixed_pack_finish_write(256*4, &pack));
+    pass(mixed_make_buffer_half(256, &left));
+    pass(mixed_make_buffer_half(256, &right));
+    pass(mixed_make_buffer_half(256, &out));
+    pass(mixed_make_segment_unpacker(&pack, 44100, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &unpacker));
+    pass(mixed_make_segment_volume_control(0.5f, 0.0f, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &left, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &right, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &volume));
+    pass(mixed_make_segment_basic_mixer(1, &mixer));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &left, &mixer));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &right, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &mixer));
+    pass(mixed_segment_start(&unpacker));
+    pass(mixed_segment_start(&volume));
+    pass(mixed_segment_start(&mixer));
+    pass(mixed_segment_mix(&unpacker));
+    // Let the volume ramp settle before looking at the output
+    pass(mixed_segment_mix(&volume));
+    pass(mixed_segment_mix(&mixer));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read_half(&half, &size, &out));
+    is(size, 256);
+    // 0.5*(0.5 - 0.25)
+    is(half[255], 0x3000);
+
+  cleanup:
+    mixed_cpu_set_features(UINT32_MAX);
+    mixed_free_segment(&unpacker);
+    mixed_free_segment(&volume);
+    mixed_free_segment(&mixer);
+    mixed_free_pack(&pack);
+    mixed_free_buffer(&floats);
+    mixed_free_buffer(&halves);
+    mixed_free_buffer(&left);
+    mixed_free_buffer(&right);
+    mixed_free_buffer(&out);
+  })
+
 #undef __TEST_SUITE
@@ -0,0 +1,374 @@
+#define __TEST_SUITE commands
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tester.h"
+
+define_test(apply, {
+    struct mixed_segment commands = {0}, mixer = {0};
+    float volume = 0.5, result = 0.0;
+    pass(mixed_make_segment_commands(4, &commands));
+    pass(mixed_make_segment_basic_mixer(2, &mixer));
+    pass(mixed_commands_set(MIXED_VOLUME, &volume, sizeof(float), &mixer, &commands));
+    volume = 0.25;
+    // Nothing happens until the commands are mixed
+    pass(mixed_segment_get(MIXED_VOLUME, &result, &mixer));
+    is_f(result, 1.0);
+    pass(mixed_segment_mix(&commands));
+    pass(mixed_segment_get(MIXED_VOLUME, &result, &mixer));
+    is_f(result, 0.5);
+
+  cleanup:
+    mixed_free_segment(&commands);
+    mixed_free_segment(&mixer);
+  })
+
+define_test(full, {
+    struct mixed_segment commands = {0}, mixer = {0};
+    float volume = 0.5;
+    uint32_t failed = 1;
+    pass(mixed_make_segment_commands(4, &commands));
+    pass(mixed_make_segment_basic_mixer(2, &mixer));
+    for(int i=0; i<4; ++i){
+      pass(mixed_commands_set(MIXED_VOLUME, &volume, sizeof(float), &mixer, &commands));
+    }
+    fail(mixed_commands_set(MIXED_VOLUME, &volume, sizeof(float), &mixer, &commands));
+    is(mixed_error(), MIXED_QUEUE_FULL);
+    pass(mixed_segment_mix(&commands));
+    pass(mixed_commands_set(MIXED_VOLUME, &volume, sizeof(float), &mixer, &commands));
+    // Unknown fields are counted rather than stopping the rest
+    pass(mixed_commands_set(MIXED_BYPASS, &volume, sizeof(float), &mixer, &commands));
+    pass(mixed_segment_mix(&commands));
+    pass(mixed_segment_get(MIXED_COMMANDS_FAILED, &failed, &commands));
+    is(failed, 1);
+
+  cleanup:
+    mixed_free_segment(&commands);
+    mixed_free_segment(&mixer);
+  })
+
+#define PRODUCERS 4
+#define PRODUCED 20000
+
+struct counter{
+  uint32_t last[PRODUCERS];
+  uint32_t count;
+  uint32_t disorder;
+};
+
+static int counter_set(uint32_t field, void *value, struct mixed_segment *segment){
+  struct counter *counter = (struct counter *)segment->data;
+  uint32_t producer = field, index = *(uint32_t *)value;
+  if(index != counter->last[producer]+1) counter->disorder++;
+  counter->last[producer] = index;
+  counter->count++;
+  return 1;
+}
+
+struct producer{
+  uint32_t id;
+  struct mixed_segment *target;
+  struct mixed_segment *commands;
+};
+
+static void *produce(void *arg){
+  struct producer *producer = (struct producer *)arg;
+  for(uint32_t i=1; i<=PRODUCED;){
+    if(mixed_commands_set(producer->id, &i, sizeof(uint32_t), producer->target, producer->commands))
+      ++i;
+  }
+  return 0;
+}
+
+define_test(producers, {
+    struct mixed_segment commands = {0}, target = {0};
+    struct counter counter = {0};
+    struct producer producers[PRODUCERS] = {0};
+    pthread_t threads[PRODUCERS] = {0};
+    target.set = counter_set;
+    target.data = &counter;
+    pass(mixed_make_segment_commands(64, &commands));
+    for(uint32_t i=0; i<PRODUCERS; ++i){
+      producers[i].id = i;
+      producers[i].target = &target;
+      producers[i].commands = &commands;
+      if(pthread_create(&threads[i], 0, produce, &producers[i]) != 0)
+        fail_test("Failed to spawn thread.");
+    }
+    while(counter.count < PRODUCERS*PRODUCED){
+      pass(mixed_segment_mix(&commands));
+    }
+    for(uint32_t i=0; i<PRODUCERS; ++i){
+      pthread_join(threads[i], 0);
+      threads[i] = 0;
+      is(counter.last[i], PRODUCED);
+    }
+    // Every producer's changes arrive in the order they were made
+    is(counter.disorder, 0);
+
+  cleanup:
+    for(uint32_t i=0; i<PRODUCERS; ++i){
+      if(threads[i]) pthread_cancel(threads[i]);
+    }
+    mixed_free_segment(&commands);
+  })
+
+struct swapped{
+  uint32_t alive;
+  uint32_t violations;
+};
+
+static int swapped_mix(struct mixed_segment *segment){
+  struct swapped *swapped = (struct swapped *)segment->data;
+  if(!__atomic_load_n(&swapped->alive, __ATOMIC_SEQ_CST))
+    swapped->violations++;
+  return 1;
+}
+
+struct mixing{
+  struct mixed_segment *chain;
+  uint32_t stop;
+  uint32_t failed;
+};
+
+static void *mix_chain(void *arg){
+  struct mixing *mixing = (struct mixing *)arg;
+  while(!__atomic_load_n(&mixing->stop, __ATOMIC_SEQ_CST)){
+    if(!mixed_segment_mix(mixing->chain))
+      mixing->failed++;
+  }
+  return 0;
+}
+
+define_test(hot_swap, {
+    struct mixed_segment chain = {0}, fixed = {0}, segment = {0};
+    struct swapped fixed_state = {1, 0}, state = {0};
+    struct mixing mixing = {&chain, 0, 0};
+    pthread_t thread = 0;
+    fixed.mix = segment.mix = swapped_mix;
+    fixed.data = &fixed_state;
+    segment.data = &state;
+    pass(mixed_make_segment_chain(&chain));
+    pass(mixed_chain_add(&fixed, &chain));
+    if(pthread_create(&thread, 0, mix_chain, &mixing) != 0)
+      fail_test("Failed to spawn thread.");
+    // Once removed, the segment must never be mixed again
+    for(uint32_t i=0; i<1000; ++i){
+      __atomic_store_n(&state.alive, 1, __ATOMIC_SEQ_CST);
+      pass(mixed_chain_add_at(i%2, &segment, &chain));
+      pass(mixed_chain_remove(&segment, &chain));
+      __atomic_store_n(&state.alive, 0, __ATOMIC_SEQ_CST);
+    }
+    __atomic_store_n(&mixing.stop, 1, __ATOMIC_SEQ_CST);
+    pthread_join(thread, 0);
+    thread = 0;
+    is(mixing.failed, 0);
+    is(state.violations, 0);
+    is(fixed_state.violations, 0);
+
+  cleanup:
+    if(thread){
+      __atomic_store_n(&mixing.stop, 1, __ATOMIC_SEQ_CST);
+      pthread_join(thread, 0);
+    }
+    mixed_free_segment(&chain);
+  })
+
+struct logged{
+  char id;
+  char *log;
+};
+
+static int logged_mix(struct mixed_segment *segment){
+  struct logged *logged = (struct logged *)segment->data;
+  size_t length = strlen(logged->log);
+  logged->log[length] = logged->id;
+  logged->log[length+1] = 0;
+  return 1;
+}
+
+static int allocations = 0;
+static void *(*original_calloc)(size_t num, size_t size) = 0;
+
+static void *counting_calloc(size_t num, size_t size){
+  ++allocations;
+  return original_calloc(num, size);
+}
+
+define_test(nested_chain, {
+    struct mixed_segment outer = {0}, inner = {0}, segments[5] = {0};
+    struct logged logged[5];
+    char log[32] = {0};
+    for(int i=0; i<5; ++i){
+      logged[i].id = 'a'+i;
+      logged[i].log = log;
+      segments[i].mix = logged_mix;
+      segments[i].data = &logged[i];
+    }
+    pass(mixed_make_segment_chain(&outer));
+    pass(mixed_make_segment_chain(&inner));
+    pass(mixed_chain_add(&segments[0], &outer));
+    pass(mixed_chain_add(&inner, &outer));
+    pass(mixed_chain_add(&segments[3], &outer));
+    pass(mixed_chain_add(&segments[1], &inner));
+    pass(mixed_chain_add(&segments[2], &inner));
+    pass(mixed_segment_mix(&outer));
+    is(strcmp(log, "abcd"), 0);
+    // Changing the inner chain shows up in the outer one's mix
+    log[0] = 0;
+    pass(mixed_chain_add(&segments[4], &inner));
+    pass(mixed_chain_remove(&segments[1], &inner));
+    // The plans are rebuilt by the changes, not by the mix
+    original_calloc = mixed_calloc;
+    mixed_calloc = counting_calloc;
+    allocations = 0;
+    pass(mixed_segment_mix(&outer));
+    mixed_calloc = original_calloc;
+    is(allocations, 0);
+    is(strcmp(log, "aced"), 0);
+
+  cleanup:
+    if(original_calloc) mixed_calloc = original_calloc;
+    mixed_free_segment(&outer);
+    mixed_free_segment(&inner);
+  })
+
+// Bypassed chains pass on nothing, so the segments in them need no
+// channels either.
+static int logged_get(uint32_t field, void *value, struct mixed_segment *segment){
+  (void)segment;
+  switch(field){
+  case MIXED_IN_COUNT:
+  case MIXED_OUT_COUNT: *(channel_t *)value = 0; return 1;
+  default: return 0;
+  }
+}
+
+define_test(bypass_chain, {
+    struct mixed_segment commands = {0}, outer = {0}, inner = {0}, segments[3] = {0};
+    struct logged logged[3];
+    char log[32] = {0};
+    bool bypass = 1;
+    for(int i=0; i<3; ++i){
+      logged[i].id = 'a'+i;
+      logged[i].log = log;
+      segments[i].mix = logged_mix;
+      segments[i].get = logged_get;
+      segments[i].data = &logged[i];
+    }
+    pass(mixed_make_segment_commands(4, &commands));
+    pass(mixed_make_segment_chain(&outer));
+    pass(mixed_make_segment_chain(&inner));
+    pass(mixed_chain_add(&commands, &outer));
+    pass(mixed_chain_add(&segments[0], &outer));
+    pass(mixed_chain_add(&inner, &outer));
+    pass(mixed_chain_add(&segments[2], &outer));
+    pass(mixed_chain_add(&segments[1], &inner));
+    // Bypassing from within the mix neither waits nor allocates
+    pass(mixed_commands_set(MIXED_BYPASS, &bypass, sizeof(bool), &inner, &commands));
+    original_calloc = mixed_calloc;
+    mixed_calloc = counting_calloc;
+    allocations = 0;
+    pass(mixed_segment_mix(&outer));
+    is(strcmp(log, "ac"), 0);
+    log[0] = 0;
+    bypass = 0;
+    pass(mixed_commands_set(MIXED_BYPASS, &bypass, sizeof(bool), &inner, &commands));
+    pass(mixed_segment_mix(&outer));
+    is(strcmp(log, "abc"), 0);
+    bypass = 1;
+    pass(mixed_commands_set(MIXED_BYPASS, &bypass, sizeof(bool), &outer, &commands));
+    pass(mixed_segment_mix(&outer));
+    mixed_calloc = original_calloc;
+    is(allocations, 0);
+
+  cleanup:
+    if(original_calloc) mixed_calloc = original_calloc;
+    mixed_free_segment(&outer);
+    mixed_free_segment(&inner);
+    mixed_free_segment(&commands);
+  })
+
+struct finite{
+  uint32_t left;
+  uint32_t ended;
+  uint32_t violations;
+};
+
+static int finite_mix(struct mixed_segment *segment){
+  struct finite *finite = (struct finite *)segment->data;
+  if(__atomic_load_n(&finite->ended, __ATOMIC_SEQ_CST))
+    finite->violations++;
+  if(finite->left == 0) return 0;
+  finite->left--;
+  return 1;
+}
+
+static int finite_end(struct mixed_segment *segment){
+  struct finite *finite = (struct finite *)segment->data;
+  __atomic_store_n(&finite->ended, 1, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+#define FINITE_COUNT 256
+
+define_test(queue_pop, {
+    struct mixed_segment queue = {0}, *current = 0;
+    struct mixed_segment segments[FINITE_COUNT] = {0};
+    struct finite finite[FINITE_COUNT] = {0};
+    struct mixing mixing = {&queue, 0, 0};
+    pthread_t thread = 0;
+    uint32_t zero = 0;
+    for(uint32_t i=0; i<FINITE_COUNT; ++i){
+      finite[i].left = 1 + i%3;
+      segments[i].mix = finite_mix;
+      segments[i].end = finite_end;
+      segments[i].data = &finite[i];
+    }
+    pass(mixed_make_segment_queue(&queue));
+    pass(mixed_segment_set(MIXED_IN_COUNT, &zero, &queue));
+    pass(mixed_segment_set(MIXED_OUT_COUNT, &zero, &queue));
+    // Finished segments drop off while others are added and removed
+    if(pthread_create(&thread, 0, mix_chain, &mixing) != 0)
+      fail_test("Failed to spawn thread.");
+    for(uint32_t i=0; i<FINITE_COUNT-2; ++i){
+      pass(mixed_queue_add(&segments[i], &queue));
+      if(i%3 == 2)
+        pass(mixed_queue_remove(&segments[i-1], &queue));
+    }
+    do{
+      pass(mixed_segment_get(MIXED_CURRENT_SEGMENT, &current, &queue));
+    }while(current);
+    __atomic_store_n(&mixing.stop, 1, __ATOMIC_SEQ_CST);
+    pthread_join(thread, 0);
+    thread = 0;
+    is(mixing.failed, 0);
+    for(uint32_t i=0; i<FINITE_COUNT-2; ++i){
+      is(finite[i].ended, 1);
+      is(finite[i].violations, 0);
+    }
+    // Dropping them neither allocates nor locks
+    finite[FINITE_COUNT-2].left = finite[FINITE_COUNT-1].left = 0;
+    pass(mixed_queue_add(&segments[FINITE_COUNT-2], &queue));
+    pass(mixed_queue_add(&segments[FINITE_COUNT-1], &queue));
+    original_calloc = mixed_calloc;
+    mixed_calloc = counting_calloc;
+    allocations = 0;
+    pass(mixed_segment_mix(&queue));
+    mixed_calloc = original_calloc;
+    is(allocations, 0);
+    is(finite[FINITE_COUNT-2].ended, 1);
+    is(finite[FINITE_COUNT-1].ended, 1);
+    pass(mixed_segment_get(MIXED_CURRENT_SEGMENT, &current, &queue));
+    is_p(current, 0);
+
+  cleanup:
+    if(original_calloc) mixed_calloc = original_calloc;
+    if(thread){
+      __atomic_store_n(&mixing.stop, 1, __ATOMIC_SEQ_CST);
+      pthread_join(thread, 0);
+    }
+    mixed_free_segment(&queue);
+  })
+
+#undef __TEST_SUITE
@@ -0,0 +1,1177 @@
+#define __TEST_SUITE filter
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tester.h"
+
+static int fill(struct mixed_buffer *buffer, float frequency, uint32_t samples){
+  float *data;
+  if(!mixed_buffer_request_write(&data, &samples, buffer)) return 0;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = 0.5f*sinf(2 * M_PI * frequency * i / 44100) + 0.25f;
+  return mixed_buffer_finish_write(samples, buffer);
+}
+
+static int filter(enum mixed_biquad_filter type, float frequency, float gain, struct mixed_buffer *in, struct mixed_buffer *out){
+  struct mixed_segment filter = {0};
+  int status = 0;
+  if(!mixed_make_segment_biquad_filter(type, frequency, 44100, &filter)) goto cleanup;
+  if(!mixed_segment_set(MIXED_GAIN, &gain, &filter)) goto cleanup;
+  if(!mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, in, &filter)) goto cleanup;
+  if(!mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, out, &filter)) goto cleanup;
+  if(!mixed_segment_start(&filter)) goto cleanup;
+  if(!mixed_segment_mix(&filter)) goto cleanup;
+  status = 1;
+
+ cleanup:
+  mixed_free_segment(&filter);
+  return status;
+}
+
+static int same(struct mixed_buffer *a, struct mixed_buffer *b){
+  float *x, *y;
+  uint32_t samples = UINT32_MAX;
+  mixed_buffer_request_read(&x, &samples, a);
+  mixed_buffer_request_read(&y, &samples, b);
+  for(uint32_t i=0; i<samples; ++i){
+    if(1e-4 < fabsf(x[i] - y[i])) return 0;
+  }
+  return 0 < samples;
+}
+
+define_test(upmix_lowpass, {
+    struct mixed_segment convert = {0};
+    struct mixed_buffer in[2] = {0}, out[6] = {0}, center = {0}, expected = {0};
+    // Long enough to cross several blocks of the filter bank
+    uint32_t samples = 1000;
+    for(int i=0; i<2; ++i) pass(mixed_make_buffer(samples, &in[i]));
+    for(int i=0; i<6; ++i) pass(mixed_make_buffer(samples, &out[i]));
+    pass(mixed_make_buffer(samples, &center));
+    pass(mixed_make_buffer(samples, &expected));
+    pass(fill(&in[0], 300, samples));
+    pass(fill(&in[1], 300, samples));
+    pass(fill(&center, 300, samples));
+    pass(mixed_make_segment_channel_convert(2, 6, 44100, &convert));
+    for(int i=0; i<2; ++i) pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &convert));
+    for(int i=0; i<6; ++i) pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &convert));
+    pass(mixed_segment_start(&convert));
+    pass(mixed_segment_mix(&convert));
+    // Both lanes of the bank must match the scalar filter
+    pass(filter(MIXED_LOWPASS, 4000, 1.0, &center, &expected));
+    pass(same(&out[MIXED_CENTER], &expected));
+    mixed_buffer_clear(&center);
+    mixed_buffer_clear(&expected);
+    pass(fill(&center, 300, samples));
+    pass(filter(MIXED_LOWPASS, 200, 1.0, &center, &expected));
+    pass(same(&out[MIXED_SUBWOOFER], &expected));
+
+  cleanup:
+    mixed_free_segment(&convert);
+    for(int i=0; i<2; ++i) mixed_free_buffer(&in[i]);
+    for(int i=0; i<6; ++i) mixed_free_buffer(&out[i]);
+    mixed_free_buffer(&center);
+    mixed_free_buffer(&expected);
+  })
+
+define_test(upmix_rears, {
+    struct mixed_segment convert = {0};
+    struct mixed_buffer in[2] = {0}, out[5] = {0};
+    uint32_t samples = 4000;
+    float *left, *right;
+    for(int i=0; i<2; ++i) pass(mixed_make_buffer(samples, &in[i]));
+    for(int i=0; i<5; ++i) pass(mixed_make_buffer(samples, &out[i]));
+    pass(fill(&in[0], 1000, samples));
+    pass(fill(&in[1], 0, samples));
+    pass(mixed_make_segment_channel_convert(2, 5, 44100, &convert));
+    for(int i=0; i<2; ++i) pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &convert));
+    for(int i=0; i<5; ++i) pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &convert));
+    pass(mixed_segment_start(&convert));
+    pass(mixed_segment_mix(&convert));
+    // Once the filters settled the rears are 90 degrees apart
+    pass(mixed_buffer_request_read(&left, &samples, &out[MIXED_LEFT_REAR]));
+    pass(mixed_buffer_request_read(&right, &samples, &out[MIXED_RIGHT_REAR]));
+    is(samples, 4000);
+    double lr = 0.0, ll = 0.0, rr = 0.0;
+    for(uint32_t i=2000; i<samples; ++i){
+      lr += left[i]*right[i];
+      ll += left[i]*left[i];
+      rr += right[i]*right[i];
+    }
+    if(ll < 1.0 || rr < 1.0) fail_test("Rears are silent");
+    if(0.05 < fabs(lr / sqrt(ll*rr))) fail_test("Rears are not in quadrature");
+
+  cleanup:
+    mixed_free_segment(&convert);
+    for(int i=0; i<2; ++i) mixed_free_buffer(&in[i]);
+    for(int i=0; i<5; ++i) mixed_free_buffer(&out[i]);
+  })
+
+define_test(channel_matrix, {
+    struct mixed_segment convert = {0};
+    struct mixed_buffer in[6] = {0}, out[2] = {0};
+    float matrix[12] = {0}, *data = 0;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<6; ++i) pass(mixed_make_buffer(64, &in[i]));
+    for(int i=0; i<2; ++i) pass(mixed_make_buffer(64, &out[i]));
+    pass(mixed_make_segment_channel_convert(6, 2, 44100, &convert));
+    // The downmix preset folds centre and rears in and drops the LFE
+    pass(mixed_segment_get(MIXED_CHANNEL_MATRIX, matrix, &convert));
+    is_f(matrix[MIXED_LEFT_FRONT], 1.0f);
+    is_f(matrix[MIXED_RIGHT_FRONT], 0.0f);
+    is_f(matrix[MIXED_CENTER], 0.70710678f);
+    is_f(matrix[MIXED_SUBWOOFER], 0.0f);
+    is_f(matrix[6+MIXED_RIGHT_REAR], 0.70710678f);
+    for(int i=0; i<12; ++i) matrix[i] = 0.0f;
+    matrix[MIXED_SUBWOOFER] = 2.0f;
+    matrix[6+MIXED_LEFT_FRONT] = 0.5f;
+    matrix[6+MIXED_RIGHT_FRONT] = 0.25f;
+    pass(mixed_segment_set(MIXED_CHANNEL_MATRIX, matrix, &convert));
+    for(int i=0; i<6; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &convert));
+      pass(mixed_buffer_request_write(&data, &samples, &in[i]));
+      for(uint32_t j=0; j<40; ++j) data[j] = 1.0f;
+      pass(mixed_buffer_finish_write(40, &in[i]));
+      samples = UINT32_MAX;
+    }
+    for(int i=0; i<2; ++i) pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &convert));
+    pass(mixed_segment_start(&convert));
+    pass(mixed_segment_mix(&convert));
+    pass(mixed_buffer_request_read(&data, &samples, &out[MIXED_LEFT]));
+    is(samples, 40);
+    for(uint32_t j=0; j<40; ++j) is_f(data[j], 2.0f);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out[MIXED_RIGHT]));
+    for(uint32_t j=0; j<40; ++j) is_f(data[j], 0.75f);
+
+  cleanup:
+    mixed_free_segment(&convert);
+    for(int i=0; i<6; ++i) mixed_free_buffer(&in[i]);
+    for(int i=0; i<2; ++i) mixed_free_buffer(&out[i]);
+  })
+
+define_test(linked_limiter, {
+    struct mixed_segment limiter = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0};
+    float threshold = -6.0f, *l = 0, *r = 0;
+    uint8_t enable = 1;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(4096, &in[i]));
+      pass(mixed_make_buffer(4096, &out[i]));
+    }
+    pass(mixed_make_segment_linked_compressor(2, 44100, &limiter));
+    pass(mixed_segment_set(MIXED_COMPRESSOR_LIMITER, &enable, &limiter));
+    pass(mixed_segment_set(MIXED_COMPRESSOR_THRESHOLD, &threshold, &limiter));
+    for(int i=0; i<2; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &limiter));
+      pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &limiter));
+      pass(mixed_buffer_request_write(&l, &samples, &in[i]));
+      for(uint32_t j=0; j<samples; ++j) l[j] = (i == 0)? 1.0f : 0.5f;
+      pass(mixed_buffer_finish_write(samples, &in[i]));
+      samples = UINT32_MAX;
+    }
+    pass(mixed_segment_start(&limiter));
+    pass(mixed_segment_mix(&limiter));
+    pass(mixed_buffer_request_read(&l, &samples, &out[0]));
+    pass(mixed_buffer_request_read(&r, &samples, &out[1]));
+    is(samples, 4096);
+    // No sample passes the ceiling, and both channels share one gain
+    for(uint32_t j=0; j<samples; ++j){
+      if(0.5013f < l[j]) fail_test("Sample over the ceiling");
+      if(1e-5f < fabsf(l[j]*0.5f - r[j])) fail_test("Channels are not linked");
+    }
+    if(0.001f < fabsf(l[samples-1] - 0.5012f)) fail_test("Gain did not settle at the ceiling");
+
+  cleanup:
+    mixed_free_segment(&limiter);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+define_test(gate_spans, {
+    struct mixed_segment gate = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    float attack = 0.01f, hold = 0.005f, release = 0.01f, *data = 0;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(128, &in));
+    pass(mixed_make_buffer(128, &out));
+    pass(mixed_make_segment_gate(1000, &gate));
+    pass(mixed_segment_set(MIXED_GATE_ATTACK, &attack, &gate));
+    pass(mixed_segment_set(MIXED_GATE_HOLD, &hold, &gate));
+    pass(mixed_segment_set(MIXED_GATE_RELEASE, &release, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &gate));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    // Silence, a loud negative span, then a quiet tail
+    for(uint32_t i=0; i<100; ++i)
+      data[i] = (i < 20)? 0.0f : (i < 60)? -1.0f : 0.001f;
+    pass(mixed_buffer_finish_write(100, &in));
+    pass(mixed_segment_start(&gate));
+    pass(mixed_segment_mix(&gate));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 100);
+    for(uint32_t i=0; i<20; ++i) is_f(data[i], 0.0f);
+    if(1e-6f < fabsf(data[25] + 0.5f)) fail_test("Attack ramp is off");
+    for(uint32_t i=30; i<60; ++i) is_f(data[i], -1.0f);
+    // Held for five samples, then released over ten
+    is_f(data[64], 0.001f);
+    if(1e-6f < fabsf(data[70] - 0.0005f)) fail_test("Release ramp is off");
+    for(uint32_t i=75; i<100; ++i) is_f(data[i], 0.0f);
+
+  cleanup:
+    mixed_free_segment(&gate);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(gate_inverted_thresholds, {
+    struct mixed_segment gate = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    float open = -30.0f, close = -10.0f, attack = 0.01f, hold = 0.0f, *data = 0;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(128, &in));
+    pass(mixed_make_buffer(128, &out));
+    pass(mixed_make_segment_gate(1000, &gate));
+    pass(mixed_segment_set(MIXED_GATE_OPEN_THRESHOLD, &open, &gate));
+    pass(mixed_segment_set(MIXED_GATE_CLOSE_THRESHOLD, &close, &gate));
+    pass(mixed_segment_set(MIXED_GATE_ATTACK, &attack, &gate));
+    pass(mixed_segment_set(MIXED_GATE_HOLD, &hold, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &gate));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    // Between the two thresholds, so the gate must open and stay open
+    for(uint32_t i=0; i<100; ++i) data[i] = 0.1f;
+    pass(mixed_buffer_finish_write(100, &in));
+    pass(mixed_segment_start(&gate));
+    pass(mixed_segment_mix(&gate));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 100);
+    for(uint32_t i=10; i<100; ++i) is_f(data[i], 0.1f);
+
+  cleanup:
+    mixed_free_segment(&gate);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(sidechain, {
+    struct mixed_segment gate = {0}, limiter = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0}, key = {0};
+    float attack = 0.01f, threshold = -6.0f, *data = 0;
+    uint8_t enable = 1;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(4096, &in[i]));
+      pass(mixed_make_buffer(4096, &out[i]));
+    }
+    pass(mixed_make_buffer(4096, &key));
+    // Loud channels stay shut until the key opens the gate on both
+    pass(mixed_make_segment_linked_gate(2, 1000, &gate));
+    pass(mixed_segment_set(MIXED_GATE_ATTACK, &attack, &gate));
+    for(int i=0; i<2; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &gate));
+      pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &gate));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_write(&data, &samples, &in[i]));
+      for(uint32_t j=0; j<100; ++j) data[j] = (i == 0)? 1.0f : -0.5f;
+      pass(mixed_buffer_finish_write(100, &in[i]));
+    }
+    pass(mixed_segment_set_in(MIXED_BUFFER, 2, &key, &gate));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &key));
+    for(uint32_t j=0; j<100; ++j) data[j] = (j < 50)? 0.0f : 1.0f;
+    pass(mixed_buffer_finish_write(100, &key));
+    pass(mixed_segment_start(&gate));
+    pass(mixed_segment_mix(&gate));
+    is(mixed_buffer_available_read(&key), 0);
+    for(int i=0; i<2; ++i){
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out[i]));
+      is(samples, 100);
+      for(uint32_t j=0; j<50; ++j) is_f(data[j], 0.0f);
+      for(uint32_t j=60; j<100; ++j) is_f(data[j], (i == 0)? 1.0f : -0.5f);
+      pass(mixed_buffer_finish_read(samples, &out[i]));
+    }
+    // A quiet stem is ducked by a loud key it does not contain
+    pass(mixed_make_segment_linked_compressor(2, 44100, &limiter));
+    pass(mixed_segment_set(MIXED_COMPRESSOR_LIMITER, &enable, &limiter));
+    pass(mixed_segment_set(MIXED_COMPRESSOR_THRESHOLD, &threshold, &limiter));
+    for(int i=0; i<2; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &limiter));
+      pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &limiter));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_write(&data, &samples, &in[i]));
+      for(uint32_t j=0; j<samples; ++j) data[j] = 0.25f;
+      pass(mixed_buffer_finish_write(samples, &in[i]));
+    }
+    pass(mixed_segment_set_in(MIXED_BUFFER, 2, &key, &limiter));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &key));
+    for(uint32_t j=0; j<samples; ++j) data[j] = 1.0f;
+    pass(mixed_buffer_finish_write(samples, &key));
+    pass(mixed_segment_start(&limiter));
+    pass(mixed_segment_mix(&limiter));
+    for(int i=0; i<2; ++i){
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out[i]));
+      if(samples < 2048) fail_test("Too little output");
+      if(0.001f < fabsf(data[samples-1] - 0.1253f)) fail_test("Key did not duck the stem");
+    }
+
+  cleanup:
+    mixed_free_segment(&gate);
+    mixed_free_segment(&limiter);
+    mixed_free_buffer(&key);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+define_test(sidechain_short, {
+    struct mixed_segment gate = {0};
+    struct mixed_buffer in = {0}, key = {0};
+    float *data = 0;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(4096, &in));
+    pass(mixed_make_buffer(4096, &key));
+    pass(mixed_make_segment_gate(1000, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &key, &gate));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t j=0; j<100; ++j) data[j] = 1.0f;
+    pass(mixed_buffer_finish_write(100, &in));
+    pass(mixed_segment_start(&gate));
+    // Nothing to key on yet leaves the input as it is
+    pass(mixed_segment_mix(&gate));
+    is(mixed_buffer_is_silent(&in), 0);
+    is(mixed_buffer_available_read(&in), 100);
+    // A closed gate over only part of the input does not silence the rest
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &key));
+    for(uint32_t j=0; j<50; ++j) data[j] = 0.0f;
+    pass(mixed_buffer_finish_write(50, &key));
+    pass(mixed_segment_mix(&gate));
+    is(mixed_buffer_is_silent(&in), 0);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &in));
+    is(samples, 100);
+    is_f(data[99], 1.0f);
+
+  cleanup:
+    mixed_free_segment(&gate);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&key);
+  })
+
+define_test(delay_taps, {
+    struct mixed_segment delay = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    struct mixed_delay_tap echo = {1, 0.003f, 0.5f, 0.0f, 0.0f};
+    struct mixed_delay_tap chorus = {2, 0.002f, 0.25f, 0.001f, 5.0f};
+    uint32_t samples = UINT32_MAX, count = 3;
+    float *data = 0;
+    pass(mixed_make_buffer(1024, &in));
+    pass(mixed_make_buffer(1024, &out));
+    pass(mixed_make_segment_delay(0.001f, 1000, &delay));
+    pass(mixed_segment_set(MIXED_DELAY_TAP_COUNT, &count, &delay));
+    pass(mixed_segment_set(MIXED_DELAY_TAP, &echo, &delay));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &delay));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &delay));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<400; ++i)
+      data[i] = (i == 0)? 1.0f : 0.0f;
+    pass(mixed_buffer_finish_write(400, &in));
+    pass(mixed_segment_start(&delay));
+    pass(mixed_segment_mix(&delay));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 400);
+    // The impulse comes back at both taps and nowhere else.
+    for(uint32_t i=0; i<400; ++i)
+      is_f(data[i], (i == 1)? 1.0f : (i == 3)? 0.5f : 0.0f);
+    pass(mixed_buffer_finish_read(samples, &out));
+    // A modulated tap keeps a DC input level through interpolation.
+    pass(mixed_segment_set(MIXED_DELAY_TAP, &chorus, &delay));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<400; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(400, &in));
+    pass(mixed_segment_mix(&delay));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    for(uint32_t i=10; i<400; ++i)
+      if(1e-6f < fabsf(data[i] - 1.75f)) fail_test("Taps do not sum up");
+
+  cleanup:
+    mixed_free_segment(&delay);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(fade_curves, {
+    struct mixed_segment fade = {0}, volume = {0};
+    struct mixed_buffer in = {0}, out = {0}, right = {0};
+    uint32_t samples = UINT32_MAX, duration = 10;
+    float pan = 0.5f, *data = 0;
+    pass(mixed_make_buffer(512, &in));
+    pass(mixed_make_buffer(512, &out));
+    pass(mixed_make_buffer(512, &right));
+    pass(mixed_make_segment_fade(0.0f, 1.0f, 0.1f, MIXED_CUBIC_IN_OUT, 1000, &fade));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &fade));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &fade));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<200; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(200, &in));
+    pass(mixed_segment_start(&fade));
+    pass(mixed_segment_mix(&fade));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 200);
+    is_f(data[0], 0.0f);
+    if(1e-5f < fabsf(data[25] - 0.0625f)) fail_test("Fade in is off");
+    if(1e-5f < fabsf(data[50] - 0.5f)) fail_test("Fade midpoint is off");
+    if(1e-5f < fabsf(data[75] - 0.9375f)) fail_test("Fade out is off");
+    for(uint32_t i=100; i<200; ++i) is_f(data[i], 1.0f);
+    // Pan the faded signal in place, ramping over ten samples
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<200; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(200, &in));
+    pass(mixed_make_segment_volume_control(1.0f, 0.0f, &volume));
+    pass(mixed_segment_set(MIXED_RAMP_DURATION, &duration, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &out, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &in, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &volume));
+    pass(mixed_segment_set(MIXED_VOLUME_CONTROL_PAN, &pan, &volume));
+    pass(mixed_segment_start(&volume));
+    pass(mixed_segment_mix(&volume));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 200);
+    if(1e-7f < fabsf(data[4] - 0.75f*4*0.04f*0.04f*0.04f)) fail_test("Pan ramp is off");
+    for(uint32_t i=100; i<200; ++i) is_f(data[i], 0.5f);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &right));
+    is(samples, 200);
+    for(uint32_t i=0; i<200; ++i) is_f(data[i], 1.0f);
+
+  cleanup:
+    mixed_free_segment(&fade);
+    mixed_free_segment(&volume);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&right);
+  })
+
+define_test(volume_silent_skip, {
+    // Each ramp moves on by as much silence as its own channel passed.
+    struct mixed_segment volume = {0};
+    struct mixed_buffer left = {0}, right = {0}, left_out = {0}, right_out = {0};
+    uint32_t samples, duration = 100;
+    enum mixed_ramp_type type = MIXED_LINEAR_RAMP;
+    float target = 0.0f, *data = 0;
+    pass(mixed_make_buffer(256, &left));
+    pass(mixed_make_buffer(256, &right));
+    pass(mixed_make_buffer(256, &left_out));
+    pass(mixed_make_buffer(256, &right_out));
+    pass(mixed_make_segment_volume_control(1.0f, 0.0f, &volume));
+    pass(mixed_segment_set(MIXED_RAMP_DURATION, &duration, &volume));
+    pass(mixed_segment_set(MIXED_RAMP_TYPE, &type, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &left, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left_out, &volume));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &right, &volume));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right_out, &volume));
+    pass(mixed_segment_start(&volume));
+    pass(mixed_segment_set(MIXED_VOLUME, &target, &volume));
+    samples = 100;
+    pass(mixed_buffer_request_write(&data, &samples, &left));
+    memset(data, 0, samples*sizeof(float));
+    pass(mixed_buffer_finish_write_silence(100, &left));
+    samples = 10;
+    pass(mixed_buffer_request_write(&data, &samples, &right));
+    memset(data, 0, samples*sizeof(float));
+    pass(mixed_buffer_finish_write_silence(10, &right));
+    pass(mixed_segment_mix(&volume));
+    is(mixed_buffer_available_read(&left_out), 100);
+    is(mixed_buffer_available_read(&right_out), 10);
+    mixed_buffer_clear(&left_out);
+    mixed_buffer_clear(&right_out);
+    samples = 10;
+    pass(mixed_buffer_request_write(&data, &samples, &left));
+    for(uint32_t i=0; i<10; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(10, &left));
+    samples = 10;
+    pass(mixed_buffer_request_write(&data, &samples, &right));
+    for(uint32_t i=0; i<10; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(10, &right));
+    pass(mixed_segment_mix(&volume));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &left_out));
+    is(samples, 10);
+    for(uint32_t i=0; i<10; ++i) is_f(data[i], 0.0f);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &right_out));
+    is(samples, 10);
+    if(data[0] < 0.5f || data[9] < 0.5f) fail_test("Right ramp skipped the left's silence");
+
+  cleanup:
+    mixed_free_segment(&volume);
+    mixed_free_buffer(&left);
+    mixed_free_buffer(&right);
+    mixed_free_buffer(&left_out);
+    mixed_free_buffer(&right_out);
+  })
+
+define_test(repeat_overdub, {
+    struct mixed_segment repeat = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    float max_time = 0.02f, time = 0.015f, expected[10], *data = 0;
+    enum mixed_repeat_mode mode = MIXED_OVERDUB;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(1024, &in));
+    pass(mixed_make_buffer(1024, &out));
+    pass(mixed_make_segment_repeat(0.01f, 1000, &repeat));
+    pass(mixed_segment_set(MIXED_REPEAT_MAX_TIME, &max_time, &repeat));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &repeat));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &repeat));
+    pass(mixed_segment_start(&repeat));
+    // Record a constant loop, then layer the same on top of it twenty
+    // times, fading in over the first hundred samples.
+    for(int round=0; round<2; ++round){
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      for(uint32_t i=0; i<200; ++i) data[i] = 1.0f;
+      pass(mixed_buffer_finish_write(200, &in));
+      pass(mixed_segment_mix(&repeat));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      is(samples, 200);
+      if(round == 0) for(uint32_t i=100; i<200; ++i) is_f(data[i], 1.0f);
+      pass(mixed_buffer_finish_read(samples, &out));
+      pass(mixed_segment_set(MIXED_REPEAT_MODE, &mode, &repeat));
+    }
+    for(uint32_t j=0; j<10; ++j){
+      expected[j] = 1.0f;
+      for(uint32_t t=j; t<200; t+=10) expected[j] += (t < 100)? t/100.0f : 1.0f;
+    }
+    // Lengthening the loop within the capacity keeps the recording.
+    pass(mixed_segment_set(MIXED_REPEAT_TIME, &time, &repeat));
+    mode = MIXED_PLAY;
+    pass(mixed_segment_set(MIXED_REPEAT_MODE, &mode, &repeat));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<30; ++i) data[i] = 0.0f;
+    pass(mixed_buffer_finish_write(30, &in));
+    pass(mixed_segment_mix(&repeat));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 30);
+    for(uint32_t i=0; i<30; ++i){
+      float value = (i%15 < 10)? expected[i%15] : 0.0f;
+      if(1e-4f < fabsf(data[i] - value)) fail_test("Loop does not play back its layers");
+    }
+
+  cleanup:
+    mixed_free_segment(&repeat);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(quantize_hold, {
+    struct mixed_segment quantize = {0};
+    struct mixed_buffer buffer = {0};
+    uint32_t samples = UINT32_MAX, hold = 3;
+    float *data = 0;
+    pass(mixed_make_buffer(64, &buffer));
+    pass(mixed_make_segment_quantize(4, &quantize));
+    pass(mixed_segment_set(MIXED_QUANTIZE_HOLD, &hold, &quantize));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &buffer, &quantize));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &buffer, &quantize));
+    pass(mixed_buffer_request_write(&data, &samples, &buffer));
+    for(uint32_t i=0; i<10; ++i) data[i] = i*0.1f;
+    pass(mixed_buffer_finish_write(10, &buffer));
+    pass(mixed_segment_start(&quantize));
+    // Works in place, quantizing every third sample and holding it
+    pass(mixed_segment_mix(&quantize));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &buffer));
+    is(samples, 10);
+    for(uint32_t i=0; i<3; ++i) is_f(data[i], 0.0f);
+    for(uint32_t i=3; i<6; ++i) is_f(data[i], 0.25f);
+    for(uint32_t i=6; i<9; ++i) is_f(data[i], 0.5f);
+    is_f(data[9], 0.75f);
+
+  cleanup:
+    mixed_free_segment(&quantize);
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(pitch_octave, {
+    struct mixed_segment pitch = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    uint32_t samples = UINT32_MAX, crossings = 0;
+    float *data = 0;
+    pass(mixed_make_buffer(8192, &in));
+    pass(mixed_make_buffer(8192, &out));
+    pass(fill(&in, 500, 8192));
+    pass(mixed_make_segment_pitch(2.0f, 44100, &pitch));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &pitch));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &pitch));
+    pass(mixed_segment_start(&pitch));
+    pass(mixed_segment_mix(&pitch));
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 8192);
+    // Past the latency of a frame, the tone should come out at 1kHz,
+    // riding on the offset that fill adds.
+    for(uint32_t i=4096; i<8191; ++i){
+      if((data[i] < 0.25f) != (data[i+1] < 0.25f)) ++crossings;
+    }
+    if(crossings < 175 || 195 < crossings) fail_test("Pitch was not doubled");
+
+  cleanup:
+    mixed_free_segment(&pitch);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(pitch_wsola, {
+    struct mixed_segment pitch = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    uint32_t samples = UINT32_MAX, crossings = 0;
+    enum mixed_pitch_mode mode = MIXED_PITCH_WSOLA;
+    float *data = 0;
+    pass(mixed_make_buffer(8192, &in));
+    pass(mixed_make_buffer(8192, &out));
+    pass(fill(&in, 500, 8192));
+    pass(mixed_make_segment_pitch(2.0f, 44100, &pitch));
+    pass(mixed_segment_set(MIXED_PITCH_MODE, &mode, &pitch));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &pitch));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &pitch));
+    pass(mixed_segment_start(&pitch));
+    pass(mixed_segment_mix(&pitch));
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 8192);
+    // Grains only delay by a few hundred samples.
+    for(uint32_t i=2048; i<8191; ++i){
+      if((data[i] < 0.25f) != (data[i+1] < 0.25f)) ++crossings;
+    }
+    if(crossings < 260 || 297 < crossings) fail_test("Pitch was not doubled");
+
+  cleanup:
+    mixed_free_segment(&pitch);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(biquad_silence, {
+    struct mixed_segment filter = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    float *data = 0;
+    uint32_t samples = 64, blocks = 0;
+    pass(mixed_make_buffer(64, &in));
+    pass(mixed_make_buffer(64, &out));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 1000, 44100, &filter));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &filter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &filter));
+    pass(mixed_segment_start(&filter));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<samples; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(samples, &in));
+    pass(mixed_segment_mix(&filter));
+    is(mixed_buffer_is_silent(&out), 0);
+    // Feed silence until the tail has died down
+    do{
+      mixed_buffer_clear(&out);
+      samples = 64;
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      memset(data, 0, samples*sizeof(float));
+      pass(mixed_buffer_finish_write_silence(samples, &in));
+      pass(mixed_segment_mix(&filter));
+    }while(!mixed_buffer_is_silent(&out) && ++blocks < 100);
+    if(100 <= blocks) fail_test("Tail never turned silent");
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 64);
+    for(uint32_t i=0; i<samples; ++i) is_f(data[i], 0.0f);
+
+  cleanup:
+    mixed_free_segment(&filter);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(equalizer, {
+    struct mixed_segment eq = {0};
+    struct mixed_buffer in[3] = {0}, out[3] = {0}, a = {0}, b = {0};
+    struct mixed_equalizer_band bands[] = {
+      {0, MIXED_LOWSHELF, 200, 1.0, 6.0},
+      {1, MIXED_PEAKING, 1000, 1.0, -3.0},
+      {2, MIXED_HIGHSHELF, 5000, 1.0, 4.0}};
+    struct mixed_equalizer_band band = {0};
+    uint32_t samples = 1000, count = 0;
+    for(int i=0; i<3; ++i){
+      pass(mixed_make_buffer(samples, &in[i]));
+      pass(mixed_make_buffer(samples, &out[i]));
+    }
+    pass(mixed_make_buffer(samples, &a));
+    pass(mixed_make_buffer(samples, &b));
+    pass(mixed_make_segment_equalizer(3, 3, 44100, &eq));
+    pass(mixed_segment_get(MIXED_EQUALIZER_BAND_COUNT, &count, &eq));
+    is(count, 3);
+    for(int i=0; i<3; ++i){
+      pass(fill(&in[i], 500*(i+1), samples));
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &eq));
+      pass(mixed_segment_set_out(MIXED_BUFFER, i, &out[i], &eq));
+    }
+    // A fresh equalizer is flat
+    pass(mixed_segment_start(&eq));
+    pass(mixed_segment_mix(&eq));
+    for(int i=0; i<3; ++i){
+      pass(fill(&a, 500*(i+1), samples));
+      pass(same(&a, &out[i]));
+      mixed_buffer_clear(&a);
+      mixed_buffer_clear(&out[i]);
+      pass(fill(&in[i], 500*(i+1), samples));
+    }
+    for(int i=0; i<3; ++i){
+      pass(mixed_segment_set(MIXED_EQUALIZER_BAND, &bands[i], &eq));
+    }
+    band.band = 3;
+    fail(mixed_segment_set(MIXED_EQUALIZER_BAND, &band, &eq));
+    band.band = 1;
+    pass(mixed_segment_get(MIXED_EQUALIZER_BAND, &band, &eq));
+    is(band.type, MIXED_PEAKING);
+    is_f(band.gain, -3.0f);
+    pass(mixed_segment_start(&eq));
+    pass(mixed_segment_mix(&eq));
+    // Every channel must match the same chain of single filters
+    for(int i=0; i<3; ++i){
+      mixed_buffer_clear(&a);
+      pass(fill(&a, 500*(i+1), samples));
+      pass(filter(MIXED_LOWSHELF, 200, 6.0, &a, &b));
+      mixed_buffer_clear(&a);
+      pass(filter(MIXED_PEAKING, 1000, -3.0, &b, &a));
+      mixed_buffer_clear(&b);
+      pass(filter(MIXED_HIGHSHELF, 5000, 4.0, &a, &b));
+      pass(same(&out[i], &b));
+      mixed_buffer_clear(&a);
+      mixed_buffer_clear(&b);
+    }
+
+  cleanup:
+    mixed_free_segment(&eq);
+    for(int i=0; i<3; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+  })
+
+static int convolve(struct mixed_impulse_response *response, float *input, float *output, uint32_t samples){
+  struct mixed_segment convolution = {0};
+  struct mixed_buffer in = {0}, out = {0};
+  int status = 0;
+  if(!mixed_make_buffer(100, &in)) goto cleanup;
+  if(!mixed_make_buffer(100, &out)) goto cleanup;
+  if(!mixed_make_segment_convolution(response, &convolution)) goto cleanup;
+  if(!mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &convolution)) goto cleanup;
+  if(!mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &convolution)) goto cleanup;
+  if(!mixed_segment_start(&convolution)) goto cleanup;
+  // Blocks that do not line up with the partitions
+  for(uint32_t i=0; i<samples; i+=100){
+    float *data;
+    uint32_t count = 100;
+    if(!mixed_buffer_request_write(&data, &count, &in)) goto cleanup;
+    for(uint32_t j=0; j<count; ++j) data[j] = input[i+j];
+    mixed_buffer_finish_write(count, &in);
+    if(!mixed_segment_mix(&convolution)) goto cleanup;
+    count = 100;
+    if(!mixed_buffer_request_read(&data, &count, &out)) goto cleanup;
+    for(uint32_t j=0; j<count; ++j) output[i+j] = data[j];
+    mixed_buffer_finish_read(count, &out);
+  }
+  status = 1;
+
+ cleanup:
+  mixed_free_segment(&convolution);
+  mixed_free_buffer(&in);
+  mixed_free_buffer(&out);
+  return status;
+}
+
+define_test(convolution, {
+    struct mixed_impulse_response response = {0};
+    float impulse[300], input[1000], output[1000], shared[1000];
+    for(int i=0; i<300; ++i) impulse[i] = sinf(i*0.37f) * expf(-i*0.01f);
+    for(int i=0; i<1000; ++i) input[i] = sinf(i*0.11f) + 0.3f*cosf(i*1.3f);
+    fail(mixed_make_impulse_response(impulse, 300, 48, &response));
+    pass(mixed_make_impulse_response(impulse, 300, 64, &response));
+    is(response.partition, 64);
+    pass(convolve(&response, input, output, 1000));
+    // The output lags by one partition
+    for(int n=0; n<1000; ++n){
+      double expected = 0.0;
+      for(int k=0; k<300 && k<=n-64; ++k)
+        expected += impulse[k] * input[n-64-k];
+      if(1e-3 < fabs(output[n] - expected))
+        fail_test("Sample %i is %f instead of %f", n, output[n], expected);
+    }
+    // Segments keep the response alive on their own
+    struct mixed_segment kept = {0};
+    pass(mixed_make_segment_convolution(&response, &kept));
+    mixed_free_impulse_response(&response);
+    response = (struct mixed_impulse_response){0};
+    mixed_free_segment(&kept);
+
+    pass(mixed_make_impulse_response(impulse, 300, 64, &response));
+    pass(convolve(&response, input, shared, 1000));
+    for(int i=0; i<1000; ++i) is_f(shared[i], output[i]);
+
+  cleanup:
+    mixed_free_impulse_response(&response);
+  })
+
+static void *doubler_make(uint32_t samplerate){
+  static int state;
+  (void)samplerate;
+  return &state;
+}
+
+static void doubler_free(void *state){
+  (void)state;
+}
+
+static int doubler_process(float **in, float **out, uint32_t samples, void *state){
+  (void)state;
+  if(samples != 16 || ((uintptr_t)in[0] & 63) || ((uintptr_t)out[0] & 63)) return 0;
+  for(uint32_t i=0; i<samples; ++i)
+    out[0][i] = in[0][i] * 2.0f;
+  return 1;
+}
+
+static struct mixed_block_processor doubler = {
+  MIXED_BLOCK_PROCESSOR_VERSION, "test_doubler", "Doubles its input.",
+  1, 1, 16, 3, MIXED_BLOCK_INPLACE | MIXED_BLOCK_SIMD,
+  doubler_make, doubler_free, 0, doubler_process, 0, 0};
+
+define_test(block_processor, {
+    struct mixed_segment block = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    uint32_t samples = UINT32_MAX, latency = 0, samplerate = 44100;
+    void *args[] = {&samplerate};
+    float *data = 0;
+    pass(mixed_make_buffer(128, &in));
+    pass(mixed_make_buffer(128, &out));
+    pass(mixed_register_block_processor(&doubler));
+    fail(mixed_register_block_processor(&doubler));
+    pass(mixed_make_segment("test_doubler", args, &block));
+    mixed_free_segment(&block);
+    struct mixed_segment_constructor *constructor = mixed_find_segment("test_doubler");
+    if(!constructor) fail_test("Processor not found");
+    pass(mixed_make_segment_from(constructor, args, &block));
+    pass(mixed_segment_get(MIXED_LATENCY, &latency, &block));
+    is(latency, 3);
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &block));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &block));
+    pass(mixed_segment_start(&block));
+    // Two whole blocks run directly, the rest waits for more input.
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<40; ++i) data[i] = i;
+    pass(mixed_buffer_finish_write(40, &in));
+    pass(mixed_segment_mix(&block));
+    is(mixed_buffer_available_read(&out), 32);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<24; ++i) data[i] = 40+i;
+    pass(mixed_buffer_finish_write(24, &in));
+    pass(mixed_segment_mix(&block));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 64);
+    for(uint32_t i=0; i<64; ++i) is_f(data[i], 2.0f*i);
+
+  cleanup:
+    mixed_free_segment(&block);
+    mixed_deregister_segment("test_doubler");
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(meter, {
+    struct mixed_segment meter = {0};
+    struct mixed_buffer in = {0}, out = {0}, quiet = {0};
+    struct mixed_meter_levels levels = {0};
+    uint32_t samples = 4800;
+    float *data;
+    pass(mixed_make_buffer(samples, &in));
+    pass(mixed_make_buffer(samples, &out));
+    pass(mixed_make_buffer(samples, &quiet));
+    pass(mixed_make_segment_meter(2, 48000, &meter));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &meter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &meter));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &quiet, &meter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 1, &quiet, &meter));
+    pass(mixed_segment_start(&meter));
+    // Half a second of a full scale sine at 1kHz on one channel
+    for(uint32_t block=0; block<5; ++block){
+      samples = 4800;
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      for(uint32_t i=0; i<samples; ++i)
+        data[i] = sinf(2 * M_PI * 1000 * (block*4800+i) / 48000);
+      pass(mixed_buffer_finish_write(samples, &in));
+      samples = 4800;
+      pass(mixed_buffer_request_write(&data, &samples, &quiet));
+      memset(data, 0, samples*sizeof(float));
+      pass(mixed_buffer_finish_write(samples, &quiet));
+      pass(mixed_segment_mix(&meter));
+      is(mixed_buffer_available_read(&out), 4800);
+      mixed_buffer_clear(&out);
+      mixed_buffer_clear(&quiet);
+    }
+    levels.channel = 0;
+    pass(mixed_segment_get(MIXED_METER_LEVELS, &levels, &meter));
+    if(levels.peak < 0.99f || 1.0f < levels.peak) fail_test("Peak is %f", levels.peak);
+    if(levels.true_peak < levels.peak || 1.01f < levels.true_peak) fail_test("True peak is %f", levels.true_peak);
+    if(fabsf(levels.rms - 0.7071f) > 0.01f) fail_test("RMS is %f", levels.rms);
+    // The reference level of BS.1770
+    if(fabsf(levels.momentary + 3.01f) > 0.1f) fail_test("Momentary loudness is %f", levels.momentary);
+    if(levels.momentary - 7.0f < levels.short_term) fail_test("Short term loudness is %f", levels.short_term);
+    pass(mixed_segment_get(MIXED_METER_LEVELS, &levels, &meter));
+    is_f(levels.peak, 0.0f);
+    levels.channel = 1;
+    pass(mixed_segment_get(MIXED_METER_LEVELS, &levels, &meter));
+    is_f(levels.rms, 0.0f);
+    levels.channel = 2;
+    fail(mixed_segment_get(MIXED_METER_LEVELS, &levels, &meter));
+
+  cleanup:
+    mixed_free_segment(&meter);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&quiet);
+  })
+
+define_test(spectrum, {
+    struct mixed_segment spectrum = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    struct mixed_spectrum result = {0};
+    float magnitudes[513] = {0};
+    enum mixed_window_type window = MIXED_BLACKMAN_WINDOW;
+    float overlap = 1.0f;
+    uint32_t samples = 2048;
+    float *data;
+    pass(mixed_make_buffer(samples, &in));
+    pass(mixed_make_buffer(samples, &out));
+    fail(mixed_make_segment_spectrum(1000, 48000, &spectrum));
+    pass(mixed_make_segment_spectrum(1024, 48000, &spectrum));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &spectrum));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &spectrum));
+    fail(mixed_segment_set(MIXED_SPECTRUM_OVERLAP, &overlap, &spectrum));
+    pass(mixed_segment_start(&spectrum));
+    result.magnitudes = magnitudes;
+    result.bins = 513;
+    pass(mixed_segment_get(MIXED_SPECTRUM, &result, &spectrum));
+    is(result.frames, 0);
+    // A sine right on bin 64
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<samples; ++i)
+      data[i] = 0.5f*sinf(2 * M_PI * 3000 * i / 48000);
+    pass(mixed_buffer_finish_write(samples, &in));
+    pass(mixed_segment_mix(&spectrum));
+    is(mixed_buffer_available_read(&out), 2048);
+    result.bins = 513;
+    pass(mixed_segment_get(MIXED_SPECTRUM, &result, &spectrum));
+    is(result.frames, 3);
+    is(result.bins, 513);
+    if(fabsf(magnitudes[64] - 0.5f) > 0.01f) fail_test("Peak bin is %f", magnitudes[64]);
+    if(magnitudes[200] > 0.001f) fail_test("Far bin is %f", magnitudes[200]);
+    pass(mixed_segment_set(MIXED_SPECTRUM_WINDOW, &window, &spectrum));
+    window = 0;
+    pass(mixed_segment_get(MIXED_SPECTRUM_WINDOW, &window, &spectrum));
+    is(window, MIXED_BLACKMAN_WINDOW);
+
+  cleanup:
+    mixed_free_segment(&spectrum);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+static int run_filter(struct mixed_segment *filter, float frequency, uint32_t offset, uint32_t samples, struct mixed_buffer *in, struct mixed_buffer *out){
+  float *data;
+  mixed_buffer_clear(in);
+  mixed_buffer_clear(out);
+  if(!mixed_buffer_request_write(&data, &samples, in)) return 0;
+  for(uint32_t i=0; i<samples; ++i)
+    data[i] = 0.5f*sinf(2 * M_PI * frequency * (offset+i) / 44100) + 0.25f*sinf(2 * M_PI * 5 * frequency * (offset+i) / 44100);
+  if(!mixed_buffer_finish_write(samples, in)) return 0;
+  return mixed_segment_mix(filter);
+}
+
+define_test(biquad_table, {
+    struct mixed_segment table = {0}, exact = {0};
+    struct mixed_buffer in = {0}, a = {0}, b = {0};
+    enum mixed_biquad_filter types[] = {MIXED_LOWPASS, MIXED_PEAKING, MIXED_HIGHSHELF};
+    float frequencies[] = {1234, 517, 7000};
+    float Q = 0.7f, gain = -6.0f, frequency;
+    float *x = 0, *y = 0;
+    bool on = true;
+    uint32_t samples;
+    pass(mixed_make_buffer(4096, &in));
+    pass(mixed_make_buffer(4096, &a));
+    pass(mixed_make_buffer(4096, &b));
+    // Interpolated designs must sound like exact ones
+    for(int t=0; t<3; ++t){
+      mixed_free_segment(&table);
+      mixed_free_segment(&exact);
+      pass(mixed_make_segment_biquad_filter(types[t], frequencies[t], 44100, &table));
+      pass(mixed_make_segment_biquad_filter(types[t], frequencies[t], 44100, &exact));
+      pass(mixed_segment_set(MIXED_GAIN, &gain, &table));
+      pass(mixed_segment_set(MIXED_GAIN, &gain, &exact));
+      pass(mixed_segment_set(MIXED_BIQUAD_TABLE, &on, &table));
+      pass(mixed_segment_get(MIXED_BIQUAD_TABLE, &on, &table));
+      is(on, true);
+      pass(mixed_segment_set(MIXED_Q, &Q, &table));
+      pass(mixed_segment_set(MIXED_Q, &Q, &exact));
+      pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &table));
+      pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &table));
+      pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &exact));
+      pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &b, &exact));
+      pass(mixed_segment_start(&table));
+      pass(mixed_segment_start(&exact));
+      pass(run_filter(&table, 300, 0, 4096, &in, &a));
+      pass(run_filter(&exact, 300, 0, 4096, &in, &b));
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&x, &samples, &a));
+      pass(mixed_buffer_request_read(&y, &samples, &b));
+      is(samples, 4096);
+      for(uint32_t i=0; i<samples; ++i){
+        if(1e-2 < fabsf(x[i] - y[i])) fail_test("Interpolated design differs");
+      }
+    }
+    // A sweep glides to the new response without jumping
+    mixed_free_segment(&table);
+    mixed_free_segment(&exact);
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 500, 44100, &table));
+    pass(mixed_segment_set(MIXED_BIQUAD_TABLE, &on, &table));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &table));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &table));
+    pass(mixed_segment_start(&table));
+    pass(run_filter(&table, 300, 0, 1024, &in, &a));
+    frequency = 8000;
+    pass(mixed_segment_set(MIXED_FREQUENCY, &frequency, &table));
+    pass(run_filter(&table, 300, 1024, 4096, &in, &a));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 8000, 44100, &exact));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &exact));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &b, &exact));
+    pass(mixed_segment_start(&exact));
+    pass(run_filter(&exact, 300, 1024, 4096, &in, &b));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&x, &samples, &a));
+    pass(mixed_buffer_request_read(&y, &samples, &b));
+    is(samples, 4096);
+    // The cut-off harmonic comes in over the ramp, not all at once
+    for(uint32_t i=1; i<256; ++i){
+      if(0.1f < fabsf(x[i] - x[i-1]))fail_test("Filter jumped");
+    }
+    for(uint32_t i=3072; i<samples; ++i){
+      if(1e-2 < fabsf(x[i] - y[i])) fail_test("Sweep did not settle");
+    }
+    // A new gain is designed exactly and still glides there
+    mixed_free_segment(&table);
+    mixed_free_segment(&exact);
+    pass(mixed_make_segment_biquad_filter(MIXED_PEAKING, 517, 44100, &table));
+    pass(mixed_segment_set(MIXED_BIQUAD_TABLE, &on, &table));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &table));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &table));
+    pass(mixed_segment_start(&table));
+    pass(run_filter(&table, 300, 0, 1024, &in, &a));
+    pass(mixed_segment_set(MIXED_GAIN, &gain, &table));
+    pass(run_filter(&table, 300, 1024, 4096, &in, &a));
+    pass(mixed_make_segment_biquad_filter(MIXED_PEAKING, 517, 44100, &exact));
+    pass(mixed_segment_set(MIXED_GAIN, &gain, &exact));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &in, &exact));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &b, &exact));
+    pass(mixed_segment_start(&exact));
+    pass(run_filter(&exact, 300, 1024, 4096, &in, &b));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&x, &samples, &a));
+    pass(mixed_buffer_request_read(&y, &samples, &b));
+    for(uint32_t i=1; i<256; ++i){
+      if(0.1f < fabsf(x[i] - x[i-1]))fail_test("Filter jumped");
+    }
+    for(uint32_t i=3072; i<samples; ++i){
+      if(1e-2 < fabsf(x[i] - y[i])) fail_test("Gain did not settle");
+    }
+
+  cleanup:
+    mixed_free_segment(&table);
+    mixed_free_segment(&exact);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+  })
+
+define_test(ladspa_multi, {
+    // Every channel runs through its own instance of the amplifier,
+    // with the instances spread over several threads.
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[4] = {0}, out[4] = {0};
+    struct mixed_segment_info info = {0};
+    float gain = 0.5f;
+    float *data;
+    uint32_t samples;
+    for(uint32_t c=0; c<4; ++c){
+      pass(mixed_make_buffer(512, &in[c]));
+      pass(mixed_make_buffer(512, &out[c]));
+    }
+    pass(mixed_make_segment_ladspa_multi(TEST_LADSPA_PLUGIN, 0, 44100, 4, 4, &segment));
+    pass(mixed_segment_info(&info, &segment));
+    is(info.min_inputs, 4);
+    is(info.outputs, 4);
+    fail(mixed_segment_set_in(MIXED_BUFFER, 4, &in[0], &segment));
+    for(uint32_t c=0; c<4; ++c){
+      pass(mixed_segment_set_in(MIXED_BUFFER, c, &in[c], &segment));
+      pass(mixed_segment_set_out(MIXED_BUFFER, c, &out[c], &segment));
+    }
+    pass(mixed_segment_set(0, &gain, &segment));
+    pass(mixed_segment_start(&segment));
+    for(uint32_t round=0; round<8; ++round){
+      for(uint32_t c=0; c<4; ++c){
+        samples = 256;
+        pass(mixed_buffer_request_write(&data, &samples, &in[c]));
+        for(uint32_t i=0; i<samples; ++i)
+          data[i] = (float)(c+1) + (float)round;
+        mixed_buffer_finish_write(samples, &in[c]);
+      }
+      pass(mixed_segment_mix(&segment));
+      for(uint32_t c=0; c<4; ++c){
+        is(mixed_buffer_available_read(&in[c]), 0);
+        samples = UINT32_MAX;
+        pass(mixed_buffer_request_read(&data, &samples, &out[c]));
+        is(samples, 256);
+        for(uint32_t i=0; i<samples; ++i){
+          if(data[i] != ((float)(c+1) + (float)round) * gain)
+            fail_test("Wrong sample on an instance");
+        }
+        mixed_buffer_finish_read(samples, &out[c]);
+      }
+    }
+    pass(mixed_segment_end(&segment));
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(uint32_t c=0; c<4; ++c){
+      mixed_free_buffer(&in[c]);
+      mixed_free_buffer(&out[c]);
+    }
+  })
+
+#undef __TEST_SUITE
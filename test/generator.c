@@ -0,0 +1,152 @@
+#define __TEST_SUITE generator
+#include <math.h>
+#include "tester.h"
+
+static int render(enum mixed_generator_type type, uint32_t frequency, float *result, uint32_t samples){
+  struct mixed_segment generator = {0};
+  struct mixed_buffer out = {0};
+  float *data;
+  int status = 0;
+  if(!mixed_make_buffer(samples, &out)) goto cleanup;
+  if(!mixed_make_segment_generator(type, frequency, 48000, &generator)) goto cleanup;
+  if(!mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &generator)) goto cleanup;
+  if(!mixed_segment_start(&generator)) goto cleanup;
+  // Render in two blocks to check that the phase carries over
+  for(int i=0; i<2; ++i){
+    uint32_t count = UINT32_MAX;
+    if(!mixed_segment_mix(&generator)) goto cleanup;
+    if(!mixed_buffer_request_read(&data, &count, &out)) goto cleanup;
+    for(uint32_t j=0; j<count; ++j)
+      result[i*samples+j] = data[j];
+    mixed_buffer_finish_read(count, &out);
+  }
+  status = 1;
+
+ cleanup:
+  mixed_free_segment(&generator);
+  mixed_free_buffer(&out);
+  return status;
+}
+
+define_test(sine, {
+    float samples[2*100];
+    pass(render(MIXED_SINE, 1000, samples, 100));
+    for(uint32_t i=0; i<2*100; ++i){
+      float expected = 0.8f * sinf(2 * M_PI * 1000 * i / 48000);
+      if(1e-4 < fabsf(samples[i] - expected))
+        fail_test("Sample %u is %f instead of %f", i, samples[i], expected);
+    }
+  cleanup: {}
+  })
+
+define_test(band_limited, {
+    float samples[2*512];
+    enum mixed_generator_type types[] = {MIXED_SQUARE, MIXED_TRIANGLE, MIXED_SAWTOOTH};
+    for(int t=0; t<3; ++t){
+      // High tones must stay within full scale, low ones reach it
+      pass(render(types[t], 15000, samples, 512));
+      for(uint32_t i=0; i<2*512; ++i){
+        if(0.8f+1e-4 < fabsf(samples[i])) fail_test("Sample %u overshoots", i);
+      }
+      pass(render(types[t], 100, samples, 512));
+      float peak = 0.0f;
+      for(uint32_t i=0; i<2*512; ++i) peak = fmaxf(peak, fabsf(samples[i]));
+      if(peak < 0.79f) fail_test("Peak is only %f", peak);
+    }
+    // The square starts out high like the naive one
+    pass(render(MIXED_SQUARE, 100, samples, 512));
+    if(samples[120] < 0.7f) fail_test("Square is inverted");
+  cleanup: {}
+  })
+
+define_test(oscillator_bank, {
+    struct mixed_segment bank = {0};
+    struct mixed_buffer out = {0};
+    float frequencies[] = {1000.0f, 3000.0f, 50.0f};
+    float amplitudes[] = {0.5f, 0.25f, 0.0f};
+    float value = 0.0f, *data;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(200, &out));
+    pass(mixed_make_segment_oscillator_bank(3, MIXED_SINE, 48000, &bank));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &bank));
+    for(uint32_t v=0; v<3; ++v){
+      pass(mixed_segment_set_in(MIXED_GENERATOR_FREQUENCY, v, &frequencies[v], &bank));
+      pass(mixed_segment_set_in(MIXED_VOLUME, v, &amplitudes[v], &bank));
+    }
+    fail(mixed_segment_set_in(MIXED_VOLUME, 3, &value, &bank));
+    is(mixed_error(), MIXED_INVALID_LOCATION);
+    pass(mixed_segment_get_in(MIXED_GENERATOR_FREQUENCY, 1, &value, &bank));
+    is_f(value, 3000.0f);
+    pass(mixed_segment_start(&bank));
+    pass(mixed_segment_mix(&bank));
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 200);
+    for(uint32_t i=0; i<samples; ++i){
+      float expected = 0.5f * sinf(2 * M_PI * 1000 * i / 48000)
+        + 0.25f * sinf(2 * M_PI * 3000 * i / 48000);
+      if(1e-4 < fabsf(data[i] - expected))
+        fail_test("Sample %u is %f instead of %f", i, data[i], expected);
+    }
+
+  cleanup:
+    mixed_free_segment(&bank);
+    mixed_free_buffer(&out);
+  })
+
+define_test(noise, {
+    struct mixed_segment noise = {0}, other = {0};
+    struct mixed_buffer out = {0}, out2 = {0};
+    enum mixed_noise_type types[] = {MIXED_WHITE_NOISE, MIXED_PINK_NOISE, MIXED_BROWN_NOISE};
+    float *data, *data2;
+    uint32_t samples, samples2, seed = 1, seed2 = 2;
+    pass(mixed_make_buffer(4096, &out));
+    pass(mixed_make_buffer(4096, &out2));
+    for(int t=0; t<3; ++t){
+      double sum = 0.0, energy = 0.0;
+      pass(mixed_make_segment_noise(types[t], &noise));
+      pass(mixed_make_segment_noise(types[t], &other));
+      pass(mixed_segment_set(MIXED_NOISE_SEED, &seed, &noise));
+      pass(mixed_segment_set(MIXED_NOISE_SEED, &seed2, &other));
+      pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &noise));
+      pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out2, &other));
+      pass(mixed_segment_mix(&noise));
+      pass(mixed_segment_mix(&other));
+      samples = samples2 = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      pass(mixed_buffer_request_read(&data2, &samples2, &out2));
+      is(samples, 4096);
+      for(uint32_t i=0; i<samples; ++i){
+        if(!(-1.0f <= data[i] && data[i] <= 1.0f)) fail_test("Sample %u is %f", i, data[i]);
+        sum += data[i];
+        energy += data[i]*data[i];
+      }
+      if(energy < 1.0) fail_test("Noise is too quiet");
+      if(t == 0 && 0.05 < fabs(sum / samples)) fail_test("White noise is biased");
+      // Separate segments must not produce the same stream
+      int same = 1;
+      for(uint32_t i=0; i<samples; ++i)
+        if(data[i] != data2[i]) same = 0;
+      if(same) fail_test("Segments share a random stream");
+      mixed_buffer_finish_read(samples2, &out2);
+      // The same seed must give the same stream again
+      pass(mixed_segment_set(MIXED_NOISE_SEED, &seed, &other));
+      pass(mixed_segment_mix(&other));
+      samples2 = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data2, &samples2, &out2));
+      is(samples2, 4096);
+      for(uint32_t i=0; i<samples; ++i)
+        if(data[i] != data2[i]) fail_test("Seeded streams differ at %u", i);
+      mixed_buffer_finish_read(samples, &out);
+      mixed_buffer_finish_read(samples2, &out2);
+      mixed_free_segment(&noise);
+      mixed_free_segment(&other);
+    }
+
+  cleanup:
+    mixed_free_segment(&noise);
+    mixed_free_segment(&other);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&out2);
+  })
+
+#undef __TEST_SUITE
@@ -0,0 +1,865 @@
+#define __TEST_SUITE graph
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "tester.h"
+
+define_test(schedule, {
+    struct mixed_segment graph = {0}, generator = {0}, first = {0}, second = {0}, drain = {0};
+    uint32_t buffers = 0;
+    pass(mixed_make_segment_graph(128, &graph));
+    pass(mixed_make_segment_generator(MIXED_SINE, 440, 44100, &generator));
+    // Delays work in place, so the chain can share its buffers
+    pass(mixed_make_segment_delay(0.001, 44100, &first));
+    pass(mixed_make_segment_delay(0.001, 44100, &second));
+    pass(mixed_make_segment_void(&drain));
+    // Add out of order to make sure the graph sorts them
+    pass(mixed_graph_add(&drain, &graph));
+    pass(mixed_graph_add(&second, &graph));
+    pass(mixed_graph_add(&first, &graph));
+    pass(mixed_graph_add(&generator, &graph));
+    fail(mixed_graph_add(&first, &graph));
+    pass(mixed_graph_connect(&generator, MIXED_MONO, &first, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&first, MIXED_MONO, &second, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&second, MIXED_MONO, &drain, MIXED_MONO, &graph));
+    fail(mixed_graph_connect(&first, MIXED_MONO, &drain, MIXED_MONO, &graph));
+    pass(mixed_graph_compile(&graph));
+    // Three connections, but each delay reuses its input buffer
+    pass(mixed_segment_get(MIXED_GRAPH_BUFFER_COUNT, &buffers, &graph));
+    is(buffers, 1);
+    pass(mixed_segment_start(&graph));
+    for(int i=0; i<10; ++i){
+      pass(mixed_segment_mix(&graph));
+    }
+    pass(mixed_segment_end(&graph));
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&generator);
+    mixed_free_segment(&first);
+    mixed_free_segment(&second);
+    mixed_free_segment(&drain);
+  })
+
+static int allocations = 0;
+static void *(*original_calloc)(size_t num, size_t size) = 0;
+
+static void *counting_calloc(size_t num, size_t size){
+  ++allocations;
+  return original_calloc(num, size);
+}
+
+define_test(liveness, {
+    struct mixed_segment graph = {0}, generator = {0}, first = {0}, second = {0}, drain = {0};
+    uint32_t buffers = 0;
+    double slow = 0.5;
+    pass(mixed_make_segment_graph(128, &graph));
+    pass(mixed_make_segment_generator(MIXED_SINE, 440, 44100, &generator));
+    // Speed changes cannot work in place, so every connection needs a buffer
+    pass(mixed_make_segment_speed_change(1.0, &first));
+    pass(mixed_make_segment_speed_change(1.0, &second));
+    pass(mixed_make_segment_void(&drain));
+    pass(mixed_graph_add(&generator, &graph));
+    pass(mixed_graph_add(&first, &graph));
+    pass(mixed_graph_add(&second, &graph));
+    pass(mixed_graph_add(&drain, &graph));
+    pass(mixed_graph_connect(&generator, MIXED_MONO, &first, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&first, MIXED_MONO, &second, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&second, MIXED_MONO, &drain, MIXED_MONO, &graph));
+    pass(mixed_graph_compile(&graph));
+    // Three connections, but only two are ever live at once
+    pass(mixed_segment_get(MIXED_GRAPH_BUFFER_COUNT, &buffers, &graph));
+    is(buffers, 2);
+    pass(mixed_segment_start(&graph));
+    for(int i=0; i<10; ++i){
+      pass(mixed_segment_mix(&graph));
+    }
+    // Slowing down leaves input behind in the shared buffer, which
+    // moves the edge onto a buffer made ahead of time.
+    pass(mixed_segment_set(MIXED_SPEED_FACTOR, &slow, &first));
+    original_calloc = mixed_calloc;
+    mixed_calloc = counting_calloc;
+    allocations = 0;
+    for(int i=0; i<10; ++i){
+      pass(mixed_segment_mix(&graph));
+    }
+    mixed_calloc = original_calloc;
+    is(allocations, 0);
+    pass(mixed_segment_get(MIXED_GRAPH_BUFFER_COUNT, &buffers, &graph));
+    is(buffers, 3);
+    pass(mixed_segment_end(&graph));
+
+  cleanup:
+    if(original_calloc) mixed_calloc = original_calloc;
+    mixed_free_segment(&graph);
+    mixed_free_segment(&generator);
+    mixed_free_segment(&first);
+    mixed_free_segment(&second);
+    mixed_free_segment(&drain);
+  })
+
+define_test(cycle, {
+    struct mixed_segment graph = {0}, first = {0}, second = {0};
+    pass(mixed_make_segment_graph(128, &graph));
+    pass(mixed_make_segment_quantize(8, &first));
+    pass(mixed_make_segment_quantize(4, &second));
+    pass(mixed_graph_add(&first, &graph));
+    pass(mixed_graph_add(&second, &graph));
+    pass(mixed_graph_connect(&first, MIXED_MONO, &second, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&second, MIXED_MONO, &first, MIXED_MONO, &graph));
+    fail(mixed_graph_compile(&graph));
+    is(mixed_error(), MIXED_GRAPH_CYCLE);
+    pass(mixed_graph_disconnect(&second, MIXED_MONO, &first, MIXED_MONO, &graph));
+    pass(mixed_graph_compile(&graph));
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&first);
+    mixed_free_segment(&second);
+  })
+
+define_test(inplace, {
+    struct mixed_segment graph = {0}, generator = {0}, first = {0}, second = {0}, mixer = {0};
+    struct mixed_segment generator2 = {0}, first2 = {0}, second2 = {0};
+    struct mixed_buffer out = {0}, a = {0}, b = {0}, expected = {0};
+    uint32_t buffers = 0, samples = UINT32_MAX, samples2 = UINT32_MAX;
+    float *data = 0, *data2 = 0;
+    pass(mixed_make_buffer(128, &out));
+    pass(mixed_make_buffer(128, &a));
+    pass(mixed_make_buffer(128, &b));
+    pass(mixed_make_buffer(128, &expected));
+    pass(mixed_make_segment_graph(128, &graph));
+    pass(mixed_make_segment_generator(MIXED_SINE, 440, 44100, &generator));
+    pass(mixed_make_segment_quantize(8, &first));
+    pass(mixed_make_segment_quantize(4, &second));
+    pass(mixed_make_segment_basic_mixer(1, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &mixer));
+    pass(mixed_graph_add(&generator, &graph));
+    pass(mixed_graph_add(&first, &graph));
+    pass(mixed_graph_add(&second, &graph));
+    pass(mixed_graph_add(&mixer, &graph));
+    pass(mixed_graph_connect(&generator, MIXED_MONO, &first, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&first, MIXED_MONO, &second, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&second, MIXED_MONO, &mixer, 0, &graph));
+    pass(mixed_graph_compile(&graph));
+    // Both quantizers work on the generator's buffer directly
+    pass(mixed_segment_get(MIXED_GRAPH_BUFFER_COUNT, &buffers, &graph));
+    is(buffers, 1);
+    pass(mixed_segment_start(&graph));
+    pass(mixed_segment_mix(&graph));
+
+    // The same pipeline with a buffer per connection
+    pass(mixed_make_segment_generator(MIXED_SINE, 440, 44100, &generator2));
+    pass(mixed_make_segment_quantize(8, &first2));
+    pass(mixed_make_segment_quantize(4, &second2));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &generator2));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &a, &first2));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &b, &first2));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &b, &second2));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &expected, &second2));
+    pass(mixed_segment_mix(&generator2));
+    pass(mixed_segment_mix(&first2));
+    pass(mixed_segment_mix(&second2));
+
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    pass(mixed_buffer_request_read(&data2, &samples2, &expected));
+    is(samples, samples2);
+    for(uint32_t i=0; i<samples; ++i){
+      is_f(data[i], data2[i]);
+    }
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&generator);
+    mixed_free_segment(&first);
+    mixed_free_segment(&second);
+    mixed_free_segment(&mixer);
+    mixed_free_segment(&generator2);
+    mixed_free_segment(&first2);
+    mixed_free_segment(&second2);
+    mixed_free_buffer(&out);
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+    mixed_free_buffer(&expected);
+  })
+
+#define VOICES 8
+
+static int mix_voices(uint32_t threads, float *result, uint32_t samples){
+  struct mixed_segment graph = {0}, mixer = {0}, generators[VOICES] = {0}, filters[VOICES] = {0};
+  struct mixed_buffer out = {0};
+  float *data;
+  int status = 0;
+  if(!mixed_make_buffer(samples, &out)) goto cleanup;
+  if(!mixed_make_segment_graph(samples, &graph)) goto cleanup;
+  if(!mixed_segment_set(MIXED_GRAPH_THREADS, &threads, &graph)) goto cleanup;
+  if(!mixed_make_segment_basic_mixer(1, &mixer)) goto cleanup;
+  if(!mixed_graph_add(&mixer, &graph)) goto cleanup;
+  if(!mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &mixer)) goto cleanup;
+  for(uint32_t i=0; i<VOICES; ++i){
+    if(!mixed_make_segment_generator(MIXED_SINE, 100*(i+1), 44100, &generators[i])) goto cleanup;
+    if(!mixed_make_segment_quantize(16, &filters[i])) goto cleanup;
+    if(!mixed_graph_add(&generators[i], &graph)) goto cleanup;
+    if(!mixed_graph_add(&filters[i], &graph)) goto cleanup;
+    if(!mixed_graph_connect(&generators[i], MIXED_MONO, &filters[i], MIXED_MONO, &graph)) goto cleanup;
+    if(!mixed_graph_connect(&filters[i], MIXED_MONO, &mixer, i, &graph)) goto cleanup;
+  }
+  if(!mixed_segment_start(&graph)) goto cleanup;
+  if(!mixed_segment_mix(&graph)) goto cleanup;
+  if(!mixed_buffer_request_read(&data, &samples, &out)) goto cleanup;
+  memcpy(result, data, samples*sizeof(float));
+  status = samples;
+
+ cleanup:
+  mixed_free_segment(&graph);
+  mixed_free_segment(&mixer);
+  for(uint32_t i=0; i<VOICES; ++i){
+    mixed_free_segment(&generators[i]);
+    mixed_free_segment(&filters[i]);
+  }
+  mixed_free_buffer(&out);
+  return status;
+}
+
+define_test(parallel, {
+    float serial[256], parallel[256];
+    int samples = 0;
+    pass((samples = mix_voices(1, serial, 256)));
+    is(samples, 256);
+    for(int i=0; i<100; ++i){
+      is(mix_voices(4, parallel, 256), samples);
+      for(int j=0; j<samples; ++j){
+        is_f(parallel[j], serial[j]);
+      }
+    }
+  cleanup:;
+  })
+
+define_test(block_size, {
+    struct mixed_segment graph = {0}, unpacker = {0}, mixer = {0};
+    struct mixed_pack pack = {0};
+    struct mixed_buffer out = {0}, *internal = 0;
+    uint32_t block = 64, size = UINT32_MAX;
+    float *data = 0;
+    pack.encoding = MIXED_FLOAT;
+    pack.channels = 1;
+    pack.samplerate = 48000;
+    pass(mixed_make_pack(128, &pack));
+    pass(mixed_pack_request_write((void **)&data, &size, &pack));
+    for(uint32_t i=0; i<100; ++i) data[i] = i/128.0f;
+    pass(mixed_pack_finish_write(100*sizeof(float), &pack));
+    pass(mixed_make_buffer(256, &out));
+    pass(mixed_make_segment_graph(128, &graph));
+    pass(mixed_make_segment_unpacker(&pack, 48000, &unpacker));
+    pass(mixed_make_segment_basic_mixer(1, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &mixer));
+    pass(mixed_graph_add(&unpacker, &graph));
+    pass(mixed_graph_add(&mixer, &graph));
+    pass(mixed_graph_connect(&unpacker, MIXED_MONO, &mixer, 0, &graph));
+    pass(mixed_segment_set(MIXED_BLOCK_SIZE, &block, &graph));
+    pass(mixed_segment_start(&graph));
+    // The block size reaches the segments and sizes the buffers
+    block = 0;
+    pass(mixed_segment_get(MIXED_BLOCK_SIZE, &block, &unpacker));
+    is(block, 64);
+    pass(mixed_segment_get_in(MIXED_BUFFER, 0, &internal, &mixer));
+    is(internal->size, 64);
+    is((uintptr_t)internal->_data % 64, 0);
+    pass(mixed_segment_mix(&graph));
+    is(mixed_buffer_available_read(&out), 64);
+    // Only 36 frames are left, which is not a whole block
+    pass(mixed_segment_mix(&graph));
+    is(mixed_buffer_available_read(&out), 64);
+    is(mixed_pack_available_read(&pack), 0);
+    size = UINT32_MAX;
+    pass(mixed_pack_request_write((void **)&data, &size, &pack));
+    for(uint32_t i=0; i<28; ++i) data[i] = (100+i)/128.0f;
+    pass(mixed_pack_finish_write(28*sizeof(float), &pack));
+    pass(mixed_segment_mix(&graph));
+    is(mixed_buffer_available_read(&out), 128);
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &out));
+    // The mixer fades its new input in over the first block
+    for(uint32_t i=64; i<128; ++i){
+      if(data[i] != i/128.0f) fail_test("Frames out of order");
+    }
+    pass(mixed_segment_end(&graph));
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&unpacker);
+    mixed_free_segment(&mixer);
+    mixed_free_buffer(&out);
+    mixed_free_pack(&pack);
+  })
+
+define_test(latency, {
+    struct mixed_segment graph = {0}, dry = {0}, wet = {0}, compressor = {0}, mixer = {0};
+    struct mixed_pack dry_pack = {0}, wet_pack = {0};
+    struct mixed_buffer out = {0};
+    uint32_t latency = 0, size = UINT32_MAX, first = UINT32_MAX;
+    float *data = 0;
+    dry_pack.encoding = wet_pack.encoding = MIXED_FLOAT;
+    dry_pack.channels = wet_pack.channels = 1;
+    dry_pack.samplerate = wet_pack.samplerate = 44100;
+    pass(mixed_make_pack(1024, &dry_pack));
+    pass(mixed_make_pack(1024, &wet_pack));
+    // An impulse a little into each pack
+    pass(mixed_pack_request_write((void **)&data, &size, &dry_pack));
+    memset(data, 0, size);
+    data[10] = 0.5f;
+    pass(mixed_pack_finish_write(size, &dry_pack));
+    size = UINT32_MAX;
+    pass(mixed_pack_request_write((void **)&data, &size, &wet_pack));
+    memset(data, 0, size);
+    data[10] = 0.5f;
+    pass(mixed_pack_finish_write(size, &wet_pack));
+    pass(mixed_make_buffer(1024, &out));
+    pass(mixed_make_segment_graph(1024, &graph));
+    pass(mixed_make_segment_unpacker(&dry_pack, 44100, &dry));
+    pass(mixed_make_segment_unpacker(&wet_pack, 44100, &wet));
+    pass(mixed_make_segment_compressor(44100, &compressor));
+    pass(mixed_make_segment_basic_mixer(1, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &mixer));
+    pass(mixed_segment_get(MIXED_LATENCY, &latency, &compressor));
+    if(latency == 0) fail_test("Compressor reports no latency");
+    pass(mixed_graph_add(&dry, &graph));
+    pass(mixed_graph_add(&wet, &graph));
+    pass(mixed_graph_add(&compressor, &graph));
+    pass(mixed_graph_add(&mixer, &graph));
+    pass(mixed_graph_connect(&wet, MIXED_MONO, &compressor, MIXED_MONO, &graph));
+    pass(mixed_graph_connect(&compressor, MIXED_MONO, &mixer, 0, &graph));
+    pass(mixed_graph_connect(&dry, MIXED_MONO, &mixer, 1, &graph));
+    pass(mixed_graph_compile(&graph));
+    size = 0;
+    pass(mixed_segment_get(MIXED_LATENCY, &size, &graph));
+    is(size, latency);
+    pass(mixed_segment_start(&graph));
+    pass(mixed_segment_mix(&graph));
+    // Both impulses come out together, as late as the compressor's
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &out));
+    for(uint32_t i=0; i<size && first == UINT32_MAX; ++i){
+      if(data[i] != 0.0f) first = i;
+    }
+    is(first, 10+latency);
+    pass(mixed_segment_end(&graph));
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&dry);
+    mixed_free_segment(&wet);
+    mixed_free_segment(&compressor);
+    mixed_free_segment(&mixer);
+    mixed_free_buffer(&out);
+    mixed_free_pack(&dry_pack);
+    mixed_free_pack(&wet_pack);
+  })
+
+define_test(deadline, {
+    struct mixed_segment graph = {0}, source = {0}, volume = {0}, mixer = {0};
+    struct mixed_pack pack = {0};
+    struct mixed_buffer left = {0}, right = {0};
+    enum mixed_resample_type quality = MIXED_SINC_FASTEST;
+    uint32_t voices = 4, level = 0;
+    float deadline = 1e-12f;
+    bool bypass = false, fallback = false;
+    pack.encoding = MIXED_FLOAT;
+    pack.channels = 2;
+    pack.samplerate = 44100;
+    pass(mixed_make_pack(1024, &pack));
+    pass(mixed_make_buffer(1024, &left));
+    pass(mixed_make_buffer(1024, &right));
+    pass(mixed_make_segment_graph(256, &graph));
+    pass(mixed_make_segment_unpacker(&pack, 44100, &source));
+    pass(mixed_make_segment_volume_control(1.0f, 0.0f, &volume));
+    pass(mixed_make_segment_basic_mixer(2, &mixer));
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &source));
+    pass(mixed_segment_set(MIXED_MAX_VOICES, &voices, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, &mixer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &mixer));
+    pass(mixed_graph_add(&source, &graph));
+    pass(mixed_graph_add(&volume, &graph));
+    pass(mixed_graph_add(&mixer, &graph));
+    fail(mixed_graph_optional(&graph, 1, &graph));
+    pass(mixed_graph_optional(&volume, 1, &graph));
+    pass(mixed_graph_connect(&source, MIXED_LEFT, &volume, MIXED_LEFT, &graph));
+    pass(mixed_graph_connect(&source, MIXED_RIGHT, &volume, MIXED_RIGHT, &graph));
+    pass(mixed_graph_connect(&volume, MIXED_LEFT, &mixer, 0, &graph));
+    pass(mixed_graph_connect(&volume, MIXED_RIGHT, &mixer, 1, &graph));
+    // No mix fits, so every one takes another step
+    pass(mixed_segment_set(MIXED_DEADLINE, &deadline, &graph));
+    pass(mixed_segment_start(&graph));
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_get(MIXED_DEGRADATION, &level, &graph));
+    is(level, 1);
+    pass(mixed_segment_get(MIXED_RESAMPLE_FALLBACK, &fallback, &source));
+    is(fallback, true);
+    pass(mixed_segment_get(MIXED_RESAMPLE_TYPE, &quality, &source));
+    is(quality, MIXED_SINC_FASTEST);
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_get(MIXED_BYPASS, &bypass, &volume));
+    is(bypass, true);
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_get(MIXED_MAX_VOICES, &voices, &mixer));
+    is(voices, 2);
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_get(MIXED_MAX_VOICES, &voices, &mixer));
+    is(voices, 1);
+    pass(mixed_segment_get(MIXED_DEGRADATION, &level, &graph));
+    is(level, 4);
+    // With plenty of time the last step is undone again
+    deadline = 1000.0f;
+    pass(mixed_segment_set(MIXED_DEADLINE, &deadline, &graph));
+    for(int i=0; i<64; ++i) pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_get(MIXED_DEGRADATION, &level, &graph));
+    is(level, 3);
+    pass(mixed_segment_get(MIXED_MAX_VOICES, &voices, &mixer));
+    is(voices, 2);
+    // Turning the deadline off restores everything
+    deadline = 0.0f;
+    pass(mixed_segment_set(MIXED_DEADLINE, &deadline, &graph));
+    pass(mixed_segment_get(MIXED_DEGRADATION, &level, &graph));
+    is(level, 0);
+    pass(mixed_segment_get(MIXED_RESAMPLE_FALLBACK, &fallback, &source));
+    is(fallback, false);
+    pass(mixed_segment_get(MIXED_BYPASS, &bypass, &volume));
+    is(bypass, false);
+    pass(mixed_segment_get(MIXED_MAX_VOICES, &voices, &mixer));
+    is(voices, 4);
+    pass(mixed_segment_end(&graph));
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&source);
+    mixed_free_segment(&volume);
+    mixed_free_segment(&mixer);
+    mixed_free_buffer(&left);
+    mixed_free_buffer(&right);
+    mixed_free_pack(&pack);
+  })
+
+struct snapshot_rig{
+  struct mixed_segment graph, delay, filter;
+  struct mixed_buffer in, out;
+};
+
+static int make_snapshot_rig(float time, enum mixed_biquad_filter type, float frequency, struct snapshot_rig *rig){
+  return mixed_make_buffer(256, &rig->in)
+    && mixed_make_buffer(256, &rig->out)
+    && mixed_make_segment_graph(256, &rig->graph)
+    && mixed_make_segment_delay(time, 44100, &rig->delay)
+    && mixed_make_segment_biquad_filter(type, frequency, 44100, &rig->filter)
+    && mixed_segment_set_in(MIXED_BUFFER, 0, &rig->in, &rig->delay)
+    && mixed_segment_set_out(MIXED_BUFFER, 0, &rig->out, &rig->filter)
+    && mixed_graph_add(&rig->delay, &rig->graph)
+    && mixed_graph_add(&rig->filter, &rig->graph)
+    && mixed_graph_connect(&rig->delay, 0, &rig->filter, 0, &rig->graph);
+}
+
+static void free_snapshot_rig(struct snapshot_rig *rig){
+  mixed_free_segment(&rig->graph);
+  mixed_free_segment(&rig->delay);
+  mixed_free_segment(&rig->filter);
+  mixed_free_buffer(&rig->in);
+  mixed_free_buffer(&rig->out);
+}
+
+static int run_snapshot_rig(uint32_t seed, float *result, struct snapshot_rig *rig){
+  float *data;
+  uint32_t size = 256;
+  mixed_buffer_request_write(&data, &size, &rig->in);
+  for(uint32_t i=0; i<size; ++i){
+    seed = seed*1664525u + 1013904223u;
+    data[i] = (seed >> 8) / (float)(1 << 24) - 0.5f;
+  }
+  mixed_buffer_finish_write(size, &rig->in);
+  if(!mixed_segment_mix(&rig->graph)) return 0;
+  size = 256;
+  mixed_buffer_request_read(&data, &size, &rig->out);
+  if(result) memcpy(result, data, size*sizeof(float));
+  mixed_buffer_finish_read(size, &rig->out);
+  return size;
+}
+
+define_test(snapshot, {
+    struct snapshot_rig a = {0}, b = {0};
+    struct mixed_delay_tap tap = {1, 0.003f, 0.5f, 0.0f, 0.0f};
+    uint32_t count = 2, size = 0;
+    float frequency = 0.0f, expected[256], actual[256];
+    char *snapshot = 0;
+    pass(make_snapshot_rig(0.01f, MIXED_LOWPASS, 2000.0f, &a));
+    pass(make_snapshot_rig(0.5f, MIXED_HIGHPASS, 500.0f, &b));
+    pass(mixed_segment_set(MIXED_DELAY_TAP_COUNT, &count, &a.delay));
+    pass(mixed_segment_set(MIXED_DELAY_TAP, &tap, &a.delay));
+    pass(mixed_segment_start(&a.graph));
+    for(uint32_t i=0; i<4; ++i) is(run_snapshot_rig(i, 0, &a), 256);
+    // Snapshot with the delay line and filter memory
+    pass(mixed_segment_save(0, &size, 1, &a.graph));
+    snapshot = malloc(size);
+    pass(mixed_segment_save(snapshot, &size, 1, &a.graph));
+    fail(mixed_segment_load(snapshot, size, &a.delay));
+    pass(mixed_segment_start(&b.graph));
+    pass(mixed_segment_load(snapshot, size, &b.graph));
+    pass(mixed_segment_get(MIXED_FREQUENCY, &frequency, &b.filter));
+    is_f(frequency, 2000.0f);
+    pass(mixed_segment_get(MIXED_DELAY_TAP_COUNT, &count, &b.delay));
+    is(count, 2);
+    tap.gain = 0.0f;
+    pass(mixed_segment_get(MIXED_DELAY_TAP, &tap, &b.delay));
+    is_f(tap.gain, 0.5f);
+    // Both carry on the same from here
+    for(uint32_t i=4; i<8; ++i){
+      is(run_snapshot_rig(i, expected, &a), 256);
+      is(run_snapshot_rig(i, actual, &b), 256);
+      for(uint32_t j=0; j<256; ++j) is_f(actual[j], expected[j]);
+    }
+    pass(mixed_segment_end(&a.graph));
+    pass(mixed_segment_end(&b.graph));
+
+  cleanup:
+    free(snapshot);
+    free_snapshot_rig(&a);
+    free_snapshot_rig(&b);
+  })
+
+struct probe{
+  struct mixed_buffer *in;
+  struct mixed_buffer *out;
+  uint32_t largest;
+};
+
+static int probe_mix(struct mixed_segment *segment){
+  struct probe *probe = (struct probe *)segment->data;
+  uint32_t samples = mixed_buffer_available_read(probe->in);
+  if(probe->largest < samples) probe->largest = samples;
+  return mixed_buffer_transfer(probe->in, probe->out);
+}
+
+static int probe_info(struct mixed_segment_info *info, struct mixed_segment *segment){
+  info->name = "probe";
+  info->flags = MIXED_INPLACE;
+  info->min_inputs = 1;
+  info->max_inputs = 1;
+  info->outputs = 1;
+  return 1;
+}
+
+static int probe_set_in(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  ((struct probe *)segment->data)->in = (struct mixed_buffer *)value;
+  return 1;
+}
+
+static int probe_set_out(uint32_t field, uint32_t location, void *value, struct mixed_segment *segment){
+  ((struct probe *)segment->data)->out = (struct mixed_buffer *)value;
+  return 1;
+}
+
+static int fill_fusion_pack(struct mixed_pack *pack){
+  float *data;
+  uint32_t size = UINT32_MAX, seed = 1;
+  if(!mixed_make_pack(4096, pack)) return 0;
+  mixed_pack_request_write((void **)&data, &size, pack);
+  for(uint32_t i=0; i<size/sizeof(float); ++i){
+    seed = seed*1664525u + 1013904223u;
+    data[i] = (seed >> 8) / (float)(1 << 24) - 0.5f;
+  }
+  return mixed_pack_finish_write(size, pack);
+}
+
+define_test(fusion, {
+    struct mixed_segment graph = {0}, source = {0}, filter = {0}, probe = {0}, drain = {0};
+    struct mixed_segment ref_source = {0}, ref_filter = {0}, ref_drain = {0};
+    struct mixed_pack in = {0}, out = {0}, ref_in = {0}, ref_out = {0};
+    struct mixed_buffer a = {0}, b = {0};
+    struct probe probe_data = {0};
+    float *expected, *actual;
+    uint32_t expected_size = UINT32_MAX, actual_size = UINT32_MAX;
+    in.encoding = out.encoding = ref_in.encoding = ref_out.encoding = MIXED_FLOAT;
+    in.channels = out.channels = ref_in.channels = ref_out.channels = 1;
+    in.samplerate = out.samplerate = ref_in.samplerate = ref_out.samplerate = 44100;
+    pass(fill_fusion_pack(&in));
+    pass(fill_fusion_pack(&ref_in));
+    pass(mixed_make_pack(4096, &out));
+    pass(mixed_make_pack(4096, &ref_out));
+    probe.data = &probe_data;
+    probe.mix = probe_mix;
+    probe.info = probe_info;
+    probe.set_in = probe_set_in;
+    probe.set_out = probe_set_out;
+    // The filter and probe work in place on the same buffer
+    pass(mixed_make_segment_graph(4096, &graph));
+    pass(mixed_make_segment_unpacker(&in, 44100, &source));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 2000.0f, 44100, &filter));
+    pass(mixed_make_segment_packer(&out, 44100, &drain));
+    pass(mixed_graph_add(&source, &graph));
+    pass(mixed_graph_add(&filter, &graph));
+    pass(mixed_graph_add(&probe, &graph));
+    pass(mixed_graph_add(&drain, &graph));
+    pass(mixed_graph_connect(&source, MIXED_MONO, &filter, 0, &graph));
+    pass(mixed_graph_connect(&filter, 0, &probe, 0, &graph));
+    pass(mixed_graph_connect(&probe, 0, &drain, MIXED_MONO, &graph));
+    pass(mixed_segment_start(&graph));
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_end(&graph));
+    // They only ever saw a strip at a time
+    if(probe_data.largest == 0 || 4096 <= probe_data.largest)
+      fail_test("Run was not mixed in strips");
+    // The same without a graph
+    pass(mixed_make_buffer(4096, &a));
+    pass(mixed_make_buffer(4096, &b));
+    pass(mixed_make_segment_unpacker(&ref_in, 44100, &ref_source));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 2000.0f, 44100, &ref_filter));
+    pass(mixed_make_segment_packer(&ref_out, 44100, &ref_drain));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &ref_source));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &a, &ref_filter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &b, &ref_filter));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &b, &ref_drain));
+    pass(mixed_segment_start(&ref_source));
+    pass(mixed_segment_start(&ref_filter));
+    pass(mixed_segment_start(&ref_drain));
+    pass(mixed_segment_mix(&ref_source));
+    pass(mixed_segment_mix(&ref_filter));
+    pass(mixed_segment_mix(&ref_drain));
+    pass(mixed_pack_request_read((void **)&expected, &expected_size, &ref_out));
+    pass(mixed_pack_request_read((void **)&actual, &actual_size, &out));
+    is(actual_size, expected_size);
+    for(uint32_t i=0; i<expected_size/sizeof(float); ++i)
+      is_f(actual[i], expected[i]);
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&source);
+    mixed_free_segment(&filter);
+    mixed_free_segment(&drain);
+    mixed_free_segment(&ref_source);
+    mixed_free_segment(&ref_filter);
+    mixed_free_segment(&ref_drain);
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+    mixed_free_pack(&in);
+    mixed_free_pack(&out);
+    mixed_free_pack(&ref_in);
+    mixed_free_pack(&ref_out);
+  })
+
+define_test(gate_fusion, {
+    struct mixed_segment graph = {0}, source = {0}, gate = {0}, filter = {0}, drain = {0};
+    struct mixed_segment ref_source = {0}, ref_gate = {0}, ref_filter = {0}, ref_drain = {0};
+    struct mixed_pack in = {0}, out = {0}, ref_in = {0}, ref_out = {0};
+    struct mixed_buffer a = {0}, b = {0};
+    float *expected, *actual;
+    uint32_t expected_size = UINT32_MAX, actual_size = UINT32_MAX;
+    in.encoding = out.encoding = ref_in.encoding = ref_out.encoding = MIXED_FLOAT;
+    in.channels = out.channels = ref_in.channels = ref_out.channels = 1;
+    in.samplerate = out.samplerate = ref_in.samplerate = ref_out.samplerate = 44100;
+    pass(fill_fusion_pack(&in));
+    pass(fill_fusion_pack(&ref_in));
+    // Silence for more than a strip closes the gate, then noise opens it
+    pass(mixed_pack_request_read((void **)&actual, &actual_size, &in));
+    memset(actual, 0, 300*sizeof(float));
+    pass(mixed_pack_request_read((void **)&expected, &expected_size, &ref_in));
+    memset(expected, 0, 300*sizeof(float));
+    expected_size = actual_size = UINT32_MAX;
+    pass(mixed_make_pack(4096, &out));
+    pass(mixed_make_pack(4096, &ref_out));
+    pass(mixed_make_segment_graph(4096, &graph));
+    pass(mixed_make_segment_unpacker(&in, 44100, &source));
+    pass(mixed_make_segment_gate(44100, &gate));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 2000.0f, 44100, &filter));
+    pass(mixed_make_segment_packer(&out, 44100, &drain));
+    pass(mixed_graph_add(&source, &graph));
+    pass(mixed_graph_add(&gate, &graph));
+    pass(mixed_graph_add(&filter, &graph));
+    pass(mixed_graph_add(&drain, &graph));
+    pass(mixed_graph_connect(&source, MIXED_MONO, &gate, 0, &graph));
+    pass(mixed_graph_connect(&gate, 0, &filter, 0, &graph));
+    pass(mixed_graph_connect(&filter, 0, &drain, MIXED_MONO, &graph));
+    pass(mixed_segment_start(&graph));
+    pass(mixed_segment_mix(&graph));
+    pass(mixed_segment_end(&graph));
+    // The same without a graph
+    pass(mixed_make_buffer(4096, &a));
+    pass(mixed_make_buffer(4096, &b));
+    pass(mixed_make_segment_unpacker(&ref_in, 44100, &ref_source));
+    pass(mixed_make_segment_gate(44100, &ref_gate));
+    pass(mixed_make_segment_biquad_filter(MIXED_LOWPASS, 2000.0f, 44100, &ref_filter));
+    pass(mixed_make_segment_packer(&ref_out, 44100, &ref_drain));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &a, &ref_source));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &a, &ref_gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &a, &ref_gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &a, &ref_filter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &b, &ref_filter));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &b, &ref_drain));
+    pass(mixed_segment_start(&ref_source));
+    pass(mixed_segment_start(&ref_gate));
+    pass(mixed_segment_start(&ref_filter));
+    pass(mixed_segment_start(&ref_drain));
+    pass(mixed_segment_mix(&ref_source));
+    pass(mixed_segment_mix(&ref_gate));
+    pass(mixed_segment_mix(&ref_filter));
+    pass(mixed_segment_mix(&ref_drain));
+    pass(mixed_pack_request_read((void **)&expected, &expected_size, &ref_out));
+    pass(mixed_pack_request_read((void **)&actual, &actual_size, &out));
+    is(actual_size, expected_size);
+    for(uint32_t i=0; i<expected_size/sizeof(float); ++i){
+      if(1e-6f < fabsf(actual[i] - expected[i]))
+        fail_test("Sample %u is %f but should be %f", i, actual[i], expected[i]);
+    }
+
+  cleanup:
+    mixed_free_segment(&graph);
+    mixed_free_segment(&source);
+    mixed_free_segment(&gate);
+    mixed_free_segment(&filter);
+    mixed_free_segment(&drain);
+    mixed_free_segment(&ref_source);
+    mixed_free_segment(&ref_gate);
+    mixed_free_segment(&ref_filter);
+    mixed_free_segment(&ref_drain);
+    mixed_free_buffer(&a);
+    mixed_free_buffer(&b);
+    mixed_free_pack(&in);
+    mixed_free_pack(&out);
+    mixed_free_pack(&ref_in);
+    mixed_free_pack(&ref_out);
+  })
+
+define_test(profile, {
+    struct mixed_segment gate = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    struct mixed_segment_profile profile = {0};
+    struct mixed_segment *segments[4];
+    uint32_t count = 4;
+    float *data;
+    pass(mixed_profile_start(8));
+    pass(mixed_make_buffer(256, &in));
+    pass(mixed_make_buffer(256, &out));
+    pass(mixed_make_segment_gate(44100, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &gate));
+    pass(mixed_segment_start(&gate));
+    for(uint32_t i=0; i<4; ++i){
+      uint32_t samples = (i == 3)? 50 : 100;
+      pass(mixed_buffer_request_write(&data, &samples, &in));
+      memset(data, 0, samples*sizeof(float));
+      pass(mixed_buffer_finish_write(samples, &in));
+      pass(mixed_segment_mix(&gate));
+      mixed_buffer_clear(&in);
+      mixed_buffer_clear(&out);
+    }
+    pass(mixed_segment_get(MIXED_PROFILE, &profile, &gate));
+    is(profile.calls, 4);
+    is(profile.frames, 350);
+    is(profile.short_mixes, 1);
+    if(profile.max_ns < profile.min_ns) fail_test("Minimum above maximum");
+    if(profile.max_ns < profile.p99_ns) fail_test("Percentile above maximum");
+    pass(mixed_profile_dump(&count, segments, 0));
+    is(count, 1);
+    is(segments[0], &gate);
+    pass(mixed_profile_reset());
+    pass(mixed_segment_get(MIXED_PROFILE, &profile, &gate));
+    is(profile.calls, 0);
+    // A segment made in the place of a freed one starts afresh.
+    pass(mixed_segment_mix(&gate));
+    mixed_free_segment(&gate);
+    count = 4;
+    pass(mixed_profile_dump(&count, 0, 0));
+    is(count, 0);
+    pass(mixed_make_segment_gate(44100, &gate));
+    fail(mixed_segment_get(MIXED_PROFILE, &profile, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_get(MIXED_PROFILE, &profile, &gate));
+    is(profile.calls, 0);
+    count = 4;
+    pass(mixed_profile_dump(&count, segments, 0));
+    is(count, 1);
+    is(segments[0], &gate);
+
+  cleanup:
+    mixed_profile_end();
+    mixed_free_segment(&gate);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(trace, {
+    struct mixed_segment gate = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    char path[] = "/tmp/mixed-trace-XXXXXX";
+    char text[4096] = {0};
+    FILE *file = 0;
+    float *data;
+    uint32_t samples = 100;
+    int fd = mkstemp(path);
+    if(fd < 0) fail_test("Failed to create a temporary file");
+    close(fd);
+    pass(mixed_trace_start(64));
+    pass(mixed_make_buffer(256, &in));
+    pass(mixed_make_buffer(256, &out));
+    pass(mixed_make_segment_gate(44100, &gate));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &gate));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &gate));
+    pass(mixed_segment_start(&gate));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    memset(data, 0, samples*sizeof(float));
+    pass(mixed_buffer_finish_write(samples, &in));
+    pass(mixed_segment_mix(&gate));
+    samples = 100;
+    fail(mixed_buffer_request_read(&data, &samples, &in));
+    // The events keep their name after the segment is gone
+    pass(mixed_free_segment(&gate));
+    pass(mixed_trace_write(path));
+    file = fopen(path, "r");
+    if(!file) fail_test("Trace was not written");
+    if(fread(text, 1, sizeof(text)-1, file) == 0) fail_test("Trace is empty");
+    if(!strstr(text, "\"traceEvents\"")) fail_test("No event list");
+    if(!strstr(text, "{\"name\":\"gate\",\"ph\":\"B\"")) fail_test("No begin event");
+    if(!strstr(text, "{\"name\":\"gate\",\"ph\":\"E\"")) fail_test("No end event");
+    if(!strstr(text, "{\"name\":\"starved\",\"ph\":\"i\"")) fail_test("No starvation event");
+    pass(mixed_trace_end());
+    fail(mixed_trace_write(path));
+
+  cleanup:
+    if(file) fclose(file);
+    if(0 <= fd) remove(path);
+    mixed_trace_end();
+    mixed_free_segment(&gate);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+static float denormal_product = -1.0f;
+
+static int denormal_mix(struct mixed_segment *segment){
+  volatile float tiny = 1e-38f;
+  denormal_product = tiny * 0.5f;
+  (void)segment;
+  return 1;
+}
+
+define_test(denormals, {
+    struct mixed_segment outer = {0}, inner = {0};
+    volatile float tiny = 1e-38f;
+    inner.mix = denormal_mix;
+    pass(mixed_make_segment_chain(&outer));
+    pass(mixed_chain_add(&inner, &outer));
+    pass(mixed_segment_start(&outer));
+    // Nested mixes run in the mode the outermost one set up
+    pass(mixed_segment_mix(&outer));
+#if defined(__SSE__) || defined(__aarch64__)
+    is_f(denormal_product, 0.0f);
+#endif
+    // The caller's mode is back afterwards
+    if(tiny * 0.5f == 0.0f) fail_test("Denormals still flushed after mixing");
+    pass(mixed_flush_denormals(0));
+    pass(mixed_segment_mix(&outer));
+    if(denormal_product == 0.0f) fail_test("Denormals flushed while disabled");
+
+  cleanup:
+    mixed_flush_denormals(1);
+    mixed_free_segment(&outer);
+  })
+
+#undef __TEST_SUITE
@@ -0,0 +1,73 @@
+// A mono amplifier to test the LADSPA segments with.
+#include <stdlib.h>
+#include "../src/ladspa.h"
+
+#define PORT_INPUT 0
+#define PORT_OUTPUT 1
+#define PORT_GAIN 2
+
+struct amplifier{
+  LADSPA_Data *ports[3];
+};
+
+static LADSPA_Handle amplifier_instantiate(const LADSPA_Descriptor *descriptor, unsigned long samplerate){
+  (void)descriptor;
+  (void)samplerate;
+  return calloc(1, sizeof(struct amplifier));
+}
+
+static void amplifier_connect_port(LADSPA_Handle handle, unsigned long port, LADSPA_Data *location){
+  ((struct amplifier *)handle)->ports[port] = location;
+}
+
+static void amplifier_run(LADSPA_Handle handle, unsigned long samples){
+  struct amplifier *amplifier = (struct amplifier *)handle;
+  LADSPA_Data *in = amplifier->ports[PORT_INPUT];
+  LADSPA_Data *out = amplifier->ports[PORT_OUTPUT];
+  LADSPA_Data gain = *amplifier->ports[PORT_GAIN];
+  for(unsigned long i=0; i<samples; ++i)
+    out[i] = in[i] * gain;
+}
+
+static void amplifier_cleanup(LADSPA_Handle handle){
+  free(handle);
+}
+
+static const LADSPA_PortDescriptor amplifier_ports[] = {
+  LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+  LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+  LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL
+};
+
+static const char * const amplifier_port_names[] = {
+  "Input",
+  "Output",
+  "Gain"
+};
+
+static const LADSPA_PortRangeHint amplifier_hints[] = {
+  {0, 0, 0},
+  {0, 0, 0},
+  {0, 0, 0}
+};
+
+static const LADSPA_Descriptor amplifier = {
+  .UniqueID = 1,
+  .Label = "amplifier",
+  .Properties = LADSPA_PROPERTY_HARD_RT_CAPABLE,
+  .Name = "Amplifier",
+  .Maker = "libmixed",
+  .Copyright = "None",
+  .PortCount = 3,
+  .PortDescriptors = amplifier_ports,
+  .PortNames = amplifier_port_names,
+  .PortRangeHints = amplifier_hints,
+  .instantiate = amplifier_instantiate,
+  .connect_port = amplifier_connect_port,
+  .run = amplifier_run,
+  .cleanup = amplifier_cleanup
+};
+
+const LADSPA_Descriptor *ladspa_descriptor(unsigned long index){
+  return (index == 0)? &amplifier : 0;
+}
@@ -0,0 +1,618 @@
+#define __TEST_SUITE mixer
+#include "tester.h"
+
+static int allocations = 0;
+static void *(*original_calloc)(size_t num, size_t size) = 0;
+static void *(*original_realloc)(void *ptr, size_t size) = 0;
+
+static void *counting_calloc(size_t num, size_t size){
+  ++allocations;
+  return original_calloc(num, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size){
+  ++allocations;
+  return original_realloc(ptr, size);
+}
+
+static void count_allocations(){
+  original_calloc = mixed_calloc;
+  original_realloc = mixed_realloc;
+  mixed_calloc = counting_calloc;
+  mixed_realloc = counting_realloc;
+  allocations = 0;
+}
+
+static void stop_counting(){
+  if(original_calloc) mixed_calloc = original_calloc;
+  if(original_realloc) mixed_realloc = original_realloc;
+  original_calloc = 0;
+  original_realloc = 0;
+}
+
+define_test(space_capacity, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer buffers[8] = {0};
+    uint32_t capacity = 8;
+    for(int i=0; i<8; ++i){
+      pass(mixed_make_buffer(64, &buffers[i]));
+    }
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_CAPACITY, &capacity, &segment));
+    capacity = 0;
+    pass(mixed_segment_get(MIXED_CAPACITY, &capacity, &segment));
+    is(capacity, 8);
+    count_allocations();
+    // Churn sources as a game would during playback
+    for(int r=0; r<10; ++r){
+      for(int i=0; i<8; ++i){
+        pass(mixed_segment_set_in(MIXED_BUFFER, i, &buffers[i], &segment));
+      }
+      for(int i=0; i<8; ++i){
+        pass(mixed_segment_set_in(MIXED_BUFFER, i, 0, &segment));
+      }
+    }
+    stop_counting();
+    is(allocations, 0);
+
+  cleanup:
+    stop_counting();
+    mixed_free_segment(&segment);
+    for(int i=0; i<8; ++i){
+      mixed_free_buffer(&buffers[i]);
+    }
+  })
+
+define_test(basic_capacity, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer buffer = {0};
+    uint32_t capacity = 256;
+    pass(mixed_make_buffer(64, &buffer));
+    pass(mixed_make_segment_basic_mixer(2, &segment));
+    pass(mixed_segment_set(MIXED_CAPACITY, &capacity, &segment));
+    count_allocations();
+    for(int i=0; i<256; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &buffer, &segment));
+    }
+    stop_counting();
+    is(allocations, 0);
+    pass(mixed_segment_get(MIXED_CAPACITY, &capacity, &segment));
+    is(capacity, 256);
+
+  cleanup:
+    stop_counting();
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&buffer);
+  })
+
+define_test(volume_ramp, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out = {0};
+    uint32_t duration = 4, samples = UINT32_MAX;
+    float volume = 0.0f, *data = 0;
+    pass(mixed_make_buffer(16, &in));
+    pass(mixed_make_buffer(16, &out));
+    pass(mixed_make_segment_basic_mixer(1, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    pass(mixed_segment_set(MIXED_RAMP_DURATION, &duration, &segment));
+    pass(mixed_segment_set(MIXED_VOLUME, &volume, &segment));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<8; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(8, &in));
+    pass(mixed_segment_start(&segment));
+    pass(mixed_segment_mix(&segment));
+    // The gain moves in equal steps and then holds the target
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    is(samples, 8);
+    is_f(data[0], 0.75f);
+    is_f(data[1], 0.5f);
+    is_f(data[2], 0.25f);
+    for(uint32_t i=3; i<8; ++i){
+      is_f(data[i], 0.0f);
+    }
+
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+define_test(input_volume, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[2] = {0}, out = {0};
+    uint32_t samples = UINT32_MAX;
+    float volume = 0.5f, *data = 0;
+    pass(mixed_make_buffer(16, &in[0]));
+    pass(mixed_make_buffer(16, &in[1]));
+    pass(mixed_make_buffer(16, &out));
+    pass(mixed_make_segment_basic_mixer(1, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in[0], &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &in[1], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    fail(mixed_segment_set_in(MIXED_VOLUME, 2, &volume, &segment));
+    pass(mixed_segment_set_in(MIXED_VOLUME, 0, &volume, &segment));
+    volume = 0.0f;
+    pass(mixed_segment_get_in(MIXED_VOLUME, 0, &volume, &segment));
+    is_f(volume, 0.5f);
+    pass(mixed_segment_get_in(MIXED_VOLUME, 1, &volume, &segment));
+    is_f(volume, 1.0f);
+    pass(mixed_segment_start(&segment));
+    for(int r=0; r<2; ++r){
+      for(int b=0; b<2; ++b){
+        pass(mixed_buffer_request_write(&data, &samples, &in[b]));
+        for(uint32_t i=0; i<8; ++i) data[i] = 1.0f;
+        pass(mixed_buffer_finish_write(8, &in[b]));
+        samples = UINT32_MAX;
+      }
+      pass(mixed_segment_mix(&segment));
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      is(samples, 8);
+      // The change is spread over the first block
+      for(uint32_t i=0; i<8; ++i){
+        is_f(data[i], (r == 0)? 2.0f - 0.5f*i/8 : 1.5f);
+      }
+      pass(mixed_buffer_finish_read(samples, &out));
+      samples = UINT32_MAX;
+    }
+
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in[0]);
+    mixed_free_buffer(&in[1]);
+    mixed_free_buffer(&out);
+  })
+
+static int space_block(struct mixed_segment *segment, struct mixed_buffer *in, struct mixed_buffer *out, float *result){
+  float *data;
+  uint32_t samples = UINT32_MAX;
+  if(!mixed_buffer_request_write(&data, &samples, in)) return 0;
+  for(uint32_t i=0; i<8; ++i) data[i] = 1.0f;
+  if(!mixed_buffer_finish_write(8, in)) return 0;
+  if(!mixed_segment_mix(segment)) return 0;
+  samples = UINT32_MAX;
+  if(!mixed_buffer_request_read(&data, &samples, out) || samples != 8) return 0;
+  for(uint32_t i=0; i<8; ++i) result[i] = data[i];
+  mixed_buffer_finish_read(samples, out);
+  mixed_buffer_clear(&out[1]);
+  return 1;
+}
+
+define_test(space_smoothing, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[2] = {0};
+    float location[3] = {0.0f, 0.0f, 100.0f}, first[8], second[8], third[8];
+    pass(mixed_make_buffer(16, &in));
+    pass(mixed_make_buffer(16, &out[0]));
+    pass(mixed_make_buffer(16, &out[1]));
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(mixed_segment_start(&segment));
+    // A new source starts at its volume right away
+    pass(space_block(&segment, &in, out, first));
+    for(int i=1; i<8; ++i) is_f(first[i], first[0]);
+    location[2] = 1000.0f;
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(space_block(&segment, &in, out, second));
+    pass(space_block(&segment, &in, out, third));
+    // A moved one fades from its old volume to the new one
+    is_f(second[0], first[0]);
+    for(int i=1; i<8; ++i){
+      if(second[i-1] <= second[i]) fail_test("Volume did not fall at %i", i);
+      is_f(third[i], third[0]);
+    }
+    if(third[0] >= second[7]) fail_test("Volume overshot");
+
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+  })
+
+define_test(plane_pan, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0};
+    float location[2] = {-500.0f, 0.0f};
+    float *data;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(16, &in[i]));
+      pass(mixed_make_buffer(16, &out[i]));
+    }
+    pass(mixed_make_segment_plane_mixer(44100, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in[0], &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &in[1], &segment));
+    pass(mixed_segment_set_in(MIXED_PLANE_LOCATION, 0, location, &segment));
+    location[0] = 0.0f;
+    pass(mixed_segment_get_in(MIXED_PLANE_LOCATION, 0, location, &segment));
+    is_f(location[0], -500.0f);
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    // Only the source on the left makes any sound
+    pass(mixed_buffer_request_write(&data, &samples, &in[0]));
+    for(uint32_t i=0; i<8; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(8, &in[0]));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in[1]));
+    for(uint32_t i=0; i<8; ++i) data[i] = 0.0f;
+    pass(mixed_buffer_finish_write(8, &in[1]));
+    pass(mixed_segment_mix(&segment));
+    float *left, *right;
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&left, &samples, &out[0]));
+    pass(mixed_buffer_request_read(&right, &samples, &out[1]));
+    is(samples, 8);
+    for(uint32_t i=0; i<8; ++i){
+      if(left[i] <= right[i]) fail_test("Sample %i is not panned left", i);
+      if(right[i] < 0.0f) fail_test("Sample %i is inverted", i);
+    }
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+define_test(space_doppler, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0};
+    float location[3] = {0.0f, 0.0f, 200.0f}, velocity[3] = {0.0f, 0.0f, -1000.0f};
+    float doppler = 1.0f;
+    float *data, *left;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(16, &in[i]));
+      pass(mixed_make_buffer(16, &out[i]));
+    }
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_DOPPLER_FACTOR, &doppler, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in[0], &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &in[1], &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 1, location, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_VELOCITY, 1, velocity, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    for(int i=0; i<2; ++i){
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_write(&data, &samples, &in[i]));
+      for(uint32_t j=0; j<16; ++j) data[j] = i*j;
+      pass(mixed_buffer_finish_write(16, &in[i]));
+    }
+    pass(mixed_segment_mix(&segment));
+    // The approaching source plays at twice its rate, the other one
+    // keeps what it could not play yet.
+    is(mixed_buffer_available_read(&in[1]), 0);
+    is(mixed_buffer_available_read(&in[0]), 8);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&left, &samples, &out[0]));
+    is(samples, 8);
+    is_f(left[0], 0.0f);
+    if(left[1] <= 0.0f) fail_test("The shifted source is silent");
+    for(uint32_t i=2; i<8; ++i)
+      is_f(left[i], left[1]*(2*i-1));
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+define_test(space_hrtf, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[2] = {0};
+    struct mixed_hrtf hrtf = {0};
+    float directions[6] = {1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f};
+    float left_ir[2] = {0.0f, 1.0f}, right_ir[2] = {1.0f, 0.0f};
+    float location[3] = {-100.0f, 0.0f, 0.0f};
+    struct mixed_hrtf *current = 0;
+    float *data, *left, *right;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(64, &in));
+    pass(mixed_make_buffer(64, &out[0]));
+    pass(mixed_make_buffer(64, &out[1]));
+    pass(mixed_make_hrtf(directions, left_ir, right_ir, 2, 1, &hrtf));
+    is(hrtf.partition, 32);
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_HRTF, &hrtf, &segment));
+    pass(mixed_segment_get(MIXED_SPACE_HRTF, &current, &segment));
+    is(current, &hrtf);
+    // The mixer keeps its own reference to the responses
+    mixed_free_hrtf(&hrtf);
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<64; ++i) data[i] = 1.0f;
+    pass(mixed_buffer_finish_write(64, &in));
+    pass(mixed_segment_mix(&segment));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&left, &samples, &out[0]));
+    pass(mixed_buffer_request_read(&right, &samples, &out[1]));
+    is(samples, 64);
+    // One partition of latency, then the source is heard on the right
+    for(uint32_t i=0; i<32; ++i){
+      is_f(left[i], 0.0f);
+      is_f(right[i], 0.0f);
+    }
+    for(uint32_t i=32; i<64; ++i){
+      if(right[i] <= 0.0f) fail_test("Sample %i is silent on the right", i);
+      if(right[i] < 100.0f*fabsf(left[i])) fail_test("Sample %i is not on the right", i);
+    }
+
+  cleanup:
+    mixed_free_hrtf(&hrtf);
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out[0]);
+    mixed_free_buffer(&out[1]);
+  })
+
+static int space_mix_channels(struct mixed_segment *segment, struct mixed_buffer *in, struct mixed_buffer *out, uint32_t channels, float *result){
+  float *data;
+  uint32_t samples = UINT32_MAX;
+  if(!mixed_buffer_request_write(&data, &samples, in)) return 0;
+  for(uint32_t i=0; i<8; ++i) data[i] = 1.0f;
+  if(!mixed_buffer_finish_write(8, in)) return 0;
+  if(!mixed_segment_mix(segment)) return 0;
+  for(uint32_t c=0; c<channels; ++c){
+    samples = UINT32_MAX;
+    if(!mixed_buffer_request_read(&data, &samples, &out[c]) || samples != 8) return 0;
+    result[c] = data[0];
+    mixed_buffer_finish_read(samples, &out[c]);
+  }
+  return 1;
+}
+
+define_test(space_layout, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in = {0}, out[6] = {0};
+    float location[3] = {0.0f, 0.0f, 100.0f}, result[6];
+    uint32_t layout = MIXED_SPACE_SURROUND_5_1;
+    pass(mixed_make_buffer(16, &in));
+    for(int c=0; c<6; ++c)
+      pass(mixed_make_buffer(16, &out[c]));
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_LAYOUT, &layout, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    for(int c=0; c<5; ++c)
+      pass(mixed_segment_set_out(MIXED_BUFFER, c, &out[c], &segment));
+    fail(mixed_segment_start(&segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_SUBWOOFER, &out[5], &segment));
+    pass(mixed_segment_start(&segment));
+    // A source ahead plays from the center speaker alone
+    pass(space_mix_channels(&segment, &in, out, 6, result));
+    if(result[MIXED_CENTER] <= 0.0f) fail_test("The center is silent");
+    for(int c=0; c<6; ++c)
+      if(c != MIXED_CENTER) is_f(result[c], 0.0f);
+    pass(mixed_segment_end(&segment));
+    // A source to the left encodes into W and Y alone
+    layout = MIXED_SPACE_AMBISONICS_FIRST_ORDER;
+    pass(mixed_segment_set(MIXED_SPACE_LAYOUT, &layout, &segment));
+    location[0] = 100.0f;
+    location[2] = 0.0f;
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 0, location, &segment));
+    pass(mixed_segment_start(&segment));
+    pass(space_mix_channels(&segment, &in, out, 4, result));
+    if(result[0] <= 0.0f) fail_test("W is silent");
+    is_f(result[1], result[0]);
+    is_f(result[2], 0.0f);
+    is_f(result[3], 0.0f);
+
+  cleanup:
+    mixed_free_segment(&segment);
+    mixed_free_buffer(&in);
+    for(int c=0; c<6; ++c)
+      mixed_free_buffer(&out[c]);
+  })
+
+define_test(space_virtual, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0};
+    float far[3] = {0.0f, 0.0f, 10000.0f}, threshold = 0.1f;
+    float *data;
+    uint8_t virtual = 0;
+    uint32_t samples = UINT32_MAX;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(16, &in[i]));
+      pass(mixed_make_buffer(16, &out[i]));
+    }
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_SPACE_CULL_THRESHOLD, &threshold, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in[0], &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &in[1], &segment));
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 1, far, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    pass(mixed_buffer_request_write(&data, &samples, &in[0]));
+    pass(mixed_buffer_finish_write(16, &in[0]));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_write(&data, &samples, &in[1]));
+    pass(mixed_buffer_finish_write(4, &in[1]));
+    pass(mixed_segment_mix(&segment));
+    // The far source neither holds up the mix nor falls behind
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 1, &virtual, &segment));
+    is(virtual, 1);
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 0, &virtual, &segment));
+    is(virtual, 0);
+    is(mixed_buffer_available_read(&out[0]), 16);
+    is(mixed_buffer_available_read(&in[0]), 0);
+    is(mixed_buffer_available_read(&in[1]), 0);
+    far[2] = 0.0f;
+    pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, 1, far, &segment));
+    pass(mixed_segment_mix(&segment));
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 1, &virtual, &segment));
+    is(virtual, 0);
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+static int fill_ones(struct mixed_buffer *buffer, uint32_t samples){
+  float *data;
+  uint32_t size = UINT32_MAX;
+  if(!mixed_buffer_request_write(&data, &size, buffer) || size < samples) return 0;
+  for(uint32_t i=0; i<samples; ++i) data[i] = 1.0f;
+  return mixed_buffer_finish_write(samples, buffer);
+}
+
+define_test(basic_voices, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[3] = {0}, out = {0};
+    float priorities[3] = {1.0f, 0.0f, 2.0f};
+    uint32_t voices = 2;
+    float *data;
+    uint32_t samples;
+    for(int i=0; i<3; ++i)
+      pass(mixed_make_buffer(16, &in[i]));
+    pass(mixed_make_buffer(16, &out));
+    pass(mixed_make_segment_basic_mixer(1, &segment));
+    pass(mixed_segment_set(MIXED_MAX_VOICES, &voices, &segment));
+    for(int i=0; i<3; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &segment));
+      pass(mixed_segment_set_in(MIXED_PRIORITY, i, &priorities[i], &segment));
+    }
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &segment));
+    pass(mixed_segment_start(&segment));
+    // The voice of the lowest priority fades out, then stays out but
+    // keeps consuming its input
+    for(int r=0; r<2; ++r){
+      for(int i=0; i<3; ++i)
+        pass(fill_ones(&in[i], 8));
+      pass(mixed_segment_mix(&segment));
+      is(mixed_buffer_available_read(&in[1]), 0);
+      samples = UINT32_MAX;
+      pass(mixed_buffer_request_read(&data, &samples, &out));
+      is(samples, 8);
+      if(r == 0){
+        is_f(data[0], 3.0f);
+        if(data[7] >= 3.0f) fail_test("The stolen voice did not fade");
+      }else{
+        for(uint32_t i=0; i<8; ++i) is_f(data[i], 2.0f);
+      }
+      pass(mixed_buffer_finish_read(samples, &out));
+    }
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<3; ++i)
+      mixed_free_buffer(&in[i]);
+    mixed_free_buffer(&out);
+  })
+
+define_test(space_voices, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[3] = {0}, out[2] = {0};
+    float near[3] = {0.0f, 0.0f, 20.0f}, far[3] = {0.0f, 0.0f, 500.0f};
+    float priority = 1.0f;
+    uint32_t voices = 2;
+    uint8_t virtual = 0;
+    for(int i=0; i<3; ++i)
+      pass(mixed_make_buffer(16, &in[i]));
+    for(int i=0; i<2; ++i)
+      pass(mixed_make_buffer(16, &out[i]));
+    pass(mixed_make_segment_space_mixer(44100, &segment));
+    pass(mixed_segment_set(MIXED_MAX_VOICES, &voices, &segment));
+    for(int i=0; i<3; ++i){
+      pass(mixed_segment_set_in(MIXED_BUFFER, i, &in[i], &segment));
+      pass(mixed_segment_set_in(MIXED_SPACE_LOCATION, i, (i == 0)? far : near, &segment));
+    }
+    // The far source outranks a near one by its priority
+    pass(mixed_segment_set_in(MIXED_PRIORITY, 0, &priority, &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &out[1], &segment));
+    pass(mixed_segment_start(&segment));
+    for(int r=0; r<2; ++r){
+      for(int i=0; i<3; ++i)
+        pass(fill_ones(&in[i], 8));
+      pass(mixed_segment_mix(&segment));
+      mixed_buffer_clear(&out[0]);
+      mixed_buffer_clear(&out[1]);
+    }
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 0, &virtual, &segment));
+    is(virtual, 0);
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 1, &virtual, &segment));
+    is(virtual, 0);
+    pass(mixed_segment_get_in(MIXED_SPACE_VIRTUAL, 2, &virtual, &segment));
+    is(virtual, 1);
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<3; ++i)
+      mixed_free_buffer(&in[i]);
+    for(int i=0; i<2; ++i)
+      mixed_free_buffer(&out[i]);
+  })
+
+define_test(bus_sends, {
+    struct mixed_segment segment = {0};
+    struct mixed_buffer in[2] = {0}, out[2] = {0};
+    struct mixed_bus_send send = {0};
+    uint32_t samples = UINT32_MAX;
+    float *data = 0;
+    for(int i=0; i<2; ++i){
+      pass(mixed_make_buffer(16, &in[i]));
+      pass(mixed_make_buffer(16, &out[i]));
+    }
+    pass(mixed_make_segment_bus(2, &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in[0], &segment));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 1, &in[1], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out[0], &segment));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 1, &out[1], &segment));
+    // Inputs start out on the first bus only
+    send.bus = 1;
+    pass(mixed_segment_get_in(MIXED_BUS_SEND, 0, &send, &segment));
+    is_f(send.gain, 0.0f);
+    send.bus = 2;
+    fail(mixed_segment_set_in(MIXED_BUS_SEND, 0, &send, &segment));
+    send = (struct mixed_bus_send){1, 0.5f};
+    pass(mixed_segment_set_in(MIXED_BUS_SEND, 1, &send, &segment));
+    send = (struct mixed_bus_send){0, 0.0f};
+    pass(mixed_segment_set_in(MIXED_BUS_SEND, 1, &send, &segment));
+    pass(mixed_segment_start(&segment));
+    // The first block ramps the sends, the second holds them
+    for(int r=0; r<2; ++r){
+      for(int i=0; i<2; ++i)
+        pass(fill_ones(&in[i], 8));
+      pass(mixed_segment_mix(&segment));
+      if(r == 0){
+        mixed_buffer_clear(&out[0]);
+        mixed_buffer_clear(&out[1]);
+      }
+    }
+    pass(mixed_buffer_request_read(&data, &samples, &out[0]));
+    is(samples, 8);
+    for(uint32_t i=0; i<8; ++i)
+      is_f(data[i], 1.0f);
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out[1]));
+    is(samples, 8);
+    for(uint32_t i=0; i<8; ++i)
+      is_f(data[i], 0.5f);
+
+  cleanup:
+    mixed_free_segment(&segment);
+    for(int i=0; i<2; ++i){
+      mixed_free_buffer(&in[i]);
+      mixed_free_buffer(&out[i]);
+    }
+  })
+
+#undef __TEST_SUITE
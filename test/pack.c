@@ -1,6 +1,7 @@
 #define __TEST_SUITE pack
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
 #include "tester.h"
 
 define_test(make, {
@@ -70,3 +71,155 @@ define_test(randomized, {
   cleanup:
     mixed_free_pack(&pack);
   });
+
+struct counting_stream{
+  uint32_t next;
+  uint32_t limit;
+  int *log;
+  int id;
+};
+
+static int counting_decoder(void *area, uint32_t *size, void *user){
+  struct counting_stream *stream = (struct counting_stream *)user;
+  uint32_t count = *size / sizeof(float);
+  if(stream->limit - stream->next < count)
+    count = stream->limit - stream->next;
+  for(uint32_t i=0; i<count; ++i)
+    ((float *)area)[i] = stream->next++;
+  *size = count*sizeof(float);
+  if(stream->log){
+    int *log = stream->log;
+    while(*log) log++;
+    *log = stream->id;
+  }
+  return stream->next < stream->limit;
+}
+
+static int drain_counting(uint32_t *expected, struct mixed_pack *pack){
+  float *data;
+  uint32_t size = UINT32_MAX;
+  if(!mixed_pack_request_read((void **)&data, &size, pack)) return 1;
+  for(uint32_t i=0; i<size/sizeof(float); ++i){
+    if(data[i] != (float)(*expected)++) return 0;
+  }
+  return mixed_pack_finish_read(size, pack);
+}
+
+define_test(streamer, {
+    struct mixed_streamer streamer = {0}, threaded = {0};
+    struct mixed_pack a = {0}, b = {0}, shared = {0};
+    int log[8] = {0};
+    struct counting_stream sa = {0, 3000, log, 1}, sb = {0, 3000, log, 2}, ss = {0, 20000, 0, 0};
+    uint32_t expected = 0;
+    a.encoding = b.encoding = shared.encoding = MIXED_FLOAT;
+    a.channels = b.channels = shared.channels = 1;
+    a.samplerate = b.samplerate = shared.samplerate = 44100;
+    pass(mixed_make_pack(1024, &a));
+    pass(mixed_make_pack(1024, &b));
+    pass(mixed_make_pack_shared(1024, &shared));
+    pass(mixed_make_streamer(0, &streamer));
+    fail(mixed_streamer_add(&a, 2048, 0, counting_decoder, &sa, &streamer));
+    pass(mixed_streamer_add(&a, 512, 0, counting_decoder, &sa, &streamer));
+    pass(mixed_streamer_add(&b, 512, 5, counting_decoder, &sb, &streamer));
+    // The higher priority pack is filled first
+    pass(mixed_streamer_update(&streamer));
+    is(log[0], 2);
+    is(log[1], 1);
+    is(mixed_pack_available_read(&a), 1024*sizeof(float));
+    pass(drain_counting(&expected, &a));
+    // Packs above their watermark are left alone
+    log[0] = log[1] = 0;
+    pass(mixed_streamer_update(&streamer));
+    is(log[0], 1);
+    is(log[1], 0);
+    pass(drain_counting(&expected, &a));
+    pass(mixed_streamer_update(&streamer));
+    pass(drain_counting(&expected, &a));
+    is(expected, 3000);
+    is(mixed_streamer_done(&a, &streamer), 1);
+    is(mixed_streamer_done(&b, &streamer), 0);
+    pass(mixed_streamer_remove(&a, &streamer));
+    fail(mixed_streamer_remove(&a, &streamer));
+    // A worker keeps a shared pack going while we read from it
+    pass(mixed_make_streamer(1, &threaded));
+    fail(mixed_streamer_add(&a, 512, 0, counting_decoder, &ss, &threaded));
+    pass(mixed_streamer_add(&shared, 512, 0, counting_decoder, &ss, &threaded));
+    expected = 0;
+    for(int i=0; i<10000 && expected < ss.limit; ++i){
+      struct timespec ts = {0, 100000};
+      if(!drain_counting(&expected, &shared))
+        fail_test("Streamed data out of order at %u", expected);
+      mixed_streamer_wake(&threaded);
+      nanosleep(&ts, 0);
+    }
+    is(expected, ss.limit);
+    pass(mixed_streamer_remove(&shared, &threaded));
+
+  cleanup:
+    mixed_free_streamer(&threaded);
+    mixed_free_streamer(&streamer);
+    mixed_free_pack(&a);
+    mixed_free_pack(&b);
+    mixed_free_pack(&shared);
+  });
+
+define_test(device, {
+    struct mixed_device device = {0};
+    struct mixed_pack pack = {0}, unshared = {0};
+    void *area;
+    uint32_t size = UINT32_MAX;
+    pack.encoding = unshared.encoding = MIXED_INT16;
+    pack.channels = unshared.channels = 2;
+    pack.samplerate = unshared.samplerate = 48000;
+    pass(mixed_make_pack(1024, &unshared));
+    pass(mixed_make_pack_shared(1024, &pack));
+    fail(mixed_make_device(MIXED_DEVICE_NULL, 0, 64, 2, &unshared, &device));
+    pass(mixed_make_device(MIXED_DEVICE_NULL, 0, 64, 2, &pack, &device));
+    is(mixed_device_latency(&device), 128);
+    pass(mixed_pack_request_write(&area, &size, &pack));
+    memset(area, 0, 960*4);
+    pass(mixed_pack_finish_write(960*4, &pack));
+    pass(mixed_device_start(&device));
+    // 960 frames take 20ms to play at 48kHz.
+    for(int i=0; i<200 && mixed_pack_available_read(&pack); ++i){
+      struct timespec ts = {0, 1000000};
+      nanosleep(&ts, 0);
+    }
+    is(mixed_pack_available_read(&pack), 0);
+    pass(mixed_device_end(&device));
+    fail(mixed_device_end(&device));
+
+  cleanup:
+    mixed_free_device(&device);
+    mixed_free_pack(&pack);
+    mixed_free_pack(&unshared);
+  })
+
+define_test(stats, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer_stats stats = {0};
+    void *area;
+    uint32_t size;
+    pack.channels = 2;
+    pack.encoding = MIXED_INT16;
+    pack.samplerate = 44100;
+    pass(mixed_make_pack(16, &pack));
+    pass(mixed_pack_enable_stats(&pack));
+    size = 10*4;
+    pass(mixed_pack_request_write(&area, &size, &pack));
+    pass(mixed_pack_finish_write(size, &pack));
+    size = 12*4;
+    pass(mixed_pack_request_read(&area, &size, &pack));
+    is(size, 10*4);
+    pass(mixed_pack_finish_read(size, &pack));
+    pass(mixed_pack_stats(&stats, &pack));
+    is(stats.written, 10);
+    is(stats.read, 10);
+    is(stats.high_water, 10);
+    is(stats.low_water, 10);
+    is(stats.short_reads, 1);
+    is(stats.starved_reads, 0);
+
+  cleanup:
+    mixed_free_pack(&pack);
+  });
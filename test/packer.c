@@ -1,6 +1,10 @@
 #define __TEST_SUITE packer
 #include "tester.h"
+#include <stdbool.h>
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 static int make_pack(enum mixed_encoding encoding, int channels, struct mixed_pack *pack){
   int frames = 500;
@@ -136,6 +140,42 @@ define_test(single_channel_resample_in_out, {
     mixed_free_pack(&pack_o);
   })
 
+define_test(large_block_downsample_out, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffer = {0};
+    struct mixed_segment packer = {0};
+    // Enough frames at a high enough rate that frames times rate
+    // no longer fits into 32 bits.
+    uint32_t frames = 65536;
+    pack.encoding = MIXED_FLOAT;
+    pack.channels = 1;
+    pack.samplerate = 96000;
+    pass(mixed_make_pack(frames, &pack));
+    pass(mixed_make_buffer(2*frames, &buffer));
+    pass(mixed_make_segment_packer(&pack, 192000, &packer));
+    enum mixed_resample_type quality = MIXED_LINEAR_INTERPOLATION;
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &packer));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &buffer, &packer));
+    // Fill data
+    float *area;
+    uint32_t size = UINT32_MAX;
+    mixed_buffer_request_write(&area, &size, &buffer);
+    for(uint32_t i=0; i<size; ++i)
+      area[i] = sinf(i*0.01f);
+    mixed_buffer_finish_write(size, &buffer);
+    // Run
+    pass(mixed_segment_start(&packer));
+    pass(mixed_segment_mix(&packer));
+    // The whole buffer should go out in one go.
+    is(mixed_buffer_available_read(&buffer), 0);
+    is(frames-16 < mixed_pack_available_read(&pack)/sizeof(float), 1);
+
+  cleanup:
+    mixed_free_segment(&packer);
+    mixed_free_buffer(&buffer);
+    mixed_free_pack(&pack);
+  })
+
 define_test(dual_channel_resample_in_out, {
     struct mixed_pack pack_i = {0};
     struct mixed_pack pack_o = {0};
@@ -186,5 +226,573 @@ define_test(dual_channel_resample_in_out, {
     mixed_free_pack(&pack_i);
     mixed_free_pack(&pack_o);
   })
+
+define_test(polyphase_resample, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffer = {0};
+    struct mixed_segment unpacker = {0};
+    enum mixed_resample_type quality = MIXED_POLYPHASE;
+    float *data = 0;
+    uint32_t samples = UINT32_MAX;
+    pack.encoding = MIXED_FLOAT;
+    pack.channels = 1;
+    pack.samplerate = 48000;
+    pass(mixed_make_pack(4800, &pack));
+    pass(mixed_make_buffer(4800, &buffer));
+    pass(mixed_pack_request_write((void **)&data, &samples, &pack));
+    for(uint32_t i=0; i<4800; ++i)
+      data[i] = 0.5f*sinf(2 * M_PI * 1000 * i / 48000);
+    pass(mixed_pack_finish_write(4800*sizeof(float), &pack));
+    pass(mixed_make_segment_unpacker(&pack, 44100, &unpacker));
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &buffer, &unpacker));
+    pass(mixed_segment_start(&unpacker));
+    pass(mixed_segment_mix(&unpacker));
+    // All but the last half kernel of input comes out, in phase.
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &buffer));
+    if(samples < 4300) fail_test("Too little output");
+    for(uint32_t i=64; i<samples; ++i){
+      if(0.001f < fabsf(data[i] - 0.5f*sinf(2 * M_PI * 1000 * i / 44100)))
+        fail_test("Output does not match");
+    }
+
+  cleanup:
+    mixed_free_segment(&unpacker);
+    mixed_free_buffer(&buffer);
+    mixed_free_pack(&pack);
+  })
   
+define_test(polyphase_fraction, {
+    struct mixed_buffer in = {0}, out = {0};
+    struct mixed_segment speed = {0};
+    enum mixed_resample_type quality = MIXED_POLYPHASE;
+    // Not a ratio of small integers, and it puts the position just
+    // short of the next sample right away.
+    double factor = 1.0 - 1e-8;
+    float *data = 0;
+    uint32_t samples = UINT32_MAX;
+    pass(mixed_make_buffer(4096, &in));
+    pass(mixed_make_buffer(4096, &out));
+    pass(mixed_buffer_request_write(&data, &samples, &in));
+    for(uint32_t i=0; i<samples; ++i)
+      data[i] = 0.5f*sinf(2 * M_PI * 1000 * i / 44100);
+    pass(mixed_buffer_finish_write(samples, &in));
+    pass(mixed_make_segment_speed_change(factor, &speed));
+    pass(mixed_segment_set(MIXED_RESAMPLE_TYPE, &quality, &speed));
+    pass(mixed_segment_set_in(MIXED_BUFFER, 0, &in, &speed));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &speed));
+    pass(mixed_segment_start(&speed));
+    pass(mixed_segment_mix(&speed));
+    samples = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &samples, &out));
+    if(samples < 3900) fail_test("Too little output");
+    for(uint32_t i=64; i<samples; ++i){
+      if(0.001f < fabsf(data[i] - 0.5f*sinf(2 * M_PI * 1000 * i / 44100)))
+        fail_test("Sample %u does not match", i);
+    }
+
+  cleanup:
+    mixed_free_segment(&speed);
+    mixed_free_buffer(&in);
+    mixed_free_buffer(&out);
+  })
+
+#define RENDER_FRAMES 4096
+static float render_source[RENDER_FRAMES];
+
+struct render_copy{
+  struct mixed_segment chain;
+  struct mixed_segment unpacker, filter, packer;
+  struct mixed_pack in, out;
+  struct mixed_buffer a, b;
+};
+
+static void free_render_copy(struct mixed_segment *segment, void *user){
+  struct render_copy *copy = (struct render_copy *)segment;
+  mixed_free_segment(&copy->chain);
+  mixed_free_segment(&copy->unpacker);
+  mixed_free_segment(&copy->filter);
+  mixed_free_segment(&copy->packer);
+  mixed_free_buffer(&copy->a);
+  mixed_free_buffer(&copy->b);
+  mixed_free_pack(&copy->in);
+  mixed_free_pack(&copy->out);
+  free(copy);
+}
+
+// Unpacks the source from the given frame, low-passes it, and packs it.
+static int make_render_copy(uint64_t frame, struct mixed_segment **segment, struct mixed_pack **pack, void *user){
+  struct render_copy *copy = calloc(1, sizeof(struct render_copy));
+  uint32_t size = UINT32_MAX;
+  uint32_t remaining = (frame < RENDER_FRAMES)? RENDER_FRAMES - frame : 0;
+  float *data = 0;
+  if(!copy) return 0;
+  copy->in.encoding = copy->out.encoding = MIXED_FLOAT;
+  copy->in.channels = copy->out.channels = 1;
+  copy->in.samplerate = copy->out.samplerate = 48000;
+  if(!mixed_make_pack(remaining+1, &copy->in)
+     || !mixed_make_pack(512, &copy->out)
+     || !mixed_make_buffer(512, &copy->a)
+     || !mixed_make_buffer(512, &copy->b)
+     || !mixed_make_segment_unpacker(&copy->in, 48000, &copy->unpacker)
+     || !mixed_make_segment_biquad_filter(MIXED_LOWPASS, 1000, 48000, &copy->filter)
+     || !mixed_make_segment_packer(&copy->out, 48000, &copy->packer)
+     || !mixed_make_segment_chain(&copy->chain)){
+    free_render_copy(&copy->chain, user);
+    return 0;
+  }
+  mixed_pack_request_write((void **)&data, &size, &copy->in);
+  memcpy(data, render_source + RENDER_FRAMES - remaining, remaining*sizeof(float));
+  mixed_pack_finish_write(remaining*sizeof(float), &copy->in);
+  mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &copy->a, &copy->unpacker);
+  mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &copy->a, &copy->filter);
+  mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &copy->b, &copy->filter);
+  mixed_segment_set_in(MIXED_BUFFER, MIXED_MONO, &copy->b, &copy->packer);
+  mixed_chain_add(&copy->unpacker, &copy->chain);
+  mixed_chain_add(&copy->filter, &copy->chain);
+  mixed_chain_add(&copy->packer, &copy->chain);
+  *segment = &copy->chain;
+  *pack = &copy->out;
+  return 1;
+}
+
+define_test(render, {
+    struct mixed_render_pipeline pipeline = {make_render_copy, free_render_copy, 0};
+    struct mixed_segment *segment = 0;
+    struct mixed_pack *pack = 0;
+    float *serial = calloc(RENDER_FRAMES, sizeof(float));
+    float *parallel = calloc(RENDER_FRAMES, sizeof(float));
+    uint64_t frames = RENDER_FRAMES;
+    for(uint32_t i=0; i<RENDER_FRAMES; ++i)
+      render_source[i] = 0.4f*sinf(i*0.05f) + 0.2f*sinf(i*0.7f);
+    pass(make_render_copy(0, &segment, &pack, 0));
+    pass(mixed_render(&frames, serial, pack, segment));
+    free_render_copy(segment, 0);
+    is(frames, RENDER_FRAMES);
+    // Chunks rendered with a settled lead-in match the serial render
+    pass(mixed_render_parallel(&frames, 1000, 512, 4, parallel, &pipeline));
+    is(frames, RENDER_FRAMES);
+    for(uint32_t i=0; i<RENDER_FRAMES; ++i){
+      if(0.00001f < fabsf(serial[i] - parallel[i]))
+        fail_test("Chunked render differs at frame %u", i);
+    }
+    // Asking for more than there is stops at the end of the source
+    frames = RENDER_FRAMES + 1000;
+    free(parallel);
+    parallel = calloc(RENDER_FRAMES + 1000, sizeof(float));
+    pass(mixed_render_parallel(&frames, 1000, 512, 4, parallel, &pipeline));
+    is(frames, RENDER_FRAMES);
+
+  cleanup:
+    free(serial);
+    free(parallel);
+  })
+
+static int make_constant_pack(float value, struct mixed_pack *pack){
+  float *data;
+  uint32_t size = UINT32_MAX;
+  pack->encoding = MIXED_FLOAT;
+  pack->channels = 1;
+  pack->samplerate = 44100;
+  if(!mixed_make_pack(512, pack)) return 0;
+  mixed_pack_request_write((void **)&data, &size, pack);
+  for(uint32_t i=0; i<size/sizeof(float); ++i)
+    data[i] = value;
+  return mixed_pack_finish_write(size, pack);
+}
+
+define_test(voice_pool, {
+    struct mixed_voice_pool pool = {0};
+    struct mixed_pack a = {0}, b = {0};
+    struct mixed_segment queue = {0};
+    struct mixed_segment *first = 0, *second = 0, *third = 0;
+    struct mixed_buffer out = {0};
+    uint32_t zero = 0, one = 1, size = UINT32_MAX;
+    float volume = 0.5f, *data;
+    pass(make_constant_pack(0.25f, &a));
+    pass(make_constant_pack(0.5f, &b));
+    pass(mixed_make_buffer(512, &out));
+    pass(mixed_make_segment_queue(&queue));
+    pass(mixed_segment_set(MIXED_IN_COUNT, &zero, &queue));
+    pass(mixed_segment_set(MIXED_OUT_COUNT, &one, &queue));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out, &queue));
+    pass(mixed_make_voice_pool(2, 1, 44100, 512, &pool));
+    is(pool.count, 2);
+    pass(mixed_voice_pool_take(&a, &first, &pool));
+    pass(mixed_voice_pool_take(&a, &second, &pool));
+    if(first == second) fail_test("Took the same voice twice");
+    fail(mixed_voice_pool_take(&a, &third, &pool));
+    is(mixed_error(), MIXED_QUEUE_FULL);
+    // A taken voice plays its pack from a queue
+    pass(mixed_segment_set(MIXED_VOLUME, &volume, first));
+    pass(mixed_queue_add(first, &queue));
+    pass(mixed_segment_mix(&queue));
+    pass(mixed_buffer_request_read(&data, &size, &out));
+    is(size, 512);
+    is_f(data[0], 0.125f);
+    is_f(data[511], 0.125f);
+    pass(mixed_buffer_finish_read(size, &out));
+    pass(mixed_queue_remove(first, &queue));
+    pass(mixed_voice_pool_return(first, &pool));
+    fail(mixed_voice_pool_return(first, &pool));
+    // It comes back fresh for the next sound
+    pass(mixed_voice_pool_take(&b, &third, &pool));
+    is(third, first);
+    pass(mixed_segment_get(MIXED_VOLUME, &volume, third));
+    is_f(volume, 1.0f);
+    pass(mixed_queue_add(third, &queue));
+    pass(mixed_segment_mix(&queue));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &out));
+    is(size, 512);
+    is_f(data[0], 0.5f);
+    pass(mixed_buffer_finish_read(size, &out));
+    pass(mixed_queue_remove(third, &queue));
+
+  cleanup:
+    mixed_free_segment(&queue);
+    mixed_free_voice_pool(&pool);
+    mixed_free_buffer(&out);
+    mixed_free_pack(&a);
+    mixed_free_pack(&b);
+  })
+
+define_test(planar, {
+    struct mixed_pack in = {0}, out = {0};
+    struct mixed_buffer left = {0}, right = {0};
+    struct mixed_segment unpacker = {0}, packer = {0};
+    uint32_t size = UINT32_MAX;
+    float *data;
+    int16_t *plane;
+    in.encoding = MIXED_FLOAT;
+    in.channels = 2;
+    in.samplerate = 44100;
+    in.flags = MIXED_PLANAR;
+    out.encoding = MIXED_INT16;
+    out.channels = 2;
+    out.samplerate = 44100;
+    out.flags = MIXED_PLANAR;
+    pass(mixed_make_pack(256, &in));
+    pass(mixed_make_pack(256, &out));
+    // Sizes and indices are per plane
+    is(in.size, 256*sizeof(float));
+    is(out.size, 256*sizeof(int16_t));
+    pass(mixed_pack_request_write((void **)&data, &size, &in));
+    is(size, in.size);
+    for(uint32_t i=0; i<256; ++i){
+      data[i] = 0.25f;
+      data[in.size/sizeof(float)+i] = -0.5f;
+    }
+    pass(mixed_pack_finish_write(size, &in));
+    pass(mixed_make_buffer(256, &left));
+    pass(mixed_make_buffer(256, &right));
+    pass(mixed_make_segment_unpacker(&in, 44100, &unpacker));
+    pass(mixed_make_segment_packer(&out, 44100, &packer));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &unpacker));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_LEFT, &left, &packer));
+    pass(mixed_segment_set_in(MIXED_BUFFER, MIXED_RIGHT, &right, &packer));
+    pass(mixed_segment_start(&unpacker));
+    pass(mixed_segment_start(&packer));
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_pack_available_read(&in), 0);
+    is(mixed_buffer_available_read(&left), 256);
+    is_f(left._data[0], 0.25f);
+    is_f(left._data[255], 0.25f);
+    is_f(right._data[255], -0.5f);
+    pass(mixed_segment_mix(&packer));
+    is(mixed_pack_available_read(&out), out.size);
+    size = UINT32_MAX;
+    pass(mixed_pack_request_read((void **)&plane, &size, &out));
+    is(plane[0], mixed_to_int16(0.25f));
+    is(plane[255], mixed_to_int16(0.25f));
+    is(plane[256], mixed_to_int16(-0.5f));
+    is(plane[511], mixed_to_int16(-0.5f));
+
+  cleanup:
+    mixed_free_segment(&unpacker);
+    mixed_free_segment(&packer);
+    mixed_free_buffer(&left);
+    mixed_free_buffer(&right);
+    mixed_free_pack(&in);
+    mixed_free_pack(&out);
+  })
+
+static int jitter_packet(uint32_t timestamp, int16_t value, struct mixed_segment *jitter){
+  int16_t packet[64];
+  for(int i=0; i<64; ++i) packet[i] = value;
+  return mixed_jitter_insert(timestamp, packet, 64, jitter);
+}
+
+static float jitter_mix(struct mixed_buffer *out, struct mixed_segment *jitter){
+  float *data, first;
+  uint32_t size = UINT32_MAX;
+  mixed_segment_mix(jitter);
+  mixed_buffer_request_read(&data, &size, out);
+  first = data[0];
+  mixed_buffer_finish_read(size, out);
+  return first;
+}
+
+define_test(jitter, {
+    struct mixed_segment jitter = {0};
+    struct mixed_buffer out = {0};
+    struct mixed_jitter_stats stats = {0};
+    pass(mixed_make_buffer(64, &out));
+    pass(mixed_make_segment_jitter(MIXED_INT16, 1, 64, 16, &jitter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &jitter));
+    pass(mixed_segment_start(&jitter));
+    // Nothing plays before the target is buffered
+    is_f(jitter_mix(&out, &jitter), 0.0f);
+    pass(jitter_packet(1000, 8000, &jitter));
+    is_f(jitter_mix(&out, &jitter), mixed_from_int16(8000));
+    // A lost packet is concealed with the last one, faded down
+    pass(jitter_packet(1192, 12000, &jitter));
+    pass(jitter_packet(1128, 10000, &jitter));
+    is_f(jitter_mix(&out, &jitter), 0.5f*mixed_from_int16(8000));
+    // Out of order packets play in order
+    is_f(jitter_mix(&out, &jitter), mixed_from_int16(10000));
+    is_f(jitter_mix(&out, &jitter), mixed_from_int16(12000));
+    // Too late to play
+    pass(jitter_packet(1128, 10000, &jitter));
+    // Running dry rebuffers
+    jitter_mix(&out, &jitter);
+    pass(mixed_segment_get(MIXED_JITTER_STATS, &stats, &jitter));
+    is(stats.received, 4);
+    is(stats.late, 1);
+    is(stats.underruns, 1);
+    is(stats.buffered, 0);
+    if(stats.concealed < 64+64) fail_test("Too few frames concealed");
+    if(stats.latency <= 64) fail_test("Latency did not adapt to the jitter");
+
+  cleanup:
+    mixed_free_segment(&jitter);
+    mixed_free_buffer(&out);
+  })
+
+#define JITTER_PACKETS 256
+
+static void *jitter_produce(void *arg){
+  struct mixed_segment *jitter = (struct mixed_segment *)arg;
+  for(uint32_t i=0; i<JITTER_PACKETS; ++i){
+    // Wait for the mix to hand slots back.
+    while(!jitter_packet(1000+i*64, 8000, jitter)){
+      if(mixed_error() != MIXED_QUEUE_FULL) return 0;
+      sched_yield();
+    }
+  }
+  return arg;
+}
+
+define_test(jitter_thread, {
+    struct mixed_segment jitter = {0};
+    struct mixed_buffer out = {0};
+    struct mixed_jitter_stats stats = {0};
+    pthread_t thread = 0;
+    void *status = 0;
+    pass(mixed_make_buffer(64, &out));
+    pass(mixed_make_segment_jitter(MIXED_INT16, 1, 64, 8, &jitter));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_MONO, &out, &jitter));
+    pass(mixed_segment_start(&jitter));
+    // Packets are decoded on another thread while we mix
+    if(pthread_create(&thread, 0, jitter_produce, &jitter) != 0)
+      fail_test("Failed to spawn thread.");
+    for(uint32_t i=0; i<1000000 && stats.received < JITTER_PACKETS; ++i){
+      jitter_mix(&out, &jitter);
+      pass(mixed_segment_get(MIXED_JITTER_STATS, &stats, &jitter));
+    }
+    pthread_join(thread, &status);
+    thread = 0;
+    is(status, &jitter);
+    is(stats.received, JITTER_PACKETS);
+
+  cleanup:
+    if(thread) pthread_cancel(thread);
+    mixed_free_segment(&jitter);
+    mixed_free_buffer(&out);
+  })
+
+static void put_u32(unsigned char *data, uint32_t value){
+  for(int i=0; i<4; ++i) data[i] = (value >> (8*i)) & 0xFF;
+}
+
+define_test(mapped_pack, {
+    // A stereo int16 WAVE file of 256 frames
+    unsigned char wav[44+256*4] = {0};
+    struct mixed_pack file = {0}, external = {0};
+    struct mixed_segment unpacker = {0};
+    struct mixed_buffer left = {0}, right = {0};
+    const char *path = "mixed-test-mapped.wav";
+    uint32_t size = UINT32_MAX;
+    float *data;
+    FILE *out = 0;
+    memcpy(wav, "RIFF", 4); put_u32(wav+4, sizeof(wav)-8);
+    memcpy(wav+8, "WAVEfmt ", 8); put_u32(wav+16, 16);
+    wav[20] = 1; wav[22] = 2;
+    put_u32(wav+24, 44100); put_u32(wav+28, 44100*4);
+    wav[32] = 4; wav[34] = 16;
+    memcpy(wav+36, "data", 4); put_u32(wav+40, 256*4);
+    for(int i=0; i<256; ++i){
+      int16_t frame[2] = {16384, -8192};
+      memcpy(wav+44+i*4, frame, 4);
+    }
+    // Wrapping external memory leaves out the partial frame
+    external.encoding = MIXED_INT16;
+    external.channels = 2;
+    external.samplerate = 44100;
+    pass(mixed_make_pack_external(wav+44, 256*4+3, &external));
+    is(mixed_pack_available_read(&external), 256*4);
+    mixed_free_pack(&external);
+    is(wav[44], 0);
+    // Mapping the file picks up the format from its header
+    out = fopen(path, "wb");
+    if(!out) fail_test("Failed to write the test file");
+    fwrite(wav, 1, sizeof(wav), out);
+    fclose(out);
+#ifdef _WIN32
+    fail(mixed_make_pack_file(path, &file));
+#else
+    pass(mixed_make_pack_file(path, &file));
+    is(file.encoding, MIXED_INT16);
+    is(file.channels, 2);
+    is(file.samplerate, 44100);
+    is(mixed_pack_available_read(&file), 256*4);
+    pass(mixed_make_buffer(256, &left));
+    pass(mixed_make_buffer(256, &right));
+    pass(mixed_make_segment_unpacker(&file, 44100, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_LEFT, &left, &unpacker));
+    pass(mixed_segment_set_out(MIXED_BUFFER, MIXED_RIGHT, &right, &unpacker));
+    pass(mixed_segment_start(&unpacker));
+    pass(mixed_segment_mix(&unpacker));
+    is(mixed_pack_available_read(&file), 0);
+    pass(mixed_buffer_request_read(&data, &size, &left));
+    is(size, 256);
+    is_f(data[0], mixed_from_int16(16384));
+    is_f(data[255], mixed_from_int16(16384));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &right));
+    is_f(data[255], mixed_from_int16(-8192));
+#endif
+
+  cleanup:
+    mixed_free_segment(&unpacker);
+    mixed_free_buffer(&left);
+    mixed_free_buffer(&right);
+    mixed_free_pack(&file);
+    remove(path);
+  })
+
+define_test(sample_bank, {
+    struct mixed_sample_bank bank = {0}, small = {0};
+    struct mixed_pack ramp = {0}, constant = {0};
+    struct mixed_segment a = {0}, b = {0}, c = {0};
+    struct mixed_buffer out_a = {0}, out_b = {0}, copy = {0};
+    uint32_t size = UINT32_MAX, position = 0;
+    bool loop = true;
+    float *data, *other;
+    ramp.encoding = MIXED_FLOAT;
+    ramp.channels = 1;
+    ramp.samplerate = 44100;
+    pass(mixed_make_pack(512, &ramp));
+    pass(mixed_pack_request_write((void **)&data, &size, &ramp));
+    for(uint32_t i=0; i<512; ++i) data[i] = i/512.0f;
+    pass(mixed_pack_finish_write(512*sizeof(float), &ramp));
+    pass(mixed_make_sample_bank(44100, 0, &bank));
+    pass(mixed_sample_bank_add(1, &ramp, &bank));
+    is(mixed_pack_available_read(&ramp), 0);
+    is(mixed_sample_bank_frames(1, &bank), 512);
+    is(bank.size, 512*sizeof(float));
+    fail(mixed_make_segment_sample(2, &bank, &a));
+    // Two voices read the same storage through their own cursors
+    pass(mixed_make_segment_sample(1, &bank, &a));
+    pass(mixed_make_segment_sample(1, &bank, &b));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out_a, &a));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &out_b, &b));
+    pass(mixed_segment_start(&a));
+    pass(mixed_segment_start(&b));
+    pass(mixed_segment_mix(&a));
+    pass(mixed_segment_mix(&b));
+    size = 200;
+    pass(mixed_buffer_request_read(&data, &size, &out_a));
+    size = 200;
+    pass(mixed_buffer_request_read(&other, &size, &out_b));
+    if(data != other) fail_test("Voices do not share the sample");
+    is_f(data[100], 100/512.0f);
+    pass(mixed_buffer_finish_read(200, &out_a));
+    pass(mixed_segment_mix(&a));
+    pass(mixed_segment_get(MIXED_SAMPLE_POSITION, &position, &a));
+    is(position, 200);
+    pass(mixed_segment_get(MIXED_SAMPLE_POSITION, &position, &b));
+    is(position, 0);
+    // Played through, a voice turns silent, unless it loops
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &out_a));
+    is(size, 312);
+    is_f(data[0], 200/512.0f);
+    pass(mixed_buffer_finish_read(size, &out_a));
+    pass(mixed_segment_mix(&a));
+    pass(mixed_segment_get(MIXED_SAMPLE_POSITION, &position, &a));
+    is(position, 512);
+    pass(mixed_buffer_is_silent(&out_a));
+    pass(mixed_segment_set(MIXED_SAMPLE_LOOP, &loop, &a));
+    pass(mixed_segment_mix(&a));
+    fail(mixed_buffer_is_silent(&out_a));
+    size = 1;
+    pass(mixed_buffer_request_read(&data, &size, &out_a));
+    is_f(data[0], 0.0f);
+    // Removing a sample keeps it alive for the voices playing it
+    pass(mixed_sample_bank_remove(1, &bank));
+    is(bank.count, 0);
+    is_f(other[511], 511/512.0f);
+    // Allocated outputs get a copy
+    pass(make_constant_pack(0.5f, &constant));
+    pass(mixed_sample_bank_add(2, &constant, &bank));
+    pass(mixed_make_buffer(100, &copy));
+    pass(mixed_make_segment_sample(2, &bank, &c));
+    pass(mixed_segment_set_out(MIXED_BUFFER, 0, &copy, &c));
+    pass(mixed_segment_start(&c));
+    pass(mixed_segment_mix(&c));
+    size = UINT32_MAX;
+    pass(mixed_buffer_request_read(&data, &size, &copy));
+    is(size, 100);
+    is_f(data[99], 0.5f);
+    // Over budget, only samples nobody plays are evicted
+    pass(mixed_make_sample_bank(44100, 512*sizeof(float), &small));
+    mixed_free_pack(&constant);
+    pass(make_constant_pack(0.5f, &constant));
+    pass(mixed_sample_bank_add(3, &constant, &small));
+    mixed_segment_end(&c);
+    mixed_free_segment(&c);
+    pass(mixed_make_segment_sample(3, &small, &c));
+    mixed_free_pack(&ramp);
+    pass(make_constant_pack(0.25f, &ramp));
+    fail(mixed_sample_bank_add(4, &ramp, &small));
+    is(mixed_error(), MIXED_OUT_OF_MEMORY);
+    mixed_free_segment(&c);
+    mixed_free_pack(&ramp);
+    pass(make_constant_pack(0.25f, &ramp));
+    pass(mixed_sample_bank_add(4, &ramp, &small));
+    is(mixed_sample_bank_frames(3, &small), 0);
+    is(mixed_sample_bank_frames(4, &small), 512);
+    // Packs at another rate are resampled once, on the way in
+    mixed_free_pack(&ramp);
+    pass(make_constant_pack(0.25f, &ramp));
+    ramp.samplerate = 48000;
+    pass(mixed_sample_bank_add(5, &ramp, &bank));
+    if(abs((int)mixed_sample_bank_frames(5, &bank) - 470) > 1) fail_test("Sample was not resampled");
+
+  cleanup:
+    mixed_free_segment(&a);
+    mixed_free_segment(&b);
+    mixed_free_segment(&c);
+    mixed_free_sample_bank(&bank);
+    mixed_free_sample_bank(&small);
+    mixed_free_buffer(&out_a);
+    mixed_free_buffer(&out_b);
+    mixed_free_buffer(&copy);
+    mixed_free_pack(&ramp);
+    mixed_free_pack(&constant);
+  })
+
 #undef __TEST_SUITE
@@ -1,4 +1,5 @@
 #define __TEST_SUITE transfer
+#include <string.h>
 #include "tester.h"
 
 static int make_pack(enum mixed_encoding encoding, int channels, struct mixed_pack *pack){
@@ -118,4 +119,233 @@ define_test(bounds_check, {
   cleanup: {}
   })
 
+static float decode_sample(enum mixed_encoding encoding, unsigned char *data, uint32_t i){
+  switch(encoding){
+  case MIXED_INT16: return mixed_from_int16(((int16_t *)data)[i]);
+  case MIXED_INT24: return mixed_from_int24((((int8_t *)data)[3*i+2] << 16)
+                                            + (data[3*i+1] << 8) + data[3*i]);
+  case MIXED_INT32: return mixed_from_int32(((int32_t *)data)[i]);
+  case MIXED_FLOAT: return mixed_from_float(((float *)data)[i]);
+  default: return 0.0f;
+  }
+}
+
+static int check_kernels(enum mixed_encoding encoding, channel_t channels){
+  struct mixed_pack pack = {0};
+  struct mixed_buffer buffers[8] = {0};
+  struct mixed_buffer *barray[8];
+  uint32_t frames = 37;
+  float volume = 0.0f;
+  int result = 0;
+  pack.encoding = encoding;
+  pack.channels = channels;
+  pack.samplerate = 1;
+  if(!mixed_make_pack(frames, &pack)) goto cleanup;
+  for(channel_t c=0; c<channels; ++c){
+    barray[c] = &buffers[c];
+    if(!mixed_make_buffer(frames, &buffers[c])) goto cleanup;
+  }
+  unsigned char *data;
+  uint32_t size = UINT32_MAX;
+  mixed_pack_request_write((void**)&data, &size, &pack);
+  // Keep floats finite so that the comparison below is meaningful
+  for(uint32_t i=0; i<size; ++i)
+    data[i] = rand()%128;
+  mixed_pack_finish_write(size, &pack);
+  // Fade in over the block, which every kernel has to match exactly
+  if(!mixed_buffer_from_pack(&pack, barray, &volume, 1.0f)) goto cleanup;
+  if(volume != 1.0f) goto cleanup;
+  for(uint32_t i=0; i<frames*channels; ++i){
+    float gain = 0.0f + (1.0f / frames)*(i/channels+1);
+    if(buffers[i%channels]._data[i/channels] != decode_sample(encoding, data, i)*gain) goto cleanup;
+  }
+  // Round trip at unity
+  float expected[8*37];
+  for(uint32_t i=0; i<frames*channels; ++i)
+    expected[i] = buffers[i%channels]._data[i/channels];
+  if(!mixed_buffer_to_pack(barray, &pack, &volume, 1.0f)) goto cleanup;
+  for(uint32_t i=0; i<frames*channels; ++i){
+    switch(encoding){
+    case MIXED_INT16: if(((int16_t *)data)[i] != mixed_to_int16(expected[i])) goto cleanup; break;
+    case MIXED_INT32: if(((int32_t *)data)[i] != mixed_to_int32(expected[i])) goto cleanup; break;
+    case MIXED_FLOAT: if(((float *)data)[i] != mixed_to_float(expected[i])) goto cleanup; break;
+    case MIXED_INT24: {
+      int32_t sample = mixed_to_int24(expected[i]);
+      if(data[3*i] != (sample & 0xFF) || data[3*i+1] != ((sample >> 8) & 0xFF)
+         || data[3*i+2] != ((sample >> 16) & 0xFF)) goto cleanup;
+    } break;
+    default: break;
+    }
+  }
+  result = 1;
+
+ cleanup:
+  for(channel_t c=0; c<8; ++c)
+    mixed_free_buffer(&buffers[c]);
+  mixed_free_pack(&pack);
+  return result;
+}
+
+define_test(kernels, {
+    enum mixed_encoding encodings[] = {MIXED_INT16, MIXED_INT24, MIXED_INT32, MIXED_FLOAT};
+    for(int e=0; e<4; ++e){
+      // Mono, the stereo kernels, and the transposing ones up to 7.1
+      for(channel_t c=1; c<=8; ++c){
+        pass(check_kernels(encodings[e], c));
+      }
+    }
+  cleanup: {}
+  })
+
+define_test(dispatch, {
+    // Every narrower kernel set has to match the scalar code as well
+    uint32_t detected = mixed_cpu_features();
+    uint32_t sets[] = {0, MIXED_CPU_SSE2, MIXED_CPU_SSE2 | MIXED_CPU_AVX2, MIXED_CPU_NEON, UINT32_MAX};
+    enum mixed_encoding encodings[] = {MIXED_INT16, MIXED_INT24, MIXED_INT32, MIXED_FLOAT};
+    for(int s=0; s<5; ++s){
+      is(mixed_cpu_set_features(sets[s]), detected & sets[s]);
+      for(int e=0; e<4; ++e){
+        for(channel_t c=1; c<=8; ++c){
+          pass(check_kernels(encodings[e], c));
+        }
+      }
+    }
+  cleanup:
+    mixed_cpu_set_features(UINT32_MAX);
+  })
+
+define_test(fast_conversion, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffers[6] = {0};
+    struct mixed_buffer *barray[6];
+    float volume = 1.0f;
+    int16_t *data;
+    uint32_t size = UINT32_MAX;
+    // Cover the scalar, the stereo, and the transposing kernels
+    for(channel_t channels=1; channels<=6; channels+=(channels==2)? 4 : 1){
+      pack.encoding = MIXED_INT16;
+      pack.channels = channels;
+      pack.samplerate = 1;
+      pack.flags = MIXED_FAST_CONVERSION;
+      pass(mixed_make_pack(37, &pack));
+      for(channel_t c=0; c<channels; ++c){
+        barray[c] = &buffers[c];
+        pass(mixed_make_buffer(37, &buffers[c]));
+      }
+      size = UINT32_MAX;
+      mixed_pack_request_write((void**)&data, &size, &pack);
+      for(uint32_t i=0; i<size/2; ++i)
+        data[i] = (i == 0)? INT16_MIN : rand()%0x10000 - 0x8000;
+      mixed_pack_finish_write(size, &pack);
+      pass(mixed_buffer_from_pack(&pack, barray, &volume, 1.0f));
+      for(uint32_t i=0; i<37*channels; ++i)
+        is_f(buffers[i%channels]._data[i/channels], data[i] / 32768.0f);
+      is_f(buffers[0]._data[0], -1.0f);
+      // The fast decoder is the exact inverse of the encoder
+      int16_t expected[6*37];
+      memcpy(expected, data, sizeof(int16_t)*37*channels);
+      pass(mixed_buffer_to_pack(barray, &pack, &volume, 1.0f));
+      for(uint32_t i=0; i<37*channels; ++i)
+        is(data[i], expected[i]);
+      for(channel_t c=0; c<channels; ++c)
+        mixed_free_buffer(&buffers[c]);
+      mixed_free_pack(&pack);
+    }
+
+  cleanup:
+    for(channel_t c=0; c<6; ++c)
+      mixed_free_buffer(&buffers[c]);
+    mixed_free_pack(&pack);
+  })
+
+define_test(dither, {
+    struct mixed_pack pack = {0};
+    struct mixed_buffer buffer = {0};
+    struct mixed_buffer *barray[1] = {&buffer};
+    float volume = 1.0f, *samples;
+    int16_t *data;
+    uint32_t size = 1024;
+    double sum = 0.0;
+    pack.encoding = MIXED_INT16;
+    pack.channels = 1;
+    pack.samplerate = 1;
+    pack.flags = MIXED_DITHER;
+    pass(mixed_make_pack(1024, &pack));
+    pass(mixed_make_buffer(1024, &buffer));
+    // A third of a step would always truncate to zero without dither
+    mixed_buffer_request_write(&samples, &size, &buffer);
+    for(uint32_t i=0; i<size; ++i)
+      samples[i] = (i == 0)? 1.0f : (i == 1)? -1.0f : (i == 2)? NAN : (1.0f/3)/0x8000;
+    mixed_buffer_finish_write(size, &buffer);
+    pass(mixed_buffer_to_pack(barray, &pack, &volume, 1.0f));
+    data = (int16_t *)pack._data;
+    is(data[0], INT16_MAX);
+    is(data[1], INT16_MIN);
+    is(data[2], INT16_MIN);
+    for(uint32_t i=3; i<1024; ++i){
+      if(data[i] < -1 || 1 < data[i]) fail_test("Dither is more than one step");
+      sum += data[i];
+    }
+    sum /= 1021;
+    if(sum < 0.2 || 0.45 < sum) fail_test("Dither is biased");
+
+  cleanup:
+    mixed_free_buffer(&buffer);
+    mixed_free_pack(&pack);
+  })
+
+define_test(pack_convert, {
+    struct mixed_pack a = {0}, b = {0}, c = {0}, d = {0};
+    channel_t map[3] = {1, 0, 5};
+    uint32_t size = UINT32_MAX;
+    int16_t *in;
+    uint8_t *planes;
+    a.encoding = MIXED_INT16; a.channels = 2; a.samplerate = 48000;
+    b.encoding = MIXED_INT24; b.channels = 2; b.samplerate = 48000; b.flags = MIXED_PLANAR;
+    c.encoding = MIXED_INT16; c.channels = 3; c.samplerate = 48000;
+    d.encoding = MIXED_FLOAT; d.channels = 3; d.samplerate = 44100;
+    pass(mixed_make_pack(100, &a));
+    pass(mixed_make_pack(100, &b));
+    pass(mixed_make_pack(100, &c));
+    pass(mixed_make_pack(100, &d));
+    pass(mixed_pack_request_write((void **)&in, &size, &a));
+    for(uint32_t i=0; i<100; ++i){
+      in[2*i+0] = i*300 - 15000;
+      in[2*i+1] = -(int16_t)i;
+    }
+    pass(mixed_pack_finish_write(size, &a));
+    // Widening integers is exact
+    pass(mixed_pack_convert(&a, &b, 0));
+    is(mixed_pack_available_read(&a), 0);
+    is(mixed_pack_available_read(&b), 100*3);
+    planes = b._data;
+    for(uint32_t i=0; i<100; ++i){
+      int32_t left = planes[3*i] + planes[3*i+1]*256 + (int8_t)planes[3*i+2]*65536;
+      int32_t right = planes[300+3*i] + planes[300+3*i+1]*256 + (int8_t)planes[300+3*i+2]*65536;
+      if(left != (int32_t)(i*300 - 15000)*256 || right != -(int32_t)i*256)
+        fail_test("Widened sample %u is wrong", i);
+    }
+    // Narrowing back with a channel map, including a silent channel
+    pass(mixed_pack_convert(&b, &c, map));
+    in = (int16_t *)c._data;
+    for(uint32_t i=0; i<100; ++i){
+      if(in[3*i+0] != -(int16_t)i || in[3*i+1] != (int16_t)(i*300 - 15000) || in[3*i+2] != 0)
+        fail_test("Mapped sample %u is wrong", i);
+    }
+    // Rates must match
+    fail(mixed_pack_convert(&c, &d, 0));
+    is(mixed_error(), MIXED_BAD_RESAMPLE_FACTOR);
+    d.samplerate = 48000;
+    fail(mixed_pack_convert(&a, &d, 0));
+    pass(mixed_pack_convert(&c, &d, 0));
+    is_f(((float *)d._data)[3], mixed_from_int16(-1));
+    is_f(((float *)d._data)[4], mixed_from_int16(-14700));
+
+  cleanup:
+    mixed_free_pack(&a);
+    mixed_free_pack(&b);
+    mixed_free_pack(&c);
+    mixed_free_pack(&d);
+  })
+
 #undef __TEST_SUITE